@@ -6,7 +6,7 @@
 // ============ CLIENT STATE ============
 typedef struct {
   char username[MAX_USERNAME];
-  char nm_ip[MAX_IP];
+  char nm_ip[MAX_LOCAL_ADDR]; // IPv4 address or "unix:<path>"
   int nm_port;
   int nm_socket;
   int is_connected;
@@ -22,6 +22,7 @@ int execute_info(ClientState *state, const char *filename);
 int execute_delete(ClientState *state, const char *filename);
 int execute_stream(ClientState *state, const char *filename);
 int execute_list(ClientState *state);
+int execute_stats(ClientState *state);
 int execute_addaccess(ClientState *state, const char *filename,
                       const char *username, int read, int write);
 int execute_remaccess(ClientState *state, const char *filename,
@@ -8,12 +8,14 @@
 #include <fcntl.h>
 #include <netinet/in.h>
 #include <pthread.h>
+#include <stddef.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <sys/socket.h>
 #include <sys/stat.h>
 #include <sys/types.h>
+#include <sys/un.h>
 #include <sys/wait.h>
 #include <time.h>
 #include <unistd.h>
@@ -68,6 +70,8 @@
 #define FLAG_SHOW_HIDDEN 0x01
 #define FLAG_SHOW_DETAILS 0x02
 #define FLAG_IS_REPLICATION 0x04
+#define FLAG_KEEP_ALIVE 0x08 // Requester reuses the connection (NS pool)
+#define FLAG_BATCH_ATOMIC 0x10 // OP_SS_BATCH: all-or-nothing, not best effort
 
 // Global toggle to enable/disable colors at runtime. Define in one C file.
 extern int enable_colors;
@@ -126,9 +130,7 @@ extern int enable_colors;
   1536 // MAX_PATH + MAX_FILENAME + extra (for folder_path/filename)
 #define BUFFER_SIZE 4096
 #define MAX_STORAGE_SERVERS 10
-#define MAX_FILES 1000
-#define MAX_FOLDERS 500
-#define MAX_CLIENTS 100
+#define MAX_FILES 1000 // Files compared in one replica sync manifest
 #define MAX_SENTENCE_LOCKS 100
 #define MAX_SENTENCE_CONTENT                                                   \
   2048                         // Maximum length for sentence content snapshot
@@ -136,6 +138,38 @@ extern int enable_colors;
 #define TRIE_ALPHABET_SIZE 256 // ASCII character set for Trie
 #define HEARTBEAT_TIMEOUT 5 // Seconds before marking storage server as inactive
 #define HEARTBEAT_CHECK_INTERVAL 2 // Seconds between heartbeat checks
+#define SS_POOL_MAX_CONNS 16       // Open NS->SS connections per storage server
+#define SS_POOL_MAX_IDLE 8         // Idle connections kept per storage server
+#define SS_POOL_IDLE_TIMEOUT 60    // Seconds before an idle connection is closed
+#define SS_POOL_ACQUIRE_TIMEOUT 5  // Seconds to wait when a pool is exhausted
+#define SS_POOL_IO_TIMEOUT 10      // Seconds a pooled SS socket may stall a send or a reply
+#define NM_WORKER_THREADS 8        // Default Name Server request workers
+#define NM_MAX_WORKER_THREADS 256
+#define NM_MAX_EVENTS 64           // epoll events drained per wakeup
+#define NM_CLIENT_IO_TIMEOUT 10    // Seconds a worker may block on one client socket
+#define NM_CONN_MAX_QUEUED 32      // Requests queued per connection before it is no longer read
+#define NM_CONN_MAX_INPUT (1024 * 1024) // Unframed bytes read ahead per connection, at most
+#define NM_MAX_REQUEST_SIZE WIRE_CHUNK_SIZE // Largest request payload the Name Server accepts
+#define NM_FILE_LOCK_STRIPES 64    // Per-file metadata locks, picked by path hash
+#define NM_VIEW_MIN_BUCKETS 2048   // Initial hash chains of the lock-free file view (power of 2)
+#define NM_SLAB_ENTRIES 256        // Entries per slab of a Name Server registry table
+#define NM_REGISTRY_MIN_SLOTS 64   // Initial hash index slots of a registry table (power of 2)
+#define NM_JOURNAL_SYNC_MS 10      // Journal flusher period: batch-policy syncs, uncommitted records
+#define NM_JOURNAL_COMPACT_BYTES (4 * 1024 * 1024) // Journal size that triggers a new snapshot (at least)
+#define SS_WORKER_THREADS 32       // Default Storage Server connection workers
+#define SS_ADMISSION_QUEUE 64      // Default connections allowed to wait for a worker
+#define SS_ADMISSION_QUEUE_MAX 1024
+#define SS_QUEUE_MAX_WAIT_MS 2000  // Queued longer than this: rejected as busy
+#define SS_BUSY_RETRIES 2          // NS retries after an ERR_SS_BUSY rejection
+#define SS_BUSY_BACKOFF_MS 50      // Base delay between those retries
+#define SS_POOL_STATS_INTERVAL 60  // Seconds between SS worker pool stat lines
+#define SS_HEADER_DEADLINE_MS 5000    // A started request header must arrive within this
+#define SS_PAYLOAD_DEADLINE_MS 10000  // Base time allowed for a request payload...
+#define SS_PAYLOAD_MIN_RATE (64 * 1024) // ...plus 1 s per this many bytes
+#define SS_IDLE_DEADLINE_MS 300000    // Silence allowed between requests (e.g. a user typing in WRITE)
+#define SS_MIN_DISK_FREE (64ULL * 1024 * 1024) // Below this, no new files are placed on an SS
+#define LOG_RING_SLOTS 1024        // Log lines queued for the flusher thread (power of two)
+#define LOG_LINE_MAX 2048          // Longest message kept for one log line
 
 // ============ MESSAGE TYPES ============
 #define MSG_REQUEST 1
@@ -170,12 +204,14 @@ extern int enable_colors;
 #define OP_VIEWREQUESTS 36
 #define OP_APPROVEREQUEST 37
 #define OP_DENYREQUEST 38
+#define OP_STATS 39 // Per-opcode latency stats as JSON (NS and SS)
 
 // System operations
 #define OP_REGISTER_SS 30
 #define OP_CONNECT_CLIENT 31
 #define OP_DISCONNECT 32
 #define OP_HEARTBEAT 33
+#define OP_HELLO 34 // Wire protocol negotiation ("PROTO <n>")
 
 // Storage server operations
 #define OP_SS_CREATE 40
@@ -191,6 +227,8 @@ extern int enable_colors;
 #define OP_SS_REVERT 50
 #define OP_SS_LISTCHECKPOINTS 51
 #define OP_SS_CHECK_MTIME 52 // Check file modified time (for live updates)
+#define OP_SS_BATCH 53       // Several write-session ops in one round trip
+#define OP_SS_OPEN 54        // Open a file handle for later requests (v2 only)
 
 // Sync Operations
 #define OP_REQ_SYNC 90 // NS -> SS (Recovering)
@@ -225,6 +263,9 @@ extern int enable_colors;
 #define ERR_INVALID_FILENAME 125
 #define ERR_USERNAME_TAKEN 126
 #define ERR_SS_EXISTS 127 // Storage Server ID already in use
+#define ERR_SS_BUSY 128   // Storage Server saturated; safe to retry
+#define ERR_BATCH_ABORTED 129 // Batched op rolled back after another failed
+#define ERR_STALE_HANDLE 130  // File handle unknown on this connection; reopen
 
 // ============ MESSAGE STRUCTURE ============
 typedef struct {
@@ -239,18 +280,301 @@ typedef struct {
   int sentence_index;
   int word_index;
   int flags; // For VIEW command flags
+  // Fields below are v2-only: they are not part of the v1 wire image
+  unsigned int request_id; // Echoed in the reply; 0 = unmatched/lockstep
+  int frame_flags;         // WIRE_FRAME_* bits; 0 for an ordinary frame
+  unsigned long long total_length; // Whole payload size (see recv_message_header)
+  unsigned long long handle; // File handle from OP_SS_OPEN; 0 = use filename
 } MessageHeader;
 
+// ============ WIRE PROTOCOL ============
+// v1 sends the MessageHeader struct verbatim, up to (not including)
+// request_id. v2 sends a fixed 12-byte prefix (magic, msg_type, op_code,
+// frame flags, present bitmap, extension length, payload length) followed
+// only by the optional fields that are set.
+#define PROTOCOL_V1 1
+#define PROTOCOL_V2 2
+#define PROTOCOL_VERSION PROTOCOL_V2 // Highest version this build speaks
+
+#define WIRE_V2_MAGIC 0xD2 // Never a valid first byte of a v1 header
+#define WIRE_V2_PREFIX_SIZE 12
+#define WIRE_V2_MAX_HEADER 1024 // Prefix + every optional field, worst case
+#define WIRE_V1_HEADER_SIZE offsetof(MessageHeader, request_id)
+#define MAX_TRACKED_SOCKETS 65536
+
+// v2 present-field bitmap
+#define WIRE_F_USERNAME 0x0001
+#define WIRE_F_FILENAME 0x0002
+#define WIRE_F_FOLDERNAME 0x0004
+#define WIRE_F_CHECKPOINT_TAG 0x0008
+#define WIRE_F_ERROR_CODE 0x0010
+#define WIRE_F_SENTENCE_INDEX 0x0020
+#define WIRE_F_WORD_INDEX 0x0040
+#define WIRE_F_FLAGS 0x0080
+#define WIRE_F_REQUEST_ID 0x0100
+#define WIRE_F_TOTAL_LENGTH 0x0200
+#define WIRE_F_HANDLE 0x0400
+
+// Chunked transfers (v2 only). A payload larger than WIRE_CHUNK_SIZE is sent
+// as a head frame carrying the 64-bit total length and the first slice,
+// followed by continuation frames until total_length bytes have been sent.
+#define WIRE_FRAME_CHUNKED 0x01      // Head frame of a chunked payload
+#define WIRE_FRAME_CONTINUATION 0x02 // Next slice of the current payload
+#define WIRE_CHUNK_SIZE (256 * 1024)
+#define WIRE_RECV_BUFFER (64 * 1024) // Bounce buffer for streamed payloads
+
+// Compressed frames (v2 only). A peer that can decode them sets
+// WIRE_FRAME_ACCEPTS_LZ on its frames; payloads sent to such a peer that are
+// at least the configured minimum size (set_wire_compression()) go out as an
+// lz_compress() block flagged WIRE_FRAME_COMPRESSED, if that saves at least
+// 1/WIRE_COMPRESS_MIN_GAIN of the bytes. Each frame (head or continuation)
+// decides on its own; a compressed single frame carries its uncompressed
+// size in total_length, which never exceeds WIRE_CHUNK_SIZE (larger
+// payloads are chunked), and a compressed slice of a chunked payload never
+// expands past WIRE_CHUNK_SIZE either.
+#define WIRE_FRAME_COMPRESSED 0x04 // Payload of this frame is an LZ block
+#define WIRE_FRAME_ACCEPTS_LZ 0x08 // Sender decodes compressed frames
+#define WIRE_COMPRESS_MIN 1024     // Default minimum payload to compress
+#define WIRE_COMPRESS_MIN_GAIN 16  // Must save at least 1/16 of the bytes
+
+// Socket roles decide how small writes reach the wire. Every frame is
+// written with one vectored send, so Nagle only ever delays whole frames.
+#define SOCKET_ROLE_INTERACTIVE 0 // Request/response: TCP_NODELAY
+#define SOCKET_ROLE_BULK 1        // Streams: Nagle on, kept corked
+
+// ============ LOCAL TRANSPORT ============
+// Servers also listen on a Unix-domain socket so peers on the same host can
+// skip the TCP stack. A server's local address is "<hostname>:<path>"; peers
+// use it only when the hostname is their own, and fall back to TCP if the
+// socket cannot be reached. connect_to_server() also accepts "unix:<path>"
+// in place of an IP address (the port is then ignored).
+#define UNIX_SOCKET_PREFIX "unix:"
+#define UNIX_SOCKET_DIR "/tmp"
+#define MAX_LOCAL_ADDR 160 // hostname ':' path (sun_path holds 108 bytes)
+
+// ============ RECEIVE BUFFERS ============
+// One growable buffer per connection. recv_message_into() and parse_frame()
+// leave the payload in it and hand out a borrowed pointer, valid until the
+// next receive into the same buffer, so servers do not allocate per message.
+#define RECV_BUFFER_INITIAL 1024
+
+typedef struct {
+  char *data;
+  size_t cap;
+} RecvBuffer;
+
+// ============ MULTIPLEXING ============
+// A MuxChannel carries several in-flight requests on one connection. Each
+// request is tagged with a request ID that the peer echoes back, so replies
+// can be matched even when they are consumed out of order. Peers stuck on
+// v1 framing cannot echo IDs; their replies are matched in FIFO order.
+#define MUX_MAX_IN_FLIGHT 64
+
+typedef struct MuxFrame {
+  MessageHeader header;
+  char *payload;
+  struct MuxFrame *next;
+} MuxFrame;
+
+typedef struct {
+  int fd;
+  unsigned int next_id;
+  unsigned int in_flight[MUX_MAX_IN_FLIGHT]; // Outstanding IDs, oldest first
+  int in_flight_count;
+  MuxFrame *parked; // Replies received before anyone asked for them
+} MuxChannel;
+
+// ============ COMPRESSION ============
+size_t lz_compress_bound(size_t len);
+size_t lz_decompress_bound(size_t len);
+size_t lz_compress(const char *src, size_t src_len, char *dst, size_t dst_cap);
+long lz_decompress(const char *src, size_t src_len, char *dst, size_t dst_cap);
+
+// ============ BATCHES ============
+// An OP_SS_BATCH payload is an ordered list of sub-operations, each encoded
+// as "<op_code> <sentence_index> <length>\n" followed by <length> bytes of
+// sub-payload. The reply carries one result code per sub-operation.
+#define BATCH_MAX_OPS 256
+
+typedef struct {
+  int op_code;
+  int sentence_index;
+  const char *payload; // Points into the batch; not NUL-terminated
+  int payload_len;
+} BatchOp;
+
+typedef struct {
+  char *buf;
+  size_t len;
+  size_t cap;
+  int count;
+} BatchBuilder;
+
+void batch_init(BatchBuilder *b);
+int batch_add(BatchBuilder *b, int op_code, int sentence_index,
+              const char *payload);
+void batch_reset(BatchBuilder *b);
+void batch_free(BatchBuilder *b);
+int batch_parse(const char *payload, size_t len, BatchOp *ops, int max_ops);
+int batch_parse_results(const char *payload, int *codes, int max_codes);
+
+// ============ LOAD REPORTS ============
+// Storage servers piggyback their load on every heartbeat as a text payload
+// "LOAD key=value ...". Unknown keys are ignored, so fields can be added
+// without breaking older Name Servers.
+#define LOAD_REPORT_MAX 256
+
+typedef struct {
+  int workers;                     // Connection workers in the pool
+  int active;                      // Connections currently being served
+  int queue_depth;                 // Connections waiting for a worker
+  unsigned long long disk_free;    // Bytes available in the storage directory
+  unsigned long long bytes_read;   // Storage-layer bytes read (cumulative)
+  unsigned long long bytes_written; // Storage-layer bytes written (cumulative)
+  int p99_us;                      // p99 op latency since the previous report
+  int ops;                         // Ops completed since the previous report
+} LoadReport;
+
+int format_load_report(const LoadReport *report, char *out, size_t size);
+int parse_load_report(const char *payload, LoadReport *report);
+
+// ============ DEADLINES ============
+// A thread blocked reading a socket arms a Deadline for the phase it is in.
+// One shared timer thread watches every armed deadline and shuts the socket
+// down when one expires, which fails the blocked recv(). The Storage Server
+// uses a deadline per phase of a request (see SSConfig).
+#define DEADLINE_IDLE 1    // Between requests
+#define DEADLINE_HEADER 2  // Reading a request header
+#define DEADLINE_PAYLOAD 3 // Reading a request payload
+
+typedef struct {
+  int fd;
+  int phase;       // Phase armed most recently
+  int fired;       // Phase that expired, 0 if none
+  long long due_ms; // CLOCK_MONOTONIC milliseconds
+  int heap_index;  // Position in the timer heap, -1 when disarmed
+} Deadline;
+
+void deadline_init(Deadline *d, int fd);
+int deadline_arm(Deadline *d, int phase, int timeout_ms);
+void deadline_disarm(Deadline *d);
+int deadline_fired(Deadline *d);
+
+// ============ EPOCH RECLAMATION ============
+// Lock-free readers bracket each access with epoch_enter()/epoch_exit().
+// Writers publish a new version, then pass the unlinked old one to
+// epoch_retire(), which frees it once every reader that could still see it
+// has left. Read sections nest and must not block.
+void epoch_enter(void);
+void epoch_exit(void);
+void epoch_retire(void *ptr, void (*free_fn)(void *));
+int epoch_reclaim(void);
+
+// ============ OP STATS ============
+// Servers keep a count and a latency histogram per opcode, and the time
+// threads wait for their main lock. Updates are relaxed atomic adds, so
+// recording is always on; OP_STATS returns a JSON snapshot.
+#define STATS_MAX_OPS 128           // Opcodes at or above this count as 0
+#define STATS_LOCK_NS_STATE 0       // Name Server: ns_state.lock, exclusive
+#define STATS_LOCK_SS_REGISTRY 1    // Storage Server: locked-file registry
+#define STATS_LOCK_NS_STATE_READ 2  // Name Server: ns_state.lock, shared
+#define STATS_LOCK_NS_FILE 3        // Name Server: per-file lock stripes
+#define STATS_LOCKS 4
+
+// Log-linear histogram in microseconds: values below HIST_SUB_BUCKETS get a
+// bucket each, and every power of two above is split into HIST_SUB_BUCKETS
+// buckets (at most 6.25% wide), up to UINT_MAX us
+#define HIST_SUB_BITS 4
+#define HIST_SUB_BUCKETS (1 << HIST_SUB_BITS)
+#define HIST_BUCKETS (HIST_SUB_BUCKETS + (32 - HIST_SUB_BITS) * HIST_SUB_BUCKETS)
+
+typedef struct {
+  unsigned long long counts[HIST_BUCKETS];
+  unsigned long long total;
+  unsigned long long sum_us;
+  unsigned long long max_us;
+} LatencyHistogram;
+
+struct cJSON;
+
+void hist_record(LatencyHistogram *h, double us);
+unsigned int hist_percentile(const LatencyHistogram *h, double fraction);
+void hist_drain(LatencyHistogram *h, LatencyHistogram *out);
+void stats_start(void);
+void stats_record_op(int op_code, const char *name, double us, int error_code);
+void stats_lock(pthread_mutex_t *mutex, int lock_id);
+void stats_rdlock(pthread_rwlock_t *lock, int lock_id);
+void stats_wrlock(pthread_rwlock_t *lock, int lock_id);
+struct cJSON *stats_to_json(const char *component);
+
 // ============ NETWORK FUNCTIONS ============
 int send_message(int sockfd, MessageHeader *header, const char *payload);
 int recv_message(int sockfd, MessageHeader *header, char **payload);
+int send_file_message(int sockfd, MessageHeader *header, int file_fd,
+                      size_t length);
+
+// Streaming receive: read the header first, then feed the payload (single
+// frame or chunked) to a sink in bounded pieces. Sinks return 0 to go on.
+typedef int (*PayloadSink)(void *ctx, const char *data, size_t len);
+int recv_message_header(int sockfd, MessageHeader *header);
+int recv_message_payload(int sockfd, MessageHeader *header, PayloadSink sink,
+                         void *ctx);
+int fd_payload_sink(void *ctx, const char *data, size_t len);
+
+// Forward a message whose header was just read from src_fd to dst_fd,
+// moving the payload with splice() instead of buffering it
+int relay_message(int src_fd, MessageHeader *header, int dst_fd,
+                  int *delivered);
+
+// Allocation-free receive into a per-connection buffer (payload is borrowed)
+void recv_buffer_init(RecvBuffer *rb);
+void recv_buffer_free(RecvBuffer *rb);
+int recv_buffer_reserve(RecvBuffer *rb, size_t need);
+int recv_message_into(int sockfd, MessageHeader *header, RecvBuffer *rb,
+                      char **payload);
+int recv_message_payload_into(int sockfd, MessageHeader *header,
+                              RecvBuffer *rb, char **payload);
 int create_server_socket(int port);
+int create_unix_server_socket(const char *path);
 int connect_to_server(const char *ip, int port);
+int connect_to_endpoint(const char *ip, int port, const char *local_addr);
+void set_socket_role(int sockfd, int role);
+void set_socket_timeout(int sockfd, int seconds);
+
+// Protocol negotiation / framing
+void set_socket_protocol(int sockfd, int version);
+int get_socket_protocol(int sockfd);
+void set_wire_compression(int min_bytes);
+void set_socket_compression(int sockfd, int peer_accepts);
+int get_socket_compression(int sockfd);
+int negotiate_protocol(int sockfd);
+int answer_protocol_hello(int sockfd, MessageHeader *header,
+                          const char *payload);
+int encode_wire_header(const MessageHeader *header, unsigned char *buf,
+                       size_t cap);
+int decode_wire_header(const unsigned char *buf, size_t len,
+                       MessageHeader *header);
+ssize_t parse_frame(const unsigned char *buf, size_t len,
+                    MessageHeader *header, RecvBuffer *rb, char **payload,
+                    int *version);
+void record_frame_received(int sockfd, const MessageHeader *header,
+                           int version);
+
+// Request-ID multiplexing / pipelining
+void mux_init(MuxChannel *ch, int sockfd);
+unsigned int mux_send(MuxChannel *ch, MessageHeader *header,
+                      const char *payload);
+int mux_recv(MuxChannel *ch, unsigned int request_id, MessageHeader *header,
+             char **payload);
+int mux_recv_next(MuxChannel *ch, unsigned int *request_id,
+                  MessageHeader *header, char **payload, int wait);
+void mux_discard(MuxChannel *ch);
 
 // ============ MESSAGE HELPERS ============
 void init_message_header(MessageHeader *header, int msg_type, int op_code,
                          const char *username);
-int parse_ss_info(const char *ss_info, char *ip_out, int *port_out);
+int parse_ss_info(const char *ss_info, char *ip_out, int *port_out,
+                  int *proto_out, char *local_out);
 void safe_close_socket(int *sockfd);
 
 // Response initialization macro (reduces 4-line pattern to 1 line)
@@ -271,11 +595,13 @@ void log_message(const char *component, const char *level, const char *message);
 void log_operation(const char *component, const char *level,
                    const char *operation, const char *username, const char *ip,
                    int port, const char *details, int error_code);
+void log_flush(void); // Wait until every line logged so far is written
 
 // ============ UTILITY FUNCTIONS ============
 int visual_strlen(
     const char *str); // Calculate visual width excluding ANSI codes
 char *read_file_content(const char *filepath);
+char *read_fd_content(int fd);
 int write_file_content(const char *filepath, const char *content);
 void safe_strncpy(char *dest, const char *src, size_t n);
 int construct_full_path(char *dest, size_t size, const char *folder,
@@ -289,5 +615,9 @@ char *get_error_message(int error_code);
 
 // ============ NETWORK UTILITY FUNCTIONS ============
 int get_local_network_ip(char *ip_out, size_t size);
+int get_peer_address(int sockfd, char *ip_out, size_t size, int *port_out);
+void unix_socket_path(char *out, size_t size, const char *role, int port);
+int make_local_address(char *out, size_t size, const char *path);
+int local_address_path(const char *local_addr, char *path_out, size_t size);
 
 #endif // COMMON_H
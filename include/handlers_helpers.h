@@ -12,16 +12,6 @@
 
 extern NameServerState ns_state;
 
-/**
- * SSConnection - Storage server connection info
- */
-typedef struct {
-  int socket;
-  int ss_id;
-  char ip[MAX_IP];
-  int client_port;
-} SSConnection;
-
 /**
  * Send an error response to the client.
  */
@@ -43,61 +33,31 @@ static inline void send_ack(int fd, MessageHeader *h) {
 }
 
 /**
- * Find file and verify permission.
+ * Find file and verify permission in one lookup.
  *
  * @param filename    File to find
  * @param username    User requesting access
  * @param need_write  Non-zero if write permission required
- * @param file_out    Output file metadata pointer
- * @return ERR_SUCCESS or error code
+ * @param file_out    Filled with a copy of the file's routing fields
+ * @return ERR_SUCCESS, ERR_FILE_NOT_FOUND or ERR_PERMISSION_DENIED
  */
 static inline int get_file_with_perm(const char *filename, const char *username,
-                                     int need_write, FileMetadata **file_out) {
-  FileMetadata *file = nm_find_file(filename);
-  if (!file) {
-    return ERR_FILE_NOT_FOUND;
-  }
-
-  int result = nm_check_permission(filename, username, need_write);
+                                     int need_write, FileSnapshot *file_out) {
+  int result = nm_lookup_file(filename, username, file_out);
   if (result != ERR_SUCCESS) {
     return result;
   }
 
-  *file_out = file;
-  return ERR_SUCCESS;
-}
-
-/**
- * Connect to the storage server hosting a file.
- *
- * @param file  File metadata
- * @param conn  Output connection info
- * @return ERR_SUCCESS or error code
- */
-static inline int connect_to_ss(FileMetadata *file, SSConnection *conn) {
-  StorageServerInfo *ss = nm_find_storage_server(file->ss_id);
-  if (!ss || !ss->is_active) {
-    return ERR_SS_UNAVAILABLE;
-  }
-
-  conn->socket = connect_to_server(ss->ip, ss->client_port);
-  if (conn->socket < 0) {
-    return ERR_SS_UNAVAILABLE;
-  }
-
-  conn->ss_id = ss->server_id;
-  strncpy(conn->ip, ss->ip, MAX_IP - 1);
-  conn->ip[MAX_IP - 1] = '\0';
-  conn->client_port = ss->client_port;
-
-  return ERR_SUCCESS;
+  int allowed = need_write ? file_out->can_write : file_out->can_read;
+  return allowed ? ERR_SUCCESS : ERR_PERMISSION_DENIED;
 }
 
 /**
  * Get storage server with failover support.
  *
  * First tries the primary SS. If inactive, checks for active replica.
- * Logs failover when it occurs.
+ * Logs failover when it occurs. Reads the published routes, so it never
+ * waits for ns_state.lock.
  *
  * @param ss_id     Primary storage server ID
  * @param op_name   Operation name for logging
@@ -106,48 +66,44 @@ static inline int connect_to_ss(FileMetadata *file, SSConnection *conn) {
  */
 static inline StorageServerInfo *
 get_ss_with_failover(int ss_id, const char *op_name_str, const char *filename) {
-  StorageServerInfo *primary_ss = NULL;
-
-  // Find primary SS
-  for (int i = 0; i < ns_state.ss_count; i++) {
-    if (ns_state.storage_servers[i].server_id == ss_id) {
-      primary_ss = &ns_state.storage_servers[i];
-      break;
+  StorageServerInfo *target = NULL;
+  int failed_over = 0;
+
+  epoch_enter();
+  const SSRouteTable *routes =
+      __atomic_load_n(&ns_state.ss_routes, __ATOMIC_ACQUIRE);
+  const SSRoute *primary = nm_find_ss_route(routes, ss_id);
+
+  if (primary && primary->is_active) {
+    // Primary is active - use it
+    target = primary->ss;
+  } else if (primary && primary->replica_active) {
+    // Try failover to replica
+    const SSRoute *replica = nm_find_ss_route(routes, primary->replica_id);
+    if (replica && replica->is_active) {
+      target = replica->ss;
+      failed_over = 1;
     }
   }
-
-  if (!primary_ss)
-    return NULL;
-
-  // Primary is active - use it
-  if (primary_ss->is_active) {
-    return primary_ss;
-  }
-
-  // Try failover to replica
-  if (primary_ss->replica_active) {
-    for (int i = 0; i < ns_state.ss_count; i++) {
-      if (ns_state.storage_servers[i].server_id == primary_ss->replica_id &&
-          ns_state.storage_servers[i].is_active) {
-        char alert[512];
-        snprintf(alert, sizeof(alert),
-                 "[FAILOVER] Redirecting '%s' for '%s' to Replica SS #%d "
-                 "(Primary #%d DOWN)",
-                 op_name_str, filename, ns_state.storage_servers[i].server_id,
-                 ss_id);
-        log_message("NM", "WARN", alert);
-        return &ns_state.storage_servers[i];
-      }
-    }
+  epoch_exit();
+
+  if (failed_over) {
+    char alert[512];
+    snprintf(alert, sizeof(alert),
+             "[FAILOVER] Redirecting '%s' for '%s' to Replica SS #%d "
+             "(Primary #%d DOWN)",
+             op_name_str, filename, target->server_id, ss_id);
+    log_message("NM", "WARN", alert);
   }
-
-  return NULL; // No active SS available
+  return target; // NULL if no active SS available
 }
 
 /**
  * Forward a request to the storage server and relay response to client.
  *
- * Handles permission checking, SS connection, message forwarding, and cleanup.
+ * Handles permission checking and message forwarding over a pooled SS
+ * connection. The response is relayed to the client as it arrives, so
+ * its size does not affect Name Server memory use.
  *
  * @param client_fd   Client socket
  * @param header      Request header (modified)
@@ -157,7 +113,7 @@ get_ss_with_failover(int ss_id, const char *op_name_str, const char *filename) {
  */
 static inline int forward_to_ss(int client_fd, MessageHeader *header,
                                 int ss_op_code, int need_write) {
-  FileMetadata *file = NULL;
+  FileSnapshot file;
   int result =
       get_file_with_perm(header->filename, header->username, need_write, &file);
   if (result != ERR_SUCCESS) {
@@ -165,25 +121,22 @@ static inline int forward_to_ss(int client_fd, MessageHeader *header,
     return result;
   }
 
-  SSConnection conn;
-  result = connect_to_ss(file, &conn);
-  if (result != ERR_SUCCESS) {
-    send_error(client_fd, header, result);
-    return result;
+  StorageServerInfo *ss = nm_find_storage_server(file.ss_id);
+  if (!ss || !ss->is_active) {
+    send_error(client_fd, header, ERR_SS_UNAVAILABLE);
+    return ERR_SS_UNAVAILABLE;
   }
 
   MessageHeader ss_header = *header;
   ss_header.op_code = ss_op_code;
-  send_message(conn.socket, &ss_header, NULL);
 
-  char *ss_payload = NULL;
+  // The response body is streamed through, never held by the Name Server
   MessageHeader ss_response;
-  recv_message(conn.socket, &ss_response, &ss_payload);
-  close(conn.socket);
-
-  send_message(client_fd, &ss_response, ss_payload);
-  if (ss_payload)
-    free(ss_payload);
+  if (ss_pool_relay(ss, &ss_header, NULL, client_fd, &ss_response) !=
+      ERR_SUCCESS) {
+    send_error(client_fd, header, ERR_SS_UNAVAILABLE);
+    return ERR_SS_UNAVAILABLE;
+  }
 
   return ss_response.error_code;
 }
@@ -201,6 +154,8 @@ static inline const char *op_name(int op) {
     return "CLIENT_DISCONNECT";
   case OP_HEARTBEAT:
     return "HEARTBEAT";
+  case OP_HELLO:
+    return "HELLO";
   case OP_VIEW:
     return "VIEW";
   case OP_READ:
@@ -247,6 +202,8 @@ static inline const char *op_name(int op) {
     return "APPROVE_REQUEST";
   case OP_DENYREQUEST:
     return "DENY_REQUEST";
+  case OP_STATS:
+    return "STATS";
   default:
     return "UNKNOWN";
   }
@@ -5,19 +5,30 @@
 
 // ============ DATA STRUCTURES ============
 
-// Trie node for efficient file search
+// Radix tree node for efficient file search. Each edge carries a run of
+// path bytes (label), so a chain of single-child nodes is stored as one
+// node. Children are kept sorted by the first byte of their label.
 typedef struct TrieNode {
-  struct TrieNode *children[256]; // ASCII character set
-  int file_index;                 // Index in files array (-1 if not a file)
-  int is_end_of_path;             // Flag to mark end of file path
+  struct TrieNode **children;
+  unsigned char *keys;    // keys[i] == children[i]->label[0]
+  unsigned short child_count;
+  unsigned short child_cap;
+  int file_index;         // File ID in ns_state.files (-1 if not a file)
+  int is_end_of_path;     // Flag to mark end of file path
+  int label_len;
+  char label[];           // Bytes on the edge into this node (no NUL)
 } TrieNode;
 
+// Called by trie_walk() for each stored path; return non-zero to stop
+typedef int (*TrieVisitor)(void *ctx, const char *path, int file_index);
+
 // LRU Cache node for recent file lookups
 typedef struct CacheNode {
   char key[MAX_PATH]; // Full file path
-  int file_index;     // Index in files array
-  struct CacheNode *prev;
-  struct CacheNode *next;
+  int file_index;     // File ID in ns_state.files
+  struct CacheNode *prev;      // LRU list
+  struct CacheNode *next;      // LRU list
+  struct CacheNode *hash_next; // Next node in the same hash bucket
   time_t last_access; // Timestamp of last access
 } CacheNode;
 
@@ -46,7 +57,7 @@ typedef struct {
   char foldername[MAX_FOLDERNAME]; // Full path (e.g., "folder1/folder2")
   char owner[MAX_USERNAME];
   time_t created_time;
-  int parent_folder_idx; // Index of parent folder, -1 for root
+  int parent_folder_idx; // ID of parent folder, -1 for root
   AccessControlEntry *acl;
   int acl_count;
 } FolderMetadata;
@@ -78,10 +89,87 @@ typedef struct {
   time_t last_heartbeat;
   int replica_id;     // ID of the backup server
   int replica_active; // Is the backup currently active?
+  int protocol;       // Wire protocol version advertised at registration
+  char local_addr[MAX_LOCAL_ADDR]; // "<host>:<unix path>", "" if TCP only
+  int heartbeat_fd;   // Session socket its heartbeats arrive on, -1 if none
+  LoadReport load;    // Telemetry from the latest heartbeat
+  time_t load_time;   // When load was reported, 0 if never
   char **files;
   int file_count;
 } StorageServerInfo;
 
+// Immutable copy of a file's routing fields and ACL, published in the
+// FileView for lock-free lookups. Never changed once published (only `next`
+// is relinked): a change publishes a new record and retires the old one.
+typedef struct FileRecord {
+  struct FileRecord *next; // Next record in the same chain
+  unsigned int hash;       // Hash of path
+  int ss_id;
+  int folder_len;          // path[0, folder_len) is the folder, 0 at root
+  int acl_count;
+  char owner[MAX_USERNAME];
+  AccessControlEntry *acl; // Stored in the same allocation
+  char *path;              // "<folder>/<filename>" or "<filename>", likewise
+} FileRecord;
+
+// Bucket array of a FileView; replaced as a whole when the view grows
+typedef struct {
+  unsigned int mask;     // Bucket count - 1 (a power of 2)
+  FileRecord *buckets[];
+} FileViewBuckets;
+
+// Hash table of FileRecords by full path. Readers walk the chains inside
+// epoch_enter()/epoch_exit() without locking; publishers are serialized by
+// write_lock and retire what they unlink (see file_view.c).
+typedef struct {
+  FileViewBuckets *table;
+  int count;
+  pthread_mutex_t write_lock;
+} FileView;
+
+// Writes the key an entry is indexed under into key (size bytes)
+typedef void (*RegistryKeyFn)(const void *entry, char *key, size_t size);
+
+// Growable table of fixed-size entries with stable IDs and a hash index by
+// key (see registry_table.c). Entries live in slabs of NM_SLAB_ENTRIES that
+// never move, so IDs and entry pointers stay valid until removal.
+typedef struct {
+  size_t entry_size;
+  RegistryKeyFn key_of;
+  char **slabs;              // slab_count slabs of NM_SLAB_ENTRIES entries
+  int slab_count;
+  unsigned char *live;       // live[id] is 1 while the ID is in use
+  int id_limit;              // IDs handed out so far: [0, id_limit)
+  int *free_ids;             // Removed IDs, reused before id_limit grows
+  int free_count;
+  int count;                 // Live entries
+  int *slot_ids;             // Open-addressing index: an ID, or empty/deleted
+  unsigned int *slot_hashes; // Hash of the key in each slot
+  unsigned int slot_mask;    // Slot count - 1 (a power of 2)
+  int slots_used;            // Slots holding an ID or a deleted marker
+} RegistryTable;
+
+// When a committed journal record counts as durable (see journal.c)
+typedef enum {
+  JOURNAL_SYNC_ALWAYS, // Written and fdatasync()ed before the commit returns
+  JOURNAL_SYNC_BATCH,  // Written; synced within NM_JOURNAL_SYNC_MS
+  JOURNAL_SYNC_NONE    // Written; synced whenever the kernel flushes
+} JournalSyncPolicy;
+
+// Called by journal_replay() with each intact record, in order
+typedef void (*JournalApplyFn)(char type, char *payload, size_t len, void *ctx);
+
+// Journal counters since journal_open(), for OP_STATS
+typedef struct {
+  int generation;    // Suffix of the journal file being appended to
+  long file_bytes;   // Bytes written to that file
+  long records;      // Records appended
+  long commits;      // journal_commit() calls
+  long writes;       // Batches written (one write() each)
+  long syncs;        // fdatasync() calls
+  long failed_commits; // Commits whose record could not be written
+} JournalStats;
+
 // Client information
 typedef struct {
   char username[MAX_USERNAME];
@@ -100,30 +188,77 @@ typedef struct {
   int write_requested; // 1 if write access requested
 } AccessRequest;
 
+// Routing fields of a Storage Server, as last published for redirects
+typedef struct {
+  StorageServerInfo *ss; // Its entry in ns_state.storage_servers
+  int server_id;
+  int is_active;
+  int replica_id;
+  int replica_active;
+  LoadReport load;
+  time_t load_time;
+} SSRoute;
+
+// Immutable copy of every server's routing fields (see
+// nm_publish_ss_routes())
+typedef struct {
+  int count;
+  SSRoute routes[MAX_STORAGE_SERVERS];
+} SSRouteTable;
+
 // Name Server state
 typedef struct {
   StorageServerInfo storage_servers[MAX_STORAGE_SERVERS];
   int ss_count;
 
-  FileMetadata files[MAX_FILES];
-  int file_count;
+  // Registry tables, each indexed by key: files by full path, folders by
+  // path, clients by username, access requests by file and requester (one
+  // pending request per user per file)
+  RegistryTable files;           // FileMetadata
+  RegistryTable folders;         // FolderMetadata
+  RegistryTable clients;         // ClientInfo
+  RegistryTable access_requests; // AccessRequest
 
-  FolderMetadata folders[MAX_FOLDERS];
-  int folder_count;
+  TrieNode *file_trie_root; // Paths to file IDs, for folder listings
 
-  ClientInfo clients[MAX_CLIENTS];
-  int client_count;
+  // Published copies for lock-free request routing: every change to a
+  // file's path, owner, storage server or ACL is republished to file_view,
+  // and every change to a server's state to ss_routes, by the writer that
+  // makes it while it still holds the locks below. Readers see the latest
+  // version without taking any lock.
+  FileView *file_view;
+  SSRouteTable *ss_routes;
 
-  AccessRequest access_requests[MAX_FILES]; // Max one request per file per user
-                                            // (simplified)
-  int request_count;
+  // `lock` guards the tables above and every entry's identity (names,
+  // owner, storage server). Lookups, permission checks and listings hold it
+  // shared; adding, removing or moving entries holds it exclusive. A file's
+  // ACL and cached stats are also guarded by its stripe in file_locks (see
+  // nm_file_lock()), taken while `lock` is held shared: exclusive to change
+  // them, shared to read them. Order: lock, then at most one stripe. Neither
+  // is held across network I/O.
+  pthread_rwlock_t lock;
+  pthread_rwlock_t file_locks[NM_FILE_LOCK_STRIPES];
+} NameServerState;
 
-  // Efficient search structures
-  TrieNode *file_trie_root; // Trie for O(m) file lookups
-  LRUCache *file_cache;     // LRU cache for frequent lookups
+// Copy of a file's routing fields, taken from the file view so handlers
+// can use them without holding anything
+typedef struct {
+  char filename[MAX_FILENAME];
+  char folder_path[MAX_PATH];
+  char owner[MAX_USERNAME];
+  int ss_id;
+  int can_read;  // Access of the user the lookup was made for
+  int can_write;
+} FileSnapshot;
 
-  pthread_mutex_t lock;
-} NameServerState;
+// Per-connection state kept between requests on one NS socket
+typedef struct {
+  int fd;
+  char client_ip[MAX_IP];
+  int client_port;
+  char username[MAX_USERNAME]; // Set by OP_CONNECT_CLIENT, for cleanup
+  int heartbeat_ss; // SS whose heartbeat channel this is, -1 if none
+} NMSession;
 
 // ============ FUNCTION DECLARATIONS ============
 
@@ -132,6 +267,7 @@ TrieNode *trie_create_node(void);
 void trie_insert(TrieNode *root, const char *path, int file_index);
 int trie_search(TrieNode *root, const char *path);
 void trie_delete(TrieNode *root, const char *path);
+int trie_walk(TrieNode *root, const char *prefix, TrieVisitor visit, void *ctx);
 void trie_free(TrieNode *root);
 
 // LRU Cache operations
@@ -143,16 +279,61 @@ void cache_free(LRUCache *cache);
 void cache_print_stats(LRUCache *cache);
 
 // File registry operations
+int nm_registry_init(void);
+void nm_registry_free(void);
 int nm_register_file(const char *filename, const char *folder_path,
                      const char *owner, int ss_id);
 FileMetadata *nm_find_file(const char *filename);
 FileMetadata *nm_find_file_in_folder(const char *filename,
                                      const char *folder_path);
+int nm_lookup_file(const char *filename, const char *username,
+                   FileSnapshot *out);
+pthread_rwlock_t *nm_file_lock(const FileMetadata *file);
+int nm_update_file_stats(const char *filename, long size, int words,
+                         int chars);
+int nm_touch_file(const char *filename);
+int nm_format_acl(const char *filename, char *buffer, size_t buffer_size);
 int nm_delete_file(const char *filename);
 int nm_check_permission(const char *filename, const char *username,
                         int need_write);
 int nm_move_file(const char *filename, const char *new_folder_path);
 
+// Registry tables (registry_table.c)
+unsigned int nm_path_hash(const char *key);
+int registry_init(RegistryTable *table, size_t entry_size, RegistryKeyFn key_of);
+void *registry_get(const RegistryTable *table, int id);
+int registry_find(const RegistryTable *table, const char *key);
+int registry_insert(RegistryTable *table, const void *entry);
+void registry_remove(RegistryTable *table, int id);
+int registry_rekey(RegistryTable *table, int id, const char *old_key);
+int registry_next(const RegistryTable *table, int id);
+void registry_free(RegistryTable *table);
+
+// Published file view (file_view.c)
+FileView *file_view_create(void);
+int file_view_publish(FileView *view, const FileMetadata *file);
+int file_view_remove(FileView *view, const char *path);
+const FileRecord *file_view_find(FileView *view, const char *path);
+void file_record_access(const FileRecord *record, const char *username,
+                        int *can_read, int *can_write);
+void file_view_free(FileView *view);
+
+// Metadata journal (journal.c)
+int journal_parse_policy(const char *name, JournalSyncPolicy *policy);
+const char *journal_policy_name(JournalSyncPolicy policy);
+int journal_open(const char *dir, int generation, JournalSyncPolicy policy,
+                 void (*compact)(void));
+long journal_append(char type, const char *payload, size_t len);
+int journal_commit(long lsn);
+int journal_rotate(void);
+void journal_set_snapshot_size(long bytes);
+void journal_remove_before(int generation);
+int journal_replay(const char *dir, int generation, JournalApplyFn apply,
+                   void *ctx);
+int journal_sync_dir(const char *dir);
+void journal_get_stats(JournalStats *stats);
+void journal_close(void);
+
 // Folder registry operations
 int nm_create_folder(const char *foldername, const char *owner);
 FolderMetadata *nm_find_folder(const char *foldername);
@@ -163,9 +344,31 @@ int nm_list_folder_contents(const char *foldername, const char *username,
 
 // Storage server operations
 int nm_register_storage_server(int server_id, const char *ip, int nm_port,
-                               int client_port);
+                               int client_port, int protocol,
+                               const char *local_addr);
 StorageServerInfo *nm_find_storage_server(int ss_id);
 int nm_select_storage_server(void);
+void nm_record_ss_load(StorageServerInfo *ss, const char *payload);
+void nm_publish_ss_routes(void);
+const SSRoute *nm_find_ss_route(const SSRouteTable *table, int ss_id);
+int nm_ss_saturated(const SSRoute *route);
+StorageServerInfo *nm_route_read(StorageServerInfo *ss, const char *filename);
+
+// Storage server connection pool (ss_pool.c)
+void ss_pool_init(void);
+int ss_pool_acquire(StorageServerInfo *ss, int *reused);
+void ss_pool_release(StorageServerInfo *ss, int fd, int reusable);
+int ss_pool_request(StorageServerInfo *ss, const MessageHeader *header,
+                    const char *payload, MessageHeader *response,
+                    char **response_payload);
+int ss_pool_relay(StorageServerInfo *ss, const MessageHeader *header,
+                  const char *payload, int client_fd, MessageHeader *response);
+int ss_pool_pipeline(StorageServerInfo *ss, const MessageHeader *requests,
+                     const char *const *payloads, int count,
+                     MessageHeader *responses, char **response_payloads);
+void ss_pool_invalidate(StorageServerInfo *ss);
+void ss_pool_prune(void);
+void ss_pool_print_stats(void);
 
 // Access control
 int nm_add_access(const char *filename, const char *username, int read,
@@ -185,14 +388,20 @@ int nm_deny_request(const char *filename, const char *owner,
                     const char *requester);
 
 // Handlers
-void *handle_client_connection(void *arg);
+void nm_session_init(NMSession *session, int fd);
+void nm_handle_request(NMSession *session, const MessageHeader *request,
+                       char *payload);
+void nm_session_close(NMSession *session);
 void *handle_ss_connection(void *arg);
 
+// Event loop front end (reactor.c)
+int nm_reactor_run(int server_socket, int local_socket, int worker_count);
+
 // Monitoring
 void nm_print_search_stats(void);
 
 // Persistence
 void save_state(void);
-void load_state(void);
+int load_state(void);
 
 #endif // NAME_SERVER_H
@@ -31,12 +31,23 @@ typedef struct {
 // Storage Server configuration
 typedef struct {
   int server_id;
-  char nm_ip[MAX_IP];
+  char nm_ip[MAX_LOCAL_ADDR]; // IPv4 address or "unix:<path>"
   int nm_port;
   int client_port;
+  char local_addr[MAX_LOCAL_ADDR]; // Our Unix socket, "" if TCP only
   char storage_dir[MAX_STORAGE_DIR];
   char replica_ip[MAX_IP];
   int replica_port;
+  char replica_local[MAX_LOCAL_ADDR]; // Replica's Unix socket, if advertised
+  int nm_protocol;      // Wire protocol negotiated with the Name Server
+  int replica_protocol; // Wire protocol advertised for the replica
+  int replica_compression; // Replica decodes compressed frames (learned)
+  int compress_min;        // Smallest payload to compress; 0 = off
+  int worker_threads;   // Connection workers in the pool
+  int queue_capacity;   // Connections allowed to wait for a worker
+  int header_deadline_ms;  // Per-phase request deadlines; 0 = none
+  int payload_deadline_ms;
+  int idle_deadline_ms;
 } SSConfig;
 
 extern SSConfig config;
@@ -69,6 +80,42 @@ typedef struct {
   int undo_saved; // Flag: 1 if undo snapshot was saved before first edit
 } LockedFile;
 
+// ======= FILE HANDLES =======
+#define SS_MAX_FILE_HANDLES 16 // Open handles per connection
+
+// A file opened with OP_SS_OPEN, named by its handle in later requests
+typedef struct {
+  unsigned long long id; // 0 = free slot
+  char filename[MAX_FILENAME];
+  char filepath[MAX_PATH]; // Resolved once, at open
+  int fd;
+  struct stat st; // Of the inode fd refers to
+} FileHandle;
+
+// Handles opened on one client connection
+typedef struct {
+  FileHandle slots[SS_MAX_FILE_HANDLES];
+  unsigned long long serial; // High 32 bits of every handle id
+  unsigned int opens;
+} HandleTable;
+
+// ======= WORKER POOL =======
+typedef struct {
+  int workers;         // Worker threads
+  int busy;            // Workers currently serving a connection
+  int queue_depth;     // Connections waiting for a worker
+  int queue_capacity;
+  int max_queue_depth; // High-water mark of queue_depth
+  long admitted;       // Connections queued
+  long rejected;       // Turned away because the queue was full
+  long expired;        // Turned away after waiting too long in the queue
+  double avg_wait_ms;  // Mean queue wait of connections that got a worker
+  double max_wait_ms;
+  long stalled_idle;    // Connections reclaimed after a deadline expired,
+  long stalled_header;  // by the phase they stalled in
+  long stalled_payload;
+} WorkerPoolStats;
+
 // ============ FUNCTION DECLARATIONS ============
 
 // Lock registry API
@@ -95,6 +142,7 @@ int get_file_locks(const char *filename, char *lock_info_out, size_t bufsize);
 int ss_create_file(const char *filename, const char *owner);
 int ss_delete_file(const char *filename);
 int ss_read_file(const char *filename, char **content);
+int ss_open_file(const char *filename, int *fd, size_t *size);
 int ss_get_file_info(const char *filename, long *size, int *words, int *chars);
 int ss_move_file(const char *old_filename, const char *new_filename);
 
@@ -120,6 +168,11 @@ int ss_write_word(const char *filename, int sentence_idx, int word_idx,
                   const char *new_word, const char *username);
 int ss_write_unlock(const char *filename, int sentence_idx,
                     const char *username);
+int ss_write_abort(const char *filename, const char *username);
+int ss_write_lock_handle(FileHandle *fh, int sentence_idx,
+                         const char *username);
+int ss_write_unlock_handle(FileHandle *fh, int sentence_idx,
+                           const char *username);
 
 // Undo operations
 int ss_save_undo(const char *filename);
@@ -127,8 +180,8 @@ int ss_undo_file(const char *filename);
 
 // Checkpoint operations
 int ss_create_checkpoint(const char *filename, const char *checkpoint_tag);
-int ss_view_checkpoint(const char *filename, const char *checkpoint_tag,
-                       char **content);
+int ss_open_checkpoint(const char *filename, const char *checkpoint_tag,
+                       int *fd, size_t *size);
 int ss_revert_checkpoint(const char *filename, const char *checkpoint_tag);
 int ss_list_checkpoints(const char *filename, char **checkpoint_list);
 
@@ -139,6 +192,26 @@ int ss_stream_file(int client_socket, const char *filename);
 void *handle_nm_communication(void *arg);
 void *handle_client_request(void *arg);
 
+// Worker pool (worker_pool.c)
+int ss_worker_pool_start(int workers, int queue_capacity);
+int ss_worker_pool_submit(int client_fd);
+void ss_worker_pool_expire(void);
+void ss_worker_pool_get_stats(WorkerPoolStats *out);
+void ss_worker_pool_log_stats(void);
+void ss_worker_pool_count_stalled(int phase);
+
+// File handles (file_handles.c)
+void ss_handles_init(HandleTable *table);
+int ss_handle_open(HandleTable *table, const char *filename,
+                   unsigned long long *id);
+FileHandle *ss_handle_find(HandleTable *table, unsigned long long id);
+int ss_handle_refresh(FileHandle *fh);
+void ss_handles_close(HandleTable *table);
+
+// Load telemetry for heartbeats (load_stats.c)
+void ss_load_record_op(double us);
+void ss_load_collect(LoadReport *out);
+
 // Request handler helpers (internal)
 void send_simple_response(int client_fd, int msg_type, int error_code);
 void send_content_response(int client_fd, int result, const char *content);
@@ -146,11 +219,16 @@ int ss_forward_to_replica(MessageHeader *header, const char *payload,
                           const char *op_name);
 int handle_ss_create(int client_fd, MessageHeader *header, const char *payload);
 int handle_ss_delete(int client_fd, MessageHeader *header);
-int handle_ss_read(int client_fd, MessageHeader *header);
-void handle_ss_write_lock(int client_fd, MessageHeader *header);
+int handle_ss_read(int client_fd, MessageHeader *header, FileHandle *fh);
+int handle_ss_open(int client_fd, MessageHeader *header, HandleTable *handles);
+int handle_ss_stats(int client_fd, MessageHeader *header);
+void handle_ss_write_lock(int client_fd, MessageHeader *header,
+                          FileHandle *fh);
 void handle_ss_write_word(int client_fd, MessageHeader *header,
                           const char *payload);
-void handle_ss_write_unlock(int client_fd, MessageHeader *header);
+void handle_ss_write_unlock(int client_fd, MessageHeader *header,
+                            FileHandle *fh);
+int handle_ss_batch(int client_fd, MessageHeader *header, const char *payload);
 void handle_ss_info(int client_fd, MessageHeader *header);
 void handle_ss_undo(int client_fd, MessageHeader *header);
 void handle_ss_move(int client_fd, MessageHeader *header, const char *payload);
@@ -168,7 +246,8 @@ int ss_build_filepath(char *dest, size_t dest_size, const char *filename,
                       const char *extension);
 
 // Sync / Recovery
-void ss_start_recovery_sync(const char *replica_ip, int replica_port);
+void ss_start_recovery_sync(const char *replica_ip, int replica_port,
+                            int replica_protocol, const char *replica_local);
 void handle_ss_sync(int client_fd, MessageHeader *header, const char *payload);
 
 // Live Updates
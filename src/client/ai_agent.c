@@ -19,69 +19,59 @@ static const char* get_api_key(void) {
 /**
  * @brief Helper to perform a non-interactive write to a file.
  *        Writes entire content at once using word_idx=-1 (full replacement).
+ *        Lock, write and unlock go out as one all-or-nothing OP_SS_BATCH,
+ *        so the whole write costs a single round trip.
  */
 static int auto_write_file(ClientState* state, const char* filename, const char* content) {
     int ss_socket;
     int result = get_storage_server_connection(state, filename, OP_WRITE, &ss_socket, NULL, NULL);
     if (result != ERR_SUCCESS) return result;
 
-    // 1. Lock Sentence 0 (We assume a new empty file)
-    MessageHeader header;
-    init_message_header(&header, MSG_REQUEST, OP_SS_WRITE_LOCK, state->username);
-    safe_strncpy(header.filename, filename, sizeof(header.filename));
-    header.sentence_index = 0;
-    
-    send_message(ss_socket, &header, NULL);
-    
-    char* response = NULL;
-    recv_message(ss_socket, &header, &response);
-    if (response) free(response);
-    
-    if (header.msg_type != MSG_ACK) {
+    // Replace sentence 0 (we assume a new empty file): payload "-1 " + content
+    size_t content_len = strlen(content);
+    size_t word_size = content_len + 8;  // "-1 " prefix + safety
+    char* word = malloc(word_size);
+    if (!word) {
         safe_close_socket(&ss_socket);
-        return header.error_code;
+        return ERR_FILE_OPERATION_FAILED;
+    }
+    snprintf(word, word_size, "-1 %s", content);
+
+    BatchBuilder batch;
+    batch_init(&batch);
+    int built = batch_add(&batch, OP_SS_WRITE_LOCK, 0, NULL) == 0 &&
+                batch_add(&batch, OP_SS_WRITE_WORD, 0, word) == 0 &&
+                batch_add(&batch, OP_SS_WRITE_UNLOCK, 0, NULL) == 0;
+    free(word);
+    if (!built) {
+        batch_free(&batch);
+        safe_close_socket(&ss_socket);
+        return ERR_FILE_OPERATION_FAILED;
     }
 
     PRINT_INFO("AI Agent: Writing content to %s...", filename);
 
-    // 2. Write entire content at once using word_idx=-1
-    init_message_header(&header, MSG_REQUEST, OP_SS_WRITE_WORD, state->username);
+    MessageHeader header;
+    init_message_header(&header, MSG_REQUEST, OP_SS_BATCH, state->username);
     safe_strncpy(header.filename, filename, sizeof(header.filename));
-    header.sentence_index = 0;
+    header.flags = FLAG_BATCH_ATOMIC;
+    header.data_length = batch.len;
 
-    // Allocate payload: "-1 " + content
-    size_t content_len = strlen(content);
-    size_t payload_size = content_len + 8;  // "-1 " prefix + safety
-    char* payload = malloc(payload_size);
-    if (!payload) {
-        safe_close_socket(&ss_socket);
-        return ERR_FILE_OPERATION_FAILED;
+    char* response = NULL;
+    if (send_message(ss_socket, &header, batch.buf) < 0 ||
+        recv_message(ss_socket, &header, &response) <= 0) {
+        header.msg_type = MSG_ERROR;
+        header.error_code = ERR_NETWORK_ERROR;
     }
-    snprintf(payload, payload_size, "-1 %s", content);
-    header.data_length = strlen(payload);
-
-    send_message(ss_socket, &header, payload);
-    free(payload);
-    
-    recv_message(ss_socket, &header, &response);
     if (response) free(response);
+    batch_free(&batch);
+    safe_close_socket(&ss_socket);
 
-    if (header.msg_type != MSG_ACK) {
-        PRINT_ERR("Write failed: %s", get_error_message(header.error_code));
-        safe_close_socket(&ss_socket);
+    // Atomic batch: any failed step means nothing was written
+    if (header.msg_type != MSG_ACK || header.error_code != ERR_SUCCESS) {
         return header.error_code;
     }
 
-    // 3. Unlock (ETIRW)
-    init_message_header(&header, MSG_REQUEST, OP_SS_WRITE_UNLOCK, state->username);
-    safe_strncpy(header.filename, filename, sizeof(header.filename));
-    header.sentence_index = 0;
-    
-    send_message(ss_socket, &header, NULL);
-    recv_message(ss_socket, &header, &response);
-    if (response) free(response);
-
-    safe_close_socket(&ss_socket);
     PRINT_OK("Content written successfully!");
     return ERR_SUCCESS;
 }
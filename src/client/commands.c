@@ -123,7 +123,9 @@ int get_storage_server_connection(ClientState* state, const char* filename, int
     // Parse SS IP and port
     char ss_ip[MAX_IP];
     int ss_port;
-    if (parse_ss_info(ss_info, ss_ip, &ss_port) != 0) {
+    int ss_proto;
+    char ss_local[MAX_LOCAL_ADDR];
+    if (parse_ss_info(ss_info, ss_ip, &ss_port, &ss_proto, ss_local) != 0) {
         PRINT_ERR("Invalid storage server info");
         free(ss_info);
         return ERR_NETWORK_ERROR;
@@ -134,12 +136,14 @@ int get_storage_server_connection(ClientState* state, const char* filename, int
     if (ss_ip_out) strncpy(ss_ip_out, ss_ip, MAX_IP - 1);
     if (ss_port_out) *ss_port_out = ss_port;
     
-    // Connect to SS
-    int ss_socket = connect_to_server(ss_ip, ss_port);
+    // Connect to SS (over its local socket when it runs on this host)
+    int ss_socket = connect_to_endpoint(ss_ip, ss_port, ss_local);
     if (ss_socket < 0) {
         PRINT_ERR("Failed to connect to storage server");
         return ERR_SS_UNAVAILABLE;
     }
+    // The NM advertises the SS wire version, so no extra round trip is needed
+    set_socket_protocol(ss_socket, ss_proto);
     
     *ss_socket_out = ss_socket;
     return ERR_SUCCESS;
@@ -249,12 +253,27 @@ int execute_view(ClientState* state, int flags) {
     return header.error_code;
 }
 
+/**
+ * print_payload_sink
+ * @brief PayloadSink that prints file content as it arrives.
+ *
+ * @param ctx Points to a char that receives the last byte printed.
+ */
+static int print_payload_sink(void* ctx, const char* data, size_t len) {
+    if (fwrite(data, 1, len, stdout) != len) {
+        return -1;
+    }
+    *(char*)ctx = data[len - 1];
+    return 0;
+}
+
 /**
  * execute_read
  * @brief Request the storage server location from NM then fetch file content.
  *
  * Uses helper function to establish connection to appropriate storage server,
- * then requests and displays the file content.
+ * then requests and displays the file content. The content is printed as it
+ * streams in, so large files are never held in memory.
  *
  * @param state Client state pointer.
  * @param filename Name of the file to read.
@@ -274,14 +293,16 @@ int execute_read(ClientState* state, const char* filename) {
     
     send_message(ss_socket, &header, NULL);
     
-    char* content = NULL;
-    recv_message(ss_socket, &header, &content);
-    safe_close_socket(&ss_socket);
-    
-    if (header.msg_type == MSG_RESPONSE) {
-        if (content) {
-            printf("%s", content);
-            if (content[strlen(content) - 1] != '\n') printf("\n");
+    if (recv_message_header(ss_socket, &header) > 0 && header.msg_type == MSG_RESPONSE) {
+        if (header.total_length > 0) {
+            char last = '\n';
+            if (recv_message_payload(ss_socket, &header, print_payload_sink, &last) < 0) {
+                header.error_code = ERR_NETWORK_ERROR;
+            }
+            if (last != '\n') printf("\n");
+            if (header.error_code != ERR_SUCCESS) {
+                PRINT_ERR("%s", get_error_message(header.error_code));
+            }
         } else {
             PRINT_WARN("(empty file)");
         }
@@ -289,7 +310,7 @@ int execute_read(ClientState* state, const char* filename) {
         PRINT_ERR("%s", get_error_message(header.error_code));
     }
     
-    if (content) free(content);
+    safe_close_socket(&ss_socket);
     return header.error_code;
 }
 
@@ -348,12 +369,126 @@ int execute_create(ClientState* state, const char* filename) {
     return header.error_code;
 }
 
+/**
+ * set_request_file
+ * @brief Name the target file of an SS request: by handle when one was
+ *        opened (a few bytes instead of the whole filename), else by name.
+ */
+static void set_request_file(MessageHeader* header, const char* filename,
+                             unsigned long long handle) {
+    header->handle = handle;
+    if (handle) {
+        header->filename[0] = '\0';
+    } else {
+        safe_strncpy(header->filename, filename, sizeof(header->filename));
+    }
+}
+
+/**
+ * collect_word_acks
+ * @brief Report the results of pipelined OP_SS_WRITE_WORD requests.
+ *
+ * @param mux Channel the words were sent on.
+ * @param word_of Word index of each in-flight request, keyed by request ID
+ *                modulo MUX_MAX_IN_FLIGHT.
+ * @param wait Non-zero to block until every outstanding word is answered;
+ *             zero to report only the replies that already arrived.
+ * @return Number of words the server rejected, or -1 if the connection failed.
+ */
+static int collect_word_acks(MuxChannel* mux, const int* word_of, int wait) {
+    MessageHeader reply;
+    unsigned int id;
+    int failed = 0;
+    int rc;
+
+    while ((rc = mux_recv_next(mux, &id, &reply, NULL, wait)) > 0) {
+        int word_idx = word_of[id % MUX_MAX_IN_FLIGHT];
+        if (reply.msg_type == MSG_ACK) {
+            printf("\n" ANSI_GREEN "✓ Word %d set" ANSI_RESET, word_idx);
+        } else {
+            printf("\n" ANSI_RED "Word %d: %s" ANSI_RESET, word_idx, get_error_message(reply.error_code));
+            failed++;
+        }
+    }
+    fflush(stdout);
+    return rc < 0 ? -1 : failed;
+}
+
+// Markers in the word-index table of a write batch
+#define BATCH_STEP_LOCK -1
+#define BATCH_STEP_UNLOCK -2
+
+/**
+ * send_write_batch
+ * @brief Send queued write-session steps as one OP_SS_BATCH and report
+ *        the result of each step.
+ *
+ * @param ss_socket Storage server connection.
+ * @param state Client state pointer.
+ * @param filename Target filename.
+ * @param batch Queued steps; emptied on return.
+ * @param word_of Word index of each step, or BATCH_STEP_LOCK/UNLOCK.
+ * @return ERR_SUCCESS if the lock (and unlock, when batched) succeeded,
+ *         otherwise the error that ended the session.
+ */
+static int send_write_batch(int ss_socket, ClientState* state, const char* filename,
+                            BatchBuilder* batch, const int* word_of) {
+    MessageHeader header;
+    init_message_header(&header, MSG_REQUEST, OP_SS_BATCH, state->username);
+    safe_strncpy(header.filename, filename, sizeof(header.filename));
+    header.data_length = batch->len;
+    int count = batch->count;
+    
+    char* response = NULL;
+    int sent = send_message(ss_socket, &header, batch->buf) == 0 &&
+               recv_message(ss_socket, &header, &response) > 0;
+    batch_reset(batch);
+    if (!sent || header.msg_type != MSG_ACK) {
+        int error = sent ? header.error_code : ERR_NETWORK_ERROR;
+        printf("\n");
+        PRINT_ERR("%s", get_error_message(error));
+        if (response) free(response);
+        return error;
+    }
+    
+    int codes[BATCH_MAX_OPS];
+    int n = batch_parse_results(response, codes, BATCH_MAX_OPS);
+    free(response);
+    
+    int result = ERR_SUCCESS;
+    for (int i = 0; i < count; i++) {
+        int code = i < n ? codes[i] : ERR_NETWORK_ERROR;
+        if (word_of[i] == BATCH_STEP_LOCK || word_of[i] == BATCH_STEP_UNLOCK) {
+            if (code != ERR_SUCCESS) {
+                printf("\n");
+                PRINT_ERR("%s", get_error_message(code));
+                result = code;
+                break;
+            }
+            if (word_of[i] == BATCH_STEP_UNLOCK) {
+                printf("\n");
+                PRINT_OK("Write successful!");
+            }
+        } else if (code == ERR_SUCCESS) {
+            printf("\n" ANSI_GREEN "✓ Word %d set" ANSI_RESET, word_of[i]);
+        } else {
+            printf("\n" ANSI_RED "Word %d: %s" ANSI_RESET, word_of[i], get_error_message(code));
+        }
+    }
+    fflush(stdout);
+    return result;
+}
+
 /**
  * execute_write
  * @brief Perform a sentence-level write session against a storage server.
  *
  * Uses helper to connect to storage server, locks the requested sentence,
- * then accepts interactive word-replacement commands until ETIRW.
+ * then accepts interactive word-replacement commands until ETIRW. Word
+ * updates are pipelined on the connection, and all acknowledgements are
+ * collected before the sentence is unlocked. Piped (scripted) input is
+ * sent as OP_SS_BATCH instead: lock, every word and unlock travel in one
+ * best-effort batch, one round trip for the whole session.
  *
  * @param state Client state pointer.
  * @param filename Target filename.
@@ -367,22 +502,53 @@ int execute_write(ClientState* state, const char* filename, int sentence_idx) {
         return result;
     }
     
-    // Lock sentence
-    MessageHeader header;
-    init_message_header(&header, MSG_REQUEST, OP_SS_WRITE_LOCK, state->username);
-    safe_strncpy(header.filename, filename, sizeof(header.filename));
-    header.sentence_index = sentence_idx;
+    // Check for interactive mode
+    int interactive = isatty(STDIN_FILENO);
     
-    send_message(ss_socket, &header, NULL);
+    // Scripted sessions queue every step, starting with the lock
+    BatchBuilder batch;
+    int batch_word_of[BATCH_MAX_OPS];
+    batch_init(&batch);
     
+    MessageHeader header;
     char* response = NULL;
-    recv_message(ss_socket, &header, &response);
-    if (response) free(response);
-    
-    if (header.msg_type != MSG_ACK) {
-        PRINT_ERR("%s", get_error_message(header.error_code));
-        safe_close_socket(&ss_socket);
-        return header.error_code;
+    unsigned long long handle = 0;  // Names the file in later requests, if opened
+    if (interactive) {
+        // On v2, open a file handle in the same round trip as the lock
+        int open_handle = get_socket_protocol(ss_socket) == PROTOCOL_V2;
+        if (open_handle) {
+            init_message_header(&header, MSG_REQUEST, OP_SS_OPEN, state->username);
+            safe_strncpy(header.filename, filename, sizeof(header.filename));
+            send_message(ss_socket, &header, NULL);
+        }
+        
+        // Lock sentence
+        init_message_header(&header, MSG_REQUEST, OP_SS_WRITE_LOCK, state->username);
+        safe_strncpy(header.filename, filename, sizeof(header.filename));
+        header.sentence_index = sentence_idx;
+        
+        send_message(ss_socket, &header, NULL);
+        
+        if (open_handle) {
+            recv_message(ss_socket, &header, &response);
+            if (response) free(response);
+            response = NULL;
+            if (header.msg_type == MSG_ACK) {
+                handle = header.handle;
+            }
+        }
+        
+        recv_message(ss_socket, &header, &response);
+        if (response) free(response);
+        
+        if (header.msg_type != MSG_ACK) {
+            PRINT_ERR("%s", get_error_message(header.error_code));
+            safe_close_socket(&ss_socket);
+            return header.error_code;
+        }
+    } else {
+        batch_add(&batch, OP_SS_WRITE_LOCK, sentence_idx, NULL);
+        batch_word_of[0] = BATCH_STEP_LOCK;
     }
     
     printf(ANSI_BOLD ANSI_CYAN "Interactive Edit Mode" ANSI_RESET "\n");
@@ -395,10 +561,11 @@ int execute_write(ClientState* state, const char* filename, int sentence_idx) {
     
     int success = 0;
     
-    // Enable raw mode for character-by-character input
-    // Check for interactive mode
-    int interactive = isatty(STDIN_FILENO);
+    MuxChannel mux;
+    mux_init(&mux, ss_socket);
+    int word_of[MUX_MAX_IN_FLIGHT];
     
+    // Enable raw mode for character-by-character input
     if (interactive) {
         if (enable_raw_mode() == -1) {
             safe_close_socket(&ss_socket);
@@ -435,6 +602,7 @@ int execute_write(ClientState* state, const char* filename, int sentence_idx) {
                 len--;
             }
             
+            buffer_pos = len;
             submit_buffer = 1;
         }
         
@@ -460,11 +628,26 @@ int execute_write(ClientState* state, const char* filename, int sentence_idx) {
             
             // ALWAYS check for ETIRW first, regardless of flag
             if (strcmp(content_buffer, "ETIRW") == 0 || strcmp(content_buffer, "etirw") == 0) {
+                if (!interactive) {
+                    batch_word_of[batch.count] = BATCH_STEP_UNLOCK;
+                    batch_add(&batch, OP_SS_WRITE_UNLOCK, sentence_idx, NULL);
+                    success = send_write_batch(ss_socket, state, filename, &batch,
+                                               batch_word_of) == ERR_SUCCESS;
+                    break;
+                }
+                
+                // Every pipelined word must be applied before the lock is released
+                if (collect_word_acks(&mux, word_of, 1) < 0) {
+                    printf("\n");
+                    PRINT_ERR("%s", get_error_message(ERR_NETWORK_ERROR));
+                    break;
+                }
+                
                 // Unlock sentence
                 memset(&header, 0, sizeof(header));
                 header.msg_type = MSG_REQUEST;
                 header.op_code = OP_SS_WRITE_UNLOCK;
-                safe_strncpy(header.filename, filename, sizeof(header.filename));
+                set_request_file(&header, filename, handle);
                 safe_strncpy(header.username, state->username, sizeof(header.username));
                 header.sentence_index = sentence_idx;
                 header.data_length = 0;
@@ -545,7 +728,7 @@ int execute_write(ClientState* state, const char* filename, int sentence_idx) {
             memset(&header, 0, sizeof(header));
             header.msg_type = MSG_REQUEST;
             header.op_code = OP_SS_WRITE_WORD;
-            safe_strncpy(header.filename, filename, sizeof(header.filename));
+            set_request_file(&header, filename, handle);
             safe_strncpy(header.username, state->username, sizeof(header.username));
             header.sentence_index = sentence_idx;
             
@@ -563,20 +746,46 @@ int execute_write(ClientState* state, const char* filename, int sentence_idx) {
             snprintf(payload, payload_len, "%d %s", word_idx, new_word);
             header.data_length = strlen(payload);
             
-            send_message(ss_socket, &header, payload);
-            response = NULL;
-            recv_message(ss_socket, &header, &response);
-            if (response) free(response);
+            if (!interactive) {
+                // Queue the word; flush early if the batch would overflow
+                batch_word_of[batch.count] = word_idx;
+                batch_add(&batch, OP_SS_WRITE_WORD, sentence_idx, payload);
+                free(payload);
+                free(new_word);
+                if (batch.count >= BATCH_MAX_OPS - 1 &&
+                    send_write_batch(ss_socket, state, filename, &batch, batch_word_of) != ERR_SUCCESS) {
+                    break;
+                }
+                buffer_pos = 0;
+                content_buffer[0] = '\0';
+                continue;
+            }
             
-            if (header.msg_type == MSG_ACK) {
-                printf("\n" ANSI_GREEN "✓ Word %d set" ANSI_RESET "\n> ", word_idx);
+            // Make room in the pipeline window, then send without waiting
+            int lost = 0;
+            if (mux.in_flight_count >= MUX_MAX_IN_FLIGHT &&
+                collect_word_acks(&mux, word_of, 1) < 0) {
+                lost = 1;
+            }
+            unsigned int request_id = lost ? 0 : mux_send(&mux, &header, payload);
+            if (request_id != 0) {
+                word_of[request_id % MUX_MAX_IN_FLIGHT] = word_idx;
+                // Interactive sessions show each result before the next prompt
+                lost = collect_word_acks(&mux, word_of, interactive) < 0;
             } else {
-                printf("\n" ANSI_RED "%s" ANSI_RESET "\n> ", get_error_message(header.error_code));
+                lost = 1;
             }
             
             free(payload);
             free(new_word);
             
+            if (lost) {
+                printf("\n");
+                PRINT_ERR("%s", get_error_message(ERR_NETWORK_ERROR));
+                break;
+            }
+            printf("\n> ");
+            
             // Reset buffer for next word
             buffer_pos = 0;
             content_buffer[0] = '\0';
@@ -623,6 +832,8 @@ int execute_write(ClientState* state, const char* filename, int sentence_idx) {
     // Restore terminal mode
     disable_raw_mode();
     
+    batch_free(&batch);
+    mux_discard(&mux);
     safe_close_socket(&ss_socket);
     return success ? ERR_SUCCESS : ERR_FILE_OPERATION_FAILED;
 }
@@ -808,6 +1019,31 @@ int execute_list(ClientState* state) {
     return header.error_code;
 }
 
+/**
+ * execute_stats
+ * @brief Request latency and lock-wait statistics from the NM (including
+ *        every active SS) and print the JSON reply.
+ *
+ * @param state Client state pointer.
+ * @return ERR_SUCCESS on success or an ERR_* code on failure.
+ */
+int execute_stats(ClientState* state) {
+    MessageHeader header;
+    init_message_header(&header, MSG_REQUEST, OP_STATS, state->username);
+    
+    char* response = NULL;
+    send_nm_request_and_get_response(state, &header, NULL, &response);
+    
+    if (header.msg_type == MSG_RESPONSE && response) {
+        printf("%s\n", response);
+    } else {
+        PRINT_ERR("%s", get_error_message(header.error_code));
+    }
+    
+    if (response) free(response);
+    return header.error_code;
+}
+
 /**
  * execute_addaccess
  * @brief Request NM to add or update an ACL entry for `username` on `filename`.
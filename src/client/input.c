@@ -15,7 +15,7 @@ static int raw_mode_enabled = 0;
 const char* COMMANDS[] = {
     "acl", "agent", "cat", "checkout", "chmod", "commit",
     "diff", "edit", "exit", "help", "info", "log",
-    "ls", "mkdir", "mv", "open", "quit", "rm", "touch", "undo"
+    "ls", "mkdir", "mv", "open", "quit", "rm", "touch", "undo", "write"
 };
 const int COMMAND_COUNT = sizeof(COMMANDS) / sizeof(COMMANDS[0]);
 
@@ -11,10 +11,13 @@ int main(int argc, char* argv[]) {
     }
 
     // Initialize client state
-    strcpy(client_state.nm_ip, argv[1]);
+    safe_strncpy(client_state.nm_ip, argv[1], sizeof(client_state.nm_ip));
     client_state.nm_port = atoi(argv[2]);
     client_state.is_connected = 0;
     
+    // Let storage servers compress large responses to us
+    set_wire_compression(WIRE_COMPRESS_MIN);
+    
     // Get username
     PRINT_INFO("Enter username:");
     if (fgets(client_state.username, sizeof(client_state.username), stdin) == NULL) {
@@ -30,6 +33,13 @@ int main(int argc, char* argv[]) {
         return 1;
     }
     
+    // Agree on the compact wire format (older Name Servers stay on v1)
+    if (negotiate_protocol(client_state.nm_socket) < 0) {
+        PRINT_ERR("Failed to negotiate protocol with Name Server");
+        close(client_state.nm_socket);
+        return 1;
+    }
+    
     // Register with name server
     MessageHeader header;
     memset(&header, 0, sizeof(header));
@@ -104,6 +114,7 @@ int main(int argc, char* argv[]) {
             printf(ANSI_BOLD ANSI_LAVENDER "  Editor" ANSI_RESET ANSI_SLATE " ────────────────────────\n" ANSI_RESET);
             printf(ANSI_DIM "    open" ANSI_RESET " <file>          View (read-only)\n");
             printf(ANSI_DIM "    edit" ANSI_RESET " <file> <idx>    Edit sentence\n");
+            printf(ANSI_DIM "    write" ANSI_RESET " <file> <idx>   Replace words\n");
             printf(ANSI_DIM "    undo" ANSI_RESET " <file>          Undo last change\n");
             printf("\n");
             
@@ -121,6 +132,7 @@ int main(int argc, char* argv[]) {
             
             printf(ANSI_BOLD ANSI_ROSE "  Other" ANSI_RESET ANSI_SLATE " ─────────────────────────\n" ANSI_RESET);
             printf(ANSI_DIM "    agent" ANSI_RESET " <file> <prompt> Generate with AI\n");
+            printf(ANSI_DIM "    stats" ANSI_RESET "                Server latency stats\n");
             printf("\n");
             
             printf(ANSI_SLATE "  quit/exit/q " ANSI_RESET "Exit  " ANSI_TEAL);
@@ -198,6 +210,14 @@ int main(int argc, char* argv[]) {
                 execute_edit(&client_state, subcommand, sentence_idx);
             }
         }
+        else if (strcmp(command, "write") == 0) {
+            if (subcommand[0] == '\0' || arg1[0] == '\0') {
+                PRINT_ERR("Usage: write <file> <idx>");
+            } else {
+                int sentence_idx = atoi(arg1);
+                execute_write(&client_state, subcommand, sentence_idx);
+            }
+        }
         else if (strcmp(command, "undo") == 0) {
             if (subcommand[0] == '\0') {
                 PRINT_ERR("Usage: undo <file>");
@@ -272,6 +292,10 @@ int main(int argc, char* argv[]) {
             }
         }
         
+        else if (strcmp(command, "stats") == 0) {
+            execute_stats(&client_state);
+        }
+        
         else {
             PRINT_ERR("Unknown command '%s'", command);
             printf("Type 'help' for available commands\n");
@@ -0,0 +1,156 @@
+/*
+ * batch.c - Encoding and decoding of OP_SS_BATCH payloads
+ *
+ * A batch is an ordered list of sub-operations sent as one request. Each
+ * sub-operation is a short text header "<op_code> <sentence_index> <len>\n"
+ * followed by exactly <len> bytes of sub-payload, so sub-payloads may
+ * contain newlines or any other byte. The reply payload lists one decimal
+ * result code per sub-operation, separated by spaces.
+ */
+
+#include "common.h"
+
+/**
+ * batch_init
+ * @brief Initialize an empty batch builder.
+ */
+void batch_init(BatchBuilder* b) {
+    memset(b, 0, sizeof(BatchBuilder));
+}
+
+/**
+ * batch_add
+ * @brief Append a sub-operation to a batch.
+ *
+ * @param b Batch builder.
+ * @param op_code Sub-operation opcode (e.g. OP_SS_WRITE_WORD).
+ * @param sentence_index Sentence the sub-operation applies to.
+ * @param payload Sub-payload, or NULL for none.
+ * @return 0 on success, -1 if the batch is full or memory ran out.
+ */
+int batch_add(BatchBuilder* b, int op_code, int sentence_index, const char* payload) {
+    if (b->count >= BATCH_MAX_OPS) {
+        return -1;
+    }
+
+    size_t payload_len = payload ? strlen(payload) : 0;
+    char head[64];
+    int head_len = snprintf(head, sizeof(head), "%d %d %zu\n", op_code, sentence_index, payload_len);
+
+    size_t need = b->len + head_len + payload_len + 1;
+    if (need > b->cap) {
+        size_t cap = b->cap ? b->cap : 256;
+        while (cap < need) cap *= 2;
+        char* grown = realloc(b->buf, cap);
+        if (!grown) {
+            return -1;
+        }
+        b->buf = grown;
+        b->cap = cap;
+    }
+
+    memcpy(b->buf + b->len, head, head_len);
+    b->len += head_len;
+    if (payload_len > 0) {
+        memcpy(b->buf + b->len, payload, payload_len);
+        b->len += payload_len;
+    }
+    b->buf[b->len] = '\0';
+    b->count++;
+    return 0;
+}
+
+/**
+ * batch_reset
+ * @brief Empty a batch while keeping its buffer for reuse.
+ */
+void batch_reset(BatchBuilder* b) {
+    b->len = 0;
+    b->count = 0;
+    if (b->buf) b->buf[0] = '\0';
+}
+
+/**
+ * batch_free
+ * @brief Release the memory held by a batch builder.
+ */
+void batch_free(BatchBuilder* b) {
+    free(b->buf);
+    batch_init(b);
+}
+
+/**
+ * batch_parse
+ * @brief Split a batch payload into its sub-operations.
+ *
+ * The payload is not modified; each BatchOp points into it.
+ *
+ * @param payload Batch payload bytes.
+ * @param len Number of bytes in payload.
+ * @param ops Output array.
+ * @param max_ops Capacity of ops.
+ * @return Number of sub-operations, or -1 if the payload is malformed or
+ *         holds more than max_ops entries.
+ */
+int batch_parse(const char* payload, size_t len, BatchOp* ops, int max_ops) {
+    size_t pos = 0;
+    int count = 0;
+
+    while (pos < len) {
+        if (count >= max_ops) {
+            return -1;
+        }
+
+        const char* newline = memchr(payload + pos, '\n', len - pos);
+        if (!newline || newline - (payload + pos) >= 64) {
+            return -1;
+        }
+        char head[64];
+        size_t head_len = newline - (payload + pos);
+        memcpy(head, payload + pos, head_len);
+        head[head_len] = '\0';
+
+        int op_code, sentence_index, payload_len;
+        char extra;
+        if (sscanf(head, "%d %d %d%c", &op_code, &sentence_index, &payload_len, &extra) != 3 ||
+            payload_len < 0) {
+            return -1;
+        }
+        pos += head_len + 1;
+        if ((size_t)payload_len > len - pos) {
+            return -1;
+        }
+
+        ops[count].op_code = op_code;
+        ops[count].sentence_index = sentence_index;
+        ops[count].payload = payload + pos;
+        ops[count].payload_len = payload_len;
+        count++;
+        pos += payload_len;
+    }
+    return count;
+}
+
+/**
+ * batch_parse_results
+ * @brief Read the per-operation result codes from a batch reply.
+ *
+ * @param payload Reply payload ("<code> <code> ...").
+ * @param codes Output array.
+ * @param max_codes Capacity of codes.
+ * @return Number of codes read.
+ */
+int batch_parse_results(const char* payload, int* codes, int max_codes) {
+    int count = 0;
+    const char* p = payload;
+    while (p && count < max_codes) {
+        char* end;
+        long code = strtol(p, &end, 10);
+        if (end == p) {
+            break;
+        }
+        codes[count++] = (int)code;
+        p = end;
+    }
+    return count;
+}
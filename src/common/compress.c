@@ -0,0 +1,225 @@
+/*
+ * compress.c - Fast LZ77 block codec for compressed wire frames
+ *
+ * The block format is the one popularised by LZ4: a sequence of
+ * "token, literals, match" records. The token's high nibble is the literal
+ * count and its low nibble the match length minus LZ_MIN_MATCH; a nibble of
+ * 15 is extended by further length bytes (each 255 means "add 255 and read
+ * on"). Every match is a 16-bit little-endian back-offset into the output.
+ * The last record carries only literals, and the final LZ_LAST_LITERALS
+ * bytes of a block are always literals.
+ *
+ * The compressor uses a single-entry hash table of 4-byte sequences and
+ * skips ahead faster the longer it goes without a match (one more byte of
+ * stride every 64 misses), so incompressible input is passed over quickly.
+ * The decompressor checks every length and offset against both buffers, so
+ * corrupt input fails instead of overrunning.
+ */
+
+#include "common.h"
+#include <stdint.h>
+
+#define LZ_MIN_MATCH 4
+#define LZ_LAST_LITERALS 5
+#define LZ_MATCH_FINISH 12 // No match may start in the last 12 bytes
+#define LZ_MAX_OFFSET 65535
+#define LZ_HASH_BITS 12
+
+static uint32_t read32(const unsigned char* p) {
+    uint32_t v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+static uint32_t lz_hash(uint32_t seq) {
+    return (seq * 2654435761u) >> (32 - LZ_HASH_BITS);
+}
+
+// Write the extension bytes of a length whose nibble was saturated
+static unsigned char* put_length(unsigned char* op, size_t len) {
+    while (len >= 255) {
+        *op++ = 255;
+        len -= 255;
+    }
+    *op++ = (unsigned char)len;
+    return op;
+}
+
+// Bytes needed to encode `lit` literals plus a trailing match (worst case)
+static size_t record_size(size_t lit, size_t match_len) {
+    return 1 + (lit >= 15 ? (lit - 15) / 255 + 1 : 0) + lit + 2 +
+           (match_len >= 15 ? (match_len - 15) / 255 + 1 : 0);
+}
+
+/**
+ * lz_compress_bound
+ * @brief Largest possible compressed size of an input of `len` bytes.
+ */
+size_t lz_compress_bound(size_t len) {
+    return len + len / 255 + 16;
+}
+
+/**
+ * lz_decompress_bound
+ * @brief Largest size a block of `len` compressed bytes can decode to.
+ *
+ * Each length-extension byte of 255 adds 255 bytes of output, which is the
+ * most any input byte can produce.
+ */
+size_t lz_decompress_bound(size_t len) {
+    return len * 255;
+}
+
+/**
+ * lz_compress
+ * @brief Compress a block.
+ *
+ * @param src Input bytes.
+ * @param src_len Number of input bytes.
+ * @param dst Output buffer.
+ * @param dst_cap Capacity of dst; lz_compress_bound(src_len) always suffices.
+ * @return Compressed size, or 0 if the output did not fit in dst_cap (pass
+ *         a capacity just under src_len to give up on incompressible data).
+ */
+size_t lz_compress(const char* src, size_t src_len, char* dst, size_t dst_cap) {
+    const unsigned char* in = (const unsigned char*)src;
+    const unsigned char* end = in + src_len;
+    const unsigned char* ip = in;
+    const unsigned char* anchor = in;
+    unsigned char* op = (unsigned char*)dst;
+    unsigned char* oend = op + dst_cap;
+
+    if (src_len > LZ_MATCH_FINISH) {
+        int32_t table[1 << LZ_HASH_BITS];
+        memset(table, 0xff, sizeof(table));  // -1: no candidate yet
+        const unsigned char* match_limit = end - LZ_MATCH_FINISH;
+        const unsigned char* extend_limit = end - LZ_LAST_LITERALS;
+        unsigned int misses = 0;
+
+        while (ip < match_limit) {
+            uint32_t seq = read32(ip);
+            uint32_t h = lz_hash(seq);
+            int32_t ref = table[h];
+            table[h] = (int32_t)(ip - in);
+
+            if (ref < 0 || ip - (in + ref) > LZ_MAX_OFFSET || read32(in + ref) != seq) {
+                ip += 1 + (misses++ >> 6);  // Step grows by one every 64 misses
+                continue;
+            }
+
+            // Grow the match backwards into pending literals, then forwards
+            const unsigned char* match = in + ref;
+            while (ip > anchor && match > in && ip[-1] == match[-1]) {
+                ip--;
+                match--;
+            }
+            const unsigned char* p = ip + LZ_MIN_MATCH;
+            const unsigned char* q = match + LZ_MIN_MATCH;
+            while (p < extend_limit && *p == *q) {
+                p++;
+                q++;
+            }
+
+            size_t lit = ip - anchor;
+            size_t match_len = (p - ip) - LZ_MIN_MATCH;
+            if ((size_t)(oend - op) < record_size(lit, match_len)) {
+                return 0;
+            }
+
+            unsigned char* token = op++;
+            *token = (unsigned char)((lit >= 15 ? 15 : lit) << 4);
+            if (lit >= 15) op = put_length(op, lit - 15);
+            memcpy(op, anchor, lit);
+            op += lit;
+
+            size_t offset = ip - match;
+            *op++ = (unsigned char)(offset & 0xff);
+            *op++ = (unsigned char)(offset >> 8);
+            *token |= (unsigned char)(match_len >= 15 ? 15 : match_len);
+            if (match_len >= 15) op = put_length(op, match_len - 15);
+
+            ip = anchor = p;
+            misses = 0;
+            if (ip < match_limit) {
+                table[lz_hash(read32(ip - 2))] = (int32_t)(ip - 2 - in);
+            }
+        }
+    }
+
+    // Trailing literals
+    size_t lit = end - anchor;
+    if ((size_t)(oend - op) < record_size(lit, 0) - 2) {
+        return 0;
+    }
+    *op++ = (unsigned char)((lit >= 15 ? 15 : lit) << 4);
+    if (lit >= 15) op = put_length(op, lit - 15);
+    memcpy(op, anchor, lit);
+    op += lit;
+
+    return op - (unsigned char*)dst;
+}
+
+// Read the extension bytes of a saturated length nibble
+static int get_length(const unsigned char** ip, const unsigned char* iend, size_t* len) {
+    unsigned char b;
+    do {
+        if (*ip >= iend) return -1;
+        b = *(*ip)++;
+        *len += b;
+    } while (b == 255);
+    return 0;
+}
+
+/**
+ * lz_decompress
+ * @brief Decompress a block produced by lz_compress().
+ *
+ * @param src Compressed bytes.
+ * @param src_len Number of compressed bytes.
+ * @param dst Output buffer.
+ * @param dst_cap Capacity of dst.
+ * @return Decompressed size, or -1 if the block is corrupt or its output
+ *         would exceed dst_cap.
+ */
+long lz_decompress(const char* src, size_t src_len, char* dst, size_t dst_cap) {
+    const unsigned char* ip = (const unsigned char*)src;
+    const unsigned char* iend = ip + src_len;
+    unsigned char* op = (unsigned char*)dst;
+    unsigned char* oend = op + dst_cap;
+
+    while (ip < iend) {
+        unsigned char token = *ip++;
+
+        size_t lit = token >> 4;
+        if (lit == 15 && get_length(&ip, iend, &lit) < 0) return -1;
+        if (lit > (size_t)(iend - ip) || lit > (size_t)(oend - op)) return -1;
+        memcpy(op, ip, lit);
+        op += lit;
+        ip += lit;
+
+        if (ip == iend) {
+            break;  // The last record has no match
+        }
+
+        if (iend - ip < 2) return -1;
+        size_t offset = ip[0] | ((size_t)ip[1] << 8);
+        ip += 2;
+        if (offset == 0 || offset > (size_t)(op - (unsigned char*)dst)) return -1;
+
+        size_t match_len = token & 15;
+        if (match_len == 15 && get_length(&ip, iend, &match_len) < 0) return -1;
+        match_len += LZ_MIN_MATCH;
+        if (match_len > (size_t)(oend - op)) return -1;
+
+        // Overlapping matches (offset < length) repeat the recent bytes
+        const unsigned char* match = op - offset;
+        if (offset >= match_len) {
+            memcpy(op, match, match_len);
+            op += match_len;
+        } else {
+            while (match_len--) *op++ = *match++;
+        }
+    }
+
+    return op - (unsigned char*)dst;
+}
@@ -0,0 +1,221 @@
+/*
+ * deadline.c - Shared timer for socket read deadlines
+ *
+ * Threads that block in recv() arm a Deadline for what they are waiting
+ * for (idle, header, payload). All armed deadlines live in one min-heap
+ * served by a single timer thread, so a deadline costs no thread and no
+ * syscall of its own. When one expires, the timer shuts the socket down:
+ * the blocked recv() returns at once, the owning thread sees the failure,
+ * and deadline_fired() tells it which phase stalled.
+ *
+ * The timer only ever touches sockets that are armed, under the heap lock,
+ * so owners must disarm before closing their socket.
+ */
+
+#include "common.h"
+
+static struct {
+    Deadline** heap;
+    int count;
+    int cap;
+    int started;
+    pthread_mutex_t lock;
+    pthread_cond_t changed;  // The earliest deadline moved or a new one came in
+} timer = { .lock = PTHREAD_MUTEX_INITIALIZER };
+
+static long long now_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000LL + ts.tv_nsec / 1000000;
+}
+
+static void heap_set(int i, Deadline* d) {
+    timer.heap[i] = d;
+    d->heap_index = i;
+}
+
+static void heap_up(int i) {
+    Deadline* d = timer.heap[i];
+    while (i > 0) {
+        int parent = (i - 1) / 2;
+        if (timer.heap[parent]->due_ms <= d->due_ms) break;
+        heap_set(i, timer.heap[parent]);
+        i = parent;
+    }
+    heap_set(i, d);
+}
+
+static void heap_down(int i) {
+    Deadline* d = timer.heap[i];
+    while (1) {
+        int child = 2 * i + 1;
+        if (child >= timer.count) break;
+        if (child + 1 < timer.count && timer.heap[child + 1]->due_ms < timer.heap[child]->due_ms) {
+            child++;
+        }
+        if (timer.heap[child]->due_ms >= d->due_ms) break;
+        heap_set(i, timer.heap[child]);
+        i = child;
+    }
+    heap_set(i, d);
+}
+
+static void heap_remove(Deadline* d) {
+    int i = d->heap_index;
+    Deadline* last = timer.heap[--timer.count];
+    d->heap_index = -1;
+    if (i < timer.count) {
+        heap_set(i, last);
+        heap_up(i);
+        heap_down(last->heap_index);
+    }
+}
+
+static void* timer_main(void* arg) {
+    (void)arg;
+
+    pthread_mutex_lock(&timer.lock);
+    while (1) {
+        if (timer.count == 0) {
+            pthread_cond_wait(&timer.changed, &timer.lock);
+            continue;
+        }
+
+        long long now = now_ms();
+        Deadline* first = timer.heap[0];
+        if (first->due_ms > now) {
+            struct timespec until;
+            clock_gettime(CLOCK_MONOTONIC, &until);
+            long long wait = first->due_ms - now;
+            until.tv_sec += wait / 1000;
+            until.tv_nsec += (wait % 1000) * 1000000;
+            if (until.tv_nsec >= 1000000000) {
+                until.tv_sec++;
+                until.tv_nsec -= 1000000000;
+            }
+            pthread_cond_timedwait(&timer.changed, &timer.lock, &until);
+            continue;
+        }
+
+        // Expired: wake the owner by failing its blocked recv()
+        heap_remove(first);
+        first->fired = first->phase;
+        shutdown(first->fd, SHUT_RDWR);
+    }
+    return NULL;
+}
+
+// Caller holds timer.lock
+static int start_timer(void) {
+    if (timer.started) {
+        return 0;
+    }
+    pthread_condattr_t attr;
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    pthread_cond_init(&timer.changed, &attr);
+    pthread_condattr_destroy(&attr);
+
+    pthread_t thread;
+    if (pthread_create(&thread, NULL, timer_main, NULL) != 0) {
+        return -1;
+    }
+    pthread_detach(thread);
+    timer.started = 1;
+    return 0;
+}
+
+/**
+ * deadline_init
+ * @brief Prepare an unarmed deadline for a socket.
+ *
+ * @param d Deadline, normally on the stack of the thread owning the socket.
+ * @param fd Socket to shut down if the deadline expires.
+ */
+void deadline_init(Deadline* d, int fd) {
+    memset(d, 0, sizeof(Deadline));
+    d->fd = fd;
+    d->heap_index = -1;
+}
+
+/**
+ * deadline_arm
+ * @brief Start (or restart) the clock for the phase the socket is entering.
+ *
+ * Replaces any deadline already armed on d. A timeout of 0 or less means
+ * the phase has no deadline, and just disarms.
+ *
+ * @param d Deadline from deadline_init().
+ * @param phase What the owner now waits for (DEADLINE_IDLE, ...).
+ * @param timeout_ms Time allowed for the phase.
+ * @return 0 on success, -1 if the timer could not be started or grown.
+ */
+int deadline_arm(Deadline* d, int phase, int timeout_ms) {
+    if (timeout_ms <= 0) {
+        deadline_disarm(d);
+        return 0;
+    }
+
+    pthread_mutex_lock(&timer.lock);
+    if (d->fired) {
+        pthread_mutex_unlock(&timer.lock);
+        return 0;  // Already shut down; the owner is about to notice
+    }
+    if (start_timer() < 0) {
+        pthread_mutex_unlock(&timer.lock);
+        return -1;
+    }
+
+    d->phase = phase;
+    d->due_ms = now_ms() + timeout_ms;
+    if (d->heap_index >= 0) {
+        heap_up(d->heap_index);
+        heap_down(d->heap_index);
+    } else {
+        if (timer.count == timer.cap) {
+            int cap = timer.cap ? timer.cap * 2 : 64;
+            Deadline** grown = realloc(timer.heap, cap * sizeof(Deadline*));
+            if (!grown) {
+                pthread_mutex_unlock(&timer.lock);
+                return -1;
+            }
+            timer.heap = grown;
+            timer.cap = cap;
+        }
+        heap_set(timer.count++, d);
+        heap_up(d->heap_index);
+    }
+    if (d->heap_index == 0) {
+        pthread_cond_signal(&timer.changed);
+    }
+    pthread_mutex_unlock(&timer.lock);
+    return 0;
+}
+
+/**
+ * deadline_disarm
+ * @brief Stop the clock. Must be called before the socket is closed.
+ *
+ * @param d Deadline from deadline_init().
+ */
+void deadline_disarm(Deadline* d) {
+    pthread_mutex_lock(&timer.lock);
+    if (d->heap_index >= 0) {
+        heap_remove(d);
+    }
+    pthread_mutex_unlock(&timer.lock);
+}
+
+/**
+ * deadline_fired
+ * @brief Which phase, if any, ran out of time.
+ *
+ * @param d Deadline from deadline_init().
+ * @return The expired phase, or 0 if the deadline never fired.
+ */
+int deadline_fired(Deadline* d) {
+    pthread_mutex_lock(&timer.lock);
+    int fired = d->fired;
+    pthread_mutex_unlock(&timer.lock);
+    return fired;
+}
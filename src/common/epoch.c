@@ -0,0 +1,193 @@
+/*
+ * epoch.c - Epoch-based reclamation for lock-free readers
+ *
+ * Readers of a structure that writers change by publishing new versions
+ * (a pointer swap) wrap each access in epoch_enter()/epoch_exit(). A writer
+ * that unlinks an old version hands it to epoch_retire() instead of freeing
+ * it; it is freed once no reader can still be looking at it.
+ *
+ * Each thread owns a slot holding the global epoch it saw when it entered,
+ * or 0 while it is outside. The global epoch only advances when every
+ * thread inside has seen the current one, so after two advances every
+ * reader that was inside when an object was retired has left. Readers never
+ * wait and never write shared memory other than their own slot.
+ *
+ * Read sections nest, must be short and must not block: a reader stuck
+ * inside holds back every retired object.
+ */
+
+#include "common.h"
+
+typedef struct EpochSlot {
+    struct EpochSlot* next;  // All slots ever created; never freed
+    unsigned long epoch;     // Global epoch seen on entry, 0 when outside
+    int depth;               // Nesting of read sections, owner only
+    int in_use;              // Owned by a live thread
+} EpochSlot;
+
+typedef struct Retired {
+    struct Retired* next;
+    void* ptr;
+    void (*free_fn)(void*);
+    unsigned long epoch;     // Global epoch when it was retired
+} Retired;
+
+static EpochSlot* slots;
+static unsigned long global_epoch = 1;
+static Retired* retired;     // Newest first, so epochs never increase
+static pthread_mutex_t retire_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_key_t slot_key;
+static pthread_once_t slot_key_once = PTHREAD_ONCE_INIT;
+static __thread EpochSlot* my_slot;
+
+// Thread exit: the slot can be taken over by the next new thread
+static void release_slot(void* arg) {
+    EpochSlot* slot = (EpochSlot*)arg;
+    __atomic_store_n(&slot->epoch, 0, __ATOMIC_RELEASE);
+    __atomic_store_n(&slot->in_use, 0, __ATOMIC_RELEASE);
+}
+
+static void create_slot_key(void) {
+    pthread_key_create(&slot_key, release_slot);
+}
+
+static EpochSlot* get_slot(void) {
+    if (my_slot) {
+        return my_slot;
+    }
+    pthread_once(&slot_key_once, create_slot_key);
+
+    // Reuse a slot left by an exited thread before growing the list
+    EpochSlot* slot = NULL;
+    for (EpochSlot* s = __atomic_load_n(&slots, __ATOMIC_ACQUIRE); s; s = s->next) {
+        int free_slot = 0;
+        if (__atomic_compare_exchange_n(&s->in_use, &free_slot, 1, 0,
+                                        __ATOMIC_ACQ_REL, __ATOMIC_RELAXED)) {
+            slot = s;
+            break;
+        }
+    }
+    if (!slot) {
+        slot = calloc(1, sizeof(EpochSlot));
+        if (!slot) {
+            abort();  // A reader without a slot could see freed memory
+        }
+        slot->in_use = 1;
+        slot->next = __atomic_load_n(&slots, __ATOMIC_RELAXED);
+        while (!__atomic_compare_exchange_n(&slots, &slot->next, slot, 1,
+                                            __ATOMIC_RELEASE, __ATOMIC_RELAXED)) {
+        }
+    }
+
+    pthread_setspecific(slot_key, slot);
+    my_slot = slot;
+    return slot;
+}
+
+/**
+ * epoch_enter
+ * @brief Start a read section: nothing retired from now on is freed before
+ *        the matching epoch_exit().
+ */
+void epoch_enter(void) {
+    EpochSlot* slot = get_slot();
+    if (slot->depth++ > 0) {
+        return;
+    }
+    __atomic_store_n(&slot->epoch, __atomic_load_n(&global_epoch, __ATOMIC_RELAXED),
+                     __ATOMIC_RELAXED);
+    // Order the slot store before the reader's loads of shared pointers;
+    // pairs with the fence in epoch_reclaim()
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+}
+
+/**
+ * epoch_exit
+ * @brief End the read section started by the matching epoch_enter().
+ */
+void epoch_exit(void) {
+    EpochSlot* slot = my_slot;
+    if (--slot->depth == 0) {
+        __atomic_store_n(&slot->epoch, 0, __ATOMIC_RELEASE);
+    }
+}
+
+// Advance the global epoch if every thread inside has seen it. Caller holds
+// retire_lock, so there is one advancer at a time.
+static int try_advance(void) {
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    unsigned long current = __atomic_load_n(&global_epoch, __ATOMIC_RELAXED);
+    for (EpochSlot* s = __atomic_load_n(&slots, __ATOMIC_ACQUIRE); s; s = s->next) {
+        unsigned long seen = __atomic_load_n(&s->epoch, __ATOMIC_ACQUIRE);
+        if (seen != 0 && seen != current) {
+            return 0;
+        }
+    }
+    __atomic_store_n(&global_epoch, current + 1, __ATOMIC_RELEASE);
+    return 1;
+}
+
+/**
+ * epoch_reclaim
+ * @brief Free every retired object no reader can still see.
+ *
+ * Called by epoch_retire(); exposed so writers can flush after a burst and
+ * so tests can drive it.
+ *
+ * @return Number of objects freed.
+ */
+int epoch_reclaim(void) {
+    pthread_mutex_lock(&retire_lock);
+
+    // Two advances cover readers that entered before the newest retire
+    for (int i = 0; i < 2 && retired && try_advance(); i++) {
+    }
+
+    // Objects retired two or more epochs ago are unreachable
+    unsigned long current = __atomic_load_n(&global_epoch, __ATOMIC_RELAXED);
+    Retired** link = &retired;
+    while (*link && (*link)->epoch + 2 > current) {
+        link = &(*link)->next;
+    }
+    Retired* expired = *link;
+    *link = NULL;
+    pthread_mutex_unlock(&retire_lock);
+
+    int freed = 0;
+    while (expired) {
+        Retired* next = expired->next;
+        expired->free_fn(expired->ptr);
+        free(expired);
+        expired = next;
+        freed++;
+    }
+    return freed;
+}
+
+/**
+ * epoch_retire
+ * @brief Free `ptr` with `free_fn` once no reader can still see it.
+ *
+ * The caller must already have unlinked `ptr` from everything readers can
+ * reach. Must not be called inside a read section of the same thread, or
+ * the object waits for that section too (it is still freed later).
+ *
+ * @param ptr Object to free.
+ * @param free_fn Function that frees it, e.g. free.
+ */
+void epoch_retire(void* ptr, void (*free_fn)(void*)) {
+    Retired* node = malloc(sizeof(Retired));
+    if (!node) {
+        return;  // Leak it: freeing now could pull memory from under a reader
+    }
+    node->ptr = ptr;
+    node->free_fn = free_fn;
+
+    pthread_mutex_lock(&retire_lock);
+    node->epoch = __atomic_load_n(&global_epoch, __ATOMIC_RELAXED);
+    node->next = retired;
+    retired = node;
+    pthread_mutex_unlock(&retire_lock);
+
+    epoch_reclaim();
+}
@@ -0,0 +1,67 @@
+/*
+ * load_report.c - Encoding and decoding of heartbeat load reports
+ *
+ * A report is one line of text: the word "LOAD" followed by space-separated
+ * key=value pairs. Decoding ignores keys it does not know and leaves fields
+ * that are absent at zero, so either side can be upgraded first.
+ */
+
+#include "common.h"
+
+/**
+ * format_load_report
+ * @brief Encode a load report as a heartbeat payload.
+ *
+ * @param report Report to encode.
+ * @param out Output buffer; LOAD_REPORT_MAX bytes always suffice.
+ * @param size Size of out.
+ * @return Length of the payload, or -1 if it did not fit.
+ */
+int format_load_report(const LoadReport* report, char* out, size_t size) {
+    int n = snprintf(out, size,
+                     "LOAD workers=%d active=%d queue=%d disk_free=%llu read=%llu written=%llu p99_us=%d ops=%d",
+                     report->workers, report->active, report->queue_depth, report->disk_free,
+                     report->bytes_read, report->bytes_written, report->p99_us, report->ops);
+    return (n < 0 || (size_t)n >= size) ? -1 : n;
+}
+
+static int key_is(const char* key, size_t len, const char* name) {
+    return strlen(name) == len && strncmp(key, name, len) == 0;
+}
+
+/**
+ * parse_load_report
+ * @brief Decode a heartbeat payload produced by format_load_report().
+ *
+ * @param payload NUL-terminated payload.
+ * @param report Out: decoded report (unknown keys skipped, missing ones 0).
+ * @return 0 on success, -1 if the payload is not a load report.
+ */
+int parse_load_report(const char* payload, LoadReport* report) {
+    memset(report, 0, sizeof(LoadReport));
+    if (!payload || strncmp(payload, "LOAD", 4) != 0 || (payload[4] != ' ' && payload[4] != '\0')) {
+        return -1;
+    }
+
+    const char* p = payload + 4;
+    while (*p) {
+        while (*p == ' ') p++;
+        const char* key = p;
+        const char* eq = strchr(p, '=');
+        if (!eq) break;
+        size_t key_len = eq - key;
+        unsigned long long value = strtoull(eq + 1, (char**)&p, 10);
+
+        if (key_is(key, key_len, "workers")) report->workers = (int)value;
+        else if (key_is(key, key_len, "active")) report->active = (int)value;
+        else if (key_is(key, key_len, "queue")) report->queue_depth = (int)value;
+        else if (key_is(key, key_len, "disk_free")) report->disk_free = value;
+        else if (key_is(key, key_len, "read")) report->bytes_read = value;
+        else if (key_is(key, key_len, "written")) report->bytes_written = value;
+        else if (key_is(key, key_len, "p99_us")) report->p99_us = (int)value;
+        else if (key_is(key, key_len, "ops")) report->ops = (int)value;
+
+        while (*p && *p != ' ') p++;  // Skip anything unparsed in this pair
+    }
+    return 0;
+}
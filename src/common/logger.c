@@ -1,7 +1,25 @@
+/*
+ * logger.c - Asynchronous logging to the console and logs/<component>.log
+ *
+ * log_message() and log_operation() only copy the line into a ring of
+ * LOG_RING_SLOTS slots and return. A single flusher thread drains the ring,
+ * formats the timestamps, and writes each batch with one write() per log
+ * file (the files stay open) and one fwrite() to stdout.
+ *
+ * The ring is a bounded multi-producer, single-consumer queue: a producer
+ * claims a ticket by advancing `tail` with a compare-and-swap, fills the
+ * slot, and publishes it by storing the slot's sequence number, so no lock
+ * is taken on the logging path. When the ring is full, INFO and DEBUG lines
+ * are dropped (the flusher reports how many) while WARN and ERROR lines wait
+ * for the flusher to make room. log_flush() waits until everything logged
+ * so far is written; it runs at exit.
+ */
+
 #include "common.h"
+#include <sched.h>
 
-/* Thread-safe logging mutex used by the logging functions. */
-static pthread_mutex_t log_mutex = PTHREAD_MUTEX_INITIALIZER;
+#define LOG_MAX_FILES 8             // Components with an open log file
+#define LOG_BATCH_BYTES (64 * 1024) // Written out once this much is pending
 
 /* Global flag to enable/disable colorized console output. Default enabled. */
 int enable_colors = 1;
@@ -9,13 +27,332 @@ int enable_colors = 1;
 /* Global flag for debug mode. Default disabled. */
 int debug_mode = 0;
 
+typedef struct {
+    unsigned long seq;  // == ticket: free for it; == ticket + 1: holds its line
+    time_t when;
+    char component[16];
+    char level[8];
+    char message[LOG_LINE_MAX];
+} LogSlot;
+
+static struct {
+    LogSlot slots[LOG_RING_SLOTS];
+    unsigned long tail;     // Next ticket to claim (producers)
+    unsigned long head;     // Next ticket to write (flusher)
+    unsigned long dropped;  // Lines dropped since the last report
+    int idle;               // Flusher is waiting for lines
+    int running;            // Flusher thread started; 0 means log synchronously
+    pthread_mutex_t lock;   // Flusher sleep/wakeup and the synchronous fallback
+    pthread_cond_t wake;    // Lines were published
+    pthread_cond_t drained; // The flusher went idle
+} ring = {
+    .lock = PTHREAD_MUTEX_INITIALIZER,
+    .wake = PTHREAD_COND_INITIALIZER,
+    .drained = PTHREAD_COND_INITIALIZER,
+};
+
+static pthread_once_t ring_once = PTHREAD_ONCE_INIT;
+
+// Pending output of the flusher (or of the synchronous fallback, under lock)
+typedef struct {
+    char component[16];
+    int fd;
+    char buf[LOG_BATCH_BYTES];
+    size_t len;
+} LogFile;
+
+static LogFile log_files[LOG_MAX_FILES];
+static int log_file_count;
+static char console_buf[LOG_BATCH_BYTES];
+static size_t console_len;
+
+static const char* level_color(const char* level) {
+    if (strcmp(level, "ERROR") == 0) return ANSI_BRIGHT_RED;
+    if (strcmp(level, "WARN") == 0) return ANSI_YELLOW;
+    if (strcmp(level, "INFO") == 0) return ANSI_CYAN;
+    if (strcmp(level, "DEBUG") == 0) return ANSI_BRIGHT_BLACK;
+    return ANSI_RESET;
+}
+
+static void write_all(int fd, const char* data, size_t len) {
+    while (len > 0) {
+        ssize_t n = write(fd, data, len);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return;
+        data += n;
+        len -= n;
+    }
+}
+
+static void flush_console(void) {
+    if (console_len > 0) {
+        fwrite(console_buf, 1, console_len, stdout);
+        fflush(stdout);
+        console_len = 0;
+    }
+}
+
+static void flush_file(LogFile* f) {
+    if (f->len == 0) return;
+    if (f->fd < 0) {
+        // logs/ may not exist yet; try again with every batch
+        char filename[128];
+        snprintf(filename, sizeof(filename), "logs/%s.log", f->component);
+        f->fd = open(filename, O_WRONLY | O_APPEND | O_CREAT | O_CLOEXEC, 0666);
+    }
+    if (f->fd >= 0) {
+        write_all(f->fd, f->buf, f->len);
+    }
+    f->len = 0;
+}
+
+static LogFile* find_log_file(const char* component) {
+    for (int i = 0; i < log_file_count; i++) {
+        if (strcmp(log_files[i].component, component) == 0) {
+            return &log_files[i];
+        }
+    }
+    if (log_file_count == LOG_MAX_FILES) {
+        return NULL;
+    }
+    LogFile* f = &log_files[log_file_count++];
+    safe_strncpy(f->component, component, sizeof(f->component));
+    f->fd = -1;
+    f->len = 0;
+    return f;
+}
+
+// Append one line to the console and file batches
+static void format_line(time_t when, const char* component, const char* level,
+                        const char* message) {
+    static time_t cached_when = -1;
+    static char timestamp[64];
+    if (when != cached_when) {
+        struct tm tm;
+        localtime_r(&when, &tm);
+        strftime(timestamp, sizeof(timestamp), "%Y-%m-%d %H:%M:%S", &tm);
+        cached_when = when;
+    }
+
+    size_t room = LOG_LINE_MAX + 256;
+    if (sizeof(console_buf) - console_len < room) {
+        flush_console();
+    }
+    if (enable_colors) {
+        console_len += snprintf(console_buf + console_len, sizeof(console_buf) - console_len,
+                                "%s[%s]%s %s[%s]%s %s[%s]%s %s\n",
+                                ANSI_BRIGHT_BLACK, timestamp, ANSI_RESET,
+                                ANSI_BLUE, component, ANSI_RESET,
+                                level_color(level), level, ANSI_RESET,
+                                message);
+    } else {
+        console_len += snprintf(console_buf + console_len, sizeof(console_buf) - console_len,
+                                "[%s] [%s] [%s] %s\n", timestamp, component, level, message);
+    }
+
+    LogFile* f = find_log_file(component);
+    if (!f) {
+        // More components than open files: write this one through at once
+        char filename[128];
+        snprintf(filename, sizeof(filename), "logs/%s.log", component);
+        int fd = open(filename, O_WRONLY | O_APPEND | O_CREAT | O_CLOEXEC, 0666);
+        if (fd >= 0) {
+            dprintf(fd, "[%s] [%s] %s\n", timestamp, level, message);
+            close(fd);
+        }
+        return;
+    }
+    if (sizeof(f->buf) - f->len < room) {
+        flush_file(f);
+    }
+    f->len += snprintf(f->buf + f->len, sizeof(f->buf) - f->len, "[%s] [%s] %s\n",
+                       timestamp, level, message);
+}
+
+static void flush_batches(void) {
+    flush_console();
+    for (int i = 0; i < log_file_count; i++) {
+        flush_file(&log_files[i]);
+    }
+}
+
+static int slot_ready(unsigned long ticket) {
+    LogSlot* slot = &ring.slots[ticket & (LOG_RING_SLOTS - 1)];
+    return __atomic_load_n(&slot->seq, __ATOMIC_SEQ_CST) == ticket + 1;
+}
+
+/**
+ * drain_ring
+ * @brief Write out every published line. Flusher thread only.
+ *
+ * @return Number of lines written.
+ */
+static int drain_ring(void) {
+    int count = 0;
+    static char last_component[16] = "LOG";  // Where a drop report goes
+    unsigned long head = ring.head;
+
+    while (count < LOG_RING_SLOTS && slot_ready(head)) {
+        LogSlot* slot = &ring.slots[head & (LOG_RING_SLOTS - 1)];
+        format_line(slot->when, slot->component, slot->level, slot->message);
+        safe_strncpy(last_component, slot->component, sizeof(last_component));
+
+        // Hand the slot back for the ticket one lap ahead
+        __atomic_store_n(&slot->seq, head + LOG_RING_SLOTS, __ATOMIC_RELEASE);
+        head++;
+        count++;
+    }
+    __atomic_store_n(&ring.head, head, __ATOMIC_RELEASE);
+
+    unsigned long dropped = __atomic_exchange_n(&ring.dropped, 0, __ATOMIC_RELAXED);
+    if (dropped > 0) {
+        char msg[128];
+        snprintf(msg, sizeof(msg), "[LOG] Log buffer full: dropped %lu INFO/DEBUG lines", dropped);
+        format_line(time(NULL), last_component, "WARN", msg);
+    }
+    if (count > 0 || dropped > 0) {
+        flush_batches();
+    }
+    return count;
+}
+
+static void* flusher_main(void* arg) {
+    (void)arg;
+
+    while (1) {
+        if (drain_ring() > 0) {
+            continue;
+        }
+
+        pthread_mutex_lock(&ring.lock);
+        __atomic_store_n(&ring.idle, 1, __ATOMIC_SEQ_CST);
+        pthread_cond_broadcast(&ring.drained);
+        if (!slot_ready(ring.head)) {
+            // Producers signal when they see idle set; the timeout is a safety net
+            struct timespec until;
+            clock_gettime(CLOCK_REALTIME, &until);
+            until.tv_sec += 1;
+            pthread_cond_timedwait(&ring.wake, &ring.lock, &until);
+        }
+        __atomic_store_n(&ring.idle, 0, __ATOMIC_SEQ_CST);
+        pthread_mutex_unlock(&ring.lock);
+    }
+    return NULL;
+}
+
+static void ring_init(void) {
+    for (unsigned long i = 0; i < LOG_RING_SLOTS; i++) {
+        ring.slots[i].seq = i;
+    }
+
+    pthread_t thread;
+    if (pthread_create(&thread, NULL, flusher_main, NULL) == 0) {
+        pthread_detach(thread);
+        ring.running = 1;
+        atexit(log_flush);
+    }
+}
+
+static void wake_flusher(void) {
+    if (__atomic_load_n(&ring.idle, __ATOMIC_SEQ_CST)) {
+        pthread_mutex_lock(&ring.lock);
+        pthread_cond_signal(&ring.wake);
+        pthread_mutex_unlock(&ring.lock);
+    }
+}
+
+/**
+ * log_submit
+ * @brief Queue one line for the flusher.
+ *
+ * @param may_drop Nonzero if the line may be dropped when the ring is full;
+ *                 otherwise the caller waits for room.
+ */
+static void log_submit(const char* component, const char* level, const char* message,
+                       int may_drop) {
+    pthread_once(&ring_once, ring_init);
+    time_t now = time(NULL);
+
+    if (!ring.running) {
+        // No flusher thread: write through, one line at a time
+        pthread_mutex_lock(&ring.lock);
+        format_line(now, component, level, message);
+        flush_batches();
+        pthread_mutex_unlock(&ring.lock);
+        return;
+    }
+
+    unsigned long ticket = __atomic_load_n(&ring.tail, __ATOMIC_RELAXED);
+    int waits = 0;
+    while (1) {
+        LogSlot* slot = &ring.slots[ticket & (LOG_RING_SLOTS - 1)];
+        long diff = (long)(__atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE) - ticket);
+
+        if (diff == 0) {
+            if (!__atomic_compare_exchange_n(&ring.tail, &ticket, ticket + 1, 1,
+                                             __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+                continue;  // Lost the race; ticket now holds the current tail
+            }
+            slot->when = now;
+            safe_strncpy(slot->component, component, sizeof(slot->component));
+            safe_strncpy(slot->level, level, sizeof(slot->level));
+            safe_strncpy(slot->message, message, sizeof(slot->message));
+            __atomic_store_n(&slot->seq, ticket + 1, __ATOMIC_SEQ_CST);
+            wake_flusher();
+            return;
+        }
+
+        if (diff < 0) {
+            // Full: the slot still holds the line from one lap ago
+            if (may_drop) {
+                __atomic_add_fetch(&ring.dropped, 1, __ATOMIC_RELAXED);
+                return;
+            }
+            wake_flusher();
+            if (++waits < 16) {
+                sched_yield();
+            } else {
+                usleep(100);
+            }
+        }
+        ticket = __atomic_load_n(&ring.tail, __ATOMIC_RELAXED);
+    }
+}
+
+/**
+ * log_flush
+ * @brief Wait until every line logged before the call has been written.
+ *
+ * Registered with atexit(), so lines logged right before exit() are kept.
+ */
+void log_flush(void) {
+    if (!ring.running) {
+        return;
+    }
+    unsigned long target = __atomic_load_n(&ring.tail, __ATOMIC_ACQUIRE);
+
+    pthread_mutex_lock(&ring.lock);
+    while ((long)(__atomic_load_n(&ring.head, __ATOMIC_ACQUIRE) - target) < 0) {
+        pthread_cond_signal(&ring.wake);
+        struct timespec until;
+        clock_gettime(CLOCK_REALTIME, &until);
+        until.tv_nsec += 10 * 1000000;
+        if (until.tv_nsec >= 1000000000) {
+            until.tv_sec++;
+            until.tv_nsec -= 1000000000;
+        }
+        pthread_cond_timedwait(&ring.drained, &ring.lock, &until);
+    }
+    pthread_mutex_unlock(&ring.lock);
+}
+
 /**
  * log_message
  * @brief Simple timestamp + component + level + message logging.
  *        Format: [timestamp] [component] [level] message
  *
- * This function acquires an internal mutex to ensure log lines are not
- * interleaved when called from multiple threads.
+ * Queues the line for the flusher thread and returns without blocking,
+ * except for WARN and ERROR lines when the log buffer is full.
  *
  * @param component Short component name (e.g., "NM", "SS", "CL") used to
  *                  name the logfile and tag the message.
@@ -28,54 +365,16 @@ void log_message(const char* component, const char* level, const char* message)
         return;
     }
 
-    pthread_mutex_lock(&log_mutex);
-    
-    time_t now = time(NULL);
-    char timestamp[64];
-    strftime(timestamp, sizeof(timestamp), "%Y-%m-%d %H:%M:%S", localtime(&now));
-    
-    // Determine color based on level
-    const char* level_color = ANSI_RESET;
-    if (strcmp(level, "ERROR") == 0) {
-        level_color = ANSI_BRIGHT_RED;
-    } else if (strcmp(level, "WARN") == 0) {
-        level_color = ANSI_YELLOW;
-    } else if (strcmp(level, "INFO") == 0) {
-        level_color = ANSI_CYAN;
-    } else if (strcmp(level, "DEBUG") == 0) {
-        level_color = ANSI_BRIGHT_BLACK;
-    }
-
-    // Print to console with colors (if enabled)
-    if (enable_colors) {
-        printf("%s[%s]%s %s[%s]%s %s[%s]%s %s\n", 
-               ANSI_BRIGHT_BLACK, timestamp, ANSI_RESET,
-               ANSI_BLUE, component, ANSI_RESET,
-               level_color, level, ANSI_RESET,
-               message);
-    } else {
-        printf("[%s] [%s] [%s] %s\n", timestamp, component, level, message);
-    }
-    fflush(stdout);
-    
-    // Write to log file
-    char filename[128];
-    snprintf(filename, sizeof(filename), "logs/%s.log", component);
-    FILE* f = fopen(filename, "a");
-    if (f) {
-        fprintf(f, "[%s] [%s] %s\n", timestamp, level, message);
-        fclose(f);
-    }
-    
-    pthread_mutex_unlock(&log_mutex);
+    log_submit(component, level, message,
+               strcmp(level, "WARN") != 0 && strcmp(level, "ERROR") != 0);
 }
 
 /**
  * log_operation
  * @brief Enhanced logging with operation details, user, IP, port, and error codes.
- * 
+ *
  * Format: [timestamp] [component] [level] [operation] user=X ip=X:port details | status
- * 
+ *
  * @param component Component name ("NM", "SS", "CLIENT")
  * @param level Log level ("INFO", "ERROR", "WARN", "DEBUG")
  * @param operation Operation name (e.g., "CREATE", "READ", "SS_REGISTER")
@@ -86,26 +385,20 @@ void log_message(const char* component, const char* level, const char* message)
  * @param error_code Error code (0 for success, or ERR_* codes)
  */
 void log_operation(const char* component, const char* level, const char* operation,
-                   const char* username, const char* ip, int port, 
+                   const char* username, const char* ip, int port,
                    const char* details, int error_code) {
-    pthread_mutex_lock(&log_mutex);
-    
-    time_t now = time(NULL);
-    char timestamp[64];
-    strftime(timestamp, sizeof(timestamp), "%Y-%m-%d %H:%M:%S", localtime(&now));
-    
     // Build detailed message
-    char message[2048];
+    char message[LOG_LINE_MAX];
     int offset = 0;
-    
+
     // Operation
     offset += snprintf(message + offset, sizeof(message) - offset, "[%s]", operation);
-    
+
     // Username
     if (username && username[0]) {
         offset += snprintf(message + offset, sizeof(message) - offset, " user=%s", username);
     }
-    
+
     // IP and port
     if (ip && ip[0]) {
         if (port > 0) {
@@ -114,52 +407,20 @@ void log_operation(const char* component, const char* level, const char* operati
             offset += snprintf(message + offset, sizeof(message) - offset, " from=%s", ip);
         }
     }
-    
+
     // Details
     if (details && details[0]) {
         offset += snprintf(message + offset, sizeof(message) - offset, " | %s", details);
     }
-    
+
     // Status
     if (error_code == 0) {
         offset += snprintf(message + offset, sizeof(message) - offset, " | SUCCESS");
     } else {
-        offset += snprintf(message + offset, sizeof(message) - offset, 
+        offset += snprintf(message + offset, sizeof(message) - offset,
                           " | FAILED (error=%d: %s)", error_code, get_error_message(error_code));
     }
-    
-    // Determine color based on level
-    const char* level_color = ANSI_RESET;
-    if (strcmp(level, "ERROR") == 0) {
-        level_color = ANSI_BRIGHT_RED;
-    } else if (strcmp(level, "WARN") == 0) {
-        level_color = ANSI_YELLOW;
-    } else if (strcmp(level, "INFO") == 0) {
-        level_color = ANSI_CYAN;
-    } else if (strcmp(level, "DEBUG") == 0) {
-        level_color = ANSI_BRIGHT_BLACK;
-    }
-    
-    // Print to console with colors
-    if (enable_colors) {
-        printf("%s[%s]%s %s[%s]%s %s[%s]%s %s\n", 
-               ANSI_BRIGHT_BLACK, timestamp, ANSI_RESET,
-               ANSI_BLUE, component, ANSI_RESET,
-               level_color, level, ANSI_RESET,
-               message);
-    } else {
-        printf("[%s] [%s] [%s] %s\n", timestamp, component, level, message);
-    }
-    fflush(stdout);
-    
-    // Write to log file
-    char filename[128];
-    snprintf(filename, sizeof(filename), "logs/%s.log", component);
-    FILE* f = fopen(filename, "a");
-    if (f) {
-        fprintf(f, "[%s] [%s] %s\n", timestamp, level, message);
-        fclose(f);
-    }
-    
-    pthread_mutex_unlock(&log_mutex);
+
+    log_submit(component, level, message,
+               strcmp(level, "WARN") != 0 && strcmp(level, "ERROR") != 0);
 }
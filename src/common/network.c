@@ -1,112 +1,1979 @@
+#define _GNU_SOURCE // splice()
 #include "common.h"
+#include <limits.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <signal.h>
+#include <sys/sendfile.h>
+#include <stdint.h>
+
+/*
+ * Per-socket wire protocol version.
+ *
+ * Initiators set the version after negotiating (or learning it out of band);
+ * receivers mirror whatever framing the peer last used. Unknown sockets and
+ * descriptors beyond the table default to PROTOCOL_V1.
+ */
+static unsigned char socket_protocol[MAX_TRACKED_SOCKETS];
+
+/*
+ * Request ID of the last request received on each socket. Replies sent on
+ * that socket without an explicit ID echo it, so server handlers built for
+ * lockstep request/response get multiplexing support for free.
+ */
+static unsigned int socket_request_id[MAX_TRACKED_SOCKETS];
+
+/*
+ * SOCKET_ROLE_* of each socket. Bulk sockets stay corked, so file payloads
+ * sent on them need no extra cork/uncork pair of their own.
+ */
+static unsigned char socket_role[MAX_TRACKED_SOCKETS];
+
+/*
+ * Whether the peer on each socket decodes compressed frames, as learned from
+ * WIRE_FRAME_ACCEPTS_LZ on the last frame it sent (or set out of band).
+ */
+static unsigned char socket_compress[MAX_TRACKED_SOCKETS];
+
+/*
+ * Smallest payload this process compresses; 0 disables compression, and
+ * then WIRE_FRAME_ACCEPTS_LZ is not advertised either. Compressed frames
+ * are always decoded, whatever this is set to.
+ */
+static int wire_compress_min;
+
+/**
+ * set_socket_protocol
+ * @brief Record the wire protocol version to use when sending on a socket.
+ *
+ * Also forgets whether the peer decodes compressed frames; that is relearned
+ * from the peer's next frame (or restored with set_socket_compression()).
+ *
+ * @param sockfd Socket file descriptor.
+ * @param version PROTOCOL_V1 or PROTOCOL_V2.
+ */
+void set_socket_protocol(int sockfd, int version) {
+    if (sockfd < 0 || sockfd >= MAX_TRACKED_SOCKETS) {
+        return;
+    }
+    socket_protocol[sockfd] = (version == PROTOCOL_V2) ? PROTOCOL_V2 : PROTOCOL_V1;
+    socket_compress[sockfd] = 0;
+}
+
+/**
+ * get_socket_protocol
+ * @brief Return the wire protocol version currently used on a socket.
+ *
+ * @param sockfd Socket file descriptor.
+ * @return PROTOCOL_V2 if negotiated/mirrored, PROTOCOL_V1 otherwise.
+ */
+int get_socket_protocol(int sockfd) {
+    if (sockfd < 0 || sockfd >= MAX_TRACKED_SOCKETS) {
+        return PROTOCOL_V1;
+    }
+    return socket_protocol[sockfd] == PROTOCOL_V2 ? PROTOCOL_V2 : PROTOCOL_V1;
+}
+
+/**
+ * set_wire_compression
+ * @brief Enable or disable payload compression for this process.
+ *
+ * When enabled, every v2 frame advertises WIRE_FRAME_ACCEPTS_LZ, and
+ * payloads of at least min_bytes sent to peers that advertised the same are
+ * compressed (see WIRE_FRAME_COMPRESSED).
+ *
+ * @param min_bytes Smallest payload worth compressing; 0 disables.
+ */
+void set_wire_compression(int min_bytes) {
+    wire_compress_min = min_bytes > 0 ? min_bytes : 0;
+}
+
+/**
+ * set_socket_compression
+ * @brief Record whether the peer on a socket decodes compressed frames.
+ *
+ * Normally learned from the peer's frames; use this to reuse what an
+ * earlier connection to the same peer revealed, before its first reply.
+ *
+ * @param sockfd Socket file descriptor.
+ * @param peer_accepts Non-zero if the peer decodes compressed frames.
+ */
+void set_socket_compression(int sockfd, int peer_accepts) {
+    if (sockfd >= 0 && sockfd < MAX_TRACKED_SOCKETS) {
+        socket_compress[sockfd] = peer_accepts ? 1 : 0;
+    }
+}
+
+/**
+ * get_socket_compression
+ * @brief Return whether the peer on a socket decodes compressed frames.
+ *
+ * @param sockfd Socket file descriptor.
+ * @return 1 if it has advertised WIRE_FRAME_ACCEPTS_LZ, 0 otherwise.
+ */
+int get_socket_compression(int sockfd) {
+    if (sockfd < 0 || sockfd >= MAX_TRACKED_SOCKETS) {
+        return 0;
+    }
+    return socket_compress[sockfd];
+}
+
+// Whether a payload of `len` bytes to sockfd should be compressed
+static int should_compress(int sockfd, size_t len) {
+    return wire_compress_min > 0 && len >= (size_t)wire_compress_min &&
+           get_socket_protocol(sockfd) == PROTOCOL_V2 && get_socket_compression(sockfd);
+}
+
+/**
+ * compress_payload
+ * @brief Compress a payload for a WIRE_FRAME_COMPRESSED frame.
+ *
+ * @param out Buffer of at least len bytes.
+ * @return Compressed size, or 0 if compression would not save at least
+ *         1/WIRE_COMPRESS_MIN_GAIN of the bytes (send it raw then).
+ */
+static size_t compress_payload(const char* payload, size_t len, char* out) {
+    return lz_compress(payload, len, out, len - len / WIRE_COMPRESS_MIN_GAIN);
+}
+
+// Unsigned LEB128 varint helpers
+static size_t put_varint(unsigned char* p, uint64_t v) {
+    size_t n = 0;
+    while (v >= 0x80) {
+        p[n++] = (unsigned char)(v | 0x80);
+        v >>= 7;
+    }
+    p[n++] = (unsigned char)v;
+    return n;
+}
+
+static int get_varint64(const unsigned char* p, size_t len, size_t* pos, uint64_t* out) {
+    uint64_t v = 0;
+    for (int shift = 0; shift <= 63; shift += 7) {
+        if (*pos >= len) {
+            return -1;
+        }
+        unsigned char b = p[(*pos)++];
+        v |= (uint64_t)(b & 0x7F) << shift;
+        if (!(b & 0x80)) {
+            *out = v;
+            return 0;
+        }
+    }
+    return -1;
+}
+
+static int get_varint(const unsigned char* p, size_t len, size_t* pos, uint32_t* out) {
+    uint64_t v;
+    if (get_varint64(p, len, pos, &v) < 0 || v > UINT32_MAX) {
+        return -1;
+    }
+    *out = (uint32_t)v;
+    return 0;
+}
+
+// Zigzag mapping so small negative ints (e.g. -1 indexes) stay one byte
+static uint32_t zigzag_encode(int v) {
+    return ((uint32_t)v << 1) ^ (uint32_t)(v >> 31);
+}
+
+static int zigzag_decode(uint32_t v) {
+    return (int)((v >> 1) ^ (~(v & 1) + 1));
+}
+
+static size_t put_string_field(unsigned char* p, const char* s, size_t field_size) {
+    size_t len = strnlen(s, field_size - 1);
+    size_t n = put_varint(p, (uint32_t)len);
+    memcpy(p + n, s, len);
+    return n + len;
+}
+
+static int get_string_field(const unsigned char* p, size_t len, size_t* pos,
+                            char* dest, size_t field_size) {
+    uint32_t slen;
+    if (get_varint(p, len, pos, &slen) < 0 || slen > len - *pos) {
+        return -1;
+    }
+    size_t copy = slen < field_size - 1 ? slen : field_size - 1;
+    memcpy(dest, p + *pos, copy);
+    dest[copy] = '\0';
+    *pos += slen;
+    return 0;
+}
+
+static void put_u16(unsigned char* p, uint16_t v) {
+    p[0] = (unsigned char)(v >> 8);
+    p[1] = (unsigned char)v;
+}
+
+static void put_u32(unsigned char* p, uint32_t v) {
+    p[0] = (unsigned char)(v >> 24);
+    p[1] = (unsigned char)(v >> 16);
+    p[2] = (unsigned char)(v >> 8);
+    p[3] = (unsigned char)v;
+}
+
+static uint16_t get_u16(const unsigned char* p) {
+    return (uint16_t)((p[0] << 8) | p[1]);
+}
+
+static uint32_t get_u32(const unsigned char* p) {
+    return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) |
+           ((uint32_t)p[2] << 8) | (uint32_t)p[3];
+}
+
+/**
+ * encode_wire_header
+ * @brief Serialize a MessageHeader into the compact v2 wire format.
+ *
+ * Layout: a WIRE_V2_PREFIX_SIZE-byte fixed prefix (magic, msg_type, op_code,
+ * frame flags, present-field bitmap, extension length, payload length; all
+ * big-endian) followed by only those optional fields that are non-empty or
+ * non-zero. Strings are varint-length-prefixed, integers are zigzag varints.
+ * The payload length is that of this frame; a chunked head frame also
+ * carries the 64-bit total length of the whole payload, and a compressed
+ * single frame its uncompressed length.
+ *
+ * @param header Header to encode.
+ * @param buf Output buffer (WIRE_V2_MAX_HEADER bytes is always enough).
+ * @param cap Capacity of buf.
+ * @return Number of bytes written, or -1 if the header cannot be encoded.
+ */
+int encode_wire_header(const MessageHeader* header, unsigned char* buf, size_t cap) {
+    if (!header || !buf || cap < WIRE_V2_MAX_HEADER ||
+        header->msg_type < 0 || header->msg_type > 0xFF ||
+        header->op_code < 0 || header->op_code > 0xFF ||
+        header->frame_flags < 0 || header->frame_flags > 0xFF ||
+        header->data_length < 0) {
+        return -1;
+    }
+
+    uint16_t present = 0;
+    size_t pos = WIRE_V2_PREFIX_SIZE;
+
+    if (header->username[0]) {
+        present |= WIRE_F_USERNAME;
+        pos += put_string_field(buf + pos, header->username, sizeof(header->username));
+    }
+    if (header->filename[0]) {
+        present |= WIRE_F_FILENAME;
+        pos += put_string_field(buf + pos, header->filename, sizeof(header->filename));
+    }
+    if (header->foldername[0]) {
+        present |= WIRE_F_FOLDERNAME;
+        pos += put_string_field(buf + pos, header->foldername, sizeof(header->foldername));
+    }
+    if (header->checkpoint_tag[0]) {
+        present |= WIRE_F_CHECKPOINT_TAG;
+        pos += put_string_field(buf + pos, header->checkpoint_tag, sizeof(header->checkpoint_tag));
+    }
+    if (header->error_code) {
+        present |= WIRE_F_ERROR_CODE;
+        pos += put_varint(buf + pos, zigzag_encode(header->error_code));
+    }
+    if (header->sentence_index) {
+        present |= WIRE_F_SENTENCE_INDEX;
+        pos += put_varint(buf + pos, zigzag_encode(header->sentence_index));
+    }
+    if (header->word_index) {
+        present |= WIRE_F_WORD_INDEX;
+        pos += put_varint(buf + pos, zigzag_encode(header->word_index));
+    }
+    if (header->flags) {
+        present |= WIRE_F_FLAGS;
+        pos += put_varint(buf + pos, zigzag_encode(header->flags));
+    }
+    if (header->request_id) {
+        present |= WIRE_F_REQUEST_ID;
+        pos += put_varint(buf + pos, header->request_id);
+    }
+    if ((header->frame_flags & (WIRE_FRAME_CHUNKED | WIRE_FRAME_COMPRESSED)) &&
+        header->total_length) {
+        present |= WIRE_F_TOTAL_LENGTH;
+        pos += put_varint(buf + pos, header->total_length);
+    }
+    if (header->handle) {
+        present |= WIRE_F_HANDLE;
+        pos += put_varint(buf + pos, header->handle);
+    }
+
+    buf[0] = WIRE_V2_MAGIC;
+    buf[1] = (unsigned char)header->msg_type;
+    buf[2] = (unsigned char)header->op_code;
+    buf[3] = (unsigned char)header->frame_flags;
+    put_u16(buf + 4, present);
+    put_u16(buf + 6, (uint16_t)(pos - WIRE_V2_PREFIX_SIZE));
+    put_u32(buf + 8, (uint32_t)header->data_length);
+
+    return (int)pos;
+}
+
+/**
+ * decode_wire_header
+ * @brief Parse a compact v2 frame header back into a MessageHeader.
+ *
+ * @param buf Bytes of the fixed prefix immediately followed by the optional
+ *            field section (as announced by the prefix's extension length).
+ * @param len Total number of bytes available in buf.
+ * @param header Output header; fields not present on the wire are zeroed.
+ * @return 0 on success, -1 on a malformed or truncated header.
+ */
+int decode_wire_header(const unsigned char* buf, size_t len, MessageHeader* header) {
+    if (!buf || !header || len < WIRE_V2_PREFIX_SIZE || buf[0] != WIRE_V2_MAGIC) {
+        return -1;
+    }
+
+    uint16_t present = get_u16(buf + 4);
+    size_t ext_len = get_u16(buf + 6);
+    uint32_t data_length = get_u32(buf + 8);
+    if (len < WIRE_V2_PREFIX_SIZE + ext_len || data_length > INT_MAX) {
+        return -1;
+    }
+
+    memset(header, 0, sizeof(MessageHeader));
+    header->msg_type = buf[1];
+    header->op_code = buf[2];
+    header->frame_flags = buf[3];
+    header->data_length = (int)data_length;
+
+    size_t end = WIRE_V2_PREFIX_SIZE + ext_len;
+    size_t pos = WIRE_V2_PREFIX_SIZE;
+    uint32_t v;
+
+    if ((present & WIRE_F_USERNAME) &&
+        get_string_field(buf, end, &pos, header->username, sizeof(header->username)) < 0) {
+        return -1;
+    }
+    if ((present & WIRE_F_FILENAME) &&
+        get_string_field(buf, end, &pos, header->filename, sizeof(header->filename)) < 0) {
+        return -1;
+    }
+    if ((present & WIRE_F_FOLDERNAME) &&
+        get_string_field(buf, end, &pos, header->foldername, sizeof(header->foldername)) < 0) {
+        return -1;
+    }
+    if ((present & WIRE_F_CHECKPOINT_TAG) &&
+        get_string_field(buf, end, &pos, header->checkpoint_tag, sizeof(header->checkpoint_tag)) < 0) {
+        return -1;
+    }
+    if (present & WIRE_F_ERROR_CODE) {
+        if (get_varint(buf, end, &pos, &v) < 0) return -1;
+        header->error_code = zigzag_decode(v);
+    }
+    if (present & WIRE_F_SENTENCE_INDEX) {
+        if (get_varint(buf, end, &pos, &v) < 0) return -1;
+        header->sentence_index = zigzag_decode(v);
+    }
+    if (present & WIRE_F_WORD_INDEX) {
+        if (get_varint(buf, end, &pos, &v) < 0) return -1;
+        header->word_index = zigzag_decode(v);
+    }
+    if (present & WIRE_F_FLAGS) {
+        if (get_varint(buf, end, &pos, &v) < 0) return -1;
+        header->flags = zigzag_decode(v);
+    }
+    if (present & WIRE_F_REQUEST_ID) {
+        if (get_varint(buf, end, &pos, &v) < 0) return -1;
+        header->request_id = v;
+    }
+    if (present & WIRE_F_TOTAL_LENGTH) {
+        uint64_t total;
+        if (get_varint64(buf, end, &pos, &total) < 0) return -1;
+        header->total_length = total;
+    }
+    if (present & WIRE_F_HANDLE) {
+        uint64_t handle;
+        if (get_varint64(buf, end, &pos, &handle) < 0) return -1;
+        header->handle = handle;
+    }
+
+    // Unknown trailing fields (from newer peers) are skipped via ext_len
+    return 0;
+}
+
+/**
+ * record_frame_received
+ * @brief Apply the per-socket bookkeeping for a frame read off a socket.
+ *
+ * Replies mirror the framing of the last frame received, and echo the ID
+ * of the last request. recv_message() does this itself; callers that cut
+ * frames out of their own buffers with parse_frame() call it just before
+ * handling each frame.
+ *
+ * @param sockfd Socket the frame arrived on.
+ * @param header Decoded frame header.
+ * @param version Wire version the frame was encoded in.
+ */
+void record_frame_received(int sockfd, const MessageHeader* header, int version) {
+    set_socket_protocol(sockfd, version);
+    set_socket_compression(sockfd, version == PROTOCOL_V2 &&
+                                   (header->frame_flags & WIRE_FRAME_ACCEPTS_LZ));
+    if (header->msg_type == MSG_REQUEST && sockfd >= 0 && sockfd < MAX_TRACKED_SOCKETS) {
+        socket_request_id[sockfd] = header->request_id;
+    }
+}
+
+/**
+ * recv_buffer_init
+ * @brief Initialize an empty receive buffer (no memory is allocated yet).
+ */
+void recv_buffer_init(RecvBuffer* rb) {
+    rb->data = NULL;
+    rb->cap = 0;
+}
+
+/**
+ * recv_buffer_free
+ * @brief Release a receive buffer. Borrowed payloads become invalid.
+ */
+void recv_buffer_free(RecvBuffer* rb) {
+    free(rb->data);
+    recv_buffer_init(rb);
+}
+
+/**
+ * recv_buffer_reserve
+ * @brief Make room for `need` bytes, reusing the existing allocation.
+ *
+ * Grows geometrically, so a connection settles on one allocation after its
+ * first few messages. A buffer that grew past WIRE_RECV_BUFFER for one large
+ * payload shrinks back once small payloads return, so a long-lived
+ * connection does not pin the memory of its largest message.
+ *
+ * @return 0 on success, -1 if memory ran out (the old contents are kept).
+ */
+int recv_buffer_reserve(RecvBuffer* rb, size_t need) {
+    if (need <= rb->cap) {
+        if (rb->cap > WIRE_RECV_BUFFER && need <= WIRE_RECV_BUFFER) {
+            char* shrunk = realloc(rb->data, WIRE_RECV_BUFFER);
+            if (shrunk) {
+                rb->data = shrunk;
+                rb->cap = WIRE_RECV_BUFFER;
+            }
+        }
+        return 0;
+    }
+
+    size_t cap = rb->cap ? rb->cap : RECV_BUFFER_INITIAL;
+    while (cap < need) cap *= 2;
+    char* grown = realloc(rb->data, cap);
+    if (!grown) {
+        char errmsg[256];
+        snprintf(errmsg, sizeof(errmsg), "Failed to allocate %zu bytes for payload: %s",
+                 cap, strerror(errno));
+        log_message("NETWORK", "ERROR", errmsg);
+        return -1;
+    }
+    rb->data = grown;
+    rb->cap = cap;
+    return 0;
+}
+
+/**
+ * compressed_length_ok
+ * @brief Check the decoded size a compressed single frame announces.
+ *
+ * total_length is what the receiver allocates, so it must be one the sender
+ * could have produced: at most WIRE_CHUNK_SIZE (larger payloads are sent
+ * chunked) and no more than data_length compressed bytes can decode to.
+ *
+ * @return 1 if the frame may be decoded, 0 if it must be rejected.
+ */
+static int compressed_length_ok(const MessageHeader* header) {
+    return header->total_length > 0 && header->total_length <= WIRE_CHUNK_SIZE &&
+           header->data_length > 0 &&
+           header->total_length <= lz_decompress_bound((size_t)header->data_length);
+}
+
+/**
+ * parse_frame
+ * @brief Cut one complete frame (header and payload) out of a byte buffer.
+ *
+ * The non-blocking counterpart of recv_message() for event loops that read
+ * whatever bytes are available. Both wire versions are recognized. No
+ * per-socket state is touched; see record_frame_received(). Chunked
+ * transfers come back one frame at a time, marked by header->frame_flags;
+ * a compressed single frame is decoded.
+ * The payload is copied into a reusable RecvBuffer, so framing a steady
+ * stream of requests does not allocate.
+ *
+ * @param buf Buffered bytes, starting at a frame boundary.
+ * @param len Number of bytes in buf.
+ * @param header Out: decoded header.
+ * @param rb Receive buffer the payload is copied into.
+ * @param payload Out: null-terminated payload inside rb, or NULL.
+ * @param version Out: PROTOCOL_V1 or PROTOCOL_V2.
+ * @return Bytes consumed when a whole frame is present, 0 if more bytes
+ *         are needed, -1 on a malformed frame. When 0 is returned for a
+ *         frame whose header is complete, header->data_length already holds
+ *         its payload size (it is -1 until then), so an oversized frame can
+ *         be refused before its payload is buffered.
+ */
+ssize_t parse_frame(const unsigned char* buf, size_t len, MessageHeader* header,
+                    RecvBuffer* rb, char** payload, int* version) {
+    *payload = NULL;
+    header->data_length = -1;
+    if (len < WIRE_V2_PREFIX_SIZE) {
+        return 0;
+    }
+
+    size_t header_len;
+    if (buf[0] == WIRE_V2_MAGIC) {
+        header_len = WIRE_V2_PREFIX_SIZE + get_u16(buf + 6);
+        if (header_len > WIRE_V2_MAX_HEADER) {
+            return -1;
+        }
+        if (len < header_len) {
+            return 0;
+        }
+        if (decode_wire_header(buf, header_len, header) < 0) {
+            return -1;
+        }
+        *version = PROTOCOL_V2;
+    } else {
+        header_len = WIRE_V1_HEADER_SIZE;
+        if (len < header_len) {
+            return 0;
+        }
+        memset(header, 0, sizeof(MessageHeader));
+        memcpy(header, buf, header_len);
+        if (header->data_length < 0) {
+            return -1;
+        }
+        *version = PROTOCOL_V1;
+    }
+
+    // Single compressed frames only; total_length is the decoded size
+    if ((header->frame_flags & WIRE_FRAME_COMPRESSED) &&
+        ((header->frame_flags & (WIRE_FRAME_CHUNKED | WIRE_FRAME_CONTINUATION)) ||
+         !compressed_length_ok(header))) {
+        return -1;
+    }
+
+    size_t total = header_len + (size_t)header->data_length;
+    if (len < total) {
+        return 0;
+    }
+    if (header->frame_flags & WIRE_FRAME_COMPRESSED) {
+        if (recv_buffer_reserve(rb, header->total_length + 1) < 0 ||
+            lz_decompress((const char*)buf + header_len, header->data_length, rb->data,
+                          header->total_length) != (long)header->total_length) {
+            return -1;
+        }
+        header->frame_flags &= ~WIRE_FRAME_COMPRESSED;
+        header->data_length = (int)header->total_length;
+        rb->data[header->data_length] = '\0';
+        *payload = rb->data;
+        return (ssize_t)total;
+    }
+    if (header->data_length > 0) {
+        if (recv_buffer_reserve(rb, (size_t)header->data_length + 1) < 0) {
+            return -1;
+        }
+        memcpy(rb->data, buf + header_len, header->data_length);
+        rb->data[header->data_length] = '\0';
+        *payload = rb->data;
+    }
+    return (ssize_t)total;
+}
+
+/**
+ * wait_for_fd
+ * @brief Wait until a socket that returned EAGAIN is ready again.
+ *
+ * A non-blocking socket is polled. A blocking socket only returns EAGAIN
+ * once its SO_SNDTIMEO or SO_RCVTIMEO expired, so that is reported as a
+ * failure instead; a timed-out send may have left part of a frame on the
+ * stream, so the socket is also shut down and the peer sees it close.
+ *
+ * @return 0 when ready, -1 on a timeout (errno EAGAIN).
+ */
+static int wait_for_fd(int fd, short events) {
+    int fl = fcntl(fd, F_GETFL, 0);
+    if (fl >= 0 && !(fl & O_NONBLOCK)) {
+        if (events & POLLOUT) {
+            shutdown(fd, SHUT_RDWR);
+        }
+        errno = EAGAIN;
+        return -1;
+    }
+    struct pollfd pfd = { .fd = fd, .events = events };
+    poll(&pfd, 1, -1);
+    return 0;
+}
+
+/**
+ * send_iov
+ * @brief Write every byte of an I/O vector to a socket.
+ *
+ * Uses sendmsg() so the buffers leave in a single syscall (and, with
+ * TCP_NODELAY, in as few segments as possible). Short writes are resumed
+ * where they stopped; EINTR is retried, and EAGAIN waits for POLLOUT so
+ * non-blocking sockets work too (on a blocking socket it is a send
+ * timeout, see wait_for_fd()). MSG_NOSIGNAL turns a vanished peer into
+ * an EPIPE error instead of a process-killing SIGPIPE.
+ *
+ * @param sockfd Connected socket file descriptor.
+ * @param iov Buffers to send; consumed (modified) as data goes out.
+ * @param iovcnt Number of entries in iov.
+ * @return 0 on success, -1 on error (errno set).
+ */
+static int send_iov(int sockfd, struct iovec* iov, int iovcnt) {
+    struct msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = iov;
+    msg.msg_iovlen = iovcnt;
+
+    while (msg.msg_iovlen > 0) {
+        // Drop buffers that are already fully written (or empty)
+        if (msg.msg_iov->iov_len == 0) {
+            msg.msg_iov++;
+            msg.msg_iovlen--;
+            continue;
+        }
+
+        ssize_t n = sendmsg(sockfd, &msg, MSG_NOSIGNAL);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            if ((errno == EAGAIN || errno == EWOULDBLOCK) && wait_for_fd(sockfd, POLLOUT) == 0) {
+                continue;
+            }
+            return -1;
+        }
+
+        while (msg.msg_iovlen > 0 && (size_t)n >= msg.msg_iov->iov_len) {
+            n -= msg.msg_iov->iov_len;
+            msg.msg_iov++;
+            msg.msg_iovlen--;
+        }
+        if (msg.msg_iovlen > 0) {
+            msg.msg_iov->iov_base = (char*)msg.msg_iov->iov_base + n;
+            msg.msg_iov->iov_len -= n;
+        }
+    }
+    return 0;
+}
+
+static int send_all(int sockfd, const void* buf, size_t len) {
+    struct iovec iov = { .iov_base = (void*)buf, .iov_len = len };
+    return send_iov(sockfd, &iov, 1);
+}
+
+/**
+ * send_frame
+ * @brief Encode a header for the socket and send it with its payload.
+ *
+ * Tags replies with the last request ID, advertises WIRE_FRAME_ACCEPTS_LZ
+ * when compression is enabled, and, if may_compress is set, compresses a
+ * payload the peer can decode (see should_compress()).
+ *
+ * @return 0 on success, -1 on error (errno set).
+ */
+static int send_frame(int sockfd, MessageHeader* header, const char* payload, int may_compress) {
+    const void* wire = header;
+    size_t wire_len = WIRE_V1_HEADER_SIZE;
+    unsigned char compact[WIRE_V2_MAX_HEADER];
+    size_t body_len = (payload != NULL && header->data_length > 0) ? (size_t)header->data_length : 0;
+    char* packed = NULL;
+
+    if (get_socket_protocol(sockfd) == PROTOCOL_V2) {
+        MessageHeader tagged = *header;
+        if (tagged.request_id == 0 && tagged.msg_type != MSG_REQUEST &&
+            sockfd >= 0 && sockfd < MAX_TRACKED_SOCKETS) {
+            tagged.request_id = socket_request_id[sockfd];
+        }
+        if (wire_compress_min > 0) {
+            tagged.frame_flags |= WIRE_FRAME_ACCEPTS_LZ;
+        }
+        if (may_compress && should_compress(sockfd, body_len) &&
+            !(tagged.frame_flags & (WIRE_FRAME_CHUNKED | WIRE_FRAME_CONTINUATION)) &&
+            (packed = malloc(body_len)) != NULL) {
+            size_t n = compress_payload(payload, body_len, packed);
+            if (n > 0) {
+                tagged.frame_flags |= WIRE_FRAME_COMPRESSED;
+                tagged.total_length = body_len;
+                tagged.data_length = (int)n;
+                payload = packed;
+                body_len = n;
+            }
+        }
+        int n = encode_wire_header(&tagged, compact, sizeof(compact));
+        if (n > 0) {
+            wire = compact;
+            wire_len = n;
+        }
+    }
+
+    // Header and payload go out together in one syscall
+    struct iovec iov[2];
+    iov[0].iov_base = (void*)wire;
+    iov[0].iov_len = wire_len;
+    iov[1].iov_base = (void*)payload;
+    iov[1].iov_len = body_len;
+
+    int rc = send_iov(sockfd, iov, 2);
+    free(packed);
+    return rc;
+}
+
+/**
+ * send_message
+ * @brief Send a framed message over a connected socket.
+ *
+ * Writes the header in the wire format negotiated for this socket (the
+ * fixed-size MessageHeader for v1, the compact encoding for v2) followed by
+ * the optional payload bytes specified by header->data_length. Both leave
+ * in one vectored send (see send_iov), so a small request is never split
+ * into two segments for Nagle and delayed ACKs to stall on. Payloads to a
+ * peer that decodes compressed frames are compressed first when that pays
+ * off (see set_wire_compression()).
+ *
+ * Replies (anything but MSG_REQUEST) that carry no request ID are tagged
+ * with the ID of the last request received on the socket. v1 framing has
+ * no room for the ID and drops it.
+ *
+ * @param sockfd Connected socket file descriptor.
+ * @param header Pointer to an initialized MessageHeader to send.
+ * @param payload Optional pointer to payload data; may be NULL when
+ *                header->data_length == 0.
+ * @return 0 on success, -1 on error (and errno will be set by system calls).
+ */
+int send_message(int sockfd, MessageHeader* header, const char* payload) {
+    if (send_frame(sockfd, header, payload, 1) < 0) {
+        char errmsg[256];
+        snprintf(errmsg, sizeof(errmsg), 
+                 "Failed to send message (%d bytes) on socket %d: %s", 
+                 header->data_length, sockfd, strerror(errno));
+        log_message("NETWORK", "ERROR", errmsg);
+        return -1;
+    }
+    
+    return 0;
+}
+
+/**
+ * cork_for_stream
+ * @brief Cork an interactive TCP socket for the duration of a streamed payload.
+ *
+ * Bulk sockets are corked already and other socket types ignore the option.
+ *
+ * @return 1 if the socket was corked here (pass to uncork_after_stream()).
+ */
+static int cork_for_stream(int sockfd) {
+    if (sockfd < 0 || sockfd >= MAX_TRACKED_SOCKETS || socket_role[sockfd] == SOCKET_ROLE_BULK) {
+        return 0;
+    }
+    int on = 1;
+    return setsockopt(sockfd, IPPROTO_TCP, TCP_CORK, &on, sizeof(on)) == 0;
+}
+
+static void uncork_after_stream(int sockfd, int corked) {
+    if (corked) {
+        int off = 0;
+        setsockopt(sockfd, IPPROTO_TCP, TCP_CORK, &off, sizeof(off));
+    }
+}
+
+/**
+ * send_file_body
+ * @brief Copy exactly `count` bytes of a file, from *offset on, to a socket.
+ *
+ * Uses sendfile() so the bytes never pass through user space, falling back
+ * to pread() through a bounce buffer where sendfile() is unsupported. If
+ * the file ends early the remainder is sent as NUL bytes, so the frame the
+ * caller announced is always complete.
+ *
+ * @return 0 on success, -1 on a socket error.
+ */
+static int send_file_body(int sockfd, int file_fd, off_t* offset, size_t count,
+                          int* use_sendfile) {
+    char bounce[BUFFER_SIZE];
+    off_t end = *offset + (off_t)count;
+    int eof = 0;
+
+    while (*offset < end && !eof) {
+        size_t want = end - *offset;
+        ssize_t n;
+        if (*use_sendfile) {
+            n = sendfile(sockfd, file_fd, offset, want);
+            if (n < 0 && (errno == EINVAL || errno == ENOSYS)) {
+                *use_sendfile = 0;
+                continue;
+            }
+        } else {
+            n = pread(file_fd, bounce, want < sizeof(bounce) ? want : sizeof(bounce), *offset);
+            if (n > 0 && send_all(sockfd, bounce, n) < 0) {
+                n = -1;
+            } else if (n > 0) {
+                *offset += n;
+            }
+        }
+
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            char errmsg[256];
+            snprintf(errmsg, sizeof(errmsg),
+                     "Failed to send file payload on socket %d: %s", sockfd, strerror(errno));
+            log_message("NETWORK", "ERROR", errmsg);
+            return -1;
+        }
+        eof = (n == 0);  // File shrank since it was measured
+    }
+
+    // Honor the announced length no matter what
+    memset(bounce, 0, sizeof(bounce));
+    while (*offset < end) {
+        size_t chunk = end - *offset < (off_t)sizeof(bounce) ? (size_t)(end - *offset) : sizeof(bounce);
+        if (send_all(sockfd, bounce, chunk) < 0) {
+            return -1;
+        }
+        *offset += chunk;
+    }
+    return 0;
+}
+
+/**
+ * send_file_compressed
+ * @brief Send a file payload as frames compressed slice by slice.
+ *
+ * The file is read WIRE_CHUNK_SIZE bytes at a time and each slice goes out
+ * in its own frame, compressed when that pays off and raw otherwise; more
+ * than one slice makes a chunked payload, as in send_file_frames(). Bytes
+ * missing from a file that shrank are sent as NULs there too.
+ */
+static int send_file_compressed(int sockfd, MessageHeader* header, int file_fd, size_t length) {
+    size_t slice_cap = length < WIRE_CHUNK_SIZE ? length : WIRE_CHUNK_SIZE;
+    char* raw = malloc(slice_cap);
+    char* packed = malloc(slice_cap);
+    if (!raw || !packed) {
+        free(raw);
+        free(packed);
+        return -1;
+    }
+
+    header->frame_flags = length > WIRE_CHUNK_SIZE ? WIRE_FRAME_CHUNKED : 0;
+    header->total_length = length;
+    MessageHeader frame = *header;
+
+    // Continuation frames carry nothing but their slice (and the request ID)
+    MessageHeader cont;
+    memset(&cont, 0, sizeof(cont));
+    cont.msg_type = header->msg_type;
+    cont.op_code = header->op_code;
+    cont.request_id = header->request_id;
+    cont.frame_flags = WIRE_FRAME_CONTINUATION;
+
+    int rc = 0;
+    size_t offset = 0;
+    while (offset < length) {
+        size_t slice = length - offset < slice_cap ? length - offset : slice_cap;
+        size_t got = 0;
+        while (got < slice) {
+            ssize_t n = pread(file_fd, raw + got, slice - got, offset + got);
+            if (n < 0 && errno == EINTR) continue;
+            if (n <= 0) break;
+            got += n;
+        }
+        memset(raw + got, 0, slice - got);  // File shrank since it was measured
+
+        size_t n = compress_payload(raw, slice, packed);
+        if (n > 0) {
+            frame.frame_flags |= WIRE_FRAME_COMPRESSED;
+        }
+        frame.data_length = (int)(n > 0 ? n : slice);
+        if (send_frame(sockfd, &frame, n > 0 ? packed : raw, 0) < 0) {
+            char errmsg[256];
+            snprintf(errmsg, sizeof(errmsg),
+                     "Failed to send file payload on socket %d: %s", sockfd, strerror(errno));
+            log_message("NETWORK", "ERROR", errmsg);
+            rc = -1;
+            break;
+        }
+        offset += slice;
+        frame = cont;
+    }
+
+    free(raw);
+    free(packed);
+    return rc;
+}
+
+/**
+ * send_file_frames
+ * @brief Frame and send a file payload (see send_file_message).
+ */
+static int send_file_frames(int sockfd, MessageHeader* header, int file_fd, size_t length) {
+    off_t offset = 0;
+    int use_sendfile = 1;
+
+    if (should_compress(sockfd, length)) {
+        return send_file_compressed(sockfd, header, file_fd, length);
+    }
+
+    if (length <= WIRE_CHUNK_SIZE || get_socket_protocol(sockfd) != PROTOCOL_V2) {
+        if (length > INT_MAX) {
+            log_message("NETWORK", "ERROR", "File too large for a single v1 frame");
+            return -1;
+        }
+        header->frame_flags = 0;
+        header->data_length = (int)length;
+        if (send_message(sockfd, header, NULL) < 0) {
+            return -1;
+        }
+        return send_file_body(sockfd, file_fd, &offset, length, &use_sendfile);
+    }
+
+    header->frame_flags = WIRE_FRAME_CHUNKED;
+    header->total_length = length;
+    header->data_length = WIRE_CHUNK_SIZE;
+    if (send_message(sockfd, header, NULL) < 0 ||
+        send_file_body(sockfd, file_fd, &offset, WIRE_CHUNK_SIZE, &use_sendfile) < 0) {
+        return -1;
+    }
+
+    // Continuation frames carry nothing but their slice (and the request ID)
+    MessageHeader cont;
+    memset(&cont, 0, sizeof(cont));
+    cont.msg_type = header->msg_type;
+    cont.op_code = header->op_code;
+    cont.request_id = header->request_id;
+    cont.frame_flags = WIRE_FRAME_CONTINUATION;
+    while ((size_t)offset < length) {
+        size_t chunk = length - offset < WIRE_CHUNK_SIZE ? length - offset : WIRE_CHUNK_SIZE;
+        cont.data_length = (int)chunk;
+        if (send_message(sockfd, &cont, NULL) < 0 ||
+            send_file_body(sockfd, file_fd, &offset, chunk, &use_sendfile) < 0) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+/**
+ * send_file_message
+ * @brief Send a framed message whose payload is the contents of a file.
+ *
+ * The body is copied from the file straight into the socket with sendfile(),
+ * so no user-space copy of the file is ever made. On v2 sockets a body
+ * larger than WIRE_CHUNK_SIZE goes out chunked: a head frame announcing the
+ * 64-bit total length, then continuation frames, so files of any size can
+ * be sent and the receiver never has to hold the whole body. v1 sockets get
+ * a single frame and are limited to INT_MAX bytes. If the file shrinks
+ * underneath us, the rest of the announced length is sent as NUL bytes to
+ * keep the stream framed (readers treat payloads as C strings, so this reads
+ * as a truncation). Interactive TCP sockets are corked for the duration, so
+ * a small file leaves as one segment instead of a header segment followed
+ * by the body. If the peer decodes compressed frames and the file is large
+ * enough, it is read and compressed slice by slice instead of sendfile()d.
+ *
+ * @param sockfd Connected socket file descriptor.
+ * @param header Header to send; data_length and the chunking fields are set.
+ * @param file_fd Open file, read from offset 0.
+ * @param length Number of payload bytes (normally the file size).
+ * @return 0 on success, -1 on error.
+ */
+int send_file_message(int sockfd, MessageHeader* header, int file_fd, size_t length) {
+    // Cork so the header rides in the same segment as the start of the body
+    int corked = cork_for_stream(sockfd);
+    int rc = send_file_frames(sockfd, header, file_fd, length);
+    uncork_after_stream(sockfd, corked);
+    return rc;
+}
+
+/**
+ * recv_frame_header
+ * @brief Read one frame header off a socket (either wire version).
+ *
+ * Auto-detects the wire format from the first byte (v2 frames start with
+ * WIRE_V2_MAGIC, which can never begin a v1 header) and applies the
+ * per-socket bookkeeping of record_frame_received().
+ *
+ * @return Header bytes read (>0), 0 on orderly shutdown, -1 on error.
+ */
+static ssize_t recv_frame_header(int sockfd, MessageHeader* header) {
+    // Receive the common prefix (shorter than any v1 header)
+    unsigned char wire[WIRE_V2_MAX_HEADER];
+    ssize_t received = recv(sockfd, wire, WIRE_V2_PREFIX_SIZE, MSG_WAITALL);
+    if (received <= 0) {
+        if (received < 0) {
+            char errmsg[256];
+            snprintf(errmsg, sizeof(errmsg), 
+                     "Failed to receive message header on socket %d: %s", 
+                     sockfd, strerror(errno));
+            log_message("NETWORK", "ERROR", errmsg);
+        }
+        return received;
+    }
+    
+    ssize_t rest;
+    if (received == WIRE_V2_PREFIX_SIZE && wire[0] == WIRE_V2_MAGIC) {
+        size_t ext_len = get_u16(wire + 6);
+        if (ext_len > sizeof(wire) - WIRE_V2_PREFIX_SIZE) {
+            log_message("NETWORK", "ERROR", "Oversized v2 header extension");
+            return -1;
+        }
+        rest = ext_len > 0 ? recv(sockfd, wire + WIRE_V2_PREFIX_SIZE, ext_len, MSG_WAITALL) : 0;
+        if (rest != (ssize_t)ext_len ||
+            decode_wire_header(wire, WIRE_V2_PREFIX_SIZE + ext_len, header) < 0) {
+            char errmsg[256];
+            snprintf(errmsg, sizeof(errmsg), 
+                     "Malformed v2 message header on socket %d", sockfd);
+            log_message("NETWORK", "ERROR", errmsg);
+            return -1;
+        }
+        record_frame_received(sockfd, header, PROTOCOL_V2);
+        received += rest;
+    } else {
+        memset(header, 0, sizeof(MessageHeader));
+        memcpy(header, wire, received);
+        size_t need = WIRE_V1_HEADER_SIZE - received;
+        rest = recv(sockfd, (char*)header + received, need, MSG_WAITALL);
+        if (rest != (ssize_t)need) {
+            char errmsg[256];
+            snprintf(errmsg, sizeof(errmsg), 
+                     "Failed to receive message header on socket %d: %s", 
+                     sockfd, rest < 0 ? strerror(errno) : "short read");
+            log_message("NETWORK", "ERROR", errmsg);
+            return -1;
+        }
+        record_frame_received(sockfd, header, PROTOCOL_V1);
+        received += rest;
+    }
+    return received;
+}
+
+/**
+ * recv_message_header
+ * @brief Receive only the header of the next message.
+ *
+ * The payload is left on the socket for recv_message_payload(), which must
+ * be called next (even when the caller does not want the bytes) to keep the
+ * stream framed. header->total_length is set to the size of the whole
+ * payload, whether it arrives in one frame or chunked.
+ *
+ * @param sockfd Connected socket file descriptor.
+ * @param header Out: the received header.
+ * @return Header bytes read (>0), 0 on orderly shutdown, -1 on error.
+ */
+int recv_message_header(int sockfd, MessageHeader* header) {
+    ssize_t received = recv_frame_header(sockfd, header);
+    if (received <= 0) {
+        return (int)received;
+    }
+
+    if (header->data_length < 0) {
+        log_message("NETWORK", "ERROR", "Negative payload length in message header");
+        return -1;
+    }
+    if (header->frame_flags & WIRE_FRAME_CONTINUATION) {
+        log_message("NETWORK", "ERROR", "Continuation frame without a chunked head");
+        return -1;
+    }
+    if (header->frame_flags & WIRE_FRAME_CHUNKED) {
+        if ((unsigned long long)header->data_length > header->total_length) {
+            log_message("NETWORK", "ERROR", "Chunked head frame larger than its payload");
+            return -1;
+        }
+    } else if (header->frame_flags & WIRE_FRAME_COMPRESSED) {
+        if (!compressed_length_ok(header)) {
+            log_message("NETWORK", "ERROR", "Compressed frame with an impossible decoded size");
+            return -1;
+        }
+    } else {
+        header->total_length = (unsigned long long)header->data_length;
+    }
+    return (int)received;
+}
+
+typedef struct {
+    char* buf;
+    size_t len;
+} PayloadCollector;
+
+static int collect_payload_sink(void* ctx, const char* data, size_t len) {
+    PayloadCollector* c = ctx;
+    memcpy(c->buf + c->len, data, len);
+    c->len += len;
+    return 0;
+}
+
+/**
+ * recv_payload_bytes
+ * @brief Read `count` payload bytes into the sink, one buffer at a time.
+ *
+ * Once the sink fails it is no longer called, but the bytes are still read
+ * so the next frame starts where expected.
+ *
+ * @return 0 on success, -1 on a socket error.
+ */
+static int recv_payload_bytes(int sockfd, size_t count, PayloadSink sink, void* ctx,
+                              char* buf, int* sink_failed) {
+    while (count > 0) {
+        size_t want = count < WIRE_RECV_BUFFER ? count : WIRE_RECV_BUFFER;
+        ssize_t n = recv(sockfd, buf, want, MSG_WAITALL);
+        if (n <= 0) {
+            if (n < 0 && errno == EINTR) continue;
+            char errmsg[256];
+            snprintf(errmsg, sizeof(errmsg),
+                     "Failed to receive payload on socket %d: %s",
+                     sockfd, n < 0 ? strerror(errno) : "connection closed");
+            log_message("NETWORK", "ERROR", errmsg);
+            return -1;
+        }
+        if (sink && !*sink_failed && sink(ctx, buf, n) != 0) {
+            *sink_failed = 1;
+        }
+        count -= n;
+    }
+    return 0;
+}
+
+/**
+ * recv_frame_body
+ * @brief Read one frame's payload into the sink, decoding it if compressed.
+ *
+ * @param frame Header of the frame whose payload is next on the socket.
+ * @param raw_cap Most bytes the payload may decode to.
+ * @param raw_len Out: payload bytes the frame carried once decoded.
+ * @return 0 on success, -1 on a socket error or a corrupt compressed frame.
+ */
+static int recv_frame_body(int sockfd, const MessageHeader* frame, size_t raw_cap,
+                           PayloadSink sink, void* ctx, char* buf, int* sink_failed,
+                           size_t* raw_len) {
+    *raw_len = frame->data_length;
+    if (!(frame->frame_flags & WIRE_FRAME_COMPRESSED)) {
+        return recv_payload_bytes(sockfd, frame->data_length, sink, ctx, buf, sink_failed);
+    }
+
+    // A frame is only sent compressed when that makes it smaller
+    if ((size_t)frame->data_length > raw_cap) {
+        log_message("NETWORK", "ERROR", "Compressed frame larger than its decoded size");
+        return -1;
+    }
+
+    PayloadCollector packed = { malloc(frame->data_length + 1), 0 };
+    char* raw = malloc(raw_cap + 1);
+    int collect_failed = 0;
+    int rc = -1;
+    if (packed.buf && raw &&
+        recv_payload_bytes(sockfd, frame->data_length, collect_payload_sink, &packed, buf,
+                           &collect_failed) == 0) {
+        long n = lz_decompress(packed.buf, packed.len, raw, raw_cap);
+        if (n < 0) {
+            char errmsg[256];
+            snprintf(errmsg, sizeof(errmsg), "Corrupt compressed frame on socket %d", sockfd);
+            log_message("NETWORK", "ERROR", errmsg);
+        } else {
+            rc = 0;
+            *raw_len = n;
+            if (sink && !*sink_failed && n > 0 && sink(ctx, raw, n) != 0) {
+                *sink_failed = 1;
+            }
+        }
+    }
+    free(packed.buf);
+    free(raw);
+    return rc;
+}
+
+/**
+ * recv_message_payload
+ * @brief Stream the payload announced by recv_message_header() into a sink.
+ *
+ * Chunked payloads are followed across their continuation frames, and
+ * compressed frames are decoded. Memory use is one WIRE_RECV_BUFFER no
+ * matter how large the payload is, plus a compressed frame and its decoded
+ * slice while one is being decoded.
+ *
+ * @param sockfd Connected socket file descriptor.
+ * @param header Header returned by recv_message_header().
+ * @param sink Called with each piece of the payload, in order; NULL to
+ *             discard the payload.
+ * @param ctx Passed through to the sink.
+ * @return 0 on success, -1 on a socket or framing error, or if the sink
+ *         failed (the payload is drained either way, so the connection
+ *         stays usable after a sink failure).
+ */
+int recv_message_payload(int sockfd, MessageHeader* header, PayloadSink sink, void* ctx) {
+    if (header->total_length == 0) {
+        return 0;
+    }
+
+    char* buf = malloc(WIRE_RECV_BUFFER);
+    if (!buf) {
+        return -1;
+    }
+
+    // Compressed slices of a chunked payload never decode past WIRE_CHUNK_SIZE
+    int chunked = (header->frame_flags & WIRE_FRAME_CHUNKED) != 0;
+    unsigned long long remaining = header->total_length;
+    size_t cap = chunked && remaining > WIRE_CHUNK_SIZE ? WIRE_CHUNK_SIZE : (size_t)remaining;
+    size_t got = 0;
+    int sink_failed = 0;
+    int rc = recv_frame_body(sockfd, header, cap, sink, ctx, buf, &sink_failed, &got);
+    if (rc == 0 && (got > remaining || (!chunked && got != remaining))) {
+        log_message("NETWORK", "ERROR", "Compressed frame decoded to the wrong size");
+        rc = -1;
+    }
+    if (rc == 0) {
+        remaining -= got;
+    }
+
+    while (rc == 0 && remaining > 0) {
+        MessageHeader cont;
+        if (recv_frame_header(sockfd, &cont) <= 0 ||
+            !(cont.frame_flags & WIRE_FRAME_CONTINUATION) || cont.data_length == 0 ||
+            (!(cont.frame_flags & WIRE_FRAME_COMPRESSED) &&
+             (unsigned long long)cont.data_length > remaining)) {
+            log_message("NETWORK", "ERROR", "Chunked payload interrupted or malformed");
+            rc = -1;
+            break;
+        }
+        cap = remaining > WIRE_CHUNK_SIZE ? WIRE_CHUNK_SIZE : (size_t)remaining;
+        rc = recv_frame_body(sockfd, &cont, cap, sink, ctx, buf, &sink_failed, &got);
+        if (rc == 0 && got == 0) {
+            log_message("NETWORK", "ERROR", "Empty compressed continuation frame");
+            rc = -1;
+        }
+        remaining -= got;
+    }
+
+    free(buf);
+    return (rc == 0 && !sink_failed) ? 0 : -1;
+}
+
+/**
+ * fd_payload_sink
+ * @brief PayloadSink that writes each piece to the file descriptor in *ctx.
+ */
+int fd_payload_sink(void* ctx, const char* data, size_t len) {
+    int fd = *(int*)ctx;
+    while (len > 0) {
+        ssize_t n = write(fd, data, len);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            return -1;
+        }
+        data += n;
+        len -= n;
+    }
+    return 0;
+}
+
+/**
+ * recv_payload_into
+ * @brief Read the whole payload announced by recv_message_header() into buf.
+ *
+ * buf must hold header->total_length + 1 bytes; the payload is
+ * null-terminated. A chunked or compressed payload is reassembled (and
+ * decoded) and its header is rewritten to look like a plain single frame.
+ *
+ * @return 0 on success, -1 on error.
+ */
+static int recv_payload_into(int sockfd, MessageHeader* header, char* buf) {
+    if (header->frame_flags & (WIRE_FRAME_CHUNKED | WIRE_FRAME_COMPRESSED)) {
+        PayloadCollector c = { buf, 0 };
+        if (recv_message_payload(sockfd, header, collect_payload_sink, &c) < 0) {
+            return -1;
+        }
+        buf[c.len] = '\0';
+        header->frame_flags &= ~(WIRE_FRAME_CHUNKED | WIRE_FRAME_COMPRESSED);
+        header->data_length = (int)c.len;
+        return 0;
+    }
+
+    if (header->data_length > 0) {
+        ssize_t received = recv(sockfd, buf, header->data_length, MSG_WAITALL);
+        if (received != header->data_length) {
+            char errmsg[256];
+            snprintf(errmsg, sizeof(errmsg), 
+                     "Failed to receive payload (%d bytes expected, %zd received) on socket %d: %s", 
+                     header->data_length, received, sockfd, strerror(errno));
+            log_message("NETWORK", "ERROR", errmsg);
+            return -1;
+        }
+    }
+    buf[header->data_length] = '\0';
+    return 0;
+}
+
+/**
+ * recv_message
+ * @brief Receive a framed message from a connected socket.
+ *
+ * Reads the header using MSG_WAITALL, auto-detecting the wire format from
+ * the first byte (v2 frames start with WIRE_V2_MAGIC, which can never begin
+ * a v1 header), and remembers it so replies mirror the peer's framing. The
+ * request ID of incoming requests is remembered too, for send_message(). Then
+ * allocates a buffer for the payload if header->data_length > 0. The
+ * allocated buffer will be null-terminated and must be freed by the caller
+ * (or set to NULL when no payload exists). Chunked payloads are reassembled
+ * into one buffer (up to INT_MAX bytes); callers that may see large payloads
+ * should stream them with recv_message_header()/recv_message_payload().
+ * With payload == NULL any payload is read and discarded.
+ *
+ * @param sockfd Connected socket file descriptor.
+ * @param header Pointer to storage for the received MessageHeader.
+ * @param payload Out parameter; on success points to malloc'd buffer
+ *                (caller must free) or NULL when no payload.
+ * @return Number of payload bytes received (>0), 0 on orderly shutdown,
+ *         or negative on error.
+ */
+int recv_message(int sockfd, MessageHeader* header, char** payload) {
+    // Initialize payload to NULL
+    if (payload) {
+        *payload = NULL;
+    }
+    
+    ssize_t received = recv_message_header(sockfd, header);
+    if (received <= 0) {
+        return received;
+    }
+    
+    if (!payload) {
+        return recv_message_payload(sockfd, header, NULL, NULL) == 0 ? received : -1;
+    }
+    if (header->total_length == 0) {
+        return received;
+    }
+    if (header->total_length > INT_MAX) {
+        log_message("NETWORK", "ERROR", "Chunked payload too large to buffer");
+        return -1;
+    }
+    
+    *payload = (char*)malloc(header->total_length + 1);
+    if (*payload == NULL) {
+        char errmsg[256];
+        snprintf(errmsg, sizeof(errmsg), 
+                 "Failed to allocate %llu bytes for payload: %s", 
+                 header->total_length, strerror(errno));
+        log_message("NETWORK", "ERROR", errmsg);
+        return -1;
+    }
+    if (recv_payload_into(sockfd, header, *payload) < 0) {
+        free(*payload);
+        *payload = NULL;
+        return -1;
+    }
+    return header->data_length;
+}
+
+/**
+ * recv_message_into
+ * @brief Receive a framed message, leaving the payload in a reusable buffer.
+ *
+ * Same framing rules as recv_message(), but instead of a fresh allocation
+ * per message the payload lands in rb, which is grown only when a larger
+ * payload arrives. The caller borrows the payload: it stays valid until the
+ * next receive into (or release of) the same buffer. A server loop that
+ * keeps one RecvBuffer per connection thus handles steady traffic without
+ * touching the heap.
+ *
+ * @param sockfd Connected socket file descriptor.
+ * @param header Pointer to storage for the received MessageHeader.
+ * @param rb Per-connection receive buffer.
+ * @param payload Out: null-terminated payload inside rb, or NULL when the
+ *                message has none.
+ * @return Same as recv_message().
+ */
+int recv_message_into(int sockfd, MessageHeader* header, RecvBuffer* rb, char** payload) {
+    *payload = NULL;
+
+    int received = recv_message_header(sockfd, header);
+    if (received <= 0 || header->total_length == 0) {
+        return received;
+    }
+    return recv_message_payload_into(sockfd, header, rb, payload);
+}
+
+/**
+ * recv_message_payload_into
+ * @brief Second half of recv_message_into(): receive the payload of a
+ *        message whose header was read with recv_message_header().
+ *
+ * Lets a caller apply separate deadlines to the header and the payload.
+ *
+ * @param sockfd Connected socket file descriptor.
+ * @param header Header just received (data_length is updated for chunked
+ *               or compressed payloads).
+ * @param rb Per-connection receive buffer.
+ * @param payload Out: null-terminated payload inside rb, or NULL when the
+ *                message has none.
+ * @return Payload bytes received (>= 0), or -1 on error.
+ */
+int recv_message_payload_into(int sockfd, MessageHeader* header, RecvBuffer* rb, char** payload) {
+    *payload = NULL;
+    if (header->total_length == 0) {
+        return 0;
+    }
+    if (header->total_length > INT_MAX) {
+        log_message("NETWORK", "ERROR", "Chunked payload too large to buffer");
+        return -1;
+    }
+    if (recv_buffer_reserve(rb, header->total_length + 1) < 0 ||
+        recv_payload_into(sockfd, header, rb->data) < 0) {
+        return -1;
+    }
+    *payload = rb->data;
+    return header->data_length;
+}
+
+/*
+ * Payload relays. A relay forwards a message whose header has been read
+ * from one socket to another socket without buffering the payload: body
+ * bytes move through a pipe with splice(), so they never enter user space,
+ * or through a WIRE_RECV_BUFFER bounce buffer where splice() is unsupported.
+ * The source and destination are framed independently (chunked source
+ * frames may be re-chunked, or joined into one v1 frame for a v1 peer).
+ */
+typedef struct {
+    int fd;
+    size_t frame_left;             // Payload bytes left in the current source frame
+    unsigned long long remaining;  // Payload bytes left in the whole message
+    int pipe_fds[2];               // splice() pipe; [0] == -1 once bouncing
+    char bounce[WIRE_RECV_BUFFER];
+} RelayState;
+
+static void relay_drop_pipe(RelayState* rs) {
+    if (rs->pipe_fds[0] >= 0) {
+        close(rs->pipe_fds[0]);
+        close(rs->pipe_fds[1]);
+        rs->pipe_fds[0] = rs->pipe_fds[1] = -1;
+    }
+}
+
+/**
+ * relay_pipe_out
+ * @brief Move `count` bytes sitting in the relay pipe to the destination.
+ *
+ * If the destination cannot take spliced data the bytes are copied through
+ * the bounce buffer instead. On a destination error the pipe is emptied
+ * anyway, so it is ready for the next slice.
+ *
+ * @return 0 on success, -1 if the destination failed.
+ */
+static int relay_pipe_out(RelayState* rs, int dst_fd, size_t count) {
+    while (count > 0) {
+        ssize_t n = splice(rs->pipe_fds[0], NULL, dst_fd, NULL, count,
+                           SPLICE_F_MOVE | SPLICE_F_MORE);
+        if (n > 0) {
+            count -= n;
+            continue;
+        }
+        if (n < 0 && errno == EINTR) continue;
+        if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK) && wait_for_fd(dst_fd, POLLOUT) == 0) {
+            continue;
+        }
+
+        int copy = (n < 0 && errno == EINVAL);
+        while (count > 0) {
+            ssize_t got = read(rs->pipe_fds[0], rs->bounce,
+                               count < sizeof(rs->bounce) ? count : sizeof(rs->bounce));
+            if (got <= 0) {
+                if (got < 0 && errno == EINTR) continue;
+                return -1;
+            }
+            if (copy && send_all(dst_fd, rs->bounce, got) < 0) {
+                copy = 0;
+            }
+            count -= got;
+        }
+        return copy ? 0 : -1;
+    }
+    return 0;
+}
 
 /**
- * send_message
- * @brief Send a framed message over a connected socket.
+ * relay_bytes
+ * @brief Move the next `count` payload bytes from the source to dst_fd.
  *
- * Writes the fixed-size MessageHeader first followed by the optional payload
- * bytes specified by header->data_length. The function performs blocking
- * sends and returns 0 on success.
+ * Source continuation headers are consumed as slices run out. Once the
+ * destination has failed (*dst_failed set), the bytes are still read from
+ * the source and discarded, so the source stays framed.
  *
- * @param sockfd Connected socket file descriptor.
- * @param header Pointer to an initialized MessageHeader to send.
- * @param payload Optional pointer to payload data; may be NULL when
- *                header->data_length == 0.
- * @return 0 on success, -1 on error (and errno will be set by system calls).
+ * @return 0 on success, -1 if the source failed or broke framing.
  */
-int send_message(int sockfd, MessageHeader* header, const char* payload) {
-    // Send header first
-    ssize_t sent = send(sockfd, header, sizeof(MessageHeader), 0);
-    if (sent != sizeof(MessageHeader)) {
-        char errmsg[256];
-        snprintf(errmsg, sizeof(errmsg), 
-                 "Failed to send message header on socket %d: %s", 
-                 sockfd, strerror(errno));
-        log_message("NETWORK", "ERROR", errmsg);
-        return -1;
-    }
-    
-    // Send payload if exists
-    if (header->data_length > 0 && payload != NULL) {
-        sent = send(sockfd, payload, header->data_length, 0);
-        if (sent != header->data_length) {
+static int relay_bytes(RelayState* rs, int dst_fd, size_t count, int* dst_failed) {
+    while (count > 0) {
+        if (rs->frame_left == 0) {
+            MessageHeader cont;
+            if (recv_frame_header(rs->fd, &cont) <= 0 ||
+                !(cont.frame_flags & WIRE_FRAME_CONTINUATION) ||
+                (cont.frame_flags & WIRE_FRAME_COMPRESSED) || cont.data_length <= 0 ||
+                (unsigned long long)cont.data_length > rs->remaining) {
+                log_message("NETWORK", "ERROR", "Relayed payload interrupted or malformed");
+                return -1;
+            }
+            rs->frame_left = cont.data_length;
+        }
+
+        size_t want = count < rs->frame_left ? count : rs->frame_left;
+        if (want > WIRE_RECV_BUFFER) want = WIRE_RECV_BUFFER;
+
+        ssize_t n;
+        if (rs->pipe_fds[0] >= 0 && !*dst_failed) {
+            n = splice(rs->fd, NULL, rs->pipe_fds[1], NULL, want, SPLICE_F_MOVE | SPLICE_F_MORE);
+            if (n < 0 && errno == EINVAL) {
+                relay_drop_pipe(rs);  // Source cannot splice: bounce from now on
+                continue;
+            }
+            if (n > 0 && relay_pipe_out(rs, dst_fd, n) < 0) {
+                *dst_failed = 1;
+            }
+        } else {
+            n = recv(rs->fd, rs->bounce, want, 0);
+            if (n > 0 && !*dst_failed && send_all(dst_fd, rs->bounce, n) < 0) {
+                *dst_failed = 1;
+            }
+        }
+
+        if (n <= 0) {
+            if (n < 0 && errno == EINTR) continue;
+            if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK) && wait_for_fd(rs->fd, POLLIN) == 0) {
+                continue;
+            }
             char errmsg[256];
-            snprintf(errmsg, sizeof(errmsg), 
-                     "Failed to send payload (%d bytes) on socket %d: %s", 
-                     header->data_length, sockfd, strerror(errno));
+            snprintf(errmsg, sizeof(errmsg), "Failed to relay payload from socket %d: %s",
+                     rs->fd, n < 0 ? strerror(errno) : "connection closed");
             log_message("NETWORK", "ERROR", errmsg);
             return -1;
         }
+        rs->frame_left -= n;
+        rs->remaining -= n;
+        count -= n;
     }
-    
     return 0;
 }
 
 /**
- * recv_message
- * @brief Receive a framed message from a connected socket.
+ * relay_frames
+ * @brief Frame the relayed message for dst_fd and stream its body.
+ *
+ * @return 0 on success, -1 if the source failed.
+ */
+static int relay_frames(RelayState* rs, MessageHeader* header, int dst_fd, int* dst_failed) {
+    unsigned long long length = rs->remaining;
+    int chunked = length > WIRE_CHUNK_SIZE && get_socket_protocol(dst_fd) == PROTOCOL_V2;
+
+    MessageHeader out = *header;
+    if (!chunked && length > INT_MAX) {
+        log_message("NETWORK", "ERROR", "Relayed payload too large for a single v1 frame");
+        *dst_failed = 1;
+    }
+    out.frame_flags = chunked ? WIRE_FRAME_CHUNKED : 0;
+    out.total_length = length;
+    out.data_length = chunked ? WIRE_CHUNK_SIZE : (int)length;
+    if (!*dst_failed && send_message(dst_fd, &out, NULL) < 0) {
+        *dst_failed = 1;
+    }
+
+    // Continuation frames carry nothing but their slice (and the request ID)
+    MessageHeader cont;
+    memset(&cont, 0, sizeof(cont));
+    cont.msg_type = out.msg_type;
+    cont.op_code = out.op_code;
+    cont.request_id = out.request_id;
+    cont.frame_flags = WIRE_FRAME_CONTINUATION;
+
+    size_t slice = chunked ? WIRE_CHUNK_SIZE : (size_t)length;
+    while (1) {
+        if (relay_bytes(rs, dst_fd, slice, dst_failed) < 0) {
+            return -1;
+        }
+        if (rs->remaining == 0) {
+            return 0;
+        }
+        slice = rs->remaining < WIRE_CHUNK_SIZE ? (size_t)rs->remaining : WIRE_CHUNK_SIZE;
+        cont.data_length = (int)slice;
+        if (!*dst_failed && send_message(dst_fd, &cont, NULL) < 0) {
+            *dst_failed = 1;
+        }
+    }
+}
+
+/**
+ * relay_message
+ * @brief Forward a message from one socket to another without buffering it.
  *
- * Reads the MessageHeader using MSG_WAITALL and then allocates a buffer for
- * the payload if header->data_length > 0. The allocated buffer will be
- * null-terminated and must be freed by the caller (or set to NULL when no
- * payload exists).
+ * The header must already have been read from src_fd with
+ * recv_message_header(); its payload (single frame or chunked) is still on
+ * the socket. The header is sent to dst_fd in dst_fd's framing, re-chunked
+ * at WIRE_CHUNK_SIZE for v2 peers, and the payload bytes are moved from
+ * src_fd to dst_fd with splice() through a pipe, falling back to a bounce
+ * buffer. Memory use is bounded by the bounce buffer and the pipe,
+ * whatever the payload size.
  *
- * @param sockfd Connected socket file descriptor.
- * @param header Pointer to storage for the received MessageHeader.
- * @param payload Out parameter; on success points to malloc'd buffer
- *                (caller must free) or NULL when no payload.
- * @return Number of payload bytes received (>0), 0 on orderly shutdown,
- *         or negative on error.
+ * Compressed source frames cannot be relayed this way and fail as a source
+ * error; relaying processes must not enable compression on the source side
+ * (the Name Server never does, so storage servers send it plain frames).
+ *
+ * splice() cannot suppress SIGPIPE the way send() does with MSG_NOSIGNAL,
+ * so SIGPIPE is blocked on the calling thread for the duration and a
+ * signal raised by a vanished destination is discarded.
+ *
+ * @param src_fd Socket the header was read from.
+ * @param header Header returned by recv_message_header(); sent as is apart
+ *               from the framing fields.
+ * @param dst_fd Socket to forward the message to.
+ * @param delivered Optional out: 1 if dst_fd received the whole message,
+ *                  0 if it failed (the error is logged).
+ * @return 0 once the whole payload has been consumed from src_fd, whether
+ *         or not dst_fd took it (src_fd stays usable), -1 if src_fd failed.
  */
-int recv_message(int sockfd, MessageHeader* header, char** payload) {
-    // Initialize payload to NULL
+int relay_message(int src_fd, MessageHeader* header, int dst_fd, int* delivered) {
+    RelayState* rs = NULL;
+    if (header->frame_flags & WIRE_FRAME_COMPRESSED) {
+        log_message("NETWORK", "ERROR", "Compressed frames cannot be relayed");
+    } else {
+        rs = malloc(sizeof(RelayState));
+    }
+    if (!rs) {
+        if (delivered) *delivered = 0;
+        return -1;
+    }
+    rs->fd = src_fd;
+    rs->remaining = header->total_length;
+    rs->frame_left = header->data_length;
+    if (rs->remaining == 0 || pipe(rs->pipe_fds) < 0) {
+        rs->pipe_fds[0] = rs->pipe_fds[1] = -1;
+    }
+
+    sigset_t sigpipe, saved;
+    sigemptyset(&sigpipe);
+    sigaddset(&sigpipe, SIGPIPE);
+    pthread_sigmask(SIG_BLOCK, &sigpipe, &saved);
+
+    int dst_failed = 0;
+    int corked = cork_for_stream(dst_fd);
+    int rc = relay_frames(rs, header, dst_fd, &dst_failed);
+    uncork_after_stream(dst_fd, corked);
+
+    // Discard a SIGPIPE raised by the relay (unless the caller blocks it too)
+    struct timespec no_wait = { 0, 0 };
+    sigset_t pending;
+    sigpending(&pending);
+    if (dst_failed && !sigismember(&saved, SIGPIPE) && sigismember(&pending, SIGPIPE)) {
+        sigtimedwait(&sigpipe, NULL, &no_wait);
+    }
+    pthread_sigmask(SIG_SETMASK, &saved, NULL);
+
+    relay_drop_pipe(rs);
+    free(rs);
+    if (dst_failed) {
+        char errmsg[256];
+        snprintf(errmsg, sizeof(errmsg), "Failed to relay message to socket %d", dst_fd);
+        log_message("NETWORK", "ERROR", errmsg);
+    }
+    if (delivered) *delivered = !dst_failed;
+    return rc;
+}
+
+/**
+ * negotiate_protocol
+ * @brief Agree on a wire protocol version with the server on sockfd.
+ *
+ * Sends OP_HELLO in v1 framing offering PROTOCOL_VERSION. A v2-aware server
+ * answers with an ACK carrying "PROTO <n>"; an older server answers with
+ * ERR_INVALID_COMMAND and the connection simply stays on v1. Only use this
+ * on connections whose server keeps the socket open after an unknown opcode
+ * (the Name Server, or a Storage Server known to be v2 capable).
+ *
+ * @param sockfd Freshly connected socket.
+ * @return Negotiated version (>= PROTOCOL_V1), or -1 on network error.
+ */
+int negotiate_protocol(int sockfd) {
+    MessageHeader header;
+    init_message_header(&header, MSG_REQUEST, OP_HELLO, NULL);
+    char offer[32];
+    snprintf(offer, sizeof(offer), "PROTO %d", PROTOCOL_VERSION);
+    header.data_length = strlen(offer);
+
+    set_socket_protocol(sockfd, PROTOCOL_V1);
+    if (send_message(sockfd, &header, offer) < 0) {
+        return -1;
+    }
+
+    char* reply = NULL;
+    if (recv_message(sockfd, &header, &reply) <= 0) {
+        return -1;
+    }
+
+    int version = PROTOCOL_V1;
+    int offered;
+    if (header.msg_type == MSG_ACK && reply &&
+        sscanf(reply, "PROTO %d", &offered) == 1 &&
+        offered > PROTOCOL_V1 && offered <= PROTOCOL_VERSION) {
+        version = offered;
+    }
+    if (reply) free(reply);
+
+    set_socket_protocol(sockfd, version);
+    return version;
+}
+
+/**
+ * answer_protocol_hello
+ * @brief Server side of negotiate_protocol(): reply to an OP_HELLO request.
+ *
+ * Picks the highest version both sides support and acknowledges it. The
+ * reply goes out in the framing the hello arrived in; the peer switches
+ * to the agreed version for every subsequent request.
+ *
+ * @param sockfd Socket the hello arrived on.
+ * @param header Received request header (reused for the reply).
+ * @param payload Hello payload ("PROTO <n>"), may be NULL.
+ * @return The agreed protocol version.
+ */
+int answer_protocol_hello(int sockfd, MessageHeader* header, const char* payload) {
+    int offered = PROTOCOL_V1;
     if (payload) {
+        sscanf(payload, "PROTO %d", &offered);
+    }
+    int version = offered < PROTOCOL_VERSION ? offered : PROTOCOL_VERSION;
+    if (version < PROTOCOL_V1) {
+        version = PROTOCOL_V1;
+    }
+
+    char reply[32];
+    snprintf(reply, sizeof(reply), "PROTO %d", version);
+    header->msg_type = MSG_ACK;
+    header->error_code = ERR_SUCCESS;
+    header->data_length = strlen(reply);
+    send_message(sockfd, header, reply);
+    return version;
+}
+
+/**
+ * mux_init
+ * @brief Prepare a MuxChannel for pipelined requests on a connected socket.
+ *
+ * @param ch Channel to initialize.
+ * @param sockfd Connected socket; its protocol version must already be set.
+ */
+void mux_init(MuxChannel* ch, int sockfd) {
+    memset(ch, 0, sizeof(*ch));
+    ch->fd = sockfd;
+}
+
+/**
+ * mux_send
+ * @brief Send a request without waiting for its reply.
+ *
+ * Tags the request with the channel's next request ID (written back into
+ * header->request_id) and records it as in flight. At most
+ * MUX_MAX_IN_FLIGHT requests may be outstanding; collect replies before
+ * sending more, or both peers can block on full socket buffers.
+ *
+ * @param ch Channel to send on.
+ * @param header Request header; request_id is overwritten.
+ * @param payload Optional payload.
+ * @return The request ID (never 0), or 0 if the window is full or the send
+ *         failed.
+ */
+unsigned int mux_send(MuxChannel* ch, MessageHeader* header, const char* payload) {
+    if (ch->in_flight_count >= MUX_MAX_IN_FLIGHT) {
+        return 0;
+    }
+
+    if (++ch->next_id == 0) {
+        ch->next_id = 1;  // 0 means "no ID" on the wire
+    }
+    header->request_id = ch->next_id;
+    if (send_message(ch->fd, header, payload) < 0) {
+        return 0;
+    }
+
+    ch->in_flight[ch->in_flight_count++] = header->request_id;
+    return header->request_id;
+}
+
+// Read one reply off the socket and resolve which in-flight request it answers
+static int mux_read_frame(MuxChannel* ch, MessageHeader* header, char** payload) {
+    if (ch->in_flight_count == 0) {
+        return -1;
+    }
+    if (recv_message(ch->fd, header, payload) <= 0) {
+        return -1;
+    }
+
+    // v1 peers cannot echo IDs, but they answer strictly in order
+    if (header->request_id == 0) {
+        header->request_id = ch->in_flight[0];
+    }
+
+    for (int i = 0; i < ch->in_flight_count; i++) {
+        if (ch->in_flight[i] == header->request_id) {
+            memmove(&ch->in_flight[i], &ch->in_flight[i + 1],
+                    (ch->in_flight_count - i - 1) * sizeof(ch->in_flight[0]));
+            ch->in_flight_count--;
+            return 1;
+        }
+    }
+
+    char errmsg[256];
+    snprintf(errmsg, sizeof(errmsg),
+             "Reply for unknown request id %u on socket %d", header->request_id, ch->fd);
+    log_message("NETWORK", "ERROR", errmsg);
+    if (*payload) {
+        free(*payload);
         *payload = NULL;
     }
-    
-    // Receive header
-    ssize_t received = recv(sockfd, header, sizeof(MessageHeader), MSG_WAITALL);
-    if (received <= 0) {
-        if (received < 0) {
-            char errmsg[256];
-            snprintf(errmsg, sizeof(errmsg), 
-                     "Failed to receive message header on socket %d: %s", 
-                     sockfd, strerror(errno));
-            log_message("NETWORK", "ERROR", errmsg);
+    return -1;
+}
+
+static void mux_park(MuxChannel* ch, const MessageHeader* header, char* payload) {
+    MuxFrame* frame = malloc(sizeof(MuxFrame));
+    if (!frame) {
+        free(payload);
+        return;
+    }
+    frame->header = *header;
+    frame->payload = payload;
+    frame->next = NULL;
+
+    MuxFrame** tail = &ch->parked;
+    while (*tail) {
+        tail = &(*tail)->next;
+    }
+    *tail = frame;
+}
+
+static void mux_deliver(MuxFrame* frame, MessageHeader* header, char** payload) {
+    *header = frame->header;
+    if (payload) {
+        *payload = frame->payload;
+    } else if (frame->payload) {
+        free(frame->payload);
+    }
+    free(frame);
+}
+
+/**
+ * mux_recv
+ * @brief Wait for the reply to one specific in-flight request.
+ *
+ * Replies to other requests that arrive first are parked on the channel and
+ * handed out by later mux_recv()/mux_recv_next() calls.
+ *
+ * @param ch Channel the request was sent on.
+ * @param request_id ID returned by mux_send().
+ * @param header Out: reply header.
+ * @param payload Out: malloc'd reply payload or NULL (may itself be NULL).
+ * @return 1 on success, -1 if the ID is unknown or the connection failed.
+ */
+int mux_recv(MuxChannel* ch, unsigned int request_id, MessageHeader* header, char** payload) {
+    if (payload) {
+        *payload = NULL;
+    }
+
+    for (MuxFrame** link = &ch->parked; *link; link = &(*link)->next) {
+        if ((*link)->header.request_id == request_id) {
+            MuxFrame* frame = *link;
+            *link = frame->next;
+            mux_deliver(frame, header, payload);
+            return 1;
         }
-        return received;
     }
-    
-    // Receive payload if exists
-    if (payload && header->data_length > 0) {
-        *payload = (char*)malloc(header->data_length + 1);
-        if (*payload == NULL) {
-            char errmsg[256];
-            snprintf(errmsg, sizeof(errmsg), 
-                     "Failed to allocate %d bytes for payload: %s", 
-                     header->data_length, strerror(errno));
-            log_message("NETWORK", "ERROR", errmsg);
-            return -1;
+
+    int outstanding = 0;
+    for (int i = 0; i < ch->in_flight_count; i++) {
+        if (ch->in_flight[i] == request_id) {
+            outstanding = 1;
+            break;
         }
-        
-        received = recv(sockfd, *payload, header->data_length, MSG_WAITALL);
-        if (received != header->data_length) {
-            char errmsg[256];
-            snprintf(errmsg, sizeof(errmsg), 
-                     "Failed to receive payload (%d bytes expected, %zd received) on socket %d: %s", 
-                     header->data_length, received, sockfd, strerror(errno));
-            log_message("NETWORK", "ERROR", errmsg);
-            free(*payload);
-            *payload = NULL;
+    }
+    if (!outstanding) {
+        return -1;
+    }
+
+    while (1) {
+        MessageHeader reply;
+        char* body = NULL;
+        if (mux_read_frame(ch, &reply, &body) < 0) {
             return -1;
         }
-        
-        (*payload)[header->data_length] = '\0';
-    } else if (payload) {
+        if (reply.request_id == request_id) {
+            *header = reply;
+            if (payload) {
+                *payload = body;
+            } else if (body) {
+                free(body);
+            }
+            return 1;
+        }
+        mux_park(ch, &reply, body);
+    }
+}
+
+/**
+ * mux_recv_next
+ * @brief Collect whichever reply completes next.
+ *
+ * @param ch Channel to read from.
+ * @param request_id Out: ID of the request the reply belongs to.
+ * @param header Out: reply header.
+ * @param payload Out: malloc'd reply payload or NULL (may itself be NULL).
+ * @param wait Non-zero to block until a reply arrives; zero to return
+ *             immediately when none is ready.
+ * @return 1 when a reply was delivered, 0 if nothing is outstanding (or
+ *         ready, when not waiting), -1 if the connection failed.
+ */
+int mux_recv_next(MuxChannel* ch, unsigned int* request_id, MessageHeader* header,
+                  char** payload, int wait) {
+    if (payload) {
         *payload = NULL;
     }
-    
-    return received;
+
+    if (ch->parked) {
+        MuxFrame* frame = ch->parked;
+        ch->parked = frame->next;
+        mux_deliver(frame, header, payload);
+    } else {
+        if (ch->in_flight_count == 0) {
+            return 0;
+        }
+        if (!wait) {
+            struct pollfd pfd = { .fd = ch->fd, .events = POLLIN };
+            if (poll(&pfd, 1, 0) <= 0) {
+                return 0;
+            }
+        }
+        char* body = NULL;
+        if (mux_read_frame(ch, header, &body) < 0) {
+            return -1;
+        }
+        if (payload) {
+            *payload = body;
+        } else if (body) {
+            free(body);
+        }
+    }
+
+    if (request_id) {
+        *request_id = header->request_id;
+    }
+    return 1;
+}
+
+/**
+ * mux_discard
+ * @brief Drop parked replies and forget in-flight requests.
+ *
+ * The socket itself is left open; after abandoning in-flight requests it is
+ * out of sync and should be closed rather than reused.
+ *
+ * @param ch Channel to reset.
+ */
+void mux_discard(MuxChannel* ch) {
+    while (ch->parked) {
+        MuxFrame* frame = ch->parked;
+        ch->parked = frame->next;
+        if (frame->payload) {
+            free(frame->payload);
+        }
+        free(frame);
+    }
+    ch->in_flight_count = 0;
 }
 
 /**
@@ -165,15 +2032,98 @@ int create_server_socket(int port) {
     return sockfd;
 }
 
+/**
+ * create_unix_server_socket
+ * @brief Create, bind and listen on a Unix-domain stream socket.
+ *
+ * A socket file left behind by a previous run is removed first. The caller
+ * is responsible for closing the returned fd and unlinking the path.
+ *
+ * @param path Filesystem path for the socket.
+ * @return Listening socket fd on success, or -1 on failure.
+ */
+int create_unix_server_socket(const char* path) {
+    struct sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if (strlen(path) >= sizeof(addr.sun_path)) {
+        log_message("NETWORK", "ERROR", "Unix socket path too long");
+        return -1;
+    }
+    strcpy(addr.sun_path, path);
+    
+    int sockfd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (sockfd < 0) {
+        char errmsg[256];
+        snprintf(errmsg, sizeof(errmsg), "Failed to create socket: %s", strerror(errno));
+        log_message("NETWORK", "ERROR", errmsg);
+        return -1;
+    }
+    
+    unlink(path);
+    if (bind(sockfd, (struct sockaddr*)&addr, sizeof(addr)) < 0 || listen(sockfd, 10) < 0) {
+        char errmsg[1200];
+        snprintf(errmsg, sizeof(errmsg), "Failed to listen on %s: %s", path, strerror(errno));
+        log_message("NETWORK", "ERROR", errmsg);
+        close(sockfd);
+        return -1;
+    }
+    
+    return sockfd;
+}
+
+/**
+ * connect_unix
+ * @brief Connect to a Unix-domain stream socket.
+ *
+ * @param path Filesystem path of the listening socket.
+ * @param quiet Do not log a failure (the caller has a fallback).
+ * @return Connected socket fd on success, or -1 on failure.
+ */
+static int connect_unix(const char* path, int quiet) {
+    struct sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if (strlen(path) >= sizeof(addr.sun_path)) {
+        return -1;
+    }
+    strcpy(addr.sun_path, path);
+    
+    int sockfd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (sockfd < 0) {
+        return -1;
+    }
+    if (connect(sockfd, (struct sockaddr*)&addr, sizeof(addr)) < 0) {
+        if (!quiet) {
+            char errmsg[1200];
+            snprintf(errmsg, sizeof(errmsg), "Failed to connect to %s: %s", path, strerror(errno));
+            log_message("NETWORK", "ERROR", errmsg);
+        }
+        close(sockfd);
+        return -1;
+    }
+    
+    set_socket_protocol(sockfd, PROTOCOL_V1);
+    set_socket_role(sockfd, SOCKET_ROLE_INTERACTIVE);
+    return sockfd;
+}
+
 /**
  * connect_to_server
  * @brief Establish a TCP connection to the specified IPv4 address and port.
  *
+ * An address of the form "unix:<path>" connects to a Unix-domain socket
+ * instead, and the port is ignored.
+ *
  * @param ip Null-terminated IPv4 address string (e.g., "127.0.0.1").
  * @param port Destination port in host byte order.
  * @return Connected socket fd on success, or -1 on failure.
  */
 int connect_to_server(const char* ip, int port) {
+    if (strncmp(ip, UNIX_SOCKET_PREFIX, strlen(UNIX_SOCKET_PREFIX)) == 0) {
+        return connect_unix(ip + strlen(UNIX_SOCKET_PREFIX), 0);
+    }
+    
     int sockfd = socket(AF_INET, SOCK_STREAM, 0);
     if (sockfd < 0) {
         char errmsg[256];
@@ -204,9 +2154,77 @@ int connect_to_server(const char* ip, int port) {
         return -1;
     }
     
+    // New connections start on v1 until the caller negotiates otherwise
+    set_socket_protocol(sockfd, PROTOCOL_V1);
+    set_socket_role(sockfd, SOCKET_ROLE_INTERACTIVE);
     return sockfd;
 }
 
+/**
+ * connect_to_endpoint
+ * @brief Connect to a server, preferring its Unix socket when it is local.
+ *
+ * If local_addr names this host (see local_address_path()), the Unix socket
+ * is tried first; if that fails, or the server is remote, the connection
+ * falls back to TCP at ip:port.
+ *
+ * @param ip Server IPv4 address.
+ * @param port Server TCP port.
+ * @param local_addr Server's advertised local address, or NULL/empty.
+ * @return Connected socket fd on success, or -1 on failure.
+ */
+int connect_to_endpoint(const char* ip, int port, const char* local_addr) {
+    char path[MAX_LOCAL_ADDR];
+    if (local_address_path(local_addr, path, sizeof(path)) == 0) {
+        int sockfd = connect_unix(path, 1);
+        if (sockfd >= 0) {
+            return sockfd;
+        }
+    }
+    return connect_to_server(ip, port);
+}
+
+/**
+ * set_socket_role
+ * @brief Tune a TCP socket for the kind of traffic it carries.
+ *
+ * SOCKET_ROLE_INTERACTIVE enables TCP_NODELAY: every request and reply is
+ * a single vectored write, so there is nothing for Nagle to coalesce and
+ * it would only add a delayed-ACK stall. SOCKET_ROLE_BULK turns Nagle back
+ * on and corks the socket so a stream of frames fills whole segments;
+ * switching back to interactive uncorks it, flushing anything pending.
+ * Non-TCP sockets ignore the options.
+ *
+ * @param sockfd Connected socket file descriptor.
+ * @param role SOCKET_ROLE_INTERACTIVE or SOCKET_ROLE_BULK.
+ */
+void set_socket_role(int sockfd, int role) {
+    int bulk = (role == SOCKET_ROLE_BULK);
+    int nodelay = !bulk;
+    setsockopt(sockfd, IPPROTO_TCP, TCP_CORK, &bulk, sizeof(bulk));
+    setsockopt(sockfd, IPPROTO_TCP, TCP_NODELAY, &nodelay, sizeof(nodelay));
+    if (sockfd >= 0 && sockfd < MAX_TRACKED_SOCKETS) {
+        socket_role[sockfd] = bulk ? SOCKET_ROLE_BULK : SOCKET_ROLE_INTERACTIVE;
+    }
+}
+
+/**
+ * set_socket_timeout
+ * @brief Bound how long a blocking send or receive on a socket may stall.
+ *
+ * Sets SO_SNDTIMEO and SO_RCVTIMEO, so a peer that stops reading or stops
+ * answering makes the call fail instead of holding its thread forever. A
+ * send that times out shuts the socket down (see send_iov()).
+ *
+ * @param sockfd Connected socket file descriptor.
+ * @param seconds Timeout in seconds; 0 waits forever.
+ */
+void set_socket_timeout(int sockfd, int seconds) {
+    struct timeval tv = { .tv_sec = seconds, .tv_usec = 0 };
+    setsockopt(sockfd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+    setsockopt(sockfd, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+}
+
 /**
  * init_message_header
  * @brief Initialize a MessageHeader with common fields and zero the rest.
@@ -232,24 +2250,40 @@ void init_message_header(MessageHeader* header, int msg_type, int op_code, const
 
 /**
  * parse_ss_info
- * @brief Parse storage server info string in "IP:port" format.
+ * @brief Parse storage server info string in "IP:port[:proto[:local]]" format.
  *
- * Extracts the IP address and port number from a server info string.
+ * Extracts the IP address and port number from a server info string. The
+ * Name Server appends the storage server's wire protocol version when it
+ * is newer than v1, and its local address ("<hostname>:<path>") when it
+ * listens on a Unix socket; older peers simply ignore the suffixes.
  *
- * @param ss_info Input string in "IP:port" format.
+ * @param ss_info Input string in "IP:port" or "IP:port:proto[:local]" format.
  * @param ip_out Buffer to store extracted IP (must be at least MAX_IP bytes).
  * @param port_out Pointer to store extracted port number.
+ * @param proto_out Optional; receives the advertised protocol version
+ *                  (PROTOCOL_V1 when absent). May be NULL.
+ * @param local_out Optional; receives the local address, or "" when absent
+ *                  (must be at least MAX_LOCAL_ADDR bytes). May be NULL.
  * @return 0 on success, -1 on parse error.
  */
-int parse_ss_info(const char* ss_info, char* ip_out, int* port_out) {
+int parse_ss_info(const char* ss_info, char* ip_out, int* port_out, int* proto_out,
+                  char* local_out) {
     if (!ss_info || !ip_out || !port_out) {
         return -1;
     }
     
-    if (sscanf(ss_info, "%[^:]:%d", ip_out, port_out) != 2) {
+    int proto = PROTOCOL_V1;
+    char local[MAX_LOCAL_ADDR] = "";
+    if (sscanf(ss_info, "%15[^:]:%d:%d:%159s", ip_out, port_out, &proto, local) < 2) {
         return -1;
     }
     
+    if (proto_out) {
+        *proto_out = (proto == PROTOCOL_V2) ? PROTOCOL_V2 : PROTOCOL_V1;
+    }
+    if (local_out) {
+        strcpy(local_out, local);
+    }
     return 0;
 }
 
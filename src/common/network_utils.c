@@ -60,3 +60,102 @@ int get_local_network_ip(char* ip_out, size_t size) {
     freeifaddrs(ifaddr);
     return result;
 }
+
+/**
+ * get_peer_address
+ * @brief Describe the remote end of a connected socket for logging.
+ *
+ * TCP peers yield their IPv4 address and port. Unix-domain peers have
+ * neither and are reported as "local" with port 0.
+ *
+ * @param sockfd Connected socket.
+ * @param ip_out Buffer for the address text (at least MAX_IP bytes).
+ * @param size Size of ip_out.
+ * @param port_out Receives the peer port (0 when there is none).
+ * @return 0 on success, -1 if the peer could not be determined.
+ */
+int get_peer_address(int sockfd, char* ip_out, size_t size, int* port_out) {
+    struct sockaddr_storage addr;
+    socklen_t addr_len = sizeof(addr);
+    *port_out = 0;
+    
+    if (getpeername(sockfd, (struct sockaddr*)&addr, &addr_len) != 0) {
+        snprintf(ip_out, size, "unknown");
+        return -1;
+    }
+    
+    if (addr.ss_family == AF_INET) {
+        struct sockaddr_in* in = (struct sockaddr_in*)&addr;
+        inet_ntop(AF_INET, &in->sin_addr, ip_out, size);
+        *port_out = ntohs(in->sin_port);
+    } else {
+        snprintf(ip_out, size, "local");
+    }
+    return 0;
+}
+
+/**
+ * unix_socket_path
+ * @brief Build the well-known Unix socket path for a server.
+ *
+ * The path is derived from the role and TCP port, so it is unique per
+ * server on a host and a restarted server reuses it.
+ *
+ * @param out Output buffer.
+ * @param size Size of out.
+ * @param role Short server role ("nm" or "ss").
+ * @param port The server's TCP port.
+ */
+void unix_socket_path(char* out, size_t size, const char* role, int port) {
+    snprintf(out, size, "%s/docs-%s-%d.sock", UNIX_SOCKET_DIR, role, port);
+}
+
+/**
+ * make_local_address
+ * @brief Combine this host's name and a Unix socket path into a local address.
+ *
+ * @param out Output buffer (at least MAX_LOCAL_ADDR bytes).
+ * @param size Size of out.
+ * @param path Unix socket path the server listens on.
+ * @return 0 on success, -1 if the hostname is unavailable or it does not fit.
+ */
+int make_local_address(char* out, size_t size, const char* path) {
+    char host[64];
+    if (gethostname(host, sizeof(host)) != 0) {
+        return -1;
+    }
+    host[sizeof(host) - 1] = '\0';
+    
+    int n = snprintf(out, size, "%s:%s", host, path);
+    return (n > 0 && (size_t)n < size) ? 0 : -1;
+}
+
+/**
+ * local_address_path
+ * @brief Extract the socket path from a local address if it names this host.
+ *
+ * @param local_addr "<hostname>:<path>" as advertised by a server.
+ * @param path_out Receives the path.
+ * @param size Size of path_out.
+ * @return 0 if the address belongs to this host, -1 otherwise (including
+ *         an empty or malformed address).
+ */
+int local_address_path(const char* local_addr, char* path_out, size_t size) {
+    if (!local_addr || !local_addr[0]) {
+        return -1;
+    }
+    
+    const char* sep = strchr(local_addr, ':');
+    char host[64];
+    if (!sep || gethostname(host, sizeof(host)) != 0) {
+        return -1;
+    }
+    host[sizeof(host) - 1] = '\0';
+    
+    size_t host_len = sep - local_addr;
+    if (host_len != strlen(host) || strncmp(local_addr, host, host_len) != 0) {
+        return -1;
+    }
+    safe_strncpy(path_out, sep + 1, size);
+    return 0;
+}
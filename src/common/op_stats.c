@@ -0,0 +1,282 @@
+/*
+ * op_stats.c - Per-opcode latency histograms and lock wait times
+ *
+ * Each server records every request it finishes under its opcode: a count,
+ * an error count and a log-linear latency histogram. Threads taking the
+ * server's main locks go through stats_lock() (or stats_rdlock() and
+ * stats_wrlock() for reader-writer locks), which record how long they
+ * waited. Recording is a handful of relaxed atomic adds and never
+ * takes a lock, so it stays on in production; OP_STATS turns the counters
+ * into JSON (stats_to_json()) so tail latency can be watched from a client.
+ *
+ * Counters only ever grow. Readers take a snapshot bucket by bucket while
+ * writers keep adding, so a snapshot may be a few ops out of date, but every
+ * percentile it reports is computed from the buckets it actually read.
+ */
+
+#include "common.h"
+#include "cJSON.h"
+#include <limits.h>
+
+typedef struct {
+    const char* name;  // Set by the first record; names are string literals
+    unsigned long long errors;
+    LatencyHistogram latency;
+} OpStats;
+
+static OpStats op_stats[STATS_MAX_OPS];
+static LatencyHistogram lock_waits[STATS_LOCKS];
+static const char* lock_names[STATS_LOCKS] = { "ns_state", "lock_registry", "ns_state_read",
+                                               "ns_file_stripes" };
+static time_t stats_started;
+
+static int hist_bucket(unsigned int us) {
+    if (us < HIST_SUB_BUCKETS) {
+        return us;
+    }
+    int msb = 31 - __builtin_clz(us);
+    int sub = (us >> (msb - HIST_SUB_BITS)) & (HIST_SUB_BUCKETS - 1);
+    return HIST_SUB_BUCKETS + (msb - HIST_SUB_BITS) * HIST_SUB_BUCKETS + sub;
+}
+
+// Largest value that falls into a bucket
+static unsigned int hist_bucket_max(int bucket) {
+    if (bucket < HIST_SUB_BUCKETS) {
+        return bucket;
+    }
+    int msb = (bucket - HIST_SUB_BUCKETS) / HIST_SUB_BUCKETS + HIST_SUB_BITS;
+    unsigned int sub = (bucket - HIST_SUB_BUCKETS) % HIST_SUB_BUCKETS;
+    unsigned long long width = 1ULL << (msb - HIST_SUB_BITS);
+    unsigned long long top = (1ULL << msb) + (sub + 1) * width - 1;
+    return top > UINT_MAX ? UINT_MAX : (unsigned int)top;
+}
+
+/**
+ * hist_record
+ * @brief Add one sample to a histogram. Safe to call from any thread.
+ *
+ * @param h Histogram to update.
+ * @param us Sample in microseconds; clamped to [0, UINT_MAX].
+ */
+void hist_record(LatencyHistogram* h, double us) {
+    unsigned int v = us <= 0 ? 0 : us >= UINT_MAX ? UINT_MAX : (unsigned int)us;
+
+    __atomic_fetch_add(&h->counts[hist_bucket(v)], 1, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&h->total, 1, __ATOMIC_RELAXED);
+    if (v == 0) {
+        return;
+    }
+    __atomic_fetch_add(&h->sum_us, v, __ATOMIC_RELAXED);
+
+    unsigned long long max = __atomic_load_n(&h->max_us, __ATOMIC_RELAXED);
+    while (v > max && !__atomic_compare_exchange_n(&h->max_us, &max, v, 1,
+                                                   __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+    }
+}
+
+/**
+ * hist_percentile
+ * @brief Estimate a percentile from a histogram.
+ *
+ * @param h Histogram, possibly still being updated.
+ * @param fraction Percentile as a fraction, e.g. 0.99 for p99.
+ * @return Upper bound of the bucket holding the percentile (never above the
+ *         largest sample), or 0 if the histogram is empty.
+ */
+unsigned int hist_percentile(const LatencyHistogram* h, double fraction) {
+    unsigned long long counts[HIST_BUCKETS];
+    unsigned long long total = 0;
+    for (int i = 0; i < HIST_BUCKETS; i++) {
+        counts[i] = __atomic_load_n(&h->counts[i], __ATOMIC_RELAXED);
+        total += counts[i];
+    }
+    if (total == 0) {
+        return 0;
+    }
+
+    unsigned long long rank = (unsigned long long)(fraction * total + 0.999999);
+    if (rank < 1) rank = 1;
+    if (rank > total) rank = total;
+
+    unsigned long long seen = 0;
+    unsigned long long max = __atomic_load_n(&h->max_us, __ATOMIC_RELAXED);
+    for (int i = 0; i < HIST_BUCKETS; i++) {
+        seen += counts[i];
+        if (seen >= rank) {
+            unsigned int top = hist_bucket_max(i);
+            return top > max ? (unsigned int)max : top;
+        }
+    }
+    return (unsigned int)max;
+}
+
+/**
+ * hist_drain
+ * @brief Move every sample of a histogram into `out`, leaving it empty.
+ *
+ * Used for per-interval figures; samples recorded during the drain land in
+ * either the old or the new interval, never both.
+ *
+ * @param h Histogram to empty.
+ * @param out Filled with the drained samples.
+ */
+void hist_drain(LatencyHistogram* h, LatencyHistogram* out) {
+    for (int i = 0; i < HIST_BUCKETS; i++) {
+        out->counts[i] = __atomic_exchange_n(&h->counts[i], 0, __ATOMIC_RELAXED);
+    }
+    out->total = __atomic_exchange_n(&h->total, 0, __ATOMIC_RELAXED);
+    out->sum_us = __atomic_exchange_n(&h->sum_us, 0, __ATOMIC_RELAXED);
+    out->max_us = __atomic_exchange_n(&h->max_us, 0, __ATOMIC_RELAXED);
+}
+
+/**
+ * stats_record_op
+ * @brief Record one finished request.
+ *
+ * @param op_code Request opcode; unknown codes are counted under slot 0.
+ * @param name Operation name shown in the JSON (a string literal).
+ * @param us Time spent handling the request, in microseconds.
+ * @param error_code Result of the request; anything but ERR_SUCCESS counts
+ *                   as an error.
+ */
+void stats_record_op(int op_code, const char* name, double us, int error_code) {
+    if (op_code < 0 || op_code >= STATS_MAX_OPS) {
+        op_code = 0;
+        name = "UNKNOWN";
+    }
+    OpStats* s = &op_stats[op_code];
+
+    if (!__atomic_load_n(&s->name, __ATOMIC_RELAXED)) {
+        __atomic_store_n(&s->name, name, __ATOMIC_RELAXED);
+    }
+    if (error_code != ERR_SUCCESS) {
+        __atomic_fetch_add(&s->errors, 1, __ATOMIC_RELAXED);
+    }
+    hist_record(&s->latency, us);
+}
+
+// Record the wait of a lock the caller blocked on since `start`
+static void record_wait(int lock_id, const struct timespec* start) {
+    struct timespec end;
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    hist_record(&lock_waits[lock_id], (end.tv_sec - start->tv_sec) * 1e6 +
+                                      (end.tv_nsec - start->tv_nsec) / 1e3);
+}
+
+/**
+ * stats_lock
+ * @brief pthread_mutex_lock() that records how long the caller waited.
+ *
+ * An uncontended lock costs one trylock and is recorded as a zero wait, so
+ * the histogram also says how often the lock was contended.
+ *
+ * @param mutex Mutex to lock.
+ * @param lock_id Which lock it is (STATS_LOCK_*).
+ */
+void stats_lock(pthread_mutex_t* mutex, int lock_id) {
+    if (pthread_mutex_trylock(mutex) == 0) {
+        hist_record(&lock_waits[lock_id], 0);
+        return;
+    }
+
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    pthread_mutex_lock(mutex);
+    record_wait(lock_id, &start);
+}
+
+/**
+ * stats_rdlock
+ * @brief pthread_rwlock_rdlock() that records how long the caller waited.
+ *
+ * @param lock Reader-writer lock to take shared.
+ * @param lock_id Which lock it is (STATS_LOCK_*).
+ */
+void stats_rdlock(pthread_rwlock_t* lock, int lock_id) {
+    if (pthread_rwlock_tryrdlock(lock) == 0) {
+        hist_record(&lock_waits[lock_id], 0);
+        return;
+    }
+
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    pthread_rwlock_rdlock(lock);
+    record_wait(lock_id, &start);
+}
+
+/**
+ * stats_wrlock
+ * @brief pthread_rwlock_wrlock() that records how long the caller waited.
+ *
+ * @param lock Reader-writer lock to take exclusive.
+ * @param lock_id Which lock it is (STATS_LOCK_*).
+ */
+void stats_wrlock(pthread_rwlock_t* lock, int lock_id) {
+    if (pthread_rwlock_trywrlock(lock) == 0) {
+        hist_record(&lock_waits[lock_id], 0);
+        return;
+    }
+
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    pthread_rwlock_wrlock(lock);
+    record_wait(lock_id, &start);
+}
+
+// Add count, mean, percentiles and max of one histogram to obj
+static void hist_to_json(cJSON* obj, const LatencyHistogram* h) {
+    unsigned long long total = __atomic_load_n(&h->total, __ATOMIC_RELAXED);
+    unsigned long long sum = __atomic_load_n(&h->sum_us, __ATOMIC_RELAXED);
+
+    cJSON_AddNumberToObject(obj, "count", (double)total);
+    cJSON_AddNumberToObject(obj, "mean_us", total ? (double)sum / total : 0);
+    cJSON_AddNumberToObject(obj, "p50_us", hist_percentile(h, 0.50));
+    cJSON_AddNumberToObject(obj, "p90_us", hist_percentile(h, 0.90));
+    cJSON_AddNumberToObject(obj, "p99_us", hist_percentile(h, 0.99));
+    cJSON_AddNumberToObject(obj, "p999_us", hist_percentile(h, 0.999));
+    cJSON_AddNumberToObject(obj, "max_us", (double)__atomic_load_n(&h->max_us, __ATOMIC_RELAXED));
+}
+
+/**
+ * stats_start
+ * @brief Mark the start of the uptime reported by stats_to_json().
+ */
+void stats_start(void) {
+    stats_started = time(NULL);
+}
+
+/**
+ * stats_to_json
+ * @brief Snapshot this process's counters.
+ *
+ * Layout: {"component", "uptime_s", "ops": {NAME: {"op_code", "errors",
+ * "count", "mean_us", "p50_us", "p90_us", "p99_us", "p999_us", "max_us"}},
+ * "lock_waits": {LOCK: {...same, without op_code and errors}}}. Opcodes and
+ * locks that were never used are left out.
+ *
+ * @param component Name of this server ("NM" or "SS").
+ * @return New cJSON object; the caller adds its own fields and deletes it.
+ */
+cJSON* stats_to_json(const char* component) {
+    cJSON* root = cJSON_CreateObject();
+    cJSON_AddStringToObject(root, "component", component);
+    cJSON_AddNumberToObject(root, "uptime_s", stats_started ? (double)(time(NULL) - stats_started) : 0);
+
+    cJSON* ops = cJSON_AddObjectToObject(root, "ops");
+    for (int i = 0; i < STATS_MAX_OPS; i++) {
+        const char* name = __atomic_load_n(&op_stats[i].name, __ATOMIC_RELAXED);
+        if (!name) continue;
+        cJSON* op = cJSON_AddObjectToObject(ops, name);
+        cJSON_AddNumberToObject(op, "op_code", i);
+        cJSON_AddNumberToObject(op, "errors",
+                                (double)__atomic_load_n(&op_stats[i].errors, __ATOMIC_RELAXED));
+        hist_to_json(op, &op_stats[i].latency);
+    }
+
+    cJSON* locks = cJSON_AddObjectToObject(root, "lock_waits");
+    for (int i = 0; i < STATS_LOCKS; i++) {
+        if (__atomic_load_n(&lock_waits[i].total, __ATOMIC_RELAXED) == 0) continue;
+        hist_to_json(cJSON_AddObjectToObject(locks, lock_names[i]), &lock_waits[i]);
+    }
+    return root;
+}
@@ -68,6 +68,33 @@ char* read_file_content(const char* filepath) {
     return content;
 }
 
+/**
+ * read_fd_content
+ * @brief Read the entire contents of an open file into a malloc'd buffer.
+ *
+ * Reads from offset 0 with pread(), so the descriptor's file position is
+ * left alone and the same descriptor can be read again later.
+ *
+ * @param fd Open file descriptor.
+ * @return Pointer to malloc'd null-terminated content on success, or NULL.
+ */
+char* read_fd_content(int fd) {
+    struct stat st;
+    if (fstat(fd, &st) != 0) return NULL;
+    
+    char* content = (char*)malloc(st.st_size + 1);
+    if (!content) return NULL;
+    
+    size_t got = 0;
+    while (got < (size_t)st.st_size) {
+        ssize_t n = pread(fd, content + got, st.st_size - got, got);
+        if (n <= 0) break;
+        got += n;
+    }
+    content[got] = '\0';
+    return content;
+}
+
 /**
  * write_file_content
  * @brief Atomically write `content` to `filepath` using a temporary file and
@@ -212,6 +239,9 @@ char* get_error_message(int error_code) {
         case ERR_INVALID_FILENAME: return "Invalid filename: reserved extension not allowed";
         case ERR_USERNAME_TAKEN: return "Username is already in use";
         case ERR_SS_EXISTS: return "Storage Server ID already in use";
+        case ERR_SS_BUSY: return "Storage server busy, please retry";
+        case ERR_BATCH_ABORTED: return "Not applied: another operation in the batch failed";
+        case ERR_STALE_HANDLE: return "File handle is no longer open";
         default: return "Unknown error";
     }
 }
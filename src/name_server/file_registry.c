@@ -3,6 +3,8 @@
  * 
  * Manages file metadata, folder hierarchy, access control lists (ACLs),
  * and permission checking. Storage server registry is in ss_registry.c.
+ * Every change is journaled (journal.c) before it is acknowledged; the
+ * snapshot that journals are compacted into is written by save_state().
  */
 
 #include "common.h"
@@ -11,9 +13,298 @@
 
 extern NameServerState ns_state;
 
+// Full path of a file: "<folder>/<filename>", or "<filename>" at root
+static void file_full_path(const FileMetadata* file, char* path, size_t size) {
+    if (file->folder_path[0]) {
+        snprintf(path, size, "%s/%s", file->folder_path, file->filename);
+    } else {
+        snprintf(path, size, "%s", file->filename);
+    }
+}
+
+// Republish a changed file for lock-free lookups. Caller still holds the
+// lock that guarded the change. On allocation failure the old version stays
+// visible, so log it: readers would route by stale metadata.
+static void publish_file(const FileMetadata* file) {
+    if (file_view_publish(ns_state.file_view, file) != ERR_SUCCESS) {
+        char msg[MAX_FULL_PATH + 64];
+        snprintf(msg, sizeof(msg), "Failed to publish metadata of '%s'", file->filename);
+        log_message("NM", "ERROR", msg);
+    }
+}
+
+// Registry keys: a file's full path, a folder's path, a client's username,
+// and "<filename>\n<requester>" for an access request
+static void file_key(const void* entry, char* key, size_t size) {
+    file_full_path((const FileMetadata*)entry, key, size);
+}
+
+static void folder_key(const void* entry, char* key, size_t size) {
+    snprintf(key, size, "%s", ((const FolderMetadata*)entry)->foldername);
+}
+
+static void client_key(const void* entry, char* key, size_t size) {
+    snprintf(key, size, "%s", ((const ClientInfo*)entry)->username);
+}
+
+static void request_key(const void* entry, char* key, size_t size) {
+    const AccessRequest* req = (const AccessRequest*)entry;
+    snprintf(key, size, "%s\n%s", req->filename, req->requester);
+}
+
+// ID of the pending request of `requester` for `filename`, or -1
+static int find_request(const char* filename, const char* requester) {
+    char key[MAX_FULL_PATH];
+    snprintf(key, sizeof(key), "%s\n%s", filename, requester);
+    return registry_find(&ns_state.access_requests, key);
+}
+
+#define NM_DATA_DIR "data"
+#define NM_STATE_FILE "data/nm_state.dat"
+
+// Journal record types (see journal.c). Payloads use the state file's line
+// formats, so snapshots and the journal share one writer and one parser per
+// kind of entry. Replaying a record twice leaves the same state as once.
+#define RECORD_FILE 'F'          // File entry: created, or its ACL or stats changed
+#define RECORD_FILE_MOVED 'M'    // Old full path line, then the file entry
+#define RECORD_FILE_DELETED 'D'  // Full path line
+#define RECORD_FOLDER 'O'        // Folder entry
+#define RECORD_REQUEST 'R'       // Access request entry
+#define RECORD_REQUEST_DONE 'X'  // "<filename>|<requester>" of an approved or denied request
+
+static void write_acl(FILE* f, const AccessControlEntry* acl, int count) {
+    for (int i = 0; i < count; i++) {
+        fprintf(f, "%s|%d|%d\n", acl[i].username, acl[i].read_permission, acl[i].write_permission);
+    }
+}
+
+static void write_file_entry(FILE* f, const FileMetadata* file) {
+    fprintf(f, "%s|%s|%s|%d|%ld|%ld|%ld|%ld|%d|%d|%d\n",
+            file->filename, file->folder_path, file->owner, file->ss_id,
+            file->created_time, file->last_modified, file->last_accessed,
+            file->file_size, file->word_count, file->char_count, file->acl_count);
+    write_acl(f, file->acl, file->acl_count);
+}
+
+static void write_folder_entry(FILE* f, const FolderMetadata* folder) {
+    fprintf(f, "%s|%s|%ld|%d|%d\n",
+            folder->foldername, folder->owner,
+            folder->created_time, folder->parent_folder_idx, folder->acl_count);
+    write_acl(f, folder->acl, folder->acl_count);
+}
+
+static void write_request_entry(FILE* f, const AccessRequest* req) {
+    fprintf(f, "%s|%s|%ld|%d|%d\n",
+            req->filename, req->requester, req->request_time,
+            req->read_requested, req->write_requested);
+}
+
+// Read a line and split it at '|' into at most `max` fields, keeping empty
+// ones (a root file's folder). Returns the field count, 0 at end of input.
+static int read_fields(FILE* f, char* line, size_t size, char** fields, int max) {
+    if (!fgets(line, size, f)) {
+        return 0;
+    }
+    line[strcspn(line, "\n")] = '\0';
+    int count = 0;
+    char* field = line;
+    while (count < max) {
+        fields[count++] = field;
+        char* bar = strchr(field, '|');
+        if (!bar) {
+            break;
+        }
+        *bar = '\0';
+        field = bar + 1;
+    }
+    return count;
+}
+
+// Read `count` ACL lines into a new array (NULL when count is 0)
+static int read_acl(FILE* f, AccessControlEntry** acl, int count) {
+    *acl = NULL;
+    if (count <= 0) {
+        return ERR_SUCCESS;
+    }
+    *acl = calloc(count, sizeof(AccessControlEntry));
+    if (!*acl) {
+        return ERR_FILE_OPERATION_FAILED;
+    }
+    for (int i = 0; i < count; i++) {
+        char line[BUFFER_SIZE];
+        char* fields[3];
+        if (read_fields(f, line, sizeof(line), fields, 3) != 3) {
+            free(*acl);
+            *acl = NULL;
+            return ERR_FILE_OPERATION_FAILED;
+        }
+        safe_strncpy((*acl)[i].username, fields[0], sizeof((*acl)[i].username));
+        (*acl)[i].read_permission = atoi(fields[1]);
+        (*acl)[i].write_permission = atoi(fields[2]);
+    }
+    return ERR_SUCCESS;
+}
+
+// Parse a file entry; on success the caller owns file->acl
+static int read_file_entry(FILE* f, FileMetadata* file) {
+    char line[2 * MAX_FULL_PATH];
+    char* fields[11];
+    memset(file, 0, sizeof(FileMetadata));
+    if (read_fields(f, line, sizeof(line), fields, 11) != 11) {
+        return ERR_FILE_OPERATION_FAILED;
+    }
+    safe_strncpy(file->filename, fields[0], sizeof(file->filename));
+    safe_strncpy(file->folder_path, fields[1], sizeof(file->folder_path));
+    safe_strncpy(file->owner, fields[2], sizeof(file->owner));
+    file->ss_id = atoi(fields[3]);
+    file->created_time = atol(fields[4]);
+    file->last_modified = atol(fields[5]);
+    file->last_accessed = atol(fields[6]);
+    file->file_size = atol(fields[7]);
+    file->word_count = atoi(fields[8]);
+    file->char_count = atoi(fields[9]);
+    file->acl_count = atoi(fields[10]);
+    return read_acl(f, &file->acl, file->acl_count);
+}
+
+// Parse a folder entry; on success the caller owns folder->acl
+static int read_folder_entry(FILE* f, FolderMetadata* folder) {
+    char line[2 * MAX_FULL_PATH];
+    char* fields[5];
+    memset(folder, 0, sizeof(FolderMetadata));
+    if (read_fields(f, line, sizeof(line), fields, 5) != 5) {
+        return ERR_FILE_OPERATION_FAILED;
+    }
+    safe_strncpy(folder->foldername, fields[0], sizeof(folder->foldername));
+    safe_strncpy(folder->owner, fields[1], sizeof(folder->owner));
+    folder->created_time = atol(fields[2]);
+    folder->parent_folder_idx = atoi(fields[3]);
+    folder->acl_count = atoi(fields[4]);
+    return read_acl(f, &folder->acl, folder->acl_count);
+}
+
+static int read_request_entry(FILE* f, AccessRequest* req) {
+    char line[2 * MAX_FULL_PATH];
+    char* fields[5];
+    memset(req, 0, sizeof(AccessRequest));
+    int count = read_fields(f, line, sizeof(line), fields, 5);
+    if (count < 3) {
+        return ERR_FILE_OPERATION_FAILED;
+    }
+    safe_strncpy(req->filename, fields[0], sizeof(req->filename));
+    safe_strncpy(req->requester, fields[1], sizeof(req->requester));
+    req->request_time = atol(fields[2]);
+    // Old format without permissions - default to read only
+    req->read_requested = count == 5 ? atoi(fields[3]) : 1;
+    req->write_requested = count == 5 ? atoi(fields[4]) : 0;
+    return ERR_SUCCESS;
+}
+
+// Journal a file's current state, or with old_path its move from there.
+// Caller holds the lock that guarded the change.
+static long journal_file(const FileMetadata* file, const char* old_path) {
+    char* payload = NULL;
+    size_t len = 0;
+    FILE* f = open_memstream(&payload, &len);
+    if (!f) {
+        return -1;
+    }
+    if (old_path) {
+        fprintf(f, "%s\n", old_path);
+    }
+    write_file_entry(f, file);
+    fclose(f);
+    long lsn = journal_append(old_path ? RECORD_FILE_MOVED : RECORD_FILE, payload, len);
+    free(payload);
+    return lsn;
+}
+
+static long journal_folder(const FolderMetadata* folder) {
+    char* payload = NULL;
+    size_t len = 0;
+    FILE* f = open_memstream(&payload, &len);
+    if (!f) {
+        return -1;
+    }
+    write_folder_entry(f, folder);
+    fclose(f);
+    long lsn = journal_append(RECORD_FOLDER, payload, len);
+    free(payload);
+    return lsn;
+}
+
+static long journal_request(const AccessRequest* req) {
+    char* payload = NULL;
+    size_t len = 0;
+    FILE* f = open_memstream(&payload, &len);
+    if (!f) {
+        return -1;
+    }
+    write_request_entry(f, req);
+    fclose(f);
+    long lsn = journal_append(RECORD_REQUEST, payload, len);
+    free(payload);
+    return lsn;
+}
+
+// Journal the removal of the entry with `key` (a path, or "<file>|<user>")
+static long journal_removal(char type, const char* key) {
+    char line[MAX_FULL_PATH + 2];
+    int len = snprintf(line, sizeof(line), "%s\n", key);
+    return journal_append(type, line, len);
+}
+
+// Wait until a journaled change is durable before it is acknowledged. The
+// change is already applied in memory by then, so a journal that cannot be
+// written does not undo it: it is reported as applied, and becomes durable
+// with the next snapshot, which the flusher retries after a write failure.
+static int commit_change(long lsn) {
+    if (journal_commit(lsn) != ERR_SUCCESS) {
+        log_message("NM", "WARN", lsn < 0
+                    ? "Change applied but not journaled (out of memory); durable after the next snapshot"
+                    : "Change applied but not yet durable: metadata journal write failed");
+    }
+    return ERR_SUCCESS;
+}
+
+/**
+ * nm_registry_init
+ * @brief Create the empty file, folder, client and access request tables.
+ *
+ * @return ERR_SUCCESS, or ERR_FILE_OPERATION_FAILED if out of memory.
+ */
+int nm_registry_init(void) {
+    if (registry_init(&ns_state.files, sizeof(FileMetadata), file_key) != ERR_SUCCESS ||
+        registry_init(&ns_state.folders, sizeof(FolderMetadata), folder_key) != ERR_SUCCESS ||
+        registry_init(&ns_state.clients, sizeof(ClientInfo), client_key) != ERR_SUCCESS ||
+        registry_init(&ns_state.access_requests, sizeof(AccessRequest), request_key) != ERR_SUCCESS) {
+        return ERR_FILE_OPERATION_FAILED;
+    }
+    return ERR_SUCCESS;
+}
+
+/**
+ * nm_registry_free
+ * @brief Free every registry table and the ACLs of its entries, at exit.
+ */
+void nm_registry_free(void) {
+    for (int id = registry_next(&ns_state.files, -1); id >= 0;
+         id = registry_next(&ns_state.files, id)) {
+        free(((FileMetadata*)registry_get(&ns_state.files, id))->acl);
+    }
+    for (int id = registry_next(&ns_state.folders, -1); id >= 0;
+         id = registry_next(&ns_state.folders, id)) {
+        free(((FolderMetadata*)registry_get(&ns_state.folders, id))->acl);
+    }
+    registry_free(&ns_state.files);
+    registry_free(&ns_state.folders);
+    registry_free(&ns_state.clients);
+    registry_free(&ns_state.access_requests);
+}
+
 /**
  * nm_register_file
- * @brief Register a new file in the Name Server registry and persist state.
+ * @brief Register a new file in the Name Server registry and journal it.
  *
  * Creates a FileMetadata entry for `filename`, sets the owner and assigns the
  * storage server id where the file will reside. Initializes basic counters
@@ -23,73 +314,69 @@ extern NameServerState ns_state;
  * @param folder_path Path to folder containing file (empty string for root).
  * @param owner Null-terminated username who will own the file.
  * @param ss_id ID of the Storage Server assigned to hold the file.
- * @return ERR_SUCCESS on success, or an ERR_* code on failure (e.g.
- *         ERR_FILE_EXISTS, ERR_FILE_OPERATION_FAILED).
+ * @return ERR_SUCCESS once the new entry is durable, or an ERR_* code on
+ *         failure (e.g. ERR_FILE_EXISTS, ERR_FILE_OPERATION_FAILED).
  */
 int nm_register_file(const char* filename, const char* folder_path, const char* owner, int ss_id) {
-    pthread_mutex_lock(&ns_state.lock);
+    FileMetadata new_file;
+    memset(&new_file, 0, sizeof(new_file));
+    strcpy(new_file.filename, filename);
+    strcpy(new_file.folder_path, folder_path ? folder_path : "");
+    
+    char full_path[MAX_FULL_PATH];
+    file_full_path(&new_file, full_path, sizeof(full_path));
+    
+    stats_wrlock(&ns_state.lock, STATS_LOCK_NS_STATE);
     
     // Check if file already exists in the same folder
-    for (int i = 0; i < ns_state.file_count; i++) {
-        if (strcmp(ns_state.files[i].filename, filename) == 0 &&
-            strcmp(ns_state.files[i].folder_path, folder_path) == 0) {
-            pthread_mutex_unlock(&ns_state.lock);
-            return ERR_FILE_EXISTS;
-        }
+    if (registry_find(&ns_state.files, full_path) >= 0) {
+        pthread_rwlock_unlock(&ns_state.lock);
+        return ERR_FILE_EXISTS;
     }
     
     // If folder_path is not empty, verify folder exists
     if (folder_path && strlen(folder_path) > 0) {
         FolderMetadata* folder = nm_find_folder(folder_path);
         if (!folder) {
-            pthread_mutex_unlock(&ns_state.lock);
+            pthread_rwlock_unlock(&ns_state.lock);
             return ERR_FOLDER_NOT_FOUND;
         }
     }
     
-    // Add new file
-    if (ns_state.file_count >= MAX_FILES) {
-        pthread_mutex_unlock(&ns_state.lock);
-        return ERR_FILE_OPERATION_FAILED;
-    }
-    
-    FileMetadata* file = &ns_state.files[ns_state.file_count];
-    strcpy(file->filename, filename);
-    strcpy(file->folder_path, folder_path ? folder_path : "");
-    strcpy(file->owner, owner);
-    file->ss_id = ss_id;
-    file->created_time = time(NULL);
-    file->last_modified = time(NULL);
-    file->last_accessed = time(NULL);
-    file->file_size = 0;
-    file->word_count = 0;
-    file->char_count = 0;
+    strcpy(new_file.owner, owner);
+    new_file.ss_id = ss_id;
+    new_file.created_time = time(NULL);
+    new_file.last_modified = time(NULL);
+    new_file.last_accessed = time(NULL);
     
     // Initialize ACL with owner having full access
-    file->acl = malloc(sizeof(AccessControlEntry));
-    strcpy(file->acl[0].username, owner);
-    file->acl[0].read_permission = 1;
-    file->acl[0].write_permission = 1;
-    file->acl_count = 1;
-    
-    int file_idx = ns_state.file_count;
-    ns_state.file_count++;
+    new_file.acl = malloc(sizeof(AccessControlEntry));
+    if (!new_file.acl) {
+        pthread_rwlock_unlock(&ns_state.lock);
+        return ERR_FILE_OPERATION_FAILED;
+    }
+    strcpy(new_file.acl[0].username, owner);
+    new_file.acl[0].read_permission = 1;
+    new_file.acl[0].write_permission = 1;
+    new_file.acl_count = 1;
     
-    // Insert into Trie for efficient search
-    char full_path[MAX_PATH];
-    if (folder_path && strlen(folder_path) > 0) {
-        snprintf(full_path, MAX_PATH, "%s/%s", folder_path, filename);
-    } else {
-        snprintf(full_path, MAX_PATH, "%s", filename);
+    int file_idx = registry_insert(&ns_state.files, &new_file);
+    if (file_idx < 0) {
+        pthread_rwlock_unlock(&ns_state.lock);
+        free(new_file.acl);
+        return ERR_FILE_OPERATION_FAILED;
     }
     
+    // Insert into Trie for folder listings
     if (ns_state.file_trie_root) {
         trie_insert(ns_state.file_trie_root, full_path, file_idx);
     }
+    publish_file(registry_get(&ns_state.files, file_idx));
+    long lsn = journal_file(registry_get(&ns_state.files, file_idx), NULL);
     
-    pthread_mutex_unlock(&ns_state.lock);
+    pthread_rwlock_unlock(&ns_state.lock);
     
-    save_state();
+    int result = commit_change(lsn);
     
     char msg[256];
     snprintf(msg, sizeof(msg), 
@@ -97,189 +384,264 @@ int nm_register_file(const char* filename, const char* folder_path, const char*
              filename, folder_path ? folder_path : "/", ss_id);
     log_message("NM", "INFO", msg);
     
-    return ERR_SUCCESS;
+    return result;
 }
 
 /**
  * nm_find_file
- * @brief Look up a file by its full path or just filename using efficient search.
- *
- * Uses two-level caching strategy:
- * 1. LRU Cache: O(1) lookup for recently accessed files
- * 2. Trie: O(m) lookup where m is path length
- * 3. Linear fallback: Only if Trie/cache unavailable
+ * @brief Look up a file by its full path, or by filename for a root file.
  *
- * This function handles both formats:
+ * One probe of the files table's hash index:
  * - Full path: "projects/backend/server.py" 
  * - Just filename: "server.py" (searches root only)
  *
+ * Caller must hold ns_state.lock (shared is enough). The pointer stays valid
+ * until the file is deleted, which takes the lock exclusive; handlers that
+ * need the file after releasing it use nm_lookup_file() instead.
+ *
  * @param filename Null-terminated filename or full path to search for.
  * @return Pointer to FileMetadata on success, or NULL if not found.
  */
 FileMetadata* nm_find_file(const char* filename) {
-    // Construct full path for search
-    char full_path[MAX_PATH];
-    const char* last_slash = strrchr(filename, '/');
+    return registry_get(&ns_state.files, registry_find(&ns_state.files, filename));
+}
+
+/**
+ * nm_file_lock
+ * @brief Return the lock stripe guarding a file's ACL and cached stats.
+ *
+ * Stripes are picked by a hash of the file's full path, so unrelated files
+ * rarely share one. Take it only while holding ns_state.lock shared; an
+ * exclusive holder already excludes every stripe user.
+ *
+ * @param file File whose stripe to return.
+ * @return One of ns_state.file_locks.
+ */
+pthread_rwlock_t* nm_file_lock(const FileMetadata* file) {
+    unsigned int hash = 2166136261u;  // FNV-1a over "<folder>/<filename>"
+    for (const char* p = file->folder_path; *p; p++) {
+        hash = (hash ^ (unsigned char)*p) * 16777619u;
+    }
+    if (file->folder_path[0]) {
+        hash = (hash ^ '/') * 16777619u;
+    }
+    for (const char* p = file->filename; *p; p++) {
+        hash = (hash ^ (unsigned char)*p) * 16777619u;
+    }
+    return &ns_state.file_locks[hash % NM_FILE_LOCK_STRIPES];
+}
+
+/**
+ * nm_lookup_file
+ * @brief Find a file and copy out what a handler needs to route a request.
+ *
+ * Reads the published file view, so it takes no lock and never waits for
+ * a CREATE, DELETE or MOVE in progress. The copy stays usable afterwards,
+ * so the handler can go on to talk to a Storage Server.
+ *
+ * @param filename Filename or full path to look up.
+ * @param username User to report access for, or NULL.
+ * @param out Filled on success; can_read/can_write are 0 for a NULL user.
+ * @return ERR_SUCCESS, or ERR_FILE_NOT_FOUND.
+ */
+int nm_lookup_file(const char* filename, const char* username, FileSnapshot* out) {
+    epoch_enter();
     
-    if (last_slash) {
-        strncpy(full_path, filename, MAX_PATH - 1);
-        full_path[MAX_PATH - 1] = '\0';
-    } else {
-        // Root file - use filename as-is
-        snprintf(full_path, MAX_PATH, "%s", filename);
-    }
-    
-    // LEVEL 1: Check LRU cache first (O(1) for cache hits)
-    if (ns_state.file_cache) {
-        int cached_index = cache_get(ns_state.file_cache, full_path);
-        if (cached_index >= 0 && cached_index < ns_state.file_count) {
-            // Verify cache entry is still valid
-            FileMetadata* file = &ns_state.files[cached_index];
-            char file_full_path[MAX_FULL_PATH];
-            if (strlen(file->folder_path) > 0) {
-                snprintf(file_full_path, MAX_FULL_PATH, "%s/%s", file->folder_path, file->filename);
-            } else {
-                snprintf(file_full_path, MAX_FULL_PATH, "%s", file->filename);
-            }
-            
-            if (strcmp(file_full_path, full_path) == 0) {
-                return file;  // Cache hit!
-            }
-        }
+    const FileRecord* record = file_view_find(ns_state.file_view, filename);
+    if (!record) {
+        epoch_exit();
+        return ERR_FILE_NOT_FOUND;
     }
     
-    // LEVEL 2: Check Trie (O(m) where m is path length)
-    if (ns_state.file_trie_root) {
-        int trie_index = trie_search(ns_state.file_trie_root, full_path);
-        if (trie_index >= 0 && trie_index < ns_state.file_count) {
-            FileMetadata* file = &ns_state.files[trie_index];
-            
-            // Add to cache for future O(1) lookups
-            if (ns_state.file_cache) {
-                cache_put(ns_state.file_cache, full_path, trie_index);
-            }
-            
-            return file;  // Found in Trie
-        }
+    int folder_len = record->folder_len;
+    memcpy(out->folder_path, record->path, folder_len);
+    out->folder_path[folder_len] = '\0';
+    safe_strncpy(out->filename, record->path + folder_len + (folder_len ? 1 : 0),
+                 sizeof(out->filename));
+    safe_strncpy(out->owner, record->owner, sizeof(out->owner));
+    out->ss_id = record->ss_id;
+    file_record_access(record, username, &out->can_read, &out->can_write);
+    
+    epoch_exit();
+    return ERR_SUCCESS;
+}
+
+/**
+ * nm_update_file_stats
+ * @brief Store the size and counts a Storage Server reported for a file.
+ *
+ * Only the file's stripe is taken exclusive, so updates to different files,
+ * and lookups, run in parallel. The file may have been deleted or moved
+ * since the Storage Server was asked; then nothing is updated. Changed
+ * stats are journaled without waiting: they are a cache, and the access
+ * time alone is only persisted by the next snapshot.
+ *
+ * @param filename Filename or full path of the file.
+ * @param size File size in bytes.
+ * @param words Word count.
+ * @param chars Character count.
+ * @return ERR_SUCCESS, or ERR_FILE_NOT_FOUND.
+ */
+int nm_update_file_stats(const char* filename, long size, int words, int chars) {
+    stats_rdlock(&ns_state.lock, STATS_LOCK_NS_STATE_READ);
+    
+    FileMetadata* file = nm_find_file(filename);
+    if (!file) {
+        pthread_rwlock_unlock(&ns_state.lock);
+        return ERR_FILE_NOT_FOUND;
     }
     
-    // LEVEL 3: Fallback to linear search (O(N) - only if Trie unavailable)
-    if (last_slash) {
-        // Filename contains path - parse it
-        char folder_path[MAX_PATH];
-        char base_filename[MAX_FILENAME];
-        
-        int folder_len = last_slash - filename;
-        strncpy(folder_path, filename, folder_len);
-        folder_path[folder_len] = '\0';
-        strcpy(base_filename, last_slash + 1);
-        
-        // Search for file with matching folder_path and filename
-        for (int i = 0; i < ns_state.file_count; i++) {
-            if (strcmp(ns_state.files[i].filename, base_filename) == 0 &&
-                strcmp(ns_state.files[i].folder_path, folder_path) == 0) {
-                
-                // Add to Trie and cache for future lookups
-                if (ns_state.file_trie_root) {
-                    trie_insert(ns_state.file_trie_root, full_path, i);
-                }
-                if (ns_state.file_cache) {
-                    cache_put(ns_state.file_cache, full_path, i);
-                }
-                
-                return &ns_state.files[i];
-            }
-        }
-    } else {
-        // No path - search for file in root (empty folder_path)
-        for (int i = 0; i < ns_state.file_count; i++) {
-            if (strcmp(ns_state.files[i].filename, filename) == 0 &&
-                ns_state.files[i].folder_path[0] == '\0') {
-                
-                // Add to Trie and cache
-                if (ns_state.file_trie_root) {
-                    trie_insert(ns_state.file_trie_root, full_path, i);
-                }
-                if (ns_state.file_cache) {
-                    cache_put(ns_state.file_cache, full_path, i);
-                }
-                
-                return &ns_state.files[i];
-            }
-        }
+    pthread_rwlock_t* stripe = nm_file_lock(file);
+    stats_wrlock(stripe, STATS_LOCK_NS_FILE);
+    int changed = file->file_size != size || file->word_count != words ||
+                  file->char_count != chars;
+    file->file_size = size;
+    file->word_count = words;
+    file->char_count = chars;
+    file->last_accessed = time(NULL);
+    if (changed) {
+        journal_file(file, NULL);
     }
+    pthread_rwlock_unlock(stripe);
     
-    return NULL;
+    pthread_rwlock_unlock(&ns_state.lock);
+    return ERR_SUCCESS;
 }
 
 /**
- * nm_delete_file
- * @brief Remove a file entry from the registry and persist the change.
- *
- * Frees any ACL memory for the deleted file and compacts the in-memory
- * array of files. If the file isn't found, returns an error.
+ * nm_touch_file
+ * @brief Set a file's last access time to now. Like other access times, it
+ *        is persisted by the next snapshot.
  *
- * @param filename Null-terminated filename to remove.
- * @return ERR_SUCCESS on success, or ERR_FILE_NOT_FOUND if the file
- *         does not exist.
+ * @param filename Filename or full path of the file.
+ * @return ERR_SUCCESS, or ERR_FILE_NOT_FOUND.
  */
-int nm_delete_file(const char* filename) {
-    pthread_mutex_lock(&ns_state.lock);
+int nm_touch_file(const char* filename) {
+    stats_rdlock(&ns_state.lock, STATS_LOCK_NS_STATE_READ);
     
-    // Construct full path for Trie/cache invalidation
     FileMetadata* file = nm_find_file(filename);
-    if (file) {
-        char full_path[MAX_FULL_PATH];
-        if (strlen(file->folder_path) > 0) {
-            snprintf(full_path, MAX_FULL_PATH, "%s/%s", file->folder_path, file->filename);
+    if (!file) {
+        pthread_rwlock_unlock(&ns_state.lock);
+        return ERR_FILE_NOT_FOUND;
+    }
+    
+    pthread_rwlock_t* stripe = nm_file_lock(file);
+    stats_wrlock(stripe, STATS_LOCK_NS_FILE);
+    file->last_accessed = time(NULL);
+    pthread_rwlock_unlock(stripe);
+    
+    pthread_rwlock_unlock(&ns_state.lock);
+    return ERR_SUCCESS;
+}
+
+/**
+ * nm_format_acl
+ * @brief Render a file's ACL as the "Access Permissions" section of INFO.
+ *
+ * Like nm_lookup_file(), reads the published view without locking.
+ *
+ * @param filename Filename or full path of the file.
+ * @param buffer Output buffer; always NUL-terminated.
+ * @param buffer_size Size of buffer.
+ * @return ERR_SUCCESS, or ERR_FILE_NOT_FOUND (buffer left empty).
+ */
+int nm_format_acl(const char* filename, char* buffer, size_t buffer_size) {
+    buffer[0] = '\0';
+    epoch_enter();
+    
+    const FileRecord* file = file_view_find(ns_state.file_view, filename);
+    if (!file) {
+        epoch_exit();
+        return ERR_FILE_NOT_FOUND;
+    }
+    
+    char acl_entries[1800] = "";
+    for (int i = 0; i < file->acl_count; i++) {
+        char temp[128];
+        char perms[4] = "";
+        if (file->acl[i].read_permission && file->acl[i].write_permission) {
+            strcpy(perms, "RW");
+        } else if (file->acl[i].read_permission) {
+            strcpy(perms, "R");
+        } else if (file->acl[i].write_permission) {
+            strcpy(perms, "W");
         } else {
-            snprintf(full_path, MAX_FULL_PATH, "%s", file->filename);
+            strcpy(perms, "-");
         }
         
-        // Remove from Trie
-        if (ns_state.file_trie_root) {
-            trie_delete(ns_state.file_trie_root, full_path);
-        }
+        // Use └─ for last entry, ├─ for others
+        const char* branch = (i == file->acl_count - 1) ? "└─" : "├─";
         
-        // Invalidate cache entry
-        if (ns_state.file_cache) {
-            cache_invalidate(ns_state.file_cache, full_path);
-        }
+        snprintf(temp, sizeof(temp),
+                "  %s%s%s %s%s%s (%s%s%s)\n",
+                ANSI_MAGENTA, branch, ANSI_RESET,
+                ANSI_BRIGHT_CYAN, file->acl[i].username, ANSI_RESET,
+                ANSI_BRIGHT_MAGENTA, perms, ANSI_RESET);
+        strncat(acl_entries, temp, sizeof(acl_entries) - strlen(acl_entries) - 1);
     }
     
-    int found = -1;
-    for (int i = 0; i < ns_state.file_count; i++) {
-        if (strcmp(ns_state.files[i].filename, filename) == 0) {
-            found = i;
-            break;
-        }
-    }
+    snprintf(buffer, buffer_size,
+            "%s%s═══ Access Permissions (%d) ═══%s\n"
+            "%s",
+            ANSI_BOLD, ANSI_MAGENTA, file->acl_count, ANSI_RESET,
+            acl_entries);
     
-    if (found == -1) {
-        pthread_mutex_unlock(&ns_state.lock);
-        return ERR_FILE_NOT_FOUND;
-    }
+    epoch_exit();
+    return ERR_SUCCESS;
+}
+
+// Unpublish a file, drop it from the Trie and the files table, and free its
+// ACL. Caller holds ns_state.lock exclusive (or is loading state).
+static void remove_file(int file_idx) {
+    FileMetadata* file = registry_get(&ns_state.files, file_idx);
     
-    // Free ACL
-    if (ns_state.files[found].acl) {
-        free(ns_state.files[found].acl);
+    // Unpublish first: from here on lookups report the file as gone
+    char full_path[MAX_FULL_PATH];
+    file_full_path(file, full_path, sizeof(full_path));
+    file_view_remove(ns_state.file_view, full_path);
+    
+    if (ns_state.file_trie_root) {
+        trie_delete(ns_state.file_trie_root, full_path);
     }
+    free(file->acl);
+    registry_remove(&ns_state.files, file_idx);
+}
+
+/**
+ * nm_delete_file
+ * @brief Remove a file entry from the registry and journal the change.
+ *
+ * Frees any ACL memory for the deleted file and releases its ID. If the
+ * file isn't found, returns an error.
+ *
+ * @param filename Filename or full path of the file to remove.
+ * @return ERR_SUCCESS on success, or ERR_FILE_NOT_FOUND if the file
+ *         does not exist.
+ */
+int nm_delete_file(const char* filename) {
+    stats_wrlock(&ns_state.lock, STATS_LOCK_NS_STATE);
     
-    // Shift remaining files
-    for (int i = found; i < ns_state.file_count - 1; i++) {
-        ns_state.files[i] = ns_state.files[i + 1];
+    int file_idx = registry_find(&ns_state.files, filename);
+    FileMetadata* file = registry_get(&ns_state.files, file_idx);
+    if (!file) {
+        pthread_rwlock_unlock(&ns_state.lock);
+        return ERR_FILE_NOT_FOUND;
     }
-    ns_state.file_count--;
     
-    pthread_mutex_unlock(&ns_state.lock);
+    char full_path[MAX_FULL_PATH];
+    file_full_path(file, full_path, sizeof(full_path));
+    remove_file(file_idx);
+    long lsn = journal_removal(RECORD_FILE_DELETED, full_path);
     
-    save_state();
+    pthread_rwlock_unlock(&ns_state.lock);
+    
+    int result = commit_change(lsn);
     
     char msg[256];
     snprintf(msg, sizeof(msg), "Deleted file '%s'", filename);
     log_message("NM", "INFO", msg);
     
-    return ERR_SUCCESS;
+    return result;
 }
 
 /**
@@ -296,37 +658,13 @@ int nm_delete_file(const char* filename) {
  *         or ERR_FILE_NOT_FOUND if the file does not exist.
  */
 int nm_check_permission(const char* filename, const char* username, int need_write) {
-    pthread_mutex_lock(&ns_state.lock);
-    
-    FileMetadata* file = nm_find_file(filename);
-    if (!file) {
-        pthread_mutex_unlock(&ns_state.lock);
+    FileSnapshot file;
+    if (nm_lookup_file(filename, username, &file) != ERR_SUCCESS) {
         return ERR_FILE_NOT_FOUND;
     }
     
-    // Owner always has full permissions
-    if (strcmp(file->owner, username) == 0) {
-        pthread_mutex_unlock(&ns_state.lock);
-        return ERR_SUCCESS;
-    }
-    
-    // Check ACL
-    for (int i = 0; i < file->acl_count; i++) {
-        if (strcmp(file->acl[i].username, username) == 0) {
-            if (need_write) {
-                int has_permission = file->acl[i].write_permission;
-                pthread_mutex_unlock(&ns_state.lock);
-                return has_permission ? ERR_SUCCESS : ERR_PERMISSION_DENIED;
-            } else {
-                int has_permission = file->acl[i].read_permission;
-                pthread_mutex_unlock(&ns_state.lock);
-                return has_permission ? ERR_SUCCESS : ERR_PERMISSION_DENIED;
-            }
-        }
-    }
-    
-    pthread_mutex_unlock(&ns_state.lock);
-    return ERR_PERMISSION_DENIED;
+    int has_permission = need_write ? file.can_write : file.can_read;
+    return has_permission ? ERR_SUCCESS : ERR_PERMISSION_DENIED;
 }
 
 /**
@@ -343,23 +681,29 @@ int nm_check_permission(const char* filename, const char* username, int need_wri
  * @return ERR_SUCCESS on success, or ERR_FILE_NOT_FOUND if file doesn't exist.
  */
 int nm_add_access(const char* filename, const char* username, int read, int write) {
-    pthread_mutex_lock(&ns_state.lock);
+    stats_rdlock(&ns_state.lock, STATS_LOCK_NS_STATE_READ);
     
     FileMetadata* file = nm_find_file(filename);
     if (!file) {
-        pthread_mutex_unlock(&ns_state.lock);
+        pthread_rwlock_unlock(&ns_state.lock);
         return ERR_FILE_NOT_FOUND;
     }
     
+    // Only this file's ACL changes: its stripe is enough
+    pthread_rwlock_t* stripe = nm_file_lock(file);
+    stats_wrlock(stripe, STATS_LOCK_NS_FILE);
+    
     // Check if user already in ACL
     for (int i = 0; i < file->acl_count; i++) {
         if (strcmp(file->acl[i].username, username) == 0) {
             // Update permissions
             file->acl[i].read_permission = read;
             file->acl[i].write_permission = write;
-            pthread_mutex_unlock(&ns_state.lock);
-            save_state();
-            return ERR_SUCCESS;
+            publish_file(file);
+            long lsn = journal_file(file, NULL);
+            pthread_rwlock_unlock(stripe);
+            pthread_rwlock_unlock(&ns_state.lock);
+            return commit_change(lsn);
         }
     }
     
@@ -369,10 +713,13 @@ int nm_add_access(const char* filename, const char* username, int read, int writ
     file->acl[file->acl_count].read_permission = read;
     file->acl[file->acl_count].write_permission = write;
     file->acl_count++;
+    publish_file(file);
+    long lsn = journal_file(file, NULL);
     
-    pthread_mutex_unlock(&ns_state.lock);
+    pthread_rwlock_unlock(stripe);
+    pthread_rwlock_unlock(&ns_state.lock);
     
-    save_state();
+    int result = commit_change(lsn);
     
     char msg[256];
     snprintf(msg, sizeof(msg), 
@@ -380,7 +727,7 @@ int nm_add_access(const char* filename, const char* username, int read, int writ
              filename, read, write);
     log_message("NM", "INFO", msg);
     
-    return ERR_SUCCESS;
+    return result;
 }
 
 /**
@@ -396,20 +743,23 @@ int nm_add_access(const char* filename, const char* username, int read, int writ
  *         / ERR_FILE_NOT_FOUND on failure.
  */
 int nm_remove_access(const char* filename, const char* username) {
-    pthread_mutex_lock(&ns_state.lock);
+    stats_rdlock(&ns_state.lock, STATS_LOCK_NS_STATE_READ);
     
     FileMetadata* file = nm_find_file(filename);
     if (!file) {
-        pthread_mutex_unlock(&ns_state.lock);
+        pthread_rwlock_unlock(&ns_state.lock);
         return ERR_FILE_NOT_FOUND;
     }
     
     // Don't allow removing owner
     if (strcmp(file->owner, username) == 0) {
-        pthread_mutex_unlock(&ns_state.lock);
+        pthread_rwlock_unlock(&ns_state.lock);
         return ERR_PERMISSION_DENIED;
     }
     
+    pthread_rwlock_t* stripe = nm_file_lock(file);
+    stats_wrlock(stripe, STATS_LOCK_NS_FILE);
+    
     // Find and remove entry
     int found = -1;
     for (int i = 0; i < file->acl_count; i++) {
@@ -420,7 +770,8 @@ int nm_remove_access(const char* filename, const char* username) {
     }
     
     if (found == -1) {
-        pthread_mutex_unlock(&ns_state.lock);
+        pthread_rwlock_unlock(stripe);
+        pthread_rwlock_unlock(&ns_state.lock);
         return ERR_USER_NOT_FOUND;
     }
     
@@ -429,34 +780,35 @@ int nm_remove_access(const char* filename, const char* username) {
         file->acl[i] = file->acl[i + 1];
     }
     file->acl_count--;
+    publish_file(file);
+    long lsn = journal_file(file, NULL);
     
-    pthread_mutex_unlock(&ns_state.lock);
+    pthread_rwlock_unlock(stripe);
+    pthread_rwlock_unlock(&ns_state.lock);
     
-    save_state();
+    int result = commit_change(lsn);
     
     char msg[256];
     snprintf(msg, sizeof(msg), "Revoked access to '%s'", filename);
     log_message("NM", "INFO", msg);
     
-    return ERR_SUCCESS;
+    return result;
 }
 
 /**
  * nm_find_file_in_folder
  * @brief Find a file within a specific folder.
  *
+ * Caller must hold ns_state.lock.
+ *
  * @param filename File to find.
  * @param folder_path Folder path to search in.
  * @return Pointer to FileMetadata or NULL if not found.
  */
 FileMetadata* nm_find_file_in_folder(const char* filename, const char* folder_path) {
-    for (int i = 0; i < ns_state.file_count; i++) {
-        if (strcmp(ns_state.files[i].filename, filename) == 0 &&
-            strcmp(ns_state.files[i].folder_path, folder_path ? folder_path : "") == 0) {
-            return &ns_state.files[i];
-        }
-    }
-    return NULL;
+    char full_path[MAX_FULL_PATH];
+    construct_full_path(full_path, sizeof(full_path), folder_path ? folder_path : "", filename);
+    return nm_find_file(full_path);
 }
 
 /**
@@ -468,11 +820,12 @@ FileMetadata* nm_find_file_in_folder(const char* filename, const char* folder_pa
  * @return ERR_SUCCESS on success, error code otherwise.
  */
 int nm_move_file(const char* filename, const char* new_folder_path) {
-    pthread_mutex_lock(&ns_state.lock);
+    stats_wrlock(&ns_state.lock, STATS_LOCK_NS_STATE);
     
-    FileMetadata* file = nm_find_file(filename);
+    int file_index = registry_find(&ns_state.files, filename);
+    FileMetadata* file = registry_get(&ns_state.files, file_index);
     if (!file) {
-        pthread_mutex_unlock(&ns_state.lock);
+        pthread_rwlock_unlock(&ns_state.lock);
         return ERR_FILE_NOT_FOUND;
     }
     
@@ -480,62 +833,50 @@ int nm_move_file(const char* filename, const char* new_folder_path) {
     if (new_folder_path && strlen(new_folder_path) > 0) {
         FolderMetadata* folder = nm_find_folder(new_folder_path);
         if (!folder) {
-            pthread_mutex_unlock(&ns_state.lock);
+            pthread_rwlock_unlock(&ns_state.lock);
             return ERR_FOLDER_NOT_FOUND;
         }
     }
     
-    // Check if file with same name already exists in destination
-    for (int i = 0; i < ns_state.file_count; i++) {
-        if (strcmp(ns_state.files[i].filename, filename) == 0 &&
-            strcmp(ns_state.files[i].folder_path, new_folder_path ? new_folder_path : "") == 0 &&
-            &ns_state.files[i] != file) {
-            pthread_mutex_unlock(&ns_state.lock);
-            return ERR_FILE_EXISTS;
-        }
-    }
-    
-    // Construct old and new full paths for Trie/cache update
+    // Construct old and new full paths for index/Trie update
     char old_full_path[MAX_FULL_PATH];
     char new_full_path[MAX_FULL_PATH];
+    file_full_path(file, old_full_path, sizeof(old_full_path));
+    construct_full_path(new_full_path, sizeof(new_full_path),
+                        new_folder_path ? new_folder_path : "", file->filename);
     
-    if (strlen(file->folder_path) > 0) {
-        snprintf(old_full_path, sizeof(old_full_path), "%s/%s", file->folder_path, file->filename);
-    } else {
-        snprintf(old_full_path, sizeof(old_full_path), "%s", file->filename);
+    // Check if file with same name already exists in destination
+    int existing = registry_find(&ns_state.files, new_full_path);
+    if (existing >= 0 && existing != file_index) {
+        pthread_rwlock_unlock(&ns_state.lock);
+        return ERR_FILE_EXISTS;
     }
     
-    if (new_folder_path && strlen(new_folder_path) > 0) {
-        snprintf(new_full_path, sizeof(new_full_path), "%s/%s", new_folder_path, file->filename);
-    } else {
-        snprintf(new_full_path, sizeof(new_full_path), "%s", file->filename);
+    // Update folder path and re-index the file under its new path
+    char old_folder_path[MAX_PATH];
+    strcpy(old_folder_path, file->folder_path);
+    strcpy(file->folder_path, new_folder_path ? new_folder_path : "");
+    if (registry_rekey(&ns_state.files, file_index, old_full_path) != ERR_SUCCESS) {
+        strcpy(file->folder_path, old_folder_path);
+        pthread_rwlock_unlock(&ns_state.lock);
+        return ERR_FILE_OPERATION_FAILED;
     }
+    file->last_modified = time(NULL);
     
-    // Find the file index for Trie/cache operations
-    int file_index = file - ns_state.files;
+    // Publish the new path before dropping the old one, so a concurrent
+    // lookup finds the file under one name or the other
+    publish_file(file);
+    file_view_remove(ns_state.file_view, old_full_path);
     
-    // Remove old path from Trie and cache
+    // Move the path in the Trie
     if (ns_state.file_trie_root) {
         trie_delete(ns_state.file_trie_root, old_full_path);
-    }
-    if (ns_state.file_cache) {
-        cache_invalidate(ns_state.file_cache, old_full_path);
-    }
-    
-    // Update folder path
-    strcpy(file->folder_path, new_folder_path ? new_folder_path : "");
-    file->last_modified = time(NULL);
-    
-    // Add new path to Trie and cache
-    if (ns_state.file_trie_root) {
         trie_insert(ns_state.file_trie_root, new_full_path, file_index);
     }
-    if (ns_state.file_cache) {
-        cache_put(ns_state.file_cache, new_full_path, file_index);
-    }
+    long lsn = journal_file(file, old_full_path);
     
-    pthread_mutex_unlock(&ns_state.lock);
-    save_state();
+    pthread_rwlock_unlock(&ns_state.lock);
+    int result = commit_change(lsn);
     
     char msg[256];
     snprintf(msg, sizeof(msg), 
@@ -543,7 +884,7 @@ int nm_move_file(const char* filename, const char* new_folder_path) {
              filename, new_folder_path ? new_folder_path : "/");
     log_message("NM", "INFO", msg);
     
-    return ERR_SUCCESS;
+    return result;
 }
 
 /**
@@ -555,23 +896,15 @@ int nm_move_file(const char* filename, const char* new_folder_path) {
  * @return ERR_SUCCESS on success, error code otherwise.
  */
 int nm_create_folder(const char* foldername, const char* owner) {
-    pthread_mutex_lock(&ns_state.lock);
+    stats_wrlock(&ns_state.lock, STATS_LOCK_NS_STATE);
     
     // Check if folder already exists
-    for (int i = 0; i < ns_state.folder_count; i++) {
-        if (strcmp(ns_state.folders[i].foldername, foldername) == 0) {
-            pthread_mutex_unlock(&ns_state.lock);
-            return ERR_FOLDER_EXISTS;
-        }
-    }
-    
-    // Check capacity
-    if (ns_state.folder_count >= MAX_FOLDERS) {
-        pthread_mutex_unlock(&ns_state.lock);
-        return ERR_FILE_OPERATION_FAILED;
+    if (registry_find(&ns_state.folders, foldername) >= 0) {
+        pthread_rwlock_unlock(&ns_state.lock);
+        return ERR_FOLDER_EXISTS;
     }
     
-    // Find parent folder index
+    // Find parent folder ID
     int parent_idx = -1;
     char* last_slash = strrchr(foldername, '/');
     if (last_slash) {
@@ -581,66 +914,69 @@ int nm_create_folder(const char* foldername, const char* owner) {
         strncpy(parent_path, foldername, len);
         parent_path[len] = '\0';
         
-        // Find parent
-        for (int i = 0; i < ns_state.folder_count; i++) {
-            if (strcmp(ns_state.folders[i].foldername, parent_path) == 0) {
-                parent_idx = i;
-                break;
-            }
-        }
-        
+        parent_idx = registry_find(&ns_state.folders, parent_path);
         if (parent_idx == -1) {
-            pthread_mutex_unlock(&ns_state.lock);
+            pthread_rwlock_unlock(&ns_state.lock);
             return ERR_FOLDER_NOT_FOUND;  // Parent doesn't exist
         }
     }
     
     // Create folder
-    FolderMetadata* folder = &ns_state.folders[ns_state.folder_count];
-    strcpy(folder->foldername, foldername);
-    strcpy(folder->owner, owner);
-    folder->created_time = time(NULL);
-    folder->parent_folder_idx = parent_idx;
+    FolderMetadata folder;
+    memset(&folder, 0, sizeof(folder));
+    strcpy(folder.foldername, foldername);
+    strcpy(folder.owner, owner);
+    folder.created_time = time(NULL);
+    folder.parent_folder_idx = parent_idx;
     
     // Initialize ACL with owner having full access
-    folder->acl = malloc(sizeof(AccessControlEntry));
-    strcpy(folder->acl[0].username, owner);
-    folder->acl[0].read_permission = 1;
-    folder->acl[0].write_permission = 1;
-    folder->acl_count = 1;
+    folder.acl = malloc(sizeof(AccessControlEntry));
+    if (!folder.acl) {
+        pthread_rwlock_unlock(&ns_state.lock);
+        return ERR_FILE_OPERATION_FAILED;
+    }
+    strcpy(folder.acl[0].username, owner);
+    folder.acl[0].read_permission = 1;
+    folder.acl[0].write_permission = 1;
+    folder.acl_count = 1;
     
-    ns_state.folder_count++;
+    if (registry_insert(&ns_state.folders, &folder) < 0) {
+        pthread_rwlock_unlock(&ns_state.lock);
+        free(folder.acl);
+        return ERR_FILE_OPERATION_FAILED;
+    }
+    long lsn = journal_folder(&folder);
     
-    pthread_mutex_unlock(&ns_state.lock);
-    save_state();
+    pthread_rwlock_unlock(&ns_state.lock);
+    int result = commit_change(lsn);
     
     char msg[256];
     snprintf(msg, sizeof(msg), "Created folder '%s'", foldername);
     log_message("NM", "INFO", msg);
     
-    return ERR_SUCCESS;
+    return result;
 }
 
 /**
  * nm_find_folder
  * @brief Find a folder by its full path.
  *
+ * Caller must hold ns_state.lock.
+ *
  * @param foldername Full folder path.
  * @return Pointer to FolderMetadata or NULL if not found.
  */
 FolderMetadata* nm_find_folder(const char* foldername) {
-    for (int i = 0; i < ns_state.folder_count; i++) {
-        if (strcmp(ns_state.folders[i].foldername, foldername) == 0) {
-            return &ns_state.folders[i];
-        }
-    }
-    return NULL;
+    return registry_get(&ns_state.folders, registry_find(&ns_state.folders, foldername));
 }
 
 /**
  * nm_check_folder_permission
  * @brief Check if a user has permission to access a folder.
  *
+ * Caller must hold ns_state.lock; folder ACLs only change under it
+ * exclusive.
+ *
  * @param foldername Folder to check.
  * @param username User requesting access.
  * @param need_write 1 if write access needed, 0 for read.
@@ -673,6 +1009,45 @@ int nm_check_folder_permission(const char* foldername, const char* username, int
     return ERR_PERMISSION_DENIED;
 }
 
+typedef struct {
+    const char* username;
+    char* buffer;
+    size_t buffer_size;
+    size_t prefix_len;  // Length of "<folder>/", 0 for the root folder
+    int found_any;
+} FolderListing;
+
+// trie_walk() visitor: list a file that sits directly in the folder and
+// that the user can see
+static int list_folder_file(void* ctx, const char* path, int file_index) {
+    FolderListing* listing = (FolderListing*)ctx;
+    if (strchr(path + listing->prefix_len, '/')) {
+        return 0;  // In a subfolder
+    }
+    FileMetadata* file = registry_get(&ns_state.files, file_index);
+    if (!file) {
+        return 0;
+    }
+
+    int has_access = strcmp(file->owner, listing->username) == 0;
+    if (!has_access) {
+        pthread_rwlock_t* stripe = nm_file_lock(file);
+        stats_rdlock(stripe, STATS_LOCK_NS_FILE);
+        for (int j = 0; !has_access && j < file->acl_count; j++) {
+            has_access = strcmp(file->acl[j].username, listing->username) == 0;
+        }
+        pthread_rwlock_unlock(stripe);
+    }
+    
+    if (has_access) {
+        char line[512];
+        snprintf(line, sizeof(line), "[FILE] %s\n", file->filename);
+        strncat(listing->buffer, line, listing->buffer_size - strlen(listing->buffer) - 1);
+        listing->found_any = 1;
+    }
+    return 0;
+}
+
 /**
  * nm_list_folder_contents
  * @brief List all files and subfolders in a folder.
@@ -686,19 +1061,22 @@ int nm_check_folder_permission(const char* foldername, const char* username, int
 int nm_list_folder_contents(const char* foldername, const char* username, 
                             char* buffer, size_t buffer_size) {
     buffer[0] = '\0';
+    stats_rdlock(&ns_state.lock, STATS_LOCK_NS_STATE_READ);
     
     // Check folder permission
     if (foldername && strlen(foldername) > 0) {
         int perm = nm_check_folder_permission(foldername, username, 0);
         if (perm != ERR_SUCCESS) {
+            pthread_rwlock_unlock(&ns_state.lock);
             return perm;
         }
     }
     
     // List subfolders
     int found_any = 0;
-    for (int i = 0; i < ns_state.folder_count; i++) {
-        FolderMetadata* folder = &ns_state.folders[i];
+    for (int id = registry_next(&ns_state.folders, -1); id >= 0;
+         id = registry_next(&ns_state.folders, id)) {
+        FolderMetadata* folder = registry_get(&ns_state.folders, id);
         
         // Check if this folder is a direct child
         if (foldername && strlen(foldername) > 0) {
@@ -726,28 +1104,16 @@ int nm_list_folder_contents(const char* foldername, const char* username,
         }
     }
     
-    // List files in this folder
-    for (int i = 0; i < ns_state.file_count; i++) {
-        FileMetadata* file = &ns_state.files[i];
-        
-        if (strcmp(file->folder_path, foldername ? foldername : "") == 0) {
-            // Check if user has access
-            int has_access = 0;
-            for (int j = 0; j < file->acl_count; j++) {
-                if (strcmp(file->acl[j].username, username) == 0) {
-                    has_access = 1;
-                    break;
-                }
-            }
-            
-            if (has_access || strcmp(file->owner, username) == 0) {
-                char line[512];
-                snprintf(line, sizeof(line), "[FILE] %s\n", file->filename);
-                strncat(buffer, line, buffer_size - strlen(buffer) - 1);
-                found_any = 1;
-            }
-        }
+    // List files in this folder: the paths under "<folder>/" in the Trie
+    FolderListing listing = { username, buffer, buffer_size, 0, 0 };
+    char prefix[MAX_FULL_PATH] = "";
+    if (foldername && strlen(foldername) > 0) {
+        snprintf(prefix, sizeof(prefix), "%s/", foldername);
+        listing.prefix_len = strlen(prefix);
     }
+    trie_walk(ns_state.file_trie_root, prefix, list_folder_file, &listing);
+    pthread_rwlock_unlock(&ns_state.lock);
+    found_any |= listing.found_any;
     
     if (!found_any) {
         strcpy(buffer, "(empty folder)\n");
@@ -767,11 +1133,11 @@ int nm_list_folder_contents(const char* foldername, const char* username,
  * @return ERR_SUCCESS on success, error code otherwise.
  */
 int nm_add_folder_access(const char* foldername, const char* username, int read, int write) {
-    pthread_mutex_lock(&ns_state.lock);
+    stats_wrlock(&ns_state.lock, STATS_LOCK_NS_STATE);
     
     FolderMetadata* folder = nm_find_folder(foldername);
     if (!folder) {
-        pthread_mutex_unlock(&ns_state.lock);
+        pthread_rwlock_unlock(&ns_state.lock);
         return ERR_FOLDER_NOT_FOUND;
     }
     
@@ -781,9 +1147,9 @@ int nm_add_folder_access(const char* foldername, const char* username, int read,
             // Update permissions
             folder->acl[i].read_permission = read;
             folder->acl[i].write_permission = write;
-            pthread_mutex_unlock(&ns_state.lock);
-            save_state();
-            return ERR_SUCCESS;
+            long lsn = journal_folder(folder);
+            pthread_rwlock_unlock(&ns_state.lock);
+            return commit_change(lsn);
         }
     }
     
@@ -793,11 +1159,10 @@ int nm_add_folder_access(const char* foldername, const char* username, int read,
     folder->acl[folder->acl_count].read_permission = read;
     folder->acl[folder->acl_count].write_permission = write;
     folder->acl_count++;
+    long lsn = journal_folder(folder);
     
-    pthread_mutex_unlock(&ns_state.lock);
-    save_state();
-    
-    return ERR_SUCCESS;
+    pthread_rwlock_unlock(&ns_state.lock);
+    return commit_change(lsn);
 }
 
 /**
@@ -805,18 +1170,18 @@ int nm_add_folder_access(const char* foldername, const char* username, int read,
  * @brief Submit a request to access a file
  */
 int nm_request_access(const char* filename, const char* requester, int read_requested, int write_requested) {
-    pthread_mutex_lock(&ns_state.lock);
+    stats_wrlock(&ns_state.lock, STATS_LOCK_NS_STATE);
     
     // Check if file exists
     FileMetadata* file = nm_find_file(filename);
     if (!file) {
-        pthread_mutex_unlock(&ns_state.lock);
+        pthread_rwlock_unlock(&ns_state.lock);
         return ERR_FILE_NOT_FOUND;
     }
     
     // Check if requester is the owner
     if (strcmp(file->owner, requester) == 0) {
-        pthread_mutex_unlock(&ns_state.lock);
+        pthread_rwlock_unlock(&ns_state.lock);
         return ERR_SUCCESS;  // Owner already has access
     }
     
@@ -828,7 +1193,7 @@ int nm_request_access(const char* filename, const char* requester, int read_requ
             if (read_requested && !file->acl[i].read_permission) has_sufficient = 0;
             if (write_requested && !file->acl[i].write_permission) has_sufficient = 0;
             if (has_sufficient) {
-                pthread_mutex_unlock(&ns_state.lock);
+                pthread_rwlock_unlock(&ns_state.lock);
                 // Return special code to indicate they already have access
                 // Store what access they have in flags for the client to read
                 return ERR_ALREADY_HAS_ACCESS;
@@ -837,36 +1202,33 @@ int nm_request_access(const char* filename, const char* requester, int read_requ
     }
     
     // Check if request already exists - if so, update it
-    for (int i = 0; i < ns_state.request_count; i++) {
-        if (strcmp(ns_state.access_requests[i].filename, filename) == 0 &&
-            strcmp(ns_state.access_requests[i].requester, requester) == 0) {
-            // Update existing request
-            ns_state.access_requests[i].read_requested = read_requested;
-            ns_state.access_requests[i].write_requested = write_requested;
-            ns_state.access_requests[i].request_time = time(NULL);
-            pthread_mutex_unlock(&ns_state.lock);
-            save_state();
-            return ERR_SUCCESS;
-        }
+    AccessRequest* existing = registry_get(&ns_state.access_requests,
+                                           find_request(filename, requester));
+    if (existing) {
+        existing->read_requested = read_requested;
+        existing->write_requested = write_requested;
+        existing->request_time = time(NULL);
+        long lsn = journal_request(existing);
+        pthread_rwlock_unlock(&ns_state.lock);
+        return commit_change(lsn);
     }
     
     // Add new request
-    if (ns_state.request_count >= MAX_FILES) {
-        pthread_mutex_unlock(&ns_state.lock);
-        return ERR_FILE_OPERATION_FAILED;  // Too many requests
+    AccessRequest req;
+    memset(&req, 0, sizeof(req));
+    strcpy(req.filename, filename);
+    strcpy(req.requester, requester);
+    req.request_time = time(NULL);
+    req.read_requested = read_requested;
+    req.write_requested = write_requested;
+    if (registry_insert(&ns_state.access_requests, &req) < 0) {
+        pthread_rwlock_unlock(&ns_state.lock);
+        return ERR_FILE_OPERATION_FAILED;
     }
+    long lsn = journal_request(&req);
     
-    strcpy(ns_state.access_requests[ns_state.request_count].filename, filename);
-    strcpy(ns_state.access_requests[ns_state.request_count].requester, requester);
-    ns_state.access_requests[ns_state.request_count].request_time = time(NULL);
-    ns_state.access_requests[ns_state.request_count].read_requested = read_requested;
-    ns_state.access_requests[ns_state.request_count].write_requested = write_requested;
-    ns_state.request_count++;
-    
-    pthread_mutex_unlock(&ns_state.lock);
-    save_state();
-    
-    return ERR_SUCCESS;
+    pthread_rwlock_unlock(&ns_state.lock);
+    return commit_change(lsn);
 }
 
 /**
@@ -874,18 +1236,18 @@ int nm_request_access(const char* filename, const char* requester, int read_requ
  * @brief View all pending access requests for a file (owner only)
  */
 int nm_view_requests(const char* filename, const char* owner, char* buffer, size_t buffer_size) {
-    pthread_mutex_lock(&ns_state.lock);
+    stats_rdlock(&ns_state.lock, STATS_LOCK_NS_STATE_READ);
     
     // Check if file exists
     FileMetadata* file = nm_find_file(filename);
     if (!file) {
-        pthread_mutex_unlock(&ns_state.lock);
+        pthread_rwlock_unlock(&ns_state.lock);
         return ERR_FILE_NOT_FOUND;
     }
     
     // Check if caller is owner
     if (strcmp(file->owner, owner) != 0) {
-        pthread_mutex_unlock(&ns_state.lock);
+        pthread_rwlock_unlock(&ns_state.lock);
         return ERR_NOT_OWNER;
     }
     
@@ -893,17 +1255,20 @@ int nm_view_requests(const char* filename, const char* owner, char* buffer, size
     char temp[BUFFER_SIZE * 2] = "";
     int count = 0;
     
-    for (int i = 0; i < ns_state.request_count; i++) {
-        if (strcmp(ns_state.access_requests[i].filename, filename) == 0) {
+    for (int id = registry_next(&ns_state.access_requests, -1); id >= 0;
+         id = registry_next(&ns_state.access_requests, id)) {
+        AccessRequest* req = registry_get(&ns_state.access_requests, id);
+        if (strcmp(req->filename, filename) == 0) {
             char time_str[64];
-            struct tm* tm_info = localtime(&ns_state.access_requests[i].request_time);
-            strftime(time_str, sizeof(time_str), "%Y-%m-%d %H:%M:%S", tm_info);
+            struct tm tm_info;  // localtime() is not safe with concurrent readers
+            localtime_r(&req->request_time, &tm_info);
+            strftime(time_str, sizeof(time_str), "%Y-%m-%d %H:%M:%S", &tm_info);
             
             // Determine permission type
             char perm_str[32];
-            if (ns_state.access_requests[i].read_requested && ns_state.access_requests[i].write_requested) {
+            if (req->read_requested && req->write_requested) {
                 strcpy(perm_str, "Read+Write");
-            } else if (ns_state.access_requests[i].write_requested) {
+            } else if (req->write_requested) {
                 strcpy(perm_str, "Write");
             } else {
                 strcpy(perm_str, "Read");
@@ -911,7 +1276,7 @@ int nm_view_requests(const char* filename, const char* owner, char* buffer, size
             
             char line[256];
             snprintf(line, sizeof(line), "  [%s] - %s access - Requested on %s\n",
-                     ns_state.access_requests[i].requester, perm_str, time_str);
+                     req->requester, perm_str, time_str);
             
             if (strlen(temp) + strlen(line) < sizeof(temp) - 1) {
                 strcat(temp, line);
@@ -927,7 +1292,7 @@ int nm_view_requests(const char* filename, const char* owner, char* buffer, size
                  filename, count, temp);
     }
     
-    pthread_mutex_unlock(&ns_state.lock);
+    pthread_rwlock_unlock(&ns_state.lock);
     return ERR_SUCCESS;
 }
 
@@ -936,52 +1301,43 @@ int nm_view_requests(const char* filename, const char* owner, char* buffer, size
  * @brief Approve an access request and grant read access
  */
 int nm_approve_request(const char* filename, const char* owner, const char* requester) {
-    pthread_mutex_lock(&ns_state.lock);
+    stats_wrlock(&ns_state.lock, STATS_LOCK_NS_STATE);
     
     // Check if file exists
     FileMetadata* file = nm_find_file(filename);
     if (!file) {
-        pthread_mutex_unlock(&ns_state.lock);
+        pthread_rwlock_unlock(&ns_state.lock);
         return ERR_FILE_NOT_FOUND;
     }
     
     // Check if caller is owner
     if (strcmp(file->owner, owner) != 0) {
-        pthread_mutex_unlock(&ns_state.lock);
+        pthread_rwlock_unlock(&ns_state.lock);
         return ERR_NOT_OWNER;
     }
     
     // Find the request and get the requested permissions
-    int found = 0;
-    int read_requested = 0;
-    int write_requested = 0;
-    
-    for (int i = 0; i < ns_state.request_count; i++) {
-        if (strcmp(ns_state.access_requests[i].filename, filename) == 0 &&
-            strcmp(ns_state.access_requests[i].requester, requester) == 0) {
-            // Save the requested permissions
-            read_requested = ns_state.access_requests[i].read_requested;
-            write_requested = ns_state.access_requests[i].write_requested;
-            
-            // Remove request by shifting array
-            for (int j = i; j < ns_state.request_count - 1; j++) {
-                ns_state.access_requests[j] = ns_state.access_requests[j + 1];
-            }
-            ns_state.request_count--;
-            found = 1;
-            break;
-        }
-    }
-    
-    if (!found) {
-        pthread_mutex_unlock(&ns_state.lock);
+    int req_id = find_request(filename, requester);
+    AccessRequest* req = registry_get(&ns_state.access_requests, req_id);
+    if (!req) {
+        pthread_rwlock_unlock(&ns_state.lock);
         return ERR_REQUEST_NOT_FOUND;
     }
+    int read_requested = req->read_requested;
+    int write_requested = req->write_requested;
+    registry_remove(&ns_state.access_requests, req_id);
+    char key[MAX_FULL_PATH];
+    snprintf(key, sizeof(key), "%s|%s", filename, requester);
+    long lsn = journal_removal(RECORD_REQUEST_DONE, key);
     
-    pthread_mutex_unlock(&ns_state.lock);
+    pthread_rwlock_unlock(&ns_state.lock);
     
-    // Grant the requested permissions
+    // Grant the requested permissions; its commit covers the removal too,
+    // unless the file went away in between
     int result = nm_add_access(filename, requester, read_requested, write_requested);
+    if (result == ERR_FILE_NOT_FOUND) {
+        commit_change(lsn);
+    }
     
     return result;
 }
@@ -991,188 +1347,301 @@ int nm_approve_request(const char* filename, const char* owner, const char* requ
  * @brief Deny an access request
  */
 int nm_deny_request(const char* filename, const char* owner, const char* requester) {
-    pthread_mutex_lock(&ns_state.lock);
+    stats_wrlock(&ns_state.lock, STATS_LOCK_NS_STATE);
     
     // Check if file exists
     FileMetadata* file = nm_find_file(filename);
     if (!file) {
-        pthread_mutex_unlock(&ns_state.lock);
+        pthread_rwlock_unlock(&ns_state.lock);
         return ERR_FILE_NOT_FOUND;
     }
     
     // Check if caller is owner
     if (strcmp(file->owner, owner) != 0) {
-        pthread_mutex_unlock(&ns_state.lock);
+        pthread_rwlock_unlock(&ns_state.lock);
         return ERR_NOT_OWNER;
     }
     
     // Find and remove the request
-    int found = 0;
-    for (int i = 0; i < ns_state.request_count; i++) {
-        if (strcmp(ns_state.access_requests[i].filename, filename) == 0 &&
-            strcmp(ns_state.access_requests[i].requester, requester) == 0) {
-            // Remove request by shifting array
-            for (int j = i; j < ns_state.request_count - 1; j++) {
-                ns_state.access_requests[j] = ns_state.access_requests[j + 1];
-            }
-            ns_state.request_count--;
-            found = 1;
-            break;
-        }
-    }
-    
-    if (!found) {
-        pthread_mutex_unlock(&ns_state.lock);
+    int req_id = find_request(filename, requester);
+    if (req_id < 0) {
+        pthread_rwlock_unlock(&ns_state.lock);
         return ERR_REQUEST_NOT_FOUND;
     }
+    registry_remove(&ns_state.access_requests, req_id);
+    char key[MAX_FULL_PATH];
+    snprintf(key, sizeof(key), "%s|%s", filename, requester);
+    long lsn = journal_removal(RECORD_REQUEST_DONE, key);
     
-    pthread_mutex_unlock(&ns_state.lock);
-    save_state();
-    
-    return ERR_SUCCESS;
+    pthread_rwlock_unlock(&ns_state.lock);
+    return commit_change(lsn);
 }
 
 /**
  * save_state
- * @brief Persist the in-memory Name Server registry to disk (`data/nm_state.dat`).
+ * @brief Compact the journal: write a snapshot of the whole registry to
+ *        `data/nm_state.dat` and delete the journals it replaces.
  *
- * The file format is simple and intended only for recovery between runs. If
- * writing fails the function returns silently; callers should log if needed.
+ * Called from the journal's flusher thread once the journal has grown as
+ * large as the last snapshot, and at shutdown. The journal is switched to
+ * a new file first; every change journaled before the switch was already
+ * made in memory, so the snapshot taken after it covers the old files, and
+ * changes racing with the snapshot are in the new file. The registry is
+ * serialized into memory under ns_state.lock held shared (and each file's
+ * stripe while its ACL is copied), then written out after the lock is
+ * released, so lookups never wait on the disk. The snapshot is written to a
+ * temporary file, synced and renamed over the old one, so a crash leaves
+ * either snapshot intact.
+ *
+ * On failure the journals are kept and the error is logged. Callers must
+ * not hold ns_state.lock.
  */
 void save_state(void) {
-    FILE* f = fopen("data/nm_state.dat", "w");
-    if (!f) return;
+    static pthread_mutex_t save_lock = PTHREAD_MUTEX_INITIALIZER;
+    char* snapshot = NULL;
+    size_t snapshot_len = 0;
+    
+    pthread_mutex_lock(&save_lock);
+    int generation = journal_rotate();
+    FILE* f = generation >= 0 ? open_memstream(&snapshot, &snapshot_len) : NULL;
+    if (!f) {
+        pthread_mutex_unlock(&save_lock);
+        log_message("NM", "ERROR", "Snapshot skipped: could not start a new journal");
+        return;
+    }
+    
+    stats_rdlock(&ns_state.lock, STATS_LOCK_NS_STATE_READ);
     
     // Save files
-    fprintf(f, "%d\n", ns_state.file_count);
-    for (int i = 0; i < ns_state.file_count; i++) {
-        FileMetadata* file = &ns_state.files[i];
-        fprintf(f, "%s|%s|%s|%d|%ld|%ld|%ld|%ld|%d|%d|%d\n",
-                file->filename, file->folder_path, file->owner, file->ss_id,
-                file->created_time, file->last_modified, file->last_accessed,
-                file->file_size, file->word_count, file->char_count, file->acl_count);
-        
-        for (int j = 0; j < file->acl_count; j++) {
-            fprintf(f, "%s|%d|%d\n",
-                    file->acl[j].username,
-                    file->acl[j].read_permission,
-                    file->acl[j].write_permission);
-        }
+    fprintf(f, "%d\n", ns_state.files.count);
+    for (int id = registry_next(&ns_state.files, -1); id >= 0;
+         id = registry_next(&ns_state.files, id)) {
+        FileMetadata* file = registry_get(&ns_state.files, id);
+        pthread_rwlock_t* stripe = nm_file_lock(file);
+        stats_rdlock(stripe, STATS_LOCK_NS_FILE);
+        write_file_entry(f, file);
+        pthread_rwlock_unlock(stripe);
     }
     
     // Save folders
-    fprintf(f, "%d\n", ns_state.folder_count);
-    for (int i = 0; i < ns_state.folder_count; i++) {
-        FolderMetadata* folder = &ns_state.folders[i];
-        fprintf(f, "%s|%s|%ld|%d|%d\n",
-                folder->foldername, folder->owner,
-                folder->created_time, folder->parent_folder_idx, folder->acl_count);
-        
-        for (int j = 0; j < folder->acl_count; j++) {
-            fprintf(f, "%s|%d|%d\n",
-                    folder->acl[j].username,
-                    folder->acl[j].read_permission,
-                    folder->acl[j].write_permission);
-        }
+    // Folders are never removed, so their IDs run 0..count-1 and load back
+    // unchanged: parent_folder_idx stays valid
+    fprintf(f, "%d\n", ns_state.folders.count);
+    for (int id = registry_next(&ns_state.folders, -1); id >= 0;
+         id = registry_next(&ns_state.folders, id)) {
+        write_folder_entry(f, registry_get(&ns_state.folders, id));
     }
     
     // Save access requests
-    fprintf(f, "%d\n", ns_state.request_count);
-    for (int i = 0; i < ns_state.request_count; i++) {
-        AccessRequest* req = &ns_state.access_requests[i];
-        fprintf(f, "%s|%s|%ld|%d|%d\n",
-                req->filename, req->requester, req->request_time,
-                req->read_requested, req->write_requested);
+    fprintf(f, "%d\n", ns_state.access_requests.count);
+    for (int id = registry_next(&ns_state.access_requests, -1); id >= 0;
+         id = registry_next(&ns_state.access_requests, id)) {
+        write_request_entry(f, registry_get(&ns_state.access_requests, id));
     }
     
+    pthread_rwlock_unlock(&ns_state.lock);
+    
+    // Journal to replay on top of this snapshot
+    fprintf(f, "%d\n", generation);
+    fclose(f);
+    
+    int saved = 0;
+    f = fopen(NM_STATE_FILE ".tmp", "w");
+    if (f) {
+        saved = fwrite(snapshot, 1, snapshot_len, f) == snapshot_len &&
+                fflush(f) == 0 && fdatasync(fileno(f)) == 0;
+        saved = fclose(f) == 0 && saved;
+    }
+    if (saved && rename(NM_STATE_FILE ".tmp", NM_STATE_FILE) == 0 &&
+        journal_sync_dir(NM_DATA_DIR) == ERR_SUCCESS) {
+        journal_set_snapshot_size(snapshot_len);
+        journal_remove_before(generation);
+    } else {
+        log_message("NM", "ERROR", "Failed to write state snapshot; keeping the journals");
+    }
+    pthread_mutex_unlock(&save_lock);
+    free(snapshot);
+}
+
+// Insert a loaded or replayed file, or replace the entry at its path.
+// Takes over file->acl.
+static void apply_file(FileMetadata* file) {
+    char full_path[MAX_FULL_PATH];
+    file_full_path(file, full_path, sizeof(full_path));
+    
+    int file_idx = registry_find(&ns_state.files, full_path);
+    FileMetadata* existing = registry_get(&ns_state.files, file_idx);
+    if (existing) {
+        free(existing->acl);
+        *existing = *file;
+    } else {
+        file_idx = registry_insert(&ns_state.files, file);
+        if (file_idx < 0) {
+            free(file->acl);
+            return;
+        }
+        // Index for folder listings
+        if (ns_state.file_trie_root) {
+            trie_insert(ns_state.file_trie_root, full_path, file_idx);
+        }
+    }
+    // Publish for lock-free lookups
+    publish_file(registry_get(&ns_state.files, file_idx));
+}
+
+// Insert a loaded or replayed folder, or replace its ACL. Takes over
+// folder->acl.
+static void apply_folder(FolderMetadata* folder) {
+    FolderMetadata* existing = nm_find_folder(folder->foldername);
+    if (existing) {
+        free(existing->acl);
+        existing->acl = folder->acl;
+        existing->acl_count = folder->acl_count;
+    } else if (registry_insert(&ns_state.folders, folder) < 0) {
+        free(folder->acl);
+    }
+}
+
+static void apply_request(const AccessRequest* req) {
+    AccessRequest* existing = registry_get(&ns_state.access_requests,
+                                           find_request(req->filename, req->requester));
+    if (existing) {
+        *existing = *req;
+    } else {
+        registry_insert(&ns_state.access_requests, req);
+    }
+}
+
+// journal_replay() callback: redo one journaled change
+static void replay_record(char type, char* payload, size_t len, void* ctx) {
+    (void)ctx;
+    FILE* f = fmemopen(payload, len, "r");
+    if (!f) {
+        return;
+    }
+    
+    char line[2 * MAX_FULL_PATH];
+    char* fields[2];
+    FileMetadata file;
+    FolderMetadata folder;
+    AccessRequest req;
+    switch (type) {
+        case RECORD_FILE_MOVED:
+        case RECORD_FILE_DELETED: {
+            if (read_fields(f, line, sizeof(line), fields, 1) != 1) {
+                break;
+            }
+            int file_idx = registry_find(&ns_state.files, fields[0]);
+            if (file_idx >= 0) {
+                remove_file(file_idx);
+            }
+            if (type == RECORD_FILE_MOVED && read_file_entry(f, &file) == ERR_SUCCESS) {
+                apply_file(&file);
+            }
+            break;
+        }
+        case RECORD_FILE:
+            if (read_file_entry(f, &file) == ERR_SUCCESS) {
+                apply_file(&file);
+            }
+            break;
+        case RECORD_FOLDER:
+            if (read_folder_entry(f, &folder) == ERR_SUCCESS) {
+                apply_folder(&folder);
+            }
+            break;
+        case RECORD_REQUEST:
+            if (read_request_entry(f, &req) == ERR_SUCCESS) {
+                apply_request(&req);
+            }
+            break;
+        case RECORD_REQUEST_DONE:
+            if (read_fields(f, line, sizeof(line), fields, 2) == 2) {
+                int req_id = find_request(fields[0], fields[1]);
+                if (req_id >= 0) {
+                    registry_remove(&ns_state.access_requests, req_id);
+                }
+            }
+            break;
+    }
     fclose(f);
 }
 
 /**
  * load_state
- * @brief Load the Name Server registry from disk (`data/nm_state.dat`) into
- *        memory.
+ * @brief Load the Name Server registry from disk: the snapshot in
+ *        `data/nm_state.dat`, then every journal written since.
+ *
+ * Runs before any request is served, so it takes no locks. A missing
+ * snapshot is an empty registry; a snapshot without a journal generation
+ * (written before the journal existed) is followed by journal 0. A torn
+ * record at the end of a journal is dropped, as it was never acknowledged.
  *
- * If the state file is missing the function does nothing. Any malformed
- * entries may produce undefined behavior; the format is expected to match
- * `save_state`'s output.
+ * @return Generation of the last journal, for journal_open() to append to.
  */
-void load_state(void) {
-    FILE* f = fopen("data/nm_state.dat", "r");
-    if (!f) return;
-    
-    // Load files
-    fscanf(f, "%d\n", &ns_state.file_count);
-    for (int i = 0; i < ns_state.file_count; i++) {
-        FileMetadata* file = &ns_state.files[i];
-        fscanf(f, "%[^|]|%[^|]|%[^|]|%d|%ld|%ld|%ld|%ld|%d|%d|%d\n",
-               file->filename, file->folder_path, file->owner, &file->ss_id,
-               &file->created_time, &file->last_modified, &file->last_accessed,
-               &file->file_size, &file->word_count, &file->char_count, &file->acl_count);
+int load_state(void) {
+    int generation = 0;
+    FILE* f = fopen(NM_STATE_FILE, "r");
+    if (f) {
+        char line[64];
+        int ok = 1;
         
-        file->acl = malloc(sizeof(AccessControlEntry) * file->acl_count);
-        for (int j = 0; j < file->acl_count; j++) {
-            fscanf(f, "%[^|]|%d|%d\n",
-                   file->acl[j].username,
-                   &file->acl[j].read_permission,
-                   &file->acl[j].write_permission);
+        // Load files
+        int file_count = fgets(line, sizeof(line), f) ? atoi(line) : 0;
+        for (int i = 0; ok && i < file_count; i++) {
+            FileMetadata file;
+            ok = read_file_entry(f, &file) == ERR_SUCCESS;
+            if (ok) {
+                apply_file(&file);
+            }
         }
-    }
-    
-    // Load folders
-    if (fscanf(f, "%d\n", &ns_state.folder_count) == 1) {
-        for (int i = 0; i < ns_state.folder_count; i++) {
-            FolderMetadata* folder = &ns_state.folders[i];
-            fscanf(f, "%[^|]|%[^|]|%ld|%d|%d\n",
-                   folder->foldername, folder->owner,
-                   &folder->created_time, &folder->parent_folder_idx, &folder->acl_count);
-            
-            folder->acl = malloc(sizeof(AccessControlEntry) * folder->acl_count);
-            for (int j = 0; j < folder->acl_count; j++) {
-                fscanf(f, "%[^|]|%d|%d\n",
-                       folder->acl[j].username,
-                       &folder->acl[j].read_permission,
-                       &folder->acl[j].write_permission);
+        
+        // Load folders
+        int folder_count = ok && fgets(line, sizeof(line), f) ? atoi(line) : 0;
+        for (int i = 0; ok && i < folder_count; i++) {
+            FolderMetadata folder;
+            ok = read_folder_entry(f, &folder) == ERR_SUCCESS;
+            if (ok) {
+                apply_folder(&folder);
             }
         }
-    }
-    
-    // Load access requests
-    if (fscanf(f, "%d\n", &ns_state.request_count) == 1) {
-        for (int i = 0; i < ns_state.request_count; i++) {
-            AccessRequest* req = &ns_state.access_requests[i];
-            if (fscanf(f, "%[^|]|%[^|]|%ld|%d|%d\n",
-                   req->filename, req->requester, &req->request_time,
-                   &req->read_requested, &req->write_requested) < 3) {
-                // Old format without permissions - default to read only
-                req->read_requested = 1;
-                req->write_requested = 0;
+        
+        // Load access requests
+        int request_count = ok && fgets(line, sizeof(line), f) ? atoi(line) : 0;
+        for (int i = 0; ok && i < request_count; i++) {
+            AccessRequest req;
+            ok = read_request_entry(f, &req) == ERR_SUCCESS;
+            if (ok) {
+                apply_request(&req);
             }
         }
+        
+        if (ok && fgets(line, sizeof(line), f)) {
+            generation = atoi(line);
+        }
+        fclose(f);
+        if (!ok) {
+            log_message("NM", "WARN", "State snapshot is malformed; loaded the entries before the error");
+        }
     }
     
-    fclose(f);
-    log_message("NM", "INFO", "Loaded persistent state");
-    
-    // Rebuild Trie from loaded files for efficient search
-    if (ns_state.file_trie_root) {
-        for (int i = 0; i < ns_state.file_count; i++) {
-            FileMetadata* file = &ns_state.files[i];
-            char full_path[MAX_FULL_PATH];
-            
-            if (strlen(file->folder_path) > 0) {
-                snprintf(full_path, MAX_FULL_PATH, "%s/%s", file->folder_path, file->filename);
-            } else {
-                snprintf(full_path, MAX_FULL_PATH, "%s", file->filename);
-            }
-            
-            trie_insert(ns_state.file_trie_root, full_path, i);
+    int records = 0;
+    int last = generation;
+    for (int gen = generation;; gen++) {
+        int replayed = journal_replay(NM_DATA_DIR, gen, replay_record, NULL);
+        if (replayed < 0) {
+            break;
         }
-        
-        char msg[128];
-        snprintf(msg, sizeof(msg), "Rebuilt Trie with %d files", ns_state.file_count);
-        log_message("NM", "INFO", msg);
+        records += replayed;
+        last = gen;
     }
+    
+    char msg[160];
+    snprintf(msg, sizeof(msg),
+             "Loaded persistent state: %d files, %d folders (%d journal records replayed)",
+             ns_state.files.count, ns_state.folders.count, records);
+    log_message("NM", "INFO", msg);
+    return last;
 }
 
 /**
@@ -1180,11 +1649,7 @@ void load_state(void) {
  * @brief Print statistics about search performance for monitoring.
  */
 void nm_print_search_stats(void) {
-    if (ns_state.file_cache) {
-        cache_print_stats(ns_state.file_cache);
-    }
-    
     char msg[256];
-    snprintf(msg, sizeof(msg), "Total files indexed: %d", ns_state.file_count);
+    snprintf(msg, sizeof(msg), "Total files indexed: %d", ns_state.files.count);
     log_message("NM", "INFO", msg);
 }
@@ -0,0 +1,285 @@
+/**
+ * file_view.c - Lock-free published view of the file registry
+ *
+ * Every READ/WRITE/STREAM/UNDO redirect, INFO and permission check needs a
+ * file's storage server, owner and ACL. Those come from a FileView: a hash
+ * table of immutable FileRecords keyed by full path, which readers search
+ * inside an epoch read section without taking any lock, so lookups never
+ * wait behind CREATE, DELETE or MOVE holding ns_state.lock.
+ *
+ * The registry stays the source of truth. Whoever changes a file republishes
+ * it while still holding the lock that guarded the change: a new record
+ * replaces the old one in its chain with a single pointer store, and the old
+ * record is retired through epoch_retire(). A reader therefore sees either
+ * the old or the new version of a file, never a mix, and never freed memory.
+ *
+ * Once there are more files than chains, the bucket array is rebuilt at
+ * twice the size from copies of every record and swapped in whole; the old
+ * array and its records are retired together. Readers still walking the old
+ * array finish on a consistent, if briefly outdated, copy.
+ */
+
+#include "common.h"
+#include "name_server.h"
+
+// One allocation: the record, then its ACL, then its path
+static FileRecord* record_create(const FileMetadata* file) {
+    size_t folder_len = strlen(file->folder_path);
+    size_t path_len = (folder_len ? folder_len + 1 : 0) + strlen(file->filename);
+    size_t acl_size = sizeof(AccessControlEntry) * file->acl_count;
+
+    FileRecord* record = malloc(sizeof(FileRecord) + acl_size + path_len + 1);
+    if (!record) {
+        return NULL;
+    }
+    record->acl = (AccessControlEntry*)(record + 1);
+    record->path = (char*)record->acl + acl_size;
+    if (folder_len) {
+        snprintf(record->path, path_len + 1, "%s/%s", file->folder_path, file->filename);
+    } else {
+        memcpy(record->path, file->filename, path_len + 1);
+    }
+
+    record->next = NULL;
+    record->hash = nm_path_hash(record->path);
+    record->ss_id = file->ss_id;
+    record->folder_len = (int)folder_len;
+    record->acl_count = file->acl_count;
+    safe_strncpy(record->owner, file->owner, sizeof(record->owner));
+    if (acl_size) {
+        memcpy(record->acl, file->acl, acl_size);
+    }
+    return record;
+}
+
+static FileRecord* record_copy(const FileRecord* record) {
+    size_t size = sizeof(FileRecord) + sizeof(AccessControlEntry) * record->acl_count +
+                  strlen(record->path) + 1;
+    FileRecord* copy = malloc(size);
+    if (!copy) {
+        return NULL;
+    }
+    memcpy(copy, record, size);
+    copy->acl = (AccessControlEntry*)(copy + 1);
+    copy->path = (char*)copy + (record->path - (const char*)record);
+    copy->next = NULL;
+    return copy;
+}
+
+static FileViewBuckets* buckets_create(unsigned int count) {
+    FileViewBuckets* table = calloc(1, sizeof(FileViewBuckets) + sizeof(FileRecord*) * count);
+    if (table) {
+        table->mask = count - 1;
+    }
+    return table;
+}
+
+// Free a bucket array and every record still in it
+static void buckets_free(void* arg) {
+    FileViewBuckets* table = (FileViewBuckets*)arg;
+    for (unsigned int i = 0; i <= table->mask; i++) {
+        FileRecord* record = table->buckets[i];
+        while (record) {
+            FileRecord* next = record->next;
+            free(record);
+            record = next;
+        }
+    }
+    free(table);
+}
+
+// Link in the chain that points at `record`. Caller holds view->write_lock.
+static FileRecord** find_link(FileViewBuckets* table, const char* path, unsigned int hash) {
+    FileRecord** link = &table->buckets[hash & table->mask];
+    while (*link && ((*link)->hash != hash || strcmp((*link)->path, path) != 0)) {
+        link = &(*link)->next;
+    }
+    return link;
+}
+
+// Double the buckets once there are more files than chains. Caller holds
+// view->write_lock. On allocation failure the view just stays smaller.
+static void grow(FileView* view) {
+    FileViewBuckets* old = view->table;
+    if ((unsigned int)view->count <= old->mask + 1) {
+        return;
+    }
+
+    FileViewBuckets* table = buckets_create((old->mask + 1) * 2);
+    if (!table) {
+        return;
+    }
+    // Copies, not the records themselves: readers of the old array follow
+    // their next pointers, which must not change under them
+    for (unsigned int i = 0; i <= old->mask; i++) {
+        for (FileRecord* record = old->buckets[i]; record; record = record->next) {
+            FileRecord* copy = record_copy(record);
+            if (!copy) {
+                buckets_free(table);
+                return;
+            }
+            FileRecord** link = &table->buckets[copy->hash & table->mask];
+            copy->next = *link;
+            *link = copy;
+        }
+    }
+    __atomic_store_n(&view->table, table, __ATOMIC_RELEASE);
+    epoch_retire(old, buckets_free);
+}
+
+/**
+ * file_view_create
+ * @brief Allocate an empty view.
+ *
+ * @return New view, or NULL on allocation failure.
+ */
+FileView* file_view_create(void) {
+    FileView* view = calloc(1, sizeof(FileView));
+    if (!view) {
+        return NULL;
+    }
+    view->table = buckets_create(NM_VIEW_MIN_BUCKETS);
+    if (!view->table) {
+        free(view);
+        return NULL;
+    }
+    pthread_mutex_init(&view->write_lock, NULL);
+    return view;
+}
+
+/**
+ * file_view_publish
+ * @brief Make the current state of `file` visible to readers, replacing the
+ *        record previously published under the same path.
+ *
+ * Callers hold whichever lock guards the fields they changed, so two
+ * publishes of one file are never reordered.
+ *
+ * @param view View to update.
+ * @param file Registry entry to copy.
+ * @return ERR_SUCCESS, or ERR_FILE_OPERATION_FAILED if out of memory (the
+ *         old record, if any, stays published).
+ */
+int file_view_publish(FileView* view, const FileMetadata* file) {
+    FileRecord* record = record_create(file);
+    if (!record) {
+        return ERR_FILE_OPERATION_FAILED;
+    }
+
+    pthread_mutex_lock(&view->write_lock);
+    FileViewBuckets* table = view->table;
+    FileRecord** link = find_link(table, record->path, record->hash);
+    FileRecord* old = *link;
+    if (old) {
+        record->next = old->next;
+    } else {
+        link = &table->buckets[record->hash & table->mask];
+        record->next = *link;
+        view->count++;
+    }
+    // Release: a reader that finds the record sees it fully written
+    __atomic_store_n(link, record, __ATOMIC_RELEASE);
+    if (!old) {
+        grow(view);
+    }
+    pthread_mutex_unlock(&view->write_lock);
+
+    if (old) {
+        epoch_retire(old, free);
+    }
+    return ERR_SUCCESS;
+}
+
+/**
+ * file_view_remove
+ * @brief Stop publishing the file at `path`.
+ *
+ * @param view View to update.
+ * @param path Full path of the file.
+ * @return ERR_SUCCESS, or ERR_FILE_NOT_FOUND if nothing was published there.
+ */
+int file_view_remove(FileView* view, const char* path) {
+    pthread_mutex_lock(&view->write_lock);
+    FileRecord** link = find_link(view->table, path, nm_path_hash(path));
+    FileRecord* old = *link;
+    if (!old) {
+        pthread_mutex_unlock(&view->write_lock);
+        return ERR_FILE_NOT_FOUND;
+    }
+    // Readers already on `old` still follow its next pointer to the rest
+    __atomic_store_n(link, old->next, __ATOMIC_RELEASE);
+    view->count--;
+    pthread_mutex_unlock(&view->write_lock);
+
+    epoch_retire(old, free);
+    return ERR_SUCCESS;
+}
+
+/**
+ * file_view_find
+ * @brief Look up the record published for a full path.
+ *
+ * Takes no lock. The caller must be inside epoch_enter()/epoch_exit(), and
+ * the record is only valid until it leaves.
+ *
+ * @param view View to search.
+ * @param path Full path ("<folder>/<filename>", or "<filename>" at root).
+ * @return Record, or NULL if no file is published at `path`.
+ */
+const FileRecord* file_view_find(FileView* view, const char* path) {
+    unsigned int hash = nm_path_hash(path);
+    const FileViewBuckets* table = __atomic_load_n(&view->table, __ATOMIC_ACQUIRE);
+    const FileRecord* record = __atomic_load_n(&table->buckets[hash & table->mask], __ATOMIC_ACQUIRE);
+    while (record && (record->hash != hash || strcmp(record->path, path) != 0)) {
+        record = __atomic_load_n(&record->next, __ATOMIC_ACQUIRE);
+    }
+    return record;
+}
+
+/**
+ * file_record_access
+ * @brief Work out what `username` may do with a published file.
+ *
+ * @param record Record from file_view_find().
+ * @param username User to check, or NULL (no access).
+ * @param can_read Set to 1 if the user may read, else 0.
+ * @param can_write Set to 1 if the user may write, else 0.
+ */
+void file_record_access(const FileRecord* record, const char* username,
+                        int* can_read, int* can_write) {
+    *can_read = 0;
+    *can_write = 0;
+    if (!username) {
+        return;
+    }
+    // Owner always has full permissions
+    if (strcmp(record->owner, username) == 0) {
+        *can_read = 1;
+        *can_write = 1;
+        return;
+    }
+    for (int i = 0; i < record->acl_count; i++) {
+        if (strcmp(record->acl[i].username, username) == 0) {
+            *can_read = record->acl[i].read_permission;
+            *can_write = record->acl[i].write_permission;
+            return;
+        }
+    }
+}
+
+/**
+ * file_view_free
+ * @brief Free a view and every record in it.
+ *
+ * No reader may still be using the view.
+ *
+ * @param view View to free, or NULL.
+ */
+void file_view_free(FileView* view) {
+    if (!view) {
+        return;
+    }
+    buckets_free(view->table);
+    pthread_mutex_destroy(&view->write_lock);
+    free(view);
+}
@@ -1,1447 +1,1555 @@
 #include "common.h"
 #include "name_server.h"
 #include "handlers_helpers.h"
+#include "cJSON.h"
 
 extern NameServerState ns_state;
 
+// One VIEW line, copied out of ns_state so that VIEW -l can ask the Storage
+// Servers for fresh counts without holding any lock
+typedef struct {
+    char path[MAX_FULL_PATH];
+    char filename[MAX_FILENAME];
+    char owner[MAX_USERNAME];
+    int ss_id;
+    int word_count;
+    int char_count;
+    time_t last_accessed;
+} ViewRow;
+
 /**
- * handle_client_connection
- * @brief Thread entry point to process messages from a connected client or
- *        storage-server registration/forwarding requests.
+ * nm_session_init
+ * @brief Prepare per-connection state for a newly accepted socket.
  *
- * This function loops receiving framed messages from the connected socket and
- * dispatches actions based on the `op_code` in the message header. It may
- * forward requests to storage servers (for create/delete) or return storage
- * server connection info for read/write operations. The function sends
- * responses back on the same socket.
+ * @param session Session to initialize.
+ * @param fd Accepted socket fd; the session takes ownership of it.
+ */
+void nm_session_init(NMSession* session, int fd) {
+    memset(session, 0, sizeof(*session));
+    session->fd = fd;
+    session->heartbeat_ss = -1;
+    
+    // Get client IP and port for logging ("local" for Unix-socket peers)
+    get_peer_address(fd, session->client_ip, sizeof(session->client_ip), &session->client_port);
+}
+
+/**
+ * nm_stats_reply
+ * @brief Build the OP_STATS reply: this server's op latencies and lock waits,
+ *        the sizes of its registry tables, its metadata journal counters,
+ *        and the stats of every active Storage Server.
  *
- * @param arg Pointer to an allocated int containing the accepted socket fd.
- *            The function takes ownership and frees it.
- * @return Always returns NULL when the thread exits.
+ * Storage Servers are queried over the connection pool without holding
+ * ns_state.lock, so a slow server does not stall other requests.
+ *
+ * @return Malloc'd JSON text, or NULL if it could not be built.
  */
-void* handle_client_connection(void* arg) {
-    int client_fd = *(int*)arg;
-    free(arg);
+static char* nm_stats_reply(void) {
+    cJSON* root = stats_to_json("NM");
+
+    StorageServerInfo* active[MAX_STORAGE_SERVERS];
+    int active_count = 0;
+    stats_rdlock(&ns_state.lock, STATS_LOCK_NS_STATE_READ);
+    cJSON* registry = cJSON_AddObjectToObject(root, "registry");
+    cJSON_AddNumberToObject(registry, "files", ns_state.files.count);
+    cJSON_AddNumberToObject(registry, "folders", ns_state.folders.count);
+    cJSON_AddNumberToObject(registry, "clients", ns_state.clients.count);
+    cJSON_AddNumberToObject(registry, "access_requests", ns_state.access_requests.count);
+    JournalStats journal;
+    journal_get_stats(&journal);
+    cJSON* journal_json = cJSON_AddObjectToObject(root, "journal");
+    cJSON_AddNumberToObject(journal_json, "generation", journal.generation);
+    cJSON_AddNumberToObject(journal_json, "bytes", journal.file_bytes);
+    cJSON_AddNumberToObject(journal_json, "records", journal.records);
+    cJSON_AddNumberToObject(journal_json, "commits", journal.commits);
+    cJSON_AddNumberToObject(journal_json, "writes", journal.writes);
+    cJSON_AddNumberToObject(journal_json, "syncs", journal.syncs);
+    cJSON_AddNumberToObject(journal_json, "failed_commits", journal.failed_commits);
+    for (int i = 0; i < ns_state.ss_count; i++) {
+        if (ns_state.storage_servers[i].is_active) {
+            active[active_count++] = &ns_state.storage_servers[i];
+        }
+    }
+    pthread_rwlock_unlock(&ns_state.lock);
+
+    cJSON* servers = cJSON_AddArrayToObject(root, "storage_servers");
+    for (int i = 0; i < active_count; i++) {
+        MessageHeader request, response;
+        init_message_header(&request, MSG_REQUEST, OP_STATS, "system");
+        char* body = NULL;
+        cJSON* ss_stats = NULL;
+        if (ss_pool_request(active[i], &request, NULL, &response, &body) == ERR_SUCCESS &&
+            response.msg_type == MSG_RESPONSE && body) {
+            ss_stats = cJSON_Parse(body);
+        }
+        if (body) free(body);
+        if (!ss_stats) {
+            ss_stats = cJSON_CreateObject();
+            cJSON_AddNumberToObject(ss_stats, "server_id", active[i]->server_id);
+            cJSON_AddStringToObject(ss_stats, "error", get_error_message(ERR_SS_UNAVAILABLE));
+        }
+        cJSON_AddItemToArray(servers, ss_stats);
+    }
+
+    char* json = cJSON_Print(root);
+    cJSON_Delete(root);
+    return json;
+}
+
+/**
+ * nm_handle_request
+ * @brief Process one request from a connected client or storage server.
+ *
+ * Dispatches on the `op_code` in the message header. It may forward requests
+ * to storage servers (for create/delete) or return storage server connection
+ * info for read/write operations. Responses are sent back on the session's
+ * socket. Requests on one session must be handled one at a time and in
+ * arrival order.
+ *
+ * @param session Connection the request arrived on.
+ * @param request Received request header.
+ * @param payload Request payload or NULL; still owned by the caller.
+ */
+void nm_handle_request(NMSession* session, const MessageHeader* request, char* payload) {
+    int client_fd = session->fd;
+    const char* client_ip = session->client_ip;
+    int client_port = session->client_port;
+    char* connected_username = session->username;  // Track connected user for cleanup
+    MessageHeader header = *request;
+    struct timespec op_start;
+    clock_gettime(CLOCK_MONOTONIC, &op_start);
     
-    // Get client IP and port for logging
-    struct sockaddr_in client_addr;
-    socklen_t addr_len = sizeof(client_addr);
-    getpeername(client_fd, (struct sockaddr*)&client_addr, &addr_len);
-    char client_ip[MAX_IP];
-    inet_ntop(AF_INET, &client_addr.sin_addr, client_ip, sizeof(client_ip));
-    int client_port = ntohs(client_addr.sin_port);
+    char response_buf[BUFFER_SIZE];
+    char details[1024];
+    // Get operation name using helper
+    const char* operation = op_name(header.op_code);
+    int result_code = ERR_SUCCESS;
     
-    MessageHeader header;
-    char* payload = NULL;
-    char connected_username[MAX_USERNAME] = "";  // Track connected user for cleanup
+    // Initialize default details based on header content
+    if (header.filename[0]) {
+        snprintf(details, sizeof(details), "file=%s", header.filename);
+    } else if (header.foldername[0]) {
+        snprintf(details, sizeof(details), "folder=%s", header.foldername);
+    } else {
+        details[0] = '\0';
+    }
     
-    while (recv_message(client_fd, &header, &payload) > 0) {
-        char response_buf[BUFFER_SIZE];
-        char details[1024];
-        // Get operation name using helper
-        const char* operation = op_name(header.op_code);
-        int result_code = ERR_SUCCESS;
-        
-        // Initialize default details based on header content
-        if (header.filename[0]) {
-            snprintf(details, sizeof(details), "file=%s", header.filename);
-        } else if (header.foldername[0]) {
-            snprintf(details, sizeof(details), "folder=%s", header.foldername);
-        } else {
-            details[0] = '\0';
-        }
-        
-        switch (header.op_code) {
-            case OP_REGISTER_SS: {
-                // Parse: "server_id nm_port client_port ss_ip"
-                // The SS now provides its own network IP to fix the localhost bug
-                int server_id, nm_port, client_port;
-                char ss_provided_ip[MAX_IP] = {0};
-                
-                // Parse registration payload - ss_ip is optional for backward compatibility
-                int parsed = sscanf(payload, "%d %d %d %15s", &server_id, &nm_port, &client_port, ss_provided_ip);
-                
-                char ip[MAX_IP];
-                if (parsed >= 4 && ss_provided_ip[0] != '\0') {
-                    // Use SS-provided IP (new behavior - fixes localhost bug)
-                    strncpy(ip, ss_provided_ip, MAX_IP - 1);
-                    ip[MAX_IP - 1] = '\0';
-                } else {
-                    // Fallback to getpeername() for backward compatibility
-                    struct sockaddr_in addr;
-                    socklen_t addr_len = sizeof(addr);
-                    getpeername(client_fd, (struct sockaddr*)&addr, &addr_len);
-                    inet_ntop(AF_INET, &addr.sin_addr, ip, sizeof(ip));
-                }
-                
-                snprintf(details, sizeof(details), "SS_ID=%d IP=%s NM_Port=%d Client_Port=%d", 
-                        server_id, ip, nm_port, client_port);
-                
-                // Log registration request received
-                log_operation("NM", "INFO", "SS_REGISTER_REQUEST", "", ip, nm_port, details, 0);
-                
-                int result = nm_register_storage_server(server_id, ip, nm_port, client_port);
-                result_code = result;
-                
-                if (result == ERR_SUCCESS) {
-                    char msg[512];
-                    snprintf(msg, sizeof(msg), 
-                             "✓ Storage Server #%d registered | IP=%s | NM_Port=%d | Client_Port=%d", 
-                             server_id, ip, nm_port, client_port);
-                     log_message("NM", "INFO", msg);
+    switch (header.op_code) {
+        case OP_REGISTER_SS: {
+            // Parse: "server_id nm_port client_port ss_ip [protocol [local_addr]]"
+            // The SS now provides its own network IP to fix the localhost bug
+            int server_id, nm_port, client_port;
+            int ss_protocol = PROTOCOL_V1;
+            char ss_provided_ip[MAX_IP] = {0};
+            char ss_local_addr[MAX_LOCAL_ADDR] = "";
+            
+            // Parse registration payload - ss_ip and protocol are optional for backward compatibility
+            int parsed = sscanf(payload, "%d %d %d %15s %d %159s", &server_id, &nm_port, &client_port,
+                                ss_provided_ip, &ss_protocol, ss_local_addr);
+            
+            char ip[MAX_IP];
+            if (parsed >= 4 && ss_provided_ip[0] != '\0') {
+                // Use SS-provided IP (new behavior - fixes localhost bug)
+                strncpy(ip, ss_provided_ip, MAX_IP - 1);
+                ip[MAX_IP - 1] = '\0';
+            } else {
+                // Fallback to getpeername() for backward compatibility
+                int peer_port;
+                get_peer_address(client_fd, ip, sizeof(ip), &peer_port);
+            }
+            
+            snprintf(details, sizeof(details), "SS_ID=%d IP=%s NM_Port=%d Client_Port=%d", 
+                    server_id, ip, nm_port, client_port);
+            
+            // Log registration request received
+            log_operation("NM", "INFO", "SS_REGISTER_REQUEST", "", ip, nm_port, details, 0);
+            
+            int result = nm_register_storage_server(server_id, ip, nm_port, client_port, ss_protocol,
+                                                    ss_local_addr);
+            result_code = result;
+            
+            if (result == ERR_SUCCESS) {
+                char msg[512];
+                snprintf(msg, sizeof(msg), 
+                         "✓ Storage Server #%d registered | IP=%s | NM_Port=%d | Client_Port=%d", 
+                         server_id, ip, nm_port, client_port);
+                 log_message("NM", "INFO", msg);
 
-                    // Check if this SS needs to Sync from an Active Replica (Stale Detection)
-                    StorageServerInfo* ss = nm_find_storage_server(server_id);
-                    if (ss && ss->replica_active) {
-                        StorageServerInfo* replica = nm_find_storage_server(ss->replica_id);
-                        if (replica && replica->is_active) {
-                             char sync_payload[256];
-                             snprintf(sync_payload, sizeof(sync_payload), "SYNC %s %d", replica->ip, replica->client_port);
-                             
-                             // Send ACK with SYNC instruction
-                             header.msg_type = MSG_ACK;
-                             header.error_code = ERR_SUCCESS;
-                             header.data_length = strlen(sync_payload);
-                             send_message(client_fd, &header, sync_payload);
-                             
-                             char sync_msg[512];
-                             snprintf(sync_msg, sizeof(sync_msg), "[RECOVERY] Triggering SYNC for SS #%d from Replica SS #%d", server_id, replica->server_id);
-                             log_message("NM", "INFO", sync_msg);
-                             goto registration_done;
-                        }
+                // Check if this SS needs to Sync from an Active Replica (Stale Detection)
+                char sync_payload[256] = "";
+                int replica_id = -1;
+                stats_rdlock(&ns_state.lock, STATS_LOCK_NS_STATE_READ);
+                StorageServerInfo* ss = nm_find_storage_server(server_id);
+                if (ss && ss->replica_active) {
+                    StorageServerInfo* replica = nm_find_storage_server(ss->replica_id);
+                    if (replica && replica->is_active) {
+                        replica_id = replica->server_id;
+                        snprintf(sync_payload, sizeof(sync_payload), "SYNC %s %d %d %s",
+                                 replica->ip, replica->client_port, replica->protocol,
+                                 replica->local_addr);
                     }
                 }
+                pthread_rwlock_unlock(&ns_state.lock);
                 
-                header.msg_type = (result == ERR_SUCCESS) ? MSG_ACK : MSG_ERROR;
-                header.error_code = result;
-                header.data_length = 0;
-                send_message(client_fd, &header, NULL);
+                if (sync_payload[0]) {
+                    // Send ACK with SYNC instruction
+                    header.msg_type = MSG_ACK;
+                    header.error_code = ERR_SUCCESS;
+                    header.data_length = strlen(sync_payload);
+                    send_message(client_fd, &header, sync_payload);
+                    
+                    char sync_msg[512];
+                    snprintf(sync_msg, sizeof(sync_msg), "[RECOVERY] Triggering SYNC for SS #%d from Replica SS #%d", server_id, replica_id);
+                    log_message("NM", "INFO", sync_msg);
+                    goto registration_done;
+                }
+            }
+            
+            header.msg_type = (result == ERR_SUCCESS) ? MSG_ACK : MSG_ERROR;
+            header.error_code = result;
+            header.data_length = 0;
+            send_message(client_fd, &header, NULL);
 
-                registration_done:
+            registration_done:
+            
+            // Log acknowledgment sent
+            log_operation("NM", result == ERR_SUCCESS ? "INFO" : "ERROR",
+                         "SS_REGISTER_ACK", "", ip, nm_port, details, result);
+            break;
+        }
+        
+        case OP_CONNECT_CLIENT: {
+            // Register client - payload contains username
+            stats_wrlock(&ns_state.lock, STATS_LOCK_NS_STATE);
+            
+            // Log connection request
+            log_operation("NM", "INFO", "CLIENT_CONNECT_REQUEST", payload, client_ip, client_port, "Registration attempt", 0);
+            
+            // First, check if username is already connected (reject if so)
+            ClientInfo* existing = registry_get(&ns_state.clients,
+                                                registry_find(&ns_state.clients, payload));
+            
+            if (existing && existing->is_connected) {
+                pthread_rwlock_unlock(&ns_state.lock);
+                result_code = ERR_USERNAME_TAKEN;
+                snprintf(details, sizeof(details), "Username '%s' already in use", payload);
+                
+                log_message("NM", "WARN", details);
                 
-                // Log acknowledgment sent
-                log_operation("NM", result == ERR_SUCCESS ? "INFO" : "ERROR",
-                             "SS_REGISTER_ACK", "", ip, nm_port, details, result);
+                send_error(client_fd, &header, ERR_USERNAME_TAKEN);
                 break;
             }
             
-            case OP_CONNECT_CLIENT: {
-                // Register client - payload contains username
-                pthread_mutex_lock(&ns_state.lock);
-                
-                // Log connection request
-                log_operation("NM", "INFO", "CLIENT_CONNECT_REQUEST", payload, client_ip, client_port, "Registration attempt", 0);
-                
-                // First, check if username is already connected (reject if so)
-                int username_connected = 0;
-                int existing_index = -1;
-                for (int i = 0; i < ns_state.client_count; i++) {
-                    if (strcmp(ns_state.clients[i].username, payload) == 0) {
-                        existing_index = i;
-                        if (ns_state.clients[i].is_connected) {
-                            username_connected = 1;
-                            break;
-                        }
-                    }
-                }
-                
-                if (username_connected) {
-                    pthread_mutex_unlock(&ns_state.lock);
-                    result_code = ERR_USERNAME_TAKEN;
-                    snprintf(details, sizeof(details), "Username '%s' already in use", payload);
-                    
-                    log_message("NM", "WARN", details);
-                    
-                    send_error(client_fd, &header, ERR_USERNAME_TAKEN);
-                    break;
-                }
+            // Reuse existing disconnected entry or create new one
+            ClientInfo* client = NULL;
+            if (existing) {
+                // Reuse existing disconnected entry
+                client = existing;
+                snprintf(details, sizeof(details), "✓ Client '%s' reconnected from %s:%d (reused entry)", 
+                         payload, client_ip, client_port);
+            } else {
+                // Create new entry
+                ClientInfo new_client;
+                memset(&new_client, 0, sizeof(new_client));
+                safe_strncpy(new_client.username, payload, sizeof(new_client.username));
+                client = registry_get(&ns_state.clients,
+                                      registry_insert(&ns_state.clients, &new_client));
+                snprintf(details, sizeof(details), "✓ Client '%s' registered from %s:%d", 
+                         payload, client_ip, client_port);
+            }
+            
+            if (client) {
+                strcpy(connected_username, payload);  // Track username for disconnect
                 
-                // Reuse existing disconnected entry or create new one
-                ClientInfo* client = NULL;
-                if (existing_index >= 0) {
-                    // Reuse existing disconnected entry
-                    client = &ns_state.clients[existing_index];
-                    snprintf(details, sizeof(details), "✓ Client '%s' reconnected from %s:%d (reused entry)", 
-                             payload, client_ip, client_port);
-                } else if (ns_state.client_count < MAX_CLIENTS) {
-                    // Create new entry
-                    client = &ns_state.clients[ns_state.client_count];
-                    strcpy(client->username, payload);
-                    ns_state.client_count++;
-                    snprintf(details, sizeof(details), "✓ Client '%s' registered from %s:%d", 
-                             payload, client_ip, client_port);
-                }
+                int peer_port;
+                get_peer_address(client_fd, client->ip, sizeof(client->ip), &peer_port);
                 
-                if (client) {
-                    strcpy(connected_username, payload);  // Track username for disconnect
-                    
-                    struct sockaddr_in addr;
-                    socklen_t addr_len = sizeof(addr);
-                    getpeername(client_fd, (struct sockaddr*)&addr, &addr_len);
-                    inet_ntop(AF_INET, &addr.sin_addr, client->ip, sizeof(client->ip));
-                    
-                    client->is_connected = 1;
-                    client->last_activity = time(NULL);
-                    
-                    result_code = ERR_SUCCESS;
-                    log_message("NM", "INFO", details);
-                } else {
-                    result_code = ERR_FILE_OPERATION_FAILED;
-                    snprintf(details, sizeof(details), "Failed to register client: max clients reached");
-                    log_message("NM", "ERROR", details);
-                }
-                pthread_mutex_unlock(&ns_state.lock);
+                client->is_connected = 1;
+                client->last_activity = time(NULL);
                 
-                if (result_code == ERR_SUCCESS) {
-                    send_ack(client_fd, &header);
-                    
-                    // Log successful connection
-                    log_operation("NM", "INFO", "CLIENT_CONNECT_SUCCESS", payload, client_ip, client_port, "Client registered", ERR_SUCCESS);
-                } else {
-                    send_error(client_fd, &header, result_code);
-                }
-                break;
+                result_code = ERR_SUCCESS;
+                log_message("NM", "INFO", details);
+            } else {
+                result_code = ERR_FILE_OPERATION_FAILED;
+                snprintf(details, sizeof(details), "Failed to register client: out of memory");
+                log_message("NM", "ERROR", details);
             }
+            pthread_rwlock_unlock(&ns_state.lock);
             
-            case OP_VIEW: {
-                // List files - check flags for -a and -l
-                int show_all = (header.flags & 1);  // -a flag
-                int show_details = (header.flags & 2);  // -l flag
+            if (result_code == ERR_SUCCESS) {
+                send_ack(client_fd, &header);
                 
-                response_buf[0] = '\0';
+                // Log successful connection
+                log_operation("NM", "INFO", "CLIENT_CONNECT_SUCCESS", payload, client_ip, client_port, "Client registered", ERR_SUCCESS);
+            } else {
+                send_error(client_fd, &header, result_code);
+            }
+            break;
+        }
+        
+        case OP_VIEW: {
+            // List files - check flags for -a and -l
+            int show_all = (header.flags & 1);  // -a flag
+            int show_details = (header.flags & 2);  // -l flag
+            
+            stats_rdlock(&ns_state.lock, STATS_LOCK_NS_STATE_READ);
+            ViewRow* rows = malloc((ns_state.files.count + 1) * sizeof(ViewRow));
+            int row_count = 0;
+            for (int id = rows ? registry_next(&ns_state.files, -1) : -1; id >= 0;
+                 id = registry_next(&ns_state.files, id)) {
+                FileMetadata* file = registry_get(&ns_state.files, id);
+                ViewRow* row = &rows[row_count];
                 
-                pthread_mutex_lock(&ns_state.lock);
-                for (int i = 0; i < ns_state.file_count; i++) {
-                    FileMetadata* file = &ns_state.files[i];
-                    
-                    // Check permission
-                    int has_access = 0;
-                    for (int j = 0; j < file->acl_count; j++) {
-                        if (strcmp(file->acl[j].username, header.username) == 0) {
-                            has_access = 1;
-                            break;
-                        }
+                // Check permission
+                int has_access = 0;
+                pthread_rwlock_t* stripe = nm_file_lock(file);
+                stats_rdlock(stripe, STATS_LOCK_NS_FILE);
+                for (int j = 0; j < file->acl_count; j++) {
+                    if (strcmp(file->acl[j].username, header.username) == 0) {
+                        has_access = 1;
+                        break;
                     }
-                    
+                }
+                row->word_count = file->word_count;
+                row->char_count = file->char_count;
+                row->last_accessed = file->last_accessed;
+                pthread_rwlock_unlock(stripe);
 
-                    // Filter hidden files (starting with '.') unless -a is specified
-                    int is_hidden = (file->filename[0] == '.');
-                    if (is_hidden && !show_all) continue;
+                // Filter hidden files (starting with '.') unless -a is specified
+                int is_hidden = (file->filename[0] == '.');
+                if (is_hidden && !show_all) continue;
+                
+                if (!has_access) {
+                    // Normally we hide files user doesn't have access to
+                    // BUT if -a is for "admin/all" it might show them
+                    // Let's stick to standard behavior: only show what you have access to,
+                    // unless you are admin/root (not implemented yet).
+                    // Actually, previous logic was `if (!show_all && !has_access) continue;`
+                    // which implies `show_all` bypasses ALC checks? That seems insecure for a client explicit flag.
+                    // Let's assume standard behavior:
+                    // 1. Must have access
+                    // 2. If access OK, check hidden status
+                    continue;
+                }
+                
+                construct_full_path(row->path, sizeof(row->path), file->folder_path, file->filename);
+                safe_strncpy(row->filename, file->filename, sizeof(row->filename));
+                safe_strncpy(row->owner, file->owner, sizeof(row->owner));
+                row->ss_id = file->ss_id;
+                row_count++;
+            }
+            
+            StorageServerInfo* servers[MAX_STORAGE_SERVERS];
+            int server_count = 0;
+            for (int i = 0; i < ns_state.ss_count; i++) {
+                if (ns_state.storage_servers[i].is_active) {
+                    servers[server_count++] = &ns_state.storage_servers[i];
+                }
+            }
+            pthread_rwlock_unlock(&ns_state.lock);
+            
+            if (show_details && rows) {
+                // Refresh metadata from the Storage Servers before displaying.
+                // INFO requests to each SS are pipelined on one connection,
+                // with no lock held; results are stored back file by file.
+                MessageHeader* requests = malloc((row_count + 1) * sizeof(MessageHeader));
+                MessageHeader* replies = malloc((row_count + 1) * sizeof(MessageHeader));
+                char** reply_payloads = malloc((row_count + 1) * sizeof(char*));
+                int* batch = malloc((row_count + 1) * sizeof(int));
+                
+                for (int s = 0; requests && replies && reply_payloads && batch && s < server_count; s++) {
+                    StorageServerInfo* ss = servers[s];
                     
-                    if (!has_access) {
-                        // Normally we hide files user doesn't have access to
-                        // BUT if -a is for "admin/all" it might show them
-                        // Let's stick to standard behavior: only show what you have access to,
-                        // unless you are admin/root (not implemented yet).
-                        // Actually, previous logic was `if (!show_all && !has_access) continue;`
-                        // which implies `show_all` bypasses ALC checks? That seems insecure for a client explicit flag.
-                        // Let's assume standard behavior:
-                        // 1. Must have access
-                        // 2. If access OK, check hidden status
-                        continue;
+                    int batch_count = 0;
+                    for (int v = 0; v < row_count; v++) {
+                        if (rows[v].ss_id != ss->server_id) continue;
+                        init_message_header(&requests[batch_count], MSG_REQUEST, OP_INFO, header.username);
+                        strcpy(requests[batch_count].filename, rows[v].filename);
+                        batch[batch_count++] = v;
                     }
+                    if (batch_count == 0) continue;
                     
-                    if (show_details) {
-                        // Refresh metadata from Storage Server before displaying
-                        StorageServerInfo* ss = nm_find_storage_server(file->ss_id);
-                        if (ss && ss->is_active) {
-                            int ss_socket = connect_to_server(ss->ip, ss->client_port);
-                            if (ss_socket >= 0) {
-                                MessageHeader ss_header;
-                                memset(&ss_header, 0, sizeof(ss_header));
-                                ss_header.msg_type = MSG_REQUEST;
-                                ss_header.op_code = OP_INFO;
-                                strcpy(ss_header.filename, file->filename);
-                                strcpy(ss_header.username, header.username);
-                                ss_header.data_length = 0;
-                                
-                                send_message(ss_socket, &ss_header, NULL);
-                                
-                                char* ss_response = NULL;
-                                recv_message(ss_socket, &ss_header, &ss_response);
-                                close(ss_socket);
-                                
-                                if (ss_header.msg_type == MSG_RESPONSE && ss_response) {
-                                    // Parse: "Size:123 Words:45 Chars:67"
-                                    long size = 0;
-                                    int words = 0, chars = 0;
-                                    if (sscanf(ss_response, "Size:%ld Words:%d Chars:%d", 
-                                            &size, &words, &chars) == 3) {
-                                        // Update cached metadata
-                                        file->file_size = size;
-                                        file->word_count = words;
-                                        file->char_count = chars;
-                                        file->last_accessed = time(NULL);
-                                    }
-                                    free(ss_response);
-                                }
+                    int answered = ss_pool_pipeline(ss, requests, NULL, batch_count, replies, reply_payloads);
+                    for (int b = 0; b < answered; b++) {
+                        if (replies[b].msg_type == MSG_RESPONSE && reply_payloads[b]) {
+                            // Parse: "Size:123 Words:45 Chars:67"
+                            long size = 0;
+                            int words = 0, chars = 0;
+                            if (sscanf(reply_payloads[b], "Size:%ld Words:%d Chars:%d", 
+                                    &size, &words, &chars) == 3) {
+                                // Update cached metadata
+                                ViewRow* row = &rows[batch[b]];
+                                row->word_count = words;
+                                row->char_count = chars;
+                                row->last_accessed = time(NULL);
+                                nm_update_file_stats(row->path, size, words, chars);
                             }
                         }
-                        
-                        char line[512];
-                        char time_str[32];
-                        strftime(time_str, sizeof(time_str), "%Y-%m-%d %H:%M",
-                                localtime(&file->last_accessed));
-                        snprintf(line, sizeof(line), "%-20s %5d %5d %16s %s\n",
-                                file->filename, file->word_count, file->char_count,
-                                time_str, file->owner);
-                        strcat(response_buf, line);
-                    } else {
-                        strcat(response_buf, file->filename);
-                        strcat(response_buf, "\n");
+                        if (reply_payloads[b]) free(reply_payloads[b]);
                     }
                 }
-                pthread_mutex_unlock(&ns_state.lock);
                 
-                // Save state to persist any metadata updates
+                free(requests);
+                free(replies);
+                free(reply_payloads);
+                free(batch);
+            }
+            
+            // The listing grows with the number of files, so it is built
+            // in a heap buffer rather than response_buf
+            char* listing = NULL;
+            size_t listing_len = 0;
+            FILE* out = rows ? open_memstream(&listing, &listing_len) : NULL;
+            for (int v = 0; out && v < row_count; v++) {
+                ViewRow* row = &rows[v];
                 if (show_details) {
-                    save_state();
+                    char time_str[32];
+                    struct tm tm_info;
+                    strftime(time_str, sizeof(time_str), "%Y-%m-%d %H:%M",
+                            localtime_r(&row->last_accessed, &tm_info));
+                    fprintf(out, "%-20s %5d %5d %16s %s\n",
+                            row->filename, row->word_count, row->char_count,
+                            time_str, row->owner);
+                } else {
+                    fprintf(out, "%s\n", row->filename);
                 }
-                
-                header.msg_type = MSG_RESPONSE;
-                header.error_code = ERR_SUCCESS;
-                header.data_length = strlen(response_buf);
-                send_message(client_fd, &header, response_buf);
+            }
+            free(rows);
+            if (!out || fclose(out) != 0) {
+                free(listing);
+                result_code = ERR_FILE_OPERATION_FAILED;
+                log_message("NM", "ERROR", "VIEW failed: Out of memory building the listing");
+                send_error(client_fd, &header, ERR_FILE_OPERATION_FAILED);
                 break;
             }
             
-            case OP_LIST: {
-                // List all connected users only
-                response_buf[0] = '\0';
-                pthread_mutex_lock(&ns_state.lock);
-                for (int i = 0; i < ns_state.client_count; i++) {
-                    if (ns_state.clients[i].is_connected) {
-                        strcat(response_buf, ns_state.clients[i].username);
-                        strcat(response_buf, "\n");
-                    }
+            header.msg_type = MSG_RESPONSE;
+            header.error_code = ERR_SUCCESS;
+            header.data_length = listing_len;
+            send_message(client_fd, &header, listing);
+            free(listing);
+            break;
+        }
+        
+        case OP_LIST: {
+            // List all connected users only, into a heap buffer since the
+            // client table is unbounded
+            char* listing = NULL;
+            size_t listing_len = 0;
+            FILE* out = open_memstream(&listing, &listing_len);
+            if (!out) {
+                result_code = ERR_FILE_OPERATION_FAILED;
+                send_error(client_fd, &header, ERR_FILE_OPERATION_FAILED);
+                break;
+            }
+            stats_rdlock(&ns_state.lock, STATS_LOCK_NS_STATE_READ);
+            for (int id = registry_next(&ns_state.clients, -1); id >= 0;
+                 id = registry_next(&ns_state.clients, id)) {
+                ClientInfo* client = registry_get(&ns_state.clients, id);
+                if (client->is_connected) {
+                    fprintf(out, "%s\n", client->username);
                 }
-                pthread_mutex_unlock(&ns_state.lock);
-                
-                header.msg_type = MSG_RESPONSE;
-                header.error_code = ERR_SUCCESS;
-                header.data_length = strlen(response_buf);
-                send_message(client_fd, &header, response_buf);
+            }
+            pthread_rwlock_unlock(&ns_state.lock);
+            if (fclose(out) != 0) {
+                free(listing);
+                result_code = ERR_FILE_OPERATION_FAILED;
+                send_error(client_fd, &header, ERR_FILE_OPERATION_FAILED);
                 break;
             }
             
-            case OP_CREATE: {
-                snprintf(details, sizeof(details), "file=%s folder=%s", 
-                        header.filename, header.foldername[0] ? header.foldername : "/");
-                
-                // Log request received
-                log_operation("NM", "INFO", "CREATE_REQUEST", header.username, client_ip, client_port, details, 0);
-                
-                // Validate filename - reject reserved extensions
-                if (!is_valid_filename(header.filename)) {
-                    result_code = ERR_INVALID_FILENAME;
-                    log_message("NM", "ERROR", "File creation rejected: Invalid filename (reserved extension)");
-                    send_error(client_fd, &header, ERR_INVALID_FILENAME);
-                    break;
-                }
-                
-                // Create file - select SS and forward request
-                int ss_id = nm_select_storage_server();
-                if (ss_id < 0) {
-                    result_code = ERR_SS_UNAVAILABLE;
-                    log_message("NM", "ERROR", "File creation failed: No storage server available");
-                    send_error(client_fd, &header, ERR_SS_UNAVAILABLE);
-                    break;
-                }
-                
-                StorageServerInfo* ss = nm_find_storage_server(ss_id);
-                if (!ss) {
-                    result_code = ERR_SS_UNAVAILABLE;
-                    send_error(client_fd, &header, ERR_SS_UNAVAILABLE);
-                    break;
-                }
-                
-                char ss_details[512];
-                snprintf(ss_details, sizeof(ss_details), "Forwarding CREATE to SS #%d at %s:%d", 
-                         ss_id, ss->ip, ss->client_port);
-                log_message("NM", "INFO", ss_details);
-                
-                // Connect to SS and forward create request
-                int ss_socket = connect_to_server(ss->ip, ss->client_port);
-                if (ss_socket < 0) {
-                    result_code = ERR_SS_UNAVAILABLE;
-                    log_message("NM", "ERROR", "Failed to connect to storage server");
-                    send_error(client_fd, &header, ERR_SS_UNAVAILABLE);
-                    break;
-                }
-                
-                MessageHeader ss_header = header;
-                ss_header.op_code = OP_SS_CREATE;
-                send_message(ss_socket, &ss_header, header.username);
-                
-                char* ss_response;
-                recv_message(ss_socket, &ss_header, &ss_response);
-                close(ss_socket);
-                
-                result_code = ss_header.error_code;
-                if (ss_header.msg_type == MSG_ACK) {
-                    // Register file in NM (with folder path from header)
-                    nm_register_file(header.filename, header.foldername, header.username, ss_id);
-                    char tmp[2048];
-                    snprintf(tmp, sizeof(tmp), "✓ File '%s' created by '%s' on SS #%d", 
-                             header.filename, header.username, ss_id);
-                    log_message("NM", "INFO", tmp);
-                    
-                    snprintf(tmp, sizeof(tmp), "%s | SS_ID=%d", details, ss_id);
-                    strncpy(details, tmp, sizeof(details) - 1);
-                }
-                
-                send_message(client_fd, &ss_header, ss_response);
-                
-                // Log response sent
-                log_operation("NM", result_code == ERR_SUCCESS ? "INFO" : "ERROR",
-                             "CREATE_RESPONSE", header.username, client_ip, client_port, details, result_code);
-                
-                if (ss_response) free(ss_response);
+            header.msg_type = MSG_RESPONSE;
+            header.error_code = ERR_SUCCESS;
+            header.data_length = listing_len;
+            send_message(client_fd, &header, listing);
+            free(listing);
+            break;
+        }
+        
+        case OP_CREATE: {
+            snprintf(details, sizeof(details), "file=%s folder=%s", 
+                    header.filename, header.foldername[0] ? header.foldername : "/");
+            
+            // Log request received
+            log_operation("NM", "INFO", "CREATE_REQUEST", header.username, client_ip, client_port, details, 0);
+            
+            // Validate filename - reject reserved extensions
+            if (!is_valid_filename(header.filename)) {
+                result_code = ERR_INVALID_FILENAME;
+                log_message("NM", "ERROR", "File creation rejected: Invalid filename (reserved extension)");
+                send_error(client_fd, &header, ERR_INVALID_FILENAME);
                 break;
             }
             
-            case OP_DELETE: {
-                snprintf(details, sizeof(details), "file=%s", header.filename);
-                
-                // Log request received
-                log_operation("NM", "INFO", "DELETE_REQUEST", header.username, client_ip, client_port, details, 0);
-                
-                // Check ownership
-                FileMetadata* file = nm_find_file(header.filename);
-                if (!file) {
-                    result_code = ERR_FILE_NOT_FOUND;
-                    log_message("NM", "ERROR", "Delete failed: File not found");
-                    send_error(client_fd, &header, ERR_FILE_NOT_FOUND);
-                    break;
-                }
-                
-                if (strcmp(file->owner, header.username) != 0) {
-                    result_code = ERR_NOT_OWNER;
+            // Create file - select SS and forward request
+            int ss_id = nm_select_storage_server();
+            if (ss_id < 0) {
+                result_code = ERR_SS_UNAVAILABLE;
+                log_message("NM", "ERROR", "File creation failed: No storage server available");
+                send_error(client_fd, &header, ERR_SS_UNAVAILABLE);
+                break;
+            }
+            
+            StorageServerInfo* ss = nm_find_storage_server(ss_id);
+            if (!ss) {
+                result_code = ERR_SS_UNAVAILABLE;
+                send_error(client_fd, &header, ERR_SS_UNAVAILABLE);
+                break;
+            }
+            
+            char ss_details[512];
+            snprintf(ss_details, sizeof(ss_details), "Forwarding CREATE to SS #%d at %s:%d", 
+                     ss_id, ss->ip, ss->client_port);
+            log_message("NM", "INFO", ss_details);
+            
+            // Forward create request over a pooled connection
+            MessageHeader ss_header = header;
+            ss_header.op_code = OP_SS_CREATE;
+            char* ss_response = NULL;
+            if (ss_pool_request(ss, &ss_header, header.username, &ss_header, &ss_response) != ERR_SUCCESS) {
+                result_code = ERR_SS_UNAVAILABLE;
+                log_message("NM", "ERROR", "Failed to reach storage server");
+                send_error(client_fd, &header, ERR_SS_UNAVAILABLE);
+                break;
+            }
+            
+            result_code = ss_header.error_code;
+            if (ss_header.msg_type == MSG_ACK) {
+                // Register file in NM (with folder path from header). Only a
+                // registration that was refused fails here; one the journal
+                // could not write yet is still applied (see commit_change())
+                result_code = nm_register_file(header.filename, header.foldername, header.username, ss_id);
+                if (result_code != ERR_SUCCESS) {
                     char msg[600];
-                    snprintf(msg, sizeof(msg), "Delete denied: User '%s' not owner of '%s'", 
-                             header.username, header.filename);
-                    log_message("NM", "WARN", msg);
-                    send_error(client_fd, &header, ERR_NOT_OWNER);
-                    break;
-                }
-                
-                // Forward to SS
-                StorageServerInfo* ss = nm_find_storage_server(file->ss_id);
-                if (!ss) {
-                    result_code = ERR_SS_UNAVAILABLE;
-                    log_message("NM", "ERROR", "Delete failed: Storage server unavailable");
-                    send_error(client_fd, &header, ERR_SS_UNAVAILABLE);
-                    break;
-                }
-                
-                char ss_msg[256];
-                snprintf(ss_msg, sizeof(ss_msg), "Forwarding DELETE to SS #%d at %s:%d", 
-                         file->ss_id, ss->ip, ss->client_port);
-                log_message("NM", "INFO", ss_msg);
-                
-                int ss_socket = connect_to_server(ss->ip, ss->client_port);
-                if (ss_socket < 0) {
-                    result_code = ERR_SS_UNAVAILABLE;
-                    log_message("NM", "ERROR", "Failed to connect to storage server");
-                    send_error(client_fd, &header, ERR_SS_UNAVAILABLE);
+                    snprintf(msg, sizeof(msg), "File creation failed: '%s' was created on SS #%d but the registry refused it (error %d)",
+                             header.filename, ss_id, result_code);
+                    log_message("NM", "ERROR", msg);
+                    send_error(client_fd, &header, result_code);
+                    log_operation("NM", "ERROR", "CREATE_RESPONSE", header.username, client_ip, client_port, details, result_code);
+                    if (ss_response) free(ss_response);
                     break;
                 }
+                char tmp[2048];
+                snprintf(tmp, sizeof(tmp), "✓ File '%s' created by '%s' on SS #%d", 
+                         header.filename, header.username, ss_id);
+                log_message("NM", "INFO", tmp);
                 
-                MessageHeader ss_header = header;
-                ss_header.op_code = OP_SS_DELETE;
-                send_message(ss_socket, &ss_header, NULL);
-                
-                char* ss_response;
-                recv_message(ss_socket, &ss_header, &ss_response);
-                close(ss_socket);
-                
-                result_code = ss_header.error_code;
-                if (ss_header.msg_type == MSG_ACK) {
-                    nm_delete_file(header.filename);
-                    char msg[600];
-                    snprintf(msg, sizeof(msg), "✓ File '%s' deleted by '%s' from SS #%d", 
-                             header.filename, header.username, file->ss_id);
-                    log_message("NM", "INFO", msg);
-                }
-                
-                send_message(client_fd, &ss_header, ss_response);
-                
-                // Log response sent
-                log_operation("NM", result_code == ERR_SUCCESS ? "INFO" : "ERROR",
-                             "DELETE_RESPONSE", header.username, client_ip, client_port, details, result_code);
-                
-                if (ss_response) free(ss_response);
+                snprintf(tmp, sizeof(tmp), "%s | SS_ID=%d", details, ss_id);
+                strncpy(details, tmp, sizeof(details) - 1);
+            }
+            
+            send_message(client_fd, &ss_header, ss_response);
+            
+            // Log response sent
+            log_operation("NM", result_code == ERR_SUCCESS ? "INFO" : "ERROR",
+                         "CREATE_RESPONSE", header.username, client_ip, client_port, details, result_code);
+            
+            if (ss_response) free(ss_response);
+            break;
+        }
+        
+        case OP_DELETE: {
+            snprintf(details, sizeof(details), "file=%s", header.filename);
+            
+            // Log request received
+            log_operation("NM", "INFO", "DELETE_REQUEST", header.username, client_ip, client_port, details, 0);
+            
+            // Check ownership
+            FileSnapshot file;
+            if (nm_lookup_file(header.filename, NULL, &file) != ERR_SUCCESS) {
+                result_code = ERR_FILE_NOT_FOUND;
+                log_message("NM", "ERROR", "Delete failed: File not found");
+                send_error(client_fd, &header, ERR_FILE_NOT_FOUND);
                 break;
             }
             
-            case OP_READ:
-            case OP_WRITE:
-            case OP_STREAM:
-            case OP_UNDO: {
-                snprintf(details, sizeof(details), "file=%s", header.filename);
-                
-                // Log request received
-                log_operation("NM", "INFO", operation, header.username, client_ip, client_port, details, 0);
-                
-                // Return SS information for direct connection
-                FileMetadata* file = nm_find_file(header.filename);
-                if (!file) {
-                    result_code = ERR_FILE_NOT_FOUND;
-                    log_message("NM", "ERROR", "Operation failed: File not found");
-                    send_error(client_fd, &header, ERR_FILE_NOT_FOUND);
-                    break;
-                }
-                
-                // Check permission
-                int need_write = (header.op_code == OP_WRITE || header.op_code == OP_UNDO);
-                int perm_result = nm_check_permission(header.filename, header.username, need_write);
-                if (perm_result != ERR_SUCCESS) {
-                    result_code = perm_result;
+            if (strcmp(file.owner, header.username) != 0) {
+                result_code = ERR_NOT_OWNER;
+                char msg[600];
+                snprintf(msg, sizeof(msg), "Delete denied: User '%s' not owner of '%s'", 
+                         header.username, header.filename);
+                log_message("NM", "WARN", msg);
+                send_error(client_fd, &header, ERR_NOT_OWNER);
+                break;
+            }
+            
+            // Forward to SS
+            StorageServerInfo* ss = nm_find_storage_server(file.ss_id);
+            if (!ss) {
+                result_code = ERR_SS_UNAVAILABLE;
+                log_message("NM", "ERROR", "Delete failed: Storage server unavailable");
+                send_error(client_fd, &header, ERR_SS_UNAVAILABLE);
+                break;
+            }
+            
+            char ss_msg[256];
+            snprintf(ss_msg, sizeof(ss_msg), "Forwarding DELETE to SS #%d at %s:%d", 
+                     file.ss_id, ss->ip, ss->client_port);
+            log_message("NM", "INFO", ss_msg);
+            
+            MessageHeader ss_header = header;
+            ss_header.op_code = OP_SS_DELETE;
+            char* ss_response = NULL;
+            if (ss_pool_request(ss, &ss_header, NULL, &ss_header, &ss_response) != ERR_SUCCESS) {
+                result_code = ERR_SS_UNAVAILABLE;
+                log_message("NM", "ERROR", "Failed to reach storage server");
+                send_error(client_fd, &header, ERR_SS_UNAVAILABLE);
+                break;
+            }
+            
+            result_code = ss_header.error_code;
+            if (ss_header.msg_type == MSG_ACK) {
+                result_code = nm_delete_file(header.filename);
+                if (result_code != ERR_SUCCESS) {
                     char msg[600];
-                    snprintf(msg, sizeof(msg), "Permission denied for '%s' on file '%s'", 
-                             header.username, header.filename);
-                    log_message("NM", "WARN", msg);
-                    send_error(client_fd, &header, perm_result);
-                    break;
-                }
-                
-                // Find target Storage Server with Failover support
-                StorageServerInfo* target_ss = get_ss_with_failover(file->ss_id, op_name(header.op_code), header.filename);
-
-                if (!target_ss) {
-                    result_code = ERR_SS_UNAVAILABLE;
-                    log_message("NM", "ERROR", "Storage server unavailable (Primary and Replica both down or not found)");
-                    send_error(client_fd, &header, ERR_SS_UNAVAILABLE);
+                    snprintf(msg, sizeof(msg), "Delete failed: '%s' was deleted on SS #%d but the registry refused it (error %d)",
+                             header.filename, file.ss_id, result_code);
+                    log_message("NM", "ERROR", msg);
+                    send_error(client_fd, &header, result_code);
+                    log_operation("NM", "ERROR", "DELETE_RESPONSE", header.username, client_ip, client_port, details, result_code);
+                    if (ss_response) free(ss_response);
                     break;
                 }
-
-                // Use target_ss for response
-                StorageServerInfo* ss = target_ss;
-                
-                // Send SS info to client
-                result_code = ERR_SUCCESS;
-                char tmp[2048];
-                snprintf(tmp, sizeof(tmp), "%s | SS=#%d at %s:%d", details, file->ss_id, ss->ip, ss->client_port);
-                strncpy(details, tmp, sizeof(details) - 1);
-                
                 char msg[600];
-                snprintf(msg, sizeof(msg), "Directing client '%s' to SS #%d for %s operation on '%s'", 
-                         header.username, file->ss_id, operation, header.filename);
+                snprintf(msg, sizeof(msg), "✓ File '%s' deleted by '%s' from SS #%d", 
+                         header.filename, header.username, file.ss_id);
                 log_message("NM", "INFO", msg);
-                
-                snprintf(response_buf, sizeof(response_buf), "%s:%d", ss->ip, ss->client_port);
-                header.msg_type = MSG_RESPONSE;
-                header.error_code = ERR_SUCCESS;
-                header.data_length = strlen(response_buf);
-                send_message(client_fd, &header, response_buf);
-                
-                // Log response sent
-                log_operation("NM", "INFO", operation, header.username, client_ip, client_port, details, result_code);
+            }
+            
+            send_message(client_fd, &ss_header, ss_response);
+            
+            // Log response sent
+            log_operation("NM", result_code == ERR_SUCCESS ? "INFO" : "ERROR",
+                         "DELETE_RESPONSE", header.username, client_ip, client_port, details, result_code);
+            
+            if (ss_response) free(ss_response);
+            break;
+        }
+        
+        case OP_READ:
+        case OP_WRITE:
+        case OP_STREAM:
+        case OP_UNDO: {
+            snprintf(details, sizeof(details), "file=%s", header.filename);
+            
+            // Log request received
+            log_operation("NM", "INFO", operation, header.username, client_ip, client_port, details, 0);
+            
+            // Return SS information for direct connection
+            FileSnapshot file;
+            int need_write = (header.op_code == OP_WRITE || header.op_code == OP_UNDO);
+            int perm_result = get_file_with_perm(header.filename, header.username, need_write, &file);
+            if (perm_result == ERR_FILE_NOT_FOUND) {
+                result_code = ERR_FILE_NOT_FOUND;
+                log_message("NM", "ERROR", "Operation failed: File not found");
+                send_error(client_fd, &header, ERR_FILE_NOT_FOUND);
                 break;
             }
             
-            case OP_INFO: {
-                // Get file info
-                FileMetadata* file = nm_find_file(header.filename);
-                if (!file) {
-                    send_error(client_fd, &header, ERR_FILE_NOT_FOUND);
-                    break;
-                }
-                
-                // Check permission
-                int perm_result = nm_check_permission(header.filename, header.username, 0);
-                if (perm_result != ERR_SUCCESS) {
-                    send_error(client_fd, &header, perm_result);
-                    break;
-                }
+            // Check permission
+            if (perm_result != ERR_SUCCESS) {
+                result_code = perm_result;
+                char msg[600];
+                snprintf(msg, sizeof(msg), "Permission denied for '%s' on file '%s'", 
+                         header.username, header.filename);
+                log_message("NM", "WARN", msg);
+                send_error(client_fd, &header, perm_result);
+                break;
+            }
+            
+            // Find target Storage Server with Failover support
+            StorageServerInfo* target_ss = get_ss_with_failover(file.ss_id, op_name(header.op_code), header.filename);
 
-                StorageServerInfo* ss = nm_find_storage_server(file->ss_id);
-                if (ss && ss->is_active) {
-                    // Connect to SS and request file info
-                    int ss_socket = connect_to_server(ss->ip, ss->client_port);
-                    if (ss_socket >= 0) {
-                        MessageHeader ss_header;
-                        memset(&ss_header, 0, sizeof(ss_header));
-                        ss_header.msg_type = MSG_REQUEST;
-                        ss_header.op_code = OP_INFO;
-                        strcpy(ss_header.filename, header.filename);
-                        strcpy(ss_header.username, header.username);
-                        ss_header.data_length = 0;
+            if (!target_ss) {
+                result_code = ERR_SS_UNAVAILABLE;
+                log_message("NM", "ERROR", "Storage server unavailable (Primary and Replica both down or not found)");
+                send_error(client_fd, &header, ERR_SS_UNAVAILABLE);
+                break;
+            }
+
+            // Use target_ss for response; reads may go to an idle replica
+            StorageServerInfo* ss = target_ss;
+            if (header.op_code == OP_READ || header.op_code == OP_STREAM) {
+                ss = nm_route_read(target_ss, header.filename);
+            }
+            
+            // Send SS info to client
+            result_code = ERR_SUCCESS;
+            char tmp[2048];
+            snprintf(tmp, sizeof(tmp), "%s | SS=#%d at %s:%d", details, ss->server_id, ss->ip, ss->client_port);
+            strncpy(details, tmp, sizeof(details) - 1);
+            
+            char msg[600];
+            snprintf(msg, sizeof(msg), "Directing client '%s' to SS #%d for %s operation on '%s'", 
+                     header.username, ss->server_id, operation, header.filename);
+            log_message("NM", "INFO", msg);
+            
+            // "ip:port:proto[:local]" - the protocol lets the client skip negotiating
+            // with the SS, and the local address lets a co-located client use its
+            // Unix socket
+            if (ss->local_addr[0]) {
+                snprintf(response_buf, sizeof(response_buf), "%s:%d:%d:%s",
+                         ss->ip, ss->client_port, ss->protocol, ss->local_addr);
+            } else {
+                snprintf(response_buf, sizeof(response_buf), "%s:%d:%d", ss->ip, ss->client_port, ss->protocol);
+            }
+            header.msg_type = MSG_RESPONSE;
+            header.error_code = ERR_SUCCESS;
+            header.data_length = strlen(response_buf);
+            send_message(client_fd, &header, response_buf);
+            
+            // Log response sent
+            log_operation("NM", "INFO", operation, header.username, client_ip, client_port, details, result_code);
+            break;
+        }
+        
+        case OP_INFO: {
+            // Get file info
+            FileSnapshot file;
+            int perm_result = get_file_with_perm(header.filename, header.username, 0, &file);
+            if (perm_result != ERR_SUCCESS) {
+                send_error(client_fd, &header, perm_result);
+                break;
+            }
+
+            StorageServerInfo* ss = nm_find_storage_server(file.ss_id);
+            if (ss && ss->is_active) {
+                // Request file info over a pooled connection
+                MessageHeader ss_header;
+                init_message_header(&ss_header, MSG_REQUEST, OP_INFO, header.username);
+                strcpy(ss_header.filename, header.filename);
+                
+                char* ss_response = NULL;
+                if (ss_pool_request(ss, &ss_header, NULL, &ss_header, &ss_response) == ERR_SUCCESS) {
+                    if (ss_header.msg_type == MSG_RESPONSE && ss_response) {
+                        // Extract size/words/chars for cache update
+                        long size = 0;
+                        int words = 0, chars = 0;
                         
-                        send_message(ss_socket, &ss_header, NULL);
+                        char* size_line = strstr(ss_response, "Size:");
+                        char* words_line = strstr(ss_response, "Words:");
+                        char* chars_line = strstr(ss_response, "Chars:");
                         
-                        char* ss_response = NULL;
-                        recv_message(ss_socket, &ss_header, &ss_response);
-                        close(ss_socket);
+                        if (size_line) sscanf(size_line, "Size: %ld", &size);
+                        if (words_line) sscanf(words_line, "Words: %d", &words);
+                        if (chars_line) sscanf(chars_line, "Chars: %d", &chars);
                         
-                        if (ss_header.msg_type == MSG_RESPONSE && ss_response) {
-                            // Extract size/words/chars for cache update
-                            long size = 0;
-                            int words = 0, chars = 0;
-                            
-                            char* size_line = strstr(ss_response, "Size:");
-                            char* words_line = strstr(ss_response, "Words:");
-                            char* chars_line = strstr(ss_response, "Chars:");
-                            
-                            if (size_line) sscanf(size_line, "Size: %ld", &size);
-                            if (words_line) sscanf(words_line, "Words: %d", &words);
-                            if (chars_line) sscanf(chars_line, "Chars: %d", &chars);
-                            
-                            pthread_mutex_lock(&ns_state.lock);
-                            file->file_size = size;
-                            file->word_count = words;
-                            file->char_count = chars;
-                            file->last_accessed = time(NULL);
-                            pthread_mutex_unlock(&ns_state.lock);
-                            save_state();
-                            
-                            // Append ACL information as separate mini-section
-                            char acl_info[2048];
-                            char acl_entries[1800] = "";
-                            
-                            for (int i = 0; i < file->acl_count; i++) {
-                                char temp[128];
-                                char perms[4] = "";
-                                if (file->acl[i].read_permission && file->acl[i].write_permission) {
-                                    strcpy(perms, "RW");
-                                } else if (file->acl[i].read_permission) {
-                                    strcpy(perms, "R");
-                                } else if (file->acl[i].write_permission) {
-                                    strcpy(perms, "W");
-                                } else {
-                                    strcpy(perms, "-");
-                                }
-                                
-                                // Use └─ for last entry, ├─ for others
-                                const char* branch = (i == file->acl_count - 1) ? "└─" : "├─";
-                                
-                                snprintf(temp, sizeof(temp),
-                                        "  %s%s%s %s%s%s (%s%s%s)\n",
-                                        ANSI_MAGENTA, branch, ANSI_RESET,
-                                        ANSI_BRIGHT_CYAN, file->acl[i].username, ANSI_RESET,
-                                        ANSI_BRIGHT_MAGENTA, perms, ANSI_RESET);
-                                strcat(acl_entries, temp);
-                            }
+                        nm_update_file_stats(header.filename, size, words, chars);
+                        
+                        // Append ACL information as separate mini-section
+                        char acl_info[2048];
+                        nm_format_acl(header.filename, acl_info, sizeof(acl_info));
+                        
+                        // Combine SS response with ACL info
+                        size_t total_len = strlen(ss_response) + strlen(acl_info) + 1;
+                        char* combined_response = (char*)malloc(total_len);
+                        if (combined_response) {
+                            strcpy(combined_response, ss_response);
+                            strcat(combined_response, acl_info);
                             
-                            snprintf(acl_info, sizeof(acl_info),
-                                    "%s%s═══ Access Permissions (%d) ═══%s\n"
-                                    "%s",
-                                    ANSI_BOLD, ANSI_MAGENTA, file->acl_count, ANSI_RESET,
-                                    acl_entries);
+                            header.msg_type = MSG_RESPONSE;
+                            header.error_code = ERR_SUCCESS;
+                            header.data_length = strlen(combined_response);
+                            send_message(client_fd, &header, combined_response);
                             
-                            // Combine SS response with ACL info
-                            size_t total_len = strlen(ss_response) + strlen(acl_info) + 1;
-                            char* combined_response = (char*)malloc(total_len);
-                            if (combined_response) {
-                                strcpy(combined_response, ss_response);
-                                strcat(combined_response, acl_info);
-                                
-                                header.msg_type = MSG_RESPONSE;
-                                header.error_code = ERR_SUCCESS;
-                                header.data_length = strlen(combined_response);
-                                send_message(client_fd, &header, combined_response);
-                                
-                                free(combined_response);
-                                free(ss_response);
-                                break;
-                            }
+                            free(combined_response);
                             free(ss_response);
+                            break;
                         }
+                        free(ss_response);
                     }
                 }
-                
-                // Fallback - SS unavailable
+            }
+            
+            // Fallback - SS unavailable
+            header.msg_type = MSG_ERROR;
+            header.error_code = ERR_SS_UNAVAILABLE;
+            header.data_length = 0;
+            send_message(client_fd, &header, NULL);
+            break;
+        }
+        
+        case OP_ADDACCESS: {
+            // Add access - payload: "username read write"
+            FileSnapshot file;
+            if (nm_lookup_file(header.filename, NULL, &file) != ERR_SUCCESS) {
                 header.msg_type = MSG_ERROR;
-                header.error_code = ERR_SS_UNAVAILABLE;
+                header.error_code = ERR_FILE_NOT_FOUND;
                 header.data_length = 0;
                 send_message(client_fd, &header, NULL);
                 break;
             }
             
-            case OP_ADDACCESS: {
-                // Add access - payload: "username read write"
-                FileMetadata* file = nm_find_file(header.filename);
-                if (!file) {
-                    header.msg_type = MSG_ERROR;
-                    header.error_code = ERR_FILE_NOT_FOUND;
-                    header.data_length = 0;
-                    send_message(client_fd, &header, NULL);
-                    break;
-                }
-                
-                // Check ownership
-                if (strcmp(file->owner, header.username) != 0) {
-                    header.msg_type = MSG_ERROR;
-                    header.error_code = ERR_NOT_OWNER;
-                    header.data_length = 0;
-                    send_message(client_fd, &header, NULL);
-                    break;
-                }
-                
-                char target_user[MAX_USERNAME];
-                int read, write;
-                sscanf(payload, "%s %d %d", target_user, &read, &write);
-                
-                int result = nm_add_access(header.filename, target_user, read, write);
-                
-                header.msg_type = (result == ERR_SUCCESS) ? MSG_ACK : MSG_ERROR;
-                header.error_code = result;
+            // Check ownership
+            if (strcmp(file.owner, header.username) != 0) {
+                header.msg_type = MSG_ERROR;
+                header.error_code = ERR_NOT_OWNER;
                 header.data_length = 0;
                 send_message(client_fd, &header, NULL);
                 break;
             }
             
-            case OP_REMACCESS: {
-                // Remove access
-                FileMetadata* file = nm_find_file(header.filename);
-                if (!file) {
-                    header.msg_type = MSG_ERROR;
-                    header.error_code = ERR_FILE_NOT_FOUND;
-                    header.data_length = 0;
-                    send_message(client_fd, &header, NULL);
-                    break;
-                }
-                
-                // Check ownership
-                if (strcmp(file->owner, header.username) != 0) {
-                    header.msg_type = MSG_ERROR;
-                    header.error_code = ERR_NOT_OWNER;
-                    header.data_length = 0;
-                    send_message(client_fd, &header, NULL);
-                    break;
-                }
-                
-                int result = nm_remove_access(header.filename, payload);
-                
-                header.msg_type = (result == ERR_SUCCESS) ? MSG_ACK : MSG_ERROR;
-                header.error_code = result;
+            char target_user[MAX_USERNAME];
+            int read, write;
+            sscanf(payload, "%s %d %d", target_user, &read, &write);
+            
+            int result = nm_add_access(header.filename, target_user, read, write);
+            
+            header.msg_type = (result == ERR_SUCCESS) ? MSG_ACK : MSG_ERROR;
+            header.error_code = result;
+            header.data_length = 0;
+            send_message(client_fd, &header, NULL);
+            break;
+        }
+        
+        case OP_REMACCESS: {
+            // Remove access
+            FileSnapshot file;
+            if (nm_lookup_file(header.filename, NULL, &file) != ERR_SUCCESS) {
+                header.msg_type = MSG_ERROR;
+                header.error_code = ERR_FILE_NOT_FOUND;
                 header.data_length = 0;
                 send_message(client_fd, &header, NULL);
                 break;
             }
             
-            case OP_CREATEFOLDER: {
-                // Create a new folder
-                int result = nm_create_folder(header.foldername, header.username);
-                
-                header.msg_type = (result == ERR_SUCCESS) ? MSG_ACK : MSG_ERROR;
-                header.error_code = result;
+            // Check ownership
+            if (strcmp(file.owner, header.username) != 0) {
+                header.msg_type = MSG_ERROR;
+                header.error_code = ERR_NOT_OWNER;
                 header.data_length = 0;
                 send_message(client_fd, &header, NULL);
-                
-                if (result == ERR_SUCCESS) {
-                    char msg[BUFFER_SIZE];
-                    snprintf(msg, sizeof(msg), "Created folder '%s'", header.foldername);
-                    log_message("NM", "INFO", msg);
-                }
                 break;
             }
             
-            case OP_MOVE: {
-                // Move file to different folder
-                FileMetadata* file = nm_find_file(header.filename);
-                if (!file) {
-                    header.msg_type = MSG_ERROR;
-                    header.error_code = ERR_FILE_NOT_FOUND;
-                    header.data_length = 0;
-                    send_message(client_fd, &header, NULL);
-                    break;
-                }
-                
-                // Check if user has write permission on the file
-                int perm_result = nm_check_permission(header.filename, header.username, 1);
-                if (perm_result != ERR_SUCCESS) {
-                    header.msg_type = MSG_ERROR;
-                    header.error_code = perm_result;
-                    header.data_length = 0;
-                    send_message(client_fd, &header, NULL);
-                    break;
-                }
-                
-                // Construct the new full path for the file
-                char new_fullpath[MAX_PATH];
-                construct_full_path(new_fullpath, sizeof(new_fullpath), header.foldername, header.filename);
-                
-                // First, move the file physically on the storage server
-                StorageServerInfo* ss = nm_find_storage_server(file->ss_id);
-                if (!ss || !ss->is_active) {
-                    send_error(client_fd, &header, ERR_SS_UNAVAILABLE);
-                    break;
-                }
-                
-                int ss_socket = connect_to_server(ss->ip, ss->client_port);
-                if (ss_socket < 0) {
-                    send_error(client_fd, &header, ERR_SS_UNAVAILABLE);
-                    break;
-                }
-                
-                // Construct the current full path
-                char old_fullpath[MAX_PATH];
-                if (construct_full_path(old_fullpath, sizeof(old_fullpath), file->folder_path, header.filename) < 0) {
-                    send_error(client_fd, &header, ERR_INVALID_PATH);
-                    close(ss_socket);
-                    break;
-                }
-                
-                MessageHeader ss_header;
-                memset(&ss_header, 0, sizeof(ss_header));
-                ss_header.msg_type = MSG_REQUEST;
-                ss_header.op_code = OP_SS_MOVE;
-                strcpy(ss_header.filename, old_fullpath);
-                ss_header.data_length = strlen(new_fullpath);
-                
-                send_message(ss_socket, &ss_header, new_fullpath);
-                
-                char* ss_response;
-                recv_message(ss_socket, &ss_header, &ss_response);
-                close(ss_socket);
-                
-                if (ss_response) free(ss_response);
-                
-                // If storage server move succeeded, update name server metadata
-                int result = ERR_FILE_OPERATION_FAILED;
-                if (ss_header.msg_type == MSG_ACK) {
-                    result = nm_move_file(header.filename, header.foldername);
-                } else {
-                    result = ss_header.error_code;
-                }
-                
-                header.msg_type = (result == ERR_SUCCESS) ? MSG_ACK : MSG_ERROR;
-                header.error_code = result;
+            int result = nm_remove_access(header.filename, payload);
+            
+            header.msg_type = (result == ERR_SUCCESS) ? MSG_ACK : MSG_ERROR;
+            header.error_code = result;
+            header.data_length = 0;
+            send_message(client_fd, &header, NULL);
+            break;
+        }
+        
+        case OP_CREATEFOLDER: {
+            // Create a new folder
+            int result = nm_create_folder(header.foldername, header.username);
+            
+            header.msg_type = (result == ERR_SUCCESS) ? MSG_ACK : MSG_ERROR;
+            header.error_code = result;
+            header.data_length = 0;
+            send_message(client_fd, &header, NULL);
+            
+            if (result == ERR_SUCCESS) {
+                char msg[BUFFER_SIZE];
+                snprintf(msg, sizeof(msg), "Created folder '%s'", header.foldername);
+                log_message("NM", "INFO", msg);
+            }
+            break;
+        }
+        
+        case OP_MOVE: {
+            // Move file to different folder; needs write permission on the file
+            FileSnapshot file;
+            int perm_result = get_file_with_perm(header.filename, header.username, 1, &file);
+            if (perm_result != ERR_SUCCESS) {
+                header.msg_type = MSG_ERROR;
+                header.error_code = perm_result;
                 header.data_length = 0;
                 send_message(client_fd, &header, NULL);
-                
-                if (result == ERR_SUCCESS) {
-                    char msg[BUFFER_SIZE];
-                    snprintf(msg, sizeof(msg), 
-                             "Moved file '%s' to folder '%s'", 
-                             header.filename, header.foldername);
-                    log_message("NM", "INFO", msg);
-                }
                 break;
             }
             
-            case OP_VIEWFOLDER: {
-                // Normalize folder name by removing trailing slash
-                char normalized_folder[MAX_FOLDERNAME];
-                if (header.foldername[0]) {
-                    strncpy(normalized_folder, header.foldername, MAX_FOLDERNAME - 1);
-                    normalized_folder[MAX_FOLDERNAME - 1] = '\0';
-                    
-                    // Remove trailing slash
-                    size_t len = strlen(normalized_folder);
-                    if (len > 0 && normalized_folder[len - 1] == '/') {
-                        normalized_folder[len - 1] = '\0';
-                    }
-                }
-                
-                // List folder contents
-                char folder_contents[BUFFER_SIZE * 2];
-                int result = nm_list_folder_contents(
-                    header.foldername[0] ? normalized_folder : NULL,
-                    header.username,
-                    folder_contents,
-                    sizeof(folder_contents)
-                );
-                
-                if (result == ERR_SUCCESS) {
-                    header.msg_type = MSG_RESPONSE;
-                    header.error_code = ERR_SUCCESS;
-                    header.data_length = strlen(folder_contents);
-                    send_message(client_fd, &header, folder_contents);
-                } else {
-                    header.msg_type = MSG_ERROR;
-                    header.error_code = result;
-                    header.data_length = 0;
-                    send_message(client_fd, &header, NULL);
-                }
+            // Construct the new full path for the file
+            char new_fullpath[MAX_PATH];
+            construct_full_path(new_fullpath, sizeof(new_fullpath), header.foldername, header.filename);
+            
+            // First, move the file physically on the storage server
+            StorageServerInfo* ss = nm_find_storage_server(file.ss_id);
+            if (!ss || !ss->is_active) {
+                send_error(client_fd, &header, ERR_SS_UNAVAILABLE);
                 break;
             }
             
-            case OP_EXEC: {
-                // EXEC operation - executes file content as bash script on Name Server
-                snprintf(details, sizeof(details), "file=%s user=%s", header.filename, header.username);
-                log_operation("NM", "INFO", "EXEC_REQUEST", header.username, client_ip, client_port, details, 0);
-                
-                // Find file in registry
-                FileMetadata* file = nm_find_file(header.filename);
-                if (!file) {
-                    result_code = ERR_FILE_NOT_FOUND;
-                    log_message("NM", "ERROR", "EXEC failed: File not found");
-                    header.msg_type = MSG_ERROR;
-                    header.error_code = ERR_FILE_NOT_FOUND;
-                    header.data_length = 0;
-                    send_message(client_fd, &header, NULL);
-                    break;
-                }
-                
-                // Check read permission (user needs read access to execute)
-                int perm_result = nm_check_permission(header.filename, header.username, 0);
-                if (perm_result != ERR_SUCCESS) {
-                    result_code = perm_result;
-                    char msg[600];
-                    snprintf(msg, sizeof(msg), "EXEC denied: User '%s' lacks read permission on '%s'", 
-                             header.username, header.filename);
-                    log_message("NM", "WARN", msg);
-                    header.msg_type = MSG_ERROR;
-                    header.error_code = perm_result;
-                    header.data_length = 0;
-                    send_message(client_fd, &header, NULL);
-                    break;
-                }
-                
-                // Find storage server hosting the file
-                StorageServerInfo* ss = nm_find_storage_server(file->ss_id);
-                if (!ss || !ss->is_active) {
-                    result_code = ERR_SS_UNAVAILABLE;
-                    log_message("NM", "ERROR", "EXEC failed: Storage server unavailable");
-                    header.msg_type = MSG_ERROR;
-                    header.error_code = ERR_SS_UNAVAILABLE;
-                    header.data_length = 0;
-                    send_message(client_fd, &header, NULL);
-                    break;
-                }
-                
-                // Fetch file content from Storage Server
-                char fetch_msg[512];
-                snprintf(fetch_msg, sizeof(fetch_msg), "Fetching '%s' from SS #%d for execution", 
-                         header.filename, file->ss_id);
-                log_message("NM", "INFO", fetch_msg);
-                
-                int ss_socket = connect_to_server(ss->ip, ss->client_port);
-                if (ss_socket < 0) {
-                    result_code = ERR_SS_UNAVAILABLE;
-                    log_message("NM", "ERROR", "EXEC failed: Cannot connect to storage server");
-                    header.msg_type = MSG_ERROR;
-                    header.error_code = ERR_SS_UNAVAILABLE;
-                    header.data_length = 0;
-                    send_message(client_fd, &header, NULL);
-                    break;
-                }
-                
-                MessageHeader ss_header = header;
-                ss_header.op_code = OP_SS_READ;
-                send_message(ss_socket, &ss_header, NULL);
-                
-                char* file_content;
-                recv_message(ss_socket, &ss_header, &file_content);
-                close(ss_socket);
-                
-                if (ss_header.msg_type != MSG_RESPONSE || !file_content) {
-                    result_code = ERR_FILE_OPERATION_FAILED;
-                    log_message("NM", "ERROR", "EXEC failed: Could not read file from storage server");
-                    header.msg_type = MSG_ERROR;
-                    header.error_code = ERR_FILE_OPERATION_FAILED;
-                    header.data_length = 0;
-                    send_message(client_fd, &header, NULL);
-                    if (file_content) free(file_content);
-                    break;
-                }
-                
-                // Log script content size
-                char content_msg[512];
-                snprintf(content_msg, sizeof(content_msg), 
-                         "⚙ Executing bash script | File: '%s' | User: '%s' | Size: %zu bytes | ON NAME SERVER", 
-                         header.filename, header.username, strlen(file_content));
-                log_message("NM", "INFO", content_msg);
-                
-                // Execute file content as bash script on Name Server
-                // Security note: popen executes in shell context - assumes trusted scripts
-                FILE* pipe = popen(file_content, "r");
-                if (!pipe) {
-                    result_code = ERR_FILE_OPERATION_FAILED;
-                    char err_msg[512];
-                    snprintf(err_msg, sizeof(err_msg), 
-                             "EXEC failed: popen error for '%s' (errno: %d)", 
-                             header.filename, errno);
-                    log_message("NM", "ERROR", err_msg);
-                    
-                    header.msg_type = MSG_ERROR;
-                    header.error_code = ERR_FILE_OPERATION_FAILED;
-                    header.data_length = 0;
-                    send_message(client_fd, &header, NULL);
-                    free(file_content);
-                    break;
-                }
-                
-                // Capture output from script execution
-                char output[BUFFER_SIZE * 4];
-                memset(output, 0, sizeof(output));
-                size_t total = 0;
-                
-                while (total < sizeof(output) - 1 && 
-                       fgets(output + total, sizeof(output) - total, pipe) != NULL) {
-                    total = strlen(output);
+            // Construct the current full path
+            char old_fullpath[MAX_PATH];
+            if (construct_full_path(old_fullpath, sizeof(old_fullpath), file.folder_path, header.filename) < 0) {
+                send_error(client_fd, &header, ERR_INVALID_PATH);
+                break;
+            }
+            
+            MessageHeader ss_header;
+            init_message_header(&ss_header, MSG_REQUEST, OP_SS_MOVE, NULL);
+            strcpy(ss_header.filename, old_fullpath);
+            ss_header.data_length = strlen(new_fullpath);
+            
+            if (ss_pool_request(ss, &ss_header, new_fullpath, &ss_header, NULL) != ERR_SUCCESS) {
+                send_error(client_fd, &header, ERR_SS_UNAVAILABLE);
+                break;
+            }
+            
+            // If storage server move succeeded, update name server metadata
+            int result = ERR_FILE_OPERATION_FAILED;
+            if (ss_header.msg_type == MSG_ACK) {
+                result = nm_move_file(header.filename, header.foldername);
+            } else {
+                result = ss_header.error_code;
+            }
+            
+            header.msg_type = (result == ERR_SUCCESS) ? MSG_ACK : MSG_ERROR;
+            header.error_code = result;
+            header.data_length = 0;
+            send_message(client_fd, &header, NULL);
+            
+            if (result == ERR_SUCCESS) {
+                char msg[BUFFER_SIZE];
+                snprintf(msg, sizeof(msg), 
+                         "Moved file '%s' to folder '%s'", 
+                         header.filename, header.foldername);
+                log_message("NM", "INFO", msg);
+            }
+            break;
+        }
+        
+        case OP_VIEWFOLDER: {
+            // Normalize folder name by removing trailing slash
+            char normalized_folder[MAX_FOLDERNAME];
+            if (header.foldername[0]) {
+                strncpy(normalized_folder, header.foldername, MAX_FOLDERNAME - 1);
+                normalized_folder[MAX_FOLDERNAME - 1] = '\0';
+                
+                // Remove trailing slash
+                size_t len = strlen(normalized_folder);
+                if (len > 0 && normalized_folder[len - 1] == '/') {
+                    normalized_folder[len - 1] = '\0';
                 }
-                
-                int exit_status = pclose(pipe);
-                int exit_code = WEXITSTATUS(exit_status);
-                
-                // Log execution completion
-                char exec_result_msg[512];
-                snprintf(exec_result_msg, sizeof(exec_result_msg), 
-                         "✓ EXEC completed | File: '%s' | User: '%s' | Exit code: %d | Output size: %zu bytes", 
-                         header.filename, header.username, exit_code, strlen(output));
-                log_message("NM", exit_code == 0 ? "INFO" : "WARN", exec_result_msg);
-                
-                // Send output back to client
-                result_code = ERR_SUCCESS;
+            }
+            
+            // List folder contents
+            char folder_contents[BUFFER_SIZE * 2];
+            int result = nm_list_folder_contents(
+                header.foldername[0] ? normalized_folder : NULL,
+                header.username,
+                folder_contents,
+                sizeof(folder_contents)
+            );
+            
+            if (result == ERR_SUCCESS) {
                 header.msg_type = MSG_RESPONSE;
                 header.error_code = ERR_SUCCESS;
-                header.data_length = strlen(output);
-                send_message(client_fd, &header, output);
-                
-                // Log response sent
-                char response_details[1024];
-                snprintf(response_details, sizeof(response_details), 
-                         "file=%s exit_code=%d output_bytes=%zu", 
-                         header.filename, exit_code, strlen(output));
-                log_operation("NM", "INFO", "EXEC_RESPONSE", header.username, 
-                             client_ip, client_port, response_details, ERR_SUCCESS);
+                header.data_length = strlen(folder_contents);
+                send_message(client_fd, &header, folder_contents);
+            } else {
+                header.msg_type = MSG_ERROR;
+                header.error_code = result;
+                header.data_length = 0;
+                send_message(client_fd, &header, NULL);
+            }
+            break;
+        }
+        
+        case OP_EXEC: {
+            // EXEC operation - executes file content as bash script on Name Server
+            snprintf(details, sizeof(details), "file=%s user=%s", header.filename, header.username);
+            log_operation("NM", "INFO", "EXEC_REQUEST", header.username, client_ip, client_port, details, 0);
+            
+            // Find file in registry; user needs read access to execute
+            FileSnapshot file;
+            int perm_result = get_file_with_perm(header.filename, header.username, 0, &file);
+            if (perm_result == ERR_FILE_NOT_FOUND) {
+                result_code = ERR_FILE_NOT_FOUND;
+                log_message("NM", "ERROR", "EXEC failed: File not found");
+                header.msg_type = MSG_ERROR;
+                header.error_code = ERR_FILE_NOT_FOUND;
+                header.data_length = 0;
+                send_message(client_fd, &header, NULL);
+                break;
+            }
+            
+            // Check read permission
+            if (perm_result != ERR_SUCCESS) {
+                result_code = perm_result;
+                char msg[600];
+                snprintf(msg, sizeof(msg), "EXEC denied: User '%s' lacks read permission on '%s'", 
+                         header.username, header.filename);
+                log_message("NM", "WARN", msg);
+                header.msg_type = MSG_ERROR;
+                header.error_code = perm_result;
+                header.data_length = 0;
+                send_message(client_fd, &header, NULL);
+                break;
+            }
+            
+            // Find storage server hosting the file
+            StorageServerInfo* ss = nm_find_storage_server(file.ss_id);
+            if (!ss || !ss->is_active) {
+                result_code = ERR_SS_UNAVAILABLE;
+                log_message("NM", "ERROR", "EXEC failed: Storage server unavailable");
+                header.msg_type = MSG_ERROR;
+                header.error_code = ERR_SS_UNAVAILABLE;
+                header.data_length = 0;
+                send_message(client_fd, &header, NULL);
+                break;
+            }
+            
+            // Fetch file content from Storage Server
+            char fetch_msg[512];
+            snprintf(fetch_msg, sizeof(fetch_msg), "Fetching '%s' from SS #%d for execution", 
+                     header.filename, file.ss_id);
+            log_message("NM", "INFO", fetch_msg);
+            
+            MessageHeader ss_header = header;
+            ss_header.op_code = OP_SS_READ;
+            char* file_content = NULL;
+            if (ss_pool_request(ss, &ss_header, NULL, &ss_header, &file_content) != ERR_SUCCESS) {
+                result_code = ERR_SS_UNAVAILABLE;
+                log_message("NM", "ERROR", "EXEC failed: Cannot reach storage server");
+                header.msg_type = MSG_ERROR;
+                header.error_code = ERR_SS_UNAVAILABLE;
+                header.data_length = 0;
+                send_message(client_fd, &header, NULL);
+                break;
+            }
+            
+            if (ss_header.msg_type != MSG_RESPONSE || !file_content) {
+                result_code = ERR_FILE_OPERATION_FAILED;
+                log_message("NM", "ERROR", "EXEC failed: Could not read file from storage server");
+                header.msg_type = MSG_ERROR;
+                header.error_code = ERR_FILE_OPERATION_FAILED;
+                header.data_length = 0;
+                send_message(client_fd, &header, NULL);
+                if (file_content) free(file_content);
+                break;
+            }
+            
+            // Log script content size
+            char content_msg[512];
+            snprintf(content_msg, sizeof(content_msg), 
+                     "⚙ Executing bash script | File: '%s' | User: '%s' | Size: %zu bytes | ON NAME SERVER", 
+                     header.filename, header.username, strlen(file_content));
+            log_message("NM", "INFO", content_msg);
+            
+            // Execute file content as bash script on Name Server
+            // Security note: popen executes in shell context - assumes trusted scripts
+            FILE* pipe = popen(file_content, "r");
+            if (!pipe) {
+                result_code = ERR_FILE_OPERATION_FAILED;
+                char err_msg[512];
+                snprintf(err_msg, sizeof(err_msg), 
+                         "EXEC failed: popen error for '%s' (errno: %d)", 
+                         header.filename, errno);
+                log_message("NM", "ERROR", err_msg);
                 
+                header.msg_type = MSG_ERROR;
+                header.error_code = ERR_FILE_OPERATION_FAILED;
+                header.data_length = 0;
+                send_message(client_fd, &header, NULL);
                 free(file_content);
                 break;
             }
             
-            case OP_CHECKPOINT: {
-                // Create checkpoint for file
-                FileMetadata* file = nm_find_file(header.filename);
-                if (!file) {
-                    header.msg_type = MSG_ERROR;
-                    header.error_code = ERR_FILE_NOT_FOUND;
-                    header.data_length = 0;
-                    send_message(client_fd, &header, NULL);
-                    break;
-                }
-                
-                // Check write permission (checkpoints require write access)
-                int perm_result = nm_check_permission(header.filename, header.username, 1);
-                if (perm_result != ERR_SUCCESS) {
-                    header.msg_type = MSG_ERROR;
-                    header.error_code = perm_result;
-                    header.data_length = 0;
-                    send_message(client_fd, &header, NULL);
-                    break;
-                }
-                
-                // Forward to storage server
-                StorageServerInfo* ss = nm_find_storage_server(file->ss_id);
-                if (!ss) {
-                    header.msg_type = MSG_ERROR;
-                    header.error_code = ERR_SS_UNAVAILABLE;
-                    header.data_length = 0;
-                    send_message(client_fd, &header, NULL);
-                    break;
-                }
-                
-                int ss_socket = socket(AF_INET, SOCK_STREAM, 0);
-                struct sockaddr_in ss_addr;
-                ss_addr.sin_family = AF_INET;
-                ss_addr.sin_port = htons(ss->client_port);
-                inet_pton(AF_INET, ss->ip, &ss_addr.sin_addr);
-                
-                if (connect(ss_socket, (struct sockaddr*)&ss_addr, sizeof(ss_addr)) < 0) {
-                    header.msg_type = MSG_ERROR;
-                    header.error_code = ERR_SS_UNAVAILABLE;
-                    header.data_length = 0;
-                    send_message(client_fd, &header, NULL);
-                    close(ss_socket);
-                    break;
-                }
-                
-                MessageHeader ss_header = header;
-                ss_header.op_code = OP_SS_CHECKPOINT;
-                send_message(ss_socket, &ss_header, NULL);
-                
-                MessageHeader ss_response;
-                char* ss_payload = NULL;
-                recv_message(ss_socket, &ss_response, &ss_payload);
-                
-                send_message(client_fd, &ss_response, ss_payload);
-                
-                if (ss_response.error_code == ERR_SUCCESS) {
-                    char msg[BUFFER_SIZE];
-                    snprintf(msg, sizeof(msg), 
-                             "Created checkpoint '%s' for file '%s'", 
-                             header.checkpoint_tag, header.filename);
-                    log_message("NM", "INFO", msg);
-                }
-                
-                if (ss_payload) free(ss_payload);
-                close(ss_socket);
+            // Capture output from script execution
+            char output[BUFFER_SIZE * 4];
+            memset(output, 0, sizeof(output));
+            size_t total = 0;
+            
+            while (total < sizeof(output) - 1 && 
+                   fgets(output + total, sizeof(output) - total, pipe) != NULL) {
+                total = strlen(output);
+            }
+            
+            int exit_status = pclose(pipe);
+            int exit_code = WEXITSTATUS(exit_status);
+            
+            // Log execution completion
+            char exec_result_msg[512];
+            snprintf(exec_result_msg, sizeof(exec_result_msg), 
+                     "✓ EXEC completed | File: '%s' | User: '%s' | Exit code: %d | Output size: %zu bytes", 
+                     header.filename, header.username, exit_code, strlen(output));
+            log_message("NM", exit_code == 0 ? "INFO" : "WARN", exec_result_msg);
+            
+            // Send output back to client
+            result_code = ERR_SUCCESS;
+            header.msg_type = MSG_RESPONSE;
+            header.error_code = ERR_SUCCESS;
+            header.data_length = strlen(output);
+            send_message(client_fd, &header, output);
+            
+            // Log response sent
+            char response_details[1024];
+            snprintf(response_details, sizeof(response_details), 
+                     "file=%s exit_code=%d output_bytes=%zu", 
+                     header.filename, exit_code, strlen(output));
+            log_operation("NM", "INFO", "EXEC_RESPONSE", header.username, 
+                         client_ip, client_port, response_details, ERR_SUCCESS);
+            
+            free(file_content);
+            break;
+        }
+        
+        case OP_CHECKPOINT: {
+            // Create checkpoint for file
+            FileSnapshot file;
+            int perm_result = get_file_with_perm(header.filename, header.username, 1, &file);
+            
+            // Checkpoints require write access
+            if (perm_result != ERR_SUCCESS) {
+                header.msg_type = MSG_ERROR;
+                header.error_code = perm_result;
+                header.data_length = 0;
+                send_message(client_fd, &header, NULL);
+                break;
+            }
+            
+            // Forward to storage server
+            StorageServerInfo* ss = nm_find_storage_server(file.ss_id);
+            if (!ss) {
+                header.msg_type = MSG_ERROR;
+                header.error_code = ERR_SS_UNAVAILABLE;
+                header.data_length = 0;
+                send_message(client_fd, &header, NULL);
                 break;
             }
             
-            case OP_VIEWCHECKPOINT: {
-                // View checkpoint content - uses forward helper for read operation
-                result_code = forward_to_ss(client_fd, &header, OP_SS_VIEWCHECKPOINT, 0);
+            MessageHeader ss_header = header;
+            ss_header.op_code = OP_SS_CHECKPOINT;
+            
+            MessageHeader ss_response;
+            char* ss_payload = NULL;
+            if (ss_pool_request(ss, &ss_header, NULL, &ss_response, &ss_payload) != ERR_SUCCESS) {
+                header.msg_type = MSG_ERROR;
+                header.error_code = ERR_SS_UNAVAILABLE;
+                header.data_length = 0;
+                send_message(client_fd, &header, NULL);
                 break;
             }
             
-            case OP_REVERT: {
-                // Revert file to checkpoint
-                FileMetadata* file = nm_find_file(header.filename);
-                if (!file) {
-                    header.msg_type = MSG_ERROR;
-                    header.error_code = ERR_FILE_NOT_FOUND;
-                    header.data_length = 0;
-                    send_message(client_fd, &header, NULL);
-                    break;
-                }
-                
-                // Check write permission
-                int perm_result = nm_check_permission(header.filename, header.username, 1);
-                if (perm_result != ERR_SUCCESS) {
-                    header.msg_type = MSG_ERROR;
-                    header.error_code = perm_result;
-                    header.data_length = 0;
-                    send_message(client_fd, &header, NULL);
-                    break;
-                }
-                
-                // Forward to storage server
-                StorageServerInfo* ss = nm_find_storage_server(file->ss_id);
-                if (!ss) {
-                    header.msg_type = MSG_ERROR;
-                    header.error_code = ERR_SS_UNAVAILABLE;
-                    header.data_length = 0;
-                    send_message(client_fd, &header, NULL);
-                    break;
-                }
-                
-                int ss_socket = socket(AF_INET, SOCK_STREAM, 0);
-                struct sockaddr_in ss_addr;
-                ss_addr.sin_family = AF_INET;
-                ss_addr.sin_port = htons(ss->client_port);
-                inet_pton(AF_INET, ss->ip, &ss_addr.sin_addr);
-                
-                if (connect(ss_socket, (struct sockaddr*)&ss_addr, sizeof(ss_addr)) < 0) {
-                    header.msg_type = MSG_ERROR;
-                    header.error_code = ERR_SS_UNAVAILABLE;
-                    header.data_length = 0;
-                    send_message(client_fd, &header, NULL);
-                    close(ss_socket);
-                    break;
-                }
-                
-                MessageHeader ss_header = header;
-                ss_header.op_code = OP_SS_REVERT;
-                send_message(ss_socket, &ss_header, NULL);
-                
-                MessageHeader ss_response;
-                char* ss_payload = NULL;
-                recv_message(ss_socket, &ss_response, &ss_payload);
-                
-                send_message(client_fd, &ss_response, ss_payload);
-                
-                if (ss_response.error_code == ERR_SUCCESS) {
-                    char msg[BUFFER_SIZE];
-                    snprintf(msg, sizeof(msg), 
-                             "Reverted file '%s' to checkpoint '%s'", 
-                             header.filename, header.checkpoint_tag);
-                    log_message("NM", "INFO", msg);
-                    
-                    // Update file metadata (size, word count, etc.) after revert
-                    file->last_accessed = time(NULL);
-                    save_state();
-                }
-                
-                if (ss_payload) free(ss_payload);
-                close(ss_socket);
-                break;
+            send_message(client_fd, &ss_response, ss_payload);
+            
+            if (ss_response.error_code == ERR_SUCCESS) {
+                char msg[BUFFER_SIZE];
+                snprintf(msg, sizeof(msg), 
+                         "Created checkpoint '%s' for file '%s'", 
+                         header.checkpoint_tag, header.filename);
+                log_message("NM", "INFO", msg);
             }
             
-            case OP_LISTCHECKPOINTS: {
-                // List all checkpoints - uses forward helper for read operation
-                result_code = forward_to_ss(client_fd, &header, OP_SS_LISTCHECKPOINTS, 0);
+            if (ss_payload) free(ss_payload);
+            break;
+        }
+        
+        case OP_VIEWCHECKPOINT: {
+            // View checkpoint content - uses forward helper for read operation
+            result_code = forward_to_ss(client_fd, &header, OP_SS_VIEWCHECKPOINT, 0);
+            break;
+        }
+        
+        case OP_REVERT: {
+            // Revert file to checkpoint
+            FileSnapshot file;
+            int perm_result = get_file_with_perm(header.filename, header.username, 1, &file);
+            
+            // Check write permission
+            if (perm_result != ERR_SUCCESS) {
+                header.msg_type = MSG_ERROR;
+                header.error_code = perm_result;
+                header.data_length = 0;
+                send_message(client_fd, &header, NULL);
                 break;
             }
             
-            case OP_REQUESTACCESS: {
-                // Request access to a file
-                // flags field: bit 0 = read, bit 1 = write
-                int read_flag = (header.flags & 0x01) ? 1 : 0;
-                int write_flag = (header.flags & 0x02) ? 1 : 0;
-                
-                // Determine requested permissions:
-                // - If -W is present (regardless of -R), request both read and write
-                // - If only -R is present, request only read
-                // - If no flags, default to read only
-                int read_requested, write_requested;
-                if (write_flag) {
-                    // -W flag present: grant both read and write
-                    read_requested = 1;
-                    write_requested = 1;
-                } else if (read_flag) {
-                    // Only -R flag present: grant only read
-                    read_requested = 1;
-                    write_requested = 0;
-                } else {
-                    // No flags: default to read only
-                    read_requested = 1;
-                    write_requested = 0;
-                }
-                
-                // First check what access they currently have
-                FileMetadata* file = nm_find_file(header.filename);
-                int current_read = 0, current_write = 0;
-                if (file) {
-                    // Check if owner
-                    if (strcmp(file->owner, header.username) == 0) {
-                        current_read = 1;
-                        current_write = 1;
-                    } else {
-                        // Check ACL
-                        for (int i = 0; i < file->acl_count; i++) {
-                            if (strcmp(file->acl[i].username, header.username) == 0) {
-                                current_read = file->acl[i].read_permission;
-                                current_write = file->acl[i].write_permission;
-                                break;
-                            }
-                        }
-                    }
-                }
-                
-                int result = nm_request_access(header.filename, header.username, read_requested, write_requested);
-                
-                if (result == ERR_SUCCESS) {
-                    header.msg_type = MSG_ACK;
-                    header.error_code = ERR_SUCCESS;
-                    header.data_length = 0;
-                    send_message(client_fd, &header, NULL);
-                    
-                    char perm_str[32];
-                    if (read_requested && write_requested) {
-                        strcpy(perm_str, "read+write");
-                    } else if (write_requested) {
-                        strcpy(perm_str, "write");
-                    } else {
-                        strcpy(perm_str, "read");
-                    }
-                    
-                    char msg[BUFFER_SIZE];
-                    snprintf(msg, sizeof(msg), 
-                             "Requested %s access to file '%s'", 
-                             perm_str, header.filename);
-                    log_message("NM", "INFO", msg);
-                } else if (result == ERR_ALREADY_HAS_ACCESS) {
-                    // Send back what access they have in the flags field
-                    header.msg_type = MSG_ERROR;
-                    header.error_code = result;
-                    header.flags = (current_read ? 0x01 : 0) | (current_write ? 0x02 : 0);
-                    header.data_length = 0;
-                    send_message(client_fd, &header, NULL);
-                } else {
-                    header.msg_type = MSG_ERROR;
-                    header.error_code = result;
-                    header.data_length = 0;
-                    send_message(client_fd, &header, NULL);
-                }
+            // Forward to storage server
+            StorageServerInfo* ss = nm_find_storage_server(file.ss_id);
+            if (!ss) {
+                header.msg_type = MSG_ERROR;
+                header.error_code = ERR_SS_UNAVAILABLE;
+                header.data_length = 0;
+                send_message(client_fd, &header, NULL);
                 break;
             }
             
-            case OP_VIEWREQUESTS: {
-                // View pending requests for a file (owner only)
-                char request_list[BUFFER_SIZE * 2];
-                int result = nm_view_requests(header.filename, header.username, 
-                                             request_list, sizeof(request_list));
-                
-                if (result == ERR_SUCCESS) {
-                    header.msg_type = MSG_RESPONSE;
-                    header.error_code = ERR_SUCCESS;
-                    header.data_length = strlen(request_list);
-                    send_message(client_fd, &header, request_list);
-                } else {
-                    header.msg_type = MSG_ERROR;
-                    header.error_code = result;
-                    header.data_length = 0;
-                    send_message(client_fd, &header, NULL);
-                }
+            MessageHeader ss_header = header;
+            ss_header.op_code = OP_SS_REVERT;
+            
+            MessageHeader ss_response;
+            char* ss_payload = NULL;
+            if (ss_pool_request(ss, &ss_header, NULL, &ss_response, &ss_payload) != ERR_SUCCESS) {
+                header.msg_type = MSG_ERROR;
+                header.error_code = ERR_SS_UNAVAILABLE;
+                header.data_length = 0;
+                send_message(client_fd, &header, NULL);
                 break;
             }
             
-            case OP_APPROVEREQUEST: {
-                // Approve an access request (owner only)
-                // Payload contains the username to approve
-                if (!payload) {
-                    header.msg_type = MSG_ERROR;
-                    header.error_code = ERR_FILE_OPERATION_FAILED;
-                    header.data_length = 0;
-                    send_message(client_fd, &header, NULL);
-                    break;
-                }
+            send_message(client_fd, &ss_response, ss_payload);
+            
+            if (ss_response.error_code == ERR_SUCCESS) {
+                char msg[BUFFER_SIZE];
+                snprintf(msg, sizeof(msg), 
+                         "Reverted file '%s' to checkpoint '%s'", 
+                         header.filename, header.checkpoint_tag);
+                log_message("NM", "INFO", msg);
                 
-                int result = nm_approve_request(header.filename, header.username, payload);
+                // Update file metadata (size, word count, etc.) after revert
+                nm_touch_file(header.filename);
+            }
+            
+            if (ss_payload) free(ss_payload);
+            break;
+        }
+        
+        case OP_LISTCHECKPOINTS: {
+            // List all checkpoints - uses forward helper for read operation
+            result_code = forward_to_ss(client_fd, &header, OP_SS_LISTCHECKPOINTS, 0);
+            break;
+        }
+        
+        case OP_REQUESTACCESS: {
+            // Request access to a file
+            // flags field: bit 0 = read, bit 1 = write
+            int read_flag = (header.flags & 0x01) ? 1 : 0;
+            int write_flag = (header.flags & 0x02) ? 1 : 0;
+            
+            // Determine requested permissions:
+            // - If -W is present (regardless of -R), request both read and write
+            // - If only -R is present, request only read
+            // - If no flags, default to read only
+            int read_requested, write_requested;
+            if (write_flag) {
+                // -W flag present: grant both read and write
+                read_requested = 1;
+                write_requested = 1;
+            } else if (read_flag) {
+                // Only -R flag present: grant only read
+                read_requested = 1;
+                write_requested = 0;
+            } else {
+                // No flags: default to read only
+                read_requested = 1;
+                write_requested = 0;
+            }
+            
+            // First check what access they currently have (owners have all)
+            FileSnapshot file;
+            int current_read = 0, current_write = 0;
+            if (nm_lookup_file(header.filename, header.username, &file) == ERR_SUCCESS) {
+                current_read = file.can_read;
+                current_write = file.can_write;
+            }
+            
+            int result = nm_request_access(header.filename, header.username, read_requested, write_requested);
+            
+            if (result == ERR_SUCCESS) {
+                header.msg_type = MSG_ACK;
+                header.error_code = ERR_SUCCESS;
+                header.data_length = 0;
+                send_message(client_fd, &header, NULL);
                 
-                if (result == ERR_SUCCESS) {
-                    header.msg_type = MSG_ACK;
-                    header.error_code = ERR_SUCCESS;
-                    header.data_length = 0;
-                    send_message(client_fd, &header, NULL);
-                    
-                    char msg[BUFFER_SIZE];
-                    snprintf(msg, sizeof(msg), 
-                             "Approved access request from '%s' for file '%s'", 
-                             payload, header.filename);
-                    log_message("NM", "INFO", msg);
+                char perm_str[32];
+                if (read_requested && write_requested) {
+                    strcpy(perm_str, "read+write");
+                } else if (write_requested) {
+                    strcpy(perm_str, "write");
                 } else {
-                    header.msg_type = MSG_ERROR;
-                    header.error_code = result;
-                    header.data_length = 0;
-                    send_message(client_fd, &header, NULL);
+                    strcpy(perm_str, "read");
                 }
+                
+                char msg[BUFFER_SIZE];
+                snprintf(msg, sizeof(msg), 
+                         "Requested %s access to file '%s'", 
+                         perm_str, header.filename);
+                log_message("NM", "INFO", msg);
+            } else if (result == ERR_ALREADY_HAS_ACCESS) {
+                // Send back what access they have in the flags field
+                header.msg_type = MSG_ERROR;
+                header.error_code = result;
+                header.flags = (current_read ? 0x01 : 0) | (current_write ? 0x02 : 0);
+                header.data_length = 0;
+                send_message(client_fd, &header, NULL);
+            } else {
+                header.msg_type = MSG_ERROR;
+                header.error_code = result;
+                header.data_length = 0;
+                send_message(client_fd, &header, NULL);
+            }
+            break;
+        }
+        
+        case OP_VIEWREQUESTS: {
+            // View pending requests for a file (owner only)
+            char request_list[BUFFER_SIZE * 2];
+            int result = nm_view_requests(header.filename, header.username, 
+                                         request_list, sizeof(request_list));
+            
+            if (result == ERR_SUCCESS) {
+                header.msg_type = MSG_RESPONSE;
+                header.error_code = ERR_SUCCESS;
+                header.data_length = strlen(request_list);
+                send_message(client_fd, &header, request_list);
+            } else {
+                header.msg_type = MSG_ERROR;
+                header.error_code = result;
+                header.data_length = 0;
+                send_message(client_fd, &header, NULL);
+            }
+            break;
+        }
+        
+        case OP_APPROVEREQUEST: {
+            // Approve an access request (owner only)
+            // Payload contains the username to approve
+            if (!payload) {
+                header.msg_type = MSG_ERROR;
+                header.error_code = ERR_FILE_OPERATION_FAILED;
+                header.data_length = 0;
+                send_message(client_fd, &header, NULL);
                 break;
             }
             
-            case OP_DENYREQUEST: {
-                // Deny an access request (owner only)
-                // Payload contains the username to deny
-                if (!payload) {
-                    header.msg_type = MSG_ERROR;
-                    header.error_code = ERR_FILE_OPERATION_FAILED;
-                    header.data_length = 0;
-                    send_message(client_fd, &header, NULL);
-                    break;
-                }
-                
-                int result = nm_deny_request(header.filename, header.username, payload);
+            int result = nm_approve_request(header.filename, header.username, payload);
+            
+            if (result == ERR_SUCCESS) {
+                header.msg_type = MSG_ACK;
+                header.error_code = ERR_SUCCESS;
+                header.data_length = 0;
+                send_message(client_fd, &header, NULL);
                 
-                if (result == ERR_SUCCESS) {
-                    header.msg_type = MSG_ACK;
-                    header.error_code = ERR_SUCCESS;
-                    header.data_length = 0;
-                    send_message(client_fd, &header, NULL);
-                    
-                    char msg[BUFFER_SIZE];
-                    snprintf(msg, sizeof(msg), 
-                             "Denied access request from '%s' for file '%s'", 
-                             payload, header.filename);
-                    log_message("NM", "INFO", msg);
-                } else {
-                    header.msg_type = MSG_ERROR;
-                    header.error_code = result;
-                    header.data_length = 0;
-                    send_message(client_fd, &header, NULL);
-                }
+                char msg[BUFFER_SIZE];
+                snprintf(msg, sizeof(msg), 
+                         "Approved access request from '%s' for file '%s'", 
+                         payload, header.filename);
+                log_message("NM", "INFO", msg);
+            } else {
+                header.msg_type = MSG_ERROR;
+                header.error_code = result;
+                header.data_length = 0;
+                send_message(client_fd, &header, NULL);
+            }
+            break;
+        }
+        
+        case OP_DENYREQUEST: {
+            // Deny an access request (owner only)
+            // Payload contains the username to deny
+            if (!payload) {
+                header.msg_type = MSG_ERROR;
+                header.error_code = ERR_FILE_OPERATION_FAILED;
+                header.data_length = 0;
+                send_message(client_fd, &header, NULL);
                 break;
             }
             
-            case OP_DISCONNECT: {
-                // Mark user as disconnected
-                pthread_mutex_lock(&ns_state.lock);
-                for (int i = 0; i < ns_state.client_count; i++) {
-                    if (strcmp(ns_state.clients[i].username, header.username) == 0) {
-                        ns_state.clients[i].is_connected = 0;
-                        
-                        char msg[256];
-                        snprintf(msg, sizeof(msg), "User '%s' disconnected", header.username);
-                        log_message("NM", "INFO", msg);
-                        break;
-                    }
-                }
-                pthread_mutex_unlock(&ns_state.lock);
-                
+            int result = nm_deny_request(header.filename, header.username, payload);
+            
+            if (result == ERR_SUCCESS) {
                 header.msg_type = MSG_ACK;
                 header.error_code = ERR_SUCCESS;
                 header.data_length = 0;
                 send_message(client_fd, &header, NULL);
+                
+                char msg[BUFFER_SIZE];
+                snprintf(msg, sizeof(msg), 
+                         "Denied access request from '%s' for file '%s'", 
+                         payload, header.filename);
+                log_message("NM", "INFO", msg);
+            } else {
+                header.msg_type = MSG_ERROR;
+                header.error_code = result;
+                header.data_length = 0;
+                send_message(client_fd, &header, NULL);
+            }
+            break;
+        }
+        
+        case OP_DISCONNECT: {
+            // Mark user as disconnected
+            stats_wrlock(&ns_state.lock, STATS_LOCK_NS_STATE);
+            ClientInfo* client = registry_get(&ns_state.clients,
+                                              registry_find(&ns_state.clients, header.username));
+            if (client) {
+                client->is_connected = 0;
+                
+                char msg[256];
+                snprintf(msg, sizeof(msg), "User '%s' disconnected", header.username);
+                log_message("NM", "INFO", msg);
+            }
+            pthread_rwlock_unlock(&ns_state.lock);
+            
+            header.msg_type = MSG_ACK;
+            header.error_code = ERR_SUCCESS;
+            header.data_length = 0;
+            send_message(client_fd, &header, NULL);
+            break;
+        }
+        
+        case OP_STATS: {
+            char* json = nm_stats_reply();
+            if (!json) {
+                send_error(client_fd, &header, ERR_FILE_OPERATION_FAILED);
+                result_code = ERR_FILE_OPERATION_FAILED;
                 break;
             }
+            header.msg_type = MSG_RESPONSE;
+            header.error_code = ERR_SUCCESS;
+            header.data_length = strlen(json);
+            send_message(client_fd, &header, json);
+            free(json);
+            break;
+        }
+        
+        case OP_HELLO: {
+            // Wire protocol negotiation; replies mirror the request framing
+            int version = answer_protocol_hello(client_fd, &header, payload);
+            snprintf(details, sizeof(details), "protocol=v%d", version);
+            break;
+        }
+        
+        case OP_HEARTBEAT: {
+            // Storage server heartbeat - update last_heartbeat timestamp and
+            // the load report it carries. Heartbeats arrive on one long-lived
+            // connection per server, remembered so its closing can be acted on.
+            int ss_id = header.flags;  // Server ID passed in flags field
             
-            case OP_HEARTBEAT: {
-                // Storage server heartbeat - update last_heartbeat timestamp
-                int ss_id = header.flags;  // Server ID passed in flags field
-                
-                char payload[256] = "";
+            char reply[256] = "";
 
-                pthread_mutex_lock(&ns_state.lock);
-                int found = 0;
-                for (int i = 0; i < ns_state.ss_count; i++) {
-                    if (ns_state.storage_servers[i].server_id == ss_id) {
-                        // Check if server was previously inactive (Recovery Detect)
-                        if (!ns_state.storage_servers[i].is_active) {
-                            ns_state.storage_servers[i].is_active = 1;
-                            
-                            char rec_msg[256];
-                            snprintf(rec_msg, sizeof(rec_msg), 
-                                     "✓ Heartbeat RESUMED from Storage Server #%d | IP=%s | Sync state: ACTIVE", 
-                                     ss_id, ns_state.storage_servers[i].ip);
-                            log_message("NM", "INFO", rec_msg);
-                        }
+            stats_wrlock(&ns_state.lock, STATS_LOCK_NS_STATE);
+            int found = 0;
+            for (int i = 0; i < ns_state.ss_count; i++) {
+                if (ns_state.storage_servers[i].server_id == ss_id) {
+                    // Check if server was previously inactive (Recovery Detect)
+                    if (!ns_state.storage_servers[i].is_active) {
+                        ns_state.storage_servers[i].is_active = 1;
                         
-                        ns_state.storage_servers[i].last_heartbeat = time(NULL);
-                        found = 1;
+                        char rec_msg[256];
+                        snprintf(rec_msg, sizeof(rec_msg), 
+                                 "✓ Heartbeat RESUMED from Storage Server #%d | IP=%s | Sync state: ACTIVE", 
+                                 ss_id, ns_state.storage_servers[i].ip);
+                        log_message("NM", "INFO", rec_msg);
+                    }
+                    
+                    ns_state.storage_servers[i].last_heartbeat = time(NULL);
+                    ns_state.storage_servers[i].heartbeat_fd = client_fd;
+                    nm_record_ss_load(&ns_state.storage_servers[i], payload);
+                    session->heartbeat_ss = ss_id;
+                    found = 1;
 
-                        // Check and append Replica Info if active
-                        if (ns_state.storage_servers[i].replica_active) {
-                             int replica_id = ns_state.storage_servers[i].replica_id;
-                             for (int j = 0; j < ns_state.ss_count; j++) {
-                                 if (ns_state.storage_servers[j].server_id == replica_id &&
-                                     ns_state.storage_servers[j].is_active) {
-                                     snprintf(payload, sizeof(payload), "REPLICA %s %d", 
-                                              ns_state.storage_servers[j].ip, 
-                                              ns_state.storage_servers[j].client_port);
-                                     break;
-                                 }
+                    // Check and append Replica Info if active
+                    if (ns_state.storage_servers[i].replica_active) {
+                         int replica_id = ns_state.storage_servers[i].replica_id;
+                         for (int j = 0; j < ns_state.ss_count; j++) {
+                             if (ns_state.storage_servers[j].server_id == replica_id &&
+                                 ns_state.storage_servers[j].is_active) {
+                                 snprintf(reply, sizeof(reply), "REPLICA %s %d %d %s", 
+                                          ns_state.storage_servers[j].ip, 
+                                          ns_state.storage_servers[j].client_port,
+                                          ns_state.storage_servers[j].protocol,
+                                          ns_state.storage_servers[j].local_addr);
+                                 break;
                              }
-                        }
-                        break;
+                         }
                     }
+                    break;
                 }
-                pthread_mutex_unlock(&ns_state.lock);
-                
-                // Send acknowledgment with payload (if any)
-                header.msg_type = MSG_ACK;
-                header.error_code = found ? ERR_SUCCESS : ERR_SS_UNAVAILABLE;
-                header.data_length = strlen(payload);
-                send_message(client_fd, &header, payload);
-                
-                result_code = header.error_code;
-                snprintf(details, sizeof(details), "SS_ID=%d", ss_id);
-                break;
             }
+            if (found) {
+                nm_publish_ss_routes();  // New load report, maybe revived
+            }
+            pthread_rwlock_unlock(&ns_state.lock);
             
-            default:
-                header.msg_type = MSG_ERROR;
-                header.error_code = ERR_INVALID_COMMAND;
-                header.data_length = 0;
-                send_message(client_fd, &header, NULL);
-                result_code = ERR_INVALID_COMMAND;
-                snprintf(details, sizeof(details), "Invalid operation code");
-                break;
-        }
-        
-        // Log the completed operation (SKIP healthy heartbeats to avoid spam)
-        if (header.op_code != OP_HEARTBEAT || result_code != ERR_SUCCESS) {
-            log_operation("NM", result_code == ERR_SUCCESS ? "INFO" : "ERROR",
-                         operation, header.username[0] ? header.username : connected_username, 
-                         client_ip, client_port, details, result_code);
+            // Send acknowledgment with replica info (if any)
+            header.msg_type = MSG_ACK;
+            header.error_code = found ? ERR_SUCCESS : ERR_SS_UNAVAILABLE;
+            header.data_length = strlen(reply);
+            send_message(client_fd, &header, reply);
+            
+            result_code = header.error_code;
+            snprintf(details, sizeof(details), "SS_ID=%d", ss_id);
+            break;
         }
         
-        if (payload) {
-            free(payload);
-            payload = NULL;
+        default:
+            header.msg_type = MSG_ERROR;
+            header.error_code = ERR_INVALID_COMMAND;
+            header.data_length = 0;
+            send_message(client_fd, &header, NULL);
+            result_code = ERR_INVALID_COMMAND;
+            snprintf(details, sizeof(details), "Invalid operation code");
+            break;
+    }
+    
+    struct timespec op_end;
+    clock_gettime(CLOCK_MONOTONIC, &op_end);
+    stats_record_op(header.op_code, operation,
+                    (op_end.tv_sec - op_start.tv_sec) * 1e6 +
+                    (op_end.tv_nsec - op_start.tv_nsec) / 1e3, result_code);
+    
+    // Log the completed operation (SKIP healthy heartbeats to avoid spam)
+    if (header.op_code != OP_HEARTBEAT || result_code != ERR_SUCCESS) {
+        log_operation("NM", result_code == ERR_SUCCESS ? "INFO" : "ERROR",
+                     operation, header.username[0] ? header.username : connected_username, 
+                     client_ip, client_port, details, result_code);
+    }
+}
+
+/**
+ * nm_session_close
+ * @brief Tear down a session once its peer has disconnected.
+ *
+ * Marks the session's user as disconnected and closes the socket. If the
+ * session was a storage server's heartbeat channel, the server is marked
+ * inactive at once: it only closes that channel when it goes down, so there
+ * is no point waiting for the heartbeat timeout before failing over.
+ *
+ * @param session Session to close.
+ */
+void nm_session_close(NMSession* session) {
+    const char* connected_username = session->username;
+    
+    if (session->heartbeat_ss >= 0) {
+        stats_wrlock(&ns_state.lock, STATS_LOCK_NS_STATE);
+        for (int i = 0; i < ns_state.ss_count; i++) {
+            StorageServerInfo* ss = &ns_state.storage_servers[i];
+            // A newer channel may already have replaced this one
+            if (ss->server_id != session->heartbeat_ss || ss->heartbeat_fd != session->fd) {
+                continue;
+            }
+            ss->heartbeat_fd = -1;
+            ss->load_time = 0;
+            if (ss->is_active) {
+                ss->is_active = 0;
+                
+                char msg[512];
+                snprintf(msg, sizeof(msg),
+                         "✗ Storage Server #%d connection LOST (heartbeat channel closed) | IP=%s | Client_Port=%d",
+                         ss->server_id, ss->ip, ss->client_port);
+                log_message("NM", "WARN", msg);
+                
+                // Pooled sockets to a dead server are useless; drop them now
+                ss_pool_invalidate(ss);
+            }
+            nm_publish_ss_routes();
+            break;
         }
+        pthread_rwlock_unlock(&ns_state.lock);
     }
     
     // Mark user as disconnected when connection closes
     if (connected_username[0] != '\0') {
-        pthread_mutex_lock(&ns_state.lock);
-        for (int i = 0; i < ns_state.client_count; i++) {
-            if (strcmp(ns_state.clients[i].username, connected_username) == 0) {
-                ns_state.clients[i].is_connected = 0;
-                
-                char msg[256];
-                snprintf(msg, sizeof(msg), "User '%s' connection closed", connected_username);
-                log_message("NM", "INFO", msg);
-                break;
-            }
+        stats_wrlock(&ns_state.lock, STATS_LOCK_NS_STATE);
+        ClientInfo* client = registry_get(&ns_state.clients,
+                                          registry_find(&ns_state.clients, connected_username));
+        if (client) {
+            client->is_connected = 0;
+            
+            char msg[256];
+            snprintf(msg, sizeof(msg), "User '%s' connection closed", connected_username);
+            log_message("NM", "INFO", msg);
         }
-        pthread_mutex_unlock(&ns_state.lock);
+        pthread_rwlock_unlock(&ns_state.lock);
     }
     
-    close(client_fd);
-    return NULL;
+    close(session->fd);
+    session->fd = -1;
 }
 
 /**
@@ -1461,21 +1569,15 @@ void* handle_ss_connection(void* arg) {
     free(arg);
     
     // Get SS IP and port for tracking
-    struct sockaddr_in ss_addr;
-    socklen_t addr_len = sizeof(ss_addr);
     char ss_ip[MAX_IP] = "unknown";
     int ss_port = 0;
-    
-    if (getpeername(ss_fd, (struct sockaddr*)&ss_addr, &addr_len) == 0) {
-        inet_ntop(AF_INET, &ss_addr.sin_addr, ss_ip, sizeof(ss_ip));
-        ss_port = ntohs(ss_addr.sin_port);
-    }
+    get_peer_address(ss_fd, ss_ip, sizeof(ss_ip), &ss_port);
     
     // Find which SS this is by matching IP
     int ss_id = -1;
     char ss_info[256] = "";
     
-    pthread_mutex_lock(&ns_state.lock);
+    stats_rdlock(&ns_state.lock, STATS_LOCK_NS_STATE_READ);
     for (int i = 0; i < ns_state.ss_count; i++) {
         if (strcmp(ns_state.storage_servers[i].ip, ss_ip) == 0) {
             ss_id = ns_state.storage_servers[i].server_id;
@@ -1484,7 +1586,7 @@ void* handle_ss_connection(void* arg) {
             break;
         }
     }
-    pthread_mutex_unlock(&ns_state.lock);
+    pthread_rwlock_unlock(&ns_state.lock);
     
     // Log SS connection established
     if (ss_id >= 0) {
@@ -1497,11 +1599,13 @@ void* handle_ss_connection(void* arg) {
     // Handle heartbeats and other SS messages
     MessageHeader header;
     char* payload = NULL;
+    RecvBuffer recv_buf;
+    recv_buffer_init(&recv_buf);
     
-    while (recv_message(ss_fd, &header, &payload) > 0) {
+    while (recv_message_into(ss_fd, &header, &recv_buf, &payload) > 0) {
         if (header.op_code == OP_HEARTBEAT) {
             // Update last heartbeat time
-            pthread_mutex_lock(&ns_state.lock);
+            stats_wrlock(&ns_state.lock, STATS_LOCK_NS_STATE);
             for (int i = 0; i < ns_state.ss_count; i++) {
                 if (ns_state.storage_servers[i].server_id == ss_id) {
                     ns_state.storage_servers[i].last_heartbeat = time(NULL);
@@ -1513,21 +1617,17 @@ void* handle_ss_connection(void* arg) {
                     break;
                 }
             }
-            pthread_mutex_unlock(&ns_state.lock);
+            pthread_rwlock_unlock(&ns_state.lock);
             
             header.msg_type = MSG_ACK;
             send_message(ss_fd, &header, NULL);
         }
-        
-        if (payload) {
-            free(payload);
-            payload = NULL;
-        }
     }
+    recv_buffer_free(&recv_buf);
     
     // Storage Server disconnected - log it and mark as inactive
     if (ss_id >= 0) {
-        pthread_mutex_lock(&ns_state.lock);
+        stats_wrlock(&ns_state.lock, STATS_LOCK_NS_STATE);
         for (int i = 0; i < ns_state.ss_count; i++) {
             if (ns_state.storage_servers[i].server_id == ss_id) {
                 int was_active = ns_state.storage_servers[i].is_active;
@@ -1549,10 +1649,11 @@ void* handle_ss_connection(void* arg) {
                     log_operation("NM", "WARN", "SS_DISCONNECT", "system", 
                                  ss_ip, ss_port, details, ERR_SUCCESS);
                 }
+                nm_publish_ss_routes();
                 break;
             }
         }
-        pthread_mutex_unlock(&ns_state.lock);
+        pthread_rwlock_unlock(&ns_state.lock);
     } else {
         // Unknown SS disconnected
         char msg[512];
@@ -0,0 +1,543 @@
+/**
+ * journal.c - Write-ahead journal of Name Server metadata changes
+ *
+ * Every change to the registry (a file created, moved or deleted, an ACL
+ * entry, a folder, an access request) is appended to <dir>/nm_journal.<gen>
+ * as one self-contained record instead of rewriting the whole state file,
+ * so a change costs the same however many files there are. The full state
+ * is written only when the journal is compacted into a new snapshot (see
+ * save_state()), once it has grown as large as the snapshot itself.
+ *
+ * Records are appended to a memory buffer under the lock that guarded the
+ * change, so the journal holds changes in the order they were made. A
+ * handler calls journal_commit() before acknowledging its change: the first
+ * waiter writes every buffered record with one write() and, under
+ * JOURNAL_SYNC_ALWAYS, one fdatasync(), while waiters arriving meanwhile
+ * queue up and share the next batch (group commit). Under JOURNAL_SYNC_BATCH
+ * a commit waits only for the write and a background thread syncs every
+ * NM_JOURNAL_SYNC_MS; under JOURNAL_SYNC_NONE syncing is left to the kernel.
+ * The same thread writes out records nobody commits (cached file stats) and
+ * starts compaction.
+ *
+ * On disk a record is a header line "<type> <length> <checksum>\n" followed
+ * by <length> bytes of payload. Replay stops at the first record that is
+ * cut short or fails its checksum, i.e. one torn by a crash mid-write, and
+ * truncates the file there.
+ *
+ * If a write fails, its records are kept and the file is not written again:
+ * commits fail until journal_rotate() moves the records to a new file.
+ */
+
+#include "common.h"
+#include "name_server.h"
+
+typedef struct {
+    char* data;
+    size_t len;
+    size_t cap;
+} JournalBuffer;
+
+static struct {
+    pthread_mutex_t lock;
+    pthread_cond_t flushed;    // A flush finished (or failed)
+    pthread_cond_t wake;       // journal_close() is stopping the flusher
+    char dir[MAX_PATH];
+    int fd;                    // -1 while closed
+    JournalSyncPolicy policy;
+    void (*compact)(void);
+    JournalBuffer pending;     // Appended, not yet handed to a flush
+    JournalBuffer spare;       // Being written by the current flush
+    long appended_lsn;         // Last record appended
+    long written_lsn;          // Last record written to the file
+    long synced_lsn;           // Last record known to be on disk
+    int flushing;              // A flush is doing I/O without the lock
+    int failed;                // The current file hit a write error
+    long snapshot_bytes;       // Size of the last snapshot
+    int running;
+    pthread_t flusher;
+    JournalStats stats;
+} journal = {
+    .lock = PTHREAD_MUTEX_INITIALIZER,
+    .flushed = PTHREAD_COND_INITIALIZER,
+    .wake = PTHREAD_COND_INITIALIZER,
+    .fd = -1,
+};
+
+static const char* policy_names[] = { "always", "batch", "none" };
+
+/**
+ * journal_parse_policy
+ * @brief Parse a sync policy name: "always", "batch" or "none".
+ *
+ * @param name Name to parse.
+ * @param policy Set on success.
+ * @return ERR_SUCCESS, or ERR_INVALID_COMMAND for an unknown name.
+ */
+int journal_parse_policy(const char* name, JournalSyncPolicy* policy) {
+    for (int i = 0; i < (int)(sizeof(policy_names) / sizeof(policy_names[0])); i++) {
+        if (strcmp(name, policy_names[i]) == 0) {
+            *policy = (JournalSyncPolicy)i;
+            return ERR_SUCCESS;
+        }
+    }
+    return ERR_INVALID_COMMAND;
+}
+
+/**
+ * journal_policy_name
+ * @brief Name of a sync policy, as accepted by journal_parse_policy().
+ */
+const char* journal_policy_name(JournalSyncPolicy policy) {
+    return policy_names[policy];
+}
+
+// FNV-1a over a record's payload
+static unsigned int checksum(const char* data, size_t len) {
+    unsigned int hash = 2166136261u;
+    for (size_t i = 0; i < len; i++) {
+        hash = (hash ^ (unsigned char)data[i]) * 16777619u;
+    }
+    return hash;
+}
+
+static void journal_path(char* path, size_t size, const char* dir, int generation) {
+    snprintf(path, size, "%s/nm_journal.%d", dir, generation);
+}
+
+static int buffer_append(JournalBuffer* buf, const char* data, size_t len) {
+    if (buf->len + len > buf->cap) {
+        size_t cap = buf->cap ? buf->cap : BUFFER_SIZE;
+        while (cap < buf->len + len) {
+            cap *= 2;
+        }
+        char* grown = realloc(buf->data, cap);
+        if (!grown) {
+            return ERR_FILE_OPERATION_FAILED;
+        }
+        buf->data = grown;
+        buf->cap = cap;
+    }
+    memcpy(buf->data + buf->len, data, len);
+    buf->len += len;
+    return ERR_SUCCESS;
+}
+
+static int write_all(int fd, const char* data, size_t len) {
+    while (len > 0) {
+        ssize_t n = write(fd, data, len);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return -1;
+        }
+        data += n;
+        len -= n;
+    }
+    return 0;
+}
+
+/**
+ * journal_sync_dir
+ * @brief fsync a directory, making files created or renamed in it durable.
+ *
+ * @param dir Directory path.
+ * @return ERR_SUCCESS, or ERR_FILE_OPERATION_FAILED.
+ */
+int journal_sync_dir(const char* dir) {
+    int fd = open(dir, O_RDONLY);
+    if (fd < 0) {
+        return ERR_FILE_OPERATION_FAILED;
+    }
+    int result = fsync(fd) == 0 ? ERR_SUCCESS : ERR_FILE_OPERATION_FAILED;
+    close(fd);
+    return result;
+}
+
+// Write every pending record and, if `sync`, fdatasync the file. Called with
+// journal.lock held and no flush in progress; the lock is dropped during the
+// I/O, so appends carry on into the other buffer.
+static int flush_locked(int sync) {
+    long target = journal.appended_lsn;
+    if (journal.failed) {
+        return ERR_FILE_OPERATION_FAILED;
+    }
+    if (journal.written_lsn == target && (!sync || journal.synced_lsn == target)) {
+        return ERR_SUCCESS;
+    }
+
+    JournalBuffer batch = journal.pending;
+    journal.pending = journal.spare;
+    journal.pending.len = 0;
+    journal.flushing = 1;
+    int fd = journal.fd;
+    pthread_mutex_unlock(&journal.lock);
+
+    int ok = write_all(fd, batch.data, batch.len) == 0 && (!sync || fdatasync(fd) == 0);
+
+    pthread_mutex_lock(&journal.lock);
+    journal.flushing = 0;
+    if (ok) {
+        journal.written_lsn = target;
+        if (sync) {
+            journal.synced_lsn = target;
+            journal.stats.syncs++;
+        }
+        if (batch.len > 0) {
+            journal.stats.writes++;
+            journal.stats.file_bytes += batch.len;
+        }
+        batch.len = 0;
+        journal.spare = batch;
+    } else {
+        // Keep the batch, ahead of anything appended since, for the next file
+        if (buffer_append(&batch, journal.pending.data, journal.pending.len) != ERR_SUCCESS) {
+            log_message("NM", "ERROR", "Out of memory keeping unwritten journal records");
+        }
+        journal.spare = journal.pending;
+        journal.spare.len = 0;
+        journal.pending = batch;
+        if (!journal.failed) {
+            log_message("NM", "ERROR", "Journal write failed; changes are not durable until the next snapshot");
+        }
+        journal.failed = 1;
+    }
+    pthread_cond_broadcast(&journal.flushed);
+    return ok ? ERR_SUCCESS : ERR_FILE_OPERATION_FAILED;
+}
+
+// Background thread: writes (and under the batch policy syncs) records
+// nobody is waiting for, and compacts once the journal outgrows the
+// snapshot, or after a write failure
+static void* flusher_main(void* arg) {
+    (void)arg;
+    time_t last_failed_compact = 0;
+
+    pthread_mutex_lock(&journal.lock);
+    while (journal.running) {
+        struct timespec deadline;
+        clock_gettime(CLOCK_REALTIME, &deadline);
+        deadline.tv_nsec += NM_JOURNAL_SYNC_MS * 1000000L;
+        if (deadline.tv_nsec >= 1000000000L) {
+            deadline.tv_sec++;
+            deadline.tv_nsec -= 1000000000L;
+        }
+        pthread_cond_timedwait(&journal.wake, &journal.lock, &deadline);
+        if (!journal.running) {
+            break;
+        }
+
+        if (!journal.flushing) {
+            flush_locked(journal.policy != JOURNAL_SYNC_NONE);
+        }
+
+        long threshold = journal.snapshot_bytes > NM_JOURNAL_COMPACT_BYTES
+                             ? journal.snapshot_bytes : NM_JOURNAL_COMPACT_BYTES;
+        int compact = journal.stats.file_bytes >= threshold;
+        if (journal.failed) {
+            // Retry at most once a second while the disk keeps failing
+            time_t now = time(NULL);
+            compact = now != last_failed_compact;
+            last_failed_compact = now;
+        }
+        if (compact && journal.compact) {
+            pthread_mutex_unlock(&journal.lock);
+            journal.compact();
+            pthread_mutex_lock(&journal.lock);
+        }
+    }
+    pthread_mutex_unlock(&journal.lock);
+    return NULL;
+}
+
+/**
+ * journal_open
+ * @brief Start appending to <dir>/nm_journal.<generation>.
+ *
+ * @param dir Directory of the journal files.
+ * @param generation Journal to append to, normally the last one replayed.
+ * @param policy When commits count as durable.
+ * @param compact Writes a snapshot and calls journal_rotate(); run on the
+ *        flusher thread when the journal grows too large. May be NULL.
+ * @return ERR_SUCCESS, or ERR_FILE_OPERATION_FAILED.
+ */
+int journal_open(const char* dir, int generation, JournalSyncPolicy policy,
+                 void (*compact)(void)) {
+    char path[MAX_PATH + 32];
+    journal_path(path, sizeof(path), dir, generation);
+    int fd = open(path, O_WRONLY | O_CREAT | O_APPEND, 0644);
+    if (fd < 0) {
+        return ERR_FILE_OPERATION_FAILED;
+    }
+    journal_sync_dir(dir);
+
+    pthread_mutex_lock(&journal.lock);
+    safe_strncpy(journal.dir, dir, sizeof(journal.dir));
+    journal.fd = fd;
+    journal.policy = policy;
+    journal.compact = compact;
+    journal.failed = 0;
+    journal.written_lsn = journal.synced_lsn = journal.appended_lsn;
+    memset(&journal.stats, 0, sizeof(journal.stats));
+    journal.stats.generation = generation;
+    journal.stats.file_bytes = lseek(fd, 0, SEEK_END);
+    journal.running = 1;
+    pthread_mutex_unlock(&journal.lock);
+
+    if (pthread_create(&journal.flusher, NULL, flusher_main, NULL) != 0) {
+        journal_close();
+        return ERR_FILE_OPERATION_FAILED;
+    }
+    return ERR_SUCCESS;
+}
+
+/**
+ * journal_append
+ * @brief Buffer one record. Call while still holding the lock that guarded
+ *        the change, so records stay in the order changes were made.
+ *
+ * @param type Record type, interpreted by the caller on replay.
+ * @param payload Record contents.
+ * @param len Length of payload.
+ * @return Sequence number to pass to journal_commit(); 0 if the journal is
+ *         not open (nothing to wait for), -1 if out of memory.
+ */
+long journal_append(char type, const char* payload, size_t len) {
+    char header[64];
+    int header_len = snprintf(header, sizeof(header), "%c %zu %08x\n",
+                              type, len, checksum(payload, len));
+
+    pthread_mutex_lock(&journal.lock);
+    if (journal.fd < 0) {
+        pthread_mutex_unlock(&journal.lock);
+        return 0;
+    }
+    size_t mark = journal.pending.len;
+    if (buffer_append(&journal.pending, header, header_len) != ERR_SUCCESS ||
+        buffer_append(&journal.pending, payload, len) != ERR_SUCCESS) {
+        journal.pending.len = mark;
+        pthread_mutex_unlock(&journal.lock);
+        return -1;
+    }
+    long lsn = ++journal.appended_lsn;
+    journal.stats.records++;
+    pthread_mutex_unlock(&journal.lock);
+    return lsn;
+}
+
+/**
+ * journal_commit
+ * @brief Wait until a record, and every record before it, is durable under
+ *        the sync policy. Callers must not hold ns_state.lock or a stripe.
+ *
+ * @param lsn Value returned by journal_append().
+ * @return ERR_SUCCESS, or ERR_FILE_OPERATION_FAILED if the record could not
+ *         be written (it is kept, and written after the next rotation).
+ */
+int journal_commit(long lsn) {
+    pthread_mutex_lock(&journal.lock);
+    journal.stats.commits++;
+    if (lsn < 0) {
+        journal.stats.failed_commits++;
+        pthread_mutex_unlock(&journal.lock);
+        return ERR_FILE_OPERATION_FAILED;
+    }
+    int sync = journal.policy == JOURNAL_SYNC_ALWAYS;
+    int result = ERR_SUCCESS;
+    while ((sync ? journal.synced_lsn : journal.written_lsn) < lsn) {
+        if (journal.failed) {
+            journal.stats.failed_commits++;
+            result = ERR_FILE_OPERATION_FAILED;
+            break;
+        }
+        if (journal.flushing) {
+            // Our record may be in this batch; if not, we lead the next one
+            pthread_cond_wait(&journal.flushed, &journal.lock);
+        } else {
+            flush_locked(sync);
+        }
+    }
+    pthread_mutex_unlock(&journal.lock);
+    return result;
+}
+
+/**
+ * journal_rotate
+ * @brief Switch to a new journal file, before writing a snapshot.
+ *
+ * Records appended before the switch are in the state the snapshot is then
+ * taken from; records still buffered go to the new file, and replaying
+ * them over the snapshot is harmless (replay is idempotent). A failed file
+ * is abandoned here.
+ *
+ * @return Generation of the new journal, which the snapshot must name, or
+ *         -1 if it could not be created (appends continue to the old one).
+ */
+int journal_rotate(void) {
+    pthread_mutex_lock(&journal.lock);
+    while (journal.flushing) {
+        pthread_cond_wait(&journal.flushed, &journal.lock);
+    }
+    if (journal.fd < 0) {
+        pthread_mutex_unlock(&journal.lock);
+        return -1;
+    }
+
+    int generation = journal.stats.generation + 1;
+    char path[MAX_PATH + 32];
+    journal_path(path, sizeof(path), journal.dir, generation);
+    int fd = open(path, O_WRONLY | O_CREAT | O_APPEND, 0644);
+    if (fd < 0 || journal_sync_dir(journal.dir) != ERR_SUCCESS) {
+        if (fd >= 0) {
+            close(fd);
+        }
+        pthread_mutex_unlock(&journal.lock);
+        return -1;
+    }
+
+    // Under the batch policy the old file's tail may not be synced yet
+    if (!journal.failed && journal.synced_lsn < journal.written_lsn) {
+        fdatasync(journal.fd);
+    }
+    close(journal.fd);
+    journal.fd = fd;
+    journal.failed = 0;
+    journal.stats.generation = generation;
+    journal.stats.file_bytes = 0;
+    pthread_mutex_unlock(&journal.lock);
+    return generation;
+}
+
+/**
+ * journal_set_snapshot_size
+ * @brief Record the size of the snapshot just written: the journal is next
+ *        compacted once it is this large (or NM_JOURNAL_COMPACT_BYTES).
+ *
+ * @param bytes Snapshot size.
+ */
+void journal_set_snapshot_size(long bytes) {
+    pthread_mutex_lock(&journal.lock);
+    journal.snapshot_bytes = bytes;
+    pthread_mutex_unlock(&journal.lock);
+}
+
+/**
+ * journal_remove_before
+ * @brief Delete the journals a durable snapshot has made obsolete.
+ *
+ * @param generation Generation the snapshot names; older files are removed.
+ */
+void journal_remove_before(int generation) {
+    char path[MAX_PATH + 32];
+    for (int gen = generation - 1; gen >= 0; gen--) {
+        journal_path(path, sizeof(path), journal.dir, gen);
+        if (unlink(path) != 0) {
+            break;
+        }
+    }
+}
+
+/**
+ * journal_replay
+ * @brief Apply the intact records of <dir>/nm_journal.<generation> in order,
+ *        and cut off a torn record at its end.
+ *
+ * @param dir Directory of the journal files.
+ * @param generation Journal to replay.
+ * @param apply Called for each record; payload is writable and not
+ *        NUL-terminated.
+ * @param ctx Passed to apply.
+ * @return Records applied, or -1 if there is no such journal.
+ */
+int journal_replay(const char* dir, int generation, JournalApplyFn apply, void* ctx) {
+    char path[MAX_PATH + 32];
+    journal_path(path, sizeof(path), dir, generation);
+    FILE* f = fopen(path, "r");
+    if (!f) {
+        return -1;
+    }
+
+    struct stat st;
+    size_t size = fstat(fileno(f), &st) == 0 ? (size_t)st.st_size : 0;
+    char* data = malloc(size + 1);
+    if (!data) {
+        fclose(f);
+        return -1;
+    }
+    size = fread(data, 1, size, f);
+    data[size] = '\0';
+    fclose(f);
+
+    size_t pos = 0;
+    int records = 0;
+    while (pos < size) {
+        char* newline = memchr(data + pos, '\n', size - pos);
+        char type;
+        size_t len;
+        unsigned int sum;
+        if (!newline || sscanf(data + pos, "%c %zu %x", &type, &len, &sum) != 3) {
+            break;
+        }
+        size_t start = newline - data + 1;
+        if (len > size - start || checksum(data + start, len) != sum) {
+            break;
+        }
+        apply(type, data + start, len, ctx);
+        pos = start + len;
+        records++;
+    }
+
+    if (pos < size) {
+        char msg[MAX_PATH + 128];
+        snprintf(msg, sizeof(msg), "Discarded %zu bytes of a torn record at the end of %s",
+                 size - pos, path);
+        log_message("NM", "WARN", msg);
+        if (truncate(path, pos) != 0) {
+            log_message("NM", "ERROR", "Failed to truncate the torn journal record");
+        }
+    }
+    free(data);
+    return records;
+}
+
+/**
+ * journal_get_stats
+ * @brief Copy the journal's counters.
+ *
+ * @param stats Filled with the current values.
+ */
+void journal_get_stats(JournalStats* stats) {
+    pthread_mutex_lock(&journal.lock);
+    *stats = journal.stats;
+    pthread_mutex_unlock(&journal.lock);
+}
+
+/**
+ * journal_close
+ * @brief Stop the flusher, write and sync what is buffered, close the file.
+ */
+void journal_close(void) {
+    pthread_mutex_lock(&journal.lock);
+    int running = journal.running;
+    journal.running = 0;
+    pthread_cond_broadcast(&journal.wake);
+    pthread_mutex_unlock(&journal.lock);
+    if (running) {
+        pthread_join(journal.flusher, NULL);
+    }
+
+    pthread_mutex_lock(&journal.lock);
+    while (journal.flushing) {
+        pthread_cond_wait(&journal.flushed, &journal.lock);
+    }
+    if (journal.fd >= 0) {
+        flush_locked(1);
+        close(journal.fd);
+        journal.fd = -1;
+    }
+    free(journal.pending.data);
+    free(journal.spare.data);
+    memset(&journal.pending, 0, sizeof(journal.pending));
+    memset(&journal.spare, 0, sizeof(journal.spare));
+    pthread_mutex_unlock(&journal.lock);
+}
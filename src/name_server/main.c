@@ -1,9 +1,30 @@
+#define _GNU_SOURCE // pthread_rwlockattr_setkind_np()
 #include "common.h"
 #include "name_server.h"
 
 // Global name server state
 NameServerState ns_state;
 
+/**
+ * init_locks
+ * @brief Create ns_state.lock and the per-file lock stripes.
+ *
+ * Readers far outnumber writers, so the locks prefer writers: with glibc's
+ * default, a steady stream of lookups could keep a CREATE or a heartbeat
+ * waiting indefinitely. The price is that a thread must never take a read
+ * lock it already holds, as a queued writer would block the second rdlock.
+ */
+static void init_locks(void) {
+    pthread_rwlockattr_t attr;
+    pthread_rwlockattr_init(&attr);
+    pthread_rwlockattr_setkind_np(&attr, PTHREAD_RWLOCK_PREFER_WRITER_NONRECURSIVE_NP);
+    pthread_rwlock_init(&ns_state.lock, &attr);
+    for (int i = 0; i < NM_FILE_LOCK_STRIPES; i++) {
+        pthread_rwlock_init(&ns_state.file_locks[i], &attr);
+    }
+    pthread_rwlockattr_destroy(&attr);
+}
+
 /**
  * monitor_storage_servers
  * @brief Background thread that periodically checks storage server heartbeats
@@ -12,7 +33,9 @@ NameServerState ns_state;
  * This thread wakes up every HEARTBEAT_CHECK_INTERVAL seconds and iterates
  * through all registered storage servers. If a server is marked active but
  * hasn't sent a heartbeat within HEARTBEAT_TIMEOUT seconds, it is marked as
- * inactive and a warning is logged.
+ * inactive and a warning is logged. It also health-checks the NS->SS
+ * connection pool, closing idle connections that went stale, and every
+ * SS_POOL_STATS_INTERVAL seconds logs the load each server last reported.
  *
  * @param arg Unused thread argument (required by pthread_create signature).
  * @return NULL (thread runs indefinitely).
@@ -21,26 +44,50 @@ void* monitor_storage_servers(void* arg) {
     (void)arg;  // Suppress unused parameter warning
     
     log_message("NM", "INFO", "Storage server monitoring thread started");
+    time_t last_load_log = time(NULL);
     
     while (1) {
         sleep(HEARTBEAT_CHECK_INTERVAL);
         
-        pthread_mutex_lock(&ns_state.lock);
+        stats_wrlock(&ns_state.lock, STATS_LOCK_NS_STATE);
         time_t now = time(NULL);
+        int log_load = now - last_load_log >= SS_POOL_STATS_INTERVAL;
+        if (log_load) {
+            last_load_log = now;
+        }
         
+        int changed = 0;
         for (int i = 0; i < ns_state.ss_count; i++) {
             StorageServerInfo* ss = &ns_state.storage_servers[i];
+            if (log_load && ss->is_active && ss->load_time != 0) {
+                char msg[256];
+                snprintf(msg, sizeof(msg),
+                         "[LOAD] SS #%d: %d/%d busy | queue %d | %.1f GiB free | p99 %d us over %d ops",
+                         ss->server_id, ss->load.active, ss->load.workers, ss->load.queue_depth,
+                         ss->load.disk_free / (1024.0 * 1024.0 * 1024.0), ss->load.p99_us, ss->load.ops);
+                log_message("NM", "INFO", msg);
+            }
             if (ss->is_active && (now - ss->last_heartbeat > HEARTBEAT_TIMEOUT)) {
                 ss->is_active = 0;
+                changed = 1;
                 
                 char msg[512];
                 snprintf(msg, sizeof(msg),
                          "✗ Storage Server #%d connection LOST (timeout) | IP=%s | Client_Port=%d | Last_Heartbeat=%ld seconds ago",
                          ss->server_id, ss->ip, ss->client_port, (long)(now - ss->last_heartbeat));
                 log_message("NM", "WARN", msg);
+                
+                // Pooled sockets to a dead server are useless; drop them now
+                ss_pool_invalidate(ss);
             }
         }
-        pthread_mutex_unlock(&ns_state.lock);
+        if (changed) {
+            nm_publish_ss_routes();
+        }
+        pthread_rwlock_unlock(&ns_state.lock);
+        
+        // Health-check idle pooled connections outside the registry lock
+        ss_pool_prune();
     }
     
     return NULL;
@@ -51,32 +98,52 @@ void* monitor_storage_servers(void* arg) {
  *
  * Start the central Name Server which listens for client and storage server
  * connections. The Name Server maintains the file registry and routes client
- * requests to appropriate storage servers.
+ * requests to appropriate storage servers. Connections are multiplexed by an
+ * epoll event loop; requests run on a fixed pool of worker threads. Besides
+ * the TCP port, the Name Server listens on a Unix socket
+ * (/tmp/docs-nm-<port>.sock) for clients and servers on the same host.
  *
- * Usage: ./name_server <port>
+ * Registry changes are journaled to data/nm_journal.<n> and acknowledged
+ * once durable under the sync policy: "always" (default; fdatasync, shared
+ * by concurrent commits), "batch" (synced every NM_JOURNAL_SYNC_MS) or
+ * "none" (left to the kernel).
+ *
+ * Usage: ./name_server <port> [worker_threads] [always|batch|none]
  */
 int main(int argc, char* argv[]) {
-    if (argc != 2) {
-        fprintf(stderr, "Usage: %s <port>\n", argv[0]);
+    if (argc < 2 || argc > 4) {
+        fprintf(stderr, "Usage: %s <port> [worker_threads] [always|batch|none]\n", argv[0]);
         return 1;
     }
     
     int port = atoi(argv[1]);
+    int workers = (argc >= 3) ? atoi(argv[2]) : NM_WORKER_THREADS;
+    if (workers < 1 || workers > NM_MAX_WORKER_THREADS) {
+        fprintf(stderr, "worker_threads must be between 1 and %d\n", NM_MAX_WORKER_THREADS);
+        return 1;
+    }
+    JournalSyncPolicy sync_policy = JOURNAL_SYNC_ALWAYS;
+    if (argc == 4 && journal_parse_policy(argv[3], &sync_policy) != ERR_SUCCESS) {
+        fprintf(stderr, "sync policy must be always, batch or none\n");
+        return 1;
+    }
     
     // Initialize state
     memset(&ns_state, 0, sizeof(ns_state));
-    pthread_mutex_init(&ns_state.lock, NULL);
+    init_locks();
+    stats_start();
     
-    // Initialize efficient search structures
+    // Initialize registry tables and search structures
     ns_state.file_trie_root = trie_create_node();
-    ns_state.file_cache = cache_create(LRU_CACHE_SIZE);
+    ns_state.file_view = file_view_create();
+    ss_pool_init();
     
-    if (!ns_state.file_trie_root || !ns_state.file_cache) {
-        log_message("NM", "ERROR", "Failed to initialize Trie and LRU cache structures");
+    if (nm_registry_init() != ERR_SUCCESS || !ns_state.file_trie_root || !ns_state.file_view) {
+        log_message("NM", "ERROR", "Failed to initialize registry tables, Trie and file view");
         return 1;
     }
     
-    log_message("NM", "INFO", "Initialized Trie and LRU cache for efficient file search");
+    log_message("NM", "INFO", "Initialized hash-indexed registry tables and Trie");
     
     // Create directories
     create_directory("logs");
@@ -84,8 +151,18 @@ int main(int argc, char* argv[]) {
     
     log_message("NM", "INFO", "Name Server starting");
     
-    // Load persistent state (will rebuild Trie from loaded files)
-    load_state();
+    char msg[256];
+    
+    // Load the snapshot and replay the journal (rebuilds the Trie too),
+    // then keep appending to the last journal
+    int generation = load_state();
+    if (journal_open("data", generation, sync_policy, save_state) != ERR_SUCCESS) {
+        log_message("NM", "ERROR", "Failed to open the metadata journal");
+        return 1;
+    }
+    snprintf(msg, sizeof(msg), "Journaling metadata to data/nm_journal.%d (sync: %s)",
+             generation, journal_policy_name(sync_policy));
+    log_message("NM", "INFO", msg);
     
     // Create server socket
     int server_socket = create_server_socket(port);
@@ -94,10 +171,18 @@ int main(int argc, char* argv[]) {
         return 1;
     }
     
-    char msg[128];
     snprintf(msg, sizeof(msg), "Name Server listening on port %d", port);
     log_message("NM", "INFO", msg);
     
+    // Co-located peers can skip TCP; losing this listener is not fatal
+    char local_path[MAX_LOCAL_ADDR];
+    unix_socket_path(local_path, sizeof(local_path), "nm", port);
+    int local_socket = create_unix_server_socket(local_path);
+    if (local_socket >= 0) {
+        snprintf(msg, sizeof(msg), "Name Server listening on %s%s", UNIX_SOCKET_PREFIX, local_path);
+        log_message("NM", "INFO", msg);
+    }
+    
     // Start the storage server monitoring thread
     pthread_t monitor_thread;
     if (pthread_create(&monitor_thread, NULL, monitor_storage_servers, NULL) != 0) {
@@ -107,40 +192,30 @@ int main(int argc, char* argv[]) {
     }
     pthread_detach(monitor_thread);  // Run in the background
     
-    // Accept connections
-    while (1) {
-        struct sockaddr_in client_addr;
-        socklen_t addr_len = sizeof(client_addr);
-        
-        int* client_fd = malloc(sizeof(int));
-        *client_fd = accept(server_socket, (struct sockaddr*)&client_addr, &addr_len);
-        
-        if (*client_fd >= 0) {
-            char ip[MAX_IP];
-            inet_ntop(AF_INET, &client_addr.sin_addr, ip, sizeof(ip));
-            
-            /* snprintf(msg, sizeof(msg), "New connection from %s (fd %d)", ip, *client_fd);
-            log_message("NM", "INFO", msg); */
-            
-            pthread_t thread;
-            pthread_create(&thread, NULL, handle_client_connection, client_fd);
-            pthread_detach(thread);
-        } else {
-            free(client_fd);
-        }
-    }
+    // Accept connections and serve requests (returns only on failure)
+    nm_reactor_run(server_socket, local_socket, workers);
     
     close(server_socket);
-    
-    // Cleanup search structures
-    if (ns_state.file_cache) {
-        cache_print_stats(ns_state.file_cache);
-        cache_free(ns_state.file_cache);
+    if (local_socket >= 0) {
+        close(local_socket);
+        unlink(local_path);
     }
+    ss_pool_print_stats();
+    
+    // Leave a fresh snapshot and an empty journal behind
+    save_state();
+    journal_close();
+    
+    // Cleanup registry and search structures
+    nm_registry_free();
     if (ns_state.file_trie_root) {
         trie_free(ns_state.file_trie_root);
     }
+    file_view_free(ns_state.file_view);
     
-    pthread_mutex_destroy(&ns_state.lock);
+    for (int i = 0; i < NM_FILE_LOCK_STRIPES; i++) {
+        pthread_rwlock_destroy(&ns_state.file_locks[i]);
+    }
+    pthread_rwlock_destroy(&ns_state.lock);
     return 0;
 }
@@ -0,0 +1,533 @@
+/*
+ * reactor.c - Event-driven front end for the Name Server
+ *
+ * A single thread owns an epoll set holding the listening socket and every
+ * client and storage server connection. It accepts new connections, reads
+ * whatever bytes are available without blocking and cuts them into frames.
+ * Complete requests are queued on their connection, and the connection is
+ * handed to a fixed pool of worker threads that run the regular opcode
+ * handlers. A connection is owned by at most one worker at a time, so
+ * requests on the same socket are still answered one by one, in order.
+ * Storage Server heartbeats have a queue and a worker of their own, so a
+ * pool stuck on slow peers cannot make healthy servers miss heartbeats;
+ * client sockets get NM_CLIENT_IO_TIMEOUT so a peer that stops reading
+ * only holds its worker that long.
+ * A connection with NM_CONN_MAX_QUEUED requests waiting is taken out of the
+ * epoll set until its worker has drained half of them, so a client that
+ * pipelines faster than it is served is held back by TCP flow control
+ * instead of growing the Name Server's buffers; read-ahead is capped at
+ * NM_CONN_MAX_INPUT bytes and a frame over NM_MAX_REQUEST_SIZE is refused
+ * as soon as its header arrives.
+ * Idle connections cost a small struct instead of a thread stack. Handled
+ * requests are kept on their connection, payload buffer included, and
+ * reused for the next frames, so steady traffic does not allocate.
+ */
+
+#include "common.h"
+#include "name_server.h"
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+
+#define REACTOR_READ_CHUNK 16384
+#define REACTOR_SPARE_REQUESTS 8   // Handled requests kept per connection
+
+// A decoded request waiting for a worker
+typedef struct NMRequest {
+    MessageHeader header;
+    RecvBuffer body;           // Owns the payload bytes; reused across requests
+    char* payload;             // Points into body, or NULL
+    int version;               // Wire version the request arrived in
+    struct NMRequest* next;
+} NMRequest;
+
+typedef struct NMConnection {
+    NMSession session;
+    unsigned char* inbuf;      // Bytes read but not yet framed (reactor only)
+    size_t in_len;
+    size_t in_cap;
+    pthread_mutex_t lock;      // Guards the fields below
+    NMRequest* head;           // Requests not yet handled, oldest first
+    NMRequest* tail;
+    int queued;                // Requests on the head list
+    int paused;                // Out of the epoll set until the queue drains
+    NMRequest* spare;          // Handled requests waiting to be reused
+    int spare_count;
+    int scheduled;             // On the ready queue or owned by a worker
+    int closing;               // Peer hung up; free once the queue drains
+    struct NMConnection* next_ready;
+    struct NMConnection* next_resume;
+} NMConnection;
+
+// Connections with queued requests, waiting for a worker
+typedef struct {
+    NMConnection* head;
+    NMConnection* tail;
+    pthread_mutex_t lock;
+    pthread_cond_t nonempty;
+} ReadyQueue;
+
+static ReadyQueue ready_queue = { NULL, NULL, PTHREAD_MUTEX_INITIALIZER, PTHREAD_COND_INITIALIZER };
+// Connections whose next request is OP_HEARTBEAT, served by their own worker
+static ReadyQueue heartbeat_queue = { NULL, NULL, PTHREAD_MUTEX_INITIALIZER, PTHREAD_COND_INITIALIZER };
+
+// Paused connections a worker has drained, for the reactor to watch again
+static struct {
+    NMConnection* head;
+    pthread_mutex_t lock;
+    int wake_fd;               // eventfd in the epoll set; written on a push
+} resume_queue = { NULL, PTHREAD_MUTEX_INITIALIZER, -1 };
+
+static int listen_marker;        // epoll data for the TCP listening socket
+static int local_listen_marker;  // epoll data for the Unix listening socket
+static int wake_marker;          // epoll data for resume_queue.wake_fd
+
+static void resume_push(NMConnection* conn) {
+    pthread_mutex_lock(&resume_queue.lock);
+    conn->next_resume = resume_queue.head;
+    resume_queue.head = conn;
+    pthread_mutex_unlock(&resume_queue.lock);
+    uint64_t one = 1;
+    if (write(resume_queue.wake_fd, &one, sizeof(one)) < 0) {
+        log_message("NM", "ERROR", "Failed to wake the event loop");
+    }
+}
+
+// Queue a connection for the worker its next request belongs to. Caller
+// holds conn->lock.
+static ReadyQueue* queue_for(NMConnection* conn) {
+    if (conn->head && conn->head->header.op_code == OP_HEARTBEAT) {
+        return &heartbeat_queue;
+    }
+    return &ready_queue;
+}
+
+static void ready_push(ReadyQueue* queue, NMConnection* conn) {
+    pthread_mutex_lock(&queue->lock);
+    conn->next_ready = NULL;
+    if (queue->tail) {
+        queue->tail->next_ready = conn;
+    } else {
+        queue->head = conn;
+    }
+    queue->tail = conn;
+    pthread_cond_signal(&queue->nonempty);
+    pthread_mutex_unlock(&queue->lock);
+}
+
+static NMConnection* ready_pop(ReadyQueue* queue) {
+    pthread_mutex_lock(&queue->lock);
+    while (!queue->head) {
+        pthread_cond_wait(&queue->nonempty, &queue->lock);
+    }
+    NMConnection* conn = queue->head;
+    queue->head = conn->next_ready;
+    if (!queue->head) {
+        queue->tail = NULL;
+    }
+    pthread_mutex_unlock(&queue->lock);
+    return conn;
+}
+
+static void request_free_list(NMRequest* req) {
+    while (req) {
+        NMRequest* next = req->next;
+        recv_buffer_free(&req->body);
+        free(req);
+        req = next;
+    }
+}
+
+/**
+ * request_recycle
+ * @brief Keep a handled request for reuse. Caller holds conn->lock.
+ *
+ * Requests whose buffer grew past WIRE_RECV_BUFFER, or beyond the first
+ * REACTOR_SPARE_REQUESTS, are freed instead so idle connections stay small.
+ */
+static void request_recycle(NMConnection* conn, NMRequest* req) {
+    if (conn->spare_count >= REACTOR_SPARE_REQUESTS || req->body.cap > WIRE_RECV_BUFFER) {
+        recv_buffer_free(&req->body);
+        free(req);
+        return;
+    }
+    req->next = conn->spare;
+    conn->spare = req;
+    conn->spare_count++;
+}
+
+static void connection_destroy(NMConnection* conn) {
+    nm_session_close(&conn->session);
+    request_free_list(conn->head);
+    request_free_list(conn->spare);
+    pthread_mutex_destroy(&conn->lock);
+    free(conn->inbuf);
+    free(conn);
+}
+
+/**
+ * worker_main
+ * @brief Worker thread: handle one request at a time from ready connections.
+ *
+ * After each request the connection goes to the back of the ready queue if
+ * more requests are waiting, so one chatty client cannot starve the rest.
+ *
+ * @param arg ReadyQueue this worker serves.
+ */
+static void* worker_main(void* arg) {
+    ReadyQueue* queue = arg;
+
+    while (1) {
+        NMConnection* conn = ready_pop(queue);
+
+        pthread_mutex_lock(&conn->lock);
+        NMRequest* req = conn->head;
+        if (req) {
+            conn->head = req->next;
+            if (!conn->head) conn->tail = NULL;
+            conn->queued--;
+        }
+        int resume = conn->paused && conn->queued <= NM_CONN_MAX_QUEUED / 2;
+        if (resume) conn->paused = 0;
+        pthread_mutex_unlock(&conn->lock);
+
+        if (resume) {
+            resume_push(conn);
+        }
+
+        if (req) {
+            record_frame_received(conn->session.fd, &req->header, req->version);
+            nm_handle_request(&conn->session, &req->header, req->payload);
+        }
+
+        pthread_mutex_lock(&conn->lock);
+        if (req) {
+            request_recycle(conn, req);
+        }
+        if (conn->head) {
+            ReadyQueue* next = queue_for(conn);
+            pthread_mutex_unlock(&conn->lock);
+            ready_push(next, conn);
+            continue;
+        }
+        conn->scheduled = 0;
+        int release = conn->closing;
+        pthread_mutex_unlock(&conn->lock);
+
+        if (release) {
+            connection_destroy(conn);
+        }
+    }
+
+    return NULL;
+}
+
+static void accept_connections(int epfd, int server_socket) {
+    while (1) {
+        int fd = accept(server_socket, NULL, NULL);
+        if (fd < 0) {
+            if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) {
+                char msg[256];
+                snprintf(msg, sizeof(msg), "accept failed: %s", strerror(errno));
+                log_message("NM", "ERROR", msg);
+            }
+            return;
+        }
+
+        NMConnection* conn = calloc(1, sizeof(NMConnection));
+        if (!conn) {
+            close(fd);
+            continue;
+        }
+        nm_session_init(&conn->session, fd);
+        pthread_mutex_init(&conn->lock, NULL);
+        set_socket_protocol(fd, PROTOCOL_V1);
+        set_socket_role(fd, SOCKET_ROLE_INTERACTIVE);
+        set_socket_timeout(fd, NM_CLIENT_IO_TIMEOUT);
+
+        struct epoll_event ev;
+        memset(&ev, 0, sizeof(ev));
+        ev.events = EPOLLIN | EPOLLRDHUP;
+        ev.data.ptr = conn;
+        if (epoll_ctl(epfd, EPOLL_CTL_ADD, fd, &ev) < 0) {
+            pthread_mutex_destroy(&conn->lock);
+            close(fd);
+            free(conn);
+        }
+    }
+}
+
+/**
+ * read_connection
+ * @brief Drain readable bytes from a connection and queue complete frames.
+ *
+ * The socket stays in blocking mode (workers send replies with ordinary
+ * blocking writes); reads here use MSG_DONTWAIT instead.
+ *
+ * @return 0 while the connection is usable, -1 once it hung up or sent a
+ *         malformed frame.
+ */
+static int read_connection(NMConnection* conn) {
+    int fd = conn->session.fd;
+    int alive = 1;
+
+    while (conn->in_len < NM_CONN_MAX_INPUT) {
+        if (conn->in_cap - conn->in_len < REACTOR_READ_CHUNK) {
+            size_t cap = conn->in_cap ? conn->in_cap * 2 : REACTOR_READ_CHUNK * 2;
+            unsigned char* grown = realloc(conn->inbuf, cap);
+            if (!grown) {
+                alive = 0;
+                break;
+            }
+            conn->inbuf = grown;
+            conn->in_cap = cap;
+        }
+
+        ssize_t n = recv(fd, conn->inbuf + conn->in_len, conn->in_cap - conn->in_len, MSG_DONTWAIT);
+        if (n > 0) {
+            conn->in_len += n;
+            continue;
+        }
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n == 0 || (errno != EAGAIN && errno != EWOULDBLOCK)) {
+            alive = 0;
+        }
+        break;
+    }
+
+    // Take the recycled requests; frames are decoded straight into them
+    pthread_mutex_lock(&conn->lock);
+    NMRequest* spare = conn->spare;
+    conn->spare = NULL;
+    conn->spare_count = 0;
+    int room = NM_CONN_MAX_QUEUED - conn->queued;
+    pthread_mutex_unlock(&conn->lock);
+
+    // Frame what is complete, up to the queue limit; the rest stays buffered
+    NMRequest* first = NULL;
+    NMRequest* last = NULL;
+    int framed = 0;
+    size_t offset = 0;
+    while (offset < conn->in_len && framed < room) {
+        NMRequest* req = spare;
+        if (req) {
+            spare = req->next;
+        } else {
+            req = malloc(sizeof(NMRequest));
+            if (!req) {
+                alive = 0;
+                break;
+            }
+            recv_buffer_init(&req->body);
+        }
+
+        ssize_t used = parse_frame(conn->inbuf + offset, conn->in_len - offset,
+                                   &req->header, &req->body, &req->payload, &req->version);
+        if (used > 0 && (req->header.frame_flags & (WIRE_FRAME_CHUNKED | WIRE_FRAME_CONTINUATION))) {
+            // Requests to the Name Server are never chunked
+            used = -1;
+        }
+        if (used >= 0 && req->header.data_length > NM_MAX_REQUEST_SIZE) {
+            // Refused before its payload is buffered
+            used = -1;
+        }
+        if (used <= 0) {
+            req->next = spare;
+            spare = req;
+        }
+        if (used == 0) {
+            break;
+        }
+        if (used < 0) {
+            char msg[256];
+            snprintf(msg, sizeof(msg), "Malformed frame from %s:%d, dropping connection",
+                     conn->session.client_ip, conn->session.client_port);
+            log_message("NM", "WARN", msg);
+            alive = 0;
+            break;
+        }
+        offset += used;
+
+        req->next = NULL;
+        if (last) last->next = req; else first = req;
+        last = req;
+        framed++;
+    }
+    if (offset > 0) {
+        memmove(conn->inbuf, conn->inbuf + offset, conn->in_len - offset);
+        conn->in_len -= offset;
+    }
+
+    pthread_mutex_lock(&conn->lock);
+    if (first) {
+        if (conn->tail) conn->tail->next = first; else conn->head = first;
+        conn->tail = last;
+        conn->queued += framed;
+    }
+    while (spare) {
+        NMRequest* next = spare->next;
+        request_recycle(conn, spare);
+        spare = next;
+    }
+    pthread_mutex_unlock(&conn->lock);
+    return alive ? 0 : -1;
+}
+
+/**
+ * serve_connection
+ * @brief Read and frame a connection's input, then hand it to a worker.
+ *
+ * A connection whose queue is full is taken out of the epoll set; bytes
+ * the client keeps sending wait in its socket buffer until a worker has
+ * drained the queue and resume_connections() watches it again.
+ */
+static void serve_connection(int epfd, NMConnection* conn) {
+    int hung_up = read_connection(conn) < 0;
+    if (hung_up) {
+        // Stop watching before a worker may free the connection
+        epoll_ctl(epfd, EPOLL_CTL_DEL, conn->session.fd, NULL);
+    }
+
+    pthread_mutex_lock(&conn->lock);
+    if (hung_up) {
+        conn->closing = 1;
+    } else if (conn->queued >= NM_CONN_MAX_QUEUED) {
+        conn->paused = 1;
+        epoll_ctl(epfd, EPOLL_CTL_DEL, conn->session.fd, NULL);
+    }
+    int schedule = !conn->scheduled && (conn->head || conn->closing);
+    if (schedule) conn->scheduled = 1;
+    ReadyQueue* queue = queue_for(conn);
+    pthread_mutex_unlock(&conn->lock);
+
+    if (schedule) {
+        ready_push(queue, conn);
+    }
+}
+
+/**
+ * resume_connections
+ * @brief Watch connections again whose queue a worker has drained.
+ *
+ * Each is served at once: requests it sent before being paused may still
+ * be in its input buffer, with nothing new on the socket for epoll to report.
+ */
+static void resume_connections(int epfd) {
+    uint64_t count;
+    if (read(resume_queue.wake_fd, &count, sizeof(count)) < 0 && errno != EAGAIN) {
+        log_message("NM", "ERROR", "Failed to read the event loop wake-up counter");
+    }
+
+    pthread_mutex_lock(&resume_queue.lock);
+    NMConnection* conn = resume_queue.head;
+    resume_queue.head = NULL;
+    pthread_mutex_unlock(&resume_queue.lock);
+
+    while (conn) {
+        NMConnection* next = conn->next_resume;
+        struct epoll_event ev;
+        memset(&ev, 0, sizeof(ev));
+        ev.events = EPOLLIN | EPOLLRDHUP;
+        ev.data.ptr = conn;
+        epoll_ctl(epfd, EPOLL_CTL_ADD, conn->session.fd, &ev);
+        serve_connection(epfd, conn);
+        conn = next;
+    }
+}
+
+/**
+ * nm_reactor_run
+ * @brief Serve the Name Server port with an epoll loop and worker pool.
+ *
+ * Never returns under normal operation. Connections accepted on the Unix
+ * socket are served exactly like TCP ones.
+ *
+ * @param server_socket Listening socket from create_server_socket().
+ * @param local_socket Listening socket from create_unix_server_socket(), or
+ *                     -1 to serve TCP only.
+ * @param worker_count Number of worker threads handling requests.
+ * @return -1 if the event loop could not be set up or failed.
+ */
+int nm_reactor_run(int server_socket, int local_socket, int worker_count) {
+    int epfd = epoll_create1(0);
+    if (epfd < 0) {
+        log_message("NM", "ERROR", "Failed to create epoll instance");
+        return -1;
+    }
+
+    resume_queue.wake_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    struct epoll_event wake_ev;
+    memset(&wake_ev, 0, sizeof(wake_ev));
+    wake_ev.events = EPOLLIN;
+    wake_ev.data.ptr = &wake_marker;
+    if (resume_queue.wake_fd < 0 ||
+        epoll_ctl(epfd, EPOLL_CTL_ADD, resume_queue.wake_fd, &wake_ev) < 0) {
+        log_message("NM", "ERROR", "Failed to set up the event loop wake-up");
+        close(epfd);
+        return -1;
+    }
+
+    int listeners[2] = { server_socket, local_socket };
+    void* markers[2] = { &listen_marker, &local_listen_marker };
+    for (int i = 0; i < 2; i++) {
+        if (listeners[i] < 0) continue;
+        int fl = fcntl(listeners[i], F_GETFL, 0);
+        fcntl(listeners[i], F_SETFL, fl | O_NONBLOCK);
+
+        struct epoll_event ev;
+        memset(&ev, 0, sizeof(ev));
+        ev.events = EPOLLIN;
+        ev.data.ptr = markers[i];
+        if (epoll_ctl(epfd, EPOLL_CTL_ADD, listeners[i], &ev) < 0) {
+            log_message("NM", "ERROR", "Failed to watch listening socket");
+            close(epfd);
+            return -1;
+        }
+    }
+
+    // One extra worker serves heartbeats only
+    for (int i = 0; i <= worker_count; i++) {
+        pthread_t thread;
+        ReadyQueue* queue = i < worker_count ? &ready_queue : &heartbeat_queue;
+        if (pthread_create(&thread, NULL, worker_main, queue) != 0) {
+            log_message("NM", "ERROR", "Failed to create worker thread");
+            close(epfd);
+            return -1;
+        }
+        pthread_detach(thread);
+    }
+
+    char msg[128];
+    snprintf(msg, sizeof(msg), "Event loop started with %d worker threads (+1 for heartbeats)", worker_count);
+    log_message("NM", "INFO", msg);
+
+    struct epoll_event events[NM_MAX_EVENTS];
+    while (1) {
+        int n = epoll_wait(epfd, events, NM_MAX_EVENTS, -1);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            log_message("NM", "ERROR", "epoll_wait failed");
+            close(epfd);
+            return -1;
+        }
+
+        for (int i = 0; i < n; i++) {
+            if (events[i].data.ptr == &listen_marker) {
+                accept_connections(epfd, server_socket);
+                continue;
+            }
+            if (events[i].data.ptr == &local_listen_marker) {
+                accept_connections(epfd, local_socket);
+                continue;
+            }
+
+            if (events[i].data.ptr == &wake_marker) {
+                resume_connections(epfd);
+                continue;
+            }
+
+            serve_connection(epfd, events[i].data.ptr);
+        }
+    }
+}
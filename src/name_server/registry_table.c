@@ -0,0 +1,314 @@
+/**
+ * registry_table.c - Growable Name Server tables with stable IDs
+ *
+ * Files, folders, clients and access requests each live in a RegistryTable.
+ * Entries are stored in fixed-size slabs that are never moved or freed while
+ * the table exists, so an entry's ID, and a pointer to it, stay valid until
+ * the entry is removed; the trie stores IDs and handlers may keep pointers
+ * for as long as they hold ns_state.lock. A removed entry's ID is reused by
+ * the next insert. Capacity is bounded only by memory.
+ *
+ * Every entry is indexed by a string key (full path, folder path, username,
+ * ...) in an open-addressing hash table with linear probing, so finding an
+ * entry is O(1) instead of a scan. The index keeps each key's hash next to
+ * its ID, so a probe only builds and compares a key when the hashes match.
+ * It doubles once three quarters of its slots are in use, live or deleted.
+ *
+ * A table does no locking of its own: callers hold ns_state.lock, exclusive
+ * to insert, remove or rekey.
+ */
+
+#include "common.h"
+#include "name_server.h"
+
+#define REGISTRY_EMPTY -1    // Slot never used: ends a probe
+#define REGISTRY_DELETED -2  // Slot of a removed key: probes continue past it
+
+/**
+ * nm_path_hash
+ * @brief Hash a path or other registry key (FNV-1a).
+ *
+ * @param key NUL-terminated key.
+ * @return 32-bit hash.
+ */
+unsigned int nm_path_hash(const char* key) {
+    unsigned int hash = 2166136261u;
+    for (const char* p = key; *p; p++) {
+        hash = (hash ^ (unsigned char)*p) * 16777619u;
+    }
+    return hash;
+}
+
+static void* entry_at(const RegistryTable* table, int id) {
+    return table->slabs[id / NM_SLAB_ENTRIES] + (size_t)(id % NM_SLAB_ENTRIES) * table->entry_size;
+}
+
+// Does the entry with this ID have `key`? Only called when the hashes match.
+static int key_matches(const RegistryTable* table, int id, const char* key) {
+    char entry_key[MAX_FULL_PATH];
+    table->key_of(entry_at(table, id), entry_key, sizeof(entry_key));
+    return strcmp(entry_key, key) == 0;
+}
+
+// Index slot holding `key`, or -1
+static int index_find(const RegistryTable* table, const char* key, unsigned int hash) {
+    for (unsigned int i = hash & table->slot_mask;; i = (i + 1) & table->slot_mask) {
+        int id = table->slot_ids[i];
+        if (id == REGISTRY_EMPTY) {
+            return -1;
+        }
+        if (id >= 0 && table->slot_hashes[i] == hash && key_matches(table, id, key)) {
+            return (int)i;
+        }
+    }
+}
+
+// Put an ID in the first free slot of its probe. There is always one: the
+// index is grown before it fills up.
+static void index_add(RegistryTable* table, int id, unsigned int hash) {
+    unsigned int i = hash & table->slot_mask;
+    while (table->slot_ids[i] >= 0) {
+        i = (i + 1) & table->slot_mask;
+    }
+    if (table->slot_ids[i] == REGISTRY_EMPTY) {
+        table->slots_used++;
+    }
+    table->slot_ids[i] = id;
+    table->slot_hashes[i] = hash;
+}
+
+// Make room for one more key, rehashing into a larger index (or the same
+// size, to drop deleted slots) once three quarters are used
+static int index_reserve(RegistryTable* table) {
+    int slot_count = table->slot_mask + 1;
+    if ((table->slots_used + 1) * 4 <= slot_count * 3) {
+        return ERR_SUCCESS;
+    }
+
+    int new_count = slot_count;
+    while ((table->count + 1) * 2 > new_count) {
+        new_count *= 2;
+    }
+    int* ids = malloc(sizeof(int) * new_count);
+    unsigned int* hashes = malloc(sizeof(unsigned int) * new_count);
+    if (!ids || !hashes) {
+        free(ids);
+        free(hashes);
+        return ERR_FILE_OPERATION_FAILED;
+    }
+    for (int i = 0; i < new_count; i++) {
+        ids[i] = REGISTRY_EMPTY;
+    }
+
+    int* old_ids = table->slot_ids;
+    unsigned int* old_hashes = table->slot_hashes;
+    table->slot_ids = ids;
+    table->slot_hashes = hashes;
+    table->slot_mask = new_count - 1;
+    table->slots_used = 0;
+    for (int i = 0; i < slot_count; i++) {
+        if (old_ids[i] >= 0) {
+            index_add(table, old_ids[i], old_hashes[i]);
+        }
+    }
+    free(old_ids);
+    free(old_hashes);
+    return ERR_SUCCESS;
+}
+
+// Add a slab, and room to track its IDs, once every ID is taken
+static int slab_reserve(RegistryTable* table) {
+    if (table->free_count > 0 || table->id_limit < table->slab_count * NM_SLAB_ENTRIES) {
+        return ERR_SUCCESS;
+    }
+
+    int capacity = (table->slab_count + 1) * NM_SLAB_ENTRIES;
+    char** slabs = realloc(table->slabs, sizeof(char*) * (table->slab_count + 1));
+    if (!slabs) {
+        return ERR_FILE_OPERATION_FAILED;
+    }
+    table->slabs = slabs;
+    unsigned char* live = realloc(table->live, capacity);
+    if (!live) {
+        return ERR_FILE_OPERATION_FAILED;
+    }
+    table->live = live;
+    // Sized for every ID, so registry_remove() never has to allocate
+    int* free_ids = realloc(table->free_ids, sizeof(int) * capacity);
+    if (!free_ids) {
+        return ERR_FILE_OPERATION_FAILED;
+    }
+    table->free_ids = free_ids;
+    char* slab = malloc(table->entry_size * NM_SLAB_ENTRIES);
+    if (!slab) {
+        return ERR_FILE_OPERATION_FAILED;
+    }
+
+    memset(live + table->slab_count * NM_SLAB_ENTRIES, 0, NM_SLAB_ENTRIES);
+    table->slabs[table->slab_count++] = slab;
+    return ERR_SUCCESS;
+}
+
+/**
+ * registry_init
+ * @brief Set up an empty table.
+ *
+ * @param table Table to initialize.
+ * @param entry_size Size of one entry, e.g. sizeof(FileMetadata).
+ * @param key_of Writes an entry's key; keys are shorter than MAX_FULL_PATH.
+ * @return ERR_SUCCESS, or ERR_FILE_OPERATION_FAILED if out of memory.
+ */
+int registry_init(RegistryTable* table, size_t entry_size, RegistryKeyFn key_of) {
+    memset(table, 0, sizeof(RegistryTable));
+    table->entry_size = entry_size;
+    table->key_of = key_of;
+    table->slot_ids = malloc(sizeof(int) * NM_REGISTRY_MIN_SLOTS);
+    table->slot_hashes = malloc(sizeof(unsigned int) * NM_REGISTRY_MIN_SLOTS);
+    if (!table->slot_ids || !table->slot_hashes) {
+        registry_free(table);
+        return ERR_FILE_OPERATION_FAILED;
+    }
+    for (int i = 0; i < NM_REGISTRY_MIN_SLOTS; i++) {
+        table->slot_ids[i] = REGISTRY_EMPTY;
+    }
+    table->slot_mask = NM_REGISTRY_MIN_SLOTS - 1;
+    return ERR_SUCCESS;
+}
+
+/**
+ * registry_get
+ * @brief Return the entry with an ID.
+ *
+ * @param table Table to look in.
+ * @param id Entry ID.
+ * @return Entry, or NULL if no entry has that ID.
+ */
+void* registry_get(const RegistryTable* table, int id) {
+    if (id < 0 || id >= table->id_limit || !table->live[id]) {
+        return NULL;
+    }
+    return entry_at(table, id);
+}
+
+/**
+ * registry_find
+ * @brief Find the entry with a key.
+ *
+ * @param table Table to search.
+ * @param key Key to look for.
+ * @return ID of the entry, or -1 if there is none.
+ */
+int registry_find(const RegistryTable* table, const char* key) {
+    int slot = index_find(table, key, nm_path_hash(key));
+    return slot < 0 ? -1 : table->slot_ids[slot];
+}
+
+/**
+ * registry_insert
+ * @brief Copy an entry into the table and index it under its key.
+ *
+ * The caller makes sure no entry has the same key yet.
+ *
+ * @param table Table to add to.
+ * @param entry Entry to copy; the table takes over anything it points to.
+ * @return ID of the new entry, or -1 if out of memory (table unchanged).
+ */
+int registry_insert(RegistryTable* table, const void* entry) {
+    if (slab_reserve(table) != ERR_SUCCESS || index_reserve(table) != ERR_SUCCESS) {
+        return -1;
+    }
+
+    int id = table->free_count > 0 ? table->free_ids[--table->free_count] : table->id_limit++;
+    memcpy(entry_at(table, id), entry, table->entry_size);
+    table->live[id] = 1;
+    table->count++;
+
+    char key[MAX_FULL_PATH];
+    table->key_of(entry, key, sizeof(key));
+    index_add(table, id, nm_path_hash(key));
+    return id;
+}
+
+/**
+ * registry_remove
+ * @brief Remove an entry; its ID may be handed out again.
+ *
+ * Anything the entry points to is left for the caller to free.
+ *
+ * @param table Table to remove from.
+ * @param id ID of a live entry.
+ */
+void registry_remove(RegistryTable* table, int id) {
+    char key[MAX_FULL_PATH];
+    table->key_of(entry_at(table, id), key, sizeof(key));
+    int slot = index_find(table, key, nm_path_hash(key));
+    if (slot >= 0) {
+        table->slot_ids[slot] = REGISTRY_DELETED;
+    }
+
+    table->live[id] = 0;
+    table->free_ids[table->free_count++] = id;
+    table->count--;
+}
+
+/**
+ * registry_rekey
+ * @brief Re-index an entry whose key fields the caller has just changed.
+ *
+ * @param table Table holding the entry.
+ * @param id ID of the entry.
+ * @param old_key Key the entry was indexed under before the change.
+ * @return ERR_SUCCESS, or ERR_FILE_OPERATION_FAILED if out of memory (the
+ *         entry is still indexed under old_key; the caller restores it).
+ */
+int registry_rekey(RegistryTable* table, int id, const char* old_key) {
+    if (index_reserve(table) != ERR_SUCCESS) {
+        return ERR_FILE_OPERATION_FAILED;
+    }
+
+    int slot = index_find(table, old_key, nm_path_hash(old_key));
+    if (slot >= 0) {
+        table->slot_ids[slot] = REGISTRY_DELETED;
+    }
+    char key[MAX_FULL_PATH];
+    table->key_of(entry_at(table, id), key, sizeof(key));
+    index_add(table, id, nm_path_hash(key));
+    return ERR_SUCCESS;
+}
+
+/**
+ * registry_next
+ * @brief Iterate over live entries in ID order:
+ *        for (id = registry_next(t, -1); id >= 0; id = registry_next(t, id))
+ *
+ * @param table Table to iterate.
+ * @param id Previous ID, or -1 to start.
+ * @return Next live ID, or -1 when there are no more.
+ */
+int registry_next(const RegistryTable* table, int id) {
+    for (id++; id < table->id_limit; id++) {
+        if (table->live[id]) {
+            return id;
+        }
+    }
+    return -1;
+}
+
+/**
+ * registry_free
+ * @brief Free a table's slabs and index. Entries' own allocations are the
+ *        caller's to free first.
+ *
+ * @param table Table to free; left empty and unusable until re-initialized.
+ */
+void registry_free(RegistryTable* table) {
+    for (int i = 0; i < table->slab_count; i++) {
+        free(table->slabs[i]);
+    }
+    free(table->slabs);
+    free(table->live);
+    free(table->free_ids);
+    free(table->slot_ids);
+    free(table->slot_hashes);
+    memset(table, 0, sizeof(RegistryTable));
+}
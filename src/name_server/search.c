@@ -4,37 +4,102 @@
 
 /**
  * ============================================================================
- * TRIE OPERATIONS FOR EFFICIENT FILE SEARCH
+ * RADIX TREE FOR EFFICIENT FILE SEARCH
  * ============================================================================
- * Trie provides O(m) search time where m is the length of the filename
- * Much better than O(N) linear search where N is the number of files
+ * Paths are kept in a path-compressed trie: each edge holds the longest run
+ * of bytes shared by every path below it, so nodes exist only where paths
+ * branch or end. Lookups stay O(m) in the path length, but memory grows with
+ * the number of paths instead of their total length, and a node only has as
+ * many child slots as it has children (binary searched by first byte).
  */
 
+// Node with an edge label of label_len bytes
+static TrieNode* trie_alloc(const char* label, int label_len) {
+    TrieNode* node = (TrieNode*)malloc(sizeof(TrieNode) + label_len);
+    if (!node) return NULL;
+    
+    memset(node, 0, sizeof(TrieNode));
+    node->file_index = -1;
+    node->label_len = label_len;
+    memcpy(node->label, label, label_len);
+    return node;
+}
+
 /**
  * trie_create_node
- * @brief Create and initialize a new Trie node.
+ * @brief Create an empty root node.
  */
 TrieNode* trie_create_node(void) {
-    TrieNode* node = (TrieNode*)malloc(sizeof(TrieNode));
-    if (!node) return NULL;
-    
-    node->file_index = -1;
-    node->is_end_of_path = 0;
-    
-    for (int i = 0; i < 256; i++) {
-        node->children[i] = NULL;
+    return trie_alloc("", 0);
+}
+
+// Slot of the child whose label starts with ch, or where it would be added
+static int trie_find_slot(const TrieNode* node, unsigned char ch, int* found) {
+    int lo = 0, hi = node->child_count;
+    while (lo < hi) {
+        int mid = (lo + hi) / 2;
+        if (node->keys[mid] < ch) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    *found = lo < node->child_count && node->keys[lo] == ch;
+    return lo;
+}
+
+// Make room for one more child
+static int trie_reserve(TrieNode* node) {
+    if (node->child_count < node->child_cap) return 0;
+    
+    int cap = node->child_cap ? node->child_cap * 2 : 2;
+    if (cap > 256) cap = 256;
+    TrieNode** children = realloc(node->children, cap * sizeof(TrieNode*));
+    if (!children) return -1;
+    node->children = children;
+    unsigned char* keys = realloc(node->keys, cap);
+    if (!keys) return -1;
+    node->keys = keys;
+    node->child_cap = cap;
+    return 0;
+}
+
+static int trie_add_child(TrieNode* node, int slot, TrieNode* child) {
+    if (trie_reserve(node) != 0) return -1;
+    
+    int tail = node->child_count - slot;
+    memmove(&node->children[slot + 1], &node->children[slot], tail * sizeof(TrieNode*));
+    memmove(&node->keys[slot + 1], &node->keys[slot], tail);
+    node->children[slot] = child;
+    node->keys[slot] = (unsigned char)child->label[0];
+    node->child_count++;
+    return 0;
+}
+
+static void trie_remove_child(TrieNode* node, int slot) {
+    node->child_count--;
+    int tail = node->child_count - slot;
+    memmove(&node->children[slot], &node->children[slot + 1], tail * sizeof(TrieNode*));
+    memmove(&node->keys[slot], &node->keys[slot + 1], tail);
+    
+    if (node->child_count == 0) {
+        free(node->children);
+        free(node->keys);
+        node->children = NULL;
+        node->keys = NULL;
+        node->child_cap = 0;
     }
-    
-    return node;
 }
 
 /**
  * trie_insert
  * @brief Insert a file path into the Trie with its array index.
  *
+ * Replaces the index if the path is already present.
+ *
  * @param root Root of the Trie
  * @param path Full file path (folder_path/filename or just filename)
- * @param file_index Index in the files array
+ * @param file_index File ID in ns_state.files
  */
 void trie_insert(TrieNode* root, const char* path, int file_index) {
     if (!root || !path) return;
@@ -43,15 +108,43 @@ void trie_insert(TrieNode* root, const char* path, int file_index) {
     const char* p = path;
     
     while (*p) {
-        unsigned char ch = (unsigned char)*p;
+        int found;
+        int slot = trie_find_slot(current, (unsigned char)*p, &found);
+        
+        if (!found) {
+            // Nothing shares this byte: the rest of the path is one new edge
+            TrieNode* leaf = trie_alloc(p, strlen(p));
+            if (!leaf) return;  // Allocation failed
+            if (trie_add_child(current, slot, leaf) != 0) {
+                free(leaf);
+                return;
+            }
+            current = leaf;
+            break;
+        }
         
-        if (!current->children[ch]) {
-            current->children[ch] = trie_create_node();
-            if (!current->children[ch]) return;  // Allocation failed
+        TrieNode* child = current->children[slot];
+        int common = 1;
+        while (common < child->label_len && p[common] == child->label[common]) {
+            common++;
         }
         
-        current = current->children[ch];
-        p++;
+        if (common < child->label_len) {
+            // The path leaves the edge part-way: split it at that byte
+            TrieNode* mid = trie_alloc(child->label, common);
+            if (!mid || trie_reserve(mid) != 0) {
+                trie_free(mid);
+                return;
+            }
+            memmove(child->label, child->label + common, child->label_len - common);
+            child->label_len -= common;
+            trie_add_child(mid, 0, child);
+            current->children[slot] = mid;
+            child = mid;
+        }
+        
+        current = child;
+        p += common;
     }
     
     current->is_end_of_path = 1;
@@ -69,18 +162,21 @@ void trie_insert(TrieNode* root, const char* path, int file_index) {
 int trie_search(TrieNode* root, const char* path) {
     if (!root || !path) return -1;
     
-    TrieNode* current = root;
+    const TrieNode* current = root;
     const char* p = path;
     
     while (*p) {
-        unsigned char ch = (unsigned char)*p;
-        
-        if (!current->children[ch]) {
+        int found;
+        int slot = trie_find_slot(current, (unsigned char)*p, &found);
+        if (!found) {
             return -1;  // Path not found
         }
         
-        current = current->children[ch];
-        p++;
+        current = current->children[slot];
+        if (strncmp(p, current->label, current->label_len) != 0) {
+            return -1;  // Path ends or differs inside the edge
+        }
+        p += current->label_len;
     }
     
     if (current->is_end_of_path) {
@@ -90,43 +186,57 @@ int trie_search(TrieNode* root, const char* path) {
     return -1;
 }
 
+// Fold a node that no longer ends a path into its only child
+static TrieNode* trie_merge_child(TrieNode* node) {
+    TrieNode* child = node->children[0];
+    TrieNode* merged = (TrieNode*)malloc(sizeof(TrieNode) + node->label_len + child->label_len);
+    if (!merged) return node;  // Still correct, just not compact
+    
+    *merged = *child;
+    merged->label_len = node->label_len + child->label_len;
+    memcpy(merged->label, node->label, node->label_len);
+    memcpy(merged->label + node->label_len, child->label, child->label_len);
+    
+    free(node->children);
+    free(node->keys);
+    free(node);
+    free(child);
+    return merged;
+}
+
 /**
- * trie_delete_helper
- * @brief Helper function to recursively delete a path from Trie.
+ * trie_delete_below
+ * @brief Helper to remove a path from the subtree under `node`, removing
+ *        or merging the nodes it leaves without a purpose.
+ *
+ * @return 1 if the path was found and removed, 0 otherwise.
  */
-static int trie_delete_helper(TrieNode* node, const char* path, int depth, int len) {
-    if (!node) return 0;
-    
-    // Base case: reached end of path
-    if (depth == len) {
-        if (node->is_end_of_path) {
-            node->is_end_of_path = 0;
-            node->file_index = -1;
-        }
-        
-        // Check if node has any children
-        for (int i = 0; i < 256; i++) {
-            if (node->children[i]) return 0;
-        }
-        
-        return 1;  // Can delete this node
+static int trie_delete_below(TrieNode* node, const char* path) {
+    int found;
+    int slot = trie_find_slot(node, (unsigned char)*path, &found);
+    if (!found) return 0;
+    
+    TrieNode* child = node->children[slot];
+    if (strncmp(path, child->label, child->label_len) != 0) return 0;
+    
+    const char* rest = path + child->label_len;
+    if (*rest == '\0') {
+        if (!child->is_end_of_path) return 0;
+        child->is_end_of_path = 0;
+        child->file_index = -1;
+    } else if (!trie_delete_below(child, rest)) {
+        return 0;
     }
     
-    unsigned char ch = (unsigned char)path[depth];
-    if (trie_delete_helper(node->children[ch], path, depth + 1, len)) {
-        free(node->children[ch]);
-        node->children[ch] = NULL;
-        
-        // If node doesn't mark end of path and has no children
-        if (!node->is_end_of_path) {
-            for (int i = 0; i < 256; i++) {
-                if (node->children[i]) return 0;
-            }
-            return 1;
+    if (!child->is_end_of_path) {
+        if (child->child_count == 0) {
+            trie_remove_child(node, slot);
+            trie_free(child);
+        } else if (child->child_count == 1) {
+            node->children[slot] = trie_merge_child(child);
         }
     }
-    
-    return 0;
+    return 1;
 }
 
 /**
@@ -135,7 +245,82 @@ static int trie_delete_helper(TrieNode* node, const char* path, int depth, int l
  */
 void trie_delete(TrieNode* root, const char* path) {
     if (!root || !path) return;
-    trie_delete_helper(root, path, 0, strlen(path));
+    
+    if (*path == '\0') {
+        root->is_end_of_path = 0;
+        root->file_index = -1;
+        return;
+    }
+    trie_delete_below(root, path);
+}
+
+typedef struct {
+    char path[MAX_FULL_PATH];
+    TrieVisitor visit;
+    void* ctx;
+} TrieWalk;
+
+// Visit node (whose path is walk->path[0..len)) and everything below it
+static int trie_walk_from(const TrieNode* node, TrieWalk* walk, int len) {
+    if (node->is_end_of_path) {
+        walk->path[len] = '\0';
+        if (walk->visit(walk->ctx, walk->path, node->file_index)) return 1;
+    }
+    
+    for (int i = 0; i < node->child_count; i++) {
+        const TrieNode* child = node->children[i];
+        if (len + child->label_len >= MAX_FULL_PATH) continue;  // Too long to name
+        memcpy(walk->path + len, child->label, child->label_len);
+        if (trie_walk_from(child, walk, len + child->label_len)) return 1;
+    }
+    return 0;
+}
+
+/**
+ * trie_walk
+ * @brief Visit every stored path that starts with `prefix`, in byte order.
+ *
+ * @param root Root of the Trie
+ * @param prefix Path prefix ("" or NULL for every path)
+ * @param visit Called with each path and its file index; returns non-zero
+ *              to stop the walk
+ * @param ctx Passed to visit
+ * @return 1 if the visitor stopped the walk, 0 otherwise
+ */
+int trie_walk(TrieNode* root, const char* prefix, TrieVisitor visit, void* ctx) {
+    if (!root || !visit) return 0;
+    if (!prefix) prefix = "";
+    
+    TrieWalk walk;
+    walk.visit = visit;
+    walk.ctx = ctx;
+    
+    const TrieNode* current = root;
+    const char* p = prefix;
+    int len = 0;
+    
+    while (*p) {
+        int found;
+        int slot = trie_find_slot(current, (unsigned char)*p, &found);
+        if (!found) return 0;
+        
+        const TrieNode* child = current->children[slot];
+        int matched = 0;
+        while (matched < child->label_len && p[matched] == child->label[matched]) {
+            matched++;
+        }
+        if (matched < child->label_len && p[matched] != '\0') {
+            return 0;  // Prefix differs inside the edge
+        }
+        if (len + child->label_len >= MAX_FULL_PATH) return 0;
+        
+        memcpy(walk.path + len, child->label, child->label_len);
+        len += child->label_len;
+        current = child;
+        p += matched;  // Stops at the end of prefix if it ended inside the edge
+    }
+    
+    return trie_walk_from(current, &walk, len);
 }
 
 /**
@@ -145,12 +330,12 @@ void trie_delete(TrieNode* root, const char* path) {
 void trie_free(TrieNode* root) {
     if (!root) return;
     
-    for (int i = 0; i < 256; i++) {
-        if (root->children[i]) {
-            trie_free(root->children[i]);
-        }
+    for (int i = 0; i < root->child_count; i++) {
+        trie_free(root->children[i]);
     }
     
+    free(root->children);
+    free(root->keys);
     free(root);
 }
 
@@ -269,7 +454,7 @@ int cache_get(LRUCache* cache, const char* key) {
             pthread_mutex_unlock(&cache->lock);
             return result;
         }
-        current = current->next;
+        current = current->hash_next;
     }
     
     cache->misses++;
@@ -300,7 +485,7 @@ void cache_put(LRUCache* cache, const char* key, int file_index) {
             pthread_mutex_unlock(&cache->lock);
             return;
         }
-        current = current->next;
+        current = current->hash_next;
     }
     
     // Create new node
@@ -314,12 +499,7 @@ void cache_put(LRUCache* cache, const char* key, int file_index) {
     new_node->key[MAX_PATH - 1] = '\0';
     new_node->file_index = file_index;
     new_node->last_access = time(NULL);
-    new_node->prev = NULL;
-    new_node->next = cache->nodes[hash];
-    
-    if (cache->nodes[hash]) {
-        cache->nodes[hash]->prev = new_node;
-    }
+    new_node->hash_next = cache->nodes[hash];
     cache->nodes[hash] = new_node;
     
     cache_add_to_head(cache, new_node);
@@ -334,14 +514,14 @@ void cache_put(LRUCache* cache, const char* key, int file_index) {
             // Remove from hash table
             unsigned int lru_hash = cache_hash(lru->key);
             if (cache->nodes[lru_hash] == lru) {
-                cache->nodes[lru_hash] = lru->next;
+                cache->nodes[lru_hash] = lru->hash_next;
             } else {
                 CacheNode* prev = cache->nodes[lru_hash];
-                while (prev && prev->next != lru) {
-                    prev = prev->next;
+                while (prev && prev->hash_next != lru) {
+                    prev = prev->hash_next;
                 }
                 if (prev) {
-                    prev->next = lru->next;
+                    prev->hash_next = lru->hash_next;
                 }
             }
             
@@ -373,9 +553,9 @@ void cache_invalidate(LRUCache* cache, const char* key) {
             
             // Remove from hash table
             if (prev) {
-                prev->next = current->next;
+                prev->hash_next = current->hash_next;
             } else {
-                cache->nodes[hash] = current->next;
+                cache->nodes[hash] = current->hash_next;
             }
             
             free(current);
@@ -383,7 +563,7 @@ void cache_invalidate(LRUCache* cache, const char* key) {
             break;
         }
         prev = current;
-        current = current->next;
+        current = current->hash_next;
     }
     
     pthread_mutex_unlock(&cache->lock);
@@ -401,7 +581,7 @@ void cache_free(LRUCache* cache) {
     for (int i = 0; i < LRU_CACHE_SIZE; i++) {
         CacheNode* current = cache->nodes[i];
         while (current) {
-            CacheNode* next = current->next;
+            CacheNode* next = current->hash_next;
             free(current);
             current = next;
         }
@@ -0,0 +1,501 @@
+/*
+ * ss_pool.c - Name Server -> Storage Server connection pool
+ *
+ * Keeps a bounded set of keep-alive connections per storage server so that
+ * forwarded operations (CREATE, DELETE, MOVE, INFO, EXEC, checkpoints) do not
+ * pay a TCP handshake each time. Requests sent through the pool carry
+ * FLAG_KEEP_ALIVE so the storage server leaves the connection open after
+ * replying. Pooled sockets time out after SS_POOL_IO_TIMEOUT, so a storage
+ * server that accepts but never answers cannot hold Name Server workers. Large responses bound for a client (checkpoint views and
+ * listings) are relayed with ss_pool_relay() instead of being buffered.
+ */
+
+#include "common.h"
+#include "name_server.h"
+
+extern NameServerState ns_state;
+
+// Per-storage-server pool, indexed by slot in ns_state.storage_servers
+typedef struct {
+    char ip[MAX_IP];        // Endpoint the idle sockets were opened against
+    int port;
+    int idle_fds[SS_POOL_MAX_CONNS];
+    time_t idle_since[SS_POOL_MAX_CONNS];
+    int idle_count;
+    int open_count;         // Idle + checked out
+    long hits;
+    long misses;
+    long reconnects;
+    pthread_mutex_t lock;
+    pthread_cond_t available;
+} SSPool;
+
+static SSPool pools[MAX_STORAGE_SERVERS];
+
+static SSPool* pool_for(StorageServerInfo* ss) {
+    long slot = ss - ns_state.storage_servers;
+    if (slot < 0 || slot >= MAX_STORAGE_SERVERS) {
+        return NULL;
+    }
+    return &pools[slot];
+}
+
+/**
+ * connection_is_healthy
+ * @brief Cheap liveness probe for an idle pooled socket.
+ *
+ * An idle connection must have nothing to read. EOF means the storage
+ * server closed it (restart, or an older SS that ignores FLAG_KEEP_ALIVE);
+ * unexpected bytes mean the stream is out of sync. Either way it is unusable.
+ */
+static int connection_is_healthy(int fd) {
+    char probe;
+    ssize_t n = recv(fd, &probe, 1, MSG_PEEK | MSG_DONTWAIT);
+    return n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK);
+}
+
+// Close every idle socket in a pool. Caller holds pool->lock.
+static void drain_idle_locked(SSPool* pool) {
+    for (int i = 0; i < pool->idle_count; i++) {
+        close(pool->idle_fds[i]);
+    }
+    pool->open_count -= pool->idle_count;
+    pool->idle_count = 0;
+    pthread_cond_broadcast(&pool->available);
+}
+
+/**
+ * ss_pool_init
+ * @brief Initialize the per-storage-server connection pools.
+ */
+void ss_pool_init(void) {
+    memset(pools, 0, sizeof(pools));
+    for (int i = 0; i < MAX_STORAGE_SERVERS; i++) {
+        pthread_mutex_init(&pools[i].lock, NULL);
+        pthread_cond_init(&pools[i].available, NULL);
+    }
+}
+
+/**
+ * ss_pool_acquire
+ * @brief Check out a connection to a storage server.
+ *
+ * Returns a healthy idle connection when one exists, otherwise dials a new
+ * one. At most SS_POOL_MAX_CONNS connections are open per storage server;
+ * callers beyond that wait up to SS_POOL_ACQUIRE_TIMEOUT seconds for one to
+ * be released.
+ *
+ * @param ss Storage server to connect to.
+ * @param reused Optional out parameter; set to 1 when an idle pooled
+ *               connection was handed out, 0 for a fresh connection.
+ * @return Connected socket fd, or -1 if the server is unreachable or the
+ *         pool stayed exhausted.
+ */
+int ss_pool_acquire(StorageServerInfo* ss, int* reused) {
+    SSPool* pool = pool_for(ss);
+    if (reused) *reused = 0;
+    if (!pool) return -1;
+
+    struct timespec deadline;
+    clock_gettime(CLOCK_REALTIME, &deadline);
+    deadline.tv_sec += SS_POOL_ACQUIRE_TIMEOUT;
+
+    pthread_mutex_lock(&pool->lock);
+
+    // The SS re-registered on a different endpoint: old sockets are useless
+    if (pool->port != ss->client_port || strcmp(pool->ip, ss->ip) != 0) {
+        drain_idle_locked(pool);
+        strncpy(pool->ip, ss->ip, MAX_IP - 1);
+        pool->ip[MAX_IP - 1] = '\0';
+        pool->port = ss->client_port;
+    }
+
+    while (1) {
+        while (pool->idle_count > 0) {
+            int fd = pool->idle_fds[--pool->idle_count];
+            if (connection_is_healthy(fd)) {
+                pool->hits++;
+                pthread_mutex_unlock(&pool->lock);
+                if (reused) *reused = 1;
+                return fd;
+            }
+            close(fd);
+            pool->open_count--;
+            pool->reconnects++;
+        }
+
+        if (pool->open_count < SS_POOL_MAX_CONNS) {
+            break;
+        }
+
+        if (pthread_cond_timedwait(&pool->available, &pool->lock, &deadline) == ETIMEDOUT) {
+            pthread_mutex_unlock(&pool->lock);
+            char msg[256];
+            snprintf(msg, sizeof(msg),
+                     "[POOL] Timed out waiting for a connection to SS #%d (%d open)",
+                     ss->server_id, SS_POOL_MAX_CONNS);
+            log_message("NM", "WARN", msg);
+            return -1;
+        }
+    }
+
+    // Reserve a slot, then dial without holding the lock
+    pool->open_count++;
+    pool->misses++;
+    pthread_mutex_unlock(&pool->lock);
+
+    int fd = connect_to_endpoint(ss->ip, ss->client_port, ss->local_addr);
+    if (fd < 0) {
+        pthread_mutex_lock(&pool->lock);
+        pool->open_count--;
+        pthread_cond_signal(&pool->available);
+        pthread_mutex_unlock(&pool->lock);
+        return -1;
+    }
+    set_socket_protocol(fd, ss->protocol);
+    // A wedged SS fails the request instead of holding a worker forever
+    set_socket_timeout(fd, SS_POOL_IO_TIMEOUT);
+    return fd;
+}
+
+/**
+ * ss_pool_release
+ * @brief Return a checked-out connection to its pool.
+ *
+ * @param ss Storage server the connection belongs to.
+ * @param fd Socket returned by ss_pool_acquire().
+ * @param reusable Non-zero if the request/response exchange completed
+ *                 cleanly; zero closes the socket instead of pooling it.
+ */
+void ss_pool_release(StorageServerInfo* ss, int fd, int reusable) {
+    SSPool* pool = pool_for(ss);
+    if (!pool) {
+        close(fd);
+        return;
+    }
+
+    pthread_mutex_lock(&pool->lock);
+    if (reusable && pool->idle_count < SS_POOL_MAX_IDLE &&
+        pool->port == ss->client_port && strcmp(pool->ip, ss->ip) == 0) {
+        pool->idle_fds[pool->idle_count] = fd;
+        pool->idle_since[pool->idle_count] = time(NULL);
+        pool->idle_count++;
+    } else {
+        close(fd);
+        pool->open_count--;
+    }
+    pthread_cond_signal(&pool->available);
+    pthread_mutex_unlock(&pool->lock);
+}
+
+// Requests that only read, so running one twice changes nothing
+static int is_idempotent(int op_code) {
+    switch (op_code) {
+        case OP_READ:
+        case OP_SS_READ:
+        case OP_INFO:
+        case OP_STATS:
+        case OP_SS_CHECK_MTIME:
+        case OP_SS_VIEWCHECKPOINT:
+        case OP_SS_LISTCHECKPOINTS:
+            return 1;
+        default:
+            return 0;
+    }
+}
+
+/**
+ * ss_pool_request
+ * @brief Send one request to a storage server and receive its response.
+ *
+ * Uses a pooled connection and marks the request FLAG_KEEP_ALIVE. If a
+ * reused connection turns out to be dead (the SS restarted or timed it out
+ * between the health check and the send), the request is retried once on
+ * a fresh connection, but only if it cannot have been applied twice: the
+ * send itself failed, or the request only reads. Once a request is sent,
+ * a lost reply does not mean the SS never ran it, so a CREATE, DELETE or
+ * MOVE whose reply is lost fails with ERR_SS_UNAVAILABLE instead. An
+ * ERR_SS_BUSY rejection from a saturated SS, which the SS sends without
+ * reading the request, is retried up to SS_BUSY_RETRIES times with a
+ * growing backoff before being passed back to the caller.
+ *
+ * @param ss Target storage server.
+ * @param header Request header (not modified).
+ * @param payload Optional request payload.
+ * @param response Out: response header.
+ * @param response_payload Out: malloc'd response payload or NULL. May be
+ *                         NULL if the caller does not need the payload.
+ * @return ERR_SUCCESS when a response was received, ERR_SS_UNAVAILABLE otherwise.
+ */
+int ss_pool_request(StorageServerInfo* ss, const MessageHeader* header, const char* payload,
+                    MessageHeader* response, char** response_payload) {
+    if (response_payload) *response_payload = NULL;
+    if (!ss) return ERR_SS_UNAVAILABLE;
+
+    MessageHeader request = *header;
+    request.flags |= FLAG_KEEP_ALIVE;
+    int busy_retries = 0;
+
+    for (int attempt = 0; attempt < 2; attempt++) {
+        int reused = 0;
+        int fd = ss_pool_acquire(ss, &reused);
+        if (fd < 0) {
+            return ERR_SS_UNAVAILABLE;
+        }
+
+        char* body = NULL;
+        int sent = send_message(fd, &request, payload) == 0;
+        if (sent && recv_message(fd, response, &body) > 0) {
+            // The SS hangs up after a busy rejection; the request was never read
+            int busy = response->msg_type == MSG_ERROR && response->error_code == ERR_SS_BUSY;
+            ss_pool_release(ss, fd, !busy);
+            if (busy && busy_retries < SS_BUSY_RETRIES) {
+                if (body) free(body);
+                busy_retries++;
+                usleep(SS_BUSY_BACKOFF_MS * 1000 * busy_retries);
+                attempt--;
+                continue;
+            }
+            response->flags &= ~FLAG_KEEP_ALIVE;
+            response->request_id = 0;  // Let relays re-tag it for their own peer
+            if (response_payload) {
+                *response_payload = body;
+            } else if (body) {
+                free(body);
+            }
+            return ERR_SUCCESS;
+        }
+
+        ss_pool_release(ss, fd, 0);
+        if (!reused) {
+            break;  // A fresh connection failed: the SS really is unreachable
+        }
+        if (sent && !is_idempotent(request.op_code)) {
+            break;  // The SS may have applied it; running it again is unsafe
+        }
+    }
+
+    return ERR_SS_UNAVAILABLE;
+}
+
+/**
+ * ss_pool_relay
+ * @brief Send one request to a storage server and stream its response
+ *        straight to a client.
+ *
+ * Like ss_pool_request(), including which requests are retried after a
+ * stale connection or an ERR_SS_BUSY rejection, but the response payload is never buffered: it is relayed to
+ * client_fd with relay_message() as it arrives, so the Name Server's memory
+ * use does not grow with the response size. Retries only happen before the
+ * response header is received; nothing has reached the client by then.
+ *
+ * @param ss Target storage server.
+ * @param header Request header (not modified).
+ * @param payload Optional request payload.
+ * @param client_fd Socket the response is relayed to.
+ * @param response Out: the response header as relayed.
+ * @return ERR_SUCCESS when a response was relayed (even if the client went
+ *         away part way), ERR_SS_UNAVAILABLE if none was received; nothing
+ *         has been sent to the client in that case.
+ */
+int ss_pool_relay(StorageServerInfo* ss, const MessageHeader* header, const char* payload,
+                  int client_fd, MessageHeader* response) {
+    if (!ss) return ERR_SS_UNAVAILABLE;
+
+    MessageHeader request = *header;
+    request.flags |= FLAG_KEEP_ALIVE;
+    int busy_retries = 0;
+
+    for (int attempt = 0; attempt < 2; attempt++) {
+        int reused = 0;
+        int fd = ss_pool_acquire(ss, &reused);
+        if (fd < 0) {
+            return ERR_SS_UNAVAILABLE;
+        }
+
+        int sent = send_message(fd, &request, payload) == 0;
+        if (sent && recv_message_header(fd, response) > 0) {
+            int busy = response->msg_type == MSG_ERROR && response->error_code == ERR_SS_BUSY;
+            if (busy && busy_retries < SS_BUSY_RETRIES) {
+                recv_message_payload(fd, response, NULL, NULL);
+                ss_pool_release(ss, fd, 0);
+                busy_retries++;
+                usleep(SS_BUSY_BACKOFF_MS * 1000 * busy_retries);
+                attempt--;
+                continue;
+            }
+            response->flags &= ~FLAG_KEEP_ALIVE;
+            response->request_id = 0;  // Re-tagged for the client by send_message()
+            int rc = relay_message(fd, response, client_fd, NULL);
+            ss_pool_release(ss, fd, rc == 0 && !busy);
+            return ERR_SUCCESS;
+        }
+
+        ss_pool_release(ss, fd, 0);
+        if (!reused) {
+            break;  // A fresh connection failed: the SS really is unreachable
+        }
+        if (sent && !is_idempotent(request.op_code)) {
+            break;  // The SS may have applied it; running it again is unsafe
+        }
+    }
+
+    return ERR_SS_UNAVAILABLE;
+}
+
+/**
+ * ss_pool_pipeline
+ * @brief Send a batch of independent requests to one storage server without
+ *        waiting a round trip per request.
+ *
+ * The batch shares one pooled connection with up to MUX_MAX_IN_FLIGHT
+ * requests in flight; replies are matched by request ID. If the connection
+ * drops part way (a stale pooled socket, or an older SS that hangs up after
+ * every reply), the unanswered tail is resent on a new connection as long as
+ * each attempt makes progress and, as in ss_pool_request(), every request
+ * sent without a reply only reads. Requests that never got a reply are
+ * reported as MSG_ERROR with ERR_SS_UNAVAILABLE.
+ *
+ * @param ss Target storage server.
+ * @param requests Array of count request headers (not modified).
+ * @param payloads Optional array of count request payloads; may be NULL.
+ * @param count Number of requests.
+ * @param responses Out: array of count response headers.
+ * @param response_payloads Out: optional array of count malloc'd payloads
+ *                          (NULL entries when a reply has none); may be NULL.
+ * @return Number of requests that received a reply.
+ */
+int ss_pool_pipeline(StorageServerInfo* ss, const MessageHeader* requests, const char* const* payloads,
+                     int count, MessageHeader* responses, char** response_payloads) {
+    for (int i = 0; i < count; i++) {
+        INIT_RESPONSE_HEADER(&responses[i], MSG_ERROR, ERR_SS_UNAVAILABLE);
+        if (response_payloads) response_payloads[i] = NULL;
+    }
+    if (!ss || count <= 0) return 0;
+
+    unsigned int* ids = calloc(count, sizeof(unsigned int));
+    if (!ids) return 0;
+
+    int completed = 0;
+    int stale_retry = 1;
+    while (completed < count) {
+        int reused = 0;
+        int fd = ss_pool_acquire(ss, &reused);
+        if (fd < 0) break;
+
+        MuxChannel ch;
+        mux_init(&ch, fd);
+        int start = completed;
+        int sent = completed;
+        int ok = 1;
+
+        while (ok && completed < count) {
+            // Keep the window full, then wait for the oldest reply
+            while (sent < count && ch.in_flight_count < MUX_MAX_IN_FLIGHT) {
+                MessageHeader request = requests[sent];
+                request.flags |= FLAG_KEEP_ALIVE;
+                ids[sent] = mux_send(&ch, &request, payloads ? payloads[sent] : NULL);
+                if (ids[sent] == 0) {
+                    ok = 0;
+                    break;
+                }
+                sent++;
+            }
+            if (!ok || mux_recv(&ch, ids[completed], &responses[completed],
+                                response_payloads ? &response_payloads[completed] : NULL) < 0) {
+                ok = 0;
+                break;
+            }
+            responses[completed].flags &= ~FLAG_KEEP_ALIVE;
+            responses[completed].request_id = 0;
+            completed++;
+        }
+
+        mux_discard(&ch);
+        ss_pool_release(ss, fd, ok);
+        if (ok) break;
+        int unsafe = 0;
+        for (int i = completed; i < sent; i++) {
+            unsafe |= !is_idempotent(requests[i].op_code);
+        }
+        if (unsafe) break;  // The SS may have applied those already
+        if (completed > start) continue;
+        if (reused && stale_retry-- > 0) continue;
+        break;
+    }
+
+    free(ids);
+    return completed;
+}
+
+/**
+ * ss_pool_invalidate
+ * @brief Drop all idle connections to a storage server.
+ *
+ * Called when a storage server re-registers or is marked inactive so the
+ * next request reconnects instead of discovering stale sockets one by one.
+ *
+ * @param ss Storage server whose pool should be flushed.
+ */
+void ss_pool_invalidate(StorageServerInfo* ss) {
+    SSPool* pool = pool_for(ss);
+    if (!pool) return;
+
+    pthread_mutex_lock(&pool->lock);
+    drain_idle_locked(pool);
+    pthread_mutex_unlock(&pool->lock);
+}
+
+/**
+ * ss_pool_prune
+ * @brief Periodic health check for all pools.
+ *
+ * Closes idle connections that are older than SS_POOL_IDLE_TIMEOUT or fail
+ * the liveness probe, so pooled sockets do not pin storage server threads
+ * forever. Intended to run from the storage server monitor thread.
+ */
+void ss_pool_prune(void) {
+    time_t now = time(NULL);
+
+    for (int i = 0; i < MAX_STORAGE_SERVERS; i++) {
+        SSPool* pool = &pools[i];
+        pthread_mutex_lock(&pool->lock);
+        int kept = 0;
+        for (int j = 0; j < pool->idle_count; j++) {
+            int fd = pool->idle_fds[j];
+            if (now - pool->idle_since[j] > SS_POOL_IDLE_TIMEOUT || !connection_is_healthy(fd)) {
+                close(fd);
+                pool->open_count--;
+                continue;
+            }
+            pool->idle_fds[kept] = fd;
+            pool->idle_since[kept] = pool->idle_since[j];
+            kept++;
+        }
+        if (kept != pool->idle_count) {
+            pool->idle_count = kept;
+            pthread_cond_broadcast(&pool->available);
+        }
+        pthread_mutex_unlock(&pool->lock);
+    }
+}
+
+/**
+ * ss_pool_print_stats
+ * @brief Log pool reuse statistics for every storage server.
+ */
+void ss_pool_print_stats(void) {
+    for (int i = 0; i < ns_state.ss_count; i++) {
+        SSPool* pool = &pools[i];
+        pthread_mutex_lock(&pool->lock);
+        long total = pool->hits + pool->misses;
+        char msg[256];
+        snprintf(msg, sizeof(msg),
+                 "[POOL] SS #%d: %ld requests, %ld reused (%.1f%%), %ld stale reconnects, %d idle",
+                 ns_state.storage_servers[i].server_id, total, pool->hits,
+                 total > 0 ? 100.0 * pool->hits / total : 0.0,
+                 pool->reconnects, pool->idle_count);
+        pthread_mutex_unlock(&pool->lock);
+        log_message("NM", "INFO", msg);
+    }
+}
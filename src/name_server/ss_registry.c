@@ -24,12 +24,16 @@ extern NameServerState ns_state;
  *                some workflows but stored for completeness).
  * @param client_port Port number clients should use to contact the storage
  *                    server for data operations.
+ * @param protocol Highest wire protocol version the storage server speaks.
+ * @param local_addr Advertised Unix socket address ("<host>:<path>"), or
+ *                   "" when the server listens on TCP only.
  * @return ERR_SUCCESS on success, ERR_SS_EXISTS if an active server with the
  *         same ID or port already exists, or ERR_FILE_OPERATION_FAILED if
  *         registry capacity is exhausted.
  */
-int nm_register_storage_server(int server_id, const char* ip, int nm_port, int client_port) {
-    pthread_mutex_lock(&ns_state.lock);
+int nm_register_storage_server(int server_id, const char* ip, int nm_port, int client_port,
+                               int protocol, const char* local_addr) {
+    stats_wrlock(&ns_state.lock, STATS_LOCK_NS_STATE);
     
     StorageServerInfo* existing_ss = NULL;
     
@@ -43,7 +47,7 @@ int nm_register_storage_server(int server_id, const char* ip, int nm_port, int c
         if (ns_state.storage_servers[i].is_active && 
             ns_state.storage_servers[i].client_port == client_port &&
             ns_state.storage_servers[i].server_id != server_id) {
-            pthread_mutex_unlock(&ns_state.lock);
+            pthread_rwlock_unlock(&ns_state.lock);
             
             char err_msg[512];
             snprintf(err_msg, sizeof(err_msg), 
@@ -57,7 +61,7 @@ int nm_register_storage_server(int server_id, const char* ip, int nm_port, int c
     if (existing_ss) {
         if (existing_ss->is_active) {
             // An active server with this ID already exists. Reject the request.
-            pthread_mutex_unlock(&ns_state.lock);
+            pthread_rwlock_unlock(&ns_state.lock);
             char err_msg[512];
             snprintf(err_msg, sizeof(err_msg), 
                      "✗ Registration REJECTED: Storage Server ID %d is already in use (IP=%s, Port=%d)",
@@ -69,9 +73,14 @@ int nm_register_storage_server(int server_id, const char* ip, int nm_port, int c
             strcpy(existing_ss->ip, ip);
             existing_ss->nm_port = nm_port;
             existing_ss->client_port = client_port;
+            existing_ss->protocol = protocol;
+            safe_strncpy(existing_ss->local_addr, local_addr, sizeof(existing_ss->local_addr));
             existing_ss->is_active = 1;
             existing_ss->last_heartbeat = time(NULL);
-            pthread_mutex_unlock(&ns_state.lock);
+            existing_ss->load_time = 0;  // Stale until its first heartbeat
+            ss_pool_invalidate(existing_ss);  // Restarted SS: old sockets are dead
+            nm_publish_ss_routes();
+            pthread_rwlock_unlock(&ns_state.lock);
             
             char msg[512];
             snprintf(msg, sizeof(msg), 
@@ -83,7 +92,7 @@ int nm_register_storage_server(int server_id, const char* ip, int nm_port, int c
     } else {
         // No server with this ID exists. Register it as a new server.
         if (ns_state.ss_count >= MAX_STORAGE_SERVERS) {
-            pthread_mutex_unlock(&ns_state.lock);
+            pthread_rwlock_unlock(&ns_state.lock);
             log_message("NM", "ERROR", "✗ Registration FAILED: Maximum storage server capacity reached");
             return ERR_FILE_OPERATION_FAILED;
         }
@@ -93,8 +102,12 @@ int nm_register_storage_server(int server_id, const char* ip, int nm_port, int c
         strcpy(ss->ip, ip);
         ss->nm_port = nm_port;
         ss->client_port = client_port;
+        ss->protocol = protocol;
+        safe_strncpy(ss->local_addr, local_addr, sizeof(ss->local_addr));
         ss->is_active = 1;
         ss->last_heartbeat = time(NULL);
+        ss->heartbeat_fd = -1;
+        ss->load_time = 0;
         ss->files = NULL;
         ss->file_count = 0;
         
@@ -122,7 +135,8 @@ int nm_register_storage_server(int server_id, const char* ip, int nm_port, int c
         }
         
         ns_state.ss_count++;
-        pthread_mutex_unlock(&ns_state.lock);
+        nm_publish_ss_routes();
+        pthread_rwlock_unlock(&ns_state.lock);
         
         char msg[512];
         snprintf(msg, sizeof(msg), 
@@ -139,7 +153,9 @@ int nm_register_storage_server(int server_id, const char* ip, int nm_port, int c
  * @brief Return a pointer to a registered, active Storage Server by id.
  *
  * This function searches the in-memory storage server list and returns a
- * pointer to the StorageServerInfo if it exists and is active.
+ * pointer to the StorageServerInfo if it exists and is active. Entries are
+ * never removed or moved, so the pointer stays valid after ns_state.lock
+ * is released.
  *
  * @param ss_id Storage server id to look up.
  * @return Pointer to StorageServerInfo or NULL if not found/active.
@@ -154,9 +170,84 @@ StorageServerInfo* nm_find_storage_server(int ss_id) {
     return NULL;
 }
 
+/**
+ * nm_publish_ss_routes
+ * @brief Publish the current routing fields of every Storage Server.
+ *
+ * Redirects read the published table (see nm_find_ss_route()) instead of
+ * taking ns_state.lock, so whoever changes a server's active flag, replica
+ * link or load calls this before releasing the lock. The previous table is
+ * retired, and freed once no redirect is still reading it.
+ *
+ * Caller must hold ns_state.lock exclusive. On allocation failure the old
+ * table stays published until the next change.
+ */
+void nm_publish_ss_routes(void) {
+    SSRouteTable* table = malloc(sizeof(SSRouteTable));
+    if (!table) {
+        log_message("NM", "ERROR", "Failed to publish storage server routes");
+        return;
+    }
+    
+    table->count = ns_state.ss_count;
+    for (int i = 0; i < ns_state.ss_count; i++) {
+        StorageServerInfo* ss = &ns_state.storage_servers[i];
+        SSRoute* route = &table->routes[i];
+        route->ss = ss;
+        route->server_id = ss->server_id;
+        route->is_active = ss->is_active;
+        route->replica_id = ss->replica_id;
+        route->replica_active = ss->replica_active;
+        route->load = ss->load;
+        route->load_time = ss->load_time;
+    }
+    
+    SSRouteTable* old = __atomic_exchange_n(&ns_state.ss_routes, table, __ATOMIC_ACQ_REL);
+    if (old) {
+        epoch_retire(old, free);
+    }
+}
+
+/**
+ * nm_find_ss_route
+ * @brief Find a server in a published route table.
+ *
+ * The caller must be inside epoch_enter()/epoch_exit() from loading the
+ * table until it is done with the result.
+ *
+ * @param table Table loaded from ns_state.ss_routes, possibly NULL.
+ * @param ss_id Storage server id.
+ * @return Route, or NULL if the server is not registered.
+ */
+const SSRoute* nm_find_ss_route(const SSRouteTable* table, int ss_id) {
+    for (int i = 0; table && i < table->count; i++) {
+        if (table->routes[i].server_id == ss_id) {
+            return &table->routes[i];
+        }
+    }
+    return NULL;
+}
+
+// A load report older than the heartbeat timeout no longer describes the server
+static int load_is_fresh(time_t load_time, time_t now) {
+    return load_time != 0 && now - load_time <= HEARTBEAT_TIMEOUT;
+}
+
+// Worker occupancy in thousandths; queued connections count as extra load
+static long load_score(const LoadReport* load) {
+    int workers = load->workers > 0 ? load->workers : 1;
+    return (long)(load->active + load->queue_depth) * 1000 / workers;
+}
+
 /**
  * nm_select_storage_server
- * @brief Choose an active storage server using a simple round-robin policy.
+ * @brief Choose an active storage server for a new file.
+ *
+ * Uses the load reported with each heartbeat: servers with less than
+ * SS_MIN_DISK_FREE bytes free are avoided while any other has room, and
+ * among the rest the one with the lowest worker occupancy wins. Ties (and
+ * servers without a recent report) are broken round-robin, so an idle
+ * cluster still spreads files evenly.
  *
  * Returns the server id of the selected storage server, or -1 if no active
  * storage servers are available.
@@ -164,26 +255,115 @@ StorageServerInfo* nm_find_storage_server(int ss_id) {
  * @return Storage server id >= 0 when successful, -1 on failure.
  */
 int nm_select_storage_server(void) {
-    static int last_selected = 0;
+    static int last_selected = 0;  // Shared by concurrent readers: atomic
     
-    pthread_mutex_lock(&ns_state.lock);
+    stats_rdlock(&ns_state.lock, STATS_LOCK_NS_STATE_READ);
     
     if (ns_state.ss_count == 0) {
-        pthread_mutex_unlock(&ns_state.lock);
+        pthread_rwlock_unlock(&ns_state.lock);
         return -1;
     }
     
-    // Find next active server
+    // Scan from the round-robin position; only a strictly better server
+    // displaces the first candidate
+    time_t now = time(NULL);
+    int start = __atomic_load_n(&last_selected, __ATOMIC_RELAXED);
+    int best = -1;
+    int best_roomy = 0;
+    long best_score = 0;
     for (int i = 0; i < ns_state.ss_count; i++) {
-        int idx = (last_selected + i) % ns_state.ss_count;
-        if (ns_state.storage_servers[idx].is_active) {
-            last_selected = (idx + 1) % ns_state.ss_count;
-            int ss_id = ns_state.storage_servers[idx].server_id;
-            pthread_mutex_unlock(&ns_state.lock);
-            return ss_id;
+        int idx = (start + i) % ns_state.ss_count;
+        StorageServerInfo* ss = &ns_state.storage_servers[idx];
+        if (!ss->is_active) {
+            continue;
+        }
+        int fresh = load_is_fresh(ss->load_time, now);
+        int roomy = !fresh || ss->load.disk_free >= SS_MIN_DISK_FREE;
+        long score = fresh ? load_score(&ss->load) : 0;
+        if (best < 0 || roomy > best_roomy || (roomy == best_roomy && score < best_score)) {
+            best = idx;
+            best_roomy = roomy;
+            best_score = score;
         }
     }
     
-    pthread_mutex_unlock(&ns_state.lock);
-    return -1;
+    int ss_id = -1;
+    if (best >= 0) {
+        __atomic_store_n(&last_selected, (best + 1) % ns_state.ss_count, __ATOMIC_RELAXED);
+        ss_id = ns_state.storage_servers[best].server_id;
+    }
+    pthread_rwlock_unlock(&ns_state.lock);
+    return ss_id;
+}
+
+/**
+ * nm_record_ss_load
+ * @brief Store the load report carried by a heartbeat.
+ *
+ * Caller must hold ns_state.lock exclusive. Heartbeats without a report (older
+ * storage servers) leave the previous one to age out.
+ *
+ * @param ss Server the heartbeat came from.
+ * @param payload Heartbeat payload, or NULL.
+ */
+void nm_record_ss_load(StorageServerInfo* ss, const char* payload) {
+    LoadReport report;
+    if (parse_load_report(payload, &report) == 0) {
+        ss->load = report;
+        ss->load_time = time(NULL);
+    }
+}
+
+/**
+ * nm_ss_saturated
+ * @brief Whether a server's latest report shows every worker busy or
+ *        connections waiting for one.
+ *
+ * @param route Published route of the storage server.
+ * @return 1 if saturated, 0 if not or if its load is unknown.
+ */
+int nm_ss_saturated(const SSRoute* route) {
+    return load_is_fresh(route->load_time, time(NULL)) &&
+           (route->load.queue_depth > 0 || route->load.active >= route->load.workers);
+}
+
+/**
+ * nm_route_read
+ * @brief Pick the server a read-only operation should go to.
+ *
+ * Replication is synchronous, so the replica holds every acknowledged
+ * write. When the chosen server is saturated and its replica is up and
+ * not, the read is sent to the replica instead. Decided from the published
+ * routes, without taking ns_state.lock.
+ *
+ * @param ss Server chosen for the file (primary, or replica after failover).
+ * @param filename File being read, for logging.
+ * @return ss or its replica.
+ */
+StorageServerInfo* nm_route_read(StorageServerInfo* ss, const char* filename) {
+    StorageServerInfo* target = ss;
+    SSRoute from;
+    
+    epoch_enter();
+    const SSRouteTable* routes = __atomic_load_n(&ns_state.ss_routes, __ATOMIC_ACQUIRE);
+    const SSRoute* route = nm_find_ss_route(routes, ss->server_id);
+    if (route && route->replica_active && nm_ss_saturated(route)) {
+        const SSRoute* replica = nm_find_ss_route(routes, route->replica_id);
+        if (replica && replica->is_active && load_is_fresh(replica->load_time, time(NULL)) &&
+            !nm_ss_saturated(replica)) {
+            target = replica->ss;
+            from = *route;
+        }
+    }
+    epoch_exit();
+    
+    if (target != ss) {
+        char msg[512];
+        snprintf(msg, sizeof(msg),
+                 "[ROUTE] Directing read of '%s' to Replica SS #%d (SS #%d saturated: %d/%d busy, %d queued)",
+                 filename, target->server_id, from.server_id,
+                 from.load.active, from.load.workers, from.load.queue_depth);
+        log_message("NM", "INFO", msg);
+    }
+    return target;
 }
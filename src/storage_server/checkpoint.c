@@ -85,9 +85,10 @@ int ss_create_checkpoint(const char* filename, const char* checkpoint_tag) {
 }
 
 /**
- * Views the content of a specific checkpoint
+ * Opens a checkpoint for streaming; the caller sends it with
+ * send_file_message() and closes the descriptor
  */
-int ss_view_checkpoint(const char* filename, const char* checkpoint_tag, char** content) {
+int ss_open_checkpoint(const char* filename, const char* checkpoint_tag, int* fd, size_t* size) {
     char checkpoint_path[MAX_PATH];
     
     // Build checkpoint path
@@ -103,35 +104,17 @@ int ss_view_checkpoint(const char* filename, const char* checkpoint_tag, char**
         return ERR_FILE_OPERATION_FAILED;
     }
     
-    // Check if checkpoint exists
-    struct stat st;
-    if (stat(checkpoint_path, &st) != 0) {
-        return ERR_CHECKPOINT_NOT_FOUND;
-    }
-    
-    // Read checkpoint content
-    FILE* fp = fopen(checkpoint_path, "r");
-    if (!fp) {
+    *fd = open(checkpoint_path, O_RDONLY);
+    if (*fd < 0) {
         return ERR_CHECKPOINT_NOT_FOUND;
     }
     
-    // Get file size
-    fseek(fp, 0, SEEK_END);
-    long size = ftell(fp);
-    fseek(fp, 0, SEEK_SET);
-    
-    // Allocate memory for content
-    *content = (char*)malloc(size + 1);
-    if (!*content) {
-        fclose(fp);
+    struct stat st;
+    if (fstat(*fd, &st) != 0) {
+        close(*fd);
         return ERR_FILE_OPERATION_FAILED;
     }
-    
-    // Read content
-    size_t bytes_read = fread(*content, 1, size, fp);
-    (*content)[bytes_read] = '\0';
-    
-    fclose(fp);
+    *size = st.st_size;
     return ERR_SUCCESS;
 }
 
@@ -0,0 +1,152 @@
+/*
+ * file_handles.c - Per-connection file handles (OP_SS_OPEN)
+ *
+ * A client that is about to send several requests for one file can open it
+ * once and then name it by a 64-bit handle instead of its filename. The
+ * handle keeps the resolved path, an open descriptor and the file's stat,
+ * so later requests skip ss_build_filepath() (with its mkdir attempt),
+ * file_exists() and open(). Before each use the cached stat is checked with
+ * a single stat() of the path: documents are rewritten by rename, so a new
+ * inode means the descriptor is stale and is reopened.
+ *
+ * Handles belong to the connection that opened them and are closed with it.
+ * The high 32 bits of an id are unique to the connection, so a handle from
+ * another connection (or an earlier one) is never mistaken for a live one.
+ */
+
+#include "common.h"
+#include "storage_server.h"
+
+static struct {
+    unsigned long long next_serial;
+    pthread_mutex_t lock;
+} handle_ids = { .lock = PTHREAD_MUTEX_INITIALIZER };
+
+/**
+ * ss_handles_init
+ * @brief Prepare an empty handle table for a new connection.
+ *
+ * @param table Table, normally on the stack of the connection's worker.
+ */
+void ss_handles_init(HandleTable* table) {
+    memset(table, 0, sizeof(HandleTable));
+    for (int i = 0; i < SS_MAX_FILE_HANDLES; i++) {
+        table->slots[i].fd = -1;
+    }
+
+    pthread_mutex_lock(&handle_ids.lock);
+    table->serial = ++handle_ids.next_serial & 0xffffffffULL;
+    pthread_mutex_unlock(&handle_ids.lock);
+}
+
+/**
+ * ss_handle_refresh
+ * @brief Make sure a handle's descriptor and stat describe the file now at
+ *        its path.
+ *
+ * @param fh Handle to check.
+ * @return ERR_SUCCESS, ERR_FILE_NOT_FOUND if the file was deleted or moved
+ *         away, or ERR_FILE_OPERATION_FAILED.
+ */
+int ss_handle_refresh(FileHandle* fh) {
+    struct stat st;
+    if (stat(fh->filepath, &st) != 0) {
+        return errno == ENOENT ? ERR_FILE_NOT_FOUND : ERR_FILE_OPERATION_FAILED;
+    }
+    if (fh->fd >= 0 && st.st_ino == fh->st.st_ino && st.st_dev == fh->st.st_dev) {
+        fh->st = st;
+        return ERR_SUCCESS;
+    }
+
+    // Replaced since it was opened (or never opened): reopen
+    int fd = open(fh->filepath, O_RDONLY);
+    if (fd < 0) {
+        return errno == ENOENT ? ERR_FILE_NOT_FOUND : ERR_FILE_OPERATION_FAILED;
+    }
+    if (fstat(fd, &fh->st) != 0) {
+        close(fd);
+        return ERR_FILE_OPERATION_FAILED;
+    }
+    if (fh->fd >= 0) {
+        close(fh->fd);
+    }
+    fh->fd = fd;
+    return ERR_SUCCESS;
+}
+
+/**
+ * ss_handle_open
+ * @brief Open `filename` and bind it to a new handle.
+ *
+ * When the table is full the oldest handle is closed to make room; a
+ * request that still uses it gets ERR_STALE_HANDLE.
+ *
+ * @param table The connection's handle table.
+ * @param filename File to open.
+ * @param id Out: the new handle.
+ * @return ERR_SUCCESS, ERR_FILE_NOT_FOUND or ERR_FILE_OPERATION_FAILED.
+ */
+int ss_handle_open(HandleTable* table, const char* filename, unsigned long long* id) {
+    FileHandle* slot = NULL;
+    for (int i = 0; i < SS_MAX_FILE_HANDLES; i++) {
+        FileHandle* fh = &table->slots[i];
+        if (fh->id == 0) {
+            slot = fh;
+            break;
+        }
+        if (!slot || fh->id < slot->id) {
+            slot = fh;
+        }
+    }
+    if (slot->fd >= 0) {
+        close(slot->fd);
+        slot->fd = -1;
+    }
+    slot->id = 0;
+
+    if (ss_build_filepath(slot->filepath, sizeof(slot->filepath), filename, NULL) != ERR_SUCCESS) {
+        return ERR_FILE_OPERATION_FAILED;
+    }
+    int result = ss_handle_refresh(slot);
+    if (result != ERR_SUCCESS) {
+        return result;
+    }
+
+    safe_strncpy(slot->filename, filename, sizeof(slot->filename));
+    slot->id = (table->serial << 32) | ++table->opens;
+    *id = slot->id;
+    return ERR_SUCCESS;
+}
+
+/**
+ * ss_handle_find
+ * @brief Look up a handle opened on this connection. Makes no syscalls.
+ *
+ * @param table The connection's handle table.
+ * @param id Handle from the request header.
+ * @return The handle, or NULL if it is not open on this connection.
+ */
+FileHandle* ss_handle_find(HandleTable* table, unsigned long long id) {
+    for (int i = 0; id && i < SS_MAX_FILE_HANDLES; i++) {
+        if (table->slots[i].id == id) {
+            return &table->slots[i];
+        }
+    }
+    return NULL;
+}
+
+/**
+ * ss_handles_close
+ * @brief Close every handle of a connection that is going away.
+ *
+ * @param table The connection's handle table.
+ */
+void ss_handles_close(HandleTable* table) {
+    for (int i = 0; i < SS_MAX_FILE_HANDLES; i++) {
+        if (table->slots[i].fd >= 0) {
+            close(table->slots[i].fd);
+            table->slots[i].fd = -1;
+        }
+        table->slots[i].id = 0;
+    }
+}
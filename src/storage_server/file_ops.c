@@ -174,6 +174,41 @@ int ss_read_file(const char* filename, char** content) {
     return ERR_SUCCESS;
 }
 
+/**
+ * ss_open_file
+ * @brief Open `filename` read-only and report its size, for zero-copy sends.
+ *
+ * The caller streams the descriptor with send_file_message() and closes it.
+ *
+ * @param filename Null-terminated filename to open.
+ * @param fd Out parameter; open descriptor on success.
+ * @param size Out parameter; file size in bytes.
+ * @return ERR_SUCCESS on success, or ERR_FILE_NOT_FOUND / ERR_FILE_OPERATION_FAILED.
+ */
+int ss_open_file(const char* filename, int* fd, size_t* size) {
+    char filepath[MAX_PATH];
+    if (ss_build_filepath(filepath, sizeof(filepath), filename, NULL) != ERR_SUCCESS) {
+        return ERR_FILE_OPERATION_FAILED;
+    }
+    
+    *fd = open(filepath, O_RDONLY);
+    if (*fd < 0) {
+        return errno == ENOENT ? ERR_FILE_NOT_FOUND : ERR_FILE_OPERATION_FAILED;
+    }
+    
+    struct stat st;
+    if (fstat(*fd, &st) != 0) {
+        close(*fd);
+        return ERR_FILE_OPERATION_FAILED;
+    }
+    *size = st.st_size;
+    
+    char msg[256];
+    snprintf(msg, sizeof(msg), "Opened file '%s' (%zu bytes)", filename, *size);
+    log_message("SS", "INFO", msg);
+    return ERR_SUCCESS;
+}
+
 /**
  * ss_get_file_info
  * @brief Populate basic statistics about `filename` (size, word count, chars).
@@ -0,0 +1,76 @@
+/*
+ * load_stats.c - Load telemetry reported to the Name Server
+ *
+ * Every heartbeat carries a LoadReport (see format_load_report()). Most of
+ * it is sampled when the report is built: worker pool occupancy, free space
+ * in the storage directory, and the storage-layer bytes this process has
+ * read and written (from /proc/self/io, so page-cache hits do not count).
+ * Op latency is recorded as requests complete, into a log-linear histogram
+ * (see op_stats.c) that each report drains, so the p99 describes the last
+ * interval rather than the whole uptime.
+ */
+
+#include "common.h"
+#include "storage_server.h"
+#include <limits.h>
+#include <sys/statvfs.h>
+
+static LatencyHistogram latency;  // Ops since the previous report
+
+/**
+ * ss_load_record_op
+ * @brief Record the latency of one completed request.
+ *
+ * @param us Time from receiving the request to finishing it, in microseconds.
+ */
+void ss_load_record_op(double us) {
+    hist_record(&latency, us);
+}
+
+// Storage-layer I/O of this process; both stay 0 if /proc is unavailable
+static void read_process_io(unsigned long long* read_bytes, unsigned long long* write_bytes) {
+    *read_bytes = 0;
+    *write_bytes = 0;
+
+    FILE* f = fopen("/proc/self/io", "r");
+    if (!f) {
+        return;
+    }
+    char line[128];
+    while (fgets(line, sizeof(line), f)) {
+        sscanf(line, "read_bytes: %llu", read_bytes);
+        sscanf(line, "write_bytes: %llu", write_bytes);
+    }
+    fclose(f);
+}
+
+/**
+ * ss_load_collect
+ * @brief Build the load report for the next heartbeat.
+ *
+ * Takes the latency p99 over ops recorded since the previous call and
+ * starts a new interval.
+ *
+ * @param out Filled with the current load.
+ */
+void ss_load_collect(LoadReport* out) {
+    memset(out, 0, sizeof(LoadReport));
+
+    WorkerPoolStats pool;
+    ss_worker_pool_get_stats(&pool);
+    out->workers = pool.workers;
+    out->active = pool.busy;
+    out->queue_depth = pool.queue_depth;
+
+    struct statvfs vfs;
+    if (statvfs(config.storage_dir, &vfs) == 0) {
+        out->disk_free = (unsigned long long)vfs.f_bavail * vfs.f_frsize;
+    }
+    read_process_io(&out->bytes_read, &out->bytes_written);
+
+    LatencyHistogram interval;
+    hist_drain(&latency, &interval);
+    out->ops = interval.total > INT_MAX ? INT_MAX : (int)interval.total;
+    unsigned int p99 = hist_percentile(&interval, 0.99);
+    out->p99_us = p99 > INT_MAX ? INT_MAX : (int)p99;
+}
@@ -11,7 +11,7 @@ static int registry_initialized = 0;
  * @brief Initialize the locked file registry (thread-safe, idempotent)
  */
 void init_locked_file_registry(void) {
-    pthread_mutex_lock(&registry_mutex);
+    stats_lock(&registry_mutex, STATS_LOCK_SS_REGISTRY);
     if (!registry_initialized) {
         memset(locked_files, 0, sizeof(locked_files));
         locked_file_count = 0;
@@ -26,7 +26,7 @@ void init_locked_file_registry(void) {
  * @brief Clean up all locks and free resources
  */
 void cleanup_locked_file_registry(void) {
-    pthread_mutex_lock(&registry_mutex);
+    stats_lock(&registry_mutex, STATS_LOCK_SS_REGISTRY);
     
     int cleaned = 0;
     for (int i = 0; i < MAX_LOCKED_FILES; i++) {
@@ -59,7 +59,7 @@ void cleanup_locked_file_registry(void) {
  * @return Pointer to LockedFile if found, NULL otherwise
  */
 LockedFile* find_locked_file(const char* filename, const char* username) {
-    pthread_mutex_lock(&registry_mutex);
+    stats_lock(&registry_mutex, STATS_LOCK_SS_REGISTRY);
     
     for (int i = 0; i < MAX_LOCKED_FILES; i++) {
         if (locked_files[i].is_active &&
@@ -82,7 +82,7 @@ LockedFile* find_locked_file(const char* filename, const char* username) {
 int add_locked_file(const char* filename, const char* username, int sentence_idx,
                     SentenceNode* locked_node, SentenceNode* sentence_list_head, int sentence_count,
                     const char* original_text) {
-    pthread_mutex_lock(&registry_mutex);
+    stats_lock(&registry_mutex, STATS_LOCK_SS_REGISTRY);
     
     // Find empty slot
     int slot = -1;
@@ -151,7 +151,7 @@ int add_locked_file(const char* filename, const char* username, int sentence_idx
  * @return 1 if locked by username, -1 if locked by someone else, 0 if not locked
  */
 int check_lock(const char* filename, int sentence_idx, const char* username) {
-    pthread_mutex_lock(&registry_mutex);
+    stats_lock(&registry_mutex, STATS_LOCK_SS_REGISTRY);
     
     for (int i = 0; i < MAX_LOCKED_FILES; i++) {
         if (locked_files[i].is_active &&
@@ -174,7 +174,7 @@ int check_lock(const char* filename, int sentence_idx, const char* username) {
  * @return ERR_SUCCESS on success, error code otherwise
  */
 int remove_lock(const char* filename, int sentence_idx) {
-    pthread_mutex_lock(&registry_mutex);
+    stats_lock(&registry_mutex, STATS_LOCK_SS_REGISTRY);
     
     for (int i = 0; i < MAX_LOCKED_FILES; i++) {
         if (locked_files[i].is_active &&
@@ -219,7 +219,7 @@ int remove_lock(const char* filename, int sentence_idx) {
  * @return 1 if locked by username, -1 if locked by someone else, 0 if not locked
  */
 int check_lock_by_node(const char* filename, SentenceNode* node, const char* username) {
-    pthread_mutex_lock(&registry_mutex);
+    stats_lock(&registry_mutex, STATS_LOCK_SS_REGISTRY);
     
     for (int i = 0; i < MAX_LOCKED_FILES; i++) {
         if (locked_files[i].is_active &&
@@ -242,7 +242,7 @@ int check_lock_by_node(const char* filename, SentenceNode* node, const char* use
  * @return ERR_SUCCESS on success, error code otherwise
  */
 int remove_lock_by_node(const char* filename, SentenceNode* node) {
-    pthread_mutex_lock(&registry_mutex);
+    stats_lock(&registry_mutex, STATS_LOCK_SS_REGISTRY);
     
     for (int i = 0; i < MAX_LOCKED_FILES; i++) {
         if (locked_files[i].is_active &&
@@ -287,7 +287,7 @@ int remove_lock_by_node(const char* filename, SentenceNode* node) {
  * @return Pointer to sentence list head if found, NULL otherwise
  */
 SentenceNode* get_locked_sentence_list(const char* filename, const char* username, int* count) {
-    pthread_mutex_lock(&registry_mutex);
+    stats_lock(&registry_mutex, STATS_LOCK_SS_REGISTRY);
     
     for (int i = 0; i < MAX_LOCKED_FILES; i++) {
         if (locked_files[i].is_active &&
@@ -312,7 +312,7 @@ SentenceNode* get_locked_sentence_list(const char* filename, const char* usernam
  * @return Number of locks removed
  */
 int cleanup_user_locks(const char* username) {
-    pthread_mutex_lock(&registry_mutex);
+    stats_lock(&registry_mutex, STATS_LOCK_SS_REGISTRY);
     
     int removed = 0;
     for (int i = 0; i < MAX_LOCKED_FILES; i++) {
@@ -348,7 +348,7 @@ int cleanup_user_locks(const char* username) {
  * @return 1 if locked by username, -1 if locked by someone else, 0 if not locked
  */
 int check_lock_by_content(const char* filename, const char* sentence_content, const char* username) {
-    pthread_mutex_lock(&registry_mutex);
+    stats_lock(&registry_mutex, STATS_LOCK_SS_REGISTRY);
     
     for (int i = 0; i < MAX_LOCKED_FILES; i++) {
         if (locked_files[i].is_active &&
@@ -384,7 +384,7 @@ int check_lock_by_content(const char* filename, const char* sentence_content, co
  * @note This is a legacy function - extracts content from locked_node for compatibility
  */
 LockedFile* get_locked_file_by_content(const char* filename, const char* username, const char* sentence_content) {
-    pthread_mutex_lock(&registry_mutex);
+    stats_lock(&registry_mutex, STATS_LOCK_SS_REGISTRY);
     
     for (int i = 0; i < MAX_LOCKED_FILES; i++) {
         if (locked_files[i].is_active &&
@@ -419,7 +419,7 @@ LockedFile* get_locked_file_by_content(const char* filename, const char* usernam
  * @return Pointer to LockedFile if found, NULL otherwise
  */
 LockedFile* get_locked_file_by_node(const char* filename, const char* username, SentenceNode* node) {
-    pthread_mutex_lock(&registry_mutex);
+    stats_lock(&registry_mutex, STATS_LOCK_SS_REGISTRY);
     
     for (int i = 0; i < MAX_LOCKED_FILES; i++) {
         if (locked_files[i].is_active &&
@@ -442,7 +442,7 @@ LockedFile* get_locked_file_by_node(const char* filename, const char* username,
  * @return ERR_SUCCESS on success, error code otherwise
  */
 int remove_lock_by_content(const char* filename, const char* sentence_content) {
-    pthread_mutex_lock(&registry_mutex);
+    stats_lock(&registry_mutex, STATS_LOCK_SS_REGISTRY);
     
     for (int i = 0; i < MAX_LOCKED_FILES; i++) {
         if (locked_files[i].is_active &&
@@ -507,7 +507,7 @@ int remove_lock_by_content(const char* filename, const char* sentence_content) {
  * @return Number of active locks found
  */
 int get_file_locks(const char* filename, char* lock_info_out, size_t bufsize) {
-    pthread_mutex_lock(&registry_mutex);
+    stats_lock(&registry_mutex, STATS_LOCK_SS_REGISTRY);
     
     int count = 0;
     char temp[4096] = "";
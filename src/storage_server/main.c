@@ -1,6 +1,7 @@
 #include "common.h"
 #include "storage_server.h"
 #include <signal.h>
+#include <sys/time.h>
 
 // Global configuration
 SSConfig config;
@@ -8,6 +9,29 @@ SSConfig config;
 // Flag for graceful shutdown
 volatile sig_atomic_t server_running = 1;
 
+/**
+ * open_heartbeat_channel
+ * @brief Connect the long-lived heartbeat socket to the Name Server.
+ *
+ * Uses the wire version agreed at registration instead of re-negotiating,
+ * and bounds reply waits so a wedged Name Server makes us reconnect rather
+ * than stall the heartbeat thread.
+ *
+ * @return Connected socket, or -1 if the Name Server is unreachable.
+ */
+static int open_heartbeat_channel(SSConfig* config) {
+    int sock = connect_to_server(config->nm_ip, config->nm_port);
+    if (sock < 0) {
+        return -1;
+    }
+    set_socket_protocol(sock, config->nm_protocol);
+
+    struct timeval tv = { .tv_sec = HEARTBEAT_TIMEOUT, .tv_usec = 0 };
+    setsockopt(sock, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+    setsockopt(sock, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+    return sock;
+}
+
 /**
  * send_heartbeats
  * @brief Background thread that periodically sends heartbeat messages to the Name Server
@@ -15,7 +39,12 @@ volatile sig_atomic_t server_running = 1;
  *
  * This thread sends heartbeats at half the check interval to ensure the Name Server
  * receives updates well before the timeout period expires. The heartbeat includes
- * the server ID in the flags field for identification.
+ * the server ID in the flags field for identification and a LoadReport payload
+ * the Name Server uses for placement and routing.
+ *
+ * All heartbeats share one connection, which is only re-opened after it
+ * fails. The Name Server treats that connection closing as the server going
+ * down, so failover does not wait for the heartbeat timeout.
  *
  * @param arg Pointer to SSConfig containing Name Server connection details.
  * @return NULL (thread runs indefinitely until process terminates).
@@ -25,57 +54,84 @@ void* send_heartbeats(void* arg) {
     
     log_message("SS", "INFO", "Heartbeat thread started");
     
+    // Replies land in one reused buffer instead of a fresh allocation each beat
+    RecvBuffer reply_buf;
+    recv_buffer_init(&reply_buf);
+    int nm_socket = -1;
+    int channel_lost = 0;  // Log losing and regaining the channel once each
+    
     while (server_running) {
         sleep(HEARTBEAT_CHECK_INTERVAL / 2);  // Send heartbeats twice as often as timeout check
         
         if (!server_running) break;  // Check again after sleep
         
+        if (nm_socket < 0) {
+            nm_socket = open_heartbeat_channel(config);
+            if (nm_socket < 0) {
+                if (!channel_lost) {
+                    char msg[256];
+                    snprintf(msg, sizeof(msg), 
+                             "⚠ Failed to connect to NM for heartbeat (SS #%d)", 
+                             config->server_id);
+                    log_message("SS", "WARN", msg);
+                    channel_lost = 1;
+                }
+                continue;
+            }
+            if (channel_lost) {
+                log_message("SS", "INFO", "✓ Heartbeat channel to NM re-established");
+                channel_lost = 0;
+            }
+        }
+        
+        LoadReport load;
+        char load_payload[LOAD_REPORT_MAX];
+        ss_load_collect(&load);
+        int load_len = format_load_report(&load, load_payload, sizeof(load_payload));
+        
         MessageHeader header;
         init_message_header(&header, MSG_REQUEST, OP_HEARTBEAT, "system");
         header.flags = config->server_id;  // Pass server ID in flags
+        header.data_length = load_len > 0 ? load_len : 0;
         
-        // Send heartbeat to NM (create new connection each time)
-        int nm_socket = connect_to_server(config->nm_ip, config->nm_port);
-        if (nm_socket > 0) {
-            if (send_message(nm_socket, &header, NULL) == 0) {
-                // Wait for ACK
-                char* response = NULL;
-                if (recv_message(nm_socket, &header, &response) > 0) {
-                    if (header.msg_type == MSG_ACK) {
-                        if (header.data_length > 0 && response) {
-                             // Check for REPLICA info payload from NS
-                             if (strncmp(response, "REPLICA", 7) == 0) {
-                                  char ip[MAX_IP];
-                                  int port;
-                                  if (sscanf(response, "REPLICA %s %d", ip, &port) == 2) {
-                                       if (strcmp(config->replica_ip, ip) != 0 || config->replica_port != port) {
-                                            strncpy(config->replica_ip, ip, MAX_IP - 1);
-                                            config->replica_port = port;
-                                            
-                                            char link_msg[256];
-                                            snprintf(link_msg, sizeof(link_msg), "[LINK] Linked with Replica at %s:%d", ip, port);
-                                            log_message("SS", "INFO", link_msg);
-                                       }
-                                  }
-                             }
-                        }
-
-                        /* snprintf(msg, sizeof(msg), "[HEARTBEAT] Heartbeat sent to NM (SS #%d)", config->server_id);
-                        log_message("SS", "DEBUG", msg); */
+        char* response = NULL;
+        if (send_message(nm_socket, &header, load_payload) < 0 ||
+            recv_message_into(nm_socket, &header, &reply_buf, &response) <= 0) {
+            close(nm_socket);
+            nm_socket = -1;
+            log_message("SS", "WARN", "⚠ Heartbeat channel to NM lost; reconnecting");
+            channel_lost = 1;
+            continue;
+        }
+        
+        if (header.msg_type == MSG_ACK && header.data_length > 0 && response) {
+            // Check for REPLICA info payload from NS
+            if (strncmp(response, "REPLICA", 7) == 0) {
+                char ip[MAX_IP];
+                char local[MAX_LOCAL_ADDR] = "";
+                int port;
+                int proto = PROTOCOL_V1;
+                if (sscanf(response, "REPLICA %15s %d %d %159s", ip, &port, &proto, local) >= 2) {
+                    config->replica_protocol = proto;
+                    safe_strncpy(config->replica_local, local, sizeof(config->replica_local));
+                    if (strcmp(config->replica_ip, ip) != 0 || config->replica_port != port) {
+                        strncpy(config->replica_ip, ip, MAX_IP - 1);
+                        config->replica_port = port;
+                        config->replica_compression = 0;  // Relearned from its replies
+                        
+                        char link_msg[256];
+                        snprintf(link_msg, sizeof(link_msg), "[LINK] Linked with Replica at %s:%d", ip, port);
+                        log_message("SS", "INFO", link_msg);
                     }
                 }
-                if (response) free(response);
             }
-            close(nm_socket);
-        } else {
-            char msg[256];
-            snprintf(msg, sizeof(msg), 
-                     "⚠ Failed to connect to NM for heartbeat (SS #%d)", 
-                     config->server_id);
-            log_message("SS", "WARN", msg);
         }
     }
     
+    if (nm_socket >= 0) {
+        close(nm_socket);
+    }
+    recv_buffer_free(&reply_buf);
     log_message("SS", "INFO", "Heartbeat thread stopping");
     return NULL;
 }
@@ -96,16 +152,38 @@ void signal_handler(int signum) {
 }
 
 int main(int argc, char* argv[]) {
-    if (argc != 5) {
-        fprintf(stderr, "Usage: %s <nm_ip> <nm_port> <client_port> <server_id>\n", argv[0]);
+    if (argc < 5 || argc > 9) {
+        fprintf(stderr, "Usage: %s <nm_ip> <nm_port> <client_port> <server_id> [worker_threads] [queue_size] [compress_min] [header_ms:payload_ms:idle_ms]\n", argv[0]);
         return 1;
     }
     
     // Parse arguments
-    strcpy(config.nm_ip, argv[1]);
+    safe_strncpy(config.nm_ip, argv[1], sizeof(config.nm_ip));
     config.nm_port = atoi(argv[2]);
     config.client_port = atoi(argv[3]);
     config.server_id = atoi(argv[4]);
+    config.worker_threads = (argc > 5) ? atoi(argv[5]) : SS_WORKER_THREADS;
+    config.queue_capacity = (argc > 6) ? atoi(argv[6]) : SS_ADMISSION_QUEUE;
+    config.compress_min = (argc > 7) ? atoi(argv[7]) : WIRE_COMPRESS_MIN;
+    if (config.worker_threads < 1 || config.queue_capacity < 1 ||
+        config.queue_capacity > SS_ADMISSION_QUEUE_MAX) {
+        fprintf(stderr, "worker_threads must be >= 1 and queue_size between 1 and %d\n",
+                SS_ADMISSION_QUEUE_MAX);
+        return 1;
+    }
+    config.header_deadline_ms = SS_HEADER_DEADLINE_MS;
+    config.payload_deadline_ms = SS_PAYLOAD_DEADLINE_MS;
+    config.idle_deadline_ms = SS_IDLE_DEADLINE_MS;
+    if (argc > 8 && (sscanf(argv[8], "%d:%d:%d", &config.header_deadline_ms,
+                            &config.payload_deadline_ms, &config.idle_deadline_ms) != 3 ||
+                     config.header_deadline_ms < 0 || config.payload_deadline_ms < 0 ||
+                     config.idle_deadline_ms < 0)) {
+        fprintf(stderr, "deadlines must be header_ms:payload_ms:idle_ms (0 disables one)\n");
+        return 1;
+    }
+    
+    // Compress payloads to peers that can decode them (0 turns it off)
+    set_wire_compression(config.compress_min);
     
     // Set up signal handlers for graceful shutdown
     signal(SIGINT, signal_handler);
@@ -127,6 +205,16 @@ int main(int argc, char* argv[]) {
              argv[1], config.nm_port);
     log_message("SS", "INFO", startup_msg);
     
+    // Listen on a Unix socket too, so co-located peers can skip TCP. Its
+    // address is advertised at registration, but like the TCP port it is
+    // only bound once recovery is over: two servers syncing from each other
+    // at startup must get a refused connection, not one nobody serves.
+    char local_path[MAX_LOCAL_ADDR];
+    unix_socket_path(local_path, sizeof(local_path), "ss", config.client_port);
+    if (make_local_address(config.local_addr, sizeof(config.local_addr), local_path) != 0) {
+        config.local_addr[0] = '\0';
+    }
+    
     // Register with Name Server
     int nm_socket = connect_to_server(config.nm_ip, config.nm_port);
     if (nm_socket < 0) {
@@ -138,6 +226,14 @@ int main(int argc, char* argv[]) {
         return 1;
     }
     
+    // Negotiate the wire format once; heartbeats reuse the result
+    config.nm_protocol = negotiate_protocol(nm_socket);
+    if (config.nm_protocol < 0) {
+        log_message("SS", "ERROR", "Failed to negotiate protocol with Name Server");
+        close(nm_socket);
+        return 1;
+    }
+    
     // Send registration message
     MessageHeader header;
     memset(&header, 0, sizeof(header));
@@ -150,14 +246,21 @@ int main(int argc, char* argv[]) {
     if (get_local_network_ip(my_ip, sizeof(my_ip)) != 0) {
         // Fallback to NM IP if we can't determine our network IP
         // This works when SS and NM are on same machine
-        strcpy(my_ip, config.nm_ip);
+        if (strncmp(config.nm_ip, UNIX_SOCKET_PREFIX, strlen(UNIX_SOCKET_PREFIX)) == 0) {
+            strcpy(my_ip, "127.0.0.1");
+        } else {
+            safe_strncpy(my_ip, config.nm_ip, sizeof(my_ip));
+        }
         log_message("SS", "WARN", "Could not detect network IP, using NM IP as fallback");
     }
     
-    char payload[256];
-    // Include our IP in the registration payload: "server_id nm_port client_port my_ip"
-    snprintf(payload, sizeof(payload), "%d %d %d %s", 
-             config.server_id, config.nm_port, config.client_port, my_ip);
+    char payload[512];
+    // Registration payload: "server_id nm_port client_port my_ip protocol [local_addr]"
+    // The protocol lets the NM tell clients and replicas which framing we speak;
+    // the local address lets peers on this host use our Unix socket
+    snprintf(payload, sizeof(payload), "%d %d %d %s %d %s", 
+             config.server_id, config.nm_port, config.client_port, my_ip,
+             PROTOCOL_VERSION, config.local_addr);
     header.data_length = strlen(payload);
     
     send_message(nm_socket, &header, payload);
@@ -206,14 +309,16 @@ int main(int argc, char* argv[]) {
     if (header.data_length > 0 && response) {
         if (strncmp(response, "SYNC", 4) == 0) {
             char sync_ip[MAX_IP];
+            char sync_local[MAX_LOCAL_ADDR] = "";
             int sync_port;
-            if (sscanf(response, "SYNC %s %d", sync_ip, &sync_port) == 2) {
+            int sync_proto = PROTOCOL_V1;
+            if (sscanf(response, "SYNC %15s %d %d %159s", sync_ip, &sync_port, &sync_proto, sync_local) >= 2) {
                 char msg[512];
                 snprintf(msg, sizeof(msg), "[RECOVERY] Name Server requested SYNC from Active Replica at %s:%d", sync_ip, sync_port);
                 log_message("SS", "WARN", msg);
                 
                 // Perform Full Sync
-                ss_start_recovery_sync(sync_ip, sync_port);
+                ss_start_recovery_sync(sync_ip, sync_port, sync_proto, sync_local);
             }
         }
     }
@@ -246,13 +351,32 @@ int main(int argc, char* argv[]) {
         return 1;
     }
     
-    char msg[128];
+    // Peers fall back to TCP if the advertised Unix socket cannot be created
+    int local_socket = config.local_addr[0] ? create_unix_server_socket(local_path) : -1;
+    
+    char msg[256];
     snprintf(msg, sizeof(msg), "Storage Server %d listening on port %d", 
              config.server_id, config.client_port);
     log_message("SS", "INFO", msg);
+    if (local_socket >= 0) {
+        snprintf(msg, sizeof(msg), "Storage Server %d listening on %s%s",
+                 config.server_id, UNIX_SOCKET_PREFIX, local_path);
+        log_message("SS", "INFO", msg);
+    }
 
     // Initialize lock registry
     init_locked_file_registry();
+    stats_start();
+    
+    // Connections are served by a fixed pool of workers behind a bounded queue
+    if (ss_worker_pool_start(config.worker_threads, config.queue_capacity) != ERR_SUCCESS) {
+        log_message("SS", "ERROR", "Failed to start worker pool");
+        return 1;
+    }
+    snprintf(msg, sizeof(msg), "Worker pool: %d threads, admission queue %d",
+             config.worker_threads, config.queue_capacity);
+    log_message("SS", "INFO", msg);
+    time_t last_stats = time(NULL);
     
     // Accept client connections with periodic timeout to check server_running
     while (server_running) {
@@ -260,12 +384,24 @@ int main(int argc, char* argv[]) {
         fd_set readfds;
         FD_ZERO(&readfds);
         FD_SET(client_socket, &readfds);
+        int max_fd = client_socket;
+        if (local_socket >= 0) {
+            FD_SET(local_socket, &readfds);
+            if (local_socket > max_fd) max_fd = local_socket;
+        }
         
         struct timeval timeout;
         timeout.tv_sec = 1;  // Check server_running every 1 second
         timeout.tv_usec = 0;
         
-        int select_result = select(client_socket + 1, &readfds, NULL, NULL, &timeout);
+        int select_result = select(max_fd + 1, &readfds, NULL, NULL, &timeout);
+        
+        // Turn away connections that have waited too long for a worker
+        ss_worker_pool_expire();
+        if (time(NULL) - last_stats >= SS_POOL_STATS_INTERVAL) {
+            ss_worker_pool_log_stats();
+            last_stats = time(NULL);
+        }
         
         if (select_result < 0) {
             if (errno == EINTR) {
@@ -282,29 +418,31 @@ int main(int argc, char* argv[]) {
             continue;
         }
         
-        // Have an incoming connection
-        struct sockaddr_in client_addr;
-        socklen_t addr_len = sizeof(client_addr);
-        int* client_fd = malloc(sizeof(int));
-        
-        *client_fd = accept(client_socket, (struct sockaddr*)&client_addr, &addr_len);
-        
-        if (*client_fd >= 0) {
+        // Have an incoming connection (on either listener)
+        int listeners[2] = { client_socket, local_socket };
+        for (int l = 0; l < 2; l++) {
+            if (listeners[l] < 0 || !FD_ISSET(listeners[l], &readfds)) {
+                continue;
+            }
+            int client_fd = accept(listeners[l], NULL, NULL);
+            if (client_fd < 0) {
+                continue;
+            }
+            
             // Log incoming connection
             char client_ip[MAX_IP];
-            inet_ntop(AF_INET, &client_addr.sin_addr, client_ip, sizeof(client_ip));
-            int client_port = ntohs(client_addr.sin_port);
+            int client_port;
+            get_peer_address(client_fd, client_ip, sizeof(client_ip), &client_port);
             
             char conn_details[256];
             snprintf(conn_details, sizeof(conn_details), "New connection accepted");
             log_operation("SS", "INFO", "CLIENT_CONNECT", "unknown", 
                          client_ip, client_port, conn_details, ERR_SUCCESS);
             
-            pthread_t thread;
-            pthread_create(&thread, NULL, handle_client_request, client_fd);
-            pthread_detach(thread);
-        } else {
-            free(client_fd);
+            set_socket_role(client_fd, SOCKET_ROLE_INTERACTIVE);
+            
+            // Never blocks: a full queue rejects with ERR_SS_BUSY right away
+            ss_worker_pool_submit(client_fd);
         }
     }
     
@@ -318,6 +456,11 @@ int main(int argc, char* argv[]) {
     log_message("SS", "INFO", shutdown_msg);
     
     close(client_socket);
+    if (local_socket >= 0) {
+        close(local_socket);
+        unlink(local_path);
+    }
+    ss_worker_pool_log_stats();
     cleanup_locked_file_registry();
     
     char final_msg[256];
@@ -322,19 +322,27 @@ int pt_delete(PieceTable* pt, size_t pos, size_t len) {
         } else if (piece_start >= del_start && piece_end <= del_end) {
             /* Piece entirely inside delete range - skip */
         } else if (piece_start < del_start && piece_end > del_end) {
-            /* Delete range is inside this piece - split into two */
-            Piece left = {
-                .buffer = p->buffer,
-                .start = p->start,
-                .length = del_start - piece_start
-            };
+            /* Delete range is inside this piece - split into two. This is
+             * the only case that adds a piece, and nothing after it is
+             * touched, so shift the rest up by one and stop here. */
+            if (ensure_piece_capacity(pt, 1) < 0) {
+                pthread_rwlock_unlock(&pt->lock);
+                return -1;
+            }
+            p = &pt->pieces[i];
             Piece right = {
                 .buffer = p->buffer,
                 .start = p->start + (del_end - piece_start),
                 .length = piece_end - del_end
             };
-            pt->pieces[new_count++] = left;
-            pt->pieces[new_count++] = right;
+            p->length = del_start - piece_start;
+            memmove(&pt->pieces[i + 2], &pt->pieces[i + 1],
+                    (pt->piece_count - i - 1) * sizeof(Piece));
+            pt->pieces[i + 1] = right;
+            pt->piece_count++;
+
+            pthread_rwlock_unlock(&pt->lock);
+            return 0;
         } else if (piece_start < del_start) {
             /* Delete starts inside this piece */
             Piece left = {
@@ -342,31 +342,15 @@ void free_sentences(Sentence* sentences, int count) {
 }
 
 /**
- * ss_write_lock
- * @brief Acquire a write lock for a specific sentence in `filename`.
+ * write_lock_at
+ * @brief Body of ss_write_lock(), for a file whose path is already resolved.
  *
- * Reads the file, parses sentences, and tries to lock the requested index.
- * In the current design the parsed sentences are not stored long-term; this
- * function provides the locking semantic and should be followed by write
- * operations that assume the lock is held by `username`.
- *
- * @param filename Filename to operate on.
- * @param sentence_idx Index of the sentence to lock.
- * @param username Username requesting the lock.
- * @return ERR_SUCCESS on success, or ERR_FILE_NOT_FOUND / ERR_INVALID_SENTENCE / ERR_SENTENCE_LOCKED.
+ * @param fd Open descriptor to read the file through, or -1 to open filepath.
  */
-int ss_write_lock(const char* filename, int sentence_idx, const char* username) {
-    char filepath[MAX_PATH];
-    if (ss_build_filepath(filepath, sizeof(filepath), filename, NULL) != ERR_SUCCESS) {
-        return ERR_FILE_OPERATION_FAILED;
-    }
-    
-    if (!file_exists(filepath)) {
-        return ERR_FILE_NOT_FOUND;
-    }
-    
+static int write_lock_at(const char* filename, const char* filepath, int fd,
+                         int sentence_idx, const char* username) {
     // Read current content
-    char* content = read_file_content(filepath);
+    char* content = fd >= 0 ? read_fd_content(fd) : read_file_content(filepath);
     if (!content) {
         return ERR_FILE_OPERATION_FAILED;
     }
@@ -541,6 +525,53 @@ int ss_write_lock(const char* filename, int sentence_idx, const char* username)
     return ERR_SUCCESS;
 }
 
+/**
+ * ss_write_lock
+ * @brief Acquire a write lock for a specific sentence in `filename`.
+ *
+ * Reads the file, parses sentences, and tries to lock the requested index.
+ * In the current design the parsed sentences are not stored long-term; this
+ * function provides the locking semantic and should be followed by write
+ * operations that assume the lock is held by `username`.
+ *
+ * @param filename Filename to operate on.
+ * @param sentence_idx Index of the sentence to lock.
+ * @param username Username requesting the lock.
+ * @return ERR_SUCCESS on success, or ERR_FILE_NOT_FOUND / ERR_INVALID_SENTENCE / ERR_SENTENCE_LOCKED.
+ */
+int ss_write_lock(const char* filename, int sentence_idx, const char* username) {
+    char filepath[MAX_PATH];
+    if (ss_build_filepath(filepath, sizeof(filepath), filename, NULL) != ERR_SUCCESS) {
+        return ERR_FILE_OPERATION_FAILED;
+    }
+    
+    if (!file_exists(filepath)) {
+        return ERR_FILE_NOT_FOUND;
+    }
+    
+    return write_lock_at(filename, filepath, -1, sentence_idx, username);
+}
+
+/**
+ * ss_write_lock_handle
+ * @brief ss_write_lock() for a file opened with OP_SS_OPEN.
+ *
+ * Reads the file through the handle's descriptor instead of resolving and
+ * opening its path again.
+ *
+ * @param fh Handle of the file to lock a sentence in.
+ * @param sentence_idx Index of the sentence to lock.
+ * @param username Username requesting the lock.
+ * @return As for ss_write_lock().
+ */
+int ss_write_lock_handle(FileHandle* fh, int sentence_idx, const char* username) {
+    int result = ss_handle_refresh(fh);
+    if (result != ERR_SUCCESS) {
+        return result;
+    }
+    return write_lock_at(fh->filename, fh->filepath, fh->fd, sentence_idx, username);
+}
+
 /**
  * ss_write_word
  * @brief Replace a single word inside a sentence in-memory.
@@ -709,29 +740,13 @@ int ss_write_word(const char* filename, int sentence_idx, int word_idx,
 }
 
 /**
- * ss_write_unlock
- * @brief Finalize a write session by re-parsing content, updating metadata
- *        and releasing any in-memory resources.
- *
- * Note: This implementation re-parses the file and writes back the content
- * to ensure sentence boundaries are normalized after edits.
+ * write_unlock_at
+ * @brief Body of ss_write_unlock(), for a file whose path is already resolved.
  *
- * @param filename Target filename.
- * @param sentence_idx Unused in current implementation, kept for API
- *                     consistency.
- * @param username Username that completed the write.
- * @return ERR_SUCCESS on success or an ERR_* code on failure.
+ * @param fd Open descriptor to read the file through, or -1 to open filepath.
  */
-int ss_write_unlock(const char* filename, int sentence_idx, const char* username) {
-    char filepath[MAX_PATH];
-    if (ss_build_filepath(filepath, sizeof(filepath), filename, NULL) != ERR_SUCCESS) {
-        return ERR_FILE_OPERATION_FAILED;
-    }
-    
-    if (!file_exists(filepath)) {
-        return ERR_FILE_NOT_FOUND;
-    }
-    
+static int write_unlock_at(const char* filename, const char* filepath, int fd,
+                           int sentence_idx, const char* username) {
     // Get locked file entry
     LockedFile* locked_file = find_locked_file(filename, username);
     if (!locked_file || !locked_file->is_active) {
@@ -755,7 +770,7 @@ int ss_write_unlock(const char* filename, int sentence_idx, const char* username
     }
     
     // Read current file content (may have changed since lock was acquired)
-    char* content = read_file_content(filepath);
+    char* content = fd >= 0 ? read_fd_content(fd) : read_file_content(filepath);
     if (!content) {
         remove_lock_by_node(filename, locked_node);
         return ERR_FILE_OPERATION_FAILED;
@@ -999,6 +1014,84 @@ int ss_write_unlock(const char* filename, int sentence_idx, const char* username
     return ERR_SUCCESS;
 }
 
+/**
+ * ss_write_unlock
+ * @brief Finalize a write session by re-parsing content, updating metadata
+ *        and releasing any in-memory resources.
+ *
+ * Note: This implementation re-parses the file and writes back the content
+ * to ensure sentence boundaries are normalized after edits.
+ *
+ * @param filename Target filename.
+ * @param sentence_idx Unused in current implementation, kept for API
+ *                     consistency.
+ * @param username Username that completed the write.
+ * @return ERR_SUCCESS on success or an ERR_* code on failure.
+ */
+int ss_write_unlock(const char* filename, int sentence_idx, const char* username) {
+    char filepath[MAX_PATH];
+    if (ss_build_filepath(filepath, sizeof(filepath), filename, NULL) != ERR_SUCCESS) {
+        return ERR_FILE_OPERATION_FAILED;
+    }
+    
+    if (!file_exists(filepath)) {
+        return ERR_FILE_NOT_FOUND;
+    }
+    
+    return write_unlock_at(filename, filepath, -1, sentence_idx, username);
+}
+
+/**
+ * ss_write_unlock_handle
+ * @brief ss_write_unlock() for a file opened with OP_SS_OPEN.
+ *
+ * The rewritten file replaces the one the handle's descriptor refers to;
+ * the handle notices and reopens on its next use.
+ *
+ * @param fh Handle of the file being written.
+ * @param sentence_idx Index of the edited sentence.
+ * @param username Username that completed the write.
+ * @return As for ss_write_unlock().
+ */
+int ss_write_unlock_handle(FileHandle* fh, int sentence_idx, const char* username) {
+    int result = ss_handle_refresh(fh);
+    if (result != ERR_SUCCESS) {
+        return result;
+    }
+    return write_unlock_at(fh->filename, fh->filepath, fh->fd, sentence_idx, username);
+}
+
+/**
+ * ss_write_abort
+ * @brief Discard a write session: release the lock without saving edits.
+ *
+ * Edits made by ss_write_word live only in the locked in-memory copy, so
+ * dropping that copy rolls the whole session back.
+ *
+ * @param filename Target filename.
+ * @param username Username holding the lock.
+ * @return ERR_SUCCESS on success, or ERR_PERMISSION_DENIED if no lock is held.
+ */
+int ss_write_abort(const char* filename, const char* username) {
+    LockedFile* locked_file = find_locked_file(filename, username);
+    if (!locked_file || !locked_file->is_active) {
+        return ERR_PERMISSION_DENIED;
+    }
+    
+    SentenceNode* locked_node = locked_file->locked_node;
+    if (locked_node) {
+        locked_node->is_locked = 0;
+        locked_node->locked_by[0] = '\0';
+        pthread_mutex_unlock(&locked_node->lock);
+    }
+    
+    char msg[512];
+    snprintf(msg, sizeof(msg), "Write session on '%s' by %s aborted; edits discarded",
+             filename, username);
+    log_message("SS", "INFO", msg);
+    return remove_lock_by_node(filename, locked_node);
+}
+
 /**
  * ss_save_undo
  * @brief Save the current file contents to a `.undo` snapshot for rollback.
@@ -1202,14 +1295,18 @@ int ss_forward_to_replica(MessageHeader *header, const char *payload, const char
     }
 
     log_message("SS", "INFO", "[REPLICATION] Forwarding operation to replica...");
-    int replica_sock = connect_to_server(config.replica_ip, config.replica_port);
+    int replica_sock = connect_to_endpoint(config.replica_ip, config.replica_port, config.replica_local);
     if (replica_sock <= 0) {
         log_message("SS", "WARN", "[REPLICATION] Failed to connect to Replica");
         return -1;
     }
+    set_socket_protocol(replica_sock, config.replica_protocol);
+    // A replica that advertised compression on an earlier reply gets it right away
+    set_socket_compression(replica_sock, config.replica_compression);
 
     MessageHeader rep_header = *header;
     rep_header.flags |= FLAG_IS_REPLICATION;
+    rep_header.flags &= ~FLAG_KEEP_ALIVE;  // Replication connections are one-shot
     
     if (send_message(replica_sock, &rep_header, payload) < 0) {
         log_message("SS", "WARN", "[REPLICATION] Failed to send message to Replica");
@@ -1228,6 +1325,7 @@ int ss_forward_to_replica(MessageHeader *header, const char *payload, const char
     }
 
     log_message("SS", "INFO", "[REPLICATION] Replica confirmed operation");
+    config.replica_compression = get_socket_compression(replica_sock);
     close(replica_sock);
     return 0;
 }
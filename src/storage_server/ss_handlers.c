@@ -7,6 +7,8 @@
 
 #include "common.h"
 #include "storage_server.h"
+#include "cJSON.h"
+#include <limits.h>
 
 extern SSConfig config;
 
@@ -90,40 +92,119 @@ int handle_ss_delete(int client_fd, MessageHeader* header) {
 /**
  * handle_ss_read
  * @brief Handler for OP_SS_READ operation.
+ *
+ * @param fh Handle the request named the file by, or NULL.
  */
-int handle_ss_read(int client_fd, MessageHeader* header) {
+int handle_ss_read(int client_fd, MessageHeader* header, FileHandle* fh) {
     char details[1200];
     snprintf(details, sizeof(details), "file=%s user=%s", header->filename, header->username);
     log_message("SS", "INFO", details);
     
-    char* content = NULL;
-    int result = ss_read_file(header->filename, &content);
+    // Stream the file straight from the page cache instead of copying it.
+    // A handle's descriptor is reused (sends use explicit offsets).
+    int file_fd = -1;
+    size_t size = 0;
+    int result;
+    if (fh) {
+        result = ss_handle_refresh(fh);
+        file_fd = fh->fd;
+        size = fh->st.st_size;
+    } else {
+        result = ss_open_file(header->filename, &file_fd, &size);
+    }
     
     if (result == ERR_SUCCESS) {
-        char msg[1200];
-        snprintf(msg, sizeof(msg), "✓ File '%s' read successfully (%zu bytes)", 
-                 header->filename, content ? strlen(content) : 0);
-        log_message("SS", "INFO", msg);
-        
         MessageHeader resp;
         memset(&resp, 0, sizeof(resp));
         resp.msg_type = MSG_RESPONSE;
         resp.error_code = ERR_SUCCESS;
-        resp.data_length = strlen(content);
-        send_message(client_fd, &resp, content);
-        free(content);
+        if (send_file_message(client_fd, &resp, file_fd, size) < 0) {
+            result = ERR_NETWORK_ERROR;
+        }
+        if (!fh) {
+            close(file_fd);
+        }
+        
+        char msg[1200];
+        snprintf(msg, sizeof(msg), "✓ File '%s' read successfully (%zu bytes)", 
+                 header->filename, size);
+        log_message("SS", "INFO", msg);
     } else {
         send_simple_response(client_fd, MSG_ERROR, result);
     }
     return result;
 }
 
+/**
+ * handle_ss_open
+ * @brief Handler for OP_SS_OPEN: bind header->filename to a new handle.
+ *
+ * Replies MSG_ACK with the handle in the reply header. Handles travel only
+ * in v2 headers, so a v1 connection is refused.
+ *
+ * @return ERR_SUCCESS or an ERR_* code.
+ */
+int handle_ss_open(int client_fd, MessageHeader* header, HandleTable* handles) {
+    unsigned long long id = 0;
+    int result = get_socket_protocol(client_fd) == PROTOCOL_V2
+                     ? ss_handle_open(handles, header->filename, &id)
+                     : ERR_INVALID_COMMAND;
+    
+    MessageHeader resp;
+    INIT_RESPONSE_HEADER(&resp, result == ERR_SUCCESS ? MSG_ACK : MSG_ERROR, result);
+    resp.handle = id;
+    send_message(client_fd, &resp, NULL);
+    return result;
+}
+
+/**
+ * handle_ss_stats
+ * @brief Handler for OP_STATS: reply with this server's op latencies, lock
+ *        waits and worker pool counters as JSON.
+ *
+ * @return ERR_SUCCESS or an ERR_* code.
+ */
+int handle_ss_stats(int client_fd, MessageHeader* header) {
+    (void)header;
+    cJSON* root = stats_to_json("SS");
+    cJSON_AddNumberToObject(root, "server_id", config.server_id);
+
+    WorkerPoolStats pool;
+    ss_worker_pool_get_stats(&pool);
+    cJSON* workers = cJSON_AddObjectToObject(root, "worker_pool");
+    cJSON_AddNumberToObject(workers, "workers", pool.workers);
+    cJSON_AddNumberToObject(workers, "busy", pool.busy);
+    cJSON_AddNumberToObject(workers, "queue_depth", pool.queue_depth);
+    cJSON_AddNumberToObject(workers, "max_queue_depth", pool.max_queue_depth);
+    cJSON_AddNumberToObject(workers, "rejected", pool.rejected);
+    cJSON_AddNumberToObject(workers, "expired", pool.expired);
+    cJSON_AddNumberToObject(workers, "avg_wait_ms", pool.avg_wait_ms);
+    cJSON_AddNumberToObject(workers, "max_wait_ms", pool.max_wait_ms);
+
+    char* json = cJSON_PrintUnformatted(root);
+    cJSON_Delete(root);
+    if (!json) {
+        send_simple_response(client_fd, MSG_ERROR, ERR_FILE_OPERATION_FAILED);
+        return ERR_FILE_OPERATION_FAILED;
+    }
+
+    MessageHeader resp;
+    INIT_RESPONSE_HEADER(&resp, MSG_RESPONSE, ERR_SUCCESS);
+    resp.data_length = strlen(json);
+    send_message(client_fd, &resp, json);
+    free(json);
+    return ERR_SUCCESS;
+}
+
 /**
  * handle_ss_write_lock
  * @brief Handler for OP_SS_WRITE_LOCK operation.
+ *
+ * @param fh Handle the request named the file by, or NULL.
  */
-void handle_ss_write_lock(int client_fd, MessageHeader* header) {
-    int result = ss_write_lock(header->filename, header->sentence_index, header->username);
+void handle_ss_write_lock(int client_fd, MessageHeader* header, FileHandle* fh) {
+    int result = fh ? ss_write_lock_handle(fh, header->sentence_index, header->username)
+                    : ss_write_lock(header->filename, header->sentence_index, header->username);
     
     // Synchronous Replication
     if (result == ERR_SUCCESS) {
@@ -136,43 +217,51 @@ void handle_ss_write_lock(int client_fd, MessageHeader* header) {
 }
 
 /**
- * handle_ss_write_word
- * @brief Handler for OP_SS_WRITE_WORD operation.
+ * apply_write_word
+ * @brief Parse a "word_index <new_word...>" payload and apply it to the
+ *        caller's locked sentence.
  *
- * Parses payload format: "word_index <new_word...>" and updates the word.
+ * @return ERR_SUCCESS or an ERR_* code from ss_write_word().
  */
-void handle_ss_write_word(int client_fd, MessageHeader* header, const char* payload) {
+static int apply_write_word(const MessageHeader* header, int sentence_idx, const char* payload) {
     if (!payload) {
-        send_simple_response(client_fd, MSG_ERROR, ERR_INVALID_WORD);
-        return;
+        return ERR_INVALID_WORD;
     }
 
-    char* space_ptr = strchr(payload, ' ');
+    const char* space_ptr = strchr(payload, ' ');
     if (!space_ptr) {
-        send_simple_response(client_fd, MSG_ERROR, ERR_INVALID_WORD);
-        return;
+        return ERR_INVALID_WORD;
     }
 
     int word_idx = atoi(payload);
     space_ptr++;
     while (*space_ptr == ' ' || *space_ptr == '\t') space_ptr++;
 
-    // Trim trailing newline/carriage return
-    char* endp = space_ptr + strlen(space_ptr) - 1;
-    while (endp >= space_ptr && (*endp == '\n' || *endp == '\r')) {
-        *endp = '\0';
-        endp--;
-    }
-
     char* new_word = strdup(space_ptr);
     if (!new_word) {
-        send_simple_response(client_fd, MSG_ERROR, ERR_FILE_OPERATION_FAILED);
-        return;
+        return ERR_FILE_OPERATION_FAILED;
     }
 
-    int result = ss_write_word(header->filename, header->sentence_index,
+    // Trim trailing newline/carriage return
+    size_t len = strlen(new_word);
+    while (len > 0 && (new_word[len - 1] == '\n' || new_word[len - 1] == '\r')) {
+        new_word[--len] = '\0';
+    }
+
+    int result = ss_write_word(header->filename, sentence_idx,
                                word_idx, new_word, header->username);
     free(new_word);
+    return result;
+}
+
+/**
+ * handle_ss_write_word
+ * @brief Handler for OP_SS_WRITE_WORD operation.
+ *
+ * Parses payload format: "word_index <new_word...>" and updates the word.
+ */
+void handle_ss_write_word(int client_fd, MessageHeader* header, const char* payload) {
+    int result = apply_write_word(header, header->sentence_index, payload);
 
     // Synchronous Replication
     if (result == ERR_SUCCESS) {
@@ -187,9 +276,12 @@ void handle_ss_write_word(int client_fd, MessageHeader* header, const char* payl
 /**
  * handle_ss_write_unlock
  * @brief Handler for OP_SS_WRITE_UNLOCK operation.
+ *
+ * @param fh Handle the request named the file by, or NULL.
  */
-void handle_ss_write_unlock(int client_fd, MessageHeader* header) {
-    int result = ss_write_unlock(header->filename, header->sentence_index, header->username);
+void handle_ss_write_unlock(int client_fd, MessageHeader* header, FileHandle* fh) {
+    int result = fh ? ss_write_unlock_handle(fh, header->sentence_index, header->username)
+                    : ss_write_unlock(header->filename, header->sentence_index, header->username);
     
     // Synchronous Replication
     if (result == ERR_SUCCESS) {
@@ -201,6 +293,107 @@ void handle_ss_write_unlock(int client_fd, MessageHeader* header) {
                         result);
 }
 
+/**
+ * handle_ss_batch
+ * @brief Handler for OP_SS_BATCH: run write-session sub-operations in order.
+ *
+ * Sub-operations may be OP_SS_WRITE_LOCK, OP_SS_WRITE_WORD and
+ * OP_SS_WRITE_UNLOCK, all on header->filename. By default the batch is
+ * best effort: every sub-operation runs and reports its own result. With
+ * FLAG_BATCH_ATOMIC the batch must be one whole session (LOCK first,
+ * UNLOCK last, words in between, one sentence); if any step fails the
+ * session is discarded, so either every edit is saved or none is.
+ *
+ * Replies MSG_ACK with error_code set to the first failure (ERR_SUCCESS if
+ * none) and a payload holding one result code per sub-operation, or
+ * MSG_ERROR without a payload if the batch itself is malformed.
+ *
+ * @return ERR_SUCCESS, or the error code of the first failed sub-operation.
+ */
+int handle_ss_batch(int client_fd, MessageHeader* header, const char* payload) {
+    BatchOp ops[BATCH_MAX_OPS];
+    int count = payload ? batch_parse(payload, header->data_length, ops, BATCH_MAX_OPS) : -1;
+    int atomic = header->flags & FLAG_BATCH_ATOMIC;
+    
+    int valid = count > 0 && (!atomic || count >= 2);
+    for (int i = 0; valid && i < count; i++) {
+        int op = ops[i].op_code;
+        if (atomic) {
+            int expected = (i == 0) ? OP_SS_WRITE_LOCK :
+                           (i == count - 1) ? OP_SS_WRITE_UNLOCK : OP_SS_WRITE_WORD;
+            valid = (op == expected && ops[i].sentence_index == ops[0].sentence_index);
+        } else {
+            valid = (op == OP_SS_WRITE_LOCK || op == OP_SS_WRITE_WORD || op == OP_SS_WRITE_UNLOCK);
+        }
+    }
+    if (!valid) {
+        send_simple_response(client_fd, MSG_ERROR, ERR_INVALID_COMMAND);
+        return ERR_INVALID_COMMAND;
+    }
+    
+    int codes[BATCH_MAX_OPS];
+    int first_error = ERR_SUCCESS;
+    int applied = 0;
+    for (int i = 0; i < count; i++) {
+        if (atomic && first_error != ERR_SUCCESS) {
+            codes[i] = ERR_BATCH_ABORTED;
+            continue;
+        }
+        
+        const BatchOp* op = &ops[i];
+        if (op->op_code == OP_SS_WRITE_LOCK) {
+            codes[i] = ss_write_lock(header->filename, op->sentence_index, header->username);
+        } else if (op->op_code == OP_SS_WRITE_WORD) {
+            char* word = strndup(op->payload, op->payload_len);
+            codes[i] = word ? apply_write_word(header, op->sentence_index, word)
+                            : ERR_FILE_OPERATION_FAILED;
+            free(word);
+        } else {
+            codes[i] = ss_write_unlock(header->filename, op->sentence_index, header->username);
+        }
+        
+        if (codes[i] == ERR_SUCCESS) {
+            applied++;
+        } else if (first_error == ERR_SUCCESS) {
+            first_error = codes[i];
+            if (atomic) {
+                // Roll back: nothing was written yet, so dropping the session suffices
+                if (i > 0) {
+                    ss_write_abort(header->filename, header->username);
+                }
+                for (int j = 0; j < i; j++) {
+                    codes[j] = ERR_BATCH_ABORTED;
+                }
+                applied = 0;
+            }
+        }
+    }
+    
+    // Synchronous Replication: the replica replays the whole batch at once
+    if (applied > 0) {
+        ss_forward_to_replica(header, payload, "BATCH");
+    }
+    
+    char results[BATCH_MAX_OPS * 5 + 1];
+    size_t len = 0;
+    results[0] = '\0';
+    for (int i = 0; i < count; i++) {
+        len += snprintf(results + len, sizeof(results) - len, i ? " %d" : "%d", codes[i]);
+    }
+    
+    MessageHeader resp;
+    INIT_RESPONSE_HEADER(&resp, MSG_ACK, first_error);
+    resp.op_code = OP_SS_BATCH;
+    resp.data_length = len;
+    send_message(client_fd, &resp, results);
+    
+    char msg[512];
+    snprintf(msg, sizeof(msg), "Batch on '%s': %d/%d operations applied (%s)",
+             header->filename, applied, count, atomic ? "atomic" : "best effort");
+    log_message("SS", "INFO", msg);
+    return first_error;
+}
+
 /**
  * handle_ss_info
  * @brief Handler for OP_INFO operation - returns detailed file information.
@@ -356,20 +549,19 @@ void handle_ss_checkpoint(int client_fd, MessageHeader* header) {
  * @brief Handler for OP_SS_VIEWCHECKPOINT operation.
  */
 void handle_ss_viewcheckpoint(int client_fd, MessageHeader* header) {
-    char* content = NULL;
-    int result = ss_view_checkpoint(header->filename, header->checkpoint_tag, &content);
+    int file_fd = -1;
+    size_t size = 0;
+    int result = ss_open_checkpoint(header->filename, header->checkpoint_tag, &file_fd, &size);
     
-    if (result == ERR_SUCCESS && content) {
+    if (result == ERR_SUCCESS) {
         MessageHeader response;
         memset(&response, 0, sizeof(response));
         response.msg_type = MSG_RESPONSE;
         response.error_code = ERR_SUCCESS;
-        response.data_length = strlen(content);
-        send_message(client_fd, &response, content);
-        free(content);
+        send_file_message(client_fd, &response, file_fd, size);
+        close(file_fd);
     } else {
         send_simple_response(client_fd, MSG_ERROR, result);
-        if (content) free(content);
     }
 }
 
@@ -411,6 +603,53 @@ void handle_ss_listcheckpoints(int client_fd, MessageHeader* header) {
     }
 }
 
+/**
+ * recv_request
+ * @brief Receive the next request, each phase under its own deadline.
+ *
+ * Waiting for the first byte is the idle phase (the header phase for the
+ * first request, which the peer should send right after connecting). Once
+ * it arrives, the rest of the header must follow within the header
+ * deadline, and the payload within the payload deadline plus one second
+ * per SS_PAYLOAD_MIN_RATE bytes. An expired deadline shuts the socket
+ * down, so this returns failure and deadline_fired() names the phase.
+ *
+ * @param client_fd Connected client socket.
+ * @param dl Deadline for client_fd, disarmed again on return.
+ * @param first Nonzero for the first request on the connection.
+ * @param header Out: the request header.
+ * @param rb Per-connection receive buffer.
+ * @param payload Out: the request payload inside rb, or NULL.
+ * @return Header bytes received (>0), 0 on orderly shutdown, -1 on error.
+ */
+static int recv_request(int client_fd, Deadline* dl, int first, MessageHeader* header,
+                        RecvBuffer* rb, char** payload) {
+    *payload = NULL;
+
+    char c;
+    deadline_arm(dl, first ? DEADLINE_HEADER : DEADLINE_IDLE,
+                 first ? config.header_deadline_ms : config.idle_deadline_ms);
+    ssize_t ready = recv(client_fd, &c, 1, MSG_PEEK);
+    if (ready <= 0) {
+        deadline_disarm(dl);
+        return (int)ready;
+    }
+
+    deadline_arm(dl, DEADLINE_HEADER, config.header_deadline_ms);
+    int received = recv_message_header(client_fd, header);
+    if (received > 0 && header->total_length > 0) {
+        long long allowance = config.payload_deadline_ms +
+                              (long long)(header->total_length / SS_PAYLOAD_MIN_RATE) * 1000;
+        if (config.payload_deadline_ms == 0) allowance = 0;
+        deadline_arm(dl, DEADLINE_PAYLOAD, allowance > INT_MAX ? INT_MAX : (int)allowance);
+        if (recv_message_payload_into(client_fd, header, rb, payload) < 0) {
+            received = -1;
+        }
+    }
+    deadline_disarm(dl);
+    return received;
+}
+
 /**
  * handle_client_request
  * @brief Thread entrypoint for per-client connections to the Storage Server.
@@ -425,24 +664,35 @@ void* handle_client_request(void* arg) {
     int client_fd = *(int*)arg;
     free(arg);
     
-    // Get client IP and port for logging
-    struct sockaddr_in client_addr;
-    socklen_t addr_len = sizeof(client_addr);
+    // Get client IP and port for logging ("local" for Unix-socket peers)
     char client_ip[MAX_IP] = "unknown";
     int client_port = 0;
-    if (getpeername(client_fd, (struct sockaddr*)&client_addr, &addr_len) == 0) {
-        inet_ntop(AF_INET, &client_addr.sin_addr, client_ip, sizeof(client_ip));
-        client_port = ntohs(client_addr.sin_port);
-    }
+    get_peer_address(client_fd, client_ip, sizeof(client_ip), &client_port);
     
     MessageHeader header;
     char* payload = NULL;
     int keep_alive = 1;
     
-    while (keep_alive && recv_message(client_fd, &header, &payload) > 0) {
+    // Payloads are borrowed from this buffer and valid until the next receive
+    RecvBuffer recv_buf;
+    recv_buffer_init(&recv_buf);
+    
+    // A peer that stalls mid-request or idles too long is disconnected
+    Deadline deadline;
+    deadline_init(&deadline, client_fd);
+    int requests = 0;
+    
+    // Files opened with OP_SS_OPEN on this connection
+    HandleTable handles;
+    ss_handles_init(&handles);
+    
+    while (keep_alive && recv_request(client_fd, &deadline, requests++ == 0, &header,
+                                      &recv_buf, &payload) > 0) {
         const char* operation = "UNKNOWN";
         char details[1200];
         int result_code = ERR_SUCCESS;
+        struct timespec op_start;
+        clock_gettime(CLOCK_MONOTONIC, &op_start);
         
         // Determine operation name
         switch (header.op_code) {
@@ -452,6 +702,7 @@ void* handle_client_request(void* arg) {
             case OP_SS_WRITE_LOCK: operation = "WRITE_LOCK"; break;
             case OP_SS_WRITE_WORD: operation = "WRITE_WORD"; break;
             case OP_SS_WRITE_UNLOCK: operation = "WRITE_UNLOCK"; break;
+            case OP_SS_BATCH: operation = "BATCH"; break;
             case OP_STREAM: operation = "STREAM"; break;
             case OP_UNDO: operation = "UNDO"; break;
             case OP_INFO: operation = "INFO"; break;
@@ -464,9 +715,24 @@ void* handle_client_request(void* arg) {
             case OP_SS_SYNC: operation = "SYNC"; break;
             case OP_SS_CHECK_MTIME: operation = "CHECK_MTIME"; break;
             case OP_EXEC: operation = "EXEC"; break;
+            case OP_HELLO: operation = "HELLO"; break;
+            case OP_SS_OPEN: operation = "OPEN"; break;
+            case OP_STATS: operation = "STATS"; break;
             default: operation = "UNKNOWN"; break;
         }
         
+        // A request may name its file by handle instead of by filename. The
+        // handle is resolved here, so handlers (and the replica) see a name.
+        FileHandle* fh = NULL;
+        if (header.handle) {
+            fh = ss_handle_find(&handles, header.handle);
+            if (fh) {
+                safe_strncpy(header.filename, fh->filename, sizeof(header.filename));
+            }
+        }
+        int stale_handle = header.handle && !fh;
+        header.handle = 0;
+        
         // Initialize default details
         if (header.filename[0]) {
             snprintf(details, sizeof(details), "file=%s", header.filename);
@@ -478,6 +744,18 @@ void* handle_client_request(void* arg) {
         log_operation("SS", "INFO", operation, header.username[0] ? header.username : "system",
                      client_ip, client_port, details, 0);
         
+        // Pooled NS connections ask us not to hang up after single-shot ops.
+        // Streaming ops never qualify: their reply is not a single frame.
+        int pooled = (header.flags & FLAG_KEEP_ALIVE) &&
+                     header.op_code != OP_SS_SYNC && header.op_code != OP_STREAM;
+        
+        if (stale_handle) {
+            send_simple_response(client_fd, MSG_ERROR, ERR_STALE_HANDLE);
+            log_operation("SS", "ERROR", operation, header.username[0] ? header.username : "system",
+                         client_ip, client_port, "stale file handle", ERR_STALE_HANDLE);
+            continue;
+        }
+        
         switch (header.op_code) {
             case OP_SS_CREATE:
                 result_code = handle_ss_create(client_fd, &header, payload);
@@ -490,8 +768,16 @@ void* handle_client_request(void* arg) {
                 break;
             
             case OP_SS_READ:
-                result_code = handle_ss_read(client_fd, &header);
-                keep_alive = 0;
+                result_code = handle_ss_read(client_fd, &header, fh);
+                keep_alive = fh != NULL;  // Handle users keep their session open
+                break;
+            
+            case OP_SS_OPEN:
+                result_code = handle_ss_open(client_fd, &header, &handles);
+                break;
+            
+            case OP_STATS:
+                result_code = handle_ss_stats(client_fd, &header);
                 break;
             
             case OP_SS_SYNC:
@@ -531,8 +817,14 @@ void* handle_client_request(void* arg) {
                 break;
             }
             
+            case OP_HELLO: {
+                int version = answer_protocol_hello(client_fd, &header, payload);
+                snprintf(details, sizeof(details), "protocol=v%d", version);
+                break;
+            }
+            
             case OP_SS_WRITE_LOCK:
-                handle_ss_write_lock(client_fd, &header);
+                handle_ss_write_lock(client_fd, &header, fh);
                 break;
             
             case OP_SS_WRITE_WORD:
@@ -540,10 +832,14 @@ void* handle_client_request(void* arg) {
                 break;
             
             case OP_SS_WRITE_UNLOCK:
-                handle_ss_write_unlock(client_fd, &header);
+                handle_ss_write_unlock(client_fd, &header, fh);
                 keep_alive = 0;
                 break;
             
+            case OP_SS_BATCH:
+                result_code = handle_ss_batch(client_fd, &header, payload);
+                break;
+            
             case OP_STREAM:
                 result_code = ss_stream_file(client_fd, header.filename);
                 keep_alive = 0;
@@ -588,18 +884,40 @@ void* handle_client_request(void* arg) {
                 result_code = ERR_INVALID_COMMAND;
                 snprintf(details, sizeof(details), "Invalid operation code");
                 keep_alive = 0;
+                pooled = 0;  // No response was sent; the stream is not reusable
                 break;
         }
         
+        if (pooled) {
+            keep_alive = 1;
+        }
+        
+        // Feeds the p99 latency reported with the next heartbeat and the
+        // per-opcode histograms returned by OP_STATS
+        struct timespec op_end;
+        clock_gettime(CLOCK_MONOTONIC, &op_end);
+        double op_us = (op_end.tv_sec - op_start.tv_sec) * 1e6 +
+                       (op_end.tv_nsec - op_start.tv_nsec) / 1e3;
+        ss_load_record_op(op_us);
+        stats_record_op(header.op_code, operation, op_us, result_code);
+        
         // Log the completed operation
         log_operation("SS", result_code == ERR_SUCCESS ? "INFO" : "ERROR",
                      operation, header.username[0] ? header.username : "system",
                      client_ip, client_port, details, result_code);
-        
-        if (payload) {
-            free(payload);
-            payload = NULL;
-        }
+    }
+    recv_buffer_free(&recv_buf);
+    ss_handles_close(&handles);
+    
+    int stalled = deadline_fired(&deadline);
+    if (stalled) {
+        static const char* phases[] = { "", "idle", "header", "payload" };
+        char stall_msg[256];
+        snprintf(stall_msg, sizeof(stall_msg),
+                 "[DEADLINE] Reclaimed connection from %s:%d stalled in %s phase",
+                 client_ip, client_port, phases[stalled]);
+        log_message("SS", "WARN", stall_msg);
+        ss_worker_pool_count_stalled(stalled);
     }
     
     // Log client disconnection
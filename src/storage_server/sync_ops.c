@@ -3,6 +3,9 @@
  *
  * Handles full data synchronization between storage servers for recovery.
  * Uses modified timestamps to only transfer files where the source is newer.
+ * Each file travels as one message (name in the header, content as the
+ * payload) that is streamed from disk to disk, so files of any size are
+ * synced without being held in memory.
  */
 
 #include "common.h"
@@ -41,15 +44,23 @@ static time_t get_file_modified_time(const char* filename) {
  *
  * Phase 1: Send our file list with timestamps to the active replica.
  * Phase 2: Receive only files where the replica's version is newer.
+ *
+ * @param replica_ip       Active replica address
+ * @param replica_port     Active replica client port
+ * @param replica_protocol Wire protocol version advertised by the Name Server
+ * @param replica_local    Replica's local address ("" if none); used when it
+ *                         runs on this host
  */
-void ss_start_recovery_sync(const char *replica_ip, int replica_port) {
+void ss_start_recovery_sync(const char *replica_ip, int replica_port, int replica_protocol,
+                            const char *replica_local) {
     log_message("SS", "INFO", "[RECOVERY] Starting Version-Based Sync...");
     
-    int sock = connect_to_server(replica_ip, replica_port);
+    int sock = connect_to_endpoint(replica_ip, replica_port, replica_local);
     if (sock < 0) {
         log_message("SS", "ERROR", "[RECOVERY] Failed to connect to Active Replica");
         return;
     }
+    set_socket_protocol(sock, replica_protocol);
 
     // Phase 1: Build our file manifest (filename:modified_timestamp)
     char manifest[BUFFER_SIZE * 4] = "";
@@ -87,57 +98,52 @@ void ss_start_recovery_sync(const char *replica_ip, int replica_port) {
     }
 
     // Phase 2: Receive Files Loop
-    char* payload = NULL;
     int files_synced = 0;
     int files_skipped = 0;
     
-    while (recv_message(sock, &header, &payload) > 0) {
+    while (recv_message_header(sock, &header) > 0) {
         if (header.msg_type == MSG_ACK) {
             // End of Sync
             break;
         }
         
-        if (header.msg_type == MSG_RESPONSE && header.op_code == OP_SS_SYNC) {
-            if (payload) {
-                // Payload format: "FILENAME\nCONTENT"
-                char* newline = strchr(payload, '\n');
-                if (newline) {
-                    *newline = '\0';
-                    char* filename = payload;
-                    char* content = newline + 1;
-                    
-                    // Create/Overwrite file
-                    char fullpath[MAX_PATH];
-                    char* clean_filename = filename;
-                    if (strncmp(filename, "./", 2) == 0) clean_filename += 2;
-                    else if (filename[0] == '/') clean_filename += 1;
-                    
-                    construct_full_path(fullpath, sizeof(fullpath), config.storage_dir, clean_filename);
-                    
-                    if (write_file_content(fullpath, content) == ERR_SUCCESS) {
-                         char msg[512];
-                         snprintf(msg, sizeof(msg), "[RECOVERY] Synced file: %s", clean_filename);
-                         log_message("SS", "INFO", msg);
-                         files_synced++;
-                    } else {
-                         char msg[512];
-                         snprintf(msg, sizeof(msg), "[RECOVERY] Failed to write file: %s", clean_filename);
-                         log_message("SS", "ERROR", msg);
-                    }
-                }
+        if (header.msg_type == MSG_RESPONSE && header.op_code == OP_SS_SYNC && header.filename[0]) {
+            // Create/Overwrite file, streaming the content straight to disk
+            char fullpath[MAX_PATH];
+            char* clean_filename = header.filename;
+            if (strncmp(clean_filename, "./", 2) == 0) clean_filename += 2;
+            else if (clean_filename[0] == '/') clean_filename += 1;
+            
+            construct_full_path(fullpath, sizeof(fullpath), config.storage_dir, clean_filename);
+            
+            int fd = open(fullpath, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+            int written = fd >= 0 && recv_message_payload(sock, &header, fd_payload_sink, &fd) == 0;
+            if (fd >= 0) {
+                close(fd);
+            } else {
+                recv_message_payload(sock, &header, NULL, NULL);
             }
-        } else if (header.msg_type == MSG_ERROR && header.error_code == ERR_FILE_EXISTS) {
-            // File skipped (local is same or newer)
-            files_skipped++;
+            
+            char msg[512];
+            if (written) {
+                 snprintf(msg, sizeof(msg), "[RECOVERY] Synced file: %s (%llu bytes)",
+                          clean_filename, header.total_length);
+                 log_message("SS", "INFO", msg);
+                 files_synced++;
+            } else {
+                 snprintf(msg, sizeof(msg), "[RECOVERY] Failed to write file: %s", clean_filename);
+                 log_message("SS", "ERROR", msg);
+            }
+            continue;
         }
         
-        if (payload) {
-            free(payload);
-            payload = NULL;
+        if (header.msg_type == MSG_ERROR && header.error_code == ERR_FILE_EXISTS) {
+            // File skipped (local is same or newer)
+            files_skipped++;
         }
+        recv_message_payload(sock, &header, NULL, NULL);
     }
     
-    if (payload) free(payload);
     close(sock);
     
     char final_msg[256];
@@ -146,6 +152,30 @@ void ss_start_recovery_sync(const char *replica_ip, int replica_port) {
     log_message("SS", "INFO", final_msg);
 }
 
+/**
+ * send_sync_file
+ * @brief Stream one file from the storage directory to a recovering peer.
+ * @return 0 if the file was sent, -1 if it could not be opened or sent
+ */
+static int send_sync_file(int client_fd, const char* name) {
+    char fullpath[MAX_PATH];
+    construct_full_path(fullpath, sizeof(fullpath), config.storage_dir, name);
+    
+    int fd = open(fullpath, O_RDONLY);
+    if (fd < 0) return -1;
+    
+    struct stat st;
+    int rc = -1;
+    if (fstat(fd, &st) == 0) {
+        MessageHeader resp;
+        init_message_header(&resp, MSG_RESPONSE, OP_SS_SYNC, "system");
+        safe_strncpy(resp.filename, name, sizeof(resp.filename));
+        rc = send_file_message(client_fd, &resp, fd, st.st_size);
+    }
+    close(fd);
+    return rc;
+}
+
 /**
  * handle_ss_sync
  * @brief (Sender) Stream files to the recovering server, comparing timestamps.
@@ -201,6 +231,9 @@ void handle_ss_sync(int client_fd, MessageHeader *header, const char *payload) {
     int sent_count = 0;
     int skipped_count = 0;
     
+    // A back-to-back stream of files: let frames fill whole segments
+    set_socket_role(client_fd, SOCKET_ROLE_BULK);
+    
     while ((dir = readdir(d)) != NULL) {
         if (dir->d_type == DT_REG) {
             // Skip metadata files
@@ -209,9 +242,6 @@ void handle_ss_sync(int client_fd, MessageHeader *header, const char *payload) {
                 continue;
             }
             
-            char fullpath[MAX_PATH];
-            construct_full_path(fullpath, sizeof(fullpath), config.storage_dir, dir->d_name);
-            
             // Get local file's modified time
             time_t local_mtime = get_file_modified_time(dir->d_name);
             
@@ -237,48 +267,22 @@ void handle_ss_sync(int client_fd, MessageHeader *header, const char *payload) {
                 continue;
             }
             
-            char* content = read_file_content(fullpath);
-            if (content) {
-                // Construct payload: "FILENAME\nCONTENT"
-                int payload_size = strlen(dir->d_name) + 1 + strlen(content) + 1;
-                char* file_payload = malloc(payload_size);
-                if (file_payload) {
-                    snprintf(file_payload, payload_size, "%s\n%s", dir->d_name, content);
-                    
-                    MessageHeader resp;
-                    init_message_header(&resp, MSG_RESPONSE, OP_SS_SYNC, "system");
-                    resp.data_length = strlen(file_payload);
-                    
-                    send_message(client_fd, &resp, file_payload);
-                    free(file_payload);
-                    sent_count++;
-                    
-                    // Also sync the .meta file for this file
-                    char metapath[MAX_PATH];
-                    snprintf(metapath, sizeof(metapath), "%s/%s.meta", config.storage_dir, dir->d_name);
-                    char* meta_content = read_file_content(metapath);
-                    if (meta_content) {
-                        char meta_filename[MAX_PATH];
-                        snprintf(meta_filename, sizeof(meta_filename), "%s.meta", dir->d_name);
-                        
-                        int meta_payload_size = strlen(meta_filename) + 1 + strlen(meta_content) + 1;
-                        char* meta_payload = malloc(meta_payload_size);
-                        if (meta_payload) {
-                            snprintf(meta_payload, meta_payload_size, "%s\n%s", meta_filename, meta_content);
-                            resp.data_length = strlen(meta_payload);
-                            send_message(client_fd, &resp, meta_payload);
-                            free(meta_payload);
-                        }
-                        free(meta_content);
-                    }
+            if (send_sync_file(client_fd, dir->d_name) == 0) {
+                sent_count++;
+                
+                // Also sync the .meta file for this file
+                char meta_filename[MAX_FILENAME];
+                int n = snprintf(meta_filename, sizeof(meta_filename), "%s.meta", dir->d_name);
+                if (n > 0 && n < (int)sizeof(meta_filename)) {
+                    send_sync_file(client_fd, meta_filename);
                 }
-                free(content);
             }
         }
     }
     closedir(d);
     
-    // Send Done Signal
+    // Send Done Signal (uncorked, so it is not held back)
+    set_socket_role(client_fd, SOCKET_ROLE_INTERACTIVE);
     send_simple_response(client_fd, MSG_ACK, ERR_SUCCESS);
     
     char msg[256];
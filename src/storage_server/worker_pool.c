@@ -0,0 +1,247 @@
+/*
+ * worker_pool.c - Bounded worker pool for Storage Server client connections
+ *
+ * The accept loop hands each new connection to the pool instead of spawning
+ * a thread for it. A fixed number of workers serve connections, and at most
+ * queue_capacity accepted connections wait for a free worker. When the queue
+ * is full, or a connection has waited longer than SS_QUEUE_MAX_WAIT_MS, the
+ * peer is told ERR_SS_BUSY (retryable) and disconnected at once. Overload
+ * then shows up as fast rejections instead of unbounded threads and memory.
+ */
+
+#include "common.h"
+#include "storage_server.h"
+
+static struct {
+    int* fds;                  // Ring buffer of queued connections
+    struct timespec* since;    // When each queued connection was accepted
+    int capacity;
+    int head;
+    int count;
+
+    int workers;
+    int busy;
+
+    // Statistics
+    long admitted;
+    long rejected;
+    long expired;
+    int max_depth;
+    double total_wait_ms;
+    double max_wait_ms;
+    long stalled_idle;
+    long stalled_header;
+    long stalled_payload;
+
+    pthread_mutex_t lock;
+    pthread_cond_t nonempty;
+} pool = { .lock = PTHREAD_MUTEX_INITIALIZER, .nonempty = PTHREAD_COND_INITIALIZER };
+
+static double elapsed_ms(const struct timespec* from, const struct timespec* to) {
+    return (to->tv_sec - from->tv_sec) * 1000.0 + (to->tv_nsec - from->tv_nsec) / 1e6;
+}
+
+/**
+ * reject_busy
+ * @brief Tell a peer the server is saturated, then hang up.
+ *
+ * The reply goes out before the peer's request is read, so it uses v1
+ * framing, which every client understands. The write side is shut down
+ * first so the error frame is delivered ahead of the connection close.
+ */
+static void reject_busy(int fd) {
+    MessageHeader resp;
+    INIT_RESPONSE_HEADER(&resp, MSG_ERROR, ERR_SS_BUSY);
+    set_socket_protocol(fd, PROTOCOL_V1);
+    send_message(fd, &resp, NULL);
+    shutdown(fd, SHUT_WR);
+    close(fd);
+}
+
+static void* worker_main(void* arg) {
+    (void)arg;
+
+    while (1) {
+        pthread_mutex_lock(&pool.lock);
+        while (pool.count == 0) {
+            pthread_cond_wait(&pool.nonempty, &pool.lock);
+        }
+        int fd = pool.fds[pool.head];
+        struct timespec since = pool.since[pool.head];
+        pool.head = (pool.head + 1) % pool.capacity;
+        pool.count--;
+        pool.busy++;
+
+        struct timespec now;
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        double waited = elapsed_ms(&since, &now);
+        pool.total_wait_ms += waited;
+        if (waited > pool.max_wait_ms) pool.max_wait_ms = waited;
+        pthread_mutex_unlock(&pool.lock);
+
+        int* client_fd = malloc(sizeof(int));
+        if (client_fd) {
+            *client_fd = fd;
+            handle_client_request(client_fd);
+        } else {
+            close(fd);
+        }
+
+        pthread_mutex_lock(&pool.lock);
+        pool.busy--;
+        pthread_mutex_unlock(&pool.lock);
+    }
+
+    return NULL;
+}
+
+/**
+ * ss_worker_pool_start
+ * @brief Allocate the admission queue and start the worker threads.
+ *
+ * @param workers Number of worker threads.
+ * @param queue_capacity Maximum number of connections waiting for a worker.
+ * @return ERR_SUCCESS, or ERR_FILE_OPERATION_FAILED if resources ran out.
+ */
+int ss_worker_pool_start(int workers, int queue_capacity) {
+    pool.fds = malloc(queue_capacity * sizeof(int));
+    pool.since = malloc(queue_capacity * sizeof(struct timespec));
+    if (!pool.fds || !pool.since) {
+        return ERR_FILE_OPERATION_FAILED;
+    }
+    pool.capacity = queue_capacity;
+
+    for (int i = 0; i < workers; i++) {
+        pthread_t thread;
+        if (pthread_create(&thread, NULL, worker_main, NULL) != 0) {
+            return ERR_FILE_OPERATION_FAILED;
+        }
+        pthread_detach(thread);
+        pool.workers++;
+    }
+    return ERR_SUCCESS;
+}
+
+/**
+ * ss_worker_pool_submit
+ * @brief Queue an accepted connection for the next free worker.
+ *
+ * Never blocks. If the admission queue is full the connection is rejected
+ * with ERR_SS_BUSY and closed.
+ *
+ * @param client_fd Accepted socket; ownership passes to the pool.
+ * @return ERR_SUCCESS if queued, ERR_SS_BUSY if rejected.
+ */
+int ss_worker_pool_submit(int client_fd) {
+    pthread_mutex_lock(&pool.lock);
+    if (pool.count >= pool.capacity) {
+        pool.rejected++;
+        pthread_mutex_unlock(&pool.lock);
+        reject_busy(client_fd);
+        return ERR_SS_BUSY;
+    }
+
+    int tail = (pool.head + pool.count) % pool.capacity;
+    pool.fds[tail] = client_fd;
+    clock_gettime(CLOCK_MONOTONIC, &pool.since[tail]);
+    pool.count++;
+    pool.admitted++;
+    if (pool.count > pool.max_depth) pool.max_depth = pool.count;
+    pthread_cond_signal(&pool.nonempty);
+    pthread_mutex_unlock(&pool.lock);
+    return ERR_SUCCESS;
+}
+
+/**
+ * ss_worker_pool_expire
+ * @brief Reject queued connections that waited longer than SS_QUEUE_MAX_WAIT_MS.
+ *
+ * Called from the accept loop. Besides bounding latency, this breaks
+ * wait cycles between storage servers whose workers are all blocked on
+ * each other (e.g. mutual replication under load).
+ */
+void ss_worker_pool_expire(void) {
+    int stale[SS_ADMISSION_QUEUE_MAX];
+    int stale_count = 0;
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    pthread_mutex_lock(&pool.lock);
+    // The queue is FIFO, so expired entries are all at the head
+    while (pool.count > 0 && stale_count < SS_ADMISSION_QUEUE_MAX &&
+           elapsed_ms(&pool.since[pool.head], &now) > SS_QUEUE_MAX_WAIT_MS) {
+        stale[stale_count++] = pool.fds[pool.head];
+        pool.head = (pool.head + 1) % pool.capacity;
+        pool.count--;
+        pool.expired++;
+    }
+    pthread_mutex_unlock(&pool.lock);
+
+    for (int i = 0; i < stale_count; i++) {
+        reject_busy(stale[i]);
+    }
+    if (stale_count > 0) {
+        char msg[128];
+        snprintf(msg, sizeof(msg), "[POOL] Rejected %d queued connection(s) after %d ms wait",
+                 stale_count, SS_QUEUE_MAX_WAIT_MS);
+        log_message("SS", "WARN", msg);
+    }
+}
+
+/**
+ * ss_worker_pool_get_stats
+ * @brief Snapshot worker pool utilization, queue depth and wait times.
+ *
+ * @param out Filled with the current statistics.
+ */
+void ss_worker_pool_get_stats(WorkerPoolStats* out) {
+    pthread_mutex_lock(&pool.lock);
+    out->workers = pool.workers;
+    out->busy = pool.busy;
+    out->queue_depth = pool.count;
+    out->queue_capacity = pool.capacity;
+    out->max_queue_depth = pool.max_depth;
+    out->admitted = pool.admitted;
+    out->rejected = pool.rejected;
+    out->expired = pool.expired;
+    long started = pool.admitted - pool.expired - pool.count;
+    out->avg_wait_ms = started > 0 ? pool.total_wait_ms / started : 0.0;
+    out->max_wait_ms = pool.max_wait_ms;
+    out->stalled_idle = pool.stalled_idle;
+    out->stalled_header = pool.stalled_header;
+    out->stalled_payload = pool.stalled_payload;
+    pthread_mutex_unlock(&pool.lock);
+}
+
+/**
+ * ss_worker_pool_count_stalled
+ * @brief Count a connection reclaimed because a request deadline expired.
+ *
+ * @param phase The phase that ran out of time (DEADLINE_IDLE, ...).
+ */
+void ss_worker_pool_count_stalled(int phase) {
+    pthread_mutex_lock(&pool.lock);
+    if (phase == DEADLINE_IDLE) pool.stalled_idle++;
+    else if (phase == DEADLINE_HEADER) pool.stalled_header++;
+    else if (phase == DEADLINE_PAYLOAD) pool.stalled_payload++;
+    pthread_mutex_unlock(&pool.lock);
+}
+
+/**
+ * ss_worker_pool_log_stats
+ * @brief Log a one-line summary of the worker pool statistics.
+ */
+void ss_worker_pool_log_stats(void) {
+    WorkerPoolStats stats;
+    ss_worker_pool_get_stats(&stats);
+
+    char msg[512];
+    snprintf(msg, sizeof(msg),
+             "[POOL] workers %d/%d busy | queue %d/%d (max %d) | wait avg %.1f ms, max %.1f ms | "
+             "admitted %ld, rejected %ld, expired %ld | stalled idle %ld, header %ld, payload %ld",
+             stats.busy, stats.workers, stats.queue_depth, stats.queue_capacity,
+             stats.max_queue_depth, stats.avg_wait_ms, stats.max_wait_ms,
+             stats.admitted, stats.rejected, stats.expired,
+             stats.stalled_idle, stats.stalled_header, stats.stalled_payload);
+    log_message("SS", "INFO", msg);
+}
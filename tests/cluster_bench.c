@@ -0,0 +1,606 @@
+#define _XOPEN_SOURCE 700 // nftw()
+/**
+ * cluster_bench.c - End-to-end load generator for a local cluster
+ *
+ * Starts a Name Server and N Storage Servers (the binaries built by
+ * `make all`) in a scratch directory, then runs M simulated clients for a
+ * fixed time. Each client talks to the cluster exactly like ./client does:
+ * it negotiates the wire protocol, registers a username, and issues a
+ * weighted random mix of:
+ *
+ *   CREATE      OP_CREATE to the Name Server
+ *   READ        OP_READ redirect, then OP_SS_READ from the Storage Server
+ *   WRITE       OP_WRITE redirect, then LOCK / WRITE_WORD / UNLOCK
+ *   VIEW        OP_VIEW -l (long listing) from the Name Server
+ *   CHECKPOINT  OP_CHECKPOINT through the Name Server
+ *   LOOKUP      OP_READ redirect only: a Name Server lookup + permission check
+ *   INFO        OP_INFO through the Name Server
+ *   DELETE      OP_DELETE of the client's newest file (a CREATE when it has
+ *               only one left)
+ *
+ * LOOKUP, INFO and DELETE are not in the default mix; a metadata-heavy mix
+ * such as "lookup=60,info=15,view=15,write=10" at 64+ clients measures how
+ * well Name Server reads proceed next to VIEW -l refreshes and writers, and
+ * "lookup=50,create=25,delete=25" how flat redirects stay under namespace
+ * churn.
+ *
+ * READ, WRITE, CHECKPOINT, LOOKUP and INFO pick one of the client's own files, so clients
+ * never need each other's permissions. Latency is measured per operation
+ * from the first request byte to the last reply byte, including redirects
+ * and Storage Server connects. Results are printed as a table and written
+ * as JSON for regression tracking, followed by the Name Server's own view
+ * from OP_STATS: time spent handling each opcode and waiting for its locks,
+ * which separates Name Server stalls from load on the machine.
+ *
+ * Usage: ./tests/bench_cluster [-s storage_servers] [-c clients]
+ *                              [-d seconds] [-m mix] [-p base_port]
+ *                              [-o json_file]
+ *
+ * The mix is a list of weights, e.g. "create=5,read=50,write=30,view=10,checkpoint=5".
+ */
+
+#include "common.h"
+#include "cJSON.h"
+#include <ftw.h>
+#include <getopt.h>
+#include <signal.h>
+#include <sys/wait.h>
+
+#define MAX_BENCH_SS 16
+#define MAX_BENCH_CLIENTS 1024
+#define STARTUP_TIMEOUT_MS 10000
+
+typedef enum {
+    BENCH_CREATE, BENCH_READ, BENCH_WRITE, BENCH_VIEW, BENCH_CHECKPOINT, BENCH_LOOKUP, BENCH_INFO,
+    BENCH_DELETE, BENCH_OPS
+} BenchOp;
+
+static const char* op_names[] = { "CREATE", "READ", "WRITE", "VIEW", "CHECKPOINT", "LOOKUP", "INFO",
+                                  "DELETE" };
+static const char* op_keys[] = { "create", "read", "write", "view", "checkpoint", "lookup", "info",
+                                 "delete" };
+
+typedef struct {
+    double* samples;  // Latencies of successful ops, in microseconds
+    int count;
+    int cap;
+    int errors;
+} OpStats;
+
+typedef struct {
+    int id;
+    int nm_port;
+    const int* weights;
+    int weight_total;
+    volatile int* stop;
+
+    int nm_socket;
+    char username[MAX_USERNAME];
+    int files;        // Files created so far: b<id>_0.txt ... b<id>_<files-1>.txt
+    int checkpoints;
+    unsigned int seed;
+    OpStats stats[BENCH_OPS];
+    int setup_failed;
+} BenchClient;
+
+static double now_us(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e6 + ts.tv_nsec / 1e3;
+}
+
+static void record(OpStats* s, int ok, double us) {
+    if (!ok) {
+        s->errors++;
+        return;
+    }
+    if (s->count == s->cap) {
+        int cap = s->cap ? s->cap * 2 : 1024;
+        double* grown = realloc(s->samples, cap * sizeof(double));
+        if (!grown) return;
+        s->samples = grown;
+        s->cap = cap;
+    }
+    s->samples[s->count++] = us;
+}
+
+// ============ Cluster processes ============
+
+static pid_t spawn(const char* dir, char* const argv[]) {
+    pid_t pid = fork();
+    if (pid == 0) {
+        if (chdir(dir) != 0) _exit(127);
+        int devnull = open("/dev/null", O_WRONLY);
+        if (devnull >= 0) {
+            dup2(devnull, STDOUT_FILENO);
+            dup2(devnull, STDERR_FILENO);
+        }
+        execv(argv[0], argv);
+        _exit(127);
+    }
+    return pid;
+}
+
+// Poll until something accepts connections on the port
+static int wait_for_port(int port) {
+    for (int waited = 0; waited < STARTUP_TIMEOUT_MS; waited += 50) {
+        int fd = socket(AF_INET, SOCK_STREAM, 0);
+        struct sockaddr_in addr = { .sin_family = AF_INET, .sin_port = htons(port) };
+        addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        int ok = connect(fd, (struct sockaddr*)&addr, sizeof(addr)) == 0;
+        close(fd);
+        if (ok) return 0;
+        usleep(50 * 1000);
+    }
+    return -1;
+}
+
+static int remove_entry(const char* path, const struct stat* st, int flag, struct FTW* ftw) {
+    (void)st; (void)flag; (void)ftw;
+    return remove(path);
+}
+
+// ============ Simulated client ============
+
+static int nm_request(BenchClient* c, MessageHeader* header, const char* payload, char** reply) {
+    *reply = NULL;
+    if (send_message(c->nm_socket, header, payload) < 0 ||
+        recv_message(c->nm_socket, header, reply) < 0) {
+        return -1;
+    }
+    return 0;
+}
+
+static int client_connect(BenchClient* c) {
+    c->nm_socket = connect_to_server("127.0.0.1", c->nm_port);
+    if (c->nm_socket < 0 || negotiate_protocol(c->nm_socket) < 0) {
+        return -1;
+    }
+    MessageHeader header;
+    init_message_header(&header, MSG_REQUEST, OP_CONNECT_CLIENT, c->username);
+    header.data_length = strlen(c->username);
+    char* reply;
+    int ok = nm_request(c, &header, c->username, &reply) == 0 && header.msg_type == MSG_ACK;
+    free(reply);
+    return ok ? 0 : -1;
+}
+
+static void own_file(BenchClient* c, int index, char* out, size_t len) {
+    snprintf(out, len, "b%d_%d.txt", c->id, index);
+}
+
+static int op_create(BenchClient* c) {
+    MessageHeader header;
+    init_message_header(&header, MSG_REQUEST, OP_CREATE, c->username);
+    own_file(c, c->files, header.filename, sizeof(header.filename));
+    header.data_length = strlen(c->username);
+    char* reply;
+    int ok = nm_request(c, &header, c->username, &reply) == 0 && header.msg_type == MSG_ACK;
+    free(reply);
+    if (ok) c->files++;
+    return ok;
+}
+
+// Ask the Name Server where a file lives and connect there
+static int ss_connect(BenchClient* c, int op_code, const char* filename) {
+    MessageHeader header;
+    init_message_header(&header, MSG_REQUEST, op_code, c->username);
+    safe_strncpy(header.filename, filename, sizeof(header.filename));
+    char* info;
+    if (nm_request(c, &header, NULL, &info) < 0 || header.msg_type != MSG_RESPONSE || !info) {
+        free(info);
+        return -1;
+    }
+    char ip[MAX_IP];
+    char local[MAX_LOCAL_ADDR];
+    int port, proto;
+    int parsed = parse_ss_info(info, ip, &port, &proto, local);
+    free(info);
+    if (parsed != 0) return -1;
+
+    int fd = connect_to_endpoint(ip, port, local);
+    if (fd >= 0) set_socket_protocol(fd, proto);
+    return fd;
+}
+
+static int op_read(BenchClient* c, const char* filename) {
+    int fd = ss_connect(c, OP_READ, filename);
+    if (fd < 0) return 0;
+
+    MessageHeader header;
+    init_message_header(&header, MSG_REQUEST, OP_SS_READ, c->username);
+    safe_strncpy(header.filename, filename, sizeof(header.filename));
+    int ok = send_message(fd, &header, NULL) == 0 &&
+             recv_message_header(fd, &header) > 0 &&
+             recv_message_payload(fd, &header, NULL, NULL) == 0 &&
+             header.msg_type == MSG_RESPONSE;
+    close(fd);
+    return ok;
+}
+
+// One SS request/reply on an open connection; 1 if it was acknowledged
+static int ss_step(int fd, MessageHeader* header, const char* payload) {
+    char* reply = NULL;
+    int ok = send_message(fd, header, payload) == 0 &&
+             recv_message(fd, header, &reply) >= 0 && header->msg_type == MSG_ACK;
+    free(reply);
+    return ok;
+}
+
+static int op_write(BenchClient* c, const char* filename) {
+    int fd = ss_connect(c, OP_WRITE, filename);
+    if (fd < 0) return 0;
+
+    MessageHeader header;
+    init_message_header(&header, MSG_REQUEST, OP_SS_WRITE_LOCK, c->username);
+    safe_strncpy(header.filename, filename, sizeof(header.filename));
+    int ok = ss_step(fd, &header, NULL);
+
+    if (ok) {
+        char word[32];
+        snprintf(word, sizeof(word), "0 w%u", rand_r(&c->seed) % 1000);
+        init_message_header(&header, MSG_REQUEST, OP_SS_WRITE_WORD, c->username);
+        safe_strncpy(header.filename, filename, sizeof(header.filename));
+        header.data_length = strlen(word);
+        ok = ss_step(fd, &header, word);
+
+        // Release the lock even if the word failed
+        init_message_header(&header, MSG_REQUEST, OP_SS_WRITE_UNLOCK, c->username);
+        safe_strncpy(header.filename, filename, sizeof(header.filename));
+        ok = ss_step(fd, &header, NULL) && ok;
+    }
+    close(fd);
+    return ok;
+}
+
+static int op_view(BenchClient* c) {
+    MessageHeader header;
+    init_message_header(&header, MSG_REQUEST, OP_VIEW, c->username);
+    header.flags = 2;  // -l
+    char* reply;
+    int ok = nm_request(c, &header, NULL, &reply) == 0 && header.msg_type == MSG_RESPONSE;
+    free(reply);
+    return ok;
+}
+
+static int op_checkpoint(BenchClient* c, const char* filename) {
+    MessageHeader header;
+    init_message_header(&header, MSG_REQUEST, OP_CHECKPOINT, c->username);
+    safe_strncpy(header.filename, filename, sizeof(header.filename));
+    snprintf(header.checkpoint_tag, sizeof(header.checkpoint_tag), "t%d", c->checkpoints++);
+    char* reply;
+    int ok = nm_request(c, &header, NULL, &reply) == 0 && header.msg_type == MSG_ACK;
+    free(reply);
+    return ok;
+}
+
+// Ask the Name Server where a file lives, without going there
+static int op_lookup(BenchClient* c, const char* filename) {
+    MessageHeader header;
+    init_message_header(&header, MSG_REQUEST, OP_READ, c->username);
+    safe_strncpy(header.filename, filename, sizeof(header.filename));
+    char* reply;
+    int ok = nm_request(c, &header, NULL, &reply) == 0 && header.msg_type == MSG_RESPONSE;
+    free(reply);
+    return ok;
+}
+
+static int op_info(BenchClient* c, const char* filename) {
+    MessageHeader header;
+    init_message_header(&header, MSG_REQUEST, OP_INFO, c->username);
+    safe_strncpy(header.filename, filename, sizeof(header.filename));
+    char* reply;
+    int ok = nm_request(c, &header, NULL, &reply) == 0 && header.msg_type == MSG_RESPONSE;
+    free(reply);
+    return ok;
+}
+
+// Delete the newest file, so the rest stay b<id>_0 ... b<id>_<files-1>
+static int op_delete(BenchClient* c) {
+    MessageHeader header;
+    init_message_header(&header, MSG_REQUEST, OP_DELETE, c->username);
+    own_file(c, c->files - 1, header.filename, sizeof(header.filename));
+    char* reply;
+    int ok = nm_request(c, &header, NULL, &reply) == 0 && header.msg_type == MSG_ACK;
+    free(reply);
+    if (ok) c->files--;
+    return ok;
+}
+
+// The Name Server's OP_STATS snapshot, or NULL
+static cJSON* fetch_nm_stats(int port) {
+    int fd = connect_to_server("127.0.0.1", port);
+    if (fd < 0) return NULL;
+    cJSON* stats = NULL;
+    if (negotiate_protocol(fd) >= 0) {
+        MessageHeader header;
+        init_message_header(&header, MSG_REQUEST, OP_STATS, "bench");
+        char* reply = NULL;
+        if (send_message(fd, &header, NULL) == 0 && recv_message(fd, &header, &reply) >= 0 &&
+            header.msg_type == MSG_RESPONSE && reply) {
+            stats = cJSON_Parse(reply);
+        }
+        free(reply);
+    }
+    close(fd);
+    return stats;
+}
+
+// One row per histogram in a stats_to_json() group
+static void print_nm_group(cJSON* group) {
+    cJSON* item;
+    cJSON_ArrayForEach(item, group) {
+        printf("%-15s %9.0f %10.0f %10.0f %10.0f\n", item->string,
+               cJSON_GetObjectItem(item, "count")->valuedouble,
+               cJSON_GetObjectItem(item, "p50_us")->valuedouble,
+               cJSON_GetObjectItem(item, "p99_us")->valuedouble,
+               cJSON_GetObjectItem(item, "max_us")->valuedouble);
+    }
+}
+
+static BenchOp pick_op(BenchClient* c) {
+    int r = rand_r(&c->seed) % c->weight_total;
+    for (int op = 0; op < BENCH_OPS; op++) {
+        if (r < c->weights[op]) return op;
+        r -= c->weights[op];
+    }
+    return BENCH_READ;
+}
+
+static void* client_main(void* arg) {
+    BenchClient* c = arg;
+
+    // Every client starts with one file of its own (not measured)
+    if (client_connect(c) < 0 || !op_create(c)) {
+        c->setup_failed = 1;
+        return NULL;
+    }
+
+    while (!*c->stop) {
+        BenchOp op = pick_op(c);
+        if (op == BENCH_DELETE && c->files <= 1) {
+            op = BENCH_CREATE;  // Keep a file for the other ops to use
+        }
+        char filename[MAX_FILENAME];
+        own_file(c, rand_r(&c->seed) % c->files, filename, sizeof(filename));
+
+        double start = now_us();
+        int ok;
+        switch (op) {
+            case BENCH_CREATE: ok = op_create(c); break;
+            case BENCH_READ: ok = op_read(c, filename); break;
+            case BENCH_WRITE: ok = op_write(c, filename); break;
+            case BENCH_VIEW: ok = op_view(c); break;
+            case BENCH_LOOKUP: ok = op_lookup(c, filename); break;
+            case BENCH_INFO: ok = op_info(c, filename); break;
+            case BENCH_DELETE: ok = op_delete(c); break;
+            default: ok = op_checkpoint(c, filename); break;
+        }
+        record(&c->stats[op], ok, now_us() - start);
+    }
+    return NULL;
+}
+
+// ============ Reporting ============
+
+static int compare_double(const void* a, const void* b) {
+    double x = *(const double*)a, y = *(const double*)b;
+    return (x > y) - (x < y);
+}
+
+static double percentile(const OpStats* s, double p) {
+    if (s->count == 0) return 0.0;
+    int i = (int)(s->count * p);
+    return s->samples[i < s->count ? i : s->count - 1];
+}
+
+static int parse_mix(const char* mix, int* weights) {
+    memset(weights, 0, BENCH_OPS * sizeof(int));
+    char copy[256];
+    safe_strncpy(copy, mix, sizeof(copy));
+    char* save = NULL;
+    for (char* item = strtok_r(copy, ",", &save); item; item = strtok_r(NULL, ",", &save)) {
+        char* eq = strchr(item, '=');
+        if (!eq) return -1;
+        *eq = '\0';
+        int op = 0;
+        while (op < BENCH_OPS && strcmp(op_keys[op], item) != 0) op++;
+        if (op == BENCH_OPS || atoi(eq + 1) < 0) return -1;
+        weights[op] = atoi(eq + 1);
+    }
+    int total = 0;
+    for (int op = 0; op < BENCH_OPS; op++) total += weights[op];
+    return total > 0 ? total : -1;
+}
+
+int main(int argc, char* argv[]) {
+    int ss_count = 2;
+    int clients = 16;
+    int duration = 10;
+    int base_port = 19400;
+    const char* mix = "create=5,read=50,write=30,view=10,checkpoint=5";
+    const char* json_path = "tests/bench_cluster.json";
+
+    int opt;
+    while ((opt = getopt(argc, argv, "s:c:d:m:p:o:")) != -1) {
+        switch (opt) {
+            case 's': ss_count = atoi(optarg); break;
+            case 'c': clients = atoi(optarg); break;
+            case 'd': duration = atoi(optarg); break;
+            case 'm': mix = optarg; break;
+            case 'p': base_port = atoi(optarg); break;
+            case 'o': json_path = optarg; break;
+            default: ss_count = 0; break;
+        }
+    }
+    int weights[BENCH_OPS];
+    int weight_total = parse_mix(mix, weights);
+    if (ss_count < 1 || ss_count > MAX_BENCH_SS || clients < 1 || clients > MAX_BENCH_CLIENTS ||
+        duration < 1 || base_port < 1024 || weight_total < 0) {
+        fprintf(stderr, "Usage: %s [-s storage_servers (1-%d)] [-c clients (1-%d)] [-d seconds]\n"
+                        "       [-m create=N,read=N,write=N,view=N,checkpoint=N,lookup=N,info=N,delete=N]\n"
+                        "       [-p base_port] [-o json_file]\n",
+                argv[0], MAX_BENCH_SS, MAX_BENCH_CLIENTS);
+        return 1;
+    }
+    signal(SIGPIPE, SIG_IGN);
+
+    // The daemons keep data/ and logs/ relative to their working directory
+    char ns_bin[MAX_PATH], ss_bin[MAX_PATH];
+    if (!realpath("./name_server", ns_bin) || !realpath("./storage_server", ss_bin)) {
+        fprintf(stderr, "Run from the repository root after `make all`\n");
+        return 1;
+    }
+    char scratch[] = "/tmp/docs-bench-XXXXXX";
+    if (!mkdtemp(scratch)) {
+        perror("mkdtemp");
+        return 1;
+    }
+
+    pid_t pids[MAX_BENCH_SS + 1];
+    int spawned = 0;
+    char nm_port[16];
+    snprintf(nm_port, sizeof(nm_port), "%d", base_port);
+    char* ns_argv[] = { ns_bin, nm_port, NULL };
+    pids[spawned++] = spawn(scratch, ns_argv);
+
+    int rc = wait_for_port(base_port);
+    for (int i = 1; rc == 0 && i <= ss_count; i++) {
+        char client_port[16], server_id[16];
+        snprintf(client_port, sizeof(client_port), "%d", base_port + i);
+        snprintf(server_id, sizeof(server_id), "%d", i);
+        char* ss_argv[] = { ss_bin, "127.0.0.1", nm_port, client_port, server_id, NULL };
+        pids[spawned++] = spawn(scratch, ss_argv);
+    }
+    // A Storage Server opens its client port once it has registered
+    for (int i = 1; rc == 0 && i <= ss_count; i++) {
+        rc = wait_for_port(base_port + i);
+    }
+    // Servers learn their replica from the next heartbeat reply; files created
+    // before that are not replicated, and reads routed to the replica miss
+    if (rc == 0 && ss_count > 1) {
+        sleep(HEARTBEAT_CHECK_INTERVAL);
+    }
+
+    BenchClient* cs = calloc(clients, sizeof(BenchClient));
+    pthread_t* threads = calloc(clients, sizeof(pthread_t));
+    volatile int stop = 0;
+    int started = 0;
+    double start = now_us(), elapsed_s = 0;
+    if (rc < 0) {
+        fprintf(stderr, "Cluster did not start (logs in %s/logs)\n", scratch);
+    } else {
+        for (; started < clients; started++) {
+            BenchClient* c = &cs[started];
+            c->id = started;
+            c->nm_port = base_port;
+            c->weights = weights;
+            c->weight_total = weight_total;
+            c->stop = &stop;
+            c->seed = 1234 + started;
+            snprintf(c->username, sizeof(c->username), "bench%d", started);
+            pthread_create(&threads[started], NULL, client_main, c);
+        }
+        start = now_us();
+        sleep(duration);
+        stop = 1;
+        for (int i = 0; i < started; i++) {
+            pthread_join(threads[i], NULL);
+        }
+        elapsed_s = (now_us() - start) / 1e6;
+    }
+    cJSON* nm_stats = rc == 0 ? fetch_nm_stats(base_port) : NULL;
+
+    for (int i = 0; i < spawned; i++) kill(pids[i], SIGTERM);
+    for (int i = 0; i < spawned; i++) waitpid(pids[i], NULL, 0);
+    if (rc < 0) {
+        free(cs);
+        free(threads);
+        return 1;
+    }
+    nftw(scratch, remove_entry, 16, FTW_DEPTH | FTW_PHYS);
+
+    // Merge per-client samples
+    OpStats merged[BENCH_OPS];
+    memset(merged, 0, sizeof(merged));
+    int failed_setup = 0;
+    for (int i = 0; i < started; i++) {
+        failed_setup += cs[i].setup_failed;
+        for (int op = 0; op < BENCH_OPS; op++) {
+            OpStats* s = &cs[i].stats[op];
+            for (int k = 0; k < s->count; k++) record(&merged[op], 1, s->samples[k]);
+            merged[op].errors += s->errors;
+            free(s->samples);
+        }
+        if (cs[i].nm_socket > 0) close(cs[i].nm_socket);
+    }
+
+    printf("\n=== Cluster benchmark: %d storage server(s), %d client(s), %d s, mix %s ===\n\n",
+           ss_count, clients, duration, mix);
+    printf("%-11s %9s %7s %10s %10s %10s %10s\n", "op", "count", "errors", "ops/s", "p50_us",
+           "p95_us", "p99_us");
+
+    cJSON* root = cJSON_CreateObject();
+    cJSON* config_json = cJSON_AddObjectToObject(root, "config");
+    cJSON_AddNumberToObject(config_json, "storage_servers", ss_count);
+    cJSON_AddNumberToObject(config_json, "clients", clients);
+    cJSON_AddNumberToObject(config_json, "duration_s", duration);
+    cJSON_AddStringToObject(config_json, "mix", mix);
+    cJSON_AddNumberToObject(root, "elapsed_s", elapsed_s);
+    cJSON* ops_json = cJSON_AddObjectToObject(root, "ops");
+
+    long total = 0, total_errors = 0;
+    for (int op = 0; op < BENCH_OPS; op++) {
+        OpStats* s = &merged[op];
+        if (s->count == 0 && s->errors == 0) continue;
+        qsort(s->samples, s->count, sizeof(double), compare_double);
+        double rate = s->count / elapsed_s;
+        printf("%-11s %9d %7d %10.0f %10.0f %10.0f %10.0f\n", op_names[op], s->count, s->errors,
+               rate, percentile(s, 0.50), percentile(s, 0.95), percentile(s, 0.99));
+
+        cJSON* o = cJSON_AddObjectToObject(ops_json, op_names[op]);
+        cJSON_AddNumberToObject(o, "count", s->count);
+        cJSON_AddNumberToObject(o, "errors", s->errors);
+        cJSON_AddNumberToObject(o, "ops_per_s", rate);
+        cJSON_AddNumberToObject(o, "p50_us", percentile(s, 0.50));
+        cJSON_AddNumberToObject(o, "p95_us", percentile(s, 0.95));
+        cJSON_AddNumberToObject(o, "p99_us", percentile(s, 0.99));
+        total += s->count;
+        total_errors += s->errors;
+        free(s->samples);
+    }
+    printf("%-11s %9ld %7ld %10.0f\n", "total", total, total_errors, total / elapsed_s);
+    if (failed_setup > 0) {
+        printf("\n%d client(s) could not connect or create their first file\n", failed_setup);
+    }
+    cJSON_AddNumberToObject(root, "total_ops", total);
+    cJSON_AddNumberToObject(root, "total_errors", total_errors);
+    cJSON_AddNumberToObject(root, "ops_per_s", total / elapsed_s);
+    cJSON_AddNumberToObject(root, "failed_clients", failed_setup);
+
+    if (nm_stats) {
+        // Storage Server figures are not needed to read the Name Server's
+        cJSON_DeleteItemFromObject(nm_stats, "storage_servers");
+        printf("\nName Server side (OP_STATS):\n");
+        printf("%-15s %9s %10s %10s %10s\n", "op", "count", "p50_us", "p99_us", "max_us");
+        print_nm_group(cJSON_GetObjectItem(nm_stats, "ops"));
+        printf("%-15s %9s %10s %10s %10s\n", "lock wait", "count", "p50_us", "p99_us", "max_us");
+        print_nm_group(cJSON_GetObjectItem(nm_stats, "lock_waits"));
+        cJSON_AddItemToObject(root, "name_server", nm_stats);
+    }
+
+    char* json = cJSON_Print(root);
+    FILE* f = fopen(json_path, "w");
+    if (f && json) {
+        fprintf(f, "%s\n", json);
+        printf("\nJSON results written to %s\n\n", json_path);
+    } else {
+        fprintf(stderr, "Could not write %s\n", json_path);
+    }
+    if (f) fclose(f);
+    free(json);
+    cJSON_Delete(root);
+    free(cs);
+    free(threads);
+    return failed_setup == started ? 1 : 0;
+}
@@ -0,0 +1,167 @@
+/**
+ * handler_tests.c - Tests for Name Server request handling
+ *
+ * Drives nm_handle_request() directly over a socketpair, with the registry
+ * filled in process and no Storage Server attached, and checks the replies
+ * a client would receive.
+ */
+
+#include "common.h"
+#include "name_server.h"
+#include <assert.h>
+
+#define TEST(name) static void test_##name(void)
+#define RUN_TEST(name) do { \
+    printf("  Testing %s... ", #name); \
+    fflush(stdout); \
+    test_##name(); \
+    printf("✓\n"); \
+} while(0)
+
+#define ASSERT_EQ(a, b) do { \
+    if ((a) != (b)) { \
+        fprintf(stderr, "FAIL: %s != %s (%ld != %ld, line %d)\n", \
+                #a, #b, (long)(a), (long)(b), __LINE__); \
+        exit(1); \
+    } \
+} while(0)
+
+// Normally defined by the Name Server's main.c
+NameServerState ns_state;
+
+static void setup_state(void) {
+    memset(&ns_state, 0, sizeof(ns_state));
+    pthread_rwlock_init(&ns_state.lock, NULL);
+    for (int i = 0; i < NM_FILE_LOCK_STRIPES; i++) {
+        pthread_rwlock_init(&ns_state.file_locks[i], NULL);
+    }
+    ns_state.file_trie_root = trie_create_node();
+    ns_state.file_view = file_view_create();
+    ss_pool_init();
+    assert(nm_registry_init() == ERR_SUCCESS);
+}
+
+// Send one request through nm_handle_request() and receive its reply
+static char* request(int op_code, int flags, const char* username, MessageHeader* reply) {
+    int fds[2];
+    assert(socketpair(AF_UNIX, SOCK_STREAM, 0, fds) == 0);
+    NMSession session;
+    nm_session_init(&session, fds[0]);
+    safe_strncpy(session.username, username, sizeof(session.username));
+
+    MessageHeader header;
+    init_message_header(&header, MSG_REQUEST, op_code, username);
+    header.flags = flags;
+    nm_handle_request(&session, &header, NULL);
+
+    char* payload = NULL;
+    assert(recv_message(fds[1], reply, &payload) >= 0);
+    close(fds[0]);
+    close(fds[1]);
+    return payload;
+}
+
+static int count_lines(const char* text) {
+    int lines = 0;
+    for (const char* p = text; p && *p; p++) {
+        lines += (*p == '\n');
+    }
+    return lines;
+}
+
+/* === Replies larger than BUFFER_SIZE === */
+
+#define MANY 1500
+
+TEST(view_lists_more_than_a_buffer) {
+    for (int i = 0; i < MANY; i++) {
+        char name[64];
+        snprintf(name, sizeof(name), "report_%04d.txt", i);
+        ASSERT_EQ(nm_register_file(name, NULL, "alice", 1), ERR_SUCCESS);
+    }
+    nm_register_file("notes.txt", NULL, "bob", 1);  // Not visible to alice
+
+    MessageHeader reply;
+    char* payload = request(OP_VIEW, 0, "alice", &reply);
+    ASSERT_EQ(reply.msg_type, MSG_RESPONSE);
+    assert(reply.data_length > BUFFER_SIZE);
+    ASSERT_EQ(count_lines(payload), MANY);
+    assert(strstr(payload, "report_0000.txt\n"));
+    assert(strstr(payload, "report_1499.txt\n"));
+    assert(!strstr(payload, "notes.txt"));
+    free(payload);
+
+    // VIEW -l: one line per file, with counts, time and owner
+    payload = request(OP_VIEW, 2, "alice", &reply);
+    ASSERT_EQ(reply.msg_type, MSG_RESPONSE);
+    ASSERT_EQ(count_lines(payload), MANY);
+    ASSERT_EQ((int)strlen(payload), reply.data_length);
+    free(payload);
+}
+
+TEST(list_names_more_than_a_buffer) {
+    for (int i = 0; i < MANY; i++) {
+        char name[MAX_USERNAME];
+        snprintf(name, sizeof(name), "user_%04d", i);
+        ClientInfo client;
+        memset(&client, 0, sizeof(client));
+        safe_strncpy(client.username, name, sizeof(client.username));
+        client.is_connected = (i % 2 == 0);
+        assert(registry_insert(&ns_state.clients, &client) >= 0);
+    }
+
+    MessageHeader reply;
+    char* payload = request(OP_LIST, 0, "user_0000", &reply);
+    ASSERT_EQ(reply.msg_type, MSG_RESPONSE);
+    assert(reply.data_length > BUFFER_SIZE);
+    ASSERT_EQ(count_lines(payload), MANY / 2);
+    assert(strstr(payload, "user_1498\n"));
+    assert(!strstr(payload, "user_1499"));
+    free(payload);
+}
+
+/* === Journal failures === */
+
+TEST(changes_apply_when_journal_write_fails) {
+    // Every journal write fails with ENOSPC
+    char dir[] = "/tmp/handler_journalXXXXXX";
+    assert(mkdtemp(dir));
+    char path[64];
+    snprintf(path, sizeof(path), "%s/nm_journal.0", dir);
+    assert(symlink("/dev/full", path) == 0);
+    ASSERT_EQ(journal_open(dir, 0, JOURNAL_SYNC_ALWAYS, NULL), ERR_SUCCESS);
+
+    // Applied in memory, so reported as applied rather than failed, and a
+    // retry sees the first attempt
+    ASSERT_EQ(nm_register_file("unsynced.txt", NULL, "alice", 1), ERR_SUCCESS);
+    assert(nm_find_file("unsynced.txt") != NULL);
+    ASSERT_EQ(nm_register_file("unsynced.txt", NULL, "alice", 1), ERR_FILE_EXISTS);
+    ASSERT_EQ(nm_create_folder("unsynced_dir", "alice"), ERR_SUCCESS);
+    ASSERT_EQ(nm_delete_file("unsynced.txt"), ERR_SUCCESS);
+    assert(nm_find_file("unsynced.txt") == NULL);
+
+    JournalStats stats;
+    journal_get_stats(&stats);
+    ASSERT_EQ(stats.failed_commits, 3);
+    ASSERT_EQ(stats.writes, 0);
+
+    journal_close();
+    unlink(path);
+    rmdir(dir);
+}
+
+int main(void) {
+    printf("\n=== Name Server Handler Tests ===\n\n");
+
+    setup_state();
+
+    printf("Large replies:\n");
+    RUN_TEST(view_lists_more_than_a_buffer);
+    RUN_TEST(list_names_more_than_a_buffer);
+
+    printf("\nJournal:\n");
+    RUN_TEST(changes_apply_when_journal_write_fails);
+
+    printf("\n=== All handler tests passed! ===\n\n");
+    return 0;
+}
@@ -0,0 +1,169 @@
+/**
+ * latency_bench.c - Round-trip latency of small request/response exchanges
+ *
+ * Runs an echo server thread on a loopback TCP socket and measures the round
+ * trip of a small request (a header plus a short payload) under three send
+ * strategies:
+ *
+ *   split+nagle    header and payload in two send() calls, Nagle on
+ *                  (how send_message used to write frames)
+ *   vectored+nagle one sendmsg() per frame, Nagle on
+ *   vectored+nodelay one sendmsg() per frame, SOCKET_ROLE_INTERACTIVE
+ *
+ * The split path stalls on delayed ACKs (tens of milliseconds per trip), so
+ * it is sampled with at most SPLIT_MAX_TRIPS round trips.
+ *
+ * Usage: ./tests/bench_latency [round_trips] [payload_bytes]
+ */
+
+#include "common.h"
+#include <netinet/tcp.h>
+
+#define SPLIT_MAX_TRIPS 50
+
+typedef enum { MODE_SPLIT_NAGLE, MODE_VECTORED_NAGLE, MODE_VECTORED_NODELAY } SendMode;
+
+static const char* mode_names[] = { "split+nagle", "vectored+nagle", "vectored+nodelay" };
+
+typedef struct {
+    int listen_fd;
+    SendMode mode;
+    int round_trips;
+} EchoServer;
+
+// The pre-vectored send path: header and payload as separate writes
+static int split_send(int sockfd, MessageHeader* header, const char* payload) {
+    if (send(sockfd, header, WIRE_V1_HEADER_SIZE, 0) != (ssize_t)WIRE_V1_HEADER_SIZE) {
+        return -1;
+    }
+    if (header->data_length > 0 &&
+        send(sockfd, payload, header->data_length, 0) != header->data_length) {
+        return -1;
+    }
+    return 0;
+}
+
+static int bench_send(SendMode mode, int sockfd, MessageHeader* header, const char* payload) {
+    return mode == MODE_SPLIT_NAGLE ? split_send(sockfd, header, payload)
+                                    : send_message(sockfd, header, payload);
+}
+
+static void apply_mode(SendMode mode, int sockfd) {
+    set_socket_protocol(sockfd, PROTOCOL_V1);
+    if (mode == MODE_VECTORED_NODELAY) {
+        set_socket_role(sockfd, SOCKET_ROLE_INTERACTIVE);
+    } else {
+        int off = 0;
+        setsockopt(sockfd, IPPROTO_TCP, TCP_NODELAY, &off, sizeof(off));
+    }
+}
+
+static void* echo_thread(void* arg) {
+    EchoServer* srv = arg;
+    int fd = accept(srv->listen_fd, NULL, NULL);
+    if (fd < 0) return NULL;
+    apply_mode(srv->mode, fd);
+
+    for (int i = 0; i < srv->round_trips; i++) {
+        MessageHeader header;
+        char* payload = NULL;
+        if (recv_message(fd, &header, &payload) <= 0) break;
+        header.msg_type = MSG_RESPONSE;
+        bench_send(srv->mode, fd, &header, payload);
+        free(payload);
+    }
+    close(fd);
+    return NULL;
+}
+
+static int compare_double(const void* a, const void* b) {
+    double x = *(const double*)a, y = *(const double*)b;
+    return (x > y) - (x < y);
+}
+
+static double now_us(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e6 + ts.tv_nsec / 1e3;
+}
+
+static int run_mode(SendMode mode, int round_trips, int payload_bytes) {
+    if (mode == MODE_SPLIT_NAGLE && round_trips > SPLIT_MAX_TRIPS) {
+        round_trips = SPLIT_MAX_TRIPS;
+    }
+
+    int listen_fd = create_server_socket(0);
+    if (listen_fd < 0) return -1;
+    struct sockaddr_in addr;
+    socklen_t addr_len = sizeof(addr);
+    getsockname(listen_fd, (struct sockaddr*)&addr, &addr_len);
+
+    EchoServer srv = { listen_fd, mode, round_trips };
+    pthread_t server;
+    pthread_create(&server, NULL, echo_thread, &srv);
+
+    int fd = connect_to_server("127.0.0.1", ntohs(addr.sin_port));
+    if (fd < 0) {
+        close(listen_fd);
+        return -1;
+    }
+    apply_mode(mode, fd);
+
+    char* payload = malloc(payload_bytes + 1);
+    memset(payload, 'x', payload_bytes);
+    payload[payload_bytes] = '\0';
+    double* samples = malloc(round_trips * sizeof(double));
+
+    int done = 0;
+    for (; done < round_trips; done++) {
+        MessageHeader header;
+        init_message_header(&header, MSG_REQUEST, OP_SS_WRITE_WORD, "bench");
+        header.data_length = payload_bytes;
+
+        double start = now_us();
+        char* reply = NULL;
+        if (bench_send(mode, fd, &header, payload) < 0 ||
+            recv_message(fd, &header, &reply) <= 0) {
+            break;
+        }
+        samples[done] = now_us() - start;
+        free(reply);
+    }
+
+    close(fd);
+    pthread_join(server, NULL);
+    close(listen_fd);
+
+    if (done > 0) {
+        double total = 0;
+        for (int i = 0; i < done; i++) total += samples[i];
+        qsort(samples, done, sizeof(double), compare_double);
+        printf("%-18s %8d %10.1f %10.1f %10.1f %10.1f\n", mode_names[mode], done,
+               total / done, samples[done / 2], samples[(int)(done * 0.99)], samples[done - 1]);
+    }
+    free(samples);
+    free(payload);
+    return done == round_trips ? 0 : -1;
+}
+
+int main(int argc, char* argv[]) {
+    int round_trips = argc > 1 ? atoi(argv[1]) : 2000;
+    int payload_bytes = argc > 2 ? atoi(argv[2]) : 32;
+    if (round_trips < 1 || payload_bytes < 1) {
+        fprintf(stderr, "Usage: %s [round_trips] [payload_bytes]\n", argv[0]);
+        return 1;
+    }
+
+    printf("\n=== Small-op latency (loopback TCP, %d-byte payload) ===\n\n", payload_bytes);
+    printf("%-18s %8s %10s %10s %10s %10s\n", "mode", "trips", "mean_us", "p50_us", "p99_us", "max_us");
+
+    int rc = 0;
+    for (int mode = MODE_SPLIT_NAGLE; mode <= MODE_VECTORED_NODELAY; mode++) {
+        if (run_mode(mode, round_trips, payload_bytes) < 0) {
+            fprintf(stderr, "%s: benchmark failed\n", mode_names[mode]);
+            rc = 1;
+        }
+    }
+    printf("\n");
+    return rc;
+}
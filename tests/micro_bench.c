@@ -0,0 +1,545 @@
+/**
+ * micro_bench.c - Timings of the core data structures
+ *
+ * Measures, in-process and single-threaded:
+ *
+ *   pt_insert / pt_delete    1000 random edits to a piece table of 1 KiB-10 MiB
+ *   pt_materialize           flattening a table fragmented by 1000 edits
+ *   parse_sentences_to_list  splitting text into the Storage Server's list
+ *   doc_create / doc_edit    Document parse, and lock+edit+unlock with reparse
+ *   trie_insert / search     the Name Server's path index (radix tree), plus
+ *   trie_walk / delete       a folder listing and removing every path
+ *   cache_put / cache_get    the Name Server's LRU lookup cache
+ *   registry_insert / find   the Name Server's file table (slabs + hash index
+ *   registry_remove          by full path), against the linear scan it replaced
+ *
+ * Every case is run a fixed number of times on identical, seeded input and
+ * the median is reported as ns/op and ops/s, with the heap allocations
+ * (count and bytes) the timed code made per op. Results are written as JSON;
+ * pass an earlier result file with -b to print the change against it.
+ *
+ * Usage: ./tests/bench_micro [-r repetitions] [-o json_file] [-b baseline_json]
+ */
+
+#include "common.h"
+#include "storage_server.h"
+#include "name_server.h"
+#include "document.h"
+#include "cJSON.h"
+
+// Unused here, but the Storage Server sources linked in refer to them
+SSConfig config;
+volatile sig_atomic_t server_running = 1;
+
+#define MAX_REPS 99
+
+// ============ Allocation counting ============
+
+// glibc exports its allocator under these names so that programs can
+// interpose on malloc(); calls made inside libc (strdup...) come here too
+extern void* __libc_malloc(size_t size);
+extern void* __libc_calloc(size_t n, size_t size);
+extern void* __libc_realloc(void* ptr, size_t size);
+
+static unsigned long alloc_calls;
+static unsigned long long alloc_bytes;
+
+void* malloc(size_t size) {
+    alloc_calls++;
+    alloc_bytes += size;
+    return __libc_malloc(size);
+}
+
+void* calloc(size_t n, size_t size) {
+    alloc_calls++;
+    alloc_bytes += n * size;
+    return __libc_calloc(n, size);
+}
+
+void* realloc(void* ptr, size_t size) {
+    alloc_calls++;
+    alloc_bytes += size;
+    return __libc_realloc(ptr, size);
+}
+
+// ============ Measurement ============
+
+typedef struct {
+    double us;
+    unsigned long allocs;
+    unsigned long long bytes;
+} Sample;
+
+static double sample_start;
+
+static double now_us(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e6 + ts.tv_nsec / 1e3;
+}
+
+static void sample_begin(void) {
+    alloc_calls = 0;
+    alloc_bytes = 0;
+    sample_start = now_us();
+}
+
+static void sample_end(Sample* s) {
+    s->us = now_us() - sample_start;
+    s->allocs = alloc_calls;
+    s->bytes = alloc_bytes;
+}
+
+static int reps = 5;
+static cJSON* results_json;
+static cJSON* baseline_json;
+
+static int compare_samples(const void* a, const void* b) {
+    double x = ((const Sample*)a)->us, y = ((const Sample*)b)->us;
+    return (x > y) - (x < y);
+}
+
+static void size_label(char* out, size_t len, size_t size, const char* unit) {
+    if (strcmp(unit, "bytes") != 0) snprintf(out, len, "%zu %s", size, unit);
+    else if (size >= 1024 * 1024) snprintf(out, len, "%zu MiB", size / (1024 * 1024));
+    else snprintf(out, len, "%zu KiB", size / 1024);
+}
+
+static const cJSON* find_baseline(const char* name, size_t size) {
+    const cJSON* r;
+    cJSON_ArrayForEach(r, cJSON_GetObjectItem(baseline_json, "results")) {
+        const cJSON* n = cJSON_GetObjectItem(r, "name");
+        const cJSON* s = cJSON_GetObjectItem(r, "size");
+        if (cJSON_IsString(n) && cJSON_IsNumber(s) && strcmp(n->valuestring, name) == 0 &&
+            (size_t)s->valuedouble == size) {
+            return r;
+        }
+    }
+    return NULL;
+}
+
+/**
+ * report
+ * @brief Print one case from the median of its samples and add it to the
+ *        JSON results.
+ *
+ * @param name Function (or operation) measured.
+ * @param size Input size the case ran at.
+ * @param unit What size counts ("bytes", "sentences", ...).
+ * @param ops Operations performed in each sample.
+ * @param samples One sample per repetition; sorted in place.
+ */
+static void report(const char* name, size_t size, const char* unit, int ops, Sample* samples) {
+    qsort(samples, reps, sizeof(Sample), compare_samples);
+    Sample* median = &samples[reps / 2];
+    double ns_per_op = median->us * 1000.0 / ops;
+    double allocs_per_op = (double)median->allocs / ops;
+    double bytes_per_op = (double)median->bytes / ops;
+
+    char label[32];
+    size_label(label, sizeof(label), size, unit);
+    printf("%-24s %15s %7d %12.1f %12.0f %10.2f %12.1f", name, label, ops, ns_per_op,
+           1e9 / ns_per_op, allocs_per_op, bytes_per_op);
+
+    const cJSON* base = baseline_json ? find_baseline(name, size) : NULL;
+    const cJSON* base_ns = base ? cJSON_GetObjectItem(base, "ns_per_op") : NULL;
+    if (cJSON_IsNumber(base_ns) && base_ns->valuedouble > 0) {
+        printf(" %+9.1f%%", (ns_per_op / base_ns->valuedouble - 1.0) * 100.0);
+    }
+    printf("\n");
+
+    cJSON* r = cJSON_CreateObject();
+    cJSON_AddStringToObject(r, "name", name);
+    cJSON_AddNumberToObject(r, "size", size);
+    cJSON_AddStringToObject(r, "unit", unit);
+    cJSON_AddNumberToObject(r, "ops", ops);
+    cJSON_AddNumberToObject(r, "ns_per_op", ns_per_op);
+    cJSON_AddNumberToObject(r, "ops_per_s", 1e9 / ns_per_op);
+    cJSON_AddNumberToObject(r, "min_ns_per_op", samples[0].us * 1000.0 / ops);
+    cJSON_AddNumberToObject(r, "allocs_per_op", allocs_per_op);
+    cJSON_AddNumberToObject(r, "bytes_per_op", bytes_per_op);
+    cJSON_AddItemToArray(results_json, r);
+}
+
+// ============ Inputs ============
+
+static const char* words[] = {
+    "the", "document", "server", "and", "a", "of", "to", "sentence", "is", "replica",
+    "in", "that", "storage", "name", "with", "file", "for", "this", "edit", "we",
+};
+
+// Deterministic prose with a sentence delimiter every dozen words or so
+static char* make_text(size_t len, unsigned int seed) {
+    char* buf = malloc(len + 1);
+    size_t pos = 0;
+    while (pos < len) {
+        const char* w = words[rand_r(&seed) % (sizeof(words) / sizeof(words[0]))];
+        char piece[32];
+        int n = snprintf(piece, sizeof(piece), "%s%s", w, rand_r(&seed) % 12 == 0 ? ". " : " ");
+        size_t take = len - pos < (size_t)n ? len - pos : (size_t)n;
+        memcpy(buf + pos, piece, take);
+        pos += take;
+    }
+    buf[len] = '\0';
+    return buf;
+}
+
+// Text of `count` short sentences
+static char* make_sentences(int count) {
+    char* buf = malloc(count * 48 + 1);
+    size_t pos = 0;
+    for (int i = 0; i < count; i++) {
+        pos += sprintf(buf + pos, "Sentence %d talks about the server. ", i);
+    }
+    buf[pos] = '\0';
+    return buf;
+}
+
+static void make_path(char* out, size_t len, int i) {
+    snprintf(out, len, "projects/team%d/notes_%d.txt", i % 37, i);
+}
+
+static int clamp(long v, int lo, int hi) {
+    return v < lo ? lo : v > hi ? hi : (int)v;
+}
+
+// ============ Piece table ============
+
+#define PT_EDITS 1000
+
+static const size_t pt_sizes[] = { 1024, 10 * 1024, 100 * 1024, 1024 * 1024, 10 * 1024 * 1024 };
+
+static void bench_piece_table(void) {
+    for (size_t k = 0; k < sizeof(pt_sizes) / sizeof(pt_sizes[0]); k++) {
+        size_t size = pt_sizes[k];
+        char* text = make_text(size, 1);
+        Sample insert[MAX_REPS], del[MAX_REPS], flat[MAX_REPS];
+        int flat_ops = clamp((64L * 1024 * 1024) / size, 4, 2000);
+
+        for (int r = 0; r < reps; r++) {
+            PieceTable* pt = pt_create(text);
+            unsigned int seed = 42;
+            sample_begin();
+            for (int i = 0; i < PT_EDITS; i++) {
+                pt_insert(pt, rand_r(&seed) % (pt_length(pt) + 1), "word ");
+            }
+            sample_end(&insert[r]);
+
+            // The fragmented table is what materialize usually sees
+            sample_begin();
+            for (int i = 0; i < flat_ops; i++) {
+                free(pt_materialize(pt));
+            }
+            sample_end(&flat[r]);
+            pt_destroy(pt);
+
+            pt = pt_create(text);
+            seed = 43;
+            sample_begin();
+            for (int i = 0; i < PT_EDITS; i++) {
+                pt_delete(pt, rand_r(&seed) % pt_length(pt), 1);
+            }
+            sample_end(&del[r]);
+            pt_destroy(pt);
+        }
+        report("pt_insert", size, "bytes", PT_EDITS, insert);
+        report("pt_delete", size, "bytes", PT_EDITS, del);
+        report("pt_materialize", size, "bytes", flat_ops, flat);
+        free(text);
+    }
+}
+
+// ============ Sentences and documents ============
+
+static void bench_sentences(void) {
+    static const size_t sizes[] = { 1024, 100 * 1024, 1024 * 1024 };
+    for (size_t k = 0; k < sizeof(sizes) / sizeof(sizes[0]); k++) {
+        char* text = make_text(sizes[k], 2);
+        int ops = clamp((16L * 1024 * 1024) / sizes[k], 4, 1000);
+        SentenceNode** lists = malloc(ops * sizeof(SentenceNode*));
+        Sample s[MAX_REPS];
+
+        for (int r = 0; r < reps; r++) {
+            int count;
+            sample_begin();
+            for (int i = 0; i < ops; i++) {
+                lists[i] = parse_sentences_to_list(text, &count);
+            }
+            sample_end(&s[r]);
+            for (int i = 0; i < ops; i++) {
+                free_sentence_list(lists[i]);
+            }
+        }
+        report("parse_sentences_to_list", sizes[k], "bytes", ops, s);
+        free(lists);
+        free(text);
+    }
+}
+
+#define DOC_EDITS 500
+
+static void bench_document(void) {
+    static const int counts[] = { 100, 900 };
+    for (size_t k = 0; k < sizeof(counts) / sizeof(counts[0]); k++) {
+        char* text = make_sentences(counts[k]);
+        int create_ops = counts[k] > 100 ? 50 : 500;
+        Document** docs = malloc(create_ops * sizeof(Document*));
+        Sample create[MAX_REPS], edit[MAX_REPS];
+
+        for (int r = 0; r < reps; r++) {
+            sample_begin();
+            for (int i = 0; i < create_ops; i++) {
+                docs[i] = doc_create(text);
+            }
+            sample_end(&create[r]);
+            for (int i = 1; i < create_ops; i++) {
+                doc_destroy(docs[i]);
+            }
+
+            Document* doc = docs[0];
+            unsigned int seed = 44;
+            sample_begin();
+            for (int i = 0; i < DOC_EDITS; i++) {
+                int id = doc_get_sentence_by_index(doc, rand_r(&seed) % doc_get_sentence_count(doc));
+                doc_lock_sentence(doc, id, "bench");
+                doc_edit_sentence(doc, id, "This sentence was edited. ", "bench");
+                doc_unlock_sentence(doc, id, "bench");
+            }
+            sample_end(&edit[r]);
+            doc_destroy(doc);
+        }
+        report("doc_create", counts[k], "sentences", create_ops, create);
+        report("doc_edit_sentence", counts[k], "sentences", DOC_EDITS, edit);
+        free(docs);
+        free(text);
+    }
+}
+
+// ============ Name Server lookups ============
+
+static int count_walked(void* ctx, const char* path, int file_index) {
+    (void)path;
+    (void)file_index;
+    (*(int*)ctx)++;
+    return 0;
+}
+
+static void bench_trie(void) {
+    static const int counts[] = { 1000, 10000, 100000 };
+    for (size_t k = 0; k < sizeof(counts) / sizeof(counts[0]); k++) {
+        int n = counts[k];
+        char (*paths)[MAX_PATH] = malloc(n * sizeof(*paths));
+        for (int i = 0; i < n; i++) {
+            make_path(paths[i], MAX_PATH, i);
+        }
+        Sample insert[MAX_REPS], search[MAX_REPS], walk[MAX_REPS], delete[MAX_REPS];
+
+        for (int r = 0; r < reps; r++) {
+            TrieNode* root = trie_create_node();
+            sample_begin();
+            for (int i = 0; i < n; i++) {
+                trie_insert(root, paths[i], i);
+            }
+            sample_end(&insert[r]);
+
+            int found = 0;
+            sample_begin();
+            for (int i = 0; i < n; i++) {
+                found += trie_search(root, paths[(i * 7919) % n]) >= 0;
+            }
+            sample_end(&search[r]);
+            if (found != n) {
+                fprintf(stderr, "trie_search: %d of %d paths missing\n", n - found, n);
+            }
+
+            // Everything in one team's folder (1/37 of the paths)
+            int walked = 0;
+            sample_begin();
+            trie_walk(root, "projects/team7/", count_walked, &walked);
+            sample_end(&walk[r]);
+
+            sample_begin();
+            for (int i = 0; i < n; i++) {
+                trie_delete(root, paths[(i * 7919) % n]);
+            }
+            sample_end(&delete[r]);
+            trie_free(root);
+        }
+        // bytes/op of trie_insert is the index memory allocated per path
+        report("trie_insert", n, "paths", n, insert);
+        report("trie_search", n, "paths", n, search);
+        report("trie_walk", n, "paths", n / 37, walk);
+        report("trie_delete", n, "paths", n, delete);
+        free(paths);
+    }
+}
+
+#define CACHE_OPS 100000
+
+static void bench_cache(void) {
+    // Key sets that fit the cache, and that keep it evicting
+    static const int counts[] = { LRU_CACHE_SIZE, LRU_CACHE_SIZE * 10 };
+    for (size_t k = 0; k < sizeof(counts) / sizeof(counts[0]); k++) {
+        int n = counts[k];
+        char (*paths)[MAX_PATH] = malloc(n * sizeof(*paths));
+        for (int i = 0; i < n; i++) {
+            make_path(paths[i], MAX_PATH, i);
+        }
+        Sample put[MAX_REPS], get[MAX_REPS];
+
+        for (int r = 0; r < reps; r++) {
+            LRUCache* cache = cache_create(LRU_CACHE_SIZE);
+            unsigned int seed = 45;
+            sample_begin();
+            for (int i = 0; i < CACHE_OPS; i++) {
+                cache_put(cache, paths[rand_r(&seed) % n], i);
+            }
+            sample_end(&put[r]);
+
+            sample_begin();
+            for (int i = 0; i < CACHE_OPS; i++) {
+                cache_get(cache, paths[rand_r(&seed) % n]);
+            }
+            sample_end(&get[r]);
+            cache_free(cache);
+        }
+        report("cache_put", n, "keys", CACHE_OPS, put);
+        report("cache_get", n, "keys", CACHE_OPS, get);
+        free(paths);
+    }
+}
+
+// ============ Registry table ============
+
+#define REGISTRY_SCANS 200
+
+static void bench_file_key(const void* entry, char* key, size_t size) {
+    const FileMetadata* file = (const FileMetadata*)entry;
+    snprintf(key, size, "%s/%s", file->folder_path, file->filename);
+}
+
+static void bench_registry(void) {
+    static const int counts[] = { 1000, 10000, 100000 };
+    for (size_t k = 0; k < sizeof(counts) / sizeof(counts[0]); k++) {
+        int n = counts[k];
+        char (*paths)[MAX_PATH] = malloc(n * sizeof(*paths));
+        for (int i = 0; i < n; i++) {
+            make_path(paths[i], MAX_PATH, i);
+        }
+        Sample insert[MAX_REPS], find[MAX_REPS], scan[MAX_REPS], del[MAX_REPS];
+
+        for (int r = 0; r < reps; r++) {
+            RegistryTable table;
+            registry_init(&table, sizeof(FileMetadata), bench_file_key);
+            FileMetadata file;
+            memset(&file, 0, sizeof(file));
+            sample_begin();
+            for (int i = 0; i < n; i++) {
+                char* slash = strrchr(paths[i], '/');
+                snprintf(file.folder_path, sizeof(file.folder_path), "%.*s",
+                         (int)(slash - paths[i]), paths[i]);
+                snprintf(file.filename, sizeof(file.filename), "%s", slash + 1);
+                registry_insert(&table, &file);
+            }
+            sample_end(&insert[r]);
+
+            int found = 0;
+            sample_begin();
+            for (int i = 0; i < n; i++) {
+                found += registry_find(&table, paths[(i * 7919) % n]) >= 0;
+            }
+            sample_end(&find[r]);
+            if (found != n) {
+                fprintf(stderr, "registry_find: %d of %d paths missing\n", n - found, n);
+            }
+
+            // The lookup nm_find_file() did before: compare every entry
+            sample_begin();
+            for (int i = 0; i < REGISTRY_SCANS; i++) {
+                const char* path = paths[(i * 7919) % n];
+                const char* slash = strrchr(path, '/');
+                for (int id = registry_next(&table, -1); id >= 0; id = registry_next(&table, id)) {
+                    FileMetadata* f = registry_get(&table, id);
+                    if (strcmp(f->filename, slash + 1) == 0 &&
+                        strncmp(f->folder_path, path, slash - path) == 0 &&
+                        f->folder_path[slash - path] == '\0') {
+                        break;
+                    }
+                }
+            }
+            sample_end(&scan[r]);
+
+            sample_begin();
+            for (int i = 0; i < n; i++) {
+                registry_remove(&table, registry_find(&table, paths[(i * 7919) % n]));
+            }
+            sample_end(&del[r]);
+            registry_free(&table);
+        }
+        report("registry_insert", n, "files", n, insert);
+        report("registry_find", n, "files", n, find);
+        report("linear_scan_find", n, "files", REGISTRY_SCANS, scan);
+        report("registry_remove", n, "files", n, del);
+        free(paths);
+    }
+}
+
+int main(int argc, char* argv[]) {
+    const char* json_path = "tests/bench_micro.json";
+    const char* baseline_path = NULL;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "r:o:b:")) != -1) {
+        switch (opt) {
+            case 'r': reps = atoi(optarg); break;
+            case 'o': json_path = optarg; break;
+            case 'b': baseline_path = optarg; break;
+            default: reps = 0; break;
+        }
+    }
+    if (reps < 1 || reps > MAX_REPS) {
+        fprintf(stderr, "Usage: %s [-r repetitions (1-%d)] [-o json_file] [-b baseline_json]\n",
+                argv[0], MAX_REPS);
+        return 1;
+    }
+    if (baseline_path) {
+        FILE* f = fopen(baseline_path, "r");
+        char* data = f ? read_fd_content(fileno(f)) : NULL;
+        baseline_json = data ? cJSON_Parse(data) : NULL;
+        free(data);
+        if (f) fclose(f);
+        if (!baseline_json) {
+            fprintf(stderr, "Could not read baseline %s\n", baseline_path);
+            return 1;
+        }
+    }
+
+    printf("\n=== Data structure microbenchmarks (median of %d runs) ===\n\n", reps);
+    printf("%-24s %15s %7s %12s %12s %10s %12s%s\n", "benchmark", "size", "ops", "ns/op", "ops/s",
+           "allocs/op", "bytes/op", baseline_json ? "  vs_base" : "");
+
+    cJSON* root = cJSON_CreateObject();
+    cJSON_AddNumberToObject(root, "repetitions", reps);
+    results_json = cJSON_AddArrayToObject(root, "results");
+
+    bench_piece_table();
+    bench_sentences();
+    bench_document();
+    bench_trie();
+    bench_cache();
+    bench_registry();
+
+    char* json = cJSON_Print(root);
+    FILE* f = fopen(json_path, "w");
+    if (f && json) {
+        fprintf(f, "%s\n", json);
+        printf("\nJSON results written to %s (pass a copy to -b to compare a later run)\n\n", json_path);
+    } else {
+        fprintf(stderr, "Could not write %s\n", json_path);
+    }
+    if (f) fclose(f);
+    free(json);
+    cJSON_Delete(root);
+    cJSON_Delete(baseline_json);
+    return 0;
+}
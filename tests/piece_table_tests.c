@@ -169,6 +169,16 @@ TEST(delete_spanning_pieces) {
     pt_destroy(pt);
 }
 
+TEST(delete_inside_piece_keeps_following_pieces) {
+    PieceTable* pt = pt_create("Hello World");
+    pt_insert(pt, 5, ",");
+    pt_delete(pt, 1, 2);
+    char* text = pt_materialize(pt);
+    ASSERT_STR_EQ(text, "Hlo, World");
+    free(text);
+    pt_destroy(pt);
+}
+
 /* === Range Tests === */
 
 TEST(get_range_start) {
@@ -322,6 +332,7 @@ int main(void) {
     RUN_TEST(delete_from_middle);
     RUN_TEST(delete_all);
     RUN_TEST(delete_spanning_pieces);
+    RUN_TEST(delete_inside_piece_keeps_following_pieces);
     
     printf("\nRange:\n");
     RUN_TEST(get_range_start);
@@ -0,0 +1,1617 @@
+/**
+ * protocol_tests.c - Tests for wire framing and protocol negotiation
+ *
+ * Covers the compact v2 header codec, v1/v2 interoperability of
+ * send_message/recv_message over a local socketpair (including short
+ * writes), request-ID multiplexing, zero-copy file payloads, chunked
+ * transfers, reusable receive buffers, the Unix-socket transport, payload
+ * relays, compressed frames, the OP_SS_BATCH payload codec, heartbeat
+ * load reports, socket read deadlines, the Name Server's pooled SS
+ * requests and their retries, the asynchronous logger and the OP_STATS
+ * latency histograms.
+ */
+
+#include "common.h"
+#include "name_server.h"
+#include "cJSON.h"
+#include <assert.h>
+#include <poll.h>
+
+// Storage servers the pool tests point ss_pool.c at
+NameServerState ns_state;
+
+#define TEST(name) static void test_##name(void)
+#define RUN_TEST(name) do { \
+    printf("  Testing %s... ", #name); \
+    fflush(stdout); \
+    test_##name(); \
+    printf("✓\n"); \
+} while(0)
+
+#define ASSERT_EQ(a, b) do { \
+    if ((a) != (b)) { \
+        fprintf(stderr, "FAIL: %s != %s (%ld != %ld, line %d)\n", \
+                #a, #b, (long)(a), (long)(b), __LINE__); \
+        exit(1); \
+    } \
+} while(0)
+
+#define ASSERT_STR_EQ(a, b) do { \
+    if (strcmp((a), (b)) != 0) { \
+        fprintf(stderr, "FAIL: '%s' != '%s' (line %d)\n", (a), (b), __LINE__); \
+        exit(1); \
+    } \
+} while(0)
+
+static void make_pair(int fds[2]) {
+    int rc = socketpair(AF_UNIX, SOCK_STREAM, 0, fds);
+    assert(rc == 0);
+    // Descriptor numbers get reused between tests; start each pair on v1
+    set_socket_protocol(fds[0], PROTOCOL_V1);
+    set_socket_protocol(fds[1], PROTOCOL_V1);
+}
+
+/* === Codec Tests === */
+
+TEST(encode_minimal_header) {
+    MessageHeader h;
+    init_message_header(&h, MSG_ACK, OP_HEARTBEAT, NULL);
+    unsigned char buf[WIRE_V2_MAX_HEADER];
+    int n = encode_wire_header(&h, buf, sizeof(buf));
+    ASSERT_EQ(n, WIRE_V2_PREFIX_SIZE);
+    ASSERT_EQ(buf[0], WIRE_V2_MAGIC);
+}
+
+TEST(roundtrip_all_fields) {
+    MessageHeader h;
+    init_message_header(&h, MSG_REQUEST, OP_SS_WRITE_WORD, "alice");
+    strcpy(h.filename, "docs/notes.txt");
+    strcpy(h.foldername, "docs");
+    strcpy(h.checkpoint_tag, "v1");
+    h.error_code = ERR_SENTENCE_LOCKED;
+    h.sentence_index = 7;
+    h.word_index = -1;
+    h.flags = FLAG_IS_REPLICATION;
+    h.data_length = 123456;
+    h.request_id = 300;
+    h.frame_flags = WIRE_FRAME_CHUNKED;
+    h.total_length = 5000000000ULL;  // Beyond 32 bits
+    h.handle = (0xfffffffeULL << 32) | 3;
+
+    unsigned char buf[WIRE_V2_MAX_HEADER];
+    int n = encode_wire_header(&h, buf, sizeof(buf));
+    assert(n > WIRE_V2_PREFIX_SIZE);
+    assert((size_t)n < sizeof(MessageHeader));
+
+    MessageHeader out;
+    ASSERT_EQ(decode_wire_header(buf, n, &out), 0);
+    ASSERT_EQ(out.msg_type, MSG_REQUEST);
+    ASSERT_EQ(out.op_code, OP_SS_WRITE_WORD);
+    ASSERT_STR_EQ(out.username, "alice");
+    ASSERT_STR_EQ(out.filename, "docs/notes.txt");
+    ASSERT_STR_EQ(out.foldername, "docs");
+    ASSERT_STR_EQ(out.checkpoint_tag, "v1");
+    ASSERT_EQ(out.error_code, h.error_code);
+    ASSERT_EQ(out.sentence_index, 7);
+    ASSERT_EQ(out.word_index, -1);
+    ASSERT_EQ(out.flags, FLAG_IS_REPLICATION);
+    ASSERT_EQ(out.data_length, 123456);
+    ASSERT_EQ(out.request_id, 300);
+    ASSERT_EQ(out.frame_flags, WIRE_FRAME_CHUNKED);
+    assert(out.total_length == 5000000000ULL);
+    assert(out.handle == ((0xfffffffeULL << 32) | 3));
+}
+
+TEST(handle_is_shorter_than_filename) {
+    MessageHeader by_name;
+    init_message_header(&by_name, MSG_REQUEST, OP_SS_WRITE_WORD, "alice");
+    strcpy(by_name.filename, "projects/2026/quarterly-report-draft.txt");
+    by_name.sentence_index = 4;
+
+    MessageHeader by_handle = by_name;
+    by_handle.filename[0] = '\0';
+    by_handle.handle = (12ULL << 32) | 1;
+
+    unsigned char buf[WIRE_V2_MAX_HEADER];
+    int name_len = encode_wire_header(&by_name, buf, sizeof(buf));
+    int handle_len = encode_wire_header(&by_handle, buf, sizeof(buf));
+    ASSERT_EQ(handle_len < name_len, 1);
+
+    MessageHeader out;
+    ASSERT_EQ(decode_wire_header(buf, handle_len, &out), 0);
+    ASSERT_EQ(out.filename[0], '\0');
+    assert(out.handle == by_handle.handle);
+    ASSERT_EQ(out.sentence_index, 4);
+}
+
+TEST(decode_rejects_truncated) {
+    MessageHeader h;
+    init_message_header(&h, MSG_REQUEST, OP_READ, "bob");
+    strcpy(h.filename, "a.txt");
+    unsigned char buf[WIRE_V2_MAX_HEADER];
+    int n = encode_wire_header(&h, buf, sizeof(buf));
+
+    MessageHeader out;
+    ASSERT_EQ(decode_wire_header(buf, n - 1, &out), -1);
+    ASSERT_EQ(decode_wire_header(buf, WIRE_V2_PREFIX_SIZE - 1, &out), -1);
+    buf[0] = 0x01;
+    ASSERT_EQ(decode_wire_header(buf, n, &out), -1);
+}
+
+/* === Socket Tests === */
+
+TEST(v1_send_recv) {
+    int fds[2];
+    make_pair(fds);
+
+    MessageHeader h;
+    init_message_header(&h, MSG_REQUEST, OP_CREATE, "carol");
+    strcpy(h.filename, "x.txt");
+    h.data_length = 5;
+    ASSERT_EQ(send_message(fds[0], &h, "hello"), 0);
+
+    MessageHeader out;
+    char* payload = NULL;
+    ASSERT_EQ(recv_message(fds[1], &out, &payload), 5);
+    ASSERT_STR_EQ(out.filename, "x.txt");
+    ASSERT_STR_EQ(payload, "hello");
+    ASSERT_EQ(get_socket_protocol(fds[1]), PROTOCOL_V1);
+    free(payload);
+
+    close(fds[0]);
+    close(fds[1]);
+}
+
+TEST(v2_send_recv_mirrors_version) {
+    int fds[2];
+    make_pair(fds);
+    set_socket_protocol(fds[0], PROTOCOL_V2);
+
+    MessageHeader h;
+    init_message_header(&h, MSG_REQUEST, OP_SS_READ, "dave");
+    strcpy(h.filename, "folder/y.txt");
+    ASSERT_EQ(send_message(fds[0], &h, NULL), 0);
+
+    MessageHeader out;
+    char* payload = NULL;
+    assert(recv_message(fds[1], &out, &payload) > 0);
+    assert(payload == NULL);
+    ASSERT_EQ(out.op_code, OP_SS_READ);
+    ASSERT_STR_EQ(out.username, "dave");
+    ASSERT_STR_EQ(out.filename, "folder/y.txt");
+    ASSERT_EQ(get_socket_protocol(fds[1]), PROTOCOL_V2);
+
+    // The reply goes back in v2 without any explicit configuration
+    INIT_RESPONSE_HEADER(&out, MSG_RESPONSE, ERR_SUCCESS);
+    out.data_length = 3;
+    ASSERT_EQ(send_message(fds[1], &out, "abc"), 0);
+    unsigned char first;
+    ASSERT_EQ(recv(fds[0], &first, 1, MSG_PEEK), 1);
+    ASSERT_EQ(first, WIRE_V2_MAGIC);
+    ASSERT_EQ(recv_message(fds[0], &h, &payload), 3);
+    ASSERT_STR_EQ(payload, "abc");
+    free(payload);
+
+    close(fds[0]);
+    close(fds[1]);
+}
+
+typedef struct {
+    int sockfd;
+    const char* payload;
+    int length;
+    int result;
+} PayloadSender;
+
+static void* send_payload_thread(void* arg) {
+    PayloadSender* s = arg;
+    MessageHeader h;
+    INIT_RESPONSE_HEADER(&h, MSG_RESPONSE, ERR_SUCCESS);
+    h.data_length = s->length;
+    s->result = send_message(s->sockfd, &h, s->payload);
+    return NULL;
+}
+
+TEST(send_message_resumes_short_writes) {
+    int fds[2];
+    make_pair(fds);
+    set_socket_protocol(fds[0], PROTOCOL_V2);
+    // Non-blocking with a payload far beyond the socket buffer: sendmsg()
+    // returns short counts and EAGAIN until the reader catches up
+    fcntl(fds[0], F_SETFL, fcntl(fds[0], F_GETFL) | O_NONBLOCK);
+
+    int length = 4 * 1024 * 1024;
+    char* data = malloc(length);
+    for (int i = 0; i < length; i++) data[i] = (char)('a' + i % 26);
+
+    PayloadSender s = { fds[0], data, length, -1 };
+    pthread_t sender;
+    pthread_create(&sender, NULL, send_payload_thread, &s);
+
+    MessageHeader got;
+    char* payload = NULL;
+    assert(recv_message(fds[1], &got, &payload) > 0);
+    pthread_join(sender, NULL);
+    ASSERT_EQ(s.result, 0);
+    ASSERT_EQ(got.data_length, length);
+    assert(memcmp(payload, data, length) == 0);
+
+    free(payload);
+    free(data);
+    close(fds[0]);
+    close(fds[1]);
+}
+
+TEST(send_to_closed_peer_fails_without_sigpipe) {
+    int fds[2];
+    make_pair(fds);
+    close(fds[1]);
+
+    // Would kill the process with SIGPIPE if the send lacked MSG_NOSIGNAL
+    MessageHeader h;
+    INIT_RESPONSE_HEADER(&h, MSG_RESPONSE, ERR_SUCCESS);
+    h.data_length = 5;
+    ASSERT_EQ(send_message(fds[0], &h, "hello"), -1);
+    ASSERT_EQ(errno, EPIPE);
+    close(fds[0]);
+}
+
+TEST(send_times_out_when_peer_stops_reading) {
+    int fds[2];
+    make_pair(fds);
+    set_socket_timeout(fds[0], 1);
+
+    // The peer never reads: the send fails after the timeout instead of
+    // blocking forever, and the half-sent frame's socket is shut down
+    int length = 4 * 1024 * 1024;
+    char* data = calloc(1, length);
+    MessageHeader h;
+    INIT_RESPONSE_HEADER(&h, MSG_RESPONSE, ERR_SUCCESS);
+    h.data_length = length;
+    time_t start = time(NULL);
+    ASSERT_EQ(send_message(fds[0], &h, data), -1);
+    assert(time(NULL) - start <= 3);
+
+    char byte;
+    while (recv(fds[1], &byte, 1, MSG_DONTWAIT) > 0) {
+        char drain[65536];
+        while (recv(fds[1], drain, sizeof(drain), MSG_DONTWAIT) > 0) {}
+    }
+    ASSERT_EQ(recv(fds[1], &byte, 1, 0), 0);  // EOF, not a stalled stream
+
+    free(data);
+    close(fds[0]);
+    close(fds[1]);
+}
+
+TEST(parse_ss_info_protocol_suffix) {
+    char ip[MAX_IP];
+    int port, proto;
+    ASSERT_EQ(parse_ss_info("10.0.0.5:9001", ip, &port, &proto, NULL), 0);
+    ASSERT_STR_EQ(ip, "10.0.0.5");
+    ASSERT_EQ(port, 9001);
+    ASSERT_EQ(proto, PROTOCOL_V1);
+    ASSERT_EQ(parse_ss_info("10.0.0.5:9001:2", ip, &port, &proto, NULL), 0);
+    ASSERT_EQ(proto, PROTOCOL_V2);
+}
+
+TEST(parse_ss_info_local_suffix) {
+    char ip[MAX_IP], local[MAX_LOCAL_ADDR];
+    int port, proto;
+    ASSERT_EQ(parse_ss_info("10.0.0.5:9001:2", ip, &port, &proto, local), 0);
+    ASSERT_STR_EQ(local, "");
+    ASSERT_EQ(parse_ss_info("10.0.0.5:9001:2:host:/tmp/x.sock", ip, &port, &proto, local), 0);
+    ASSERT_EQ(port, 9001);
+    ASSERT_STR_EQ(local, "host:/tmp/x.sock");
+
+    // Only addresses naming this host resolve to a socket path
+    char path[MAX_LOCAL_ADDR];
+    ASSERT_EQ(local_address_path("no-such-host.invalid:/tmp/x.sock", path, sizeof(path)), -1);
+    ASSERT_EQ(local_address_path("", path, sizeof(path)), -1);
+    ASSERT_EQ(make_local_address(local, sizeof(local), "/tmp/x.sock"), 0);
+    ASSERT_EQ(local_address_path(local, path, sizeof(path)), 0);
+    ASSERT_STR_EQ(path, "/tmp/x.sock");
+}
+
+TEST(unix_socket_roundtrip) {
+    char path[MAX_LOCAL_ADDR];
+    unix_socket_path(path, sizeof(path), "test", getpid());
+    int listen_fd = create_unix_server_socket(path);
+    assert(listen_fd >= 0);
+
+    char local[MAX_LOCAL_ADDR];
+    ASSERT_EQ(make_local_address(local, sizeof(local), path), 0);
+    // The TCP fallback address is unreachable, so this must take the local path
+    int client = connect_to_endpoint("127.0.0.1", 1, local);
+    assert(client >= 0);
+    int server = accept(listen_fd, NULL, NULL);
+    assert(server >= 0);
+
+    char peer[MAX_IP];
+    int peer_port = -1;
+    get_peer_address(server, peer, sizeof(peer), &peer_port);
+    ASSERT_STR_EQ(peer, "local");
+    ASSERT_EQ(peer_port, 0);
+
+    MessageHeader h;
+    init_message_header(&h, MSG_REQUEST, OP_INFO, "uds");
+    h.data_length = 5;
+    ASSERT_EQ(send_message(client, &h, "hello"), 0);
+    char* payload = NULL;
+    ASSERT_EQ(recv_message(server, &h, &payload), 5);
+    ASSERT_STR_EQ(payload, "hello");
+    free(payload);
+
+    close(client);
+    close(server);
+    close(listen_fd);
+    unlink(path);
+}
+
+/* === Multiplexing Tests === */
+
+TEST(reply_echoes_request_id) {
+    int fds[2];
+    make_pair(fds);
+    set_socket_protocol(fds[0], PROTOCOL_V2);
+
+    MessageHeader h;
+    init_message_header(&h, MSG_REQUEST, OP_INFO, "erin");
+    h.request_id = 42;
+    ASSERT_EQ(send_message(fds[0], &h, NULL), 0);
+
+    MessageHeader out;
+    char* payload = NULL;
+    assert(recv_message(fds[1], &out, &payload) > 0);
+    ASSERT_EQ(out.request_id, 42);
+
+    // A handler that builds a fresh reply still gets the ID echoed
+    INIT_RESPONSE_HEADER(&out, MSG_ACK, ERR_SUCCESS);
+    ASSERT_EQ(send_message(fds[1], &out, NULL), 0);
+    assert(recv_message(fds[0], &h, &payload) > 0);
+    ASSERT_EQ(h.msg_type, MSG_ACK);
+    ASSERT_EQ(h.request_id, 42);
+
+    close(fds[0]);
+    close(fds[1]);
+}
+
+TEST(mux_out_of_order_replies) {
+    int fds[2];
+    make_pair(fds);
+    set_socket_protocol(fds[0], PROTOCOL_V2);
+
+    MuxChannel ch;
+    mux_init(&ch, fds[0]);
+    unsigned int ids[3];
+    for (int i = 0; i < 3; i++) {
+        MessageHeader h;
+        init_message_header(&h, MSG_REQUEST, OP_INFO, "frank");
+        h.word_index = i;
+        ids[i] = mux_send(&ch, &h, NULL);
+        assert(ids[i] != 0);
+    }
+    ASSERT_EQ(ch.in_flight_count, 3);
+
+    // Server answers newest first
+    MessageHeader req[3];
+    char* payload = NULL;
+    for (int i = 0; i < 3; i++) {
+        assert(recv_message(fds[1], &req[i], &payload) > 0);
+    }
+    for (int i = 2; i >= 0; i--) {
+        char body[8];
+        snprintf(body, sizeof(body), "r%d", req[i].word_index);
+        MessageHeader reply;
+        INIT_RESPONSE_HEADER(&reply, MSG_RESPONSE, ERR_SUCCESS);
+        reply.request_id = req[i].request_id;
+        reply.data_length = strlen(body);
+        ASSERT_EQ(send_message(fds[1], &reply, body), 0);
+    }
+
+    MessageHeader out;
+    ASSERT_EQ(mux_recv(&ch, ids[0], &out, &payload), 1);
+    ASSERT_STR_EQ(payload, "r0");
+    free(payload);
+
+    unsigned int id;
+    ASSERT_EQ(mux_recv_next(&ch, &id, &out, &payload, 0), 1);
+    ASSERT_EQ(id, ids[2]);
+    ASSERT_STR_EQ(payload, "r2");
+    free(payload);
+    ASSERT_EQ(mux_recv(&ch, ids[1], &out, &payload), 1);
+    ASSERT_STR_EQ(payload, "r1");
+    free(payload);
+
+    ASSERT_EQ(ch.in_flight_count, 0);
+    ASSERT_EQ(mux_recv_next(&ch, &id, &out, NULL, 1), 0);
+    mux_discard(&ch);
+
+    close(fds[0]);
+    close(fds[1]);
+}
+
+TEST(mux_v1_matches_in_order) {
+    int fds[2];
+    make_pair(fds);
+
+    MuxChannel ch;
+    mux_init(&ch, fds[0]);
+    MessageHeader h;
+    init_message_header(&h, MSG_REQUEST, OP_SS_WRITE_WORD, "gina");
+    unsigned int first = mux_send(&ch, &h, NULL);
+    unsigned int second = mux_send(&ch, &h, NULL);
+    assert(first != 0 && second != 0 && first != second);
+
+    // A v1 peer cannot see or echo IDs
+    char* payload = NULL;
+    for (int i = 0; i < 2; i++) {
+        MessageHeader req;
+        assert(recv_message(fds[1], &req, &payload) > 0);
+        ASSERT_EQ(req.request_id, 0);
+        INIT_RESPONSE_HEADER(&req, i == 0 ? MSG_ACK : MSG_ERROR, i == 0 ? ERR_SUCCESS : ERR_INVALID_WORD);
+        ASSERT_EQ(send_message(fds[1], &req, NULL), 0);
+    }
+
+    MessageHeader out;
+    ASSERT_EQ(mux_recv(&ch, second, &out, NULL), 1);
+    ASSERT_EQ(out.msg_type, MSG_ERROR);
+    ASSERT_EQ(mux_recv(&ch, first, &out, NULL), 1);
+    ASSERT_EQ(out.msg_type, MSG_ACK);
+
+    close(fds[0]);
+    close(fds[1]);
+}
+
+TEST(mux_window_limit) {
+    int fds[2];
+    make_pair(fds);
+    set_socket_protocol(fds[0], PROTOCOL_V2);
+
+    MuxChannel ch;
+    mux_init(&ch, fds[0]);
+    MessageHeader h;
+    init_message_header(&h, MSG_REQUEST, OP_INFO, NULL);
+    for (int i = 0; i < MUX_MAX_IN_FLIGHT; i++) {
+        assert(mux_send(&ch, &h, NULL) != 0);
+    }
+    ASSERT_EQ(mux_send(&ch, &h, NULL), 0);
+    ASSERT_EQ(mux_recv(&ch, 9999, &h, NULL), -1);
+    mux_discard(&ch);
+    ASSERT_EQ(ch.in_flight_count, 0);
+
+    close(fds[0]);
+    close(fds[1]);
+}
+
+/* === File Payload Tests === */
+
+static int make_temp_file(const char* content) {
+    char path[] = "/tmp/protocol_testXXXXXX";
+    int fd = mkstemp(path);
+    assert(fd >= 0);
+    unlink(path);
+    ssize_t len = strlen(content);
+    assert(write(fd, content, len) == len);
+    return fd;
+}
+
+TEST(file_payload_roundtrip) {
+    int fds[2];
+    make_pair(fds);
+    set_socket_protocol(fds[0], PROTOCOL_V2);
+
+    char content[4000];
+    for (size_t i = 0; i < sizeof(content) - 1; i++) {
+        content[i] = 'a' + i % 26;
+    }
+    content[sizeof(content) - 1] = '\0';
+    int file_fd = make_temp_file(content);
+
+    MessageHeader h;
+    INIT_RESPONSE_HEADER(&h, MSG_RESPONSE, ERR_SUCCESS);
+    ASSERT_EQ(send_file_message(fds[0], &h, file_fd, strlen(content)), 0);
+
+    MessageHeader got;
+    char* payload = NULL;
+    assert(recv_message(fds[1], &got, &payload) > 0);
+    ASSERT_EQ(got.data_length, (int)strlen(content));
+    ASSERT_STR_EQ(payload, content);
+    free(payload);
+
+    close(file_fd);
+    close(fds[0]);
+    close(fds[1]);
+}
+
+TEST(file_payload_keeps_framing_when_file_shrinks) {
+    int fds[2];
+    make_pair(fds);
+    int file_fd = make_temp_file("short");
+
+    // Announce more bytes than the file holds, then send a second frame
+    MessageHeader h;
+    INIT_RESPONSE_HEADER(&h, MSG_RESPONSE, ERR_SUCCESS);
+    ASSERT_EQ(send_file_message(fds[0], &h, file_fd, 64), 0);
+    INIT_RESPONSE_HEADER(&h, MSG_ACK, ERR_SUCCESS);
+    ASSERT_EQ(send_message(fds[0], &h, NULL), 0);
+
+    MessageHeader got;
+    char* payload = NULL;
+    assert(recv_message(fds[1], &got, &payload) > 0);
+    ASSERT_EQ(got.data_length, 64);
+    ASSERT_STR_EQ(payload, "short");
+    free(payload);
+    assert(recv_message(fds[1], &got, &payload) > 0);
+    ASSERT_EQ(got.msg_type, MSG_ACK);
+
+    close(file_fd);
+    close(fds[0]);
+    close(fds[1]);
+}
+
+/* === Chunked Transfer Tests === */
+
+typedef struct {
+    int sockfd;
+    int file_fd;
+    size_t length;
+    int result;
+} FileSender;
+
+static void* send_file_thread(void* arg) {
+    FileSender* s = arg;
+    MessageHeader h;
+    INIT_RESPONSE_HEADER(&h, MSG_RESPONSE, ERR_SUCCESS);
+    safe_strncpy(h.filename, "big.txt", sizeof(h.filename));
+    s->result = send_file_message(s->sockfd, &h, s->file_fd, s->length);
+    return NULL;
+}
+
+// Writes a file of `length` bytes whose content is a function of the offset
+static int make_patterned_file(size_t length) {
+    int fd = make_temp_file("");
+    char block[4096];
+    for (size_t off = 0; off < length; off += sizeof(block)) {
+        size_t n = length - off < sizeof(block) ? length - off : sizeof(block);
+        for (size_t i = 0; i < n; i++) {
+            block[i] = 'a' + (off + i) % 23;
+        }
+        assert(write(fd, block, n) == (ssize_t)n);
+    }
+    return fd;
+}
+
+typedef struct {
+    size_t received;
+    size_t largest_piece;
+    int mismatch;
+} PatternCheck;
+
+static int check_pattern_sink(void* ctx, const char* data, size_t len) {
+    PatternCheck* c = ctx;
+    for (size_t i = 0; i < len; i++) {
+        if (data[i] != (char)('a' + (c->received + i) % 23)) c->mismatch = 1;
+    }
+    c->received += len;
+    if (len > c->largest_piece) c->largest_piece = len;
+    return 0;
+}
+
+TEST(chunked_payload_streams_in_bounded_pieces) {
+    int fds[2];
+    make_pair(fds);
+    set_socket_protocol(fds[0], PROTOCOL_V2);
+
+    size_t length = 3 * WIRE_CHUNK_SIZE + 123;
+    FileSender s = { fds[0], make_patterned_file(length), length, -1 };
+    pthread_t sender;
+    pthread_create(&sender, NULL, send_file_thread, &s);
+
+    MessageHeader got;
+    assert(recv_message_header(fds[1], &got) > 0);
+    ASSERT_EQ(got.frame_flags, WIRE_FRAME_CHUNKED);
+    ASSERT_EQ(got.total_length, length);
+    ASSERT_STR_EQ(got.filename, "big.txt");
+
+    PatternCheck check = { 0, 0, 0 };
+    ASSERT_EQ(recv_message_payload(fds[1], &got, check_pattern_sink, &check), 0);
+    pthread_join(sender, NULL);
+    ASSERT_EQ(s.result, 0);
+    ASSERT_EQ(check.received, length);
+    ASSERT_EQ(check.mismatch, 0);
+    assert(check.largest_piece <= WIRE_RECV_BUFFER);
+
+    close(s.file_fd);
+    close(fds[0]);
+    close(fds[1]);
+}
+
+TEST(chunked_payload_reassembled_by_recv_message) {
+    int fds[2];
+    make_pair(fds);
+    set_socket_protocol(fds[0], PROTOCOL_V2);
+
+    size_t length = WIRE_CHUNK_SIZE + 1;
+    FileSender s = { fds[0], make_patterned_file(length), length, -1 };
+    pthread_t sender;
+    pthread_create(&sender, NULL, send_file_thread, &s);
+
+    MessageHeader got;
+    char* payload = NULL;
+    assert(recv_message(fds[1], &got, &payload) > 0);
+    pthread_join(sender, NULL);
+    ASSERT_EQ(s.result, 0);
+    ASSERT_EQ(got.data_length, (int)length);
+    ASSERT_EQ(got.frame_flags, 0);
+    ASSERT_EQ(payload[length - 1], (char)('a' + (length - 1) % 23));
+    ASSERT_EQ(strlen(payload), length);
+    free(payload);
+
+    close(s.file_fd);
+    close(fds[0]);
+    close(fds[1]);
+}
+
+TEST(v1_peer_gets_single_frame) {
+    int fds[2];
+    make_pair(fds);
+
+    size_t length = WIRE_CHUNK_SIZE + 1;
+    FileSender s = { fds[0], make_patterned_file(length), length, -1 };
+    pthread_t sender;
+    pthread_create(&sender, NULL, send_file_thread, &s);
+
+    MessageHeader got;
+    assert(recv_message_header(fds[1], &got) > 0);
+    ASSERT_EQ(got.frame_flags, 0);
+    ASSERT_EQ(got.data_length, (int)length);
+    ASSERT_EQ(got.total_length, length);
+
+    PatternCheck check = { 0, 0, 0 };
+    ASSERT_EQ(recv_message_payload(fds[1], &got, check_pattern_sink, &check), 0);
+    pthread_join(sender, NULL);
+    ASSERT_EQ(check.received, length);
+    ASSERT_EQ(check.mismatch, 0);
+
+    close(s.file_fd);
+    close(fds[0]);
+    close(fds[1]);
+}
+
+TEST(recv_message_discards_unwanted_payload) {
+    int fds[2];
+    make_pair(fds);
+    set_socket_protocol(fds[0], PROTOCOL_V2);
+
+    MessageHeader h;
+    INIT_RESPONSE_HEADER(&h, MSG_RESPONSE, ERR_SUCCESS);
+    h.data_length = 5;
+    ASSERT_EQ(send_message(fds[0], &h, "hello"), 0);
+    INIT_RESPONSE_HEADER(&h, MSG_ACK, ERR_SUCCESS);
+    ASSERT_EQ(send_message(fds[0], &h, NULL), 0);
+
+    MessageHeader got;
+    assert(recv_message(fds[1], &got, NULL) > 0);
+    ASSERT_EQ(got.msg_type, MSG_RESPONSE);
+    assert(recv_message(fds[1], &got, NULL) > 0);
+    ASSERT_EQ(got.msg_type, MSG_ACK);
+
+    close(fds[0]);
+    close(fds[1]);
+}
+
+/* === Receive Buffer Tests === */
+
+static void send_text(int fd, const char* text) {
+    MessageHeader h;
+    INIT_RESPONSE_HEADER(&h, MSG_RESPONSE, ERR_SUCCESS);
+    h.data_length = text ? (int)strlen(text) : 0;
+    ASSERT_EQ(send_message(fd, &h, text), 0);
+}
+
+TEST(recv_into_reuses_buffer) {
+    int fds[2];
+    make_pair(fds);
+    send_text(fds[0], "hello");
+    send_text(fds[0], "hi");
+    send_text(fds[0], NULL);
+
+    RecvBuffer rb;
+    recv_buffer_init(&rb);
+    MessageHeader got;
+    char* payload = NULL;
+
+    ASSERT_EQ(recv_message_into(fds[1], &got, &rb, &payload), 5);
+    ASSERT_STR_EQ(payload, "hello");
+    char* first = payload;
+    ASSERT_EQ(rb.cap, RECV_BUFFER_INITIAL);
+
+    ASSERT_EQ(recv_message_into(fds[1], &got, &rb, &payload), 2);
+    ASSERT_STR_EQ(payload, "hi");
+    assert(payload == first);  // Same storage, no new allocation
+
+    assert(recv_message_into(fds[1], &got, &rb, &payload) > 0);
+    assert(payload == NULL);
+    ASSERT_EQ(rb.cap, RECV_BUFFER_INITIAL);
+
+    recv_buffer_free(&rb);
+    close(fds[0]);
+    close(fds[1]);
+}
+
+TEST(recv_into_reassembles_chunked_then_shrinks) {
+    int fds[2];
+    make_pair(fds);
+    set_socket_protocol(fds[0], PROTOCOL_V2);
+
+    size_t length = 2 * WIRE_CHUNK_SIZE + 77;
+    FileSender s = { fds[0], make_patterned_file(length), length, -1 };
+    pthread_t sender;
+    pthread_create(&sender, NULL, send_file_thread, &s);
+
+    RecvBuffer rb;
+    recv_buffer_init(&rb);
+    MessageHeader got;
+    char* payload = NULL;
+    ASSERT_EQ(recv_message_into(fds[1], &got, &rb, &payload), (int)length);
+    pthread_join(sender, NULL);
+    ASSERT_EQ(got.frame_flags, 0);
+    ASSERT_EQ(payload[length - 1], (char)('a' + (length - 1) % 23));
+    assert(rb.cap > length);
+    close(s.file_fd);
+
+    // A small message afterwards gives the large allocation back
+    send_text(fds[0], "small");
+    ASSERT_EQ(recv_message_into(fds[1], &got, &rb, &payload), 5);
+    ASSERT_STR_EQ(payload, "small");
+    ASSERT_EQ(rb.cap, WIRE_RECV_BUFFER);
+
+    recv_buffer_free(&rb);
+    close(fds[0]);
+    close(fds[1]);
+}
+
+TEST(parse_frame_into_buffer) {
+    int fds[2];
+    make_pair(fds);
+    set_socket_protocol(fds[0], PROTOCOL_V2);
+    send_text(fds[0], "first");
+    send_text(fds[0], "second");
+
+    unsigned char wire[4096];
+    ssize_t len = recv(fds[1], wire, sizeof(wire), 0);
+    assert(len > 0);
+
+    RecvBuffer rb;
+    recv_buffer_init(&rb);
+    MessageHeader got;
+    char* payload = NULL;
+    int version = 0;
+    ssize_t used = parse_frame(wire, len, &got, &rb, &payload, &version);
+    assert(used > 0);
+    ASSERT_EQ(version, PROTOCOL_V2);
+    ASSERT_STR_EQ(payload, "first");
+    char* first = payload;
+
+    ASSERT_EQ(parse_frame(wire + used, len - used, &got, &rb, &payload, &version), len - used);
+    ASSERT_STR_EQ(payload, "second");
+    assert(payload == first);
+
+    // Incomplete frames consume nothing; once the header is in, the payload
+    // size is known before the payload is
+    ASSERT_EQ(parse_frame(wire, used - 1, &got, &rb, &payload, &version), 0);
+    ASSERT_EQ(got.data_length, 5);
+    ASSERT_EQ(parse_frame(wire, 2, &got, &rb, &payload, &version), 0);
+    ASSERT_EQ(got.data_length, -1);
+
+    recv_buffer_free(&rb);
+    close(fds[0]);
+    close(fds[1]);
+}
+
+/* === Relay Tests === */
+
+typedef struct {
+    int src_fd;
+    int dst_fd;
+    int result;
+    int delivered;
+} Relay;
+
+static void* relay_thread(void* arg) {
+    Relay* r = arg;
+    MessageHeader h;
+    r->result = recv_message_header(r->src_fd, &h) > 0
+                    ? relay_message(r->src_fd, &h, r->dst_fd, &r->delivered)
+                    : -1;
+    return NULL;
+}
+
+// file -> src pair -> relay -> dst pair -> sink, with the dst side in `dst_version`
+static void relay_pattern(size_t length, int dst_version, int expect_chunked) {
+    int src[2], dst[2];
+    make_pair(src);
+    make_pair(dst);
+    set_socket_protocol(src[0], PROTOCOL_V2);
+    set_socket_protocol(dst[0], dst_version);
+
+    FileSender s = { src[0], make_patterned_file(length), length, -1 };
+    Relay r = { src[1], dst[0], -1, -1 };
+    pthread_t sender, relay;
+    pthread_create(&sender, NULL, send_file_thread, &s);
+    pthread_create(&relay, NULL, relay_thread, &r);
+
+    MessageHeader got;
+    assert(recv_message_header(dst[1], &got) > 0);
+    ASSERT_EQ(got.frame_flags, expect_chunked ? WIRE_FRAME_CHUNKED : 0);
+    ASSERT_EQ(got.total_length, length);
+    ASSERT_STR_EQ(got.filename, "big.txt");
+
+    PatternCheck check = { 0, 0, 0 };
+    ASSERT_EQ(recv_message_payload(dst[1], &got, check_pattern_sink, &check), 0);
+    pthread_join(sender, NULL);
+    pthread_join(relay, NULL);
+    ASSERT_EQ(s.result, 0);
+    ASSERT_EQ(r.result, 0);
+    ASSERT_EQ(r.delivered, 1);
+    ASSERT_EQ(check.received, length);
+    ASSERT_EQ(check.mismatch, 0);
+
+    close(s.file_fd);
+    close(src[0]);
+    close(src[1]);
+    close(dst[0]);
+    close(dst[1]);
+}
+
+TEST(relay_rechunks_for_v2_peer) {
+    relay_pattern(3 * WIRE_CHUNK_SIZE + 5, PROTOCOL_V2, 1);
+    relay_pattern(100, PROTOCOL_V2, 0);
+}
+
+TEST(relay_joins_chunks_for_v1_peer) {
+    relay_pattern(2 * WIRE_CHUNK_SIZE + 9, PROTOCOL_V1, 0);
+}
+
+TEST(relay_drains_source_when_destination_is_gone) {
+    int src[2], dst[2];
+    make_pair(src);
+    make_pair(dst);
+    set_socket_protocol(src[0], PROTOCOL_V2);
+    close(dst[1]);
+
+    size_t length = WIRE_CHUNK_SIZE + 3;
+    FileSender s = { src[0], make_patterned_file(length), length, -1 };
+    pthread_t sender;
+    pthread_create(&sender, NULL, send_file_thread, &s);
+
+    // No SIGPIPE may escape: it would kill the test process
+    Relay r = { src[1], dst[0], -1, -1 };
+    relay_thread(&r);
+    pthread_join(sender, NULL);
+    ASSERT_EQ(r.result, 0);
+    ASSERT_EQ(r.delivered, 0);
+
+    // The source is still framed: the next message arrives intact
+    send_text(src[0], "next");
+    MessageHeader got;
+    char* payload = NULL;
+    ASSERT_EQ(recv_message(src[1], &got, &payload), 4);
+    ASSERT_STR_EQ(payload, "next");
+    free(payload);
+
+    close(s.file_fd);
+    close(src[0]);
+    close(src[1]);
+    close(dst[0]);
+}
+
+/* === Compression Tests === */
+
+typedef struct {
+    char* buf;
+    size_t len;
+} PayloadCollector;
+
+static int collect_payload(void* ctx, const char* data, size_t len) {
+    PayloadCollector* c = ctx;
+    memcpy(c->buf + c->len, data, len);
+    c->len += len;
+    return 0;
+}
+
+static void lz_roundtrip(const char* data, size_t len) {
+    char* packed = malloc(lz_compress_bound(len));
+    char* out = malloc(len + 1);
+    size_t n = lz_compress(data, len, packed, lz_compress_bound(len));
+    assert(n > 0);
+    ASSERT_EQ(lz_decompress(packed, n, out, len), (long)len);
+    assert(memcmp(out, data, len) == 0);
+    free(packed);
+    free(out);
+}
+
+TEST(lz_roundtrip_shapes) {
+    lz_roundtrip("", 0);
+    lz_roundtrip("abc", 3);
+    lz_roundtrip("hello hello hello hello hello hello", 35);
+
+    // Long runs (overlapping matches), long literals, and mixed text
+    size_t len = 200000;
+    char* data = malloc(len);
+    memset(data, 'z', len);
+    lz_roundtrip(data, len);
+    unsigned int seed = 7;
+    for (size_t i = 0; i < len; i++) data[i] = (char)(rand_r(&seed) & 0xff);
+    lz_roundtrip(data, len);
+    for (size_t i = 0; i < len; i++) data[i] = "The quick brown fox. "[i % 21] ^ (i % 97 == 0);
+    lz_roundtrip(data, len);
+
+    // Text compresses well; random bytes do not fit in less than their size
+    char* packed = malloc(lz_compress_bound(len));
+    assert(lz_compress(data, len, packed, len / 4) > 0);
+    for (size_t i = 0; i < len; i++) data[i] = (char)(rand_r(&seed) & 0xff);
+    ASSERT_EQ(lz_compress(data, len, packed, len - len / 16), 0);
+    free(packed);
+    free(data);
+}
+
+TEST(lz_rejects_corrupt_input) {
+    const char* text = "abcdabcdabcdabcdabcdabcdabcdabcdabcdabcd-end";
+    char packed[128], out[128];
+    size_t n = lz_compress(text, strlen(text), packed, sizeof(packed));
+    assert(n > 0);
+
+    // Truncated, too small an output, and an offset reaching before the start
+    ASSERT_EQ(lz_decompress(packed, n - 1, out, sizeof(out)), -1);
+    ASSERT_EQ(lz_decompress(packed, n, out, strlen(text) - 1), -1);
+    const char bad_offset[] = { 0x10, 'a', 0x09, 0x00 };
+    ASSERT_EQ(lz_decompress(bad_offset, sizeof(bad_offset), out, sizeof(out)), -1);
+}
+
+TEST(compressed_frame_roundtrip) {
+    int fds[2];
+    make_pair(fds);
+    set_wire_compression(64);
+    set_socket_protocol(fds[0], PROTOCOL_V2);
+    set_socket_compression(fds[0], 1);
+
+    char text[8192];
+    for (size_t i = 0; i < sizeof(text); i++) text[i] = "lorem ipsum dolor "[i % 18];
+    text[sizeof(text) - 1] = '\0';
+    MessageHeader h;
+    INIT_RESPONSE_HEADER(&h, MSG_RESPONSE, ERR_SUCCESS);
+    h.data_length = sizeof(text) - 1;
+    ASSERT_EQ(send_message(fds[0], &h, text), 0);
+    ASSERT_EQ(send_message(fds[0], &h, text), 0);
+
+    // On the wire: a compressed frame announcing the decoded size
+    MessageHeader got;
+    assert(recv_message_header(fds[1], &got) > 0);
+    assert(got.frame_flags & WIRE_FRAME_COMPRESSED);
+    assert(got.frame_flags & WIRE_FRAME_ACCEPTS_LZ);
+    assert(got.data_length < (int)sizeof(text) / 4);
+    ASSERT_EQ(got.total_length, sizeof(text) - 1);
+    ASSERT_EQ(get_socket_compression(fds[1]), 1);  // Capability learned
+    char* payload = malloc(sizeof(text));
+    PayloadCollector c = { payload, 0 };
+    ASSERT_EQ(recv_message_payload(fds[1], &got, collect_payload, &c), 0);
+    ASSERT_EQ(c.len, sizeof(text) - 1);
+    assert(memcmp(payload, text, c.len) == 0);
+    free(payload);
+
+    // recv_message decodes transparently
+    ASSERT_EQ(recv_message(fds[1], &got, &payload), (int)sizeof(text) - 1);
+    ASSERT_STR_EQ(payload, text);
+    free(payload);
+
+    // Below the threshold, or to a peer that never advertised, frames stay plain
+    set_socket_compression(fds[0], 0);
+    ASSERT_EQ(send_message(fds[0], &h, text), 0);
+    assert(recv_message_header(fds[1], &got) > 0);
+    ASSERT_EQ(got.frame_flags & WIRE_FRAME_COMPRESSED, 0);
+    ASSERT_EQ(recv_message_payload(fds[1], &got, NULL, NULL), 0);
+
+    set_wire_compression(0);
+    close(fds[0]);
+    close(fds[1]);
+}
+
+TEST(compressed_frame_size_is_capped) {
+    // A few compressed bytes announcing a decoded size the sender could not
+    // have produced: past WIRE_CHUNK_SIZE, or past the codec's expansion
+    const char packed[] = { 0x10, 'a', 0x01, 0x00 };
+    unsigned long long claims[] = { 1ULL << 30, WIRE_CHUNK_SIZE };
+    for (size_t i = 0; i < sizeof(claims) / sizeof(claims[0]); i++) {
+        MessageHeader h;
+        INIT_RESPONSE_HEADER(&h, MSG_RESPONSE, ERR_SUCCESS);
+        h.frame_flags = WIRE_FRAME_COMPRESSED;
+        h.total_length = claims[i];
+        h.data_length = sizeof(packed);
+        unsigned char wire[WIRE_V2_MAX_HEADER + sizeof(packed)];
+        int n = encode_wire_header(&h, wire, sizeof(wire));
+        assert(n > 0);
+        memcpy(wire + n, packed, sizeof(packed));
+
+        RecvBuffer rb;
+        recv_buffer_init(&rb);
+        MessageHeader got;
+        char* payload = NULL;
+        int version = 0;
+        ASSERT_EQ(parse_frame(wire, n + sizeof(packed), &got, &rb, &payload, &version), -1);
+        ASSERT_EQ(parse_frame(wire, n, &got, &rb, &payload, &version), -1);  // Before the payload
+        recv_buffer_free(&rb);
+
+        int fds[2];
+        make_pair(fds);
+        ASSERT_EQ(send(fds[0], wire, n + sizeof(packed), 0), n + (ssize_t)sizeof(packed));
+        ASSERT_EQ(recv_message(fds[1], &got, &payload), -1);
+        assert(payload == NULL);
+        close(fds[0]);
+        close(fds[1]);
+    }
+}
+
+TEST(compressed_file_payload_is_chunked_and_decoded) {
+    int fds[2];
+    make_pair(fds);
+    set_wire_compression(64);
+    set_socket_protocol(fds[0], PROTOCOL_V2);
+    set_socket_compression(fds[0], 1);
+
+    size_t length = 3 * WIRE_CHUNK_SIZE + 5;
+    FileSender s = { fds[0], make_patterned_file(length), length, -1 };
+    pthread_t sender;
+    pthread_create(&sender, NULL, send_file_thread, &s);
+
+    MessageHeader got;
+    assert(recv_message_header(fds[1], &got) > 0);
+    ASSERT_EQ(got.frame_flags & (WIRE_FRAME_CHUNKED | WIRE_FRAME_COMPRESSED),
+              WIRE_FRAME_CHUNKED | WIRE_FRAME_COMPRESSED);
+    ASSERT_EQ(got.total_length, length);
+    PatternCheck check = { 0, 0, 0 };
+    ASSERT_EQ(recv_message_payload(fds[1], &got, check_pattern_sink, &check), 0);
+    pthread_join(sender, NULL);
+    ASSERT_EQ(s.result, 0);
+    ASSERT_EQ(check.received, length);
+    ASSERT_EQ(check.mismatch, 0);
+    assert(check.largest_piece <= WIRE_CHUNK_SIZE);
+
+    // v1 peers never see compressed frames
+    set_socket_protocol(fds[0], PROTOCOL_V1);
+    set_socket_compression(fds[0], 1);
+    char* payload = NULL;
+    s.length = 1000;
+    pthread_create(&sender, NULL, send_file_thread, &s);
+    ASSERT_EQ(recv_message(fds[1], &got, &payload), 1000);
+    pthread_join(sender, NULL);
+    ASSERT_EQ(got.frame_flags, 0);
+    free(payload);
+
+    set_wire_compression(0);
+    close(s.file_fd);
+    close(fds[0]);
+    close(fds[1]);
+}
+
+/* === Batch Codec Tests === */
+
+TEST(batch_roundtrip) {
+    BatchBuilder b;
+    batch_init(&b);
+    ASSERT_EQ(batch_add(&b, OP_SS_WRITE_LOCK, 2, NULL), 0);
+    ASSERT_EQ(batch_add(&b, OP_SS_WRITE_WORD, 2, "0 two\nlines"), 0);
+    ASSERT_EQ(batch_add(&b, OP_SS_WRITE_UNLOCK, 2, NULL), 0);
+    ASSERT_EQ(b.count, 3);
+
+    BatchOp ops[4];
+    ASSERT_EQ(batch_parse(b.buf, b.len, ops, 4), 3);
+    ASSERT_EQ(ops[0].op_code, OP_SS_WRITE_LOCK);
+    ASSERT_EQ(ops[0].payload_len, 0);
+    ASSERT_EQ(ops[1].op_code, OP_SS_WRITE_WORD);
+    ASSERT_EQ(ops[1].sentence_index, 2);
+    ASSERT_EQ(ops[1].payload_len, 11);
+    assert(memcmp(ops[1].payload, "0 two\nlines", 11) == 0);
+    ASSERT_EQ(ops[2].op_code, OP_SS_WRITE_UNLOCK);
+
+    // Too many entries for the caller's array
+    ASSERT_EQ(batch_parse(b.buf, b.len, ops, 2), -1);
+
+    batch_reset(&b);
+    ASSERT_EQ(b.count, 0);
+    ASSERT_EQ(b.len, 0);
+    batch_free(&b);
+}
+
+TEST(batch_rejects_malformed) {
+    BatchOp ops[4];
+    const char* truncated = "44 0 10\n0 short";
+    ASSERT_EQ(batch_parse(truncated, strlen(truncated), ops, 4), -1);
+    const char* no_header_end = "44 0 3";
+    ASSERT_EQ(batch_parse(no_header_end, strlen(no_header_end), ops, 4), -1);
+    const char* garbage = "write word\n";
+    ASSERT_EQ(batch_parse(garbage, strlen(garbage), ops, 4), -1);
+    const char* negative = "44 0 -1\n";
+    ASSERT_EQ(batch_parse(negative, strlen(negative), ops, 4), -1);
+}
+
+TEST(batch_results_parse) {
+    int codes[4];
+    ASSERT_EQ(batch_parse_results("0 115 129", codes, 4), 3);
+    ASSERT_EQ(codes[0], ERR_SUCCESS);
+    ASSERT_EQ(codes[1], ERR_INVALID_WORD);
+    ASSERT_EQ(codes[2], ERR_BATCH_ABORTED);
+    ASSERT_EQ(batch_parse_results("0 0 0 0 0", codes, 4), 4);
+}
+
+/* === Load Report Tests === */
+
+TEST(load_report_roundtrip) {
+    LoadReport in = { .workers = 32, .active = 5, .queue_depth = 2,
+                      .disk_free = 123456789012ULL, .bytes_read = 4096,
+                      .bytes_written = 1ULL << 40, .p99_us = 1875, .ops = 640 };
+    char buf[LOAD_REPORT_MAX];
+    int len = format_load_report(&in, buf, sizeof(buf));
+    assert(len > 0);
+    ASSERT_EQ((size_t)len, strlen(buf));
+
+    LoadReport out;
+    ASSERT_EQ(parse_load_report(buf, &out), 0);
+    ASSERT_EQ(out.workers, 32);
+    ASSERT_EQ(out.active, 5);
+    ASSERT_EQ(out.queue_depth, 2);
+    assert(out.disk_free == 123456789012ULL);
+    ASSERT_EQ(out.bytes_read, 4096);
+    assert(out.bytes_written == 1ULL << 40);
+    ASSERT_EQ(out.p99_us, 1875);
+    ASSERT_EQ(out.ops, 640);
+
+    // Too small a buffer is reported, not truncated silently
+    ASSERT_EQ(format_load_report(&in, buf, 16), -1);
+}
+
+TEST(load_report_tolerates_unknown_and_missing_keys) {
+    LoadReport out;
+    ASSERT_EQ(parse_load_report("LOAD cpu=93 queue=7 future_field=x active=3", &out), 0);
+    ASSERT_EQ(out.queue_depth, 7);
+    ASSERT_EQ(out.active, 3);
+    ASSERT_EQ(out.workers, 0);
+    ASSERT_EQ(out.p99_us, 0);
+
+    ASSERT_EQ(parse_load_report("LOAD", &out), 0);
+    ASSERT_EQ(parse_load_report("REPLICA 10.0.0.2 9001 2", &out), -1);
+    ASSERT_EQ(parse_load_report("LOADED queue=1", &out), -1);
+    ASSERT_EQ(parse_load_report(NULL, &out), -1);
+}
+
+/* === Deadline Tests === */
+
+TEST(deadline_reclaims_stalled_header) {
+    int fds[2];
+    make_pair(fds);
+
+    // A peer that sends a fragment of a header and then goes quiet
+    ASSERT_EQ(send(fds[1], "\x02\x01", 2, 0), 2);
+
+    Deadline d;
+    deadline_init(&d, fds[0]);
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    ASSERT_EQ(deadline_arm(&d, DEADLINE_HEADER, 50), 0);
+
+    MessageHeader h;
+    ASSERT_EQ(recv_message_header(fds[0], &h) > 0, 0);
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    ASSERT_EQ(deadline_fired(&d), DEADLINE_HEADER);
+    ASSERT_EQ(end.tv_sec - start.tv_sec < 2, 1);
+
+    // Arming a fired deadline does nothing; disarming is still safe
+    ASSERT_EQ(deadline_arm(&d, DEADLINE_IDLE, 10), 0);
+    deadline_disarm(&d);
+    ASSERT_EQ(deadline_fired(&d), DEADLINE_HEADER);
+
+    close(fds[0]);
+    close(fds[1]);
+}
+
+TEST(deadline_disarmed_or_rearmed_does_not_fire) {
+    int fds[2];
+    make_pair(fds);
+
+    Deadline a, b;
+    deadline_init(&a, fds[0]);
+    deadline_init(&b, fds[0]);
+    ASSERT_EQ(deadline_arm(&a, DEADLINE_PAYLOAD, 30), 0);
+    deadline_disarm(&a);
+    ASSERT_EQ(deadline_arm(&b, DEADLINE_IDLE, 30), 0);
+    ASSERT_EQ(deadline_arm(&b, DEADLINE_HEADER, 5000), 0);  // Restarts the clock
+    usleep(100 * 1000);
+    ASSERT_EQ(deadline_fired(&a), 0);
+    ASSERT_EQ(deadline_fired(&b), 0);
+
+    // The socket was left alone
+    MessageHeader h;
+    init_message_header(&h, MSG_REQUEST, OP_HEARTBEAT, "alice");
+    ASSERT_EQ(send_message(fds[1], &h, NULL) >= 0, 1);
+    char* payload = NULL;
+    ASSERT_EQ(recv_message(fds[0], &h, &payload) > 0, 1);
+    free(payload);
+
+    deadline_disarm(&b);
+    ASSERT_EQ(deadline_arm(&a, DEADLINE_IDLE, 0), 0);  // 0: no deadline
+    usleep(20 * 1000);
+    ASSERT_EQ(deadline_fired(&a), 0);
+
+    close(fds[0]);
+    close(fds[1]);
+}
+
+/* === NS -> SS Pool Tests === */
+
+// What the fake SS does with each request it reads, in order
+enum { FAKE_REPLY, FAKE_DROP, FAKE_BUSY };
+
+typedef struct {
+    int listen_fd;
+    const int* actions;
+    int action_count;
+    int requests;               // Requests read so far
+    int ops[8];                 // Their op codes
+} FakeSS;
+
+// Accept connections and answer requests per the script: FAKE_REPLY acks
+// and keeps the connection, FAKE_DROP closes it without replying (the
+// request may have been applied), FAKE_BUSY rejects it and hangs up the way
+// a saturated SS does. Returns once the script is used up.
+static void* fake_ss_thread(void* arg) {
+    FakeSS* fake = arg;
+    while (fake->requests < fake->action_count) {
+        int fd = accept(fake->listen_fd, NULL, NULL);
+        if (fd < 0) break;
+        set_socket_protocol(fd, PROTOCOL_V1);
+
+        MessageHeader h;
+        char* payload = NULL;
+        while (fake->requests < fake->action_count && recv_message(fd, &h, &payload) > 0) {
+            free(payload);
+            payload = NULL;
+            int action = fake->actions[fake->requests];
+            fake->ops[fake->requests++] = h.op_code;
+            if (action == FAKE_DROP) break;
+
+            MessageHeader reply;
+            if (action == FAKE_BUSY) {
+                INIT_RESPONSE_HEADER(&reply, MSG_ERROR, ERR_SS_BUSY);
+                send_message(fd, &reply, NULL);
+                break;
+            }
+            INIT_RESPONSE_HEADER(&reply, MSG_ACK, ERR_SUCCESS);
+            send_message(fd, &reply, NULL);
+        }
+        close(fd);
+    }
+    return NULL;
+}
+
+// Point storage server `slot` at a fresh listener and start the fake SS
+static StorageServerInfo* start_fake_ss(int slot, FakeSS* fake, const int* actions, int count,
+                                        pthread_t* thread) {
+    memset(fake, 0, sizeof(*fake));
+    fake->actions = actions;
+    fake->action_count = count;
+    fake->listen_fd = socket(AF_INET, SOCK_STREAM, 0);
+    struct sockaddr_in addr = { .sin_family = AF_INET, .sin_addr.s_addr = htonl(INADDR_LOOPBACK) };
+    assert(bind(fake->listen_fd, (struct sockaddr*)&addr, sizeof(addr)) == 0);
+    assert(listen(fake->listen_fd, 8) == 0);
+    socklen_t len = sizeof(addr);
+    getsockname(fake->listen_fd, (struct sockaddr*)&addr, &len);
+
+    StorageServerInfo* ss = &ns_state.storage_servers[slot];
+    memset(ss, 0, sizeof(*ss));
+    ss->server_id = slot + 1;
+    strcpy(ss->ip, "127.0.0.1");
+    ss->client_port = ntohs(addr.sin_port);
+    ss->protocol = PROTOCOL_V1;
+    ss->is_active = 1;
+    pthread_create(thread, NULL, fake_ss_thread, fake);
+    return ss;
+}
+
+// Join the fake SS and check nobody dialed it again after its script ended
+static void stop_fake_ss(FakeSS* fake, pthread_t thread) {
+    pthread_join(thread, NULL);
+    struct pollfd pfd = { .fd = fake->listen_fd, .events = POLLIN };
+    ASSERT_EQ(poll(&pfd, 1, 0), 0);
+    close(fake->listen_fd);
+}
+
+static int pool_send(StorageServerInfo* ss, int op_code, MessageHeader* reply) {
+    MessageHeader request;
+    init_message_header(&request, MSG_REQUEST, op_code, "alice");
+    strcpy(request.filename, "a.txt");
+    return ss_pool_request(ss, &request, NULL, reply, NULL);
+}
+
+TEST(pool_retries_read_on_stale_connection) {
+    ss_pool_init();
+    const int actions[] = { FAKE_REPLY, FAKE_DROP, FAKE_REPLY };
+    FakeSS fake;
+    pthread_t thread;
+    StorageServerInfo* ss = start_fake_ss(0, &fake, actions, 3, &thread);
+
+    MessageHeader reply;
+    ASSERT_EQ(pool_send(ss, OP_INFO, &reply), ERR_SUCCESS);
+    // Goes out on the pooled connection, which dies without a reply; an
+    // INFO changes nothing, so it is sent again on a new connection
+    ASSERT_EQ(pool_send(ss, OP_INFO, &reply), ERR_SUCCESS);
+    ASSERT_EQ(reply.msg_type, MSG_ACK);
+
+    stop_fake_ss(&fake, thread);
+    ASSERT_EQ(fake.requests, 3);
+    ASSERT_EQ(fake.ops[1], OP_INFO);
+    ASSERT_EQ(fake.ops[2], OP_INFO);
+}
+
+TEST(pool_does_not_resend_changes_after_send) {
+    ss_pool_init();
+    int ops[] = { OP_SS_CREATE, OP_SS_DELETE };
+    for (int i = 0; i < 2; i++) {
+        const int actions[] = { FAKE_REPLY, FAKE_DROP };
+        FakeSS fake;
+        pthread_t thread;
+        StorageServerInfo* ss = start_fake_ss(1 + i, &fake, actions, 2, &thread);
+
+        MessageHeader reply;
+        ASSERT_EQ(pool_send(ss, OP_INFO, &reply), ERR_SUCCESS);
+        // The SS read it and may have applied it: the lost reply is an
+        // error for the caller, not a reason to run it twice
+        ASSERT_EQ(pool_send(ss, ops[i], &reply), ERR_SS_UNAVAILABLE);
+
+        stop_fake_ss(&fake, thread);
+        ASSERT_EQ(fake.requests, 2);
+        ASSERT_EQ(fake.ops[1], ops[i]);
+    }
+}
+
+TEST(pool_retries_busy_with_backoff) {
+    ss_pool_init();
+    const int actions[] = { FAKE_BUSY, FAKE_BUSY, FAKE_REPLY };
+    FakeSS fake;
+    pthread_t thread;
+    StorageServerInfo* ss = start_fake_ss(3, &fake, actions, 3, &thread);
+
+    // A busy SS never read the request, so even a CREATE is retried
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    MessageHeader reply;
+    ASSERT_EQ(pool_send(ss, OP_SS_CREATE, &reply), ERR_SUCCESS);
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    ASSERT_EQ(reply.msg_type, MSG_ACK);
+    long waited_ms = (end.tv_sec - start.tv_sec) * 1000 + (end.tv_nsec - start.tv_nsec) / 1000000;
+    assert(waited_ms >= SS_BUSY_BACKOFF_MS * 3);  // 1x then 2x the base delay
+
+    stop_fake_ss(&fake, thread);
+    ASSERT_EQ(fake.requests, 3);
+
+    // Still busy after SS_BUSY_RETRIES retries: the rejection is passed back
+    const int saturated[] = { FAKE_BUSY, FAKE_BUSY, FAKE_BUSY };
+    ss = start_fake_ss(4, &fake, saturated, 1 + SS_BUSY_RETRIES, &thread);
+    ASSERT_EQ(pool_send(ss, OP_SS_CREATE, &reply), ERR_SUCCESS);
+    ASSERT_EQ(reply.msg_type, MSG_ERROR);
+    ASSERT_EQ(reply.error_code, ERR_SS_BUSY);
+    stop_fake_ss(&fake, thread);
+    ASSERT_EQ(fake.requests, 1 + SS_BUSY_RETRIES);
+}
+
+/* === Logging === */
+
+#define LOG_TEST_THREADS 4
+#define LOG_TEST_LINES 1000  // Per thread; more than the ring holds in total
+
+static void* log_test_writer(void* arg) {
+    long id = (long)arg;
+    for (int i = 0; i < LOG_TEST_LINES; i++) {
+        char msg[64];
+        snprintf(msg, sizeof(msg), "writer=%ld seq=%d", id, i);
+        log_message("TESTLOG", "WARN", msg);  // WARN is never dropped
+    }
+    return NULL;
+}
+
+TEST(logger_keeps_every_warning_in_order) {
+    mkdir("logs", 0755);
+    unlink("logs/TESTLOG.log");
+
+    // Keep the console copies out of the test output
+    fflush(stdout);
+    int saved_stdout = dup(STDOUT_FILENO);
+    int devnull = open("/dev/null", O_WRONLY);
+    dup2(devnull, STDOUT_FILENO);
+
+    pthread_t threads[LOG_TEST_THREADS];
+    for (long i = 0; i < LOG_TEST_THREADS; i++) {
+        pthread_create(&threads[i], NULL, log_test_writer, (void*)i);
+    }
+    for (int i = 0; i < LOG_TEST_THREADS; i++) {
+        pthread_join(threads[i], NULL);
+    }
+    log_flush();
+
+    fflush(stdout);
+    dup2(saved_stdout, STDOUT_FILENO);
+    close(saved_stdout);
+    close(devnull);
+
+    FILE* f = fopen("logs/TESTLOG.log", "r");
+    ASSERT_EQ(f != NULL, 1);
+    int next[LOG_TEST_THREADS] = {0};
+    int lines = 0;
+    char line[256];
+    while (fgets(line, sizeof(line), f)) {
+        long id;
+        int seq;
+        char* tag = strstr(line, "[WARN] writer=");
+        ASSERT_EQ(tag != NULL, 1);
+        ASSERT_EQ(sscanf(tag, "[WARN] writer=%ld seq=%d", &id, &seq), 2);
+        ASSERT_EQ(seq, next[id]);  // Each writer's lines stay in order
+        next[id]++;
+        lines++;
+    }
+    fclose(f);
+    ASSERT_EQ(lines, LOG_TEST_THREADS * LOG_TEST_LINES);
+    unlink("logs/TESTLOG.log");
+}
+
+/* === Op stats === */
+
+TEST(histogram_percentiles_stay_within_bucket_width) {
+    static LatencyHistogram h;
+    memset(&h, 0, sizeof(h));
+    ASSERT_EQ(hist_percentile(&h, 0.99), 0);
+
+    for (int us = 1; us <= 10000; us++) {
+        hist_record(&h, us);
+    }
+    ASSERT_EQ(h.total, 10000);
+    ASSERT_EQ(h.max_us, 10000);
+
+    // Reported values are bucket upper bounds: never below the true value
+    // and at most one bucket (6.25%) above it
+    unsigned int p50 = hist_percentile(&h, 0.50);
+    unsigned int p99 = hist_percentile(&h, 0.99);
+    ASSERT_EQ(p50 >= 5000 && p50 <= 5000 * 1.0625, 1);
+    ASSERT_EQ(p99 >= 9900 && p99 <= 9900 * 1.0625, 1);
+    ASSERT_EQ(hist_percentile(&h, 1.0), 10000);  // Capped at the largest sample
+    ASSERT_EQ(hist_percentile(&h, 0.0001), 1);
+
+    static LatencyHistogram drained;
+    hist_drain(&h, &drained);
+    ASSERT_EQ(drained.total, 10000);
+    ASSERT_EQ(hist_percentile(&drained, 0.99), p99);
+    ASSERT_EQ(h.total, 0);
+    ASSERT_EQ(hist_percentile(&h, 0.99), 0);
+}
+
+TEST(stats_json_lists_recorded_ops_and_locks) {
+    for (int i = 0; i < 100; i++) {
+        stats_record_op(OP_READ, "READ", 100 + i, i < 3 ? ERR_FILE_NOT_FOUND : ERR_SUCCESS);
+    }
+    stats_record_op(-1, "BOGUS", 5, ERR_INVALID_COMMAND);
+
+    pthread_mutex_t m = PTHREAD_MUTEX_INITIALIZER;
+    stats_lock(&m, STATS_LOCK_NS_STATE);
+    pthread_mutex_unlock(&m);
+    pthread_rwlock_t rw = PTHREAD_RWLOCK_INITIALIZER;
+    stats_rdlock(&rw, STATS_LOCK_NS_STATE_READ);
+    stats_rdlock(&rw, STATS_LOCK_NS_STATE_READ);  // Readers share it
+    pthread_rwlock_unlock(&rw);
+    pthread_rwlock_unlock(&rw);
+    stats_wrlock(&rw, STATS_LOCK_NS_FILE);
+    pthread_rwlock_unlock(&rw);
+
+    cJSON* root = stats_to_json("NM");
+    cJSON* read = cJSON_GetObjectItem(cJSON_GetObjectItem(root, "ops"), "READ");
+    ASSERT_EQ(read != NULL, 1);
+    ASSERT_EQ(cJSON_GetObjectItem(read, "op_code")->valueint, OP_READ);
+    ASSERT_EQ(cJSON_GetObjectItem(read, "count")->valueint, 100);
+    ASSERT_EQ(cJSON_GetObjectItem(read, "errors")->valueint, 3);
+    ASSERT_EQ(cJSON_GetObjectItem(read, "max_us")->valueint, 199);
+    int p99 = cJSON_GetObjectItem(read, "p99_us")->valueint;
+    ASSERT_EQ(p99 >= 198 && p99 <= 199, 1);
+
+    cJSON* unknown = cJSON_GetObjectItem(cJSON_GetObjectItem(root, "ops"), "UNKNOWN");
+    ASSERT_EQ(cJSON_GetObjectItem(unknown, "errors")->valueint, 1);
+
+    cJSON* locks = cJSON_GetObjectItem(root, "lock_waits");
+    ASSERT_EQ(cJSON_GetObjectItem(cJSON_GetObjectItem(locks, "ns_state"), "count")->valueint, 1);
+    ASSERT_EQ(cJSON_GetObjectItem(locks, "lock_registry") == NULL, 1);  // Never taken
+    cJSON* shared = cJSON_GetObjectItem(locks, "ns_state_read");
+    ASSERT_EQ(cJSON_GetObjectItem(shared, "count")->valueint, 2);
+    ASSERT_EQ(cJSON_GetObjectItem(shared, "max_us")->valueint, 0);  // Never waited
+    ASSERT_EQ(cJSON_GetObjectItem(cJSON_GetObjectItem(locks, "ns_file_stripes"), "count")->valueint, 1);
+    cJSON_Delete(root);
+}
+
+/* === Main === */
+
+int main(void) {
+    printf("\n=== Protocol Tests ===\n\n");
+
+    printf("Codec:\n");
+    RUN_TEST(encode_minimal_header);
+    RUN_TEST(roundtrip_all_fields);
+    RUN_TEST(handle_is_shorter_than_filename);
+    RUN_TEST(decode_rejects_truncated);
+
+    printf("\nSockets:\n");
+    RUN_TEST(v1_send_recv);
+    RUN_TEST(v2_send_recv_mirrors_version);
+    RUN_TEST(send_message_resumes_short_writes);
+    RUN_TEST(send_to_closed_peer_fails_without_sigpipe);
+    RUN_TEST(send_times_out_when_peer_stops_reading);
+    RUN_TEST(parse_ss_info_protocol_suffix);
+    RUN_TEST(parse_ss_info_local_suffix);
+    RUN_TEST(unix_socket_roundtrip);
+
+    printf("\nMultiplexing:\n");
+    RUN_TEST(reply_echoes_request_id);
+    RUN_TEST(mux_out_of_order_replies);
+    RUN_TEST(mux_v1_matches_in_order);
+    RUN_TEST(mux_window_limit);
+
+    printf("\nFile payloads:\n");
+    RUN_TEST(file_payload_roundtrip);
+    RUN_TEST(file_payload_keeps_framing_when_file_shrinks);
+
+    printf("\nChunked transfers:\n");
+    RUN_TEST(chunked_payload_streams_in_bounded_pieces);
+    RUN_TEST(chunked_payload_reassembled_by_recv_message);
+    RUN_TEST(v1_peer_gets_single_frame);
+    RUN_TEST(recv_message_discards_unwanted_payload);
+
+    printf("\nReceive buffers:\n");
+    RUN_TEST(recv_into_reuses_buffer);
+    RUN_TEST(recv_into_reassembles_chunked_then_shrinks);
+    RUN_TEST(parse_frame_into_buffer);
+
+    printf("\nRelays:\n");
+    RUN_TEST(relay_rechunks_for_v2_peer);
+    RUN_TEST(relay_joins_chunks_for_v1_peer);
+    RUN_TEST(relay_drains_source_when_destination_is_gone);
+
+    printf("\nCompression:\n");
+    RUN_TEST(lz_roundtrip_shapes);
+    RUN_TEST(lz_rejects_corrupt_input);
+    RUN_TEST(compressed_frame_roundtrip);
+    RUN_TEST(compressed_frame_size_is_capped);
+    RUN_TEST(compressed_file_payload_is_chunked_and_decoded);
+
+    printf("\nBatches:\n");
+    RUN_TEST(batch_roundtrip);
+    RUN_TEST(batch_rejects_malformed);
+    RUN_TEST(batch_results_parse);
+
+    printf("\nLoad reports:\n");
+    RUN_TEST(load_report_roundtrip);
+    RUN_TEST(load_report_tolerates_unknown_and_missing_keys);
+
+    printf("\nDeadlines:\n");
+    RUN_TEST(deadline_reclaims_stalled_header);
+    RUN_TEST(deadline_disarmed_or_rearmed_does_not_fire);
+
+    printf("\nSS connection pool:\n");
+    RUN_TEST(pool_retries_read_on_stale_connection);
+    RUN_TEST(pool_does_not_resend_changes_after_send);
+    RUN_TEST(pool_retries_busy_with_backoff);
+
+    printf("\nLogging:\n");
+    RUN_TEST(logger_keeps_every_warning_in_order);
+
+    printf("\nOp stats:\n");
+    RUN_TEST(histogram_percentiles_stay_within_bucket_width);
+    RUN_TEST(stats_json_lists_recorded_ops_and_locks);
+
+    printf("\n=== All protocol tests passed! ===\n\n");
+    return 0;
+}
@@ -0,0 +1,745 @@
+/**
+ * search_tests.c - Tests for the Name Server's path index
+ *
+ * Covers the radix tree behind folder listings: edge splits on insert,
+ * merges on delete, prefix walks, and a randomized check against a plain
+ * array of paths. Also covers the lock-free file view used for lookups, the
+ * epoch reclamation that frees its old records, the slab-backed,
+ * hash-indexed registry tables behind ns_state.files and friends, and the
+ * metadata journal those tables are persisted through.
+ */
+
+#include "common.h"
+#include "name_server.h"
+#include <assert.h>
+
+#define TEST(name) static void test_##name(void)
+#define RUN_TEST(name) do { \
+    printf("  Testing %s... ", #name); \
+    fflush(stdout); \
+    test_##name(); \
+    printf("✓\n"); \
+} while(0)
+
+#define ASSERT_EQ(a, b) do { \
+    if ((a) != (b)) { \
+        fprintf(stderr, "FAIL: %s != %s (%ld != %ld, line %d)\n", \
+                #a, #b, (long)(a), (long)(b), __LINE__); \
+        exit(1); \
+    } \
+} while(0)
+
+#define ASSERT_STR_EQ(a, b) do { \
+    if (strcmp((a), (b)) != 0) { \
+        fprintf(stderr, "FAIL: '%s' != '%s' (line %d)\n", (a), (b), __LINE__); \
+        exit(1); \
+    } \
+} while(0)
+
+/* === Insert and search === */
+
+TEST(split_edges_keep_every_path) {
+    TrieNode* root = trie_create_node();
+    trie_insert(root, "notes.txt", 0);
+    trie_insert(root, "notebook.txt", 1);  // Splits "notes.txt" after "note"
+    trie_insert(root, "note", 2);          // Ends on the split point
+    trie_insert(root, "n", 3);             // Splits again, near the root
+    trie_insert(root, "docs/a.txt", 4);
+
+    ASSERT_EQ(trie_search(root, "notes.txt"), 0);
+    ASSERT_EQ(trie_search(root, "notebook.txt"), 1);
+    ASSERT_EQ(trie_search(root, "note"), 2);
+    ASSERT_EQ(trie_search(root, "n"), 3);
+    ASSERT_EQ(trie_search(root, "docs/a.txt"), 4);
+
+    // Prefixes of stored paths, and paths running past them, are absent
+    ASSERT_EQ(trie_search(root, "not"), -1);
+    ASSERT_EQ(trie_search(root, "notes.txt2"), -1);
+    ASSERT_EQ(trie_search(root, "docs/"), -1);
+    ASSERT_EQ(trie_search(root, "x"), -1);
+    ASSERT_EQ(trie_search(root, ""), -1);
+
+    trie_insert(root, "note", 7);  // Re-insert replaces the index
+    ASSERT_EQ(trie_search(root, "note"), 7);
+    trie_free(root);
+}
+
+TEST(shared_prefix_is_one_edge) {
+    TrieNode* root = trie_create_node();
+    trie_insert(root, "projects/team1/a.txt", 0);
+    trie_insert(root, "projects/team1/b.txt", 1);
+    trie_insert(root, "projects/team2/a.txt", 2);
+
+    // "projects/team" is shared by all three: one edge, not 13 nodes
+    ASSERT_EQ(root->child_count, 1);
+    TrieNode* shared = root->children[0];
+    ASSERT_EQ(shared->label_len, (int)strlen("projects/team"));
+    ASSERT_EQ(shared->child_count, 2);
+    trie_free(root);
+}
+
+/* === Delete === */
+
+TEST(delete_merges_and_prunes) {
+    TrieNode* root = trie_create_node();
+    trie_insert(root, "note", 0);
+    trie_insert(root, "notes.txt", 1);
+    trie_insert(root, "notebook.txt", 2);
+
+    trie_delete(root, "not");          // Not stored: no change
+    trie_delete(root, "notes.txt.bak");
+    ASSERT_EQ(trie_search(root, "note"), 0);
+
+    trie_delete(root, "note");         // "note" now only branches
+    ASSERT_EQ(trie_search(root, "note"), -1);
+    ASSERT_EQ(trie_search(root, "notes.txt"), 1);
+    ASSERT_EQ(trie_search(root, "notebook.txt"), 2);
+
+    trie_delete(root, "notes.txt");    // Branch gone: merged into one edge
+    ASSERT_EQ(root->child_count, 1);
+    ASSERT_EQ(root->children[0]->label_len, (int)strlen("notebook.txt"));
+    ASSERT_EQ(strncmp(root->children[0]->label, "notebook.txt", 12), 0);
+    ASSERT_EQ(trie_search(root, "notebook.txt"), 2);
+
+    trie_delete(root, "notebook.txt");
+    ASSERT_EQ(root->child_count, 0);
+    ASSERT_EQ(trie_search(root, "notebook.txt"), -1);
+
+    trie_insert(root, "again", 5);     // Still usable once empty
+    ASSERT_EQ(trie_search(root, "again"), 5);
+    trie_free(root);
+}
+
+/* === Walk === */
+
+typedef struct {
+    char paths[8][64];
+    int count;
+    int stop_after;
+} Collected;
+
+static int collect(void* ctx, const char* path, int file_index) {
+    Collected* c = (Collected*)ctx;
+    (void)file_index;
+    snprintf(c->paths[c->count++], sizeof(c->paths[0]), "%s", path);
+    return c->stop_after && c->count >= c->stop_after;
+}
+
+TEST(walk_visits_prefix_in_order) {
+    TrieNode* root = trie_create_node();
+    trie_insert(root, "a/y", 0);
+    trie_insert(root, "a/x", 1);
+    trie_insert(root, "a/b/z", 2);
+    trie_insert(root, "ab", 3);
+    trie_insert(root, "b", 4);
+
+    Collected c = { .count = 0 };
+    ASSERT_EQ(trie_walk(root, "a/", collect, &c), 0);
+    ASSERT_EQ(c.count, 3);
+    ASSERT_STR_EQ(c.paths[0], "a/b/z");
+    ASSERT_STR_EQ(c.paths[1], "a/x");
+    ASSERT_STR_EQ(c.paths[2], "a/y");
+
+    // Every path, and a prefix that ends inside an edge
+    c.count = 0;
+    trie_walk(root, NULL, collect, &c);
+    ASSERT_EQ(c.count, 5);
+    ASSERT_STR_EQ(c.paths[4], "b");
+    c.count = 0;
+    trie_walk(root, "a/b/", collect, &c);
+    ASSERT_EQ(c.count, 1);
+    ASSERT_STR_EQ(c.paths[0], "a/b/z");
+
+    c.count = 0;
+    trie_walk(root, "a/q", collect, &c);
+    trie_walk(root, "zzz", collect, &c);
+    ASSERT_EQ(c.count, 0);
+
+    Collected first = { .count = 0, .stop_after = 2 };
+    ASSERT_EQ(trie_walk(root, "", collect, &first), 1);
+    ASSERT_EQ(first.count, 2);
+    trie_free(root);
+}
+
+/* === Randomized === */
+
+#define RANDOM_PATHS 2000
+
+static int count_paths(void* ctx, const char* path, int file_index) {
+    (void)path;
+    (void)file_index;
+    (*(int*)ctx)++;
+    return 0;
+}
+
+TEST(random_inserts_and_deletes_match_reference) {
+    static char paths[RANDOM_PATHS][48];
+    static int present[RANDOM_PATHS];
+    unsigned int seed = 7;
+    TrieNode* root = trie_create_node();
+
+    for (int i = 0; i < RANDOM_PATHS; i++) {
+        // Few distinct folders and digits, so paths share long prefixes
+        snprintf(paths[i], sizeof(paths[i]), "dir%d/sub%d/f%d.txt",
+                 rand_r(&seed) % 5, rand_r(&seed) % 3, i);
+        trie_insert(root, paths[i], i);
+        present[i] = 1;
+    }
+    for (int round = 0; round < 3 * RANDOM_PATHS; round++) {
+        int i = rand_r(&seed) % RANDOM_PATHS;
+        if (present[i]) {
+            trie_delete(root, paths[i]);
+        } else {
+            trie_insert(root, paths[i], i);
+        }
+        present[i] = !present[i];
+    }
+
+    int expected = 0;
+    for (int i = 0; i < RANDOM_PATHS; i++) {
+        ASSERT_EQ(trie_search(root, paths[i]), present[i] ? i : -1);
+        expected += present[i];
+    }
+    int walked = 0;
+    trie_walk(root, "", count_paths, &walked);
+    ASSERT_EQ(walked, expected);
+    trie_free(root);
+}
+
+/* === Epoch reclamation === */
+
+static int freed_count;
+
+static void count_free(void* ptr) {
+    free(ptr);
+    __atomic_fetch_add(&freed_count, 1, __ATOMIC_RELAXED);
+}
+
+static pthread_barrier_t reader_entered;
+static pthread_barrier_t reader_release;
+
+static void* hold_read_section(void* arg) {
+    (void)arg;
+    epoch_enter();
+    pthread_barrier_wait(&reader_entered);
+    pthread_barrier_wait(&reader_release);
+    epoch_exit();
+    return NULL;
+}
+
+TEST(epoch_defers_free_until_readers_leave) {
+    epoch_reclaim();
+    freed_count = 0;
+
+    // Another thread is inside: nothing retired now may be freed
+    pthread_barrier_init(&reader_entered, NULL, 2);
+    pthread_barrier_init(&reader_release, NULL, 2);
+    pthread_t reader;
+    pthread_create(&reader, NULL, hold_read_section, NULL);
+    pthread_barrier_wait(&reader_entered);
+
+    epoch_retire(malloc(16), count_free);
+    for (int i = 0; i < 3; i++) {
+        ASSERT_EQ(epoch_reclaim(), 0);
+    }
+    ASSERT_EQ(freed_count, 0);
+
+    pthread_barrier_wait(&reader_release);
+    pthread_join(reader, NULL);
+    ASSERT_EQ(epoch_reclaim(), 1);
+    ASSERT_EQ(freed_count, 1);
+
+    // Sections nest: only leaving the outermost one releases the object
+    epoch_enter();
+    epoch_enter();
+    epoch_retire(malloc(16), count_free);
+    epoch_exit();
+    ASSERT_EQ(epoch_reclaim(), 0);
+    epoch_exit();
+    ASSERT_EQ(epoch_reclaim(), 1);
+    ASSERT_EQ(freed_count, 2);
+
+    pthread_barrier_destroy(&reader_entered);
+    pthread_barrier_destroy(&reader_release);
+}
+
+/* === Published view === */
+
+static void set_file(FileMetadata* file, const char* folder, const char* name,
+                     const char* owner, int ss_id) {
+    memset(file, 0, sizeof(*file));
+    snprintf(file->folder_path, sizeof(file->folder_path), "%s", folder);
+    snprintf(file->filename, sizeof(file->filename), "%s", name);
+    snprintf(file->owner, sizeof(file->owner), "%s", owner);
+    file->ss_id = ss_id;
+}
+
+TEST(view_publish_replace_remove) {
+    FileView* view = file_view_create();
+    AccessControlEntry acl[2] = { { "alice", 1, 1 }, { "bob", 1, 0 } };
+    FileMetadata file;
+    set_file(&file, "docs", "a.txt", "alice", 3);
+    file.acl = acl;
+    file.acl_count = 1;
+    ASSERT_EQ(file_view_publish(view, &file), ERR_SUCCESS);
+
+    int can_read, can_write;
+    epoch_enter();
+    const FileRecord* record = file_view_find(view, "docs/a.txt");
+    ASSERT_EQ(record != NULL, 1);
+    ASSERT_EQ(record->ss_id, 3);
+    ASSERT_EQ(record->folder_len, 4);
+    ASSERT_STR_EQ(record->owner, "alice");
+    file_record_access(record, "bob", &can_read, &can_write);
+    ASSERT_EQ(can_read + can_write, 0);
+    ASSERT_EQ(file_view_find(view, "a.txt") == NULL, 1);  // Not at root
+    ASSERT_EQ(file_view_find(view, "docs") == NULL, 1);
+    epoch_exit();
+
+    // Republishing replaces the record: the view holds a copy of the ACL
+    file.acl_count = 2;
+    ASSERT_EQ(file_view_publish(view, &file), ERR_SUCCESS);
+    acl[1].read_permission = 0;
+    ASSERT_EQ(view->count, 1);
+    epoch_enter();
+    record = file_view_find(view, "docs/a.txt");
+    file_record_access(record, "bob", &can_read, &can_write);
+    ASSERT_EQ(can_read, 1);
+    ASSERT_EQ(can_write, 0);
+    file_record_access(record, "alice", &can_read, &can_write);
+    ASSERT_EQ(can_read + can_write, 2);
+    file_record_access(record, NULL, &can_read, &can_write);
+    ASSERT_EQ(can_read + can_write, 0);
+    epoch_exit();
+
+    // Same name at root is a different file
+    set_file(&file, "", "a.txt", "carol", 4);
+    ASSERT_EQ(file_view_publish(view, &file), ERR_SUCCESS);
+    ASSERT_EQ(view->count, 2);
+
+    ASSERT_EQ(file_view_remove(view, "docs/a.txt"), ERR_SUCCESS);
+    ASSERT_EQ(file_view_remove(view, "docs/a.txt"), ERR_FILE_NOT_FOUND);
+    epoch_enter();
+    ASSERT_EQ(file_view_find(view, "docs/a.txt") == NULL, 1);
+    record = file_view_find(view, "a.txt");
+    ASSERT_EQ(record->folder_len, 0);
+    ASSERT_STR_EQ(record->owner, "carol");
+    epoch_exit();
+    ASSERT_EQ(view->count, 1);
+    file_view_free(view);
+}
+
+TEST(view_grows_past_initial_buckets) {
+    FileView* view = file_view_create();
+    FileMetadata file;
+    set_file(&file, "", "first", "o0", 0);
+    ASSERT_EQ(file_view_publish(view, &file), ERR_SUCCESS);
+
+    // A record found before the view grows stays readable until exit
+    epoch_enter();
+    const FileRecord* held = file_view_find(view, "first");
+    int files = NM_VIEW_MIN_BUCKETS * 3;
+    for (int i = 1; i < files; i++) {
+        char name[32];
+        snprintf(name, sizeof(name), "g%d", i);
+        set_file(&file, "grow", name, "o", i);
+        ASSERT_EQ(file_view_publish(view, &file), ERR_SUCCESS);
+    }
+    ASSERT_STR_EQ(held->path, "first");
+    epoch_exit();
+
+    ASSERT_EQ(view->count, files);
+    ASSERT_EQ(view->table->mask + 1 >= (unsigned int)files, 1);
+    epoch_enter();
+    for (int i = 1; i < files; i++) {
+        char path[40];
+        snprintf(path, sizeof(path), "grow/g%d", i);
+        const FileRecord* record = file_view_find(view, path);
+        ASSERT_EQ(record != NULL && record->ss_id == i, 1);
+    }
+    ASSERT_EQ(file_view_find(view, "first")->ss_id, 0);
+    epoch_exit();
+    epoch_reclaim();
+    file_view_free(view);
+}
+
+#define VIEW_FILES 64
+#define VIEW_GROW_FILES 6000
+#define VIEW_READERS 4
+#define VIEW_ROUNDS 20000
+
+static FileView* shared_view;
+static int shared_files;
+static int writer_done;
+
+// Every published version of "f<i>" has ss_id = i + 10000 * version and
+// owner "o<ss_id>"; a reader that sees anything else saw a torn record
+static void* check_lookups(void* arg) {
+    unsigned int seed = (unsigned int)(long)arg;
+    long found = 0;
+    while (!__atomic_load_n(&writer_done, __ATOMIC_ACQUIRE)) {
+        int i = rand_r(&seed) % shared_files;
+        char path[32];
+        snprintf(path, sizeof(path), "d/f%d", i);
+        epoch_enter();
+        const FileRecord* record = file_view_find(shared_view, path);
+        if (record) {
+            char owner[MAX_USERNAME];
+            snprintf(owner, sizeof(owner), "o%d", record->ss_id);
+            if (record->ss_id % 10000 != i || strcmp(record->owner, owner) != 0 ||
+                strcmp(record->path, path) != 0) {
+                fprintf(stderr, "FAIL: torn record for %s (line %d)\n", path, __LINE__);
+                exit(1);
+            }
+            found++;
+        }
+        epoch_exit();
+    }
+    return (void*)found;
+}
+
+// Random publishes and removes of `files` files against VIEW_READERS readers
+static void race_readers_with_writer(int files) {
+    shared_view = file_view_create();
+    shared_files = files;
+    writer_done = 0;
+    pthread_t readers[VIEW_READERS];
+    for (long t = 0; t < VIEW_READERS; t++) {
+        pthread_create(&readers[t], NULL, check_lookups, (void*)(t + 1));
+    }
+
+    unsigned int seed = 11;
+    FileMetadata file;
+    for (int round = 0; round < VIEW_ROUNDS; round++) {
+        int i = rand_r(&seed) % files;
+        char name[32];
+        char owner[MAX_USERNAME];
+        snprintf(name, sizeof(name), "f%d", i);
+        if (rand_r(&seed) % 4 == 0) {
+            char path[40];
+            snprintf(path, sizeof(path), "d/%s", name);
+            file_view_remove(shared_view, path);
+            continue;
+        }
+        int ss_id = i + 10000 * (round + 1);
+        snprintf(owner, sizeof(owner), "o%d", ss_id);
+        set_file(&file, "d", name, owner, ss_id);
+        ASSERT_EQ(file_view_publish(shared_view, &file), ERR_SUCCESS);
+    }
+    __atomic_store_n(&writer_done, 1, __ATOMIC_RELEASE);
+
+    for (int t = 0; t < VIEW_READERS; t++) {
+        pthread_join(readers[t], NULL);
+    }
+    ASSERT_EQ(shared_view->count <= files, 1);
+    epoch_reclaim();
+    file_view_free(shared_view);
+}
+
+TEST(view_readers_race_with_writer) {
+    race_readers_with_writer(VIEW_FILES);
+}
+
+// Enough files that the bucket array is replaced while readers walk it
+TEST(view_readers_race_with_growth) {
+    race_readers_with_writer(VIEW_GROW_FILES);
+}
+
+/* === Registry tables === */
+
+typedef struct {
+    char name[32];
+    int value;
+} Item;
+
+static void item_key(const void* entry, char* key, size_t size) {
+    snprintf(key, size, "%s", ((const Item*)entry)->name);
+}
+
+static int insert_item(RegistryTable* table, const char* name, int value) {
+    Item item;
+    memset(&item, 0, sizeof(item));
+    snprintf(item.name, sizeof(item.name), "%s", name);
+    item.value = value;
+    return registry_insert(table, &item);
+}
+
+TEST(registry_ids_are_stable_and_reused) {
+    RegistryTable table;
+    ASSERT_EQ(registry_init(&table, sizeof(Item), item_key), ERR_SUCCESS);
+    ASSERT_EQ(insert_item(&table, "a", 1), 0);
+    ASSERT_EQ(insert_item(&table, "b", 2), 1);
+    ASSERT_EQ(insert_item(&table, "c", 3), 2);
+    Item* c = registry_get(&table, 2);
+
+    ASSERT_EQ(registry_find(&table, "b"), 1);
+    ASSERT_EQ(registry_find(&table, "d"), -1);
+    ASSERT_EQ(registry_get(&table, -1) == NULL, 1);
+    ASSERT_EQ(registry_get(&table, 3) == NULL, 1);
+
+    // Removing leaves the other entries where they are
+    registry_remove(&table, 1);
+    ASSERT_EQ(table.count, 2);
+    ASSERT_EQ(registry_find(&table, "b"), -1);
+    ASSERT_EQ(registry_get(&table, 1) == NULL, 1);
+    ASSERT_EQ(registry_get(&table, 2) == c, 1);
+    ASSERT_EQ(registry_find(&table, "c"), 2);
+    ASSERT_EQ(registry_next(&table, -1), 0);
+    ASSERT_EQ(registry_next(&table, 0), 2);
+    ASSERT_EQ(registry_next(&table, 2), -1);
+
+    // The freed ID is handed out again
+    ASSERT_EQ(insert_item(&table, "e", 5), 1);
+    ASSERT_EQ(((Item*)registry_get(&table, 1))->value, 5);
+
+    // Rekey: same ID and entry, found only under the new key
+    snprintf(c->name, sizeof(c->name), "z");
+    ASSERT_EQ(registry_rekey(&table, 2, "c"), ERR_SUCCESS);
+    ASSERT_EQ(registry_find(&table, "c"), -1);
+    ASSERT_EQ(registry_find(&table, "z"), 2);
+    ASSERT_EQ(((Item*)registry_get(&table, 2))->value, 3);
+    registry_free(&table);
+}
+
+#define REGISTRY_ITEMS 20000
+
+TEST(registry_grows_without_moving_entries) {
+    RegistryTable table;
+    ASSERT_EQ(registry_init(&table, sizeof(Item), item_key), ERR_SUCCESS);
+    static Item* seen[REGISTRY_ITEMS];
+    char name[32];
+
+    // Far past one slab and the initial index: nothing moves
+    for (int i = 0; i < REGISTRY_ITEMS; i++) {
+        snprintf(name, sizeof(name), "item%d", i);
+        ASSERT_EQ(insert_item(&table, name, i), i);
+        seen[i] = registry_get(&table, i);
+    }
+    ASSERT_EQ(table.count, REGISTRY_ITEMS);
+    ASSERT_EQ(table.slab_count, (REGISTRY_ITEMS + NM_SLAB_ENTRIES - 1) / NM_SLAB_ENTRIES);
+    for (int i = 0; i < REGISTRY_ITEMS; i++) {
+        ASSERT_EQ(registry_get(&table, i) == seen[i], 1);
+    }
+
+    // Churn leaves deleted slots behind; lookups must probe past them
+    for (int round = 0; round < 3; round++) {
+        for (int i = round; i < REGISTRY_ITEMS; i += 3) {
+            snprintf(name, sizeof(name), "item%d", i);
+            registry_remove(&table, registry_find(&table, name));
+        }
+        for (int i = round; i < REGISTRY_ITEMS; i += 3) {
+            snprintf(name, sizeof(name), "item%d", i);
+            ASSERT_EQ(insert_item(&table, name, i) >= 0, 1);
+        }
+    }
+    ASSERT_EQ(table.count, REGISTRY_ITEMS);
+    ASSERT_EQ(table.id_limit, REGISTRY_ITEMS);  // Every removed ID was reused
+
+    int walked = 0;
+    for (int id = registry_next(&table, -1); id >= 0; id = registry_next(&table, id)) {
+        walked++;
+    }
+    ASSERT_EQ(walked, REGISTRY_ITEMS);
+    for (int i = 0; i < REGISTRY_ITEMS; i++) {
+        snprintf(name, sizeof(name), "item%d", i);
+        Item* item = registry_get(&table, registry_find(&table, name));
+        ASSERT_EQ(item != NULL && item->value == i, 1);
+    }
+    ASSERT_EQ(table.slots_used * 4 <= (int)(table.slot_mask + 1) * 3, 1);
+    registry_free(&table);
+}
+
+/* === Metadata journal === */
+
+#define JOURNAL_THREADS 8
+#define JOURNAL_COMMITS 50
+
+typedef struct {
+    int count;
+    char types[JOURNAL_THREADS * JOURNAL_COMMITS + 1];
+    int last_seq[JOURNAL_THREADS];  // Per-thread order check
+    int in_order;
+} Replayed;
+
+static void collect_record(char type, char* payload, size_t len, void* ctx) {
+    Replayed* replayed = (Replayed*)ctx;
+    replayed->types[replayed->count++] = type;
+    int thread = 0, seq = 0;
+    char text[64];
+    snprintf(text, sizeof(text), "%.*s", (int)len, payload);
+    if (sscanf(text, "%d %d", &thread, &seq) == 2 && thread < JOURNAL_THREADS) {
+        replayed->in_order &= seq > replayed->last_seq[thread];
+        replayed->last_seq[thread] = seq;
+    }
+}
+
+static void replay_into(const char* dir, int generation, Replayed* replayed, int expect) {
+    memset(replayed, 0, sizeof(*replayed));
+    memset(replayed->last_seq, -1, sizeof(replayed->last_seq));
+    replayed->in_order = 1;
+    ASSERT_EQ(journal_replay(dir, generation, collect_record, replayed), expect);
+}
+
+static void remove_journal_dir(const char* dir) {
+    char path[MAX_PATH];
+    for (int gen = 0; gen < 4; gen++) {
+        snprintf(path, sizeof(path), "%s/nm_journal.%d", dir, gen);
+        unlink(path);
+    }
+    rmdir(dir);
+}
+
+TEST(journal_replays_records_and_drops_torn_tail) {
+    char dir[] = "/tmp/journal_testXXXXXX";
+    ASSERT_EQ(mkdtemp(dir) != NULL, 1);
+    ASSERT_EQ(journal_open(dir, 0, JOURNAL_SYNC_ALWAYS, NULL), ERR_SUCCESS);
+
+    // Payloads may hold newlines and '|', as file entries do
+    const char* payloads[] = { "a.txt||alice|1\nalice|1|1\n", "d/b.txt\n", "" };
+    long lsn = 0;
+    for (int i = 0; i < 3; i++) {
+        lsn = journal_append("FDX"[i], payloads[i], strlen(payloads[i]));
+        ASSERT_EQ(lsn, i + 1);
+    }
+    // A commit writes and syncs every record before it in one batch (the
+    // flusher thread may have taken an earlier one on its own)
+    ASSERT_EQ(journal_commit(lsn), ERR_SUCCESS);
+    JournalStats stats;
+    journal_get_stats(&stats);
+    ASSERT_EQ(stats.records, 3);
+    ASSERT_EQ(stats.writes < stats.records, 1);
+    ASSERT_EQ(stats.syncs < stats.records, 1);
+    journal_close();
+
+    char path[MAX_PATH];
+    snprintf(path, sizeof(path), "%s/nm_journal.0", dir);
+    struct stat st;
+    stat(path, &st);
+    long intact = st.st_size;
+
+    // A crash mid-write leaves part of a record: header and some payload
+    FILE* f = fopen(path, "a");
+    fputs("F 40 0badf00d\nc.txt||al", f);
+    fclose(f);
+
+    Replayed replayed;
+    replay_into(dir, 0, &replayed, 3);
+    ASSERT_STR_EQ(replayed.types, "FDX");
+    stat(path, &st);
+    ASSERT_EQ(st.st_size, intact);
+
+    // A flipped payload byte fails the checksum: replay stops before it.
+    // The last record is empty, so this lands in the one before.
+    f = fopen(path, "r+");
+    fseek(f, -(long)strlen("X 0 00000000\n") - 3, SEEK_END);
+    fputc('#', f);
+    fclose(f);
+    replay_into(dir, 0, &replayed, 1);
+    ASSERT_EQ(journal_replay(dir, 1, collect_record, &replayed), -1);
+    remove_journal_dir(dir);
+}
+
+static void* commit_records(void* arg) {
+    long thread = (long)arg;
+    for (int seq = 0; seq < JOURNAL_COMMITS; seq++) {
+        char payload[32];
+        int len = snprintf(payload, sizeof(payload), "%ld %d", thread, seq);
+        ASSERT_EQ(journal_commit(journal_append('F', payload, len)), ERR_SUCCESS);
+    }
+    return NULL;
+}
+
+// Concurrent commits all become durable, in each thread's order, and never
+// need more syncs than commits
+TEST(journal_group_commit_keeps_every_record) {
+    char dir[] = "/tmp/journal_testXXXXXX";
+    ASSERT_EQ(mkdtemp(dir) != NULL, 1);
+    ASSERT_EQ(journal_open(dir, 0, JOURNAL_SYNC_ALWAYS, NULL), ERR_SUCCESS);
+
+    pthread_t threads[JOURNAL_THREADS];
+    for (long t = 0; t < JOURNAL_THREADS; t++) {
+        pthread_create(&threads[t], NULL, commit_records, (void*)t);
+    }
+    for (int t = 0; t < JOURNAL_THREADS; t++) {
+        pthread_join(threads[t], NULL);
+    }
+    JournalStats stats;
+    journal_get_stats(&stats);
+    ASSERT_EQ(stats.commits, JOURNAL_THREADS * JOURNAL_COMMITS);
+    ASSERT_EQ(stats.syncs <= stats.commits, 1);
+    journal_close();
+
+    Replayed replayed;
+    replay_into(dir, 0, &replayed, JOURNAL_THREADS * JOURNAL_COMMITS);
+    ASSERT_EQ(replayed.in_order, 1);
+    for (int t = 0; t < JOURNAL_THREADS; t++) {
+        ASSERT_EQ(replayed.last_seq[t], JOURNAL_COMMITS - 1);
+    }
+    remove_journal_dir(dir);
+}
+
+TEST(journal_rotate_starts_next_generation) {
+    char dir[] = "/tmp/journal_testXXXXXX";
+    ASSERT_EQ(mkdtemp(dir) != NULL, 1);
+    ASSERT_EQ(journal_open(dir, 0, JOURNAL_SYNC_BATCH, NULL), ERR_SUCCESS);
+
+    ASSERT_EQ(journal_commit(journal_append('O', "old", 3)), ERR_SUCCESS);
+    // Buffered when the journal switches: written to the new file
+    long lsn = journal_append('R', "pending", 7);
+    ASSERT_EQ(journal_rotate(), 1);
+    ASSERT_EQ(journal_commit(lsn), ERR_SUCCESS);
+    ASSERT_EQ(journal_commit(journal_append('F', "new", 3)), ERR_SUCCESS);
+    journal_close();
+
+    Replayed replayed;
+    replay_into(dir, 0, &replayed, 1);
+    ASSERT_STR_EQ(replayed.types, "O");
+    replay_into(dir, 1, &replayed, 2);
+    ASSERT_STR_EQ(replayed.types, "RF");
+
+    // Once a snapshot names generation 1, generation 0 can go
+    journal_remove_before(1);
+    ASSERT_EQ(journal_replay(dir, 0, collect_record, &replayed), -1);
+    replay_into(dir, 1, &replayed, 2);
+    remove_journal_dir(dir);
+}
+
+/* === Main === */
+
+int main(void) {
+    printf("\n=== Search Index Tests ===\n\n");
+
+    printf("Insert and search:\n");
+    RUN_TEST(split_edges_keep_every_path);
+    RUN_TEST(shared_prefix_is_one_edge);
+
+    printf("\nDelete:\n");
+    RUN_TEST(delete_merges_and_prunes);
+
+    printf("\nWalk:\n");
+    RUN_TEST(walk_visits_prefix_in_order);
+
+    printf("\nRandomized:\n");
+    RUN_TEST(random_inserts_and_deletes_match_reference);
+
+    printf("\nEpoch reclamation:\n");
+    RUN_TEST(epoch_defers_free_until_readers_leave);
+
+    printf("\nPublished view:\n");
+    RUN_TEST(view_publish_replace_remove);
+    RUN_TEST(view_grows_past_initial_buckets);
+    RUN_TEST(view_readers_race_with_writer);
+    RUN_TEST(view_readers_race_with_growth);
+
+    printf("\nRegistry tables:\n");
+    RUN_TEST(registry_ids_are_stable_and_reused);
+    RUN_TEST(registry_grows_without_moving_entries);
+
+    printf("\nMetadata journal:\n");
+    RUN_TEST(journal_replays_records_and_drops_torn_tail);
+    RUN_TEST(journal_group_commit_keeps_every_record);
+    RUN_TEST(journal_rotate_starts_next_generation);
+
+    printf("\n=== All search index tests passed! ===\n\n");
+    return 0;
+}
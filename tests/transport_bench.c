@@ -0,0 +1,175 @@
+/**
+ * transport_bench.c - Loopback TCP versus Unix-domain-socket transport
+ *
+ * Runs an echo server thread and measures, for each transport:
+ *
+ *   latency     round trip of a small request (p50/p99)
+ *   throughput  one-way stream of fixed-size frames, acknowledged at the end
+ *
+ * Both transports use the regular send_message/recv_message path, so the
+ * difference is purely the kernel's TCP loopback stack versus AF_UNIX.
+ *
+ * Usage: ./tests/bench_transport [round_trips] [stream_mib]
+ */
+
+#include "common.h"
+
+#define STREAM_FRAME_BYTES (64 * 1024)
+
+typedef enum { TRANSPORT_TCP, TRANSPORT_UNIX } Transport;
+
+static const char* transport_names[] = { "tcp-loopback", "unix-socket" };
+
+typedef struct {
+    int listen_fd;
+    int round_trips;
+    int stream_frames;
+} EchoServer;
+
+static void* echo_thread(void* arg) {
+    EchoServer* srv = arg;
+    int fd = accept(srv->listen_fd, NULL, NULL);
+    if (fd < 0) return NULL;
+    set_socket_protocol(fd, PROTOCOL_V2);
+
+    RecvBuffer rb;
+    recv_buffer_init(&rb);
+    for (int i = 0; i < srv->round_trips; i++) {
+        MessageHeader header;
+        char* payload = NULL;
+        if (recv_message_into(fd, &header, &rb, &payload) < 0) break;
+        header.msg_type = MSG_RESPONSE;
+        send_message(fd, &header, payload);
+    }
+
+    // Stream phase: swallow frames, acknowledge once at the end
+    MessageHeader header;
+    for (int i = 0; i < srv->stream_frames; i++) {
+        char* payload = NULL;
+        if (recv_message_into(fd, &header, &rb, &payload) < 0) break;
+    }
+    INIT_RESPONSE_HEADER(&header, MSG_ACK, ERR_SUCCESS);
+    send_message(fd, &header, NULL);
+
+    recv_buffer_free(&rb);
+    close(fd);
+    return NULL;
+}
+
+static int compare_double(const void* a, const void* b) {
+    double x = *(const double*)a, y = *(const double*)b;
+    return (x > y) - (x < y);
+}
+
+static double now_us(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e6 + ts.tv_nsec / 1e3;
+}
+
+static int run_transport(Transport t, int round_trips, int stream_frames) {
+    char path[MAX_LOCAL_ADDR];
+    char addr_str[MAX_LOCAL_ADDR + 8];
+    int listen_fd, port = 0;
+
+    if (t == TRANSPORT_UNIX) {
+        unix_socket_path(path, sizeof(path), "bench", getpid());
+        listen_fd = create_unix_server_socket(path);
+        snprintf(addr_str, sizeof(addr_str), "%s%s", UNIX_SOCKET_PREFIX, path);
+    } else {
+        listen_fd = create_server_socket(0);
+        struct sockaddr_in addr;
+        socklen_t addr_len = sizeof(addr);
+        getsockname(listen_fd, (struct sockaddr*)&addr, &addr_len);
+        port = ntohs(addr.sin_port);
+        snprintf(addr_str, sizeof(addr_str), "127.0.0.1");
+    }
+    if (listen_fd < 0) return -1;
+
+    EchoServer srv = { listen_fd, round_trips, stream_frames };
+    pthread_t server;
+    pthread_create(&server, NULL, echo_thread, &srv);
+
+    int fd = connect_to_server(addr_str, port);
+    if (fd < 0) {
+        close(listen_fd);
+        return -1;
+    }
+    set_socket_protocol(fd, PROTOCOL_V2);
+
+    char small[32];
+    memset(small, 'x', sizeof(small) - 1);
+    small[sizeof(small) - 1] = '\0';
+    double* samples = malloc(round_trips * sizeof(double));
+
+    int done = 0;
+    for (; done < round_trips; done++) {
+        MessageHeader header;
+        init_message_header(&header, MSG_REQUEST, OP_SS_WRITE_WORD, "bench");
+        header.data_length = sizeof(small) - 1;
+
+        double start = now_us();
+        char* reply = NULL;
+        if (send_message(fd, &header, small) < 0 || recv_message(fd, &header, &reply) < 0) {
+            break;
+        }
+        samples[done] = now_us() - start;
+        free(reply);
+    }
+
+    char* frame = malloc(STREAM_FRAME_BYTES);
+    memset(frame, 'y', STREAM_FRAME_BYTES);
+    double stream_start = now_us();
+    int sent = 0;
+    for (; done == round_trips && sent < stream_frames; sent++) {
+        MessageHeader header;
+        init_message_header(&header, MSG_REQUEST, OP_SS_WRITE_WORD, "bench");
+        header.data_length = STREAM_FRAME_BYTES;
+        if (send_message(fd, &header, frame) < 0) break;
+    }
+    MessageHeader ack;
+    char* ack_payload = NULL;
+    int acked = sent == stream_frames && recv_message(fd, &ack, &ack_payload) >= 0;
+    double stream_us = now_us() - stream_start;
+    free(ack_payload);
+
+    close(fd);
+    pthread_join(server, NULL);
+    close(listen_fd);
+    if (t == TRANSPORT_UNIX) unlink(path);
+
+    if (done > 0) {
+        qsort(samples, done, sizeof(double), compare_double);
+        double mib = (double)sent * STREAM_FRAME_BYTES / (1024.0 * 1024.0);
+        printf("%-14s %8d %10.1f %10.1f %12.0f\n", transport_names[t], done,
+               samples[done / 2], samples[(int)(done * 0.99)],
+               acked && stream_us > 0 ? mib / (stream_us / 1e6) : 0.0);
+    }
+    free(samples);
+    free(frame);
+    return done == round_trips && acked ? 0 : -1;
+}
+
+int main(int argc, char* argv[]) {
+    int round_trips = argc > 1 ? atoi(argv[1]) : 20000;
+    int stream_mib = argc > 2 ? atoi(argv[2]) : 512;
+    if (round_trips < 1 || stream_mib < 1) {
+        fprintf(stderr, "Usage: %s [round_trips] [stream_mib]\n", argv[0]);
+        return 1;
+    }
+    int stream_frames = stream_mib * (1024 * 1024 / STREAM_FRAME_BYTES);
+
+    printf("\n=== Transport comparison (32-byte round trips, %d MiB stream of %d KiB frames) ===\n\n",
+           stream_mib, STREAM_FRAME_BYTES / 1024);
+    printf("%-14s %8s %10s %10s %12s\n", "transport", "trips", "p50_us", "p99_us", "stream_MiB/s");
+
+    int rc = 0;
+    for (int t = TRANSPORT_TCP; t <= TRANSPORT_UNIX; t++) {
+        if (run_transport(t, round_trips, stream_frames) < 0) {
+            fprintf(stderr, "%s: benchmark failed\n", transport_names[t]);
+            rc = 1;
+        }
+    }
+    printf("\n");
+    return rc;
+}
@@ -0,0 +1,197 @@
+/**
+ * worker_pool_tests.c - Tests for the Storage Server's admission queue
+ *
+ * Runs the worker pool with one worker whose connection handler is held
+ * until the test lets it go, so the queue behind it can be filled, left to
+ * age and drained on purpose. Covers ERR_SS_BUSY rejections when the queue
+ * is full, expiry of connections that waited past SS_QUEUE_MAX_WAIT_MS, and
+ * the admitted/rejected/expired counters. The tests run in order on the
+ * one pool the process has.
+ */
+
+#include "common.h"
+#include "storage_server.h"
+#include <assert.h>
+
+#define TEST(name) static void test_##name(void)
+#define RUN_TEST(name) do { \
+    printf("  Testing %s... ", #name); \
+    fflush(stdout); \
+    test_##name(); \
+    printf("✓\n"); \
+} while(0)
+
+#define ASSERT_EQ(a, b) do { \
+    if ((a) != (b)) { \
+        fprintf(stderr, "FAIL: %s != %s (%ld != %ld, line %d)\n", \
+                #a, #b, (long)(a), (long)(b), __LINE__); \
+        exit(1); \
+    } \
+} while(0)
+
+#define QUEUE_CAPACITY 3
+
+// Stand-in for the real connection handler: waits for the gate to open
+static pthread_mutex_t gate_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t gate_cond = PTHREAD_COND_INITIALIZER;
+static int gate_open = 0;
+static int handled = 0;
+
+void* handle_client_request(void* arg) {
+    int fd = *(int*)arg;
+    free(arg);
+    pthread_mutex_lock(&gate_lock);
+    while (!gate_open) {
+        pthread_cond_wait(&gate_cond, &gate_lock);
+    }
+    handled++;
+    pthread_mutex_unlock(&gate_lock);
+    close(fd);
+    return NULL;
+}
+
+// Peer ends of the submitted connections, by submission order
+static int peers[8];
+static int submitted = 0;
+
+static int submit(void) {
+    int fds[2];
+    assert(socketpair(AF_UNIX, SOCK_STREAM, 0, fds) == 0);
+    peers[submitted++] = fds[1];
+    return ss_worker_pool_submit(fds[0]);
+}
+
+static WorkerPoolStats stats(void) {
+    WorkerPoolStats s;
+    ss_worker_pool_get_stats(&s);
+    return s;
+}
+
+// A rejected peer gets one v1 ERR_SS_BUSY frame, then the connection closes
+static void assert_rejected(int peer) {
+    unsigned char wire[WIRE_V1_HEADER_SIZE + 16];
+    size_t len = 0;
+    ssize_t n;
+    while ((n = recv(peer, wire + len, sizeof(wire) - len, 0)) > 0) {
+        len += n;
+    }
+    ASSERT_EQ(n, 0);
+    ASSERT_EQ(len, WIRE_V1_HEADER_SIZE);
+    assert(wire[0] != WIRE_V2_MAGIC);
+
+    MessageHeader h;
+    memset(&h, 0, sizeof(h));
+    memcpy(&h, wire, WIRE_V1_HEADER_SIZE);
+    ASSERT_EQ(h.msg_type, MSG_ERROR);
+    ASSERT_EQ(h.error_code, ERR_SS_BUSY);
+}
+
+// Nothing was sent to a peer still waiting for (or served by) a worker
+static void assert_waiting(int peer) {
+    char byte;
+    assert(recv(peer, &byte, 1, MSG_DONTWAIT) < 0 && errno == EAGAIN);
+}
+
+/* === Admission === */
+
+TEST(full_queue_rejects_busy_in_v1) {
+    // The first connection goes straight to the only worker and stays there
+    ASSERT_EQ(submit(), ERR_SUCCESS);
+    for (int i = 0; i < 200 && stats().busy == 0; i++) {
+        usleep(10000);
+    }
+    ASSERT_EQ(stats().busy, 1);
+
+    for (int i = 0; i < QUEUE_CAPACITY; i++) {
+        ASSERT_EQ(submit(), ERR_SUCCESS);
+    }
+    ASSERT_EQ(stats().queue_depth, QUEUE_CAPACITY);
+
+    ASSERT_EQ(submit(), ERR_SS_BUSY);
+    assert_rejected(peers[submitted - 1]);
+    for (int i = 0; i < submitted - 1; i++) {
+        assert_waiting(peers[i]);
+    }
+
+    WorkerPoolStats s = stats();
+    ASSERT_EQ(s.admitted, 1 + QUEUE_CAPACITY);
+    ASSERT_EQ(s.rejected, 1);
+    ASSERT_EQ(s.expired, 0);
+    ASSERT_EQ(s.max_queue_depth, QUEUE_CAPACITY);
+}
+
+/* === Expiry === */
+
+TEST(expire_drops_only_entries_past_max_wait) {
+    // Nothing has waited long enough yet
+    ss_worker_pool_expire();
+    ASSERT_EQ(stats().expired, 0);
+    ASSERT_EQ(stats().queue_depth, QUEUE_CAPACITY);
+
+    usleep((SS_QUEUE_MAX_WAIT_MS + 200) * 1000);
+    ss_worker_pool_expire();
+
+    // Every queued connection aged out and was told to retry
+    WorkerPoolStats s = stats();
+    ASSERT_EQ(s.expired, QUEUE_CAPACITY);
+    ASSERT_EQ(s.queue_depth, 0);
+    for (int i = 1; i <= QUEUE_CAPACITY; i++) {
+        assert_rejected(peers[i]);
+    }
+    assert_waiting(peers[0]);  // The one being served is untouched
+
+    // A fresh connection queues behind the worker and survives an expiry
+    ASSERT_EQ(submit(), ERR_SUCCESS);
+    ss_worker_pool_expire();
+    ASSERT_EQ(stats().queue_depth, 1);
+    assert_waiting(peers[submitted - 1]);
+}
+
+/* === Statistics === */
+
+TEST(counters_add_up_once_drained) {
+    pthread_mutex_lock(&gate_lock);
+    gate_open = 1;
+    pthread_cond_broadcast(&gate_cond);
+    pthread_mutex_unlock(&gate_lock);
+
+    WorkerPoolStats s;
+    for (int i = 0; i < 200; i++) {
+        s = stats();
+        if (s.busy == 0 && s.queue_depth == 0) break;
+        usleep(10000);
+    }
+    ASSERT_EQ(s.busy, 0);
+    ASSERT_EQ(s.queue_depth, 0);
+
+    // Every connection offered was admitted or rejected; every admitted one
+    // got a worker or expired
+    ASSERT_EQ(s.admitted + s.rejected, submitted);
+    ASSERT_EQ(s.admitted, handled + s.expired);
+    ASSERT_EQ(handled, 2);
+    ASSERT_EQ(s.rejected, 1);
+    ASSERT_EQ(s.expired, QUEUE_CAPACITY);
+    assert(s.max_wait_ms < SS_QUEUE_MAX_WAIT_MS);  // Expired waits do not count
+
+    for (int i = 0; i < submitted; i++) {
+        close(peers[i]);
+    }
+}
+
+int main(void) {
+    printf("\n=== Worker Pool Tests ===\n\n");
+
+    assert(ss_worker_pool_start(1, QUEUE_CAPACITY) == ERR_SUCCESS);
+
+    printf("Admission:\n");
+    RUN_TEST(full_queue_rejects_busy_in_v1);
+
+    printf("\nExpiry:\n");
+    RUN_TEST(expire_drops_only_entries_past_max_wait);
+
+    printf("\nStatistics:\n");
+    RUN_TEST(counters_add_up_once_drained);
+
+    printf("\n=== All worker pool tests passed! ===\n\n");
+    return 0;
+}